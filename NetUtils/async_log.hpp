@@ -0,0 +1,552 @@
+/**
+ * @file async_log.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 受信/acceptループ用の非同期バイナリログ (printfを呼ばない)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * printfは書式化・stdoutのロック・write(2)をその場で行うので, パケット毎に呼ぶとI/Oより高くつく.
+ * + 呼び出し側は固定長のレコード(呼び出し箇所へのポインタ = 書式ID, 時刻, 引数の値)をスレッド毎の
+ *   SpscRing(lockfree_ring.hpp)に積むだけ. 文字列引数はレコード内にコピーする(最大kLogTextBytes, 超えた分は切る).
+ * + 書式化と書き出しはバックグラウンドの1スレッドがまとめて行う(stdoutへfwrite + fflush. 空なら1ms眠る).
+ * + レベルはコンパイル時に捨てる: IS_NET_LOG_LEVEL未満のIS_LOG_*は何も生成しない(既定: info).
+ * + 呼び出し箇所毎の上限(IS_LOG_RATE, 件/秒). 超えた分は数え, 次に出たレコードに"(suppressed N)"を付ける.
+ * + リングが満杯なら待たずに捨て, 捨てた数を書き出しスレッドが報告する.
+ *
+ * 書式はprintfと同じ(%d %u %x %s %f %p %c, 幅・精度・'*'). 長さ修飾子(l, ll, z)は無視して値の型で出す.
+ * 書式と引数はprintfの警告(-Wformat)で検査される. 引数は整数, 浮動小数点, const char *, ポインタ.
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <NetUtils/lockfree_ring.hpp>
+
+#ifndef IS_NET_LOG_LEVEL
+#define IS_NET_LOG_LEVEL 2 // 0: trace, 1: debug, 2: info, 3: warn, 4: error
+#endif
+
+namespace is
+{
+namespace net
+{
+    enum LogLevel : int
+    {
+        kLogTrace = 0,
+        kLogDebug = 1,
+        kLogInfo = 2,
+        kLogWarn = 3,
+        kLogError = 4,
+    };
+
+    constexpr size_t kLogMaxArgs = 8;
+    constexpr size_t kLogTextBytes = 128; // 文字列引数の合計
+    constexpr size_t kLogRingRecords = 4096; // スレッド毎
+
+    // 呼び出し箇所 (マクロ内のstatic変数. アドレスが書式ID)
+    struct LogSite
+    {
+        const char *mFormat;
+        const char *mFile;
+        int mLine;
+        int mLevel;
+        uint32_t mPerSecond; // 0: 無制限
+        std::atomic<uint64_t> mWindowNs{0};
+        std::atomic<uint32_t> mCount{0};
+        std::atomic<uint64_t> mSuppressed{0};
+    };
+
+    enum LogArgType : uint8_t
+    {
+        kLogArgSigned,
+        kLogArgUnsigned,
+        kLogArgDouble,
+        kLogArgString, // 値 = (オフセット << 8) | 長さ
+        kLogArgPointer,
+    };
+
+    struct LogRecord
+    {
+        const LogSite *mSite = nullptr;
+        uint64_t mTimeNs = 0;
+        uint64_t mSuppressed = 0;
+        uint32_t mThread = 0;
+        uint8_t mCount = 0;
+        uint8_t mTextUsed = 0;
+        uint8_t mTypes[kLogMaxArgs];
+        uint64_t mArgs[kLogMaxArgs];
+        char mText[kLogTextBytes];
+    };
+
+    inline uint64_t LogClockNs()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    /////////////////////////////////////////////////////////////
+    // 引数の詰め込み
+    /////////////////////////////////////////////////////////////
+    inline void LogEncodeString(LogRecord &record, const char *text)
+    {
+        if (text == nullptr)
+        {
+            text = "(null)";
+        }
+        size_t room = kLogTextBytes - record.mTextUsed;
+        size_t length = strnlen(text, room);
+        std::memcpy(record.mText + record.mTextUsed, text, length);
+        record.mTypes[record.mCount] = kLogArgString;
+        record.mArgs[record.mCount] = ((uint64_t)record.mTextUsed << 8) | length;
+        record.mTextUsed = (uint8_t)(record.mTextUsed + length);
+        ++record.mCount;
+    }
+
+    inline void LogEncode(LogRecord &record, const char *text) { LogEncodeString(record, text); }
+    inline void LogEncode(LogRecord &record, char *text) { LogEncodeString(record, text); }
+
+    template <typename T>
+    inline void LogEncode(LogRecord &record, const T &value)
+    {
+        uint8_t &type = record.mTypes[record.mCount];
+        uint64_t &slot = record.mArgs[record.mCount];
+        if constexpr (std::is_enum<T>::value || (std::is_integral<T>::value && std::is_signed<T>::value))
+        {
+            type = kLogArgSigned;
+            slot = (uint64_t)(int64_t)value;
+        }
+        else if constexpr (std::is_integral<T>::value)
+        {
+            type = kLogArgUnsigned;
+            slot = (uint64_t)value;
+        }
+        else if constexpr (std::is_floating_point<T>::value)
+        {
+            type = kLogArgDouble;
+            double d = (double)value;
+            std::memcpy(&slot, &d, sizeof(d));
+        }
+        else if constexpr (std::is_pointer<T>::value)
+        {
+            type = kLogArgPointer;
+            slot = (uint64_t)(uintptr_t)value;
+        }
+        else
+        {
+            static_assert(std::is_pointer<T>::value, "log argument must be integer, floating point, const char * or pointer");
+        }
+        ++record.mCount;
+    }
+
+    /////////////////////////////////////////////////////////////
+    // 書式化 (書き出しスレッド)
+    /////////////////////////////////////////////////////////////
+    inline void FormatLogRecord(const LogRecord &record, std::string &out)
+    {
+        const char *p = record.mSite->mFormat;
+        size_t next = 0;
+        auto take_int = [&]() -> long long {
+            return next < record.mCount ? (long long)record.mArgs[next++] : 0;
+        };
+        char spec[32];
+        char piece[512];
+        while (*p != '\0')
+        {
+            if (*p != '%')
+            {
+                const char *literal = p;
+                while (*p != '\0' && *p != '%')
+                {
+                    ++p;
+                }
+                out.append(literal, (size_t)(p - literal));
+                continue;
+            }
+            if (p[1] == '%')
+            {
+                out.push_back('%');
+                p += 2;
+                continue;
+            }
+
+            // %[flags][width][.precision][length]conversion
+            size_t n = 0;
+            spec[n++] = *p++;
+            while (*p != '\0' && std::strchr("-+ #0", *p) != nullptr && n < 8)
+            {
+                spec[n++] = *p++;
+            }
+            if (*p == '*')
+            {
+                n += (size_t)std::snprintf(spec + n, sizeof(spec) - n, "%d", (int)take_int());
+                ++p;
+            }
+            while (*p >= '0' && *p <= '9' && n < 16)
+            {
+                spec[n++] = *p++;
+            }
+            if (*p == '.')
+            {
+                spec[n++] = *p++;
+                if (*p == '*')
+                {
+                    n += (size_t)std::snprintf(spec + n, sizeof(spec) - n, "%d", (int)take_int());
+                    ++p;
+                }
+                while (*p >= '0' && *p <= '9' && n < 24)
+                {
+                    spec[n++] = *p++;
+                }
+            }
+            while (*p != '\0' && std::strchr("hlLqjzt", *p) != nullptr)
+            {
+                ++p;
+            }
+            char conversion = *p;
+            if (conversion == '\0')
+            {
+                break;
+            }
+            ++p;
+
+            if (next >= record.mCount)
+            {
+                out.append("<?>");
+                continue;
+            }
+            uint8_t type = record.mTypes[next];
+            uint64_t value = record.mArgs[next++];
+            double d = 0.0;
+            if (type == kLogArgDouble)
+            {
+                std::memcpy(&d, &value, sizeof(d));
+            }
+            int written = 0;
+            switch (conversion)
+            {
+            case 'd':
+            case 'i':
+                spec[n++] = 'l';
+                spec[n++] = 'l';
+                spec[n++] = 'd';
+                spec[n] = '\0';
+                written = std::snprintf(piece, sizeof(piece), spec, type == kLogArgDouble ? (long long)d : (long long)value);
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                spec[n++] = 'l';
+                spec[n++] = 'l';
+                spec[n++] = conversion;
+                spec[n] = '\0';
+                written = std::snprintf(piece, sizeof(piece), spec, type == kLogArgDouble ? (unsigned long long)d : (unsigned long long)value);
+                break;
+            case 'c':
+                spec[n++] = 'c';
+                spec[n] = '\0';
+                written = std::snprintf(piece, sizeof(piece), spec, (int)value);
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                spec[n++] = conversion;
+                spec[n] = '\0';
+                written = std::snprintf(piece, sizeof(piece), spec,
+                                        type == kLogArgDouble ? d : type == kLogArgSigned ? (double)(int64_t)value : (double)value);
+                break;
+            case 's':
+            {
+                std::string text = type == kLogArgString
+                                       ? std::string(record.mText + (value >> 8), (size_t)(value & 0xFF))
+                                       : std::string("<?>");
+                spec[n++] = 's';
+                spec[n] = '\0';
+                written = std::snprintf(piece, sizeof(piece), spec, text.c_str());
+                break;
+            }
+            case 'p':
+                spec[n++] = 'p';
+                spec[n] = '\0';
+                written = std::snprintf(piece, sizeof(piece), spec, (void *)(uintptr_t)value);
+                break;
+            default:
+                written = std::snprintf(piece, sizeof(piece), "<%%%c?>", conversion);
+                break;
+            }
+            if (written > 0)
+            {
+                out.append(piece, std::min((size_t)written, sizeof(piece) - 1));
+            }
+        }
+    }
+
+    /////////////////////////////////////////////////////////////
+    // ロガー
+    /////////////////////////////////////////////////////////////
+    // スレッド毎のリング. スレッドが終わってもリングが空になるまでロガーが持つ.
+    struct LogProducer
+    {
+        explicit LogProducer(uint32_t thread) : mRing(kLogRingRecords), mThread(thread) {}
+        SpscRing<LogRecord> mRing;
+        std::atomic<uint64_t> mDropped{0};
+        uint64_t mReportedDrops = 0; // 書き出しスレッドだけが触る
+        uint32_t mThread;
+    };
+
+    class AsyncLogger
+    {
+    public:
+        static AsyncLogger &instance()
+        {
+            static AsyncLogger logger;
+            return logger;
+        }
+
+        AsyncLogger(const AsyncLogger &) = delete;
+        AsyncLogger &operator=(const AsyncLogger &) = delete;
+        ~AsyncLogger() { stop(); }
+
+        // 呼び出したスレッドのリング (初回に登録)
+        LogProducer &local()
+        {
+            thread_local std::shared_ptr<LogProducer> producer = registerThread();
+            return *producer;
+        }
+
+        uint64_t startNs() const { return mStartNs; }
+
+        // ここまでに積んだレコードが書き出されるまで待つ (mainの最後やprintfと順序を揃えたいとき)
+        void flush()
+        {
+            uint64_t target = mPasses.load(std::memory_order_acquire) + 2;
+            while (mRunning.load(std::memory_order_acquire) && mPasses.load(std::memory_order_acquire) < target)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+
+        // 残りを書き出して止める. 以後のレコードは捨てられる.
+        void stop()
+        {
+            if (mRunning.exchange(false))
+            {
+                mWriter.join();
+            }
+        }
+
+        uint64_t dropped()
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            uint64_t total = 0;
+            for (const auto &producer : mProducers)
+            {
+                total += producer->mDropped.load(std::memory_order_relaxed);
+            }
+            return total + mRetiredDrops;
+        }
+
+    private:
+        AsyncLogger() : mStartNs(LogClockNs())
+        {
+            mWriter = std::thread([this]() { run(); });
+        }
+
+        std::shared_ptr<LogProducer> registerThread()
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto producer = std::make_shared<LogProducer>(mNextThread++);
+            mProducers.push_back(producer);
+            return producer;
+        }
+
+        void run()
+        {
+            std::string out;
+            out.reserve(1 << 16);
+            while (true)
+            {
+                bool running = mRunning.load(std::memory_order_acquire);
+                drain(out);
+                bool busy = !out.empty();
+                if (busy)
+                {
+                    std::fwrite(out.data(), 1, out.size(), stdout);
+                    std::fflush(stdout);
+                    out.clear();
+                }
+                mPasses.fetch_add(1, std::memory_order_release);
+                if (!running)
+                {
+                    break; // 止める前に最後の1周を済ませた
+                }
+                // 書くものがあった間は眠らずに次の周へ (バースト中にリングが溢れないように)
+                if (busy)
+                {
+                    std::this_thread::yield();
+                }
+                else
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+        }
+
+        void drain(std::string &out)
+        {
+            std::vector<std::shared_ptr<LogProducer>> producers;
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                producers = mProducers;
+            }
+            LogRecord record;
+            char prefix[64];
+            for (const auto &producer : producers)
+            {
+                while (producer->mRing.tryPop(record))
+                {
+                    static const char kLetters[] = "TDIWE";
+                    uint64_t elapsed = record.mTimeNs - mStartNs;
+                    int n = std::snprintf(prefix, sizeof(prefix), "[%5llu.%06llu %c t%u] ",
+                                          (unsigned long long)(elapsed / 1000000000ull),
+                                          (unsigned long long)(elapsed % 1000000000ull / 1000ull),
+                                          kLetters[std::min(std::max(record.mSite->mLevel, 0), 4)],
+                                          record.mThread);
+                    out.append(prefix, (size_t)n);
+                    FormatLogRecord(record, out);
+                    if (record.mSuppressed != 0)
+                    {
+                        n = std::snprintf(prefix, sizeof(prefix), " (suppressed %llu)", (unsigned long long)record.mSuppressed);
+                        out.append(prefix, (size_t)n);
+                    }
+                    out.push_back('\n');
+                }
+                uint64_t drops = producer->mDropped.load(std::memory_order_relaxed);
+                if (drops != producer->mReportedDrops)
+                {
+                    int n = std::snprintf(prefix, sizeof(prefix), "[Warning] log: %llu records dropped (t%u)\n",
+                                          (unsigned long long)(drops - producer->mReportedDrops), producer->mThread);
+                    out.append(prefix, (size_t)n);
+                    producer->mReportedDrops = drops;
+                }
+            }
+
+            // 終わったスレッドのリングを片付ける (空で, ロガー以外が持っていない)
+            std::lock_guard<std::mutex> lock(mMutex);
+            producers.clear();
+            for (size_t i = 0; i < mProducers.size();)
+            {
+                if (mProducers[i].use_count() == 1 && mProducers[i]->mRing.sizeApprox() == 0)
+                {
+                    mRetiredDrops += mProducers[i]->mDropped.load(std::memory_order_relaxed);
+                    mProducers[i] = std::move(mProducers.back());
+                    mProducers.pop_back();
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+        }
+
+        const uint64_t mStartNs;
+        std::mutex mMutex; // mProducersの登録と片付けだけ
+        std::vector<std::shared_ptr<LogProducer>> mProducers;
+        uint32_t mNextThread = 0;
+        uint64_t mRetiredDrops = 0;
+        std::atomic<bool> mRunning{true};
+        std::atomic<uint64_t> mPasses{0};
+        std::thread mWriter;
+    };
+
+    // 呼び出し箇所毎の件/秒の上限
+    inline bool LogAdmit(LogSite &site, uint64_t now_ns)
+    {
+        if (site.mPerSecond == 0)
+        {
+            return true;
+        }
+        uint64_t window = site.mWindowNs.load(std::memory_order_relaxed);
+        if (now_ns - window >= 1000000000ull && site.mWindowNs.compare_exchange_strong(window, now_ns))
+        {
+            site.mCount.store(0, std::memory_order_relaxed);
+        }
+        if (site.mCount.fetch_add(1, std::memory_order_relaxed) < site.mPerSecond)
+        {
+            return true;
+        }
+        site.mSuppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    template <typename... Args>
+    inline void LogWrite(LogSite &site, const Args &... args)
+    {
+        static_assert(sizeof...(Args) <= kLogMaxArgs, "too many log arguments");
+        LogProducer &producer = AsyncLogger::instance().local(); // 初回はここでロガーの時刻の基準が決まる
+        uint64_t now = LogClockNs();
+        if (!LogAdmit(site, now))
+        {
+            return;
+        }
+        LogRecord record;
+        record.mSite = &site;
+        record.mTimeNs = now;
+        if (site.mPerSecond != 0)
+        {
+            record.mSuppressed = site.mSuppressed.exchange(0, std::memory_order_relaxed);
+        }
+        (LogEncode(record, args), ...);
+
+        record.mThread = producer.mThread;
+        if (!producer.mRing.tryPush(record))
+        {
+            producer.mDropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // -Wformatで書式と引数を検査するためだけの宣言 (呼ばれない)
+    inline void LogCheckFormat(const char *, ...) __attribute__((format(printf, 1, 2)));
+    inline void LogCheckFormat(const char *, ...) {}
+} // namespace net
+} // namespace is
+
+// level未満はコンパイル時に消える. per_secondは呼び出し箇所毎の上限(0: 無制限).
+#define IS_LOG_RATE(level, per_second, format, ...)                                                           \
+    do                                                                                                        \
+    {                                                                                                         \
+        if constexpr ((level) >= IS_NET_LOG_LEVEL)                                                            \
+        {                                                                                                     \
+            static ::is::net::LogSite is_log_site{(format), __FILE__, __LINE__, (level), (per_second)};      \
+            ::is::net::LogWrite(is_log_site, ##__VA_ARGS__);                                                  \
+            if (false)                                                                                        \
+            {                                                                                                 \
+                ::is::net::LogCheckFormat((format), ##__VA_ARGS__);                                           \
+            }                                                                                                 \
+        }                                                                                                     \
+    } while (0)
+
+#define IS_LOG_TRACE(format, ...) IS_LOG_RATE(::is::net::kLogTrace, 0, format, ##__VA_ARGS__)
+#define IS_LOG_DEBUG(format, ...) IS_LOG_RATE(::is::net::kLogDebug, 0, format, ##__VA_ARGS__)
+#define IS_LOG_INFO(format, ...) IS_LOG_RATE(::is::net::kLogInfo, 0, format, ##__VA_ARGS__)
+#define IS_LOG_WARN(format, ...) IS_LOG_RATE(::is::net::kLogWarn, 0, format, ##__VA_ARGS__)
+#define IS_LOG_ERROR(format, ...) IS_LOG_RATE(::is::net::kLogError, 0, format, ##__VA_ARGS__)
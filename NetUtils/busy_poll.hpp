@@ -0,0 +1,270 @@
+/**
+ * @file busy_poll.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 低遅延受信 (SO_BUSY_POLL, ユーザ空間のスピン, 隔離コアへの固定) Linux専用
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * ブロッキング受信では, パケット到着 -> 割り込み -> softirq -> スレッドの起床 の各段で数十usずつ待つ.
+ * + SO_BUSY_POLL / SO_PREFER_BUSY_POLL / SO_BUSY_POLL_BUDGET: 受信キューが空のとき, カーネルが
+ *   ドライバのNAPIを直接ポーリングする(割り込みを待たない). NAPIの無いデバイス(lo, veth)では効かない.
+ *   net.core.busy_read より大きな値を付けるにはCAP_NET_ADMINが要る.
+ * + BusyPollReceiver: recvmsg(MSG_DONTWAIT)をmSpinNsの間回し, 来なければepoll_waitで眠る.
+ *   間隔の詰まったフィードでは起床待ちが消え, 途切れたときだけ眠るのでCPUを使い切らない.
+ * + PinThreadToCpu / FirstIsolatedCpu: スピンするスレッドを隔離コア(isolcpus=, nohz_full=)に固定し,
+ *   他のタスクや割り込みに横取りされないようにする.
+ *
+ * CPUが1つしか無いと, スピンは相手(送信側やsoftirq)の時間を奪うだけになる. 固定するコアは受信専用にすること.
+ * コアを分け合うしかないときはmYieldでスピンの合間に譲る(起床待ちは消えるが, 他のタスクが居るとその分遅れる).
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <NetUtils/pacing.hpp> // MonotonicNs, CpuRelax
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69 // Linux 5.11
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70 // Linux 5.11
+#endif
+
+namespace is
+{
+namespace net
+{
+    struct BusyPollOptions
+    {
+        uint32_t mBusyPollUs = 50; // SO_BUSY_POLL (0: 付けない)
+        uint32_t mBudget = 8;      // SO_BUSY_POLL_BUDGET 1回のポーリングで処理するパケット数 (0: 既定)
+        bool mPrefer = true;       // SO_PREFER_BUSY_POLL 割り込みよりビジーポーリングを優先
+        uint64_t mSpinNs = 50000;  // ユーザ空間でスピンする時間 (0: すぐ眠る)
+        bool mYield = false;       // スピンの合間にsched_yield (送信側と同じコアを分け合うとき)
+    };
+
+    /**
+     * @brief SO_BUSY_POLL系のオプションを付ける. 失敗しても残りは試す.
+     * @return 0: 全て成功, -1: 最初に失敗したもののerrno
+     */
+    inline int EnableBusyPoll(int sock, const BusyPollOptions &options)
+    {
+        int result = 0;
+        int saved = 0;
+        auto apply = [&](int name, int value) {
+            if (setsockopt(sock, SOL_SOCKET, name, &value, sizeof(value)) != 0 && result == 0)
+            {
+                result = -1;
+                saved = errno;
+            }
+        };
+        if (options.mBusyPollUs > 0)
+        {
+            apply(SO_BUSY_POLL, (int)options.mBusyPollUs);
+            if (options.mPrefer)
+            {
+                apply(SO_PREFER_BUSY_POLL, 1);
+            }
+            if (options.mBudget > 0)
+            {
+                apply(SO_BUSY_POLL_BUDGET, (int)options.mBudget);
+            }
+        }
+        errno = saved;
+        return result;
+    }
+
+    // 呼び出したスレッドをcpuに固定する
+    inline int PinThreadToCpu(int cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (error != 0)
+        {
+            errno = error;
+            return -1;
+        }
+        return 0;
+    }
+
+    // isolcpus=で隔離されたCPUの先頭 (無ければ-1). 書式は"2-3,6"
+    inline int FirstIsolatedCpu()
+    {
+        FILE *file = std::fopen("/sys/devices/system/cpu/isolated", "r");
+        if (file == nullptr)
+        {
+            return -1;
+        }
+        int cpu = -1;
+        if (std::fscanf(file, "%d", &cpu) != 1)
+        {
+            cpu = -1;
+        }
+        std::fclose(file);
+        return cpu;
+    }
+
+    // "auto": 隔離コア(無ければ-1), それ以外は番号
+    inline int ParseCpu(const char *text)
+    {
+        return std::strcmp(text, "auto") == 0 ? FirstIsolatedCpu() : std::atoi(text);
+    }
+
+    struct BusyPollStats
+    {
+        uint64_t mReceived = 0;  // 受け取った数
+        uint64_t mSpinHits = 0;  // スピン中(起床無し)に受け取った数
+        uint64_t mSleeps = 0;    // スピン予算を使い切ってepollで眠った回数
+        uint64_t mSpinNs = 0;    // スピンに使った時間の合計
+    };
+
+    /**
+     * @brief 1つのソケットをスピン -> epollの順で待って読む. スレッドセーフではない.
+     * UDPでもTCP(接続済み)でもよい. ソケット自体はブロッキングのままでよい(MSG_DONTWAITで読む).
+     */
+    class BusyPollReceiver
+    {
+    public:
+        BusyPollReceiver(int sock, const BusyPollOptions &options)
+            : mSocket(sock), mOptions(options), mEpoll(epoll_create1(EPOLL_CLOEXEC))
+        {
+            if (mEpoll < 0)
+            {
+                throw std::runtime_error("BusyPollReceiver: epoll_create1");
+            }
+            struct epoll_event event;
+            std::memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN;
+            event.data.fd = sock;
+            if (epoll_ctl(mEpoll, EPOLL_CTL_ADD, sock, &event) != 0)
+            {
+                close(mEpoll);
+                throw std::runtime_error("BusyPollReceiver: epoll_ctl");
+            }
+        }
+        ~BusyPollReceiver() { close(mEpoll); }
+        BusyPollReceiver(const BusyPollReceiver &) = delete;
+        BusyPollReceiver &operator=(const BusyPollReceiver &) = delete;
+
+        const BusyPollStats &stats() const { return mStats; }
+        const BusyPollOptions &options() const { return mOptions; }
+
+        /**
+         * @brief recvmsgと同じ. timeout_ms(-1: 無限)までに来なければ-1 (errno=EAGAIN).
+         */
+        ssize_t recvmsg(struct msghdr *msg, int flags, int timeout_ms)
+        {
+            // 失敗したrecvmsgが書き換えても次の試行に響かないように
+            socklen_t name_length = msg->msg_namelen;
+            size_t control_length = msg->msg_controllen;
+            uint64_t spin_start = 0;
+            while (true)
+            {
+                msg->msg_namelen = name_length;
+                msg->msg_controllen = control_length;
+                ssize_t n = ::recvmsg(mSocket, msg, flags | MSG_DONTWAIT);
+                if (n >= 0)
+                {
+                    ++mStats.mReceived;
+                    if (spin_start != 0)
+                    {
+                        ++mStats.mSpinHits;
+                        mStats.mSpinNs += MonotonicNs() - spin_start;
+                    }
+                    return n;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    return -1;
+                }
+
+                if (mOptions.mSpinNs > 0)
+                {
+                    uint64_t now = MonotonicNs();
+                    if (spin_start == 0)
+                    {
+                        spin_start = now;
+                    }
+                    if (now - spin_start < mOptions.mSpinNs)
+                    {
+                        if (mOptions.mYield)
+                        {
+                            sched_yield();
+                        }
+                        else
+                        {
+                            CpuRelax();
+                        }
+                        continue;
+                    }
+                    mStats.mSpinNs += now - spin_start;
+                }
+
+                // 予算切れ: 起床を待つ
+                ++mStats.mSleeps;
+                struct epoll_event event;
+                int ready = epoll_wait(mEpoll, &event, 1, timeout_ms);
+                if (ready == 0)
+                {
+                    errno = EAGAIN;
+                    return -1;
+                }
+                if (ready < 0 && errno != EINTR)
+                {
+                    return -1;
+                }
+                spin_start = 0; // 起きた後に空振りしたらもう一度スピンから
+            }
+        }
+
+        ssize_t recvfrom(void *buf, size_t length, int flags, struct sockaddr *from, socklen_t *from_length, int timeout_ms)
+        {
+            struct iovec iov;
+            iov.iov_base = buf;
+            iov.iov_len = length;
+            struct msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_name = from;
+            msg.msg_namelen = from_length != nullptr ? *from_length : 0;
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            ssize_t n = recvmsg(&msg, flags, timeout_ms);
+            if (n >= 0 && from_length != nullptr)
+            {
+                *from_length = msg.msg_namelen;
+            }
+            return n;
+        }
+
+        ssize_t recv(void *buf, size_t length, int flags, int timeout_ms)
+        {
+            return recvfrom(buf, length, flags, nullptr, nullptr, timeout_ms);
+        }
+
+    private:
+        int mSocket;
+        BusyPollOptions mOptions;
+        int mEpoll;
+        BusyPollStats mStats;
+    };
+} // namespace net
+} // namespace is
@@ -0,0 +1,416 @@
+/**
+ * @file congestion_control.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 差し替え可能な輻輳制御 (NewReno, BBR風のモデル)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * トランスポート(reliable_udp.hpp)はACK毎に`CongestionAck`を渡し, 損失を見つけたら
+ * `onCongestionEvent()`(1往復に1回), 再送タイムアウトで`onRetransmissionTimeout()`を呼ぶ.
+ * 制御側は送ってよいバイト数(`cwnd()`)と送出レート(`pacingRate()`, 0でペーシングなし)を返すだけ.
+ *
+ * + NewReno (RFC 5681/6582): スロースタートと輻輳回避. 損失でcwndを半分にする.
+ *   ACKの固まりでバーストしないよう, Linuxと同じくcwnd/srttの2倍(スロースタート)/1.2倍でペーシングする.
+ * + BBR風 (BBRv1の簡略版): 配送レートの最大値(直近10往復)と最小RTT(10秒)から帯域遅延積を見積もり,
+ *   その倍率でcwndとペーシングレートを決める. 損失には反応しない(モデルで制御する).
+ *   Startup -> Drain -> ProbeBW(1.25, 0.75, 1 x 6 の周期) と, 10秒毎のProbeRTT(cwnd 4セグメント)を持つ.
+ *
+ * 単位はバイトとナノ秒. スレッドセーフではない(接続毎に1つ持つ).
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace is
+{
+namespace net
+{
+    // ACK 1回分の情報
+    struct CongestionAck
+    {
+        uint64_t mNowNs = 0;
+        uint64_t mAckedBytes = 0;     // 今回新たに届いた(累積ACK + SACK)バイト数
+        uint64_t mInflightBytes = 0;  // 処理後の飛行中バイト数
+        uint64_t mRttNs = 0;          // RTTの標本 (0: なし)
+        uint64_t mDeliveryRate = 0;   // 配送レートの標本 bytes/s (0: なし)
+        bool mAppLimited = false;     // 標本がアプリの送信不足で低く出ている
+        uint64_t mDelivered = 0;      // 接続の累計配送バイト数
+        uint64_t mPriorDelivered = 0; // 標本のパケットを送った時点の累計配送バイト数 (往復の区切り)
+    };
+
+    class CongestionControl
+    {
+    public:
+        virtual ~CongestionControl() = default;
+
+        virtual const char *name() const = 0;
+        virtual void onAck(const CongestionAck &ack) = 0;
+        // 損失を見つけた (回復中は呼ばれない). inflight_bytesは損失を除く前の飛行中バイト数.
+        virtual void onCongestionEvent(uint64_t now_ns, uint64_t inflight_bytes) = 0;
+        virtual void onRetransmissionTimeout() = 0;
+        virtual uint64_t cwnd() const = 0;
+        virtual uint64_t pacingRate() const = 0; // bytes/s (0: ペーシングしない)
+    };
+
+    /////////////////////////////////////////////////////////////
+    // NewReno
+    /////////////////////////////////////////////////////////////
+    class NewReno : public CongestionControl
+    {
+    public:
+        explicit NewReno(size_t mss, size_t initial_segments = 10)
+            : mMss(mss), mCwnd(mss * initial_segments), mSsthresh(UINT64_MAX) {}
+
+        const char *name() const override { return "newreno"; }
+
+        void onAck(const CongestionAck &ack) override
+        {
+            if (ack.mRttNs != 0)
+            {
+                mSrttNs = mSrttNs ? (mSrttNs * 7 + ack.mRttNs) / 8 : ack.mRttNs;
+            }
+            if (ack.mAppLimited)
+            {
+                return; // 使い切っていないcwndは増やさない (RFC 7661)
+            }
+            if (mCwnd < mSsthresh)
+            {
+                mCwnd += ack.mAckedBytes; // スロースタート
+                return;
+            }
+            // 輻輳回避: 1往復でMSS 1個分
+            mAccumulated += ack.mAckedBytes;
+            if (mAccumulated >= mCwnd)
+            {
+                mAccumulated -= mCwnd;
+                mCwnd += mMss;
+            }
+        }
+
+        void onCongestionEvent(uint64_t now_ns, uint64_t inflight_bytes) override
+        {
+            (void)now_ns;
+            mSsthresh = std::max<uint64_t>(inflight_bytes / 2, 2 * mMss);
+            mCwnd = mSsthresh;
+            mAccumulated = 0;
+        }
+
+        void onRetransmissionTimeout() override
+        {
+            mSsthresh = std::max<uint64_t>(mCwnd / 2, 2 * mMss);
+            mCwnd = mMss;
+            mAccumulated = 0;
+        }
+
+        uint64_t cwnd() const override { return mCwnd; }
+
+        uint64_t pacingRate() const override
+        {
+            if (mSrttNs == 0)
+            {
+                return 0;
+            }
+            uint64_t percent = mCwnd < mSsthresh ? 200 : 120;
+            return (uint64_t)((double)mCwnd * 1e9 / (double)mSrttNs) * percent / 100;
+        }
+
+    private:
+        size_t mMss;
+        uint64_t mCwnd;
+        uint64_t mSsthresh;
+        uint64_t mAccumulated = 0;
+        uint64_t mSrttNs = 0;
+    };
+
+    /////////////////////////////////////////////////////////////
+    // BBR風
+    /////////////////////////////////////////////////////////////
+    class BbrLike : public CongestionControl
+    {
+    public:
+        explicit BbrLike(size_t mss, size_t initial_segments = 10)
+            : mMss(mss), mInitialCwnd(mss * initial_segments) {}
+
+        const char *name() const override { return "bbr"; }
+
+        void onAck(const CongestionAck &ack) override
+        {
+            // 往復の区切り: 今回のパケットが前の区切りの後に送られていれば1往復進んだ
+            mRoundStart = false;
+            if (ack.mPriorDelivered >= mNextRoundDelivered)
+            {
+                mNextRoundDelivered = ack.mDelivered;
+                ++mRound;
+                mRoundStart = true;
+            }
+
+            // ボトルネック帯域: 往復毎の最大値をkBwRounds往復分持つ. アプリ律速の標本は現在値を超える時だけ使う.
+            if (ack.mDeliveryRate != 0 && (!ack.mAppLimited || ack.mDeliveryRate >= bottleneckBandwidth()))
+            {
+                BwSlot &slot = mBw[mRound % kBwRounds];
+                if (slot.mRound != mRound)
+                {
+                    slot.mRound = mRound;
+                    slot.mRate = 0;
+                }
+                slot.mRate = std::max(slot.mRate, ack.mDeliveryRate);
+            }
+
+            // 最小RTT (kMinRttWindowNsで期限切れ)
+            bool min_rtt_expired = mMinRttNs != 0 && ack.mNowNs > mMinRttStampNs + kMinRttWindowNs;
+            if (ack.mRttNs != 0 && (mMinRttNs == 0 || ack.mRttNs <= mMinRttNs || min_rtt_expired))
+            {
+                mMinRttNs = ack.mRttNs;
+                mMinRttStampNs = ack.mNowNs;
+            }
+
+            switch (mMode)
+            {
+            case kStartup:
+                checkFullPipe(ack);
+                break;
+            case kDrain:
+                if (ack.mInflightBytes <= bdp(100))
+                {
+                    enterProbeBw(ack.mNowNs);
+                }
+                break;
+            case kProbeBw:
+                advanceCycle(ack);
+                break;
+            case kProbeRtt:
+                break;
+            }
+
+            if (min_rtt_expired && mMode != kProbeRtt)
+            {
+                mMode = kProbeRtt;
+                mProbeRttDoneNs = 0;
+            }
+            if (mMode == kProbeRtt)
+            {
+                handleProbeRtt(ack);
+            }
+        }
+
+        void onCongestionEvent(uint64_t now_ns, uint64_t inflight_bytes) override
+        {
+            (void)now_ns;
+            (void)inflight_bytes; // BBRv1は損失では下げない
+        }
+
+        void onRetransmissionTimeout() override
+        {
+            // 経路が変わった可能性. モデルは残し, 次の往復から測り直す.
+            mNextRoundDelivered = 0;
+        }
+
+        uint64_t cwnd() const override
+        {
+            if (mMode == kProbeRtt)
+            {
+                return kMinCwndSegments * mMss;
+            }
+            if (bottleneckBandwidth() == 0 || mMinRttNs == 0)
+            {
+                return mInitialCwnd;
+            }
+            // ACKの間引き・集約に備えて数セグメントの余裕を足す
+            return std::max<uint64_t>(bdp(cwndGainPercent()) + 3 * mMss, kMinCwndSegments * mMss);
+        }
+
+        uint64_t pacingRate() const override
+        {
+            uint64_t bw = bottleneckBandwidth();
+            if (bw == 0)
+            {
+                // 初期値: 初期cwndを最小RTT(不明なら1ms)で送るレートのStartup倍
+                uint64_t rtt = mMinRttNs ? mMinRttNs : 1000000;
+                return (uint64_t)((double)mInitialCwnd * 1e9 / (double)rtt) * kHighGainPercent / 100;
+            }
+            return bw * pacingGainPercent() / 100;
+        }
+
+        uint64_t bottleneckBandwidth() const
+        {
+            uint64_t best = 0;
+            for (const BwSlot &slot : mBw)
+            {
+                if (slot.mRound + kBwRounds > mRound)
+                {
+                    best = std::max(best, slot.mRate);
+                }
+            }
+            return best;
+        }
+
+        uint64_t minRttNs() const { return mMinRttNs; }
+
+        const char *modeName() const
+        {
+            static const char *names[] = {"STARTUP", "DRAIN", "PROBE_BW", "PROBE_RTT"};
+            return names[mMode];
+        }
+
+    private:
+        enum Mode
+        {
+            kStartup,
+            kDrain,
+            kProbeBw,
+            kProbeRtt,
+        };
+
+        struct BwSlot
+        {
+            uint64_t mRound = 0;
+            uint64_t mRate = 0;
+        };
+
+        static constexpr uint64_t kBwRounds = 10;
+        static constexpr uint64_t kMinRttWindowNs = 10000000000ull; // 10 s
+        static constexpr uint64_t kProbeRttNs = 200000000ull;       // 200 ms
+        static constexpr uint64_t kHighGainPercent = 289;           // 2/ln2
+        static constexpr uint64_t kMinCwndSegments = 4;
+        static constexpr uint64_t kCycle[8] = {125, 75, 100, 100, 100, 100, 100, 100};
+
+        // 帯域遅延積のgain_percent倍
+        uint64_t bdp(uint64_t gain_percent) const
+        {
+            return (uint64_t)((double)bottleneckBandwidth() * (double)mMinRttNs / 1e9) * gain_percent / 100;
+        }
+
+        uint64_t pacingGainPercent() const
+        {
+            switch (mMode)
+            {
+            case kStartup:
+                return kHighGainPercent;
+            case kDrain:
+                return 100 * 100 / kHighGainPercent;
+            case kProbeBw:
+                return kCycle[mCycleIndex];
+            default:
+                return 100;
+            }
+        }
+
+        uint64_t cwndGainPercent() const { return mMode == kProbeBw ? 200 : kHighGainPercent; }
+
+        // 帯域が3往復続けて25%以上伸びなければパイプは埋まった
+        void checkFullPipe(const CongestionAck &ack)
+        {
+            if (!mRoundStart || ack.mAppLimited)
+            {
+                return;
+            }
+            uint64_t bw = bottleneckBandwidth();
+            if (bw >= mFullBw * 5 / 4)
+            {
+                mFullBw = bw;
+                mFullBwRounds = 0;
+                return;
+            }
+            if (++mFullBwRounds >= 3)
+            {
+                mFilledPipe = true;
+                mMode = kDrain;
+            }
+        }
+
+        void enterProbeBw(uint64_t now_ns)
+        {
+            mMode = kProbeBw;
+            mCycleIndex = 2 + (size_t)(mRound % 6); // 1.25から始めない(ランダムの代わり)
+            mCycleStampNs = now_ns;
+        }
+
+        void advanceCycle(const CongestionAck &ack)
+        {
+            uint64_t gain = kCycle[mCycleIndex];
+            bool elapsed = ack.mNowNs > mCycleStampNs + mMinRttNs;
+            bool next = elapsed;
+            if (gain > 100)
+            {
+                next = elapsed && ack.mInflightBytes >= bdp(gain); // 帯域を押し広げてから
+            }
+            else if (gain < 100)
+            {
+                next = elapsed || ack.mInflightBytes <= bdp(100); // 溜めた分を吐いたら早めに戻る
+            }
+            if (next)
+            {
+                mCycleIndex = (mCycleIndex + 1) % 8;
+                mCycleStampNs = ack.mNowNs;
+            }
+        }
+
+        void handleProbeRtt(const CongestionAck &ack)
+        {
+            if (mProbeRttDoneNs == 0)
+            {
+                if (ack.mInflightBytes <= kMinCwndSegments * mMss)
+                {
+                    mProbeRttDoneNs = ack.mNowNs + kProbeRttNs;
+                    mProbeRttRound = mRound;
+                }
+                return;
+            }
+            if (ack.mNowNs >= mProbeRttDoneNs && mRound > mProbeRttRound)
+            {
+                mMinRttStampNs = ack.mNowNs;
+                if (mFilledPipe)
+                {
+                    enterProbeBw(ack.mNowNs);
+                }
+                else
+                {
+                    mMode = kStartup;
+                }
+            }
+        }
+
+        size_t mMss;
+        uint64_t mInitialCwnd;
+        Mode mMode = kStartup;
+
+        uint64_t mRound = 0;
+        uint64_t mNextRoundDelivered = 0;
+        bool mRoundStart = false;
+        BwSlot mBw[kBwRounds];
+
+        uint64_t mMinRttNs = 0;
+        uint64_t mMinRttStampNs = 0;
+
+        uint64_t mFullBw = 0;
+        uint64_t mFullBwRounds = 0;
+        bool mFilledPipe = false;
+
+        size_t mCycleIndex = 0;
+        uint64_t mCycleStampNs = 0;
+
+        uint64_t mProbeRttDoneNs = 0;
+        uint64_t mProbeRttRound = 0;
+    };
+
+    // 名前から作る ("newreno", "reno", "bbr"). 不明ならnullptr.
+    inline std::unique_ptr<CongestionControl> MakeCongestionControl(const char *name, size_t mss)
+    {
+        if (std::strcmp(name, "newreno") == 0 || std::strcmp(name, "reno") == 0)
+        {
+            return std::unique_ptr<CongestionControl>(new NewReno(mss));
+        }
+        if (std::strcmp(name, "bbr") == 0)
+        {
+            return std::unique_ptr<CongestionControl>(new BbrLike(mss));
+        }
+        return nullptr;
+    }
+} // namespace net
+} // namespace is
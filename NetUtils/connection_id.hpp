@@ -0,0 +1,635 @@
+/**
+ * @file connection_id.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 接続ID(QUIC風)で送信元アドレスが変わっても続くUDPセッションと経路検証
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * 送信元の4-tupleで相手を識別すると, NATの割り当てが変わった(ポートが変わった)時点でセッションを失う.
+ * ここでは各データグラムに64bitの接続IDを載せ, 受信側はIDでセッション表(flat_hash_map.hpp)を引く.
+ *
+ * + クライアントはHELLO(接続IDの位置に乱数)を送り, サーバは未使用のIDを払い出してWELCOMEで返す.
+ *   同じ乱数のHELLO(WELCOMEの損失による再送)には同じIDを返す. セッション数はmax_sessionsまでで,
+ *   溢れるときはDATAがまだ来ていない(HELLOだけの)セッションを古い順に追い出す.
+ * + DATAはIDで届け先のセッションが決まる. 送信元が変わっても捨てない.
+ * + 新しい送信元から(それまでで最大の)パケット番号のDATAが来たら, その経路をPATH_CHALLENGE(8バイトの乱数)
+ *   で確かめ, 同じ値のPATH_RESPONSEが返ってから返信先を切り替える (RFC 9000 9章).
+ *   番号の古いパケット(入れ替わり)では切り替えない. 検証中も返信は元の経路へ送る.
+ * + 未検証の経路へは受け取ったバイト数の3倍までしか送らない(増幅攻撃の防止, RFC 9000 8.1).
+ * + 無通信のセッションと応答の無いチャレンジはtimer_wheel.hppで失効させる(1セッション1エントリ).
+ * + SO_REUSEPORTで複数スレッドに分ける場合, IDの下位32bit % shards をスレッド番号にして払い出し,
+ *   socket_filter.hppのReuseportPayloadWordProgram(kCidSteeringOffset, shards)で振り分ければ, 送信元が変わっても同じスレッドに届く.
+ *
+ * フレーム (20バイトのヘッダ + ペイロード, ネットワークバイトオーダ)
+ *   0: magic "CID1"
+ *   4: type (HELLO, WELCOME, DATA, PATH_CHALLENGE, PATH_RESPONSE, CLOSE)  5: reserved(3)
+ *   8: connection id (64bit. HELLOではクライアントの乱数)
+ *  16: packet number (DATA: 送信順の番号)
+ *  WELCOMEのペイロードはHELLOの乱数, PATH_CHALLENGE/RESPONSEは8バイトの値.
+ *
+ * 暗号化も認証もしない(IDを知っていれば誰でも送れる点は4-tupleと同じ). スレッドセーフではない.
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+
+#include <NetUtils/flat_hash_map.hpp>
+#include <NetUtils/packet_view.hpp>
+#include <NetUtils/timer_wheel.hpp>
+
+namespace is
+{
+namespace net
+{
+    constexpr uint32_t kCidMagic = 0x43494431; // "CID1"
+    constexpr size_t kCidHeaderSize = 20;
+    constexpr size_t kCidTokenSize = 8;
+    constexpr uint32_t kCidSteeringOffset = 12; // 接続IDの下位32bit (SO_REUSEPORTの振り分け用)
+
+    enum CidType : uint8_t
+    {
+        kCidHello = 1,
+        kCidWelcome = 2,
+        kCidData = 3,
+        kCidPathChallenge = 4,
+        kCidPathResponse = 5,
+        kCidClose = 6,
+    };
+
+    struct CidHeader
+    {
+        uint8_t mType = 0;
+        uint64_t mConnectionId = 0;
+        uint32_t mPacketNumber = 0;
+    };
+
+    inline void WriteCidHeader(uint8_t *out, const CidHeader &header)
+    {
+        StoreBe32(out, kCidMagic);
+        out[4] = header.mType;
+        out[5] = out[6] = out[7] = 0;
+        StoreBe32(out + 8, (uint32_t)(header.mConnectionId >> 32));
+        StoreBe32(out + 12, (uint32_t)header.mConnectionId);
+        StoreBe32(out + 16, header.mPacketNumber);
+    }
+
+    inline bool ReadCidHeader(BytesView frame, CidHeader *header)
+    {
+        if (frame.size() < kCidHeaderSize || frame.u32(0) != kCidMagic)
+        {
+            return false;
+        }
+        header->mType = frame.u8(4);
+        header->mConnectionId = ((uint64_t)frame.u32(8) << 32) | frame.u32(12);
+        header->mPacketNumber = frame.u32(16);
+        return true;
+    }
+
+    inline void StoreCidToken(uint8_t *out, uint64_t token)
+    {
+        StoreBe32(out, (uint32_t)(token >> 32));
+        StoreBe32(out + 4, (uint32_t)token);
+    }
+
+    inline uint64_t LoadCidToken(BytesView payload)
+    {
+        return ((uint64_t)payload.u32(0) << 32) | payload.u32(4);
+    }
+
+    // アドレスとポートが同じか
+    inline bool SameEndpoint(const struct sockaddr *a, const struct sockaddr *b)
+    {
+        if (a->sa_family != b->sa_family)
+        {
+            return false;
+        }
+        if (a->sa_family == AF_INET)
+        {
+            const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+            const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+            return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+        }
+        if (a->sa_family == AF_INET6)
+        {
+            const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+            const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+            return a6->sin6_port == b6->sin6_port && std::memcmp(&a6->sin6_addr, &b6->sin6_addr, 16) == 0;
+        }
+        return false;
+    }
+
+    // 周回する32bit番号の比較 (RFC 1982)
+    inline bool CidPacketLess(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+    // 下位ビットにシャード番号が入るので混ぜてから表の位置にする
+    struct CidHash
+    {
+        size_t operator()(uint64_t id) const
+        {
+            id ^= id >> 33;
+            id *= 0xFF51AFD7ED558CCDull; // murmur3 fmix64
+            id ^= id >> 33;
+            return (size_t)id;
+        }
+    };
+
+    /////////////////////////////////////////////////////////////
+    // サーバ側のセッション表
+    /////////////////////////////////////////////////////////////
+    struct CidSession
+    {
+        uint64_t mId = 0;
+        uint64_t mNonce = 0;               // HELLOの乱数 (再送されたHELLOを見分ける)
+        struct sockaddr_storage mPeer;     // 検証済みの経路 (返信先)
+        socklen_t mPeerLength = 0;
+        uint32_t mLargestPacket = 0;
+        bool mAnyPacket = false;
+        uint64_t mLastActiveMs = 0;
+        uint64_t mPackets = 0;
+        uint64_t mBytes = 0;
+        uint32_t mMigrations = 0;
+
+        // 検証中の経路
+        bool mProbing = false;
+        struct sockaddr_storage mCandidate;
+        socklen_t mCandidateLength = 0;
+        uint64_t mChallenge = 0;
+        uint32_t mChallengesSent = 0;
+        uint64_t mChallengeSentMs = 0;
+        uint64_t mCandidateReceived = 0; // 候補の経路から受け取ったバイト数
+        uint64_t mCandidateSent = 0;     // 候補の経路へ送ったバイト数
+
+        uint64_t mTimerMs = 0; // ホイールに積んだ期限 (0: 無し)
+    };
+
+    struct CidSessionOptions
+    {
+        uint64_t mIdleTimeoutMs = 30000;
+        uint64_t mChallengeRetryMs = 250;
+        uint32_t mMaxChallenges = 3;
+        uint32_t mAmplificationFactor = 3; // 未検証の経路へは受け取った量のこの倍まで
+        uint32_t mShard = 0;               // 払い出すIDの下位32bit % mShards == mShard
+        uint32_t mShards = 1;
+        size_t mMaxSessions = 65536;       // 溢れるHELLOはDATAの来ていないセッションを追い出す
+    };
+
+    struct CidSessionStats
+    {
+        uint64_t mCreated = 0;
+        uint64_t mExpired = 0;              // 無通信で消した
+        uint64_t mClosed = 0;               // CLOSEを受けた
+        uint64_t mUnknown = 0;              // 表に無いIDのDATA (CLOSEを返す)
+        uint64_t mChallenges = 0;           // 送ったPATH_CHALLENGE
+        uint64_t mMigrations = 0;           // 検証できて返信先を切り替えた
+        uint64_t mValidationFailures = 0;   // 応答が無く元の経路に留まった
+        uint64_t mAmplificationLimited = 0; // 増幅制限で送れなかったチャレンジ
+        uint64_t mReordered = 0;            // 別経路から来た古い番号のパケット (切り替えない)
+        uint64_t mHelloRepeats = 0;         // 同じ乱数のHELLO (同じIDを返し直した)
+        uint64_t mEvicted = 0;              // 上限で追い出したDATAの来ていないセッション
+        uint64_t mRefused = 0;              // 上限で追い出せるものが無く断ったHELLO
+    };
+
+    class CidSessionTable
+    {
+    public:
+        explicit CidSessionTable(const CidSessionOptions &options = CidSessionOptions(), uint64_t seed = 1, uint64_t now_ms = 0)
+            : mOptions(options), mSessions(1024), mNonces(1024), mTimers(512, now_ms), mRandom(seed ? seed : 1)
+        {
+            if (mOptions.mShards == 0)
+            {
+                mOptions.mShards = 1;
+            }
+            if (mOptions.mMaxSessions == 0)
+            {
+                mOptions.mMaxSessions = 1;
+            }
+        }
+
+        size_t size() const { return mSessions.size(); }
+        const CidSessionStats &stats() const { return mStats; }
+        CidSession *find(uint64_t id) { return mSessions.find(id); }
+
+        /**
+         * @brief 受信したデータグラムを処理する
+         * @param on_send (const uint8_t *frame, size_t length, const struct sockaddr *to, socklen_t to_length) 返信
+         * @param on_data (const CidSession &session, BytesView payload) DATAのペイロード
+         * @return CIDのフレームならtrue
+         */
+        template <typename OnSend, typename OnData>
+        bool onDatagram(BytesView frame, const struct sockaddr *from, socklen_t from_length, uint64_t now_ms,
+                        OnSend &&on_send, OnData &&on_data)
+        {
+            CidHeader header;
+            if (!ReadCidHeader(frame, &header))
+            {
+                return false;
+            }
+            BytesView payload = frame.sub(kCidHeaderSize);
+            uint8_t out[kCidHeaderSize + kCidTokenSize];
+
+            switch (header.mType)
+            {
+            case kCidHello:
+            {
+                uint64_t id = 0;
+                const uint64_t *known = mNonces.find(header.mConnectionId);
+                CidSession *session = known != nullptr ? mSessions.find(*known) : nullptr;
+                if (session != nullptr)
+                {
+                    // WELCOMEが届かずにHELLOが再送された: 同じIDを返し直す
+                    if (!session->mAnyPacket)
+                    {
+                        std::memcpy(&session->mPeer, from, from_length); // DATAが来るまでは最後のHELLOの経路へ
+                        session->mPeerLength = from_length;
+                    }
+                    session->mLastActiveMs = now_ms;
+                    id = session->mId;
+                    ++mStats.mHelloRepeats;
+                }
+                else
+                {
+                    if (mSessions.size() >= mOptions.mMaxSessions && !evictUnvalidated())
+                    {
+                        ++mStats.mRefused; // 返事をしない (クライアントはHELLOを再送する)
+                        break;
+                    }
+                    CidSession created;
+                    created.mId = newId();
+                    created.mNonce = header.mConnectionId;
+                    std::memcpy(&created.mPeer, from, from_length);
+                    created.mPeerLength = from_length;
+                    created.mLastActiveMs = now_ms;
+                    arm(*mSessions.emplace(created.mId, created).first, now_ms + mOptions.mIdleTimeoutMs);
+                    mNonces.emplace(created.mNonce, created.mId);
+                    pushUnvalidated(created.mId);
+                    id = created.mId;
+                    ++mStats.mCreated;
+                }
+
+                CidHeader welcome;
+                welcome.mType = kCidWelcome;
+                welcome.mConnectionId = id;
+                WriteCidHeader(out, welcome);
+                StoreCidToken(out + kCidHeaderSize, header.mConnectionId); // HELLOの乱数を返す
+                on_send(out, sizeof(out), from, from_length);
+                break;
+            }
+            case kCidData:
+            {
+                CidSession *session = mSessions.find(header.mConnectionId);
+                if (session == nullptr)
+                {
+                    // 失効した/知らないID: 作り直させる (受け取った量より小さい)
+                    ++mStats.mUnknown;
+                    CidHeader close;
+                    close.mType = kCidClose;
+                    close.mConnectionId = header.mConnectionId;
+                    WriteCidHeader(out, close);
+                    on_send(out, kCidHeaderSize, from, from_length);
+                    break;
+                }
+                session->mLastActiveMs = now_ms;
+                ++session->mPackets;
+                session->mBytes += payload.size();
+                bool newest = !session->mAnyPacket || CidPacketLess(session->mLargestPacket, header.mPacketNumber);
+                if (newest)
+                {
+                    session->mLargestPacket = header.mPacketNumber;
+                    session->mAnyPacket = true;
+                }
+                if (!SameEndpoint(from, (const struct sockaddr *)&session->mPeer))
+                {
+                    if (newest)
+                    {
+                        probe(*session, from, from_length, frame.size(), now_ms, on_send);
+                    }
+                    else
+                    {
+                        ++mStats.mReordered;
+                    }
+                }
+                on_data(*session, payload);
+                break;
+            }
+            case kCidPathResponse:
+            {
+                // どの経路で届いた応答でも, チャレンジを送った経路の検証になる (RFC 9000 8.2.2)
+                CidSession *session = mSessions.find(header.mConnectionId);
+                if (session != nullptr && session->mProbing && payload.size() >= kCidTokenSize &&
+                    LoadCidToken(payload) == session->mChallenge)
+                {
+                    std::memcpy(&session->mPeer, &session->mCandidate, session->mCandidateLength);
+                    session->mPeerLength = session->mCandidateLength;
+                    session->mProbing = false;
+                    session->mLastActiveMs = now_ms;
+                    ++session->mMigrations;
+                    ++mStats.mMigrations;
+                }
+                break;
+            }
+            case kCidPathChallenge:
+            {
+                // 相手からの検証: 届いた経路へ同じ値を返す
+                if (mSessions.find(header.mConnectionId) != nullptr && payload.size() >= kCidTokenSize)
+                {
+                    CidHeader response;
+                    response.mType = kCidPathResponse;
+                    response.mConnectionId = header.mConnectionId;
+                    WriteCidHeader(out, response);
+                    std::memcpy(out + kCidHeaderSize, payload.data(), kCidTokenSize);
+                    on_send(out, sizeof(out), from, from_length);
+                }
+                break;
+            }
+            case kCidClose:
+                if (remove(header.mConnectionId))
+                {
+                    ++mStats.mClosed;
+                }
+                break;
+            default:
+                break;
+            }
+            return true;
+        }
+
+        // チャレンジの再送と無通信セッションの失効. on_sendはonDatagram()と同じ.
+        template <typename OnSend>
+        void tick(uint64_t now_ms, OnSend &&on_send)
+        {
+            mTimers.advance(now_ms, [&](TimerEntry &entry) {
+                CidSession *session = mSessions.find(entry.mId);
+                if (session == nullptr || session->mTimerMs != entry.mDeadlineMs)
+                {
+                    return; // 消えた / 積み直した
+                }
+                session->mTimerMs = 0;
+                if (now_ms >= session->mLastActiveMs + mOptions.mIdleTimeoutMs)
+                {
+                    remove(entry.mId);
+                    ++mStats.mExpired;
+                    return;
+                }
+                if (session->mProbing && now_ms >= session->mChallengeSentMs + mOptions.mChallengeRetryMs)
+                {
+                    if (session->mChallengesSent >= mOptions.mMaxChallenges)
+                    {
+                        session->mProbing = false; // 元の経路に留まる
+                        ++mStats.mValidationFailures;
+                    }
+                    else
+                    {
+                        sendChallenge(*session, now_ms, on_send);
+                    }
+                }
+                arm(*session, nextDeadline(*session, now_ms));
+            });
+        }
+
+    private:
+        struct TimerEntry
+        {
+            uint64_t mId;
+            uint64_t mDeadlineMs;
+        };
+
+        uint64_t random()
+        {
+            // splitmix64
+            uint64_t z = (mRandom += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        // 下位32bit % shards == shard の未使用のID
+        uint64_t newId()
+        {
+            while (true)
+            {
+                uint64_t id = random();
+                uint32_t low = (uint32_t)id;
+                uint32_t base = low - low % mOptions.mShards;
+                if (base > UINT32_MAX - mOptions.mShard)
+                {
+                    base -= mOptions.mShards;
+                }
+                id = (id & 0xFFFFFFFF00000000ull) | (base + mOptions.mShard);
+                if (id != 0 && mSessions.find(id) == nullptr)
+                {
+                    return id;
+                }
+            }
+        }
+
+        // セッションと乱数の対応を消す
+        bool remove(uint64_t id)
+        {
+            CidSession *session = mSessions.find(id);
+            if (session == nullptr)
+            {
+                return false;
+            }
+            const uint64_t *known = mNonces.find(session->mNonce);
+            if (known != nullptr && *known == id)
+            {
+                mNonces.erase(session->mNonce);
+            }
+            mSessions.erase(id);
+            return true;
+        }
+
+        // HELLOだけでDATAがまだ来ていないセッション
+        bool unvalidated(uint64_t id)
+        {
+            CidSession *session = mSessions.find(id);
+            return session != nullptr && !session->mAnyPacket;
+        }
+
+        // 作った順の列. 先頭のDATAが来た/消えたものはその都度捨てる
+        void pushUnvalidated(uint64_t id)
+        {
+            while (!mUnvalidated.empty() && !unvalidated(mUnvalidated.front()))
+            {
+                mUnvalidated.pop_front();
+            }
+            mUnvalidated.push_back(id);
+        }
+
+        // 一番古いDATAの来ていないセッションを追い出す. 無ければfalse (確立したセッションは追い出さない)
+        bool evictUnvalidated()
+        {
+            while (!mUnvalidated.empty())
+            {
+                uint64_t id = mUnvalidated.front();
+                mUnvalidated.pop_front();
+                if (unvalidated(id))
+                {
+                    remove(id);
+                    ++mStats.mEvicted;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        uint64_t nextDeadline(const CidSession &session, uint64_t now_ms) const
+        {
+            uint64_t next = session.mLastActiveMs + mOptions.mIdleTimeoutMs;
+            if (session.mProbing)
+            {
+                next = std::min(next, session.mChallengeSentMs + mOptions.mChallengeRetryMs);
+            }
+            return std::max(next, now_ms + 1);
+        }
+
+        // 1セッション1エントリ. より早い期限だけ積み直す(古いエントリは失効時に無視).
+        void arm(CidSession &session, uint64_t deadline_ms)
+        {
+            if (session.mTimerMs != 0 && session.mTimerMs <= deadline_ms)
+            {
+                return;
+            }
+            session.mTimerMs = deadline_ms;
+            mTimers.schedule(deadline_ms, TimerEntry{session.mId, deadline_ms});
+        }
+
+        template <typename OnSend>
+        void probe(CidSession &session, const struct sockaddr *from, socklen_t from_length, size_t received,
+                   uint64_t now_ms, OnSend &&on_send)
+        {
+            if (session.mProbing && SameEndpoint(from, (const struct sockaddr *)&session.mCandidate))
+            {
+                session.mCandidateReceived += received; // 検証中の経路から続けて届いた
+                return;
+            }
+            // 新しい候補 (前の候補は捨てる)
+            session.mProbing = true;
+            std::memcpy(&session.mCandidate, from, from_length);
+            session.mCandidateLength = from_length;
+            session.mCandidateReceived = received;
+            session.mCandidateSent = 0;
+            session.mChallenge = random();
+            session.mChallengesSent = 0;
+            session.mChallengeSentMs = now_ms;
+            sendChallenge(session, now_ms, on_send);
+            arm(session, nextDeadline(session, now_ms));
+        }
+
+        template <typename OnSend>
+        void sendChallenge(CidSession &session, uint64_t now_ms, OnSend &&on_send)
+        {
+            uint8_t out[kCidHeaderSize + kCidTokenSize];
+            if (session.mCandidateSent + sizeof(out) > session.mCandidateReceived * mOptions.mAmplificationFactor)
+            {
+                ++mStats.mAmplificationLimited; // 候補からもっと届くまで待つ
+                return;
+            }
+            CidHeader challenge;
+            challenge.mType = kCidPathChallenge;
+            challenge.mConnectionId = session.mId;
+            WriteCidHeader(out, challenge);
+            StoreCidToken(out + kCidHeaderSize, session.mChallenge);
+            on_send(out, sizeof(out), (const struct sockaddr *)&session.mCandidate, session.mCandidateLength);
+            session.mCandidateSent += sizeof(out);
+            session.mChallengeSentMs = now_ms;
+            ++session.mChallengesSent;
+            ++mStats.mChallenges;
+        }
+
+        CidSessionOptions mOptions;
+        FlatHashMap<uint64_t, CidSession, CidHash> mSessions;
+        FlatHashMap<uint64_t, uint64_t, CidHash> mNonces; // HELLOの乱数 -> 接続ID
+        std::deque<uint64_t> mUnvalidated;                // DATAの来ていないセッション (作った順)
+        TimerWheel<TimerEntry> mTimers;
+        uint64_t mRandom;
+        CidSessionStats mStats;
+    };
+
+    /////////////////////////////////////////////////////////////
+    // クライアント側
+    /////////////////////////////////////////////////////////////
+    class CidClient
+    {
+    public:
+        explicit CidClient(uint64_t nonce) : mNonce(nonce ? nonce : 1) {}
+
+        bool connected() const { return mId != 0; }
+        uint64_t id() const { return mId; }
+        uint64_t challengesAnswered() const { return mChallengesAnswered; }
+
+        // HELLO (outはkCidHeaderSize以上)
+        size_t hello(uint8_t *out) const
+        {
+            CidHeader header;
+            header.mType = kCidHello;
+            header.mConnectionId = mNonce; // サーバ側の振り分けにも使われる
+            WriteCidHeader(out, header);
+            return kCidHeaderSize;
+        }
+
+        // DATA (outはkCidHeaderSize + length以上)
+        size_t data(const void *payload, size_t length, uint8_t *out)
+        {
+            CidHeader header;
+            header.mType = kCidData;
+            header.mConnectionId = mId;
+            header.mPacketNumber = mNextPacket++;
+            WriteCidHeader(out, header);
+            std::memcpy(out + kCidHeaderSize, payload, length);
+            return kCidHeaderSize + length;
+        }
+
+        /**
+         * @brief サーバからのフレームを処理する. PATH_CHALLENGEへの応答はon_reply(const uint8_t *frame, size_t length)へ.
+         * @return CIDのフレームならtrue
+         */
+        template <typename OnReply>
+        bool onFrame(BytesView frame, OnReply &&on_reply)
+        {
+            CidHeader header;
+            if (!ReadCidHeader(frame, &header))
+            {
+                return false;
+            }
+            BytesView payload = frame.sub(kCidHeaderSize);
+            if (header.mType == kCidWelcome && !connected() && payload.size() >= kCidTokenSize && LoadCidToken(payload) == mNonce)
+            {
+                mId = header.mConnectionId;
+            }
+            else if (header.mType == kCidPathChallenge && header.mConnectionId == mId && payload.size() >= kCidTokenSize)
+            {
+                uint8_t out[kCidHeaderSize + kCidTokenSize];
+                CidHeader response;
+                response.mType = kCidPathResponse;
+                response.mConnectionId = mId;
+                WriteCidHeader(out, response);
+                std::memcpy(out + kCidHeaderSize, payload.data(), kCidTokenSize);
+                on_reply(out, sizeof(out));
+                ++mChallengesAnswered;
+            }
+            else if (header.mType == kCidClose && header.mConnectionId == mId)
+            {
+                mId = 0; // サーバが忘れた: HELLOからやり直す
+            }
+            return true;
+        }
+
+    private:
+        uint64_t mNonce;
+        uint64_t mId = 0;
+        uint32_t mNextPacket = 0;
+        uint64_t mChallengesAnswered = 0;
+    };
+} // namespace net
+} // namespace is
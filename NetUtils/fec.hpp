@@ -0,0 +1,823 @@
+/**
+ * @file fec.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief マルチキャスト向けの前方誤り訂正 (XOR / Reed-Solomon over GF(256))
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * k個のデータパケット毎にm個のパリティパケットを足し, k+m個のうち任意のk個が届けば元のk個を復元する.
+ * NAKと違って往復が要らないので, 1つ2つの損失ならパリティが届いた時点(数マイクロ秒)で埋まる.
+ *
+ * + 符号: 組織符号(データはそのまま送る)のCauchy行列によるReed-Solomon. 行列の1行目を全て1にしてあるので,
+ *   1つ目のパリティはデータのXORになる. m=1ならXORのFECそのもので, 1個の欠落はXORだけで戻す.
+ * + GF(256)の演算: 既約多項式 x^8+x^4+x^3+x^2+1 (0x11D).
+ *   dst ^= c * src をバッファ全体に掛けるのが処理の殆どで, 次の3通りを実行時に選ぶ.
+ *   - 表引き: 256x256の乗算表(64KiB)を1バイトずつ引く
+ *   - SSSE3 / AVX2: 4bitずつに分けた16要素の表をPSHUFBで16/32バイト同時に引く
+ * + パケット: 16バイトのFECヘッダ + 中身. データパケットはすぐに送り(遅延を足さない),
+ *   パリティはブロックが揃った(またはflushされた)時点で送る. 長さの違うデータは2バイトの長さを前置して
+ *   ブロック内の最大長まで0で埋めたものを符号化する.
+ *
+ * FECヘッダ (ネットワークバイトオーダ)
+ *   0: magic "FEC1"  4: session (送信者の起動毎の値. 変われば受信側は窓を捨てる)  8: block
+ *  12: index (データ 0..k-1, パリティ k..k+m-1)  13: k  14: m
+ *  15: count (パリティのみ. そのブロックの実際のデータ数 1..k. flushで途中で閉じたブロックはk未満)
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define IS_NET_GF_X86 1
+#endif
+
+#include <NetUtils/packet_view.hpp>
+
+namespace is
+{
+namespace net
+{
+    /////////////////////////////////////////////////////////////
+    // GF(256)
+    /////////////////////////////////////////////////////////////
+    class Gf256
+    {
+    public:
+        static const Gf256 &instance()
+        {
+            static const Gf256 tables;
+            return tables;
+        }
+
+        uint8_t mul(uint8_t a, uint8_t b) const { return mMul[(size_t)a << 8 | b]; }
+        uint8_t inv(uint8_t a) const { return mExp[255 - mLog[a]]; } // a != 0
+        const uint8_t *mulRow(uint8_t c) const { return &mMul[(size_t)c << 8]; }
+        const uint8_t *lowNibble(uint8_t c) const { return mLow[c]; }   // c * x   (x = 0..15)
+        const uint8_t *highNibble(uint8_t c) const { return mHigh[c]; } // c * x<<4
+
+    private:
+        Gf256() : mMul(256 * 256)
+        {
+            uint32_t x = 1;
+            for (int i = 0; i < 255; ++i)
+            {
+                mExp[i] = mExp[i + 255] = (uint8_t)x;
+                mLog[x] = (uint8_t)i;
+                x <<= 1;
+                if (x & 0x100)
+                {
+                    x ^= 0x11D;
+                }
+            }
+            mLog[0] = 0;
+            for (int a = 0; a < 256; ++a)
+            {
+                for (int b = 0; b < 256; ++b)
+                {
+                    mMul[(size_t)a << 8 | (size_t)b] = (a == 0 || b == 0) ? 0 : mExp[mLog[a] + mLog[b]];
+                }
+            }
+            for (int c = 0; c < 256; ++c)
+            {
+                for (int n = 0; n < 16; ++n)
+                {
+                    mLow[c][n] = mMul[(size_t)c << 8 | (size_t)n];
+                    mHigh[c][n] = mMul[(size_t)c << 8 | (size_t)(n << 4)];
+                }
+            }
+        }
+
+        uint8_t mExp[510];
+        uint8_t mLog[256];
+        std::vector<uint8_t> mMul;
+        alignas(16) uint8_t mLow[256][16];
+        alignas(16) uint8_t mHigh[256][16];
+    };
+
+    enum class GfKernel
+    {
+        kTable,
+        kSsse3,
+        kAvx2,
+    };
+
+    inline const char *GfKernelName(GfKernel kernel)
+    {
+        switch (kernel)
+        {
+        case GfKernel::kSsse3:
+            return "ssse3";
+        case GfKernel::kAvx2:
+            return "avx2";
+        default:
+            return "table";
+        }
+    }
+
+    // このCPUで使える最速のもの
+    inline GfKernel GfBestKernel()
+    {
+#if defined(IS_NET_GF_X86)
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return GfKernel::kAvx2;
+        }
+        if (__builtin_cpu_supports("ssse3"))
+        {
+            return GfKernel::kSsse3;
+        }
+#endif
+        return GfKernel::kTable;
+    }
+
+    // 既定で使う実装 (ベンチマークで切り替えられるように参照で返す)
+    inline GfKernel &GfActiveKernel()
+    {
+        static GfKernel kernel = GfBestKernel();
+        return kernel;
+    }
+
+    inline void GfXorRegion(uint8_t *dst, const uint8_t *src, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            uint64_t a, b;
+            std::memcpy(&a, dst + i, 8);
+            std::memcpy(&b, src + i, 8);
+            a ^= b;
+            std::memcpy(dst + i, &a, 8);
+        }
+        for (; i < n; ++i)
+        {
+            dst[i] ^= src[i];
+        }
+    }
+
+    inline void GfMulAddTable(uint8_t *dst, const uint8_t *src, uint8_t c, size_t n)
+    {
+        const uint8_t *row = Gf256::instance().mulRow(c);
+        for (size_t i = 0; i < n; ++i)
+        {
+            dst[i] ^= row[src[i]];
+        }
+    }
+
+#if defined(IS_NET_GF_X86)
+    __attribute__((target("ssse3"))) inline void GfMulAddSsse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t n)
+    {
+        const Gf256 &gf = Gf256::instance();
+        const __m128i low = _mm_load_si128((const __m128i *)gf.lowNibble(c));
+        const __m128i high = _mm_load_si128((const __m128i *)gf.highNibble(c));
+        const __m128i mask = _mm_set1_epi8(0x0F);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i product = _mm_xor_si128(_mm_shuffle_epi8(low, _mm_and_si128(s, mask)),
+                                            _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+            __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, product));
+        }
+        GfMulAddTable(dst + i, src + i, c, n - i);
+    }
+
+    __attribute__((target("avx2"))) inline void GfMulAddAvx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t n)
+    {
+        const Gf256 &gf = Gf256::instance();
+        // PSHUFBは128bitのレーン毎に引くので, 同じ表を両レーンに置く
+        const __m256i low = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)gf.lowNibble(c)));
+        const __m256i high = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)gf.highNibble(c)));
+        const __m256i mask = _mm256_set1_epi8(0x0F);
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+            __m256i product = _mm256_xor_si256(_mm256_shuffle_epi8(low, _mm256_and_si256(s, mask)),
+                                               _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+            __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+            _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d, product));
+        }
+        GfMulAddTable(dst + i, src + i, c, n - i);
+    }
+#endif
+
+    // dst[0..n) ^= c * src[0..n)
+    inline void GfMulAdd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t n, GfKernel kernel = GfActiveKernel())
+    {
+        if (c == 0)
+        {
+            return;
+        }
+        if (c == 1)
+        {
+            GfXorRegion(dst, src, n);
+            return;
+        }
+#if defined(IS_NET_GF_X86)
+        if (kernel == GfKernel::kAvx2)
+        {
+            GfMulAddAvx2(dst, src, c, n);
+            return;
+        }
+        if (kernel == GfKernel::kSsse3)
+        {
+            GfMulAddSsse3(dst, src, c, n);
+            return;
+        }
+#endif
+        (void)kernel;
+        GfMulAddTable(dst, src, c, n);
+    }
+
+    /////////////////////////////////////////////////////////////
+    // Reed-Solomon (組織符号, Cauchy行列)
+    /////////////////////////////////////////////////////////////
+    class ReedSolomon
+    {
+    public:
+        ReedSolomon(int k, int m) : mK(k), mM(m), mMatrix((size_t)k * (size_t)m)
+        {
+            if (k < 1 || m < 1 || k + m > 256)
+            {
+                throw std::invalid_argument("ReedSolomon: 1 <= k, 1 <= m, k + m <= 256");
+            }
+            const Gf256 &gf = Gf256::instance();
+            // C[i][j] = 1 / (x_i + y_j), x_i = k + i, y_j = j. 任意の正方部分行列が正則.
+            for (int i = 0; i < m; ++i)
+            {
+                for (int j = 0; j < k; ++j)
+                {
+                    mMatrix[(size_t)i * (size_t)k + (size_t)j] = gf.inv((uint8_t)((k + i) ^ j));
+                }
+            }
+            // 列をスケールして1行目を全て1にする (正則性は変わらない). 1つ目のパリティがXORになる.
+            for (int j = 0; j < k; ++j)
+            {
+                uint8_t scale = gf.inv(mMatrix[(size_t)j]);
+                for (int i = 0; i < m; ++i)
+                {
+                    uint8_t &e = mMatrix[(size_t)i * (size_t)k + (size_t)j];
+                    e = gf.mul(e, scale);
+                }
+            }
+        }
+
+        int k() const { return mK; }
+        int m() const { return mM; }
+
+        // parity[i] = sum_j C[i][j] * data[j]  (各len バイト)
+        void encode(const uint8_t *const *data, uint8_t *const *parity, size_t len) const
+        {
+            for (int i = 0; i < mM; ++i)
+            {
+                if (i == 0)
+                {
+                    std::memcpy(parity[i], data[0], len); // 1行目は全て1
+                }
+                else
+                {
+                    std::memset(parity[i], 0, len);
+                    GfMulAdd(parity[i], data[0], coefficient(i, 0), len);
+                }
+                for (int j = 1; j < mK; ++j)
+                {
+                    GfMulAdd(parity[i], data[j], coefficient(i, j), len);
+                }
+            }
+        }
+
+        /**
+         * @brief 欠けたデータを復元する. shards[0..k+m)は全てlenバイトの領域を指し, present[s]が届いたもの.
+         * 欠けたデータの領域に結果を書く(パリティの欠けは戻さない).
+         * @return 届いたものがk個未満ならfalse
+         */
+        bool reconstruct(uint8_t *const *shards, const bool *present, size_t len) const
+        {
+            std::vector<int> missing;
+            for (int j = 0; j < mK; ++j)
+            {
+                if (!present[j])
+                {
+                    missing.push_back(j);
+                }
+            }
+            if (missing.empty())
+            {
+                return true;
+            }
+
+            // 1個だけ欠けていて1つ目のパリティがあればXORだけで戻る
+            if (missing.size() == 1 && present[mK])
+            {
+                uint8_t *out = shards[missing[0]];
+                std::memcpy(out, shards[mK], len);
+                for (int j = 0; j < mK; ++j)
+                {
+                    if (j != missing[0])
+                    {
+                        GfXorRegion(out, shards[j], len);
+                    }
+                }
+                return true;
+            }
+
+            // 届いたものからk個選び, その行の正方行列の逆行列を掛ける
+            std::vector<int> used;
+            for (int s = 0; s < mK + mM && (int)used.size() < mK; ++s)
+            {
+                if (present[s])
+                {
+                    used.push_back(s);
+                }
+            }
+            if ((int)used.size() < mK)
+            {
+                return false;
+            }
+            std::vector<uint8_t> matrix((size_t)mK * (size_t)mK, 0);
+            for (int r = 0; r < mK; ++r)
+            {
+                if (used[r] < mK)
+                {
+                    matrix[(size_t)r * (size_t)mK + (size_t)used[r]] = 1;
+                }
+                else
+                {
+                    std::memcpy(&matrix[(size_t)r * (size_t)mK], &mMatrix[(size_t)(used[r] - mK) * (size_t)mK], (size_t)mK);
+                }
+            }
+            std::vector<uint8_t> inverse;
+            if (!invert(matrix, &inverse))
+            {
+                return false;
+            }
+            for (int j : missing)
+            {
+                uint8_t *out = shards[j];
+                std::memset(out, 0, len);
+                for (int r = 0; r < mK; ++r)
+                {
+                    GfMulAdd(out, shards[used[r]], inverse[(size_t)j * (size_t)mK + (size_t)r], len);
+                }
+            }
+            return true;
+        }
+
+    private:
+        uint8_t coefficient(int i, int j) const { return mMatrix[(size_t)i * (size_t)mK + (size_t)j]; }
+
+        // Gauss-Jordan
+        bool invert(std::vector<uint8_t> &a, std::vector<uint8_t> *out) const
+        {
+            const Gf256 &gf = Gf256::instance();
+            size_t n = (size_t)mK;
+            std::vector<uint8_t> &b = *out;
+            b.assign(n * n, 0);
+            for (size_t i = 0; i < n; ++i)
+            {
+                b[i * n + i] = 1;
+            }
+            for (size_t col = 0; col < n; ++col)
+            {
+                size_t pivot = col;
+                while (pivot < n && a[pivot * n + col] == 0)
+                {
+                    ++pivot;
+                }
+                if (pivot == n)
+                {
+                    return false;
+                }
+                if (pivot != col)
+                {
+                    for (size_t c = 0; c < n; ++c)
+                    {
+                        std::swap(a[pivot * n + c], a[col * n + c]);
+                        std::swap(b[pivot * n + c], b[col * n + c]);
+                    }
+                }
+                uint8_t scale = gf.inv(a[col * n + col]);
+                for (size_t c = 0; c < n; ++c)
+                {
+                    a[col * n + c] = gf.mul(a[col * n + c], scale);
+                    b[col * n + c] = gf.mul(b[col * n + c], scale);
+                }
+                for (size_t r = 0; r < n; ++r)
+                {
+                    uint8_t factor = a[r * n + col];
+                    if (r == col || factor == 0)
+                    {
+                        continue;
+                    }
+                    for (size_t c = 0; c < n; ++c)
+                    {
+                        a[r * n + c] ^= gf.mul(factor, a[col * n + c]);
+                        b[r * n + c] ^= gf.mul(factor, b[col * n + c]);
+                    }
+                }
+            }
+            return true;
+        }
+
+        const int mK;
+        const int mM;
+        std::vector<uint8_t> mMatrix; // m x k
+    };
+
+    /////////////////////////////////////////////////////////////
+    // パケット単位のエンコーダ/デコーダ
+    /////////////////////////////////////////////////////////////
+    constexpr uint32_t kFecMagic = 0x46454331; // "FEC1"
+    constexpr size_t kFecHeaderSize = 16;
+
+    struct FecHeader
+    {
+        uint32_t mSession = 0;
+        uint32_t mBlock = 0;
+        uint8_t mIndex = 0;
+        uint8_t mK = 0;
+        uint8_t mM = 0;
+        uint8_t mCount = 0;
+    };
+
+    inline void WriteFecHeader(uint8_t *out, const FecHeader &header)
+    {
+        StoreBe32(out, kFecMagic);
+        StoreBe32(out + 4, header.mSession);
+        StoreBe32(out + 8, header.mBlock);
+        out[12] = header.mIndex;
+        out[13] = header.mK;
+        out[14] = header.mM;
+        out[15] = header.mCount;
+    }
+
+    inline bool ReadFecHeader(BytesView packet, FecHeader *header)
+    {
+        if (packet.size() < kFecHeaderSize || packet.u32(0) != kFecMagic)
+        {
+            return false;
+        }
+        header->mSession = packet.u32(4);
+        header->mBlock = packet.u32(8);
+        header->mIndex = packet.u8(12);
+        header->mK = packet.u8(13);
+        header->mM = packet.u8(14);
+        header->mCount = packet.u8(15);
+        if (header->mK < 1 || header->mM < 1 || (int)header->mK + header->mM > 256 ||
+            header->mIndex >= (int)header->mK + header->mM)
+        {
+            return false;
+        }
+        // パリティのcountは1..k (0だとtryRecoverが待ち続け, kを超えると存在しないデータを戻そうとする)
+        return header->mIndex < header->mK || (header->mCount >= 1 && header->mCount <= header->mK);
+    }
+
+    class FecEncoder
+    {
+    public:
+        // sessionは送信者の起動毎に変える (受信側は変わったら前の起動のブロックを捨てる)
+        FecEncoder(int k, int m, size_t max_datagram = 1472, uint32_t session = 0)
+            : mCodec(k, m)
+            , mSession(session)
+            , mShardCapacity(2 + max_datagram)
+            , mShards((size_t)(k + m) * mShardCapacity)
+            , mPacket(kFecHeaderSize + mShardCapacity)
+        {
+        }
+
+        size_t maxPacketSize() const { return mPacket.size(); }
+
+        // データを包んでon_packet(const uint8_t *packet, size_t length)へ渡す. k個溜まればパリティも続けて渡す.
+        template <typename OnPacket>
+        bool add(const uint8_t *data, size_t length, OnPacket &&on_packet)
+        {
+            if (length + 2 > mShardCapacity)
+            {
+                return false;
+            }
+            FecHeader header;
+            header.mSession = mSession;
+            header.mBlock = mBlock;
+            header.mIndex = (uint8_t)mCount;
+            header.mK = (uint8_t)mCodec.k();
+            header.mM = (uint8_t)mCodec.m();
+            WriteFecHeader(mPacket.data(), header);
+            std::memcpy(mPacket.data() + kFecHeaderSize, data, length);
+            on_packet(mPacket.data(), kFecHeaderSize + length);
+
+            // 符号化用に長さを前置して残す (0埋めはパリティを作るときに最大長まで)
+            uint8_t *shard = shardAt(mCount);
+            StoreBe16(shard, (uint16_t)length);
+            std::memcpy(shard + 2, data, length);
+            mLengths[(size_t)mCount] = 2 + length;
+            mShardSize = std::max(mShardSize, 2 + length);
+            if (++mCount == mCodec.k())
+            {
+                flush(on_packet);
+            }
+            return true;
+        }
+
+        // 途中のブロックを閉じてパリティを送る (送信が途切れたとき. 残りのデータは長さ0として扱う)
+        template <typename OnPacket>
+        void flush(OnPacket &&on_packet)
+        {
+            if (mCount == 0)
+            {
+                return;
+            }
+            const uint8_t *data[256];
+            uint8_t *parity[256];
+            for (int j = 0; j < mCodec.k(); ++j)
+            {
+                uint8_t *shard = shardAt(j);
+                size_t used = j < mCount ? mLengths[(size_t)j] : 0;
+                std::memset(shard + used, 0, mShardSize - used);
+                data[j] = shard;
+            }
+            for (int i = 0; i < mCodec.m(); ++i)
+            {
+                parity[i] = shardAt(mCodec.k() + i);
+            }
+            mCodec.encode(data, parity, mShardSize);
+
+            for (int i = 0; i < mCodec.m(); ++i)
+            {
+                FecHeader header;
+                header.mSession = mSession;
+                header.mBlock = mBlock;
+                header.mIndex = (uint8_t)(mCodec.k() + i);
+                header.mK = (uint8_t)mCodec.k();
+                header.mM = (uint8_t)mCodec.m();
+                header.mCount = (uint8_t)mCount;
+                WriteFecHeader(mPacket.data(), header);
+                std::memcpy(mPacket.data() + kFecHeaderSize, parity[i], mShardSize);
+                on_packet(mPacket.data(), kFecHeaderSize + mShardSize);
+            }
+            ++mBlock;
+            mCount = 0;
+            mShardSize = 0;
+        }
+
+    private:
+        uint8_t *shardAt(int index) { return mShards.data() + (size_t)index * mShardCapacity; }
+
+        ReedSolomon mCodec;
+        const uint32_t mSession;
+        const size_t mShardCapacity;
+        std::vector<uint8_t> mShards;
+        std::vector<uint8_t> mPacket;
+        size_t mLengths[256] = {};
+        size_t mShardSize = 0;
+        uint32_t mBlock = 0;
+        int mCount = 0;
+    };
+
+    struct FecDecoderStats
+    {
+        uint64_t mData = 0;          // 届いたデータパケット
+        uint64_t mParity = 0;        // 届いたパリティパケット
+        uint64_t mRecovered = 0;     // パリティから戻したデータ
+        uint64_t mUnrecoverable = 0; // 欠けが多すぎて戻せなかったデータ (上位のNAKに任せる)
+        uint64_t mMalformed = 0;     // ブロック内で長さやcountが食い違うパケット (捨てた)
+        uint64_t mSessions = 0;      // 送信者の(再)起動を見た回数
+    };
+
+    class FecDecoder
+    {
+    public:
+        explicit FecDecoder(size_t window_blocks = 64, size_t max_datagram = 1472)
+            : mShardCapacity(2 + max_datagram), mBlocks(window_blocks ? window_blocks : 1)
+        {
+        }
+
+        /**
+         * @brief FECパケットを処理する. データはon_datagram(const uint8_t *data, size_t length, bool recovered)へ.
+         * 届いたデータはすぐに, 欠けたデータはパリティで戻せた時点で渡す(順番は入れ替わる).
+         * @return FECパケットならtrue
+         */
+        template <typename OnDatagram>
+        bool onPacket(BytesView packet, OnDatagram &&on_datagram)
+        {
+            FecHeader header;
+            if (!ReadFecHeader(packet, &header))
+            {
+                return false;
+            }
+            BytesView body = packet.sub(kFecHeaderSize);
+            if (body.size() + (header.mIndex < header.mK ? 2 : 0) > mShardCapacity)
+            {
+                return true; // 大きすぎる
+            }
+            if (!mStarted || header.mSession != mSession)
+            {
+                restart(header.mSession); // 送信者の再起動: 同じブロック番号を重複と見なさないように窓を捨てる
+            }
+            Block &block = blockFor(header);
+            if (block.mPresent[header.mIndex])
+            {
+                return true; // 重複
+            }
+            if (header.mIndex >= header.mK && block.mShardSize != 0 &&
+                (body.size() != block.mShardSize || header.mCount != block.mCount))
+            {
+                ++mStats.mMalformed; // シャード長とcountは最初のパリティで決まる
+                return true;
+            }
+            block.mPresent[header.mIndex] = true;
+            uint8_t *shard = block.shard(header.mIndex, mShardCapacity);
+            if (header.mIndex < header.mK)
+            {
+                ++mStats.mData;
+                StoreBe16(shard, (uint16_t)body.size());
+                std::memcpy(shard + 2, body.data(), body.size());
+                block.mLengths[header.mIndex] = 2 + body.size();
+                on_datagram(body.data(), body.size(), false);
+            }
+            else
+            {
+                ++mStats.mParity;
+                ++block.mParityCount;
+                std::memcpy(shard, body.data(), body.size());
+                block.mShardSize = body.size();
+                block.mCount = header.mCount;
+            }
+            tryRecover(block, on_datagram);
+            return true;
+        }
+
+        const FecDecoderStats &stats() const { return mStats; }
+
+    private:
+        struct Block
+        {
+            bool mUsed = false;
+            uint32_t mId = 0;
+            int mK = 0;
+            int mM = 0;
+            int mCount = 0;     // 実際のデータ数 (パリティが届くまで不明: 0)
+            int mParityCount = 0;
+            bool mDone = false;
+            size_t mShardSize = 0;
+            bool mPresent[256];
+            size_t mLengths[256];
+            std::vector<uint8_t> mBuffer;
+
+            uint8_t *shard(int index, size_t capacity) { return mBuffer.data() + (size_t)index * capacity; }
+
+            // count以内で届いていないデータの数 (count以降に届いたデータは数えない)
+            int missingData() const
+            {
+                int missing = 0;
+                for (int j = 0; j < mCount; ++j)
+                {
+                    missing += mPresent[j] ? 0 : 1;
+                }
+                return missing;
+            }
+        };
+
+        Block &blockFor(const FecHeader &header)
+        {
+            Block &block = mBlocks[header.mBlock % mBlocks.size()];
+            if (!block.mUsed || block.mId != header.mBlock || block.mK != header.mK || block.mM != header.mM)
+            {
+                retire(block);
+                block.mUsed = true;
+                block.mId = header.mBlock;
+                block.mK = header.mK;
+                block.mM = header.mM;
+                block.mCount = 0;
+                block.mParityCount = 0;
+                block.mDone = false;
+                block.mShardSize = 0;
+                std::memset(block.mPresent, 0, sizeof(block.mPresent));
+                block.mBuffer.resize((size_t)(header.mK + header.mM) * mShardCapacity);
+            }
+            return block;
+        }
+
+        void restart(uint32_t session)
+        {
+            for (Block &block : mBlocks)
+            {
+                retire(block);
+                block.mUsed = false;
+            }
+            mStarted = true;
+            mSession = session;
+            ++mStats.mSessions;
+        }
+
+        // 窓から押し出されるブロックで戻せなかった数を数える
+        void retire(Block &block)
+        {
+            if (block.mUsed && !block.mDone && block.mCount > 0)
+            {
+                mStats.mUnrecoverable += (uint64_t)block.missingData();
+            }
+        }
+
+        const ReedSolomon &codec(int k, int m)
+        {
+            std::unique_ptr<ReedSolomon> &entry = mCodecs[k << 8 | m];
+            if (!entry)
+            {
+                entry.reset(new ReedSolomon(k, m));
+            }
+            return *entry;
+        }
+
+        template <typename OnDatagram>
+        void tryRecover(Block &block, OnDatagram &&on_datagram)
+        {
+            if (block.mDone || block.mCount == 0 || block.mShardSize == 0)
+            {
+                return; // パリティがまだ
+            }
+            int missing = block.missingData();
+            if (missing <= 0)
+            {
+                block.mDone = true;
+                return;
+            }
+            if (missing > block.mParityCount)
+            {
+                return; // まだ足りない
+            }
+
+            // 届いたデータがパリティより長い, またはcount以降にある: 同じブロックのものではない. 埋めずに諦める
+            for (int j = 0; j < block.mK; ++j)
+            {
+                if (block.mPresent[j] && (j >= block.mCount || block.mLengths[j] > block.mShardSize))
+                {
+                    block.mDone = true;
+                    mStats.mUnrecoverable += (uint64_t)missing;
+                    return;
+                }
+            }
+
+            // 送られなかった(count以降の)データは長さ0 = 全て0のシャード
+            bool present[256];
+            uint8_t *shards[256];
+            for (int s = 0; s < block.mK + block.mM; ++s)
+            {
+                shards[s] = block.shard(s, mShardCapacity);
+                present[s] = block.mPresent[s];
+                if (s < block.mK)
+                {
+                    size_t used = 0;
+                    if (s >= block.mCount)
+                    {
+                        present[s] = true;
+                    }
+                    else if (block.mPresent[s])
+                    {
+                        used = block.mLengths[s];
+                    }
+                    if (present[s])
+                    {
+                        std::memset(shards[s] + used, 0, block.mShardSize - used);
+                    }
+                }
+            }
+            if (!codec(block.mK, block.mM).reconstruct(shards, present, block.mShardSize))
+            {
+                return;
+            }
+            block.mDone = true;
+            for (int j = 0; j < block.mCount; ++j)
+            {
+                if (block.mPresent[j])
+                {
+                    continue;
+                }
+                size_t length = LoadBe16(shards[j]);
+                if (length + 2 <= block.mShardSize)
+                {
+                    ++mStats.mRecovered;
+                    on_datagram(shards[j] + 2, length, true);
+                }
+            }
+        }
+
+        const size_t mShardCapacity;
+        bool mStarted = false;
+        uint32_t mSession = 0;
+        std::vector<Block> mBlocks;
+        std::map<int, std::unique_ptr<ReedSolomon>> mCodecs;
+        FecDecoderStats mStats;
+    };
+} // namespace net
+} // namespace is
@@ -0,0 +1,169 @@
+/**
+ * @file flat_hash_map.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 開番地法(線形探査)のハッシュ表. 数百万エントリの変換表・セッション表向け.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * `std::unordered_map`はエントリ毎にノードを確保するため, 表が大きくなると
+ * 1回の検索でバケット配列とノードの2回キャッシュミスする. ここではキーと値を
+ * 1本の配列に直接並べ, 衝突時は隣のスロットを見る(線形探査).
+ *
+ * + 容量は2の冪. 負荷率70%を超えたら倍に広げる.
+ * + 削除は墓標を残さず後続を詰める(backward shift)ので, 削除が多くても探査長が伸びない.
+ * + `find()`/`emplace()`が返すポインタは次の挿入(再配置)まで有効.
+ *
+ * スレッドセーフではない. 複数スレッドから使う場合はシャードに分けて外側でロックすること.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace is
+{
+namespace net
+{
+    template <typename Key, typename Value, typename Hash>
+    class FlatHashMap
+    {
+    public:
+        explicit FlatHashMap(size_t capacity = 16) : mMask(0), mSize(0) { rehash(capacity); }
+
+        size_t size() const { return mSize; }
+        bool empty() const { return mSize == 0; }
+        size_t capacity() const { return mSlots.size(); }
+
+        // n個入れても再配置されないように広げる
+        void reserve(size_t n)
+        {
+            if (n * 10 / 7 + 1 > mSlots.size())
+            {
+                rehash(n * 10 / 7 + 1);
+            }
+        }
+
+        Value *find(const Key &key)
+        {
+            for (size_t i = home(key);; i = (i + 1) & mMask)
+            {
+                Slot &slot = mSlots[i];
+                if (!slot.used)
+                {
+                    return nullptr;
+                }
+                if (slot.key == key)
+                {
+                    return &slot.value;
+                }
+            }
+        }
+
+        // 既にあれば挿入せず{既存, false}
+        std::pair<Value *, bool> emplace(const Key &key, Value value)
+        {
+            if ((mSize + 1) * 10 > mSlots.size() * 7)
+            {
+                rehash(mSlots.size() * 2);
+            }
+            size_t i = home(key);
+            for (; mSlots[i].used; i = (i + 1) & mMask)
+            {
+                if (mSlots[i].key == key)
+                {
+                    return {&mSlots[i].value, false};
+                }
+            }
+            mSlots[i].used = true;
+            mSlots[i].key = key;
+            mSlots[i].value = std::move(value);
+            ++mSize;
+            return {&mSlots[i].value, true};
+        }
+
+        bool erase(const Key &key)
+        {
+            size_t i = home(key);
+            for (;; i = (i + 1) & mMask)
+            {
+                if (!mSlots[i].used)
+                {
+                    return false;
+                }
+                if (mSlots[i].key == key)
+                {
+                    break;
+                }
+            }
+
+            // 空きiより後ろで, 本来の位置がiより手前(巡回)のエントリを詰める
+            for (size_t j = (i + 1) & mMask; mSlots[j].used; j = (j + 1) & mMask)
+            {
+                size_t k = home(mSlots[j].key);
+                bool movable = (i <= j) ? (k <= i || k > j) : (k <= i && k > j);
+                if (movable)
+                {
+                    mSlots[i].key = mSlots[j].key;
+                    mSlots[i].value = std::move(mSlots[j].value);
+                    i = j;
+                }
+            }
+            mSlots[i].used = false;
+            mSlots[i].value = Value();
+            --mSize;
+            return true;
+        }
+
+        template <typename Func>
+        void forEach(Func &&func)
+        {
+            for (Slot &slot : mSlots)
+            {
+                if (slot.used)
+                {
+                    func(slot.key, slot.value);
+                }
+            }
+        }
+
+    private:
+        struct Slot
+        {
+            Key key{};
+            bool used = false;
+            Value value{};
+        };
+
+        size_t home(const Key &key) const { return (size_t)Hash()(key) & mMask; }
+
+        void rehash(size_t capacity)
+        {
+            size_t size = 16;
+            while (size < capacity)
+            {
+                size <<= 1;
+            }
+            std::vector<Slot> old;
+            old.swap(mSlots);
+            mSlots.resize(size);
+            mMask = size - 1;
+            mSize = 0;
+            for (Slot &slot : old)
+            {
+                if (slot.used)
+                {
+                    emplace(slot.key, std::move(slot.value));
+                }
+            }
+        }
+
+        std::vector<Slot> mSlots;
+        size_t mMask;
+        size_t mSize;
+    };
+} // namespace net
+} // namespace is
@@ -0,0 +1,372 @@
+/**
+ * @file hole_punch.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief UDPホールパンチングのピア側ライブラリ (ランデブーサーバ経由で候補を交換して同時に穴を開ける)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * メッセージはSTUN形式(stun.hpp)で, 独自メソッドと独自属性(0xC000台)を使う.
+ * ```
+ * ピアA                  ランデブー(WAN B)                 ピアB
+ *   |-- Register(A->B, host候補) -->|                          |
+ *   |<-- Success(XOR-MAPPED) -------|                          |
+ *   |                               |<-- Register(B->A) -------|
+ *   |                               |--- Success(Aの候補) ---->|
+ *   |<-- PeerIndication(Bの候補) ---|                          |
+ *   |========== Check(全候補へ50ms毎) ===== 同時に ===========|
+ *   |<========= Check Success (応答元が相手の確定アドレス) ====>|
+ * ```
+ * + 候補はランデブーから見た公開側アドレス(server reflexive)と, 各ピアが申告したLAN側アドレス(host).
+ * + 相手からのCheckの送信元が未知なら候補に加える(対称NAT越しのpeer reflexive).
+ * + 自分のCheckに応答が返り(送信方向の確認), 相手のCheckも届いた(受信方向の確認)ら完了.
+ *   相手の再送に答えるため少しだけ待ってから, connect()したソケットを返す.
+ *
+ * 完了後の制御メッセージ(再送されたCheckやキープアライブ)は`IsHolePunchControl()`で読み捨てること.
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <NetUtils/stun.hpp>
+
+namespace is
+{
+namespace net
+{
+    // メソッド 0x00A: Register (ランデブーへの登録), 0x00B: Check (ピア間の疎通確認)
+    constexpr uint16_t kPunchRegisterRequest = 0x000A;
+    constexpr uint16_t kPunchRegisterSuccess = 0x010A;
+    constexpr uint16_t kPunchPeerIndication = 0x001A;
+    constexpr uint16_t kPunchCheckRequest = 0x000B;
+    constexpr uint16_t kPunchCheckSuccess = 0x010B;
+
+    // 属性 (comprehension-optionalの私用域)
+    constexpr uint16_t kPunchAttrPeerId = 0xC001;    // 送信者のID (文字列)
+    constexpr uint16_t kPunchAttrTargetId = 0xC002;  // 接続したい相手のID
+    constexpr uint16_t kPunchAttrCandidate = 0xC003; // 候補アドレス (XOR-MAPPED-ADDRESS形式, 複数可)
+    constexpr uint16_t kPunchAttrLifetime = 0xC004;  // NATバインディングの寿命[s]
+
+    constexpr uint16_t kPunchDefaultPort = 3480;
+    constexpr size_t kPunchMaxCandidates = 8;
+    constexpr size_t kPunchMaxIdLength = 128;
+
+    struct HolePunchOptions
+    {
+        uint16_t mLocalPort = 0;       // 0ならOSが選ぶ
+        int mTimeoutMs = 10000;        // 登録からパンチ完了までの上限
+        int mBindingLifetimeSec = 30;  // NATのUDPマッピング寿命 (実測値を渡す)
+        int mCheckIntervalMs = 50;     // Checkの送信間隔
+        int mLingerMs = 200;           // 完了後に相手の再送へ答え続ける時間
+    };
+
+    struct HolePunchResult
+    {
+        int mSocket = -1;                 // 相手にconnect()済みのUDPソケット
+        struct sockaddr_storage mPeer;    // 疎通した相手のアドレス
+        struct sockaddr_storage mMapped;  // 自分の公開側アドレス (ランデブーから見た)
+        double mRttMs = -1.0;
+        int mKeepaliveSec = 0;            // 推奨キープアライブ間隔
+    };
+
+    // 1回の欠落まで耐える間隔: 寿命の半分からRTTを引く
+    inline int KeepaliveInterval(int lifetime_sec, double rtt_ms)
+    {
+        int interval_ms = lifetime_sec * 1000 / 2 - (int)rtt_ms;
+        return std::max(1, interval_ms / 1000);
+    }
+
+    // STUN Binding/Register/Check (ライブラリの制御メッセージ) なら真
+    inline bool IsHolePunchControl(const uint8_t *data, size_t nbytes)
+    {
+        StunMessageView msg(data, nbytes);
+        if (!msg.valid())
+        {
+            return false;
+        }
+        uint16_t method = msg.type() & 0x3EEF; // クラスビット(0x0110)を除く
+        return method == 0x0001 || method == 0x000A || method == 0x000B;
+    }
+
+    // キープアライブ (RFC 5389 Binding Indication). connect()済みソケット用.
+    inline int SendKeepalive(int sock)
+    {
+        uint8_t sbuf[kStunHeaderSize];
+        StunMessageWriter keepalive(sbuf, sizeof(sbuf), kStunBindingIndication, StunTransactionId::Random());
+        return (int)send(sock, sbuf, keepalive.size(), 0);
+    }
+
+    struct PunchCandidate
+    {
+        struct sockaddr_storage mAddress;
+        StunTransactionId mId; // 候補毎のCheckのトランザクションID
+        std::chrono::steady_clock::time_point mLastSend;
+    };
+
+    inline void AddPunchCandidate(std::vector<PunchCandidate> &candidates, const struct sockaddr_storage &address)
+    {
+        if (candidates.size() >= kPunchMaxCandidates || EndpointPort((const struct sockaddr *)&address) == 0)
+        {
+            return;
+        }
+        for (const PunchCandidate &candidate : candidates)
+        {
+            if (SameEndpoint((const struct sockaddr *)&candidate.mAddress, (const struct sockaddr *)&address))
+            {
+                return;
+            }
+        }
+        PunchCandidate candidate;
+        candidate.mAddress = address;
+        candidate.mId = StunTransactionId::Random();
+        candidates.push_back(candidate);
+    }
+
+    /**
+     * @brief ランデブー経由で相手と直接つながったUDPソケットを得る
+     *
+     * @param rendezvous ランデブーサーバ "ip[:port]" / "[v6][:port]"
+     * @return int 0: 成功, -1: アドレス不正, -2: ソケットエラー, -3: ランデブー応答無し, -4: パンチ失敗
+     */
+    inline int HolePunchConnect(const std::string &rendezvous,
+                                const std::string &self_id,
+                                const std::string &peer_id,
+                                const HolePunchOptions &options,
+                                HolePunchResult *result)
+    {
+        using clock = std::chrono::steady_clock;
+        using milliseconds = std::chrono::milliseconds;
+
+        struct sockaddr_storage server;
+        if (self_id.empty() || self_id.size() > kPunchMaxIdLength || peer_id.empty() ||
+            peer_id.size() > kPunchMaxIdLength || !ParseEndpoint(rendezvous, kPunchDefaultPort, &server))
+        {
+            return -1;
+        }
+        const struct sockaddr *server_addr = (const struct sockaddr *)&server;
+
+        /* 1.ソケットとhost候補 */
+        int sock = socket(server.ss_family, SOCK_DGRAM, 0);
+        if (sock < 0)
+        {
+            return -2;
+        }
+        struct sockaddr_storage local;
+        std::memset(&local, 0, sizeof(local));
+        local.ss_family = server.ss_family;
+        SetEndpointPort((struct sockaddr *)&local, options.mLocalPort);
+        socklen_t local_length = sizeof(local);
+        if (bind(sock, (struct sockaddr *)&local, EndpointLength((struct sockaddr *)&local)) != 0 ||
+            getsockname(sock, (struct sockaddr *)&local, &local_length) != 0)
+        {
+            close(sock);
+            return -2;
+        }
+        uint16_t local_port = EndpointPort((struct sockaddr *)&local);
+
+        // ランデブーへの経路の送信元アドレス (connectしたUDPは何も送らない)
+        struct sockaddr_storage host;
+        std::memset(&host, 0, sizeof(host));
+        int route = socket(server.ss_family, SOCK_DGRAM, 0);
+        socklen_t host_length = sizeof(host);
+        if (route >= 0 && connect(route, server_addr, EndpointLength(server_addr)) == 0 &&
+            getsockname(route, (struct sockaddr *)&host, &host_length) == 0)
+        {
+            SetEndpointPort((struct sockaddr *)&host, local_port);
+        }
+        if (route >= 0)
+        {
+            close(route);
+        }
+
+        /* 2.登録とパンチ */
+        uint8_t buf[1500];
+        uint8_t sbuf[1500];
+        StunTransactionId register_id = StunTransactionId::Random();
+        std::vector<PunchCandidate> candidates;
+        struct sockaddr_storage selected;
+        std::memset(&selected, 0, sizeof(selected));
+        std::memset(&result->mMapped, 0, sizeof(result->mMapped));
+        bool registered = false;
+        bool have_peer = false;
+        bool confirmed = false;
+        bool got_request = false;
+        int peer_lifetime = options.mBindingLifetimeSec;
+        int register_rto = 200;
+        double rtt_ms = -1.0;
+
+        clock::time_point start = clock::now();
+        clock::time_point deadline = start + milliseconds(options.mTimeoutMs);
+        clock::time_point next_register = start;
+        clock::time_point next_check = start;
+        clock::time_point linger_until = clock::time_point::max();
+
+        while (true)
+        {
+            clock::time_point now = clock::now();
+            if (confirmed && got_request && linger_until == clock::time_point::max())
+            {
+                linger_until = now + milliseconds(options.mLingerMs);
+            }
+            if (now >= linger_until || (now >= deadline && confirmed))
+            {
+                break;
+            }
+            if (now >= deadline)
+            {
+                close(sock);
+                return registered ? -4 : -3;
+            }
+
+            // ランデブーへ登録 (相手の候補が届くまで. 応答前はRTOで再送, 以降は1秒毎)
+            if (!have_peer && now >= next_register)
+            {
+                StunMessageWriter reg(sbuf, sizeof(sbuf), kPunchRegisterRequest, register_id);
+                reg.addAttribute(kPunchAttrPeerId, self_id.data(), (uint16_t)self_id.size());
+                reg.addAttribute(kPunchAttrTargetId, peer_id.data(), (uint16_t)peer_id.size());
+                if (host.ss_family != 0)
+                {
+                    reg.addAddress(kPunchAttrCandidate, (const struct sockaddr *)&host, true);
+                }
+                reg.addUint32(kPunchAttrLifetime, (uint32_t)options.mBindingLifetimeSec);
+                sendto(sock, sbuf, reg.size(), 0, server_addr, EndpointLength(server_addr));
+                next_register = now + milliseconds(registered ? 1000 : register_rto);
+                register_rto = std::min(register_rto * 2, 1000);
+            }
+
+            // 全候補へCheck (応答が来るまで)
+            if (have_peer && !confirmed && now >= next_check)
+            {
+                for (PunchCandidate &candidate : candidates)
+                {
+                    StunMessageWriter check(sbuf, sizeof(sbuf), kPunchCheckRequest, candidate.mId);
+                    check.addAttribute(kPunchAttrPeerId, self_id.data(), (uint16_t)self_id.size());
+                    const struct sockaddr *to = (const struct sockaddr *)&candidate.mAddress;
+                    sendto(sock, sbuf, check.size(), 0, to, EndpointLength(to));
+                    candidate.mLastSend = now;
+                }
+                next_check = now + milliseconds(options.mCheckIntervalMs);
+            }
+
+            // 次のイベントまで待つ
+            clock::time_point wake = std::min(deadline, linger_until);
+            if (!have_peer)
+            {
+                wake = std::min(wake, next_register);
+            }
+            else if (!confirmed)
+            {
+                wake = std::min(wake, next_check);
+            }
+            int wait_ms = (int)std::chrono::duration_cast<milliseconds>(wake - now).count();
+            struct pollfd target;
+            target.fd = sock;
+            target.events = POLLIN;
+            target.revents = 0;
+            if (poll(&target, 1, std::max(0, wait_ms) + 1) <= 0)
+            {
+                continue;
+            }
+
+            // 溜まっている分を全て読む
+            while (true)
+            {
+                struct sockaddr_storage from;
+                socklen_t from_length = sizeof(from);
+                ssize_t n = recvfrom(sock, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr *)&from, &from_length);
+                if (n < 0)
+                {
+                    break;
+                }
+                StunMessageView msg(buf, (size_t)n);
+                if (!msg.valid())
+                {
+                    continue;
+                }
+                now = clock::now();
+
+                if ((msg.type() == kPunchRegisterSuccess || msg.type() == kPunchPeerIndication) &&
+                    SameEndpoint((const struct sockaddr *)&from, server_addr))
+                {
+                    if (msg.type() == kPunchRegisterSuccess)
+                    {
+                        if (msg.transactionId() != register_id)
+                        {
+                            continue;
+                        }
+                        registered = true;
+                        msg.mappedAddress(&result->mMapped);
+                    }
+                    if (msg.attributeString(kPunchAttrPeerId) != peer_id)
+                    {
+                        continue; // 相手はまだ登録していない
+                    }
+                    struct sockaddr_storage candidate;
+                    for (size_t i = 0; msg.address(kPunchAttrCandidate, &candidate, true, i); ++i)
+                    {
+                        AddPunchCandidate(candidates, candidate);
+                    }
+                    peer_lifetime = (int)msg.attributeUint32(kPunchAttrLifetime, (uint32_t)peer_lifetime);
+                    if (!have_peer)
+                    {
+                        have_peer = true;
+                        next_check = now; // すぐに打ち始める
+                    }
+                }
+                else if (msg.type() == kPunchCheckRequest && msg.attributeString(kPunchAttrPeerId) == peer_id)
+                {
+                    // 相手からの受信方向は開通. 送信元へ応答する.
+                    StunMessageWriter success(sbuf, sizeof(sbuf), kPunchCheckSuccess, msg.transactionId());
+                    success.addAddress(kStunAttrXorMappedAddress, (const struct sockaddr *)&from, true);
+                    sendto(sock, sbuf, success.size(), 0, (const struct sockaddr *)&from, from_length);
+                    got_request = true;
+                    AddPunchCandidate(candidates, from); // peer reflexive
+                    if (!have_peer)
+                    {
+                        have_peer = true;
+                        next_check = now;
+                    }
+                }
+                else if (msg.type() == kPunchCheckSuccess && !confirmed)
+                {
+                    for (const PunchCandidate &candidate : candidates)
+                    {
+                        if (candidate.mId == msg.transactionId())
+                        {
+                            confirmed = true;
+                            selected = from; // 実際に応答が来たアドレスを使う
+                            rtt_ms = std::chrono::duration<double, std::milli>(now - candidate.mLastSend).count();
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        /* 3.相手に固定 */
+        if (connect(sock, (const struct sockaddr *)&selected, EndpointLength((const struct sockaddr *)&selected)) != 0)
+        {
+            close(sock);
+            return -2;
+        }
+        result->mSocket = sock;
+        result->mPeer = selected;
+        result->mRttMs = rtt_ms;
+        result->mKeepaliveSec = KeepaliveInterval(std::min(options.mBindingLifetimeSec, peer_lifetime), rtt_ms);
+        return 0;
+    }
+} // namespace net
+} // namespace is
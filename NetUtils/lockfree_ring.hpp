@@ -0,0 +1,348 @@
+/**
+ * @file lockfree_ring.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 受信スレッドと処理スレッドの間で使うロックフリーのリングバッファ
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * + SpscRing   : 1対1. 読み書き位置を別のキャッシュラインに置き, 相手側の位置はキャッシュして
+ *                必要なときだけ読み直す(キャッシュラインの行き来を減らす).
+ * + MpmcRing   : 多対多の有界キュー (D. Vyukov). セル毎のシーケンス番号で所有権を渡す.
+ * + DisruptorRing: 1生産者, 複数消費者のブロードキャスト(LMAX Disruptor). 各消費者は全要素を順に読み,
+ *                生産者は最も遅い消費者を追い越さない. 消費者間の依存(統計の後に表示, など)も張れる.
+ *
+ * 容量は2の冪に切り上げる. 要素は固定長の記述子(バッファの番号と長さなど)を想定している.
+ * 待ち方(スピン/yield/sleep)は呼び出し側がBackoffで選ぶ.
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // _mm_pause
+#endif
+
+namespace is
+{
+namespace net
+{
+    constexpr size_t kCacheLineSize = 64;
+
+    inline void CpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    // 空振りが続いたらスピン -> yield -> 短いsleepの順に引いていく
+    class Backoff
+    {
+    public:
+        void pause()
+        {
+            if (mCount < 64)
+            {
+                CpuRelax();
+            }
+            else if (mCount < 128)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            ++mCount;
+        }
+        void reset() { mCount = 0; }
+
+    private:
+        uint32_t mCount = 0;
+    };
+
+    inline size_t RoundUpPowerOfTwo(size_t n)
+    {
+        size_t power = 1;
+        while (power < n)
+        {
+            power <<= 1;
+        }
+        return power;
+    }
+
+    /////////////////////////////////////////////////////////////
+    // SPSC
+    /////////////////////////////////////////////////////////////
+    template <typename T>
+    class SpscRing
+    {
+    public:
+        explicit SpscRing(size_t capacity)
+            : mMask(RoundUpPowerOfTwo(std::max<size_t>(capacity, 2)) - 1)
+            , mSlots(new T[mMask + 1])
+        {
+        }
+
+        SpscRing(const SpscRing &) = delete;
+        SpscRing &operator=(const SpscRing &) = delete;
+
+        // 生産者スレッドのみ
+        bool tryPush(const T &value) { return emplace(value); }
+        bool tryPush(T &&value) { return emplace(std::move(value)); }
+
+        // 消費者スレッドのみ. 要素はムーブで取り出す(参照カウント付きの要素をリングに残さない).
+        bool tryPop(T &value)
+        {
+            size_t head = mHead.load(std::memory_order_relaxed);
+            if (head == mCachedTail)
+            {
+                mCachedTail = mTail.load(std::memory_order_acquire);
+                if (head == mCachedTail)
+                {
+                    return false; // 空
+                }
+            }
+            value = std::move(mSlots[head & mMask]);
+            mHead.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        size_t capacity() const { return mMask + 1; }
+        size_t sizeApprox() const
+        {
+            return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire);
+        }
+
+    private:
+        template <typename U>
+        bool emplace(U &&value)
+        {
+            size_t tail = mTail.load(std::memory_order_relaxed);
+            if (tail - mCachedHead > mMask)
+            {
+                mCachedHead = mHead.load(std::memory_order_acquire);
+                if (tail - mCachedHead > mMask)
+                {
+                    return false; // 満杯
+                }
+            }
+            mSlots[tail & mMask] = std::forward<U>(value);
+            mTail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        const size_t mMask;
+        std::unique_ptr<T[]> mSlots;
+
+        alignas(kCacheLineSize) std::atomic<size_t> mHead{0}; // 消費者が書く
+        size_t mCachedTail = 0;                               // 消費者が見たmTail
+        alignas(kCacheLineSize) std::atomic<size_t> mTail{0}; // 生産者が書く
+        size_t mCachedHead = 0;                               // 生産者が見たmHead
+    };
+
+    /////////////////////////////////////////////////////////////
+    // MPMC (有界)
+    /////////////////////////////////////////////////////////////
+    template <typename T>
+    class MpmcRing
+    {
+    public:
+        explicit MpmcRing(size_t capacity)
+            : mMask(RoundUpPowerOfTwo(std::max<size_t>(capacity, 2)) - 1)
+            , mCells(new Cell[mMask + 1])
+        {
+            for (size_t i = 0; i <= mMask; ++i)
+            {
+                mCells[i].mSequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        MpmcRing(const MpmcRing &) = delete;
+        MpmcRing &operator=(const MpmcRing &) = delete;
+
+        bool tryPush(const T &value) { return emplace(value); }
+        bool tryPush(T &&value) { return emplace(std::move(value)); }
+
+        bool tryPop(T &value)
+        {
+            size_t position = mDequeue.load(std::memory_order_relaxed);
+            while (true)
+            {
+                Cell &cell = mCells[position & mMask];
+                size_t sequence = cell.mSequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)sequence - (intptr_t)(position + 1);
+                if (diff == 0)
+                {
+                    if (mDequeue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        value = std::move(cell.mValue);
+                        cell.mSequence.store(position + mMask + 1, std::memory_order_release); // 次の周の生産者へ
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false; // 空
+                }
+                else
+                {
+                    position = mDequeue.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        size_t capacity() const { return mMask + 1; }
+
+    private:
+        template <typename U>
+        bool emplace(U &&value)
+        {
+            size_t position = mEnqueue.load(std::memory_order_relaxed);
+            while (true)
+            {
+                Cell &cell = mCells[position & mMask];
+                size_t sequence = cell.mSequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+                if (diff == 0)
+                {
+                    if (mEnqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        cell.mValue = std::forward<U>(value);
+                        cell.mSequence.store(position + 1, std::memory_order_release); // 消費者へ
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false; // 満杯 (1周前の要素がまだ読まれていない)
+                }
+                else
+                {
+                    position = mEnqueue.load(std::memory_order_relaxed); // 他の生産者に取られた
+                }
+            }
+        }
+
+        struct alignas(kCacheLineSize) Cell
+        {
+            std::atomic<size_t> mSequence;
+            T mValue;
+        };
+
+        const size_t mMask;
+        std::unique_ptr<Cell[]> mCells;
+        alignas(kCacheLineSize) std::atomic<size_t> mEnqueue{0};
+        alignas(kCacheLineSize) std::atomic<size_t> mDequeue{0};
+    };
+
+    /////////////////////////////////////////////////////////////
+    // Disruptor (1生産者, 複数消費者)
+    /////////////////////////////////////////////////////////////
+    template <typename T>
+    class DisruptorRing
+    {
+    public:
+        static constexpr size_t kNoUpstream = (size_t)-1;
+
+        DisruptorRing(size_t capacity, size_t num_consumers)
+            : mMask(RoundUpPowerOfTwo(std::max<size_t>(capacity, 2)) - 1)
+            , mSlots(new T[mMask + 1])
+            , mConsumers(num_consumers)
+            , mUpstream(num_consumers, kNoUpstream)
+        {
+        }
+
+        DisruptorRing(const DisruptorRing &) = delete;
+        DisruptorRing &operator=(const DisruptorRing &) = delete;
+
+        // consumerはupstreamが処理し終えた要素だけを読む (起動前に設定する)
+        void setUpstream(size_t consumer, size_t upstream) { mUpstream[consumer] = upstream; }
+
+        /* 生産者 */
+
+        // 次に書く番号を確保する. 最も遅い消費者が1周前の要素を読み終えていなければfalse.
+        bool tryClaim(int64_t *sequence)
+        {
+            int64_t next = mClaimed + 1;
+            if (next - (int64_t)(mMask + 1) > mCachedGate)
+            {
+                mCachedGate = minimumConsumer();
+                if (next - (int64_t)(mMask + 1) > mCachedGate)
+                {
+                    return false;
+                }
+            }
+            mClaimed = next;
+            *sequence = next;
+            return true;
+        }
+
+        T &operator[](int64_t sequence) { return mSlots[(size_t)sequence & mMask]; }
+        const T &operator[](int64_t sequence) const { return mSlots[(size_t)sequence & mMask]; }
+
+        // sequenceまでを消費者に見せる
+        void publish(int64_t sequence) { mCursor.mValue.store(sequence, std::memory_order_release); }
+
+        /* 消費者 (シーケンスバリア) */
+
+        // consumerが読んでよい最後の番号. 自分の位置と同じなら新しい要素は無い.
+        int64_t available(size_t consumer) const
+        {
+            int64_t limit = mCursor.mValue.load(std::memory_order_acquire);
+            if (mUpstream[consumer] != kNoUpstream)
+            {
+                limit = std::min(limit, mConsumers[mUpstream[consumer]].mValue.load(std::memory_order_acquire));
+            }
+            return limit;
+        }
+
+        int64_t position(size_t consumer) const { return mConsumers[consumer].mValue.load(std::memory_order_relaxed); }
+
+        // sequenceまで読み終えた (その領域を生産者に返す)
+        void release(size_t consumer, int64_t sequence)
+        {
+            mConsumers[consumer].mValue.store(sequence, std::memory_order_release);
+        }
+
+        size_t capacity() const { return mMask + 1; }
+
+    private:
+        struct alignas(kCacheLineSize) PaddedSequence
+        {
+            std::atomic<int64_t> mValue{-1};
+        };
+
+        int64_t minimumConsumer() const
+        {
+            int64_t minimum = mCursor.mValue.load(std::memory_order_relaxed);
+            for (const PaddedSequence &consumer : mConsumers)
+            {
+                minimum = std::min(minimum, consumer.mValue.load(std::memory_order_acquire));
+            }
+            return minimum;
+        }
+
+        const size_t mMask;
+        std::unique_ptr<T[]> mSlots;
+        std::vector<PaddedSequence> mConsumers;
+        std::vector<size_t> mUpstream;
+        PaddedSequence mCursor;                        // 公開済みの最後の番号
+        alignas(kCacheLineSize) int64_t mClaimed = -1; // 生産者だけが触る
+        int64_t mCachedGate = -1;
+    };
+} // namespace net
+} // namespace is
@@ -0,0 +1,611 @@
+/**
+ * @file metrics.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief スレッド毎に分けたカウンタ・ゲージ・対数線形ヒストグラムとPrometheusのテキスト形式での公開
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * + 値はスレッド毎のシャードに持ち, 書くのはそのスレッドだけ. 更新はrelaxedのload + store
+ *   (ロック接頭辞の付くfetch_addではなく, 普通のmov/addになる). 他のスレッドとキャッシュラインを取り合わない.
+ * + 集計はスクレイプ時に全シャードを足す. 終わったスレッドのシャードは退避用のシャードへ畳む.
+ * + 登録(名前・ヘルプ・ラベル)は起動時にロックを取って行い, 以後は番号(ハンドル)で更新する.
+ * + ヒストグラムは2のべき毎に4分割した対数線形のバケット(相対誤差25%以下, 1ns〜約18分). 値はns, 公開は秒.
+ *   時間以外(輻輳ウィンドウのセグメント数など)は公開の倍率を1にして整数のまま出す.
+ * + ErrnoCounter: errno毎のカウンタ(ラベルerrno="ECONNREFUSED"). 0でないものだけ公開する.
+ * + MetricsHttpServer: GET /metrics に答える小さなHTTPサーバ(別スレッド, 1接続ずつ).
+ * + NetMetrics: 受信/送信/accept/ドロップ/タイムアウト/errno毎のエラー/処理時間の組み込みのメトリクス.
+ *
+ * ゲージはスレッド毎の増減の合計(add/sub). 絶対値を置くset()は無い.
+ * 登録の数が上限を超えたら例外にせず, 捨て場のセル(公開しない)を指すハンドルを返して
+ * ipnetweb_metrics_dropped_registrations_total を数える. ワーカスレッドの中の登録でも落ちない.
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <algorithm> // std::min
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace is
+{
+namespace net
+{
+    constexpr size_t kMetricsMaxCells = 4096;       // スレッド毎のカウンタ/ゲージの数 (ErrnoCounterはkErrnoSlots個使う)
+    constexpr size_t kMetricsMaxHistograms = 16;
+    constexpr size_t kHistogramSubBuckets = 4;      // 2のべき毎の分割数
+    constexpr size_t kHistogramMaxExponent = 40;    // 2^40 ns ≒ 18分 (超えたら最後のバケット)
+    constexpr size_t kHistogramBuckets = kHistogramSubBuckets + (kHistogramMaxExponent - 1) * kHistogramSubBuckets;
+    constexpr size_t kErrnoSlots = 160;
+    constexpr uint32_t kMetricsDiscardCell = (uint32_t)kMetricsMaxCells;           // 登録できなかったカウンタ/ゲージ/ErrnoCounter
+    constexpr uint32_t kMetricsDiscardHistogram = (uint32_t)kMetricsMaxHistograms; // 登録できなかったヒストグラム
+
+    // 値 -> バケット. 0..3はそのまま, 以降は2のべき毎に4分割
+    inline size_t HistogramBucket(uint64_t value)
+    {
+        if (value < kHistogramSubBuckets)
+        {
+            return (size_t)value;
+        }
+        size_t exponent = (size_t)(63 - __builtin_clzll(value)); // >= 2
+        size_t mantissa = (size_t)(value >> (exponent - 2)) & (kHistogramSubBuckets - 1);
+        size_t bucket = kHistogramSubBuckets + (exponent - 2) * kHistogramSubBuckets + mantissa;
+        return bucket < kHistogramBuckets ? bucket : kHistogramBuckets - 1;
+    }
+
+    // バケットの下限 (上限は次のバケットの下限 - 1)
+    inline uint64_t HistogramBucketLower(size_t bucket)
+    {
+        if (bucket < kHistogramSubBuckets)
+        {
+            return (uint64_t)bucket;
+        }
+        size_t exponent = (bucket - kHistogramSubBuckets) / kHistogramSubBuckets + 2;
+        uint64_t mantissa = (bucket - kHistogramSubBuckets) % kHistogramSubBuckets;
+        return (kHistogramSubBuckets + mantissa) << (exponent - 2);
+    }
+
+    // 書くのは持ち主のスレッドだけなので, 読み書きを分けた加算で足りる
+    inline void MetricsAdd(std::atomic<uint64_t> &cell, uint64_t delta)
+    {
+        cell.store(cell.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    // ヒストグラムに入れる時間の時計 (ns)
+    inline uint64_t MetricsClockNs()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    struct alignas(64) MetricsShard
+    {
+        std::atomic<uint64_t> mCells[kMetricsMaxCells + kErrnoSlots] = {}; // 末尾は捨て場
+        struct Histogram
+        {
+            std::atomic<uint64_t> mBuckets[kHistogramBuckets] = {};
+            std::atomic<uint64_t> mSum{0};
+        };
+        Histogram mHistograms[kMetricsMaxHistograms + 1]; // 末尾は捨て場
+    };
+
+    enum MetricType : uint8_t
+    {
+        kMetricCounter,
+        kMetricGauge,
+        kMetricHistogram,
+        kMetricErrno,
+    };
+
+    struct MetricInfo
+    {
+        std::string mName;
+        std::string mHelp;
+        std::string mLabels; // `op="recv"` のような中身 (波括弧なし)
+        MetricType mType;
+        uint32_t mIndex; // セル / ヒストグラムの番号
+        double mScale;   // ヒストグラム: 公開時に値へ掛ける倍率 (ns -> 秒は1e-9)
+    };
+
+    const char *ErrnoName(int error);
+
+    class MetricsRegistry
+    {
+    public:
+        static MetricsRegistry &instance()
+        {
+            static MetricsRegistry registry;
+            return registry;
+        }
+
+        MetricsRegistry(const MetricsRegistry &) = delete;
+        MetricsRegistry &operator=(const MetricsRegistry &) = delete;
+
+        // 呼び出したスレッドのシャード (初回に登録)
+        MetricsShard &local()
+        {
+            thread_local std::shared_ptr<MetricsShard> shard = registerThread();
+            return *shard;
+        }
+
+        // 同じ名前とラベルなら同じ番号を返す. 数が尽きたら捨て場の番号を返し, 落とした登録を数える.
+        uint32_t add(const char *name, const char *help, const std::string &labels, MetricType type, double scale = 1e-9)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            for (const MetricInfo &info : mMetrics)
+            {
+                if (info.mName == name && info.mLabels == labels && info.mType == type)
+                {
+                    return info.mIndex;
+                }
+            }
+            uint32_t index;
+            if (type == kMetricHistogram)
+            {
+                if (mNextHistogram >= kMetricsMaxHistograms)
+                {
+                    ++mDroppedRegistrations;
+                    return kMetricsDiscardHistogram;
+                }
+                index = mNextHistogram++;
+            }
+            else
+            {
+                size_t cells = type == kMetricErrno ? kErrnoSlots : 1;
+                if (mNextCell + cells > kMetricsMaxCells)
+                {
+                    ++mDroppedRegistrations;
+                    return kMetricsDiscardCell;
+                }
+                index = (uint32_t)mNextCell;
+                mNextCell += cells;
+            }
+            mMetrics.push_back(MetricInfo{name, help, labels, type, index, scale});
+            return index;
+        }
+
+        // Prometheusのテキスト形式 (version 0.0.4)
+        std::string scrape()
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            retireFinishedThreads();
+
+            std::string out;
+            // 同じ名前の系列はまとめて出す (テキスト形式の決まり. 登録が離れていても)
+            std::vector<bool> emitted(mMetrics.size(), false);
+            std::vector<const MetricInfo *> ordered;
+            for (size_t i = 0; i < mMetrics.size(); ++i)
+            {
+                if (emitted[i])
+                {
+                    continue;
+                }
+                const MetricInfo &family = mMetrics[i];
+                const char *type = family.mType == kMetricGauge ? "gauge" : family.mType == kMetricHistogram ? "histogram" : "counter";
+                out += "# HELP " + family.mName + " " + family.mHelp + "\n";
+                out += "# TYPE " + family.mName + " " + type + "\n";
+                ordered.clear();
+                for (size_t j = i; j < mMetrics.size(); ++j)
+                {
+                    if (!emitted[j] && mMetrics[j].mName == family.mName)
+                    {
+                        emitted[j] = true;
+                        ordered.push_back(&mMetrics[j]);
+                    }
+                }
+                for (const MetricInfo *series : ordered)
+                {
+                    appendSeries(out, *series);
+                }
+            }
+            char line[64];
+            std::snprintf(line, sizeof(line), " %llu\n", (unsigned long long)mDroppedRegistrations);
+            out += "# HELP ipnetweb_metrics_dropped_registrations_total Metrics not registered because the registry was full\n";
+            out += "# TYPE ipnetweb_metrics_dropped_registrations_total counter\n";
+            out += std::string("ipnetweb_metrics_dropped_registrations_total") + line;
+            return out;
+        }
+
+    private:
+        MetricsRegistry() : mRetired(new MetricsShard()) {}
+
+        void appendSeries(std::string &out, const MetricInfo &info) const
+        {
+            char line[256];
+            std::string labels = info.mLabels;
+            switch (info.mType)
+            {
+            case kMetricCounter:
+                std::snprintf(line, sizeof(line), " %llu\n", (unsigned long long)sumCell(info.mIndex));
+                out += info.mName + braces(labels) + line;
+                break;
+            case kMetricGauge:
+                std::snprintf(line, sizeof(line), " %lld\n", (long long)(int64_t)sumCell(info.mIndex));
+                out += info.mName + braces(labels) + line;
+                break;
+            case kMetricErrno:
+                for (size_t slot = 0; slot < kErrnoSlots; ++slot)
+                {
+                    uint64_t value = sumCell(info.mIndex + (uint32_t)slot);
+                    if (value == 0)
+                    {
+                        continue;
+                    }
+                    std::string with_errno = labels + (labels.empty() ? "" : ",") + "errno=\"" + ErrnoName((int)slot) + "\"";
+                    std::snprintf(line, sizeof(line), " %llu\n", (unsigned long long)value);
+                    out += info.mName + braces(with_errno) + line;
+                }
+                break;
+            case kMetricHistogram:
+                appendHistogram(out, info);
+                break;
+            }
+        }
+
+        static std::string braces(const std::string &labels)
+        {
+            return labels.empty() ? std::string() : "{" + labels + "}";
+        }
+
+        std::shared_ptr<MetricsShard> registerThread()
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto shard = std::make_shared<MetricsShard>();
+            mShards.push_back(shard);
+            return shard;
+        }
+
+        // 終わったスレッド(レジストリしか持っていない)のシャードを退避用へ足す. mMutexを持って呼ぶ.
+        void retireFinishedThreads()
+        {
+            for (size_t i = 0; i < mShards.size();)
+            {
+                if (mShards[i].use_count() != 1)
+                {
+                    ++i;
+                    continue;
+                }
+                const MetricsShard &done = *mShards[i];
+                for (size_t c = 0; c < kMetricsMaxCells; ++c)
+                {
+                    MetricsAdd(mRetired->mCells[c], done.mCells[c].load(std::memory_order_relaxed));
+                }
+                for (size_t h = 0; h < kMetricsMaxHistograms; ++h)
+                {
+                    for (size_t b = 0; b < kHistogramBuckets; ++b)
+                    {
+                        MetricsAdd(mRetired->mHistograms[h].mBuckets[b], done.mHistograms[h].mBuckets[b].load(std::memory_order_relaxed));
+                    }
+                    MetricsAdd(mRetired->mHistograms[h].mSum, done.mHistograms[h].mSum.load(std::memory_order_relaxed));
+                }
+                mShards[i] = std::move(mShards.back());
+                mShards.pop_back();
+            }
+        }
+
+        uint64_t sumCell(uint32_t index) const
+        {
+            uint64_t total = mRetired->mCells[index].load(std::memory_order_relaxed);
+            for (const auto &shard : mShards)
+            {
+                total += shard->mCells[index].load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+        void appendHistogram(std::string &out, const MetricInfo &info) const
+        {
+            std::vector<uint64_t> buckets(kHistogramBuckets, 0);
+            uint64_t sum = 0;
+            auto collect = [&](const MetricsShard &shard) {
+                const MetricsShard::Histogram &histogram = shard.mHistograms[info.mIndex];
+                for (size_t b = 0; b < kHistogramBuckets; ++b)
+                {
+                    buckets[b] += histogram.mBuckets[b].load(std::memory_order_relaxed);
+                }
+                sum += histogram.mSum.load(std::memory_order_relaxed);
+            };
+            collect(*mRetired);
+            for (const auto &shard : mShards)
+            {
+                collect(*shard);
+            }
+
+            // 最初と最後の空でないバケットの間だけ出す (累積なので一度出たバケットは出続ける)
+            size_t first = kHistogramBuckets;
+            size_t last = 0;
+            for (size_t b = 0; b < kHistogramBuckets; ++b)
+            {
+                if (buckets[b] != 0)
+                {
+                    first = std::min(first, b);
+                    last = b;
+                }
+            }
+            std::string prefix = info.mLabels.empty() ? "{" : "{" + info.mLabels + ",";
+            char line[256];
+            uint64_t cumulative = 0;
+            for (size_t b = first; b <= last && first < kHistogramBuckets; ++b)
+            {
+                cumulative += buckets[b];
+                double upper = (double)(HistogramBucketLower(b + 1) - 1) * info.mScale;
+                std::snprintf(line, sizeof(line), "le=\"%.9g\"} %llu\n", upper, (unsigned long long)cumulative);
+                out += info.mName + "_bucket" + prefix + line;
+            }
+            std::snprintf(line, sizeof(line), "le=\"+Inf\"} %llu\n", (unsigned long long)cumulative);
+            out += info.mName + "_bucket" + prefix + line;
+            std::snprintf(line, sizeof(line), " %.9g\n", (double)sum * info.mScale);
+            out += info.mName + "_sum" + braces(info.mLabels) + line;
+            std::snprintf(line, sizeof(line), " %llu\n", (unsigned long long)cumulative);
+            out += info.mName + "_count" + braces(info.mLabels) + line;
+        }
+
+        std::mutex mMutex; // 登録とスクレイプだけ
+        std::vector<MetricInfo> mMetrics;
+        std::vector<std::shared_ptr<MetricsShard>> mShards;
+        std::unique_ptr<MetricsShard> mRetired;
+        size_t mNextCell = 0;
+        uint32_t mNextHistogram = 0;
+        uint64_t mDroppedRegistrations = 0;
+    };
+
+    /////////////////////////////////////////////////////////////
+    // ハンドル (登録は起動時, 更新はホットパス)
+    /////////////////////////////////////////////////////////////
+    class Counter
+    {
+    public:
+        Counter(const char *name, const char *help, const std::string &labels = std::string())
+            : mIndex(MetricsRegistry::instance().add(name, help, labels, kMetricCounter)) {}
+        void inc(uint64_t n = 1) const { MetricsAdd(MetricsRegistry::instance().local().mCells[mIndex], n); }
+
+    private:
+        uint32_t mIndex;
+    };
+
+    class Gauge
+    {
+    public:
+        Gauge(const char *name, const char *help, const std::string &labels = std::string())
+            : mIndex(MetricsRegistry::instance().add(name, help, labels, kMetricGauge)) {}
+        void add(int64_t n) const { MetricsAdd(MetricsRegistry::instance().local().mCells[mIndex], (uint64_t)n); }
+        void sub(int64_t n) const { add(-n); }
+
+    private:
+        uint32_t mIndex;
+    };
+
+    class ErrnoCounter
+    {
+    public:
+        ErrnoCounter(const char *name, const char *help, const std::string &labels = std::string())
+            : mIndex(MetricsRegistry::instance().add(name, help, labels, kMetricErrno)) {}
+        void inc(int error) const
+        {
+            size_t slot = error > 0 && (size_t)error < kErrnoSlots ? (size_t)error : 0; // 0: 範囲外
+            MetricsAdd(MetricsRegistry::instance().local().mCells[mIndex + slot], 1);
+        }
+
+    private:
+        uint32_t mIndex;
+    };
+
+    class Histogram
+    {
+    public:
+        Histogram(const char *name, const char *help, const std::string &labels = std::string(), double scale = 1e-9)
+            : mIndex(MetricsRegistry::instance().add(name, help, labels, kMetricHistogram, scale)) {}
+        void record(uint64_t value) const
+        {
+            MetricsShard::Histogram &histogram = MetricsRegistry::instance().local().mHistograms[mIndex];
+            MetricsAdd(histogram.mBuckets[HistogramBucket(value)], 1);
+            MetricsAdd(histogram.mSum, value);
+        }
+
+    private:
+        uint32_t mIndex;
+    };
+
+    inline const char *ErrnoName(int error)
+    {
+        switch (error)
+        {
+        case 0: return "other";
+        case EPERM: return "EPERM";
+        case EINTR: return "EINTR";
+        case EBADF: return "EBADF";
+        case EAGAIN: return "EAGAIN";
+        case ENOMEM: return "ENOMEM";
+        case EACCES: return "EACCES";
+        case EFAULT: return "EFAULT";
+        case EINVAL: return "EINVAL";
+        case ENFILE: return "ENFILE";
+        case EMFILE: return "EMFILE";
+        case EPIPE: return "EPIPE";
+        case EMSGSIZE: return "EMSGSIZE";
+        case EADDRINUSE: return "EADDRINUSE";
+        case EADDRNOTAVAIL: return "EADDRNOTAVAIL";
+        case ENETDOWN: return "ENETDOWN";
+        case ENETUNREACH: return "ENETUNREACH";
+        case ECONNABORTED: return "ECONNABORTED";
+        case ECONNRESET: return "ECONNRESET";
+        case ENOBUFS: return "ENOBUFS";
+        case ENOTCONN: return "ENOTCONN";
+        case ETIMEDOUT: return "ETIMEDOUT";
+        case ECONNREFUSED: return "ECONNREFUSED";
+        case EHOSTUNREACH: return "EHOSTUNREACH";
+        default:
+        {
+            static thread_local char number[16];
+            std::snprintf(number, sizeof(number), "%d", error);
+            return number;
+        }
+        }
+    }
+
+    /////////////////////////////////////////////////////////////
+    // 組み込みのメトリクス
+    /////////////////////////////////////////////////////////////
+    struct NetMetrics
+    {
+        static NetMetrics &instance()
+        {
+            static NetMetrics metrics;
+            return metrics;
+        }
+
+        Counter mAccepts{"ipnetweb_accepts_total", "Accepted TCP connections"};
+        Gauge mConnections{"ipnetweb_connections", "Open TCP connections"};
+        Counter mDatagramsReceived{"ipnetweb_datagrams_received_total", "Received UDP datagrams"};
+        Counter mDatagramsSent{"ipnetweb_datagrams_sent_total", "Sent UDP datagrams"};
+        Counter mBytesReceived{"ipnetweb_received_bytes_total", "Received payload bytes"};
+        Counter mBytesSent{"ipnetweb_sent_bytes_total", "Sent payload bytes"};
+        Counter mQueueDrops{"ipnetweb_drops_total", "Dropped datagrams", "reason=\"queue\""};
+        Counter mSocketDrops{"ipnetweb_drops_total", "Dropped datagrams", "reason=\"socket\""};
+        Counter mTimeouts{"ipnetweb_poll_timeouts_total", "poll() timeouts without events"};
+        ErrnoCounter mRecvErrors{"ipnetweb_errors_total", "Failed socket calls by errno", "op=\"recv\""};
+        ErrnoCounter mSendErrors{"ipnetweb_errors_total", "Failed socket calls by errno", "op=\"send\""};
+        ErrnoCounter mAcceptErrors{"ipnetweb_errors_total", "Failed socket calls by errno", "op=\"accept\""};
+        ErrnoCounter mPollErrors{"ipnetweb_errors_total", "Failed socket calls by errno", "op=\"poll\""};
+        Histogram mHandling{"ipnetweb_handling_seconds", "Time from receive (or accept) until the event was handled"};
+    };
+
+    /////////////////////////////////////////////////////////////
+    // GET /metrics (別スレッド)
+    /////////////////////////////////////////////////////////////
+    class MetricsHttpServer
+    {
+    public:
+        MetricsHttpServer() = default;
+        ~MetricsHttpServer() { stop(); }
+        MetricsHttpServer(const MetricsHttpServer &) = delete;
+        MetricsHttpServer &operator=(const MetricsHttpServer &) = delete;
+
+        // 全てのIPv4インターフェースのportで待ち受ける. 失敗したら-1 (errno)
+        int start(unsigned short port)
+        {
+            int sock = socket(AF_INET, SOCK_STREAM, 0);
+            if (sock < 0)
+            {
+                return -1;
+            }
+            const int on = 1;
+            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            struct sockaddr_in self;
+            std::memset(&self, 0, sizeof(self));
+            self.sin_family = AF_INET;
+            self.sin_port = htons(port);
+            self.sin_addr.s_addr = INADDR_ANY;
+            if (bind(sock, (struct sockaddr *)&self, sizeof(self)) != 0 || listen(sock, 8) != 0)
+            {
+                int saved = errno;
+                close(sock);
+                errno = saved;
+                return -1;
+            }
+            mSocket = sock;
+            mRunning.store(true);
+            mThread = std::thread([this]() { run(); });
+            return 0;
+        }
+
+        void stop()
+        {
+            if (mRunning.exchange(false))
+            {
+                mThread.join();
+                close(mSocket);
+                mSocket = -1;
+            }
+        }
+
+    private:
+        void run()
+        {
+            struct pollfd target;
+            target.fd = mSocket;
+            target.events = POLLIN;
+            while (mRunning.load(std::memory_order_relaxed))
+            {
+                target.revents = 0;
+                if (poll(&target, 1, 200) <= 0)
+                {
+                    continue;
+                }
+                int client = accept(mSocket, nullptr, nullptr);
+                if (client < 0)
+                {
+                    continue;
+                }
+                serve(client);
+                close(client);
+            }
+        }
+
+        static void serve(int client)
+        {
+            // 要求行だけ見る (ヘッダの残りは読み捨て)
+            struct timeval timeout = {1, 0};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            char request[1024];
+            ssize_t n = recv(client, request, sizeof(request) - 1, 0);
+            if (n <= 0)
+            {
+                return;
+            }
+            request[n] = '\0';
+
+            std::string body;
+            const char *status = "200 OK";
+            if (std::strncmp(request, "GET /metrics", 12) == 0 || std::strncmp(request, "GET / ", 6) == 0)
+            {
+                body = MetricsRegistry::instance().scrape();
+            }
+            else
+            {
+                status = "404 Not Found";
+                body = "not found\n";
+            }
+            char header[256];
+            int length = std::snprintf(header, sizeof(header),
+                                       "HTTP/1.1 %s\r\n"
+                                       "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                                       "Content-Length: %zu\r\n"
+                                       "Connection: close\r\n\r\n",
+                                       status, body.size());
+            std::string response(header, (size_t)length);
+            response += body;
+            size_t sent = 0;
+            while (sent < response.size())
+            {
+                ssize_t w = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                if (w <= 0)
+                {
+                    return;
+                }
+                sent += (size_t)w;
+            }
+        }
+
+        int mSocket = -1;
+        std::atomic<bool> mRunning{false};
+        std::thread mThread;
+    };
+} // namespace net
+} // namespace is
@@ -0,0 +1,488 @@
+/**
+ * @file multicast_group.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 1つのソケットで多数のマルチキャストグループ(SSM含む)に参加し, 宛先グループ毎のハンドラへ振り分ける
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * グループ毎にソケットを作ると, 数百チャンネルでファイル記述子とwakeupが数百になる.
+ * ここではファミリ毎に1つのソケットをワイルドカード:portにbindし, 全グループをそのソケットでJOINする.
+ * + 宛先グループはIP_PKTINFO / IPV6_RECVPKTINFOの補助データ(ヘッダの宛先アドレス)で知る.
+ * + グループ -> ハンドラはFlatHashMapで引く.
+ * + Linuxではrecvmmsgでまとめて受信し, IP_MULTICAST_ALL=0で他のソケットがJOINしたグループを受けない.
+ * + 送信元を指定するとMCAST_JOIN_SOURCE_GROUP(SSM). 同じグループに複数の送信元を足せる.
+ *
+ * @note Linuxの既定では1ソケットあたりのIPv4グループ数は20(net.ipv4.igmp_max_memberships),
+ * グループあたりの送信元数は10(net.ipv4.igmp_max_msf). 超えるとENOBUFSになるので大きくしておく.
+ */
+#pragma once
+
+#if defined(__MACH__) && !defined(__APPLE_USE_RFC_3542)
+#define __APPLE_USE_RFC_3542 // IPV6_RECVPKTINFO
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <net/if.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include <NetUtils/flat_hash_map.hpp>
+#include <NetUtils/packet_view.hpp>
+
+namespace is
+{
+namespace net
+{
+    // 宛先グループ (IPv4は先頭4バイト)
+    struct MulticastGroupKey
+    {
+        uint8_t mAddress[16];
+        uint8_t mFamily;
+
+        bool operator==(const MulticastGroupKey &other) const
+        {
+            return mFamily == other.mFamily && std::memcmp(mAddress, other.mAddress, sizeof(mAddress)) == 0;
+        }
+    };
+
+    struct MulticastGroupKeyHash
+    {
+        size_t operator()(const MulticastGroupKey &key) const
+        {
+            uint64_t hash = 14695981039346656037ull; // FNV-1a
+            for (uint8_t byte : key.mAddress)
+            {
+                hash = (hash ^ byte) * 1099511628211ull;
+            }
+            return (size_t)(hash ^ key.mFamily);
+        }
+    };
+
+    inline MulticastGroupKey MakeMulticastGroupKey(const struct sockaddr *address)
+    {
+        MulticastGroupKey key;
+        std::memset(&key, 0, sizeof(key));
+        key.mFamily = (uint8_t)address->sa_family;
+        if (address->sa_family == AF_INET)
+        {
+            std::memcpy(key.mAddress, &((const struct sockaddr_in *)address)->sin_addr, 4);
+        }
+        else
+        {
+            std::memcpy(key.mAddress, &((const struct sockaddr_in6 *)address)->sin6_addr, 16);
+        }
+        return key;
+    }
+
+    // ハンドラに渡す1データグラム. 参照先は呼び出しの間だけ有効.
+    struct MulticastDatagram
+    {
+        const struct sockaddr_storage *mSource; // 送信元
+        const struct sockaddr_storage *mGroup;  // 宛先グループ (ヘッダの宛先アドレス)
+        unsigned int mIfindex;                  // 受信したインターフェース
+        BytesView mPayload;
+    };
+
+    using MulticastHandler = std::function<void(const MulticastDatagram &)>;
+
+    class MulticastGroupReceiver
+    {
+    public:
+        static constexpr int kBatch = 32;
+        static constexpr size_t kBufferSize = 2048;
+
+        explicit MulticastGroupReceiver(uint16_t port) : mPort(port), mGroups(512) {}
+        ~MulticastGroupReceiver()
+        {
+            for (Family &family : mFamilies)
+            {
+                if (family.mSocket >= 0)
+                {
+                    close(family.mSocket);
+                }
+            }
+        }
+        MulticastGroupReceiver(const MulticastGroupReceiver &) = delete;
+        MulticastGroupReceiver &operator=(const MulticastGroupReceiver &) = delete;
+
+        /**
+         * @brief グループに参加する. sourceを指定するとそのソースからのみ受ける(SSM).
+         * 同じグループへの2回目以降はハンドラを置き換え, 送信元を足す.
+         * @param ifindex 0ならカーネルが経路表から選ぶ
+         * @return 成功: 0, 失敗: -1 (errnoを参照. ENOBUFSはグループ/送信元数の上限)
+         */
+        int join(const char *group, const char *source, unsigned int ifindex, MulticastHandler handler)
+        {
+            struct sockaddr_storage group_address, source_address;
+            if (!resolve(group, &group_address) || (source != nullptr && !resolve(source, &source_address)))
+            {
+                errno = EINVAL;
+                return -1;
+            }
+            if (source != nullptr && source_address.ss_family != group_address.ss_family)
+            {
+                errno = EAFNOSUPPORT;
+                return -1;
+            }
+            int sock = socketFor(group_address.ss_family);
+            if (sock < 0)
+            {
+                return -1;
+            }
+            if (membership(sock, true, &group_address, source != nullptr ? &source_address : nullptr, ifindex) != 0)
+            {
+                return -1;
+            }
+
+            MulticastGroupKey key = MakeMulticastGroupKey((const struct sockaddr *)&group_address);
+            std::pair<Group *, bool> entry = mGroups.emplace(key, Group());
+            entry.first->mHandler = std::move(handler);
+            entry.first->mJoins++;
+            return 0;
+        }
+
+        // joinと同じ引数で抜ける. そのグループの最後のメンバーシップならハンドラも外す.
+        int leave(const char *group, const char *source, unsigned int ifindex)
+        {
+            struct sockaddr_storage group_address, source_address;
+            if (!resolve(group, &group_address) || (source != nullptr && !resolve(source, &source_address)))
+            {
+                errno = EINVAL;
+                return -1;
+            }
+            int sock = socketFor(group_address.ss_family);
+            if (sock < 0 ||
+                membership(sock, false, &group_address, source != nullptr ? &source_address : nullptr, ifindex) != 0)
+            {
+                return -1;
+            }
+            MulticastGroupKey key = MakeMulticastGroupKey((const struct sockaddr *)&group_address);
+            Group *entry = mGroups.find(key);
+            if (entry != nullptr && --entry->mJoins <= 0)
+            {
+                mGroups.erase(key);
+            }
+            return 0;
+        }
+
+        /**
+         * @brief 受信できるまでtimeout_ms待ち, 溜まっている分を宛先グループのハンドラへ渡す
+         * @return 渡したデータグラム数. 失敗: -1
+         */
+        int poll(int timeout_ms)
+        {
+            struct pollfd targets[2];
+            int ntargets = 0;
+            for (Family &family : mFamilies)
+            {
+                if (family.mSocket >= 0)
+                {
+                    targets[ntargets].fd = family.mSocket;
+                    targets[ntargets].events = POLLIN;
+                    targets[ntargets].revents = 0;
+                    ++ntargets;
+                }
+            }
+            if (ntargets == 0)
+            {
+                errno = ENOTCONN;
+                return -1;
+            }
+            if (::poll(targets, (nfds_t)ntargets, timeout_ms) < 0)
+            {
+                return errno == EINTR ? 0 : -1;
+            }
+
+            int dispatched = 0;
+            for (int t = 0; t < ntargets; ++t)
+            {
+                if (targets[t].revents & POLLIN)
+                {
+                    int n = drain(familyOf(targets[t].fd));
+                    if (n < 0)
+                    {
+                        return -1;
+                    }
+                    dispatched += n;
+                }
+            }
+            return dispatched;
+        }
+
+        size_t groupCount() const { return mGroups.size(); }
+        uint64_t unmatched() const { return mUnmatched; } // どのハンドラにも当たらなかった(unicastなど)
+        uint64_t wakeups() const { return mWakeups; }     // 受信のシステムコール数
+
+        // グループ毎の受信数. func(const MulticastGroupKey&, uint64_t packets)
+        template <typename Func>
+        void forEachGroup(Func &&func)
+        {
+            mGroups.forEach([&](const MulticastGroupKey &key, Group &group) { func(key, group.mPackets); });
+        }
+
+    private:
+        struct Group
+        {
+            MulticastHandler mHandler;
+            uint64_t mPackets = 0;
+            int mJoins = 0;
+        };
+
+        struct Family
+        {
+            int mSocket = -1;
+            int mFamily = AF_UNSPEC;
+            std::vector<uint8_t> mBuffers;
+        };
+
+        static bool resolve(const char *text, struct sockaddr_storage *address)
+        {
+            struct addrinfo hints, *response;
+            std::memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_DGRAM;
+            hints.ai_flags = AI_NUMERICHOST;
+            if (getaddrinfo(text, nullptr, &hints, &response) != 0)
+            {
+                return false;
+            }
+            std::memset(address, 0, sizeof(*address));
+            std::memcpy(address, response->ai_addr, response->ai_addrlen);
+            freeaddrinfo(response);
+            return true;
+        }
+
+        Family &familyOf(int sock)
+        {
+            return mFamilies[0].mSocket == sock ? mFamilies[0] : mFamilies[1];
+        }
+
+        // ファミリ毎のソケットを最初のjoinで作る
+        int socketFor(int af)
+        {
+            Family &family = mFamilies[af == AF_INET ? 0 : 1];
+            if (family.mSocket >= 0)
+            {
+                return family.mSocket;
+            }
+            int sock = socket(af, SOCK_DGRAM, 0);
+            if (sock < 0)
+            {
+                return -1;
+            }
+            constexpr int on = 1;
+            constexpr int off = 0;
+            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)); // 同じポートの他の受信者と共存
+            int ok;
+            if (af == AF_INET)
+            {
+                ok = setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &on, sizeof(on));
+#if defined(IP_MULTICAST_ALL)
+                setsockopt(sock, IPPROTO_IP, IP_MULTICAST_ALL, &off, sizeof(off));
+#endif
+            }
+            else
+            {
+                setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on)); // IPv4はIPv4のソケットで
+                ok = setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &on, sizeof(on));
+#if defined(IPV6_MULTICAST_ALL)
+                setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_ALL, &off, sizeof(off));
+#endif
+            }
+            (void)off;
+
+            struct sockaddr_storage any;
+            socklen_t length;
+            std::memset(&any, 0, sizeof(any));
+            if (af == AF_INET)
+            {
+                struct sockaddr_in *any4 = (struct sockaddr_in *)&any;
+                any4->sin_family = AF_INET;
+                any4->sin_port = htons(mPort);
+                any4->sin_addr.s_addr = INADDR_ANY;
+                length = sizeof(struct sockaddr_in);
+            }
+            else
+            {
+                struct sockaddr_in6 *any6 = (struct sockaddr_in6 *)&any;
+                any6->sin6_family = AF_INET6;
+                any6->sin6_port = htons(mPort);
+                any6->sin6_addr = in6addr_any;
+                length = sizeof(struct sockaddr_in6);
+            }
+            if (ok != 0 || bind(sock, (struct sockaddr *)&any, length) != 0)
+            {
+                int saved = errno;
+                close(sock);
+                errno = saved;
+                return -1;
+            }
+            family.mSocket = sock;
+            family.mFamily = af;
+            family.mBuffers.resize((size_t)kBatch * kBufferSize);
+            return sock;
+        }
+
+        static int membership(int sock,
+                              bool join,
+                              const struct sockaddr_storage *group,
+                              const struct sockaddr_storage *source,
+                              unsigned int ifindex)
+        {
+            int level = group->ss_family == AF_INET ? IPPROTO_IP : IPPROTO_IPV6;
+            size_t length = group->ss_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+            if (source == nullptr)
+            {
+                struct group_req request;
+                std::memset(&request, 0, sizeof(request));
+                request.gr_interface = ifindex;
+                std::memcpy(&request.gr_group, group, length);
+                return setsockopt(sock, level, join ? MCAST_JOIN_GROUP : MCAST_LEAVE_GROUP, &request, sizeof(request));
+            }
+            struct group_source_req request;
+            std::memset(&request, 0, sizeof(request));
+            request.gsr_interface = ifindex;
+            std::memcpy(&request.gsr_group, group, length);
+            std::memcpy(&request.gsr_source, source, length);
+            return setsockopt(sock, level, join ? MCAST_JOIN_SOURCE_GROUP : MCAST_LEAVE_SOURCE_GROUP,
+                              &request, sizeof(request));
+        }
+
+        // 補助データから宛先アドレスと受信インターフェースを取り出す
+        static bool destination(struct msghdr *msg, int af, struct sockaddr_storage *group, unsigned int *ifindex)
+        {
+            std::memset(group, 0, sizeof(*group));
+            for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(msg, cmsg))
+            {
+                if (af == AF_INET && cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO)
+                {
+                    struct in_pktinfo info;
+                    std::memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+                    struct sockaddr_in *group4 = (struct sockaddr_in *)group;
+                    group4->sin_family = AF_INET;
+                    group4->sin_addr = info.ipi_addr; // ヘッダの宛先アドレス (ipi_spec_dstはローカルアドレス)
+                    *ifindex = (unsigned int)info.ipi_ifindex;
+                    return true;
+                }
+                if (af == AF_INET6 && cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO)
+                {
+                    struct in6_pktinfo info;
+                    std::memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+                    struct sockaddr_in6 *group6 = (struct sockaddr_in6 *)group;
+                    group6->sin6_family = AF_INET6;
+                    group6->sin6_addr = info.ipi6_addr;
+                    *ifindex = info.ipi6_ifindex;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void dispatch(struct msghdr *msg, int af, const uint8_t *data, size_t length)
+        {
+            struct sockaddr_storage group;
+            MulticastDatagram datagram;
+            datagram.mIfindex = 0;
+            if (!destination(msg, af, &group, &datagram.mIfindex))
+            {
+                ++mUnmatched;
+                return;
+            }
+            Group *entry = mGroups.find(MakeMulticastGroupKey((const struct sockaddr *)&group));
+            if (entry == nullptr || !entry->mHandler)
+            {
+                ++mUnmatched;
+                return;
+            }
+            datagram.mSource = (const struct sockaddr_storage *)msg->msg_name;
+            datagram.mGroup = &group;
+            datagram.mPayload = BytesView(data, length);
+            entry->mPackets++;
+            entry->mHandler(datagram);
+        }
+
+        int drain(Family &family)
+        {
+            // 補助データはin6_pktinfoが入れば足りる
+            constexpr size_t kControlSize = CMSG_SPACE(sizeof(struct in6_pktinfo)) + CMSG_SPACE(sizeof(struct in_pktinfo));
+            struct sockaddr_storage sources[kBatch];
+            alignas(struct cmsghdr) char controls[kBatch][kControlSize];
+            struct iovec iovs[kBatch];
+            int dispatched = 0;
+#if defined(__linux__)
+            struct mmsghdr messages[kBatch];
+            while (true)
+            {
+                for (int i = 0; i < kBatch; ++i)
+                {
+                    iovs[i].iov_base = family.mBuffers.data() + (size_t)i * kBufferSize;
+                    iovs[i].iov_len = kBufferSize;
+                    std::memset(&messages[i], 0, sizeof(messages[i]));
+                    messages[i].msg_hdr.msg_name = &sources[i];
+                    messages[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+                    messages[i].msg_hdr.msg_iov = &iovs[i];
+                    messages[i].msg_hdr.msg_iovlen = 1;
+                    messages[i].msg_hdr.msg_control = controls[i];
+                    messages[i].msg_hdr.msg_controllen = kControlSize;
+                }
+                int n = recvmmsg(family.mSocket, messages, kBatch, MSG_DONTWAIT, nullptr);
+                if (n < 0)
+                {
+                    return (errno == EAGAIN || errno == EWOULDBLOCK) ? dispatched : -1;
+                }
+                ++mWakeups;
+                for (int i = 0; i < n; ++i)
+                {
+                    dispatch(&messages[i].msg_hdr, family.mFamily, (const uint8_t *)iovs[i].iov_base, messages[i].msg_len);
+                }
+                dispatched += n;
+                if (n < kBatch)
+                {
+                    return dispatched;
+                }
+            }
+#else
+            while (true)
+            {
+                struct msghdr msg;
+                iovs[0].iov_base = family.mBuffers.data();
+                iovs[0].iov_len = kBufferSize;
+                std::memset(&msg, 0, sizeof(msg));
+                msg.msg_name = &sources[0];
+                msg.msg_namelen = sizeof(sources[0]);
+                msg.msg_iov = &iovs[0];
+                msg.msg_iovlen = 1;
+                msg.msg_control = controls[0];
+                msg.msg_controllen = kControlSize;
+                ssize_t n = recvmsg(family.mSocket, &msg, MSG_DONTWAIT);
+                if (n < 0)
+                {
+                    return (errno == EAGAIN || errno == EWOULDBLOCK) ? dispatched : -1;
+                }
+                ++mWakeups;
+                dispatch(&msg, family.mFamily, family.mBuffers.data(), (size_t)n);
+                ++dispatched;
+            }
+#endif
+        }
+
+        const uint16_t mPort;
+        Family mFamilies[2]; // [0]: IPv4, [1]: IPv6
+        FlatHashMap<MulticastGroupKey, Group, MulticastGroupKeyHash> mGroups;
+        uint64_t mUnmatched = 0;
+        uint64_t mWakeups = 0;
+    };
+} // namespace net
+} // namespace is
@@ -0,0 +1,380 @@
+/**
+ * @file net_interface.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief ネットワークインターフェースの列挙と選択, リンク変化の監視
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * + EnumerateInterfaces : getifaddrsでインターフェース毎に名前/番号/フラグ/アドレスをまとめる
+ * + SelectInterfaces    : 文字列の指定で選ぶ (送信先NICをソースに書かずに引数で渡せるように)
+ *   - `eth0`, `eth*`           名前 (fnmatchのワイルドカード可)
+ *   - `2`                      インターフェース番号
+ *   - `192.0.2.2`, `fd00::2`   持っているアドレス
+ *   - `cap:up,multicast,!loopback,ipv6`  フラグ/アドレスファミリの条件 (`!`で否定)
+ * + InterfaceMonitor (Linux): rtnetlinkでリンクのup/downとアドレスの増減を受ける.
+ *   fd()をpollに足し, 読めるようになったらprocess()する. 変化の後はEnumerateInterfacesで取り直せばよい.
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <ifaddrs.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <errno.h>
+
+#if defined(__linux__)
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace is
+{
+namespace net
+{
+    struct NetInterface
+    {
+        std::string mName;
+        unsigned int mIndex = 0;
+        unsigned int mFlags = 0; // IFF_*
+        std::vector<struct sockaddr_storage> mAddresses; // AF_INET / AF_INET6 のみ
+
+        bool up() const { return (mFlags & IFF_UP) && (mFlags & IFF_RUNNING); }
+        bool multicast() const { return (mFlags & IFF_MULTICAST) != 0; }
+        bool loopback() const { return (mFlags & IFF_LOOPBACK) != 0; }
+
+        bool hasFamily(int family) const
+        {
+            for (const struct sockaddr_storage &address : mAddresses)
+            {
+                if (address.ss_family == family)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // IPv4の送信元に使うアドレス (無ければfalse)
+        bool ipv4Address(struct in_addr *out) const
+        {
+            for (const struct sockaddr_storage &address : mAddresses)
+            {
+                if (address.ss_family == AF_INET)
+                {
+                    *out = ((const struct sockaddr_in *)&address)->sin_addr;
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    inline std::vector<NetInterface> EnumerateInterfaces()
+    {
+        std::vector<NetInterface> interfaces;
+        struct ifaddrs *list = nullptr;
+        if (getifaddrs(&list) != 0)
+        {
+            return interfaces;
+        }
+        for (struct ifaddrs *entry = list; entry; entry = entry->ifa_next)
+        {
+            NetInterface *target = nullptr;
+            for (NetInterface &known : interfaces)
+            {
+                if (known.mName == entry->ifa_name)
+                {
+                    target = &known;
+                    break;
+                }
+            }
+            if (!target)
+            {
+                interfaces.emplace_back();
+                target = &interfaces.back();
+                target->mName = entry->ifa_name;
+                target->mIndex = if_nametoindex(entry->ifa_name);
+            }
+            target->mFlags |= entry->ifa_flags;
+            if (entry->ifa_addr && (entry->ifa_addr->sa_family == AF_INET || entry->ifa_addr->sa_family == AF_INET6))
+            {
+                struct sockaddr_storage address;
+                std::memset(&address, 0, sizeof(address));
+                std::memcpy(&address, entry->ifa_addr,
+                            entry->ifa_addr->sa_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6));
+                target->mAddresses.push_back(address);
+            }
+        }
+        freeifaddrs(list);
+        return interfaces;
+    }
+
+    inline std::string InterfaceAddressToString(const struct sockaddr_storage &address)
+    {
+        char name[INET6_ADDRSTRLEN] = "";
+        if (address.ss_family == AF_INET)
+        {
+            inet_ntop(AF_INET, &((const struct sockaddr_in *)&address)->sin_addr, name, sizeof(name));
+        }
+        else if (address.ss_family == AF_INET6)
+        {
+            inet_ntop(AF_INET6, &((const struct sockaddr_in6 *)&address)->sin6_addr, name, sizeof(name));
+        }
+        return name;
+    }
+
+    // `cap:`の条件を1つ調べる
+    inline bool InterfaceHasCapability(const NetInterface &netif, const std::string &token)
+    {
+        bool negate = !token.empty() && token[0] == '!';
+        std::string name = negate ? token.substr(1) : token;
+        bool value;
+        if (name == "up")
+        {
+            value = netif.up();
+        }
+        else if (name == "multicast")
+        {
+            value = netif.multicast();
+        }
+        else if (name == "loopback")
+        {
+            value = netif.loopback();
+        }
+        else if (name == "ipv4")
+        {
+            value = netif.hasFamily(AF_INET);
+        }
+        else if (name == "ipv6")
+        {
+            value = netif.hasFamily(AF_INET6);
+        }
+        else
+        {
+            return false; // 知らない条件には合わない
+        }
+        return value != negate;
+    }
+
+    inline bool InterfaceMatches(const NetInterface &netif, const std::string &spec)
+    {
+        if (spec.compare(0, 4, "cap:") == 0)
+        {
+            size_t begin = 4;
+            while (begin <= spec.size())
+            {
+                size_t end = spec.find(',', begin);
+                if (end == std::string::npos)
+                {
+                    end = spec.size();
+                }
+                if (end > begin && !InterfaceHasCapability(netif, spec.substr(begin, end - begin)))
+                {
+                    return false;
+                }
+                begin = end + 1;
+            }
+            return true;
+        }
+        if (!spec.empty() && spec.find_first_not_of("0123456789") == std::string::npos)
+        {
+            return netif.mIndex == (unsigned int)std::strtoul(spec.c_str(), nullptr, 10);
+        }
+        uint8_t address[16];
+        int family = spec.find(':') != std::string::npos ? AF_INET6 : AF_INET;
+        if (inet_pton(family, spec.c_str(), address) == 1)
+        {
+            for (const struct sockaddr_storage &own : netif.mAddresses)
+            {
+                if (own.ss_family != family)
+                {
+                    continue;
+                }
+                const void *bytes = family == AF_INET ? (const void *)&((const struct sockaddr_in *)&own)->sin_addr
+                                                      : (const void *)&((const struct sockaddr_in6 *)&own)->sin6_addr;
+                if (std::memcmp(bytes, address, family == AF_INET ? 4 : 16) == 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+        return fnmatch(spec.c_str(), netif.mName.c_str(), 0) == 0;
+    }
+
+    // 指定のどれかに合うものを列挙順に (重複なし)
+    inline std::vector<NetInterface> SelectInterfaces(const std::vector<NetInterface> &interfaces,
+                                                      const std::vector<std::string> &specs)
+    {
+        std::vector<NetInterface> selected;
+        for (const NetInterface &netif : interfaces)
+        {
+            for (const std::string &spec : specs)
+            {
+                if (InterfaceMatches(netif, spec))
+                {
+                    selected.push_back(netif);
+                    break;
+                }
+            }
+        }
+        return selected;
+    }
+
+    // 1つだけ選ぶ. 見つからなければ番号0 (= カーネルに任せる)
+    inline unsigned int ResolveInterfaceIndex(const std::string &spec)
+    {
+        std::vector<NetInterface> selected = SelectInterfaces(EnumerateInterfaces(), {spec});
+        return selected.empty() ? 0 : selected.front().mIndex;
+    }
+
+#if defined(__linux__)
+    struct InterfaceEvent
+    {
+        enum Kind
+        {
+            kLinkChanged,
+            kLinkRemoved,
+            kAddressAdded,
+            kAddressRemoved,
+        };
+        Kind mKind;
+        unsigned int mIndex = 0;
+        unsigned int mFlags = 0; // kLinkChangedのIFF_*
+        std::string mName;       // リンクのイベントのみ
+        struct sockaddr_storage mAddress; // アドレスのイベントのみ
+    };
+
+    using InterfaceEventHandler = std::function<void(const InterfaceEvent &)>;
+
+    class InterfaceMonitor
+    {
+    public:
+        InterfaceMonitor()
+        {
+            mSocket = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+            if (mSocket < 0)
+            {
+                return;
+            }
+            struct sockaddr_nl local;
+            std::memset(&local, 0, sizeof(local));
+            local.nl_family = AF_NETLINK;
+            local.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+            if (bind(mSocket, (struct sockaddr *)&local, sizeof(local)) != 0)
+            {
+                close(mSocket);
+                mSocket = -1;
+            }
+        }
+
+        ~InterfaceMonitor()
+        {
+            if (mSocket >= 0)
+            {
+                close(mSocket);
+            }
+        }
+
+        InterfaceMonitor(const InterfaceMonitor &) = delete;
+        InterfaceMonitor &operator=(const InterfaceMonitor &) = delete;
+
+        // -1なら使えない (netlinkが無い環境)
+        int fd() const { return mSocket; }
+
+        // 溜まっている通知を全て読む. 戻り値はイベント数
+        int process(const InterfaceEventHandler &handler)
+        {
+            if (mSocket < 0)
+            {
+                return 0;
+            }
+            int events = 0;
+            alignas(struct nlmsghdr) char buffer[16384];
+            ssize_t n;
+            while ((n = recv(mSocket, buffer, sizeof(buffer), 0)) > 0)
+            {
+                size_t remain = (size_t)n;
+                for (struct nlmsghdr *header = (struct nlmsghdr *)buffer; NLMSG_OK(header, remain);
+                     header = NLMSG_NEXT(header, remain))
+                {
+                    InterfaceEvent event;
+                    std::memset(&event.mAddress, 0, sizeof(event.mAddress));
+                    if (header->nlmsg_type == RTM_NEWLINK || header->nlmsg_type == RTM_DELLINK)
+                    {
+                        parseLink(header, &event);
+                    }
+                    else if (header->nlmsg_type == RTM_NEWADDR || header->nlmsg_type == RTM_DELADDR)
+                    {
+                        parseAddress(header, &event);
+                    }
+                    else
+                    {
+                        continue;
+                    }
+                    ++events;
+                    handler(event);
+                }
+            }
+            return events;
+        }
+
+    private:
+        static void parseLink(struct nlmsghdr *header, InterfaceEvent *event)
+        {
+            struct ifinfomsg *info = (struct ifinfomsg *)NLMSG_DATA(header);
+            event->mKind = header->nlmsg_type == RTM_DELLINK ? InterfaceEvent::kLinkRemoved : InterfaceEvent::kLinkChanged;
+            event->mIndex = (unsigned int)info->ifi_index;
+            event->mFlags = info->ifi_flags;
+            int length = (int)IFLA_PAYLOAD(header);
+            for (struct rtattr *attr = IFLA_RTA(info); RTA_OK(attr, length); attr = RTA_NEXT(attr, length))
+            {
+                if (attr->rta_type == IFLA_IFNAME)
+                {
+                    event->mName = (const char *)RTA_DATA(attr);
+                }
+            }
+        }
+
+        static void parseAddress(struct nlmsghdr *header, InterfaceEvent *event)
+        {
+            struct ifaddrmsg *info = (struct ifaddrmsg *)NLMSG_DATA(header);
+            event->mKind = header->nlmsg_type == RTM_DELADDR ? InterfaceEvent::kAddressRemoved : InterfaceEvent::kAddressAdded;
+            event->mIndex = info->ifa_index;
+            int length = (int)IFA_PAYLOAD(header);
+            for (struct rtattr *attr = IFA_RTA(info); RTA_OK(attr, length); attr = RTA_NEXT(attr, length))
+            {
+                if (attr->rta_type != IFA_ADDRESS)
+                {
+                    continue;
+                }
+                event->mAddress.ss_family = info->ifa_family;
+                if (info->ifa_family == AF_INET)
+                {
+                    std::memcpy(&((struct sockaddr_in *)&event->mAddress)->sin_addr, RTA_DATA(attr), 4);
+                }
+                else if (info->ifa_family == AF_INET6)
+                {
+                    std::memcpy(&((struct sockaddr_in6 *)&event->mAddress)->sin6_addr, RTA_DATA(attr), 16);
+                }
+            }
+        }
+
+        int mSocket = -1;
+    };
+#endif
+} // namespace net
+} // namespace is
@@ -0,0 +1,425 @@
+/**
+ * @file pacing.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 送信のペーシング (宛先毎/ソケット毎のトークンバケット, SO_TXTIME, SO_MAX_PACING_RATE)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * sendto()が返る速さで送ると, 平均レートは低くても数十パケットが数マイクロ秒に固まって出る(マイクロバースト).
+ * スイッチのバッファや受信側のソケットバッファはこの瞬間の山で溢れる. ここでは送信時刻を均す.
+ *
+ * + TokenBucket: レート[byte/s]とバースト[byte]. 理論到着時刻(GCRA)で持つので補充の計算が要らない.
+ *   earliest()で送ってよい最も早い時刻[ns]を返す.
+ * + Pacer: ソケット全体のバケット + 宛先毎のバケット(FlatHashMap). 両方を満たす時刻を予定として返す.
+ * + 予定の時刻までの待ち方は3つ
+ *   - ユーザ空間: WaitUntilNsで待ってから送る (clock_nanosleep + 最後の少しだけスピン)
+ *   - SO_TXTIME (Linux): 予定時刻をSCM_TXTIMEで付けて先に渡し, fq/ETF qdiscがその時刻に出す.
+ *     fqはCLOCK_MONOTONIC, ETFはCLOCK_TAI. qdiscが無ければ無視されてすぐ出る.
+ *   - SO_MAX_PACING_RATE (Linux): ソケットの上限レートだけ渡し, fq qdiscが均す (宛先毎の制御はできない)
+ * + RateMeter: 実際の送信レートと, 予定より詰まって出た間隔(バースト)を数える.
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <linux/errqueue.h>   // sock_extended_err, SO_EE_ORIGIN_TXTIME
+#include <linux/net_tstamp.h> // sock_txtime, SOF_TXTIME_*
+#include <NetUtils/timestamping.hpp>
+#endif
+
+#include <cstdint>
+#include <cstring>
+
+#include <NetUtils/flat_hash_map.hpp>
+#include <NetUtils/lockfree_ring.hpp> // CpuRelax
+
+namespace is
+{
+namespace net
+{
+    inline uint64_t MonotonicNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    }
+
+    /**
+     * @brief CLOCK_MONOTONICでdeadline_nsまで待つ. spin_ns手前までは眠り, 残りはスピンする.
+     * スリープの起床遅れ(数十us)より細かい間隔で送るときはspin_nsを大きくする. 1CPUでは小さく.
+     */
+    inline void WaitUntilNs(uint64_t deadline_ns, uint64_t spin_ns = 20000)
+    {
+        uint64_t now = MonotonicNs();
+        if (deadline_ns <= now)
+        {
+            return;
+        }
+        if (deadline_ns - now > spin_ns)
+        {
+            uint64_t wake = deadline_ns - spin_ns;
+            struct timespec ts;
+            ts.tv_sec = (time_t)(wake / 1000000000ull);
+            ts.tv_nsec = (long)(wake % 1000000000ull);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+            {
+            }
+        }
+        while (MonotonicNs() < deadline_ns)
+        {
+            CpuRelax();
+        }
+    }
+
+    class TokenBucket
+    {
+    public:
+        // rate_bytes_per_sec = 0 で無制限
+        explicit TokenBucket(uint64_t rate_bytes_per_sec = 0, uint64_t burst_bytes = 0)
+        {
+            configure(rate_bytes_per_sec, burst_bytes);
+        }
+
+        void configure(uint64_t rate_bytes_per_sec, uint64_t burst_bytes)
+        {
+            mRate = rate_bytes_per_sec;
+            mBurstNs = mRate ? burst_bytes * 1000000000ull / mRate : 0;
+        }
+
+        uint64_t rate() const { return mRate; }
+
+        // bytesを送ってよい最も早い時刻 (>= now_ns)
+        uint64_t earliest(uint64_t bytes, uint64_t now_ns) const
+        {
+            if (mRate == 0)
+            {
+                return now_ns;
+            }
+            // 送った後の理論到着時刻が now + バースト分 を超えない時刻. バーストより大きいパケットは1個ずつ.
+            uint64_t tat = mTat > now_ns ? mTat : now_ns;
+            uint64_t limit = tat + interval(bytes);
+            uint64_t burst = mBurstNs > interval(bytes) ? mBurstNs : interval(bytes);
+            return limit > now_ns + burst ? limit - burst : now_ns;
+        }
+
+        // time_nsにbytesを送ったことにする
+        void consume(uint64_t bytes, uint64_t time_ns)
+        {
+            if (mRate == 0)
+            {
+                return;
+            }
+            mTat = (mTat > time_ns ? mTat : time_ns) + interval(bytes);
+        }
+
+    private:
+        uint64_t interval(uint64_t bytes) const { return bytes * 1000000000ull / mRate; }
+
+        uint64_t mRate = 0;
+        uint64_t mBurstNs = 0;
+        uint64_t mTat = 0; // 理論到着時刻 (今までの送信をレート通りに並べた終わり)
+    };
+
+    // 宛先 (アドレス + ポート)
+    struct PacerKey
+    {
+        uint8_t mAddress[16];
+        uint16_t mPort;
+        uint8_t mFamily;
+
+        bool operator==(const PacerKey &other) const
+        {
+            return mFamily == other.mFamily && mPort == other.mPort &&
+                   std::memcmp(mAddress, other.mAddress, sizeof(mAddress)) == 0;
+        }
+    };
+
+    struct PacerKeyHash
+    {
+        size_t operator()(const PacerKey &key) const
+        {
+            uint64_t hash = 1469598103934665603ull; // FNV-1a
+            for (uint8_t b : key.mAddress)
+            {
+                hash = (hash ^ b) * 1099511628211ull;
+            }
+            hash = (hash ^ key.mPort) * 1099511628211ull;
+            return (size_t)((hash ^ key.mFamily) * 1099511628211ull);
+        }
+    };
+
+    inline PacerKey MakePacerKey(const struct sockaddr *address)
+    {
+        PacerKey key;
+        std::memset(&key, 0, sizeof(key));
+        key.mFamily = (uint8_t)address->sa_family;
+        if (address->sa_family == AF_INET)
+        {
+            const struct sockaddr_in *in = (const struct sockaddr_in *)address;
+            std::memcpy(key.mAddress, &in->sin_addr, 4);
+            key.mPort = in->sin_port;
+        }
+        else if (address->sa_family == AF_INET6)
+        {
+            const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)address;
+            std::memcpy(key.mAddress, &in6->sin6_addr, 16);
+            key.mPort = in6->sin6_port;
+        }
+        return key;
+    }
+
+    class Pacer
+    {
+    public:
+        // ソケット全体の上限 (0で無制限)
+        explicit Pacer(uint64_t socket_rate_bytes_per_sec = 0, uint64_t socket_burst_bytes = 0)
+            : mSocket(socket_rate_bytes_per_sec, socket_burst_bytes)
+        {
+        }
+
+        // 個別に設定していない宛先のレート (0で宛先毎の制限なし)
+        void setDefaultDestinationRate(uint64_t rate_bytes_per_sec, uint64_t burst_bytes)
+        {
+            mDefaultRate = rate_bytes_per_sec;
+            mDefaultBurst = burst_bytes;
+        }
+
+        void setDestinationRate(const struct sockaddr *destination, uint64_t rate_bytes_per_sec, uint64_t burst_bytes)
+        {
+            PacerKey key = MakePacerKey(destination);
+            TokenBucket *bucket = mDestinations.find(key);
+            if (bucket)
+            {
+                bucket->configure(rate_bytes_per_sec, burst_bytes);
+            }
+            else
+            {
+                mDestinations.emplace(key, TokenBucket(rate_bytes_per_sec, burst_bytes));
+            }
+        }
+
+        // destinationへbytesを送れる最も早い時刻 (予約はしない). 複数の宛先から次に送るものを選ぶのに使う.
+        uint64_t earliest(const struct sockaddr *destination, size_t bytes, uint64_t now_ns)
+        {
+            TokenBucket *bucket = destinationBucket(destination);
+            uint64_t at = mSocket.earliest(bytes, now_ns > mLast ? now_ns : mLast);
+            if (bucket)
+            {
+                uint64_t destination_at = bucket->earliest(bytes, at);
+                at = destination_at > at ? destination_at : at;
+            }
+            return at;
+        }
+
+        /**
+         * @brief destinationへbytesを送る予定時刻[ns, CLOCK_MONOTONIC]を決め, その時刻に送ったことにする.
+         * 予定は前の予定より前にはならない(同じソケットからは順番に出る).
+         */
+        uint64_t schedule(const struct sockaddr *destination, size_t bytes, uint64_t now_ns)
+        {
+            uint64_t at = earliest(destination, bytes, now_ns);
+            TokenBucket *bucket = destinationBucket(destination);
+            if (bucket)
+            {
+                bucket->consume(bytes, at);
+            }
+            mSocket.consume(bytes, at);
+            mLast = at;
+            return at;
+        }
+
+    private:
+        TokenBucket *destinationBucket(const struct sockaddr *destination)
+        {
+            PacerKey key = MakePacerKey(destination);
+            TokenBucket *bucket = mDestinations.find(key);
+            if (!bucket && mDefaultRate)
+            {
+                bucket = mDestinations.emplace(key, TokenBucket(mDefaultRate, mDefaultBurst)).first;
+            }
+            return bucket;
+        }
+
+        TokenBucket mSocket;
+        FlatHashMap<PacerKey, TokenBucket, PacerKeyHash> mDestinations;
+        uint64_t mDefaultRate = 0;
+        uint64_t mDefaultBurst = 0;
+        uint64_t mLast = 0;
+    };
+
+    // 実際に出たレートと, 目標の間隔の半分より詰まって出た数 (マイクロバースト)
+    class RateMeter
+    {
+    public:
+        explicit RateMeter(uint64_t target_bytes_per_sec = 0) : mTarget(target_bytes_per_sec) {}
+
+        void record(size_t bytes, uint64_t time_ns)
+        {
+            if (mPackets > 0 && mTarget)
+            {
+                uint64_t gap = time_ns > mLastNs ? time_ns - mLastNs : 0;
+                uint64_t expected = (uint64_t)bytes * 1000000000ull / mTarget;
+                if (gap * 2 < expected)
+                {
+                    ++mBursty;
+                }
+            }
+            if (mPackets == 0)
+            {
+                mFirstNs = time_ns;
+            }
+            mLastNs = time_ns;
+            mBytes += bytes;
+            ++mPackets;
+        }
+
+        uint64_t packets() const { return mPackets; }
+        uint64_t bursty() const { return mBursty; }
+        uint64_t target() const { return mTarget; }
+
+        // 最初から最後の送信までの平均 [byte/s]
+        double achieved() const
+        {
+            if (mPackets < 2 || mLastNs == mFirstNs)
+            {
+                return 0.0;
+            }
+            // 最後のパケットの分は区間の外なので1つ分引く
+            return (double)(mBytes - mBytes / mPackets) * 1e9 / (double)(mLastNs - mFirstNs);
+        }
+
+    private:
+        uint64_t mTarget;
+        uint64_t mBytes = 0;
+        uint64_t mPackets = 0;
+        uint64_t mBursty = 0;
+        uint64_t mFirstNs = 0;
+        uint64_t mLastNs = 0;
+    };
+
+#if defined(__linux__) && defined(SO_TXTIME)
+    /**
+     * @brief SO_TXTIMEを有効にする. 時計はfqならCLOCK_MONOTONIC, ETFならCLOCK_TAI.
+     * report_errorsで, 時刻を過ぎた/不正な送信がエラーキュー(SO_EE_ORIGIN_TXTIME)に届く.
+     */
+    inline int EnableTxTime(int sock, clockid_t clock = CLOCK_MONOTONIC, bool deadline_mode = false, bool report_errors = true)
+    {
+        struct sock_txtime config;
+        std::memset(&config, 0, sizeof(config));
+        config.clockid = clock;
+        config.flags = (deadline_mode ? SOF_TXTIME_DEADLINE_MODE : 0) | (report_errors ? SOF_TXTIME_REPORT_ERRORS : 0);
+        return setsockopt(sock, SOL_SOCKET, SO_TXTIME, &config, sizeof(config));
+    }
+
+    // txtime_ns(EnableTxTimeの時計)に出るように送る
+    inline ssize_t SendAtTxTime(int sock, const void *data, size_t length, const struct sockaddr *destination,
+                                socklen_t destination_length, uint64_t txtime_ns)
+    {
+        struct iovec iov;
+        iov.iov_base = const_cast<void *>(data);
+        iov.iov_len = length;
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(uint64_t))];
+        std::memset(control, 0, sizeof(control));
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_name = const_cast<struct sockaddr *>(destination);
+        msg.msg_namelen = destination_length;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_TXTIME;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+        std::memcpy(CMSG_DATA(cmsg), &txtime_ns, sizeof(txtime_ns));
+        return sendmsg(sock, &msg, 0);
+    }
+
+    struct TxTimeErrors
+    {
+        uint64_t mMissed = 0;  // 時刻を過ぎて捨てられた (SO_EE_CODE_TXTIME_MISSED)
+        uint64_t mInvalid = 0; // 時刻/時計が不正で捨てられた (SO_EE_CODE_TXTIME_INVALID_PARAM)
+    };
+
+    /**
+     * @brief エラーキューを読み切る (ブロックしない). SO_TXTIMEのエラーは数え,
+     * SO_TIMESTAMPING(OPT_ID)の送信時刻はon_stamp(const TxTimestamp &)へ渡す. 同じキューに混ざって届くため.
+     */
+    template <typename OnStamp>
+    inline void DrainTxErrorQueue(int sock, TxTimeErrors *errors, OnStamp &&on_stamp)
+    {
+        while (true)
+        {
+            char control[512];
+            char data[64];
+            struct iovec iov = {data, sizeof(data)};
+            struct msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            {
+                return;
+            }
+            TxTimestamp stamp;
+            bool have_stamp = false;
+            for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING)
+                {
+                    struct scm_timestamping tss;
+                    std::memcpy(&tss, CMSG_DATA(cmsg), sizeof(tss));
+                    stamp.mStamp.mSoftwareNs = TimespecToNs(tss.ts[0]);
+                    stamp.mStamp.mHardwareNs = TimespecToNs(tss.ts[2]);
+                    continue;
+                }
+                if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                      (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)))
+                {
+                    continue;
+                }
+                struct sock_extended_err error;
+                std::memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+                if (error.ee_origin == SO_EE_ORIGIN_TXTIME)
+                {
+                    ++(error.ee_code == SO_EE_CODE_TXTIME_MISSED ? errors->mMissed : errors->mInvalid);
+                }
+                else if (error.ee_origin == SO_EE_ORIGIN_TIMESTAMPING)
+                {
+                    stamp.mId = error.ee_data;
+                    stamp.mType = error.ee_info;
+                    have_stamp = true;
+                }
+            }
+            if (have_stamp)
+            {
+                on_stamp(stamp);
+            }
+        }
+    }
+#endif
+
+#if defined(__linux__) && defined(SO_MAX_PACING_RATE)
+    // ソケットの上限レート[byte/s]. fq qdiscが均す. ~0で解除.
+    inline int SetMaxPacingRate(int sock, uint64_t bytes_per_sec)
+    {
+        if (bytes_per_sec <= 0xFFFFFFFFull)
+        {
+            uint32_t rate = (uint32_t)bytes_per_sec;
+            return setsockopt(sock, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate));
+        }
+        return setsockopt(sock, SOL_SOCKET, SO_MAX_PACING_RATE, &bytes_per_sec, sizeof(bytes_per_sec));
+    }
+#endif
+} // namespace net
+} // namespace is
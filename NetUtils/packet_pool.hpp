@@ -0,0 +1,348 @@
+/**
+ * @file packet_pool.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief ヒュージページ上に確保したパケットバッファのプールと参照カウント付きスライス
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * + 領域(アリーナ)は起動時に一度だけmmapする. MAP_HUGETLB(2MiB)を試し, 無ければ通常のページに
+ *   MADV_HUGEPAGE(THP)を付ける. MAP_POPULATEで事前にページを割り当て, 受信中のページフォルトを無くす.
+ * + スロット(既定2048バイト)を受信毎にmemsetしない. 受信長はスライスが持つ.
+ * + PacketSliceはスロットの一部への参照で, コピーすると参照カウントが増える.
+ *   1つの受信バッファを複数の消費者(表示, 統計, 転送など)へコピー無しで渡せる. 最後の参照が消えると返却.
+ * + 返却先はロックフリーのMpmcRing. スレッド毎のLocalCacheがまとめて取り出し/返却し, 共有部分への
+ *   アクセスをバッチ数分の1に減らす.
+ */
+#pragma once
+
+#include <sys/mman.h>
+
+#include <algorithm> // std::min
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <NetUtils/lockfree_ring.hpp>
+#include <NetUtils/packet_view.hpp>
+
+namespace is
+{
+namespace net
+{
+    /////////////////////////////////////////////////////////////
+    // アリーナ (ヒュージページ -> THP -> 通常ページ)
+    /////////////////////////////////////////////////////////////
+    class HugePageArena
+    {
+    public:
+        static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+        explicit HugePageArena(size_t bytes, bool try_huge_pages = true)
+        {
+            mSize = (bytes + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+            void *map = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+            if (try_huge_pages)
+            {
+                map = mmap(nullptr, mSize, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+                mHugePages = map != MAP_FAILED;
+            }
+#endif
+            if (map == MAP_FAILED)
+            {
+                // ヒュージページが予約されていない (vm.nr_hugepages = 0) など
+                map = mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (map == MAP_FAILED)
+                {
+                    throw std::runtime_error("HugePageArena: mmap");
+                }
+#if defined(MADV_HUGEPAGE)
+                if (try_huge_pages)
+                {
+                    madvise(map, mSize, MADV_HUGEPAGE);
+                }
+#endif
+                // 先にページを割り当てておく (受信中のページフォルトを避ける)
+                for (size_t offset = 0; offset < mSize; offset += 4096)
+                {
+                    ((volatile uint8_t *)map)[offset] = 0;
+                }
+            }
+            mData = (uint8_t *)map;
+        }
+
+        ~HugePageArena() { munmap(mData, mSize); }
+        HugePageArena(const HugePageArena &) = delete;
+        HugePageArena &operator=(const HugePageArena &) = delete;
+
+        uint8_t *data() const { return mData; }
+        size_t size() const { return mSize; }
+        bool hugePages() const { return mHugePages; } // MAP_HUGETLBで確保できた
+
+    private:
+        uint8_t *mData = nullptr;
+        size_t mSize = 0;
+        bool mHugePages = false;
+    };
+
+    class PacketPool;
+
+    /////////////////////////////////////////////////////////////
+    // スライス (参照カウント付き)
+    /////////////////////////////////////////////////////////////
+    class PacketSlice
+    {
+    public:
+        PacketSlice() = default;
+        ~PacketSlice() { reset(); }
+
+        PacketSlice(const PacketSlice &other);
+        PacketSlice &operator=(const PacketSlice &other);
+        PacketSlice(PacketSlice &&other) noexcept { steal(other); }
+        PacketSlice &operator=(PacketSlice &&other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                steal(other);
+            }
+            return *this;
+        }
+
+        explicit operator bool() const { return mPool != nullptr; }
+        uint8_t *data() const;
+        size_t size() const { return mLength; }
+        size_t capacity() const; // スロット末尾まで
+        void resize(size_t length) { mLength = (uint32_t)length; } // 受信後に長さを確定する (<= capacity)
+        BytesView view() const { return BytesView(data(), mLength); }
+
+        // 同じバッファの一部 (参照カウントを共有する). BytesView::subと同じく範囲はこのスライスの中に丸める
+        PacketSlice sub(size_t offset, size_t length) const
+        {
+            PacketSlice slice(*this);
+            if (offset > mLength)
+            {
+                offset = mLength;
+            }
+            slice.mOffset += (uint32_t)offset;
+            slice.mLength = (uint32_t)std::min(length, (size_t)mLength - offset);
+            return slice;
+        }
+
+        bool unique() const;
+        void reset();
+
+    private:
+        friend class PacketPool;
+        PacketSlice(PacketPool *pool, uint32_t slot, uint32_t length)
+            : mPool(pool), mSlot(slot), mOffset(0), mLength(length) {}
+
+        void steal(PacketSlice &other)
+        {
+            mPool = other.mPool;
+            mSlot = other.mSlot;
+            mOffset = other.mOffset;
+            mLength = other.mLength;
+            other.mPool = nullptr;
+        }
+
+        PacketPool *mPool = nullptr;
+        uint32_t mSlot = 0;
+        uint32_t mOffset = 0;
+        uint32_t mLength = 0;
+    };
+
+    /////////////////////////////////////////////////////////////
+    // プール
+    /////////////////////////////////////////////////////////////
+    class PacketPool
+    {
+    public:
+        PacketPool(size_t slot_count, size_t slot_size = 2048, bool try_huge_pages = true)
+            : mSlotSize((slot_size + kCacheLineSize - 1) / kCacheLineSize * kCacheLineSize)
+            , mSlotCount(slot_count)
+            , mArena(mSlotSize * slot_count, try_huge_pages)
+            , mRefCounts(new std::atomic<uint32_t>[slot_count])
+            , mFree(slot_count)
+        {
+            for (uint32_t slot = 0; slot < slot_count; ++slot)
+            {
+                mRefCounts[slot].store(0, std::memory_order_relaxed);
+                mFree.tryPush(slot);
+            }
+        }
+
+        PacketPool(const PacketPool &) = delete;
+        PacketPool &operator=(const PacketPool &) = delete;
+
+        // 空のスライス(長さ0, 容量はスロット全体)を返す. 枯渇したら空(false)のスライス.
+        PacketSlice allocate()
+        {
+            uint32_t slot;
+            if (!mFree.tryPop(slot))
+            {
+                return PacketSlice();
+            }
+            return acquire(slot);
+        }
+
+        size_t slotSize() const { return mSlotSize; }
+        size_t slotCount() const { return mSlotCount; }
+        bool hugePages() const { return mArena.hugePages(); }
+
+        /////////////////////////////////////////////////////////////
+        // スレッド毎のキャッシュ (そのスレッドだけが使う)
+        /////////////////////////////////////////////////////////////
+        class LocalCache
+        {
+        public:
+            explicit LocalCache(PacketPool &pool, size_t batch = 32) : mPool(pool), mBatch(batch)
+            {
+                mSlots.reserve(batch * 2);
+            }
+            ~LocalCache() { flush(0); }
+            LocalCache(const LocalCache &) = delete;
+            LocalCache &operator=(const LocalCache &) = delete;
+
+            PacketSlice allocate()
+            {
+                if (mSlots.empty())
+                {
+                    uint32_t slot;
+                    while (mSlots.size() < mBatch && mPool.mFree.tryPop(slot))
+                    {
+                        mSlots.push_back(slot);
+                    }
+                    if (mSlots.empty())
+                    {
+                        return PacketSlice();
+                    }
+                }
+                uint32_t slot = mSlots.back();
+                mSlots.pop_back();
+                return mPool.acquire(slot);
+            }
+
+            // 最後の参照ならスロットを手元に戻す (同じスレッドで次に使う)
+            void recycle(PacketSlice &&slice)
+            {
+                if (!slice || slice.mPool != &mPool)
+                {
+                    slice.reset();
+                    return;
+                }
+                uint32_t slot = slice.mSlot;
+                slice.mPool = nullptr;
+                if (mPool.mRefCounts[slot].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    mSlots.push_back(slot);
+                    if (mSlots.size() >= mBatch * 2)
+                    {
+                        flush(mBatch);
+                    }
+                }
+            }
+
+        private:
+            void flush(size_t keep)
+            {
+                while (mSlots.size() > keep)
+                {
+                    mPool.mFree.tryPush(mSlots.back());
+                    mSlots.pop_back();
+                }
+            }
+
+            PacketPool &mPool;
+            size_t mBatch;
+            std::vector<uint32_t> mSlots;
+        };
+
+    private:
+        friend class PacketSlice;
+
+        PacketSlice acquire(uint32_t slot)
+        {
+            mRefCounts[slot].store(1, std::memory_order_relaxed);
+            return PacketSlice(this, slot, 0);
+        }
+
+        uint8_t *slotData(uint32_t slot) const { return mArena.data() + (size_t)slot * mSlotSize; }
+
+        void addRef(uint32_t slot) { mRefCounts[slot].fetch_add(1, std::memory_order_relaxed); }
+
+        void release(uint32_t slot)
+        {
+            if (mRefCounts[slot].fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                mFree.tryPush(slot); // 容量 = スロット数なので必ず入る
+            }
+        }
+
+        const size_t mSlotSize;
+        const size_t mSlotCount;
+        HugePageArena mArena;
+        std::unique_ptr<std::atomic<uint32_t>[]> mRefCounts;
+        MpmcRing<uint32_t> mFree;
+    };
+
+    /////////////////////////////////////////////////////////////
+    // PacketSliceの実装 (PacketPoolが必要な部分)
+    /////////////////////////////////////////////////////////////
+    inline PacketSlice::PacketSlice(const PacketSlice &other)
+        : mPool(other.mPool), mSlot(other.mSlot), mOffset(other.mOffset), mLength(other.mLength)
+    {
+        if (mPool)
+        {
+            mPool->addRef(mSlot);
+        }
+    }
+
+    inline PacketSlice &PacketSlice::operator=(const PacketSlice &other)
+    {
+        if (this != &other)
+        {
+            if (other.mPool)
+            {
+                other.mPool->addRef(other.mSlot);
+            }
+            reset();
+            mPool = other.mPool;
+            mSlot = other.mSlot;
+            mOffset = other.mOffset;
+            mLength = other.mLength;
+        }
+        return *this;
+    }
+
+    inline uint8_t *PacketSlice::data() const
+    {
+        return mPool ? mPool->slotData(mSlot) + mOffset : nullptr;
+    }
+
+    inline size_t PacketSlice::capacity() const
+    {
+        return mPool ? mPool->slotSize() - mOffset : 0;
+    }
+
+    inline bool PacketSlice::unique() const
+    {
+        return mPool && mPool->mRefCounts[mSlot].load(std::memory_order_acquire) == 1;
+    }
+
+    inline void PacketSlice::reset()
+    {
+        if (mPool)
+        {
+            mPool->release(mSlot);
+            mPool = nullptr;
+        }
+    }
+} // namespace net
+} // namespace is
@@ -0,0 +1,327 @@
+/**
+ * @file packet_ring.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief AF_PACKETのTPACKET_V3受信リング (mmap) でパケットをコピーせずに読む (Linux)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * カーネルはパケットを共有メモリ上のブロック(既定1MiB)に詰めていき, ブロックが一杯になるか
+ * タイムアウトするとユーザー空間へ渡す. ユーザー側はブロック内のパケットをその場で読み,
+ * 読み終えたらブロックをカーネルに返す. recvfromのようなパケット毎のシステムコールとコピーが無い.
+ *
+ * + PACKET_FANOUTで同じグループのリング(スレッド毎に1つ)へ振り分ける.
+ *   PACKET_FANOUT_HASHはフローのハッシュなので, 同じフローは常に同じスレッドに届く.
+ * + SOCK_DGRAMで開くのでリンク層ヘッダは無く, loでもvethでもIPヘッダから読める.
+ * + ParsePacketRingUdp()でUDPのデータグラムを取り出せる. ipv4_udp_multicast_recieverの`-R`はこれで受信する.
+ *
+ * @note CAP_NET_RAWが必要.
+ */
+#pragma once
+
+#if defined(__linux__)
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>         // htons
+#include <net/if.h>            // if_nametoindex
+#include <linux/if_ether.h>    // ETH_P_ALL
+#include <linux/if_packet.h>   // tpacket_req3, tpacket3_hdr, sockaddr_ll
+#include <netinet/in.h>        // IPPROTO_UDP
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include <NetUtils/packet_view.hpp>
+
+#ifndef PACKET_IGNORE_OUTGOING
+#define PACKET_IGNORE_OUTGOING 23
+#endif
+
+namespace is
+{
+namespace net
+{
+    struct PacketRingOptions
+    {
+        uint32_t mBlockSize = 1 << 20;  // ブロックの大きさ (ページサイズの倍数)
+        uint32_t mBlockCount = 64;      // ブロック数. 合計がリングの容量
+        uint32_t mFrameSize = 2048;     // 最大フレーム長の目安 (V3ではブロック内に詰められる)
+        uint32_t mBlockTimeoutMs = 10;  // 一杯にならなくてもブロックを渡すまでの時間
+        int mFanoutGroup = -1;          // 0-65535ならPACKET_FANOUTに参加
+        int mFanoutMode = PACKET_FANOUT_HASH;
+        bool mIgnoreOutgoing = true;    // 自ホストの送信パケットを見ない (loで二重に見えないように)
+    };
+
+    // リングから取り出した1パケット. 参照先はブロックを返すまで有効.
+    struct PacketRingFrame
+    {
+        const struct tpacket3_hdr *mHeader;
+        const struct sockaddr_ll *mLink;
+        BytesView mNetwork; // IPヘッダから (tp_snaplen分)
+
+        uint32_t wireLength() const { return mHeader->tp_len; } // 切り詰め前の長さ
+        uint16_t protocol() const { return ntohs(mLink->sll_protocol); } // ETH_P_IP, ETH_P_IPV6
+        uint64_t timestampNs() const { return (uint64_t)mHeader->tp_sec * 1000000000ull + mHeader->tp_nsec; }
+    };
+
+    // リング上のUDPデータグラム (アドレスはネットワークバイトオーダのままフレームを指す)
+    struct PacketRingUdp
+    {
+        int mFamily;          // AF_INET, AF_INET6
+        const uint8_t *mSrc;  // 4 or 16バイト
+        const uint8_t *mDst;
+        uint16_t mSrcPort;
+        uint16_t mDstPort;
+        BytesView mPayload;   // UDPのlengthまで (イーサネットの詰め物を含めない)
+    };
+
+    // フラグメントでないUDPならoutに入れて真. 受信ソケットの代わりにリングから読む受信側のため.
+    inline bool ParsePacketRingUdp(const PacketRingFrame &frame, PacketRingUdp *out)
+    {
+        BytesView l4;
+        if (frame.protocol() == ETH_P_IP)
+        {
+            Ipv4View ip(frame.mNetwork);
+            if (!ip.valid() || ip.protocol() != IPPROTO_UDP || (ip.flags() & 0x1) || ip.fragmentOffset() != 0)
+            {
+                return false;
+            }
+            out->mFamily = AF_INET;
+            out->mSrc = ip.src();
+            out->mDst = ip.dst();
+            l4 = ip.boundedPayload();
+        }
+        else if (frame.protocol() == ETH_P_IPV6)
+        {
+            Ipv6View ip(frame.mNetwork);
+            if (!ip.valid() || ip.nextHeader() != IPPROTO_UDP) // 拡張ヘッダ付きは扱わない
+            {
+                return false;
+            }
+            out->mFamily = AF_INET6;
+            out->mSrc = ip.src();
+            out->mDst = ip.dst();
+            l4 = ip.payload();
+        }
+        else
+        {
+            return false;
+        }
+        UdpView udp(l4);
+        if (!udp.valid())
+        {
+            return false;
+        }
+        out->mSrcPort = udp.srcPort();
+        out->mDstPort = udp.dstPort();
+        out->mPayload = l4.sub(UdpView::kHeaderSize, (size_t)udp.length() - UdpView::kHeaderSize);
+        return true;
+    }
+
+    struct PacketRingStats
+    {
+        uint64_t mPackets = 0; // カーネルがリングに入れようとした数
+        uint64_t mDrops = 0;   // リングが一杯で捨てた数
+        uint64_t mFreezes = 0; // 全ブロックがユーザー側にあって止まった回数
+    };
+
+    class PacketRing
+    {
+    public:
+        PacketRing() = default;
+        ~PacketRing() { close(); }
+        PacketRing(const PacketRing &) = delete;
+        PacketRing &operator=(const PacketRing &) = delete;
+
+        // 成功: 0, 失敗: -1 (errnoを参照)
+        int open(const char *ifname, const PacketRingOptions &options = PacketRingOptions())
+        {
+            close();
+            unsigned int ifindex = if_nametoindex(ifname);
+            if (ifindex == 0)
+            {
+                return -1;
+            }
+            if ((mSocket = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_ALL))) < 0)
+            {
+                return -1;
+            }
+
+            /* 1.TPACKET_V3のリングを確保してmmap */
+            int version = TPACKET_V3;
+            struct tpacket_req3 request;
+            std::memset(&request, 0, sizeof(request));
+            request.tp_block_size = options.mBlockSize;
+            request.tp_block_nr = options.mBlockCount;
+            request.tp_frame_size = options.mFrameSize;
+            request.tp_frame_nr = (options.mBlockSize / options.mFrameSize) * options.mBlockCount;
+            request.tp_retire_blk_tov = options.mBlockTimeoutMs;
+            request.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+            if (setsockopt(mSocket, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0 ||
+                setsockopt(mSocket, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) != 0)
+            {
+                return fail();
+            }
+            mMapSize = (size_t)options.mBlockSize * options.mBlockCount;
+            void *map = mmap(nullptr, mMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, mSocket, 0);
+            if (map == MAP_FAILED)
+            {
+                map = mmap(nullptr, mMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, mSocket, 0); // RLIMIT_MEMLOCK不足
+            }
+            if (map == MAP_FAILED)
+            {
+                mMapSize = 0;
+                return fail();
+            }
+            mMap = (uint8_t *)map;
+            mBlockSize = options.mBlockSize;
+            mBlockCount = options.mBlockCount;
+            mCurrentBlock = 0;
+
+            // ファンアウト参加時や古いカーネルでは効かないので, poll()でもPACKET_OUTGOINGを読み飛ばす
+            mIgnoreOutgoing = options.mIgnoreOutgoing;
+            if (mIgnoreOutgoing)
+            {
+                int on = 1;
+                setsockopt(mSocket, SOL_PACKET, PACKET_IGNORE_OUTGOING, &on, sizeof(on));
+            }
+
+            /* 2.インターフェースにbind (bindまではパケットが入らない) */
+            struct sockaddr_ll link;
+            std::memset(&link, 0, sizeof(link));
+            link.sll_family = AF_PACKET;
+            link.sll_protocol = htons(ETH_P_ALL);
+            link.sll_ifindex = (int)ifindex;
+            if (bind(mSocket, (struct sockaddr *)&link, sizeof(link)) != 0)
+            {
+                return fail();
+            }
+
+            /* 3.ファンアウトグループに参加 (bind後) */
+            if (options.mFanoutGroup >= 0)
+            {
+                int fanout = (options.mFanoutGroup & 0xFFFF) | ((options.mFanoutMode | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+                if (setsockopt(mSocket, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) != 0)
+                {
+                    return fail();
+                }
+            }
+            return 0;
+        }
+
+        void close()
+        {
+            if (mMap != nullptr)
+            {
+                munmap(mMap, mMapSize);
+                mMap = nullptr;
+                mMapSize = 0;
+            }
+            if (mSocket >= 0)
+            {
+                ::close(mSocket);
+                mSocket = -1;
+            }
+        }
+
+        int fd() const { return mSocket; }
+        bool isOpen() const { return mMap != nullptr; }
+
+        /**
+         * @brief ユーザー側に渡されたブロックを読み, 各パケットでon_frame(const PacketRingFrame&)を呼ぶ.
+         * 渡されたブロックが無ければtimeout_msまで待つ. 読んだブロックはすぐにカーネルへ返す.
+         * @return 処理したパケット数. 失敗: -1
+         */
+        template <typename OnFrame>
+        int poll(int timeout_ms, OnFrame &&on_frame)
+        {
+            int count = 0;
+            struct tpacket_block_desc *block = currentBlock();
+            if (!(block->hdr.bh1.block_status & TP_STATUS_USER))
+            {
+                struct pollfd target;
+                target.fd = mSocket;
+                target.events = POLLIN | POLLERR;
+                target.revents = 0;
+                if (::poll(&target, 1, timeout_ms) < 0 && errno != EINTR)
+                {
+                    return -1;
+                }
+            }
+
+            // 溜まっているブロックを順に読む
+            while (block->hdr.bh1.block_status & TP_STATUS_USER)
+            {
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                uint32_t npackets = block->hdr.bh1.num_pkts;
+                const uint8_t *cursor = (const uint8_t *)block + block->hdr.bh1.offset_to_first_pkt;
+                for (uint32_t i = 0; i < npackets; ++i)
+                {
+                    const struct tpacket3_hdr *header = (const struct tpacket3_hdr *)cursor;
+                    PacketRingFrame frame;
+                    frame.mHeader = header;
+                    frame.mLink = (const struct sockaddr_ll *)(cursor + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+                    frame.mNetwork = BytesView(cursor + header->tp_net, header->tp_snaplen);
+                    cursor += header->tp_next_offset;
+                    if (mIgnoreOutgoing && frame.mLink->sll_pkttype == PACKET_OUTGOING)
+                    {
+                        continue;
+                    }
+                    on_frame(frame);
+                    ++count;
+                }
+
+                __atomic_thread_fence(__ATOMIC_RELEASE);
+                block->hdr.bh1.block_status = TP_STATUS_KERNEL; // カーネルへ返す
+                mCurrentBlock = (mCurrentBlock + 1) % mBlockCount;
+                block = currentBlock();
+            }
+            return count;
+        }
+
+        // 前回呼び出しからの統計 (カーネル側のカウンタは読むとリセットされる)
+        int statistics(PacketRingStats *stats) const
+        {
+            struct tpacket_stats_v3 kstats;
+            socklen_t length = sizeof(kstats);
+            if (getsockopt(mSocket, SOL_PACKET, PACKET_STATISTICS, &kstats, &length) != 0)
+            {
+                return -1;
+            }
+            stats->mPackets = kstats.tp_packets;
+            stats->mDrops = kstats.tp_drops;
+            stats->mFreezes = kstats.tp_freeze_q_cnt;
+            return 0;
+        }
+
+    private:
+        struct tpacket_block_desc *currentBlock() const
+        {
+            return (struct tpacket_block_desc *)(mMap + (size_t)mCurrentBlock * mBlockSize);
+        }
+
+        int fail()
+        {
+            int saved = errno;
+            close();
+            errno = saved;
+            return -1;
+        }
+
+        int mSocket = -1;
+        uint8_t *mMap = nullptr;
+        size_t mMapSize = 0;
+        uint32_t mBlockSize = 0;
+        uint32_t mBlockCount = 0;
+        uint32_t mCurrentBlock = 0;
+        bool mIgnoreOutgoing = true;
+    };
+} // namespace net
+} // namespace is
+
+#endif // __linux__
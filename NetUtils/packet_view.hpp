@@ -0,0 +1,373 @@
+/**
+ * @file packet_view.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 受信バッファ上のIPv4/IPv6/ICMP/UDP/TCPヘッダをコピーせずに読むビュー
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * `struct ip`(macOS)と`struct iphdr`(Linux)のようなOSごとの構造体の違いを吸収するため,
+ * ヘッダをワイヤ上のバイト列のまま読む. 各ビューは先頭ポインタと長さだけを持ち,
+ * 全てのアクセサは範囲外なら0を返す(未定義動作にならない).
+ *
+ * + `valid()`はヘッダ全体が揃っているかを確認する(IPv4のip_lenは見ない).
+ * + ICMPエラーに引用された元パケットはL4ヘッダの先頭8バイトしか無いので,
+ *   `valid()`が偽でもポート番号などの先頭フィールドは読める.
+ * + チェックサムは`checksumValid()`を呼んだときだけ計算する.
+ *
+ * @warning macOSのRAWソケット(IPv4)は受信時にip_lenをホストバイトオーダ・ヘッダ長抜きに書き換えるため,
+ *          `totalLength()`は受信長の確認に使わないこと. RAWソケットの受信には`payload()`,
+ *          ip_lenを信用できる入力(AF_PACKET, TUN)には`boundedPayload()`を使う.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace is
+{
+namespace net
+{
+    /////////////////////////////////////////////////////////////
+    // バイトオーダ変換 (ビッグエンディアン)
+    /////////////////////////////////////////////////////////////
+
+    constexpr uint16_t LoadBe16(const uint8_t *p)
+    {
+        return (uint16_t)((p[0] << 8) | p[1]);
+    }
+
+    constexpr uint32_t LoadBe32(const uint8_t *p)
+    {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+    }
+
+    inline void StoreBe16(uint8_t *p, uint16_t value)
+    {
+        p[0] = (uint8_t)(value >> 8);
+        p[1] = (uint8_t)(value & 0xFF);
+    }
+
+    inline void StoreBe32(uint8_t *p, uint32_t value)
+    {
+        p[0] = (uint8_t)(value >> 24);
+        p[1] = (uint8_t)((value >> 16) & 0xFF);
+        p[2] = (uint8_t)((value >> 8) & 0xFF);
+        p[3] = (uint8_t)(value & 0xFF);
+    }
+
+    /////////////////////////////////////////////////////////////
+    // インターネットチェックサム (RFC 1071)
+    /////////////////////////////////////////////////////////////
+
+    // 16ビット毎の1の補数和 (畳み込み前). 擬似ヘッダとの合算に使う.
+    constexpr uint32_t ChecksumPartial(const uint8_t *data, size_t nbytes, uint32_t sum = 0)
+    {
+        while (nbytes > 1)
+        {
+            sum += LoadBe16(data);
+            data += 2;
+            nbytes -= 2;
+        }
+        if (nbytes == 1)
+        {
+            sum += (uint32_t)(data[0] << 8); // 奇数バイトは下位を0で埋める
+        }
+        return sum;
+    }
+
+    // 1の補数和を畳み込んで補数を取る (ホストバイトオーダ)
+    constexpr uint16_t ChecksumFinish(uint32_t sum)
+    {
+        sum = (sum >> 16) + (sum & 0xFFFF);
+        sum += (sum >> 16);
+        return (uint16_t)~sum;
+    }
+
+    constexpr uint16_t InternetChecksum(const uint8_t *data, size_t nbytes, uint32_t sum = 0)
+    {
+        return ChecksumFinish(ChecksumPartial(data, nbytes, sum));
+    }
+
+    // 擬似ヘッダ (IPv4: RFC 768/793)
+    constexpr uint32_t PseudoHeaderSum4(const uint8_t *src, const uint8_t *dst, uint8_t protocol, uint32_t length)
+    {
+        return ChecksumPartial(src, 4) + ChecksumPartial(dst, 4) + protocol + length;
+    }
+
+    // 擬似ヘッダ (IPv6: RFC 8200 8.1)
+    constexpr uint32_t PseudoHeaderSum6(const uint8_t *src, const uint8_t *dst, uint8_t next_header, uint32_t length)
+    {
+        return ChecksumPartial(src, 16) + ChecksumPartial(dst, 16) +
+               (length >> 16) + (length & 0xFFFF) + next_header;
+    }
+
+    // チェックサムの差分更新 (RFC 1624): 16bitワードがold_wordからnew_wordに変わったとき
+    constexpr uint16_t ChecksumAdjust16(uint16_t checksum, uint16_t old_word, uint16_t new_word)
+    {
+        uint32_t sum = (uint32_t)(uint16_t)~checksum + (uint32_t)(uint16_t)~old_word + new_word;
+        sum = (sum >> 16) + (sum & 0xFFFF);
+        sum += (sum >> 16);
+        return (uint16_t)~sum;
+    }
+
+    // IPv4アドレスなど32bit値の差分更新
+    constexpr uint16_t ChecksumAdjust32(uint16_t checksum, uint32_t old_value, uint32_t new_value)
+    {
+        return ChecksumAdjust16(ChecksumAdjust16(checksum, (uint16_t)(old_value >> 16), (uint16_t)(new_value >> 16)),
+                                (uint16_t)(old_value & 0xFFFF), (uint16_t)(new_value & 0xFFFF));
+    }
+
+    /////////////////////////////////////////////////////////////
+    // ビューの基底
+    /////////////////////////////////////////////////////////////
+    class BytesView
+    {
+    public:
+        constexpr BytesView() : mData(nullptr), mSize(0) {}
+        constexpr BytesView(const uint8_t *data, size_t size) : mData(data), mSize(data ? size : 0) {}
+        BytesView(const void *data, size_t size) : BytesView((const uint8_t *)data, size) {}
+
+        constexpr const uint8_t *data() const { return mData; }
+        constexpr size_t size() const { return mSize; }
+        constexpr bool empty() const { return mSize == 0; }
+        constexpr bool has(size_t nbytes) const { return mSize >= nbytes; }
+
+        // 範囲外は0
+        constexpr uint8_t u8(size_t offset) const { return offset < mSize ? mData[offset] : 0; }
+        constexpr uint16_t u16(size_t offset) const { return offset + 2 <= mSize ? LoadBe16(mData + offset) : 0; }
+        constexpr uint32_t u32(size_t offset) const { return offset + 4 <= mSize ? LoadBe32(mData + offset) : 0; }
+        constexpr const uint8_t *ptr(size_t offset, size_t nbytes) const
+        {
+            return offset + nbytes <= mSize ? mData + offset : nullptr;
+        }
+
+        // offset以降 (範囲外は空)
+        constexpr BytesView sub(size_t offset) const
+        {
+            return offset <= mSize ? BytesView(mData + offset, mSize - offset) : BytesView();
+        }
+
+        // offsetから最大length (残りより長ければ残りまで)
+        constexpr BytesView sub(size_t offset, size_t length) const
+        {
+            return offset <= mSize ? BytesView(mData + offset, length < mSize - offset ? length : mSize - offset) : BytesView();
+        }
+
+    protected:
+        const uint8_t *mData;
+        size_t mSize;
+    };
+
+    /////////////////////////////////////////////////////////////
+    // IPv4 (RFC 791)
+    /////////////////////////////////////////////////////////////
+    class Ipv4View : public BytesView
+    {
+    public:
+        static constexpr size_t kMinHeaderSize = 20;
+
+        using BytesView::BytesView;
+        constexpr explicit Ipv4View(BytesView bytes) : BytesView(bytes) {}
+
+        constexpr uint8_t version() const { return u8(0) >> 4; }
+        constexpr size_t headerLength() const { return (size_t)(u8(0) & 0x0F) * 4; }
+        constexpr uint8_t tos() const { return u8(1); }
+        constexpr uint16_t totalLength() const { return u16(2); }
+        constexpr uint16_t id() const { return u16(4); }
+        constexpr uint16_t flags() const { return u16(6) >> 13; }
+        constexpr uint16_t fragmentOffset() const { return u16(6) & 0x1FFF; }
+        constexpr uint8_t ttl() const { return u8(8); }
+        constexpr uint8_t protocol() const { return u8(9); }
+        constexpr uint16_t checksum() const { return u16(10); }
+        constexpr const uint8_t *src() const { return ptr(12, 4); } // ネットワークバイトオーダのアドレス
+        constexpr const uint8_t *dst() const { return ptr(16, 4); }
+
+        constexpr bool valid() const
+        {
+            return has(kMinHeaderSize) && version() == 4 &&
+                   headerLength() >= kMinHeaderSize && has(headerLength());
+        }
+
+        constexpr bool checksumValid() const
+        {
+            return valid() && InternetChecksum(mData, headerLength()) == 0;
+        }
+
+        // L4 (ICMP/UDP/TCP). バッファの終わりまで (RAWソケットの受信はこちら. ip_lenを見ないのでmacOSでも使える)
+        constexpr BytesView payload() const { return valid() ? sub(headerLength()) : BytesView(); }
+
+        // L4をtotalLengthまで: イーサネットの最小フレーム長の詰め物を含めない.
+        // ip_lenがワイヤ上のままの入力(AF_PACKETのリング, TUN)に使う. ip_lenがヘッダより短ければ空.
+        // (ICMPエラーに引用されたヘッダのように途中で切れていれば, 有る所まで)
+        constexpr BytesView boundedPayload() const
+        {
+            return valid() && totalLength() >= headerLength() ? sub(headerLength(), (size_t)totalLength() - headerLength()) : BytesView();
+        }
+    };
+
+    /////////////////////////////////////////////////////////////
+    // IPv6 (RFC 8200) 拡張ヘッダは辿らない
+    /////////////////////////////////////////////////////////////
+    class Ipv6View : public BytesView
+    {
+    public:
+        static constexpr size_t kHeaderSize = 40;
+
+        using BytesView::BytesView;
+        constexpr explicit Ipv6View(BytesView bytes) : BytesView(bytes) {}
+
+        constexpr uint8_t version() const { return u8(0) >> 4; }
+        constexpr uint8_t trafficClass() const { return (uint8_t)((u16(0) >> 4) & 0xFF); }
+        constexpr uint32_t flowLabel() const { return u32(0) & 0xFFFFF; }
+        constexpr uint16_t payloadLength() const { return u16(4); }
+        constexpr uint8_t nextHeader() const { return u8(6); }
+        constexpr uint8_t hopLimit() const { return u8(7); }
+        constexpr const uint8_t *src() const { return ptr(8, 16); }
+        constexpr const uint8_t *dst() const { return ptr(24, 16); }
+
+        constexpr bool valid() const { return has(kHeaderSize) && version() == 6; }
+
+        // payloadLengthまで (0はジャンボグラムなので有る所まで)
+        constexpr BytesView payload() const
+        {
+            return !valid() ? BytesView() : payloadLength() == 0 ? sub(kHeaderSize) : sub(kHeaderSize, payloadLength());
+        }
+    };
+
+    /////////////////////////////////////////////////////////////
+    // ICMP (RFC 792) / ICMPv6 (RFC 4443) 先頭8バイトの配置は共通
+    /////////////////////////////////////////////////////////////
+    class IcmpView : public BytesView
+    {
+    public:
+        static constexpr size_t kHeaderSize = 8;
+
+        using BytesView::BytesView;
+        constexpr explicit IcmpView(BytesView bytes) : BytesView(bytes) {}
+
+        constexpr uint8_t type() const { return u8(0); }
+        constexpr uint8_t code() const { return u8(1); }
+        constexpr uint16_t checksum() const { return u16(2); }
+        constexpr uint16_t id() const { return u16(4); }  // Echo Request/Reply
+        constexpr uint16_t seq() const { return u16(6); } // Echo Request/Reply
+        constexpr uint16_t nextMtu() const { return u16(6); } // Fragmentation Needed (IPv4)
+        constexpr uint32_t mtu6() const { return u32(4); }    // Packet Too Big (IPv6)
+
+        constexpr bool valid() const { return has(kHeaderSize); }
+
+        // ICMPv4のチェックサム (ICMPv6は擬似ヘッダが必要なのでchecksumValid6を使う)
+        constexpr bool checksumValid() const
+        {
+            return valid() && InternetChecksum(mData, mSize) == 0;
+        }
+
+        constexpr bool checksumValid6(const uint8_t *src, const uint8_t *dst) const
+        {
+            return valid() && InternetChecksum(mData, mSize, PseudoHeaderSum6(src, dst, 58, (uint32_t)mSize)) == 0;
+        }
+
+        // Echoのデータ部, またはエラーに引用された元パケット
+        constexpr BytesView payload() const { return valid() ? sub(kHeaderSize) : BytesView(); }
+    };
+
+    /////////////////////////////////////////////////////////////
+    // UDP (RFC 768)
+    /////////////////////////////////////////////////////////////
+    class UdpView : public BytesView
+    {
+    public:
+        static constexpr size_t kHeaderSize = 8;
+
+        using BytesView::BytesView;
+        constexpr explicit UdpView(BytesView bytes) : BytesView(bytes) {}
+
+        constexpr uint16_t srcPort() const { return u16(0); }
+        constexpr uint16_t dstPort() const { return u16(2); }
+        constexpr uint16_t length() const { return u16(4); }
+        constexpr uint16_t checksum() const { return u16(6); }
+
+        constexpr bool valid() const { return has(kHeaderSize) && length() >= kHeaderSize && has(length()); }
+
+        constexpr bool checksumValid4(const uint8_t *src, const uint8_t *dst) const
+        {
+            return valid() && (checksum() == 0 || // IPv4ではチェックサム省略可
+                               InternetChecksum(mData, length(), PseudoHeaderSum4(src, dst, 17, length())) == 0);
+        }
+
+        constexpr bool checksumValid6(const uint8_t *src, const uint8_t *dst) const
+        {
+            return valid() && InternetChecksum(mData, length(), PseudoHeaderSum6(src, dst, 17, length())) == 0;
+        }
+
+        constexpr BytesView payload() const
+        {
+            return valid() ? BytesView(mData + kHeaderSize, length() - kHeaderSize) : BytesView();
+        }
+    };
+
+    /////////////////////////////////////////////////////////////
+    // TCP (RFC 9293)
+    /////////////////////////////////////////////////////////////
+    class TcpView : public BytesView
+    {
+    public:
+        static constexpr size_t kMinHeaderSize = 20;
+
+        static constexpr uint8_t kFin = 0x01;
+        static constexpr uint8_t kSyn = 0x02;
+        static constexpr uint8_t kRst = 0x04;
+        static constexpr uint8_t kPsh = 0x08;
+        static constexpr uint8_t kAck = 0x10;
+
+        using BytesView::BytesView;
+        constexpr explicit TcpView(BytesView bytes) : BytesView(bytes) {}
+
+        constexpr uint16_t srcPort() const { return u16(0); }
+        constexpr uint16_t dstPort() const { return u16(2); }
+        constexpr uint32_t seq() const { return u32(4); }
+        constexpr uint32_t ack() const { return u32(8); }
+        constexpr size_t headerLength() const { return (size_t)(u8(12) >> 4) * 4; }
+        constexpr uint8_t flags() const { return u8(13); }
+        constexpr bool syn() const { return (flags() & kSyn) != 0; }
+        constexpr bool isAck() const { return (flags() & kAck) != 0; }
+        constexpr bool rst() const { return (flags() & kRst) != 0; }
+        constexpr bool fin() const { return (flags() & kFin) != 0; }
+        constexpr uint16_t window() const { return u16(14); }
+        constexpr uint16_t checksum() const { return u16(16); }
+
+        constexpr bool valid() const
+        {
+            return has(kMinHeaderSize) && headerLength() >= kMinHeaderSize && has(headerLength());
+        }
+
+        constexpr bool checksumValid4(const uint8_t *src, const uint8_t *dst) const
+        {
+            return valid() && InternetChecksum(mData, mSize, PseudoHeaderSum4(src, dst, 6, (uint32_t)mSize)) == 0;
+        }
+
+        constexpr bool checksumValid6(const uint8_t *src, const uint8_t *dst) const
+        {
+            return valid() && InternetChecksum(mData, mSize, PseudoHeaderSum6(src, dst, 6, (uint32_t)mSize)) == 0;
+        }
+
+        constexpr BytesView payload() const { return valid() ? sub(headerLength()) : BytesView(); }
+    };
+
+    /////////////////////////////////////////////////////////////
+    // 送信用: ICMP Echoヘッダの書き込み
+    /////////////////////////////////////////////////////////////
+
+    // checksumは0で書き込む. ICMPv4は呼び出し側でInternetChecksumを書き込むこと.
+    inline void WriteIcmpEchoHeader(uint8_t *buf, uint8_t type, uint16_t id, uint16_t seq)
+    {
+        buf[0] = type;
+        buf[1] = 0; // code
+        StoreBe16(buf + 2, 0);
+        StoreBe16(buf + 4, id);
+        StoreBe16(buf + 6, seq);
+    }
+
+} // namespace net
+} // namespace is
@@ -0,0 +1,642 @@
+/**
+ * @file path_mtu.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief UDPのパスMTU探索 (DPLPMTUD, RFC 8899) と最大ペイロードの決定
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * ICMPのPacket Too Bigは途中で捨てられることが多い(ブラックホール)ので, 実際に大きなパケットを送って
+ * 相手から届いたと返事(ACK)があった大きさだけを信じる. 返事には受信側の協力が要る (AnswerPmtuProbe).
+ *
+ * + ソケットはIP_PMTUDISC_PROBE(IPv6はIPV6_PMTUDISC_PROBE): DFを立て, カーネルのPMTUキャッシュで
+ *   勝手に断片化もEMSGSIZEもしない. インターフェースのMTUを超えるとEMSGSIZE (これは上限として使う).
+ * + PlpmtudProber: 宛先1つ分の状態機械 (BASE -> SEARCHING -> SEARCH_COMPLETE, 失敗でERROR).
+ *   BASE_PLPMTU(1200)を確かめてから, 経路/インターフェースのMTU(limit)やPTBで上限が分かっていればまずその大きさを試す.
+ *   通らなければ確認済みと上限の間を二分探索する. 1つの大きさにMAX_PROBES回返事が無ければ失敗.
+ *   SEARCH_COMPLETEの後はraise時間毎にlimitまで探し直す. PTBが届けばヒントとして使う.
+ * + PathMtuCache: 宛先 -> PlpmtudProber (FlatHashMap). maxPayload()で断片化しない最大のUDPペイロード.
+ * + MaxReceivePayload: インターフェースのMTUから受信バッファの大きさを決める.
+ *
+ * プローブ/ACK (ネットワークバイトオーダ)
+ *   0: magic "PLPM"  4: type (1: probe, 2: ack)  5-7: 0  8: token  12: 探しているIPパケットの大きさ
+ *   プローブはIPパケットがその大きさになるまで0で埋める. ACKは16バイトだけ.
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+#if defined(__linux__)
+#include <linux/errqueue.h> // sock_extended_err
+#endif
+
+#include <algorithm> // std::min, std::max
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <NetUtils/flat_hash_map.hpp>
+#include <NetUtils/net_interface.hpp>
+#include <NetUtils/packet_view.hpp>
+
+namespace is
+{
+namespace net
+{
+    constexpr size_t kBasePlpmtu = 1200;   // RFC 8899 BASE_PLPMTU (IPパケットの大きさ)
+    constexpr size_t kMinPlpmtuIpv4 = 576; // これ以下には下げない
+    constexpr size_t kMinPlpmtuIpv6 = 1280;
+    constexpr uint32_t kPmtuMagic = 0x504C504D; // "PLPM"
+    constexpr size_t kPmtuFrameSize = 16;
+    constexpr uint8_t kPmtuProbe = 1;
+    constexpr uint8_t kPmtuAck = 2;
+
+    // IPヘッダ + UDPヘッダ (オプション/拡張ヘッダ無し)
+    inline size_t UdpOverhead(int family)
+    {
+        return family == AF_INET6 ? 48 : 28;
+    }
+
+    // UDPペイロードの上限 (IPv4: 65535 - 28, IPv6: 65535 - 8. ジャンボグラムは使わない)
+    inline size_t MaxUdpPayload(int family)
+    {
+        return family == AF_INET6 ? 65527 : 65507;
+    }
+
+    inline int InterfaceMtu(const char *ifname)
+    {
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sock < 0)
+        {
+            return -1;
+        }
+        struct ifreq request;
+        std::memset(&request, 0, sizeof(request));
+        std::strncpy(request.ifr_name, ifname, IFNAMSIZ - 1);
+        int ret = ioctl(sock, SIOCGIFMTU, &request);
+        close(sock);
+        return ret == 0 ? request.ifr_mtu : -1;
+    }
+
+    // upのインターフェースのMTUの最大 (ループバックを除くこともできる)
+    inline size_t MaxInterfaceMtu(bool include_loopback = true)
+    {
+        size_t mtu = 0;
+        for (const NetInterface &netif : EnumerateInterfaces())
+        {
+            if (!netif.up() || (!include_loopback && netif.loopback()))
+            {
+                continue;
+            }
+            int value = InterfaceMtu(netif.mName.c_str());
+            if (value > 0 && (size_t)value > mtu)
+            {
+                mtu = (size_t)value;
+            }
+        }
+        return mtu ? mtu : 1500;
+    }
+
+    // 受信バッファの大きさ: どのインターフェースから来ても切り詰められない最大のペイロード
+    inline size_t MaxReceivePayload(int family, bool include_loopback = true)
+    {
+        size_t mtu = MaxInterfaceMtu(include_loopback);
+        size_t payload = mtu > UdpOverhead(family) ? mtu - UdpOverhead(family) : 0;
+        return payload < MaxUdpPayload(family) ? payload : MaxUdpPayload(family);
+    }
+
+    // DFを立て, カーネルのPMTUキャッシュによる断片化/EMSGSIZEを止める
+    inline int EnableProbeMtuDiscovery(int sock, int family)
+    {
+#if defined(IP_PMTUDISC_PROBE)
+        if (family == AF_INET6)
+        {
+            int value = IPV6_PMTUDISC_PROBE;
+            return setsockopt(sock, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &value, sizeof(value));
+        }
+        int value = IP_PMTUDISC_PROBE;
+        return setsockopt(sock, IPPROTO_IP, IP_MTU_DISCOVER, &value, sizeof(value));
+#elif defined(IP_DONTFRAG)
+        int on = 1;
+        if (family == AF_INET6)
+        {
+            return setsockopt(sock, IPPROTO_IPV6, IPV6_DONTFRAG, &on, sizeof(on));
+        }
+        return setsockopt(sock, IPPROTO_IP, IP_DONTFRAG, &on, sizeof(on));
+#else
+        (void)sock;
+        (void)family;
+        errno = ENOPROTOOPT;
+        return -1;
+#endif
+    }
+
+    // PTB(ICMP)をエラーキューで受ける
+    inline int EnableIcmpErrors(int sock, int family)
+    {
+#if defined(__linux__)
+        int on = 1;
+        if (family == AF_INET6)
+        {
+            return setsockopt(sock, IPPROTO_IPV6, IPV6_RECVERR, &on, sizeof(on));
+        }
+        return setsockopt(sock, IPPROTO_IP, IP_RECVERR, &on, sizeof(on));
+#else
+        (void)sock;
+        (void)family;
+        return 0;
+#endif
+    }
+
+    // カーネルが宛先への経路に持っているMTU (出力インターフェースのMTUか, PTBで下がった値). 分からなければ-1.
+    inline int RouteMtu(const struct sockaddr *destination, socklen_t length)
+    {
+#if defined(__linux__)
+        int sock = socket(destination->sa_family, SOCK_DGRAM, 0);
+        if (sock < 0)
+        {
+            return -1;
+        }
+        int mtu = -1;
+        socklen_t size = sizeof(mtu);
+        if (connect(sock, destination, length) == 0)
+        {
+            if (destination->sa_family == AF_INET6)
+            {
+                getsockopt(sock, IPPROTO_IPV6, IPV6_MTU, &mtu, &size);
+            }
+            else
+            {
+                getsockopt(sock, IPPROTO_IP, IP_MTU, &mtu, &size);
+            }
+        }
+        close(sock);
+        return mtu;
+#else
+        (void)destination;
+        (void)length;
+        return -1;
+#endif
+    }
+
+    /**
+     * @brief エラーキューからPTB(IPv4: Fragmentation Needed, IPv6: Packet Too Big)を1つ読む.
+     * @param destination 元のパケットの宛先
+     * @param mtu 通知されたMTU
+     * @return 1: PTB, 0: キューが空, -1: PTB以外(読み捨てた)
+     */
+    inline int ReadPathMtuError(int sock, struct sockaddr_storage *destination, size_t *mtu)
+    {
+#if defined(__linux__)
+        char control[512];
+        char data[64];
+        struct iovec iov = {data, sizeof(data)};
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_name = destination;
+        msg.msg_namelen = sizeof(*destination);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            return 0;
+        }
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                  (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)))
+            {
+                continue;
+            }
+            struct sock_extended_err error;
+            std::memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+            if (error.ee_errno == EMSGSIZE &&
+                (error.ee_origin == SO_EE_ORIGIN_ICMP || error.ee_origin == SO_EE_ORIGIN_ICMP6 ||
+                 error.ee_origin == SO_EE_ORIGIN_LOCAL))
+            {
+                *mtu = error.ee_info;
+                return 1;
+            }
+        }
+        return -1;
+#else
+        (void)sock;
+        (void)destination;
+        (void)mtu;
+        return 0;
+#endif
+    }
+
+    /////////////////////////////////////////////////////////////
+    // プローブ/ACK
+    /////////////////////////////////////////////////////////////
+    // ip_sizeのIPパケットになるプローブを書く. 戻り値はUDPペイロードの大きさ (outはその大きさ必要)
+    inline size_t BuildPmtuProbe(uint8_t *out, int family, uint32_t token, size_t ip_size)
+    {
+        size_t length = ip_size - UdpOverhead(family);
+        std::memset(out, 0, length);
+        StoreBe32(out, kPmtuMagic);
+        out[4] = kPmtuProbe;
+        StoreBe32(out + 8, token);
+        StoreBe32(out + 12, (uint32_t)ip_size);
+        return length;
+    }
+
+    inline bool IsPmtuFrame(BytesView frame, uint8_t type)
+    {
+        return frame.size() >= kPmtuFrameSize && frame.u32(0) == kPmtuMagic && frame.u8(4) == type;
+    }
+
+    /**
+     * @brief 受信側: プローブなら送信元へACKを返してtrue. 普通のデータならfalse.
+     */
+    inline bool AnswerPmtuProbe(int sock, BytesView datagram, const struct sockaddr *from, socklen_t from_length)
+    {
+        if (!IsPmtuFrame(datagram, kPmtuProbe))
+        {
+            return false;
+        }
+        uint8_t ack[kPmtuFrameSize];
+        std::memcpy(ack, datagram.data(), kPmtuFrameSize);
+        ack[4] = kPmtuAck;
+        sendto(sock, ack, sizeof(ack), 0, from, from_length);
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////
+    // DPLPMTUD
+    /////////////////////////////////////////////////////////////
+    enum class PlpmtudState
+    {
+        kBase,           // BASE_PLPMTUを確かめている
+        kSearching,      // 上を探している
+        kSearchComplete, // 確定 (raise時間後に探し直す)
+        kError,          // BASE_PLPMTUも通らない
+    };
+
+    inline const char *PlpmtudStateName(PlpmtudState state)
+    {
+        switch (state)
+        {
+        case PlpmtudState::kBase:
+            return "BASE";
+        case PlpmtudState::kSearching:
+            return "SEARCHING";
+        case PlpmtudState::kSearchComplete:
+            return "SEARCH_COMPLETE";
+        default:
+            return "ERROR";
+        }
+    }
+
+    struct PlpmtudOptions
+    {
+        size_t mMaxPlpmtu = 65535;        // 探す上限 (経路/インターフェースのMTUでさらに抑える)
+        int mMaxProbes = 3;               // 1つの大きさを諦めるまでのプローブ数 (MAX_PROBES)
+        uint64_t mProbeTimeoutMs = 500;   // ACKを待つ時間 (PROBE_TIMER)
+        uint64_t mRaiseTimeoutMs = 600000; // 確定後に上を探し直すまで (PMTU_RAISE_TIMER)
+        size_t mResolution = 8;           // 上限と確認済みの差がこれ未満なら確定
+    };
+
+    class PlpmtudProber
+    {
+    public:
+        explicit PlpmtudProber(int family = AF_INET, const PlpmtudOptions &options = PlpmtudOptions())
+            : mFamily(family)
+            , mOptions(options)
+            , mMin(family == AF_INET6 ? kMinPlpmtuIpv6 : kMinPlpmtuIpv4)
+            , mPlpmtu(mMin)
+            , mHigh(options.mMaxPlpmtu)
+            , mLimit(options.mMaxPlpmtu)
+        {
+        }
+
+        PlpmtudState state() const { return mState; }
+        // 確認済みのMTU (IPパケットの大きさ)
+        size_t plpmtu() const { return mPlpmtu; }
+        // 断片化せずに送れる最大のUDPペイロード
+        size_t maxPayload() const { return mPlpmtu - UdpOverhead(mFamily); }
+        size_t probes() const { return mProbes; }
+        bool done() const { return mState == PlpmtudState::kSearchComplete || mState == PlpmtudState::kError; }
+
+        // 上限 (経路/インターフェースのMTU) を下げる. 探し直しでもこれを超えない. 次の探索ではまずこの大きさを試す.
+        void limit(size_t max_plpmtu)
+        {
+            if (max_plpmtu >= mMin && max_plpmtu < mLimit)
+            {
+                mLimit = max_plpmtu;
+            }
+            if (max_plpmtu >= mMin && max_plpmtu < mHigh && max_plpmtu >= mPlpmtu)
+            {
+                mHigh = max_plpmtu;
+                mHighKnown = true;
+            }
+        }
+
+        /**
+         * @brief 送るべきプローブがあれば, その大きさ(IPパケット)と番号を返す.
+         * 前のプローブのACKを待っている間はfalse. 時間切れはここで数える.
+         */
+        bool nextProbe(uint64_t now_ms, size_t *ip_size, uint32_t *token)
+        {
+            if (mState == PlpmtudState::kSearchComplete || mState == PlpmtudState::kError)
+            {
+                if (now_ms - mCompletedMs < mOptions.mRaiseTimeoutMs)
+                {
+                    return false;
+                }
+                // 探し直す (経路が変わって大きくなったかもしれない). 上限はlimitのまま
+                mHigh = mLimit;
+                mHighKnown = mLimit < mOptions.mMaxPlpmtu;
+                mState = mState == PlpmtudState::kError ? PlpmtudState::kBase : PlpmtudState::kSearching;
+            }
+            if (mOutstanding)
+            {
+                if (now_ms - mSentMs < mOptions.mProbeTimeoutMs)
+                {
+                    return false;
+                }
+                if (mAttempts >= mOptions.mMaxProbes)
+                {
+                    fail(mProbeSize, now_ms);
+                    if (done())
+                    {
+                        return false;
+                    }
+                }
+            }
+            if (!mOutstanding)
+            {
+                mProbeSize = target();
+                mAttempts = 0;
+            }
+            mOutstanding = true;
+            ++mAttempts;
+            ++mProbes;
+            mSentMs = now_ms;
+            mToken = ++mNextToken;
+            *ip_size = mProbeSize;
+            *token = mToken;
+            return true;
+        }
+
+        void onAck(BytesView ack, uint64_t now_ms)
+        {
+            if (!IsPmtuFrame(ack, kPmtuAck) || !mOutstanding || ack.u32(8) != mToken)
+            {
+                return; // 古いACK
+            }
+            mOutstanding = false;
+            mPlpmtu = mProbeSize;
+            if (mState == PlpmtudState::kBase)
+            {
+                mState = PlpmtudState::kSearching;
+            }
+            checkComplete(now_ms);
+        }
+
+        // ip_sizeのプローブがローカルでEMSGSIZE (出力インターフェースのMTUを超えた)
+        void onSendTooBig(size_t ip_size, uint64_t now_ms)
+        {
+            mOutstanding = false;
+            fail(ip_size, now_ms);
+        }
+
+        // PTB. 確認済みより小さければそこまで下げて探し直す. 大きければ今回の探索の上限として使う
+        // (limitは変えない. 経路が戻ればraise時間後の探し直しで大きくなれる).
+        void onPtb(size_t mtu, uint64_t now_ms)
+        {
+            if (mtu < mPlpmtu)
+            {
+                mPlpmtu = mtu > mMin ? mtu : mMin;
+                mHigh = mPlpmtu;
+                mOutstanding = false;
+                checkComplete(now_ms);
+            }
+            else if (mtu < mHigh)
+            {
+                mHigh = mtu;
+                mHighKnown = true;
+            }
+        }
+
+    private:
+        size_t target() const
+        {
+            if (mState == PlpmtudState::kBase)
+            {
+                // IPv6は最小(1280)がBASE_PLPMTU(1200)より大きい. 最小を下回る大きさは試さない
+                return std::min(std::max(kBasePlpmtu, mMin), mHigh);
+            }
+            if (mHighKnown)
+            {
+                return mHigh; // 1500のような経路のMTUそのものは丸めずに試す
+            }
+            size_t size = (mPlpmtu + mHigh + 1) / 2;
+            return size & ~(size_t)3; // 4バイト単位
+        }
+
+        void fail(size_t ip_size, uint64_t now_ms)
+        {
+            mOutstanding = false;
+            if (mState == PlpmtudState::kBase)
+            {
+                mState = PlpmtudState::kError;
+                mPlpmtu = mMin;
+                mCompletedMs = now_ms;
+                return;
+            }
+            mHigh = ip_size > mPlpmtu ? ip_size - 1 : mPlpmtu;
+            mHighKnown = false; // 分かっていた上限は通らなかったので二分探索
+            checkComplete(now_ms);
+        }
+
+        void checkComplete(uint64_t now_ms)
+        {
+            if (mState == PlpmtudState::kSearching && (mHigh <= mPlpmtu || mHigh - mPlpmtu < mOptions.mResolution))
+            {
+                mState = PlpmtudState::kSearchComplete;
+                mCompletedMs = now_ms;
+            }
+        }
+
+        int mFamily;
+        PlpmtudOptions mOptions;
+        size_t mMin;
+        PlpmtudState mState = PlpmtudState::kBase;
+        size_t mPlpmtu;
+        size_t mHigh;
+        size_t mLimit;           // 経路/インターフェースのMTU (探し直しの上限)
+        bool mHighKnown = false; // mHighが推測でなく経路のMTUかPTBの値
+        bool mOutstanding = false;
+        size_t mProbeSize = 0;
+        int mAttempts = 0;
+        uint64_t mSentMs = 0;
+        uint64_t mCompletedMs = 0;
+        uint32_t mToken = 0;
+        uint32_t mNextToken = 0;
+        size_t mProbes = 0;
+    };
+
+    // 宛先 (アドレスのみ. パスMTUはポートに依らない)
+    struct PathMtuKey
+    {
+        uint8_t mAddress[16];
+        uint8_t mFamily;
+
+        bool operator==(const PathMtuKey &other) const
+        {
+            return mFamily == other.mFamily && std::memcmp(mAddress, other.mAddress, sizeof(mAddress)) == 0;
+        }
+    };
+
+    struct PathMtuKeyHash
+    {
+        size_t operator()(const PathMtuKey &key) const
+        {
+            uint64_t hash = 1469598103934665603ull; // FNV-1a
+            for (uint8_t b : key.mAddress)
+            {
+                hash = (hash ^ b) * 1099511628211ull;
+            }
+            return (size_t)((hash ^ key.mFamily) * 1099511628211ull);
+        }
+    };
+
+    inline PathMtuKey MakePathMtuKey(const struct sockaddr *address)
+    {
+        PathMtuKey key;
+        std::memset(&key, 0, sizeof(key));
+        key.mFamily = (uint8_t)address->sa_family;
+        if (address->sa_family == AF_INET)
+        {
+            std::memcpy(key.mAddress, &((const struct sockaddr_in *)address)->sin_addr, 4);
+        }
+        else if (address->sa_family == AF_INET6)
+        {
+            std::memcpy(key.mAddress, &((const struct sockaddr_in6 *)address)->sin6_addr, 16);
+        }
+        return key;
+    }
+
+    class PathMtuCache
+    {
+    public:
+        explicit PathMtuCache(const PlpmtudOptions &options = PlpmtudOptions()) : mOptions(options) {}
+
+        // 宛先の状態 (初めてなら経路のMTUを上限にして作る). 次の挿入までのポインタ.
+        PlpmtudProber *entry(const struct sockaddr *destination, socklen_t length)
+        {
+            PathMtuKey key = MakePathMtuKey(destination);
+            PlpmtudProber *prober = mProbers.find(key);
+            if (!prober)
+            {
+                prober = mProbers.emplace(key, PlpmtudProber(destination->sa_family, mOptions)).first;
+                int route = RouteMtu(destination, length);
+                if (route > 0)
+                {
+                    prober->limit((size_t)route);
+                }
+            }
+            return prober;
+        }
+
+        // まだ探していない宛先はBASE_PLPMTU相当 (確認前なので最小値) を返す
+        size_t maxPayload(const struct sockaddr *destination)
+        {
+            PlpmtudProber *prober = mProbers.find(MakePathMtuKey(destination));
+            return prober ? prober->maxPayload()
+                          : (destination->sa_family == AF_INET6 ? kMinPlpmtuIpv6 : kMinPlpmtuIpv4) - UdpOverhead(destination->sa_family);
+        }
+
+        size_t size() const { return mProbers.size(); }
+
+    private:
+        PlpmtudOptions mOptions;
+        FlatHashMap<PathMtuKey, PlpmtudProber, PathMtuKeyHash> mProbers;
+    };
+
+    /**
+     * @brief 1つの宛先についてSEARCH_COMPLETE(かERROR)まで探す (ブロックする).
+     * sockはEnableProbeMtuDiscovery済みで, 相手はAnswerPmtuProbeで返事をすること.
+     * on_step(ip_size, acked)が各プローブの結果で呼ばれる.
+     * @return 確認できたMTU (IPパケットの大きさ)
+     */
+    template <typename OnStep>
+    inline size_t RunPlpmtud(int sock, const struct sockaddr *destination, socklen_t length, PlpmtudProber &prober,
+                             uint64_t timeout_ms, OnStep &&on_step)
+    {
+        auto now_ms = []() {
+            return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch()).count();
+        };
+        std::vector<uint8_t> probe(MaxUdpPayload(destination->sa_family));
+        uint8_t reply[256];
+        uint64_t start = now_ms();
+        size_t probing = 0;
+        while (!prober.done() && now_ms() - start < timeout_ms)
+        {
+            size_t ip_size;
+            uint32_t token;
+            if (prober.nextProbe(now_ms(), &ip_size, &token))
+            {
+                if (probing != 0 && probing != ip_size)
+                {
+                    on_step(probing, false); // 前の大きさは諦めた
+                }
+                probing = ip_size;
+                size_t n = BuildPmtuProbe(probe.data(), destination->sa_family, token, ip_size);
+                if (sendto(sock, probe.data(), n, 0, destination, length) < 0)
+                {
+                    if (errno == EMSGSIZE)
+                    {
+                        prober.onSendTooBig(ip_size, now_ms());
+                        on_step(ip_size, false);
+                        probing = 0;
+                    }
+                    continue;
+                }
+            }
+            struct pollfd target;
+            target.fd = sock;
+            target.events = POLLIN;
+            if (poll(&target, 1, 20) <= 0)
+            {
+                continue;
+            }
+            if (target.revents & POLLERR)
+            {
+                struct sockaddr_storage offender;
+                size_t mtu;
+                if (ReadPathMtuError(sock, &offender, &mtu) == 1)
+                {
+                    prober.onPtb(mtu, now_ms());
+                }
+            }
+            ssize_t n;
+            while ((n = recv(sock, reply, sizeof(reply), MSG_DONTWAIT)) > 0)
+            {
+                size_t before = prober.plpmtu();
+                prober.onAck(BytesView(reply, (size_t)n), now_ms());
+                if (prober.plpmtu() != before || (probing != 0 && prober.plpmtu() == probing))
+                {
+                    on_step(probing, true);
+                    probing = 0;
+                }
+            }
+        }
+        return prober.plpmtu();
+    }
+} // namespace net
+} // namespace is
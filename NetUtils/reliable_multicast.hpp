@@ -0,0 +1,568 @@
+/**
+ * @file reliable_multicast.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief マルチキャストの上に載せるNAK方式の再送 (シーケンス番号, 再送リング, 欠番検出)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * 受信者が数百いると, 受信者毎のTCPやACKは送信側が持たない. ここでは受信者が欠番に気付いたときだけ
+ * 送信者へユニキャストでNAKを返し, 送信者は再送をマルチキャストで流す(同じ欠番の他の受信者も同時に埋まる).
+ *
+ * + 送信者(RmcSender): DATAに連番を振り, 直近history個のフレームを再送リングに持つ.
+ *   同じ番号へのNAKはrepair_holdoffの間は1回だけ再送する(多数の受信者からの重複NAKをまとめる).
+ *   NAKは認証されないので, 1つのNAKで調べる番号はmax_nak_span個まで(広い範囲を並べた1つのNAKで
+ *   再送リング全体を流させない). 残りは数えて捨て, 受信者の次のNAKで続きを再送する.
+ *   データが途切れている間もHEARTBEAT(最後の番号)を流し, 末尾の欠落を検出させる.
+ * + 受信者(RmcReceiver): 欠番をランダムな待ち時間(0..backoff)の後にNAKする. 待っている間に
+ *   他の受信者のNAKで再送が届けば自分のNAKは出さない(抑制). 再送が来なければretryごとにNAKし直し,
+ *   max_retries回で諦めて欠落として先へ進む. 受け取ったデータは番号順に渡す.
+ *
+ * フレーム (16バイトのヘッダ + ペイロード, ネットワークバイトオーダ)
+ *   0: magic "RMC1" (UdpPayloadMagicFilterで他のパケットをカーネル内で捨てられる)
+ *   4: type (DATA, REPAIR, HEARTBEAT, NAK)  5: reserved  6: count (NAKの範囲数)
+ *   8: session (送信者の起動毎の乱数. 変われば受信者は状態を捨てる)
+ *  12: sequence (DATA/REPAIR: 番号, HEARTBEAT: 最後に送った番号)
+ *  NAKのペイロードは{first(32bit), count(32bit)}の並び.
+ *
+ * ソケットは持たない. フレームの組み立てと状態だけを持ち, 送受信は呼び出し側が行う.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include <NetUtils/packet_view.hpp>
+
+namespace is
+{
+namespace net
+{
+    constexpr uint32_t kRmcMagic = 0x524D4331; // "RMC1"
+    constexpr size_t kRmcHeaderSize = 16;
+    constexpr size_t kRmcMaxNakRanges = 64;
+    constexpr size_t kRmcMaxNakSpan = 256; // 1つのNAKで調べる番号の上限 (既定)
+
+    enum RmcType : uint8_t
+    {
+        kRmcData = 1,
+        kRmcRepair = 2,
+        kRmcHeartbeat = 3,
+        kRmcNak = 4,
+    };
+
+    struct RmcHeader
+    {
+        uint8_t mType = 0;
+        uint16_t mCount = 0;
+        uint32_t mSession = 0;
+        uint32_t mSequence = 0;
+    };
+
+    inline void WriteRmcHeader(uint8_t *out, const RmcHeader &header)
+    {
+        StoreBe32(out, kRmcMagic);
+        out[4] = header.mType;
+        out[5] = 0;
+        StoreBe16(out + 6, header.mCount);
+        StoreBe32(out + 8, header.mSession);
+        StoreBe32(out + 12, header.mSequence);
+    }
+
+    inline bool ReadRmcHeader(BytesView frame, RmcHeader *header)
+    {
+        if (frame.size() < kRmcHeaderSize || frame.u32(0) != kRmcMagic)
+        {
+            return false;
+        }
+        header->mType = frame.u8(4);
+        header->mCount = frame.u16(6);
+        header->mSession = frame.u32(8);
+        header->mSequence = frame.u32(12);
+        return true;
+    }
+
+    // 周回する32bit番号の比較 (RFC 1982)
+    inline bool RmcSeqLess(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+    struct RmcSeqCompare
+    {
+        bool operator()(uint32_t a, uint32_t b) const { return RmcSeqLess(a, b); }
+    };
+
+    /////////////////////////////////////////////////////////////
+    // 送信者
+    /////////////////////////////////////////////////////////////
+    struct RmcSenderStats
+    {
+        uint64_t mSent = 0;          // DATA
+        uint64_t mRepairs = 0;       // 再送したREPAIR
+        uint64_t mNaks = 0;          // 受け取ったNAK
+        uint64_t mSuppressed = 0;    // holdoff中で再送しなかった番号
+        uint64_t mUnrecoverable = 0; // 再送リングから溢れていた番号
+        uint64_t mClipped = 0;       // NAK毎の上限を超えて無視した番号
+    };
+
+    class RmcSender
+    {
+    public:
+        RmcSender(uint32_t session, size_t history = 4096, size_t max_payload = 1400, uint64_t repair_holdoff_ms = 20,
+                  size_t max_nak_span = kRmcMaxNakSpan)
+            : mSession(session)
+            , mMaxPayload(max_payload)
+            , mRepairHoldoffMs(repair_holdoff_ms)
+            , mMaxNakSpan(max_nak_span)
+        {
+            size_t slots = 1;
+            while (slots < history)
+            {
+                slots <<= 1;
+            }
+            mMask = slots - 1;
+            mHistory.resize(slots);
+            for (Slot &slot : mHistory)
+            {
+                slot.mFrame.resize(kRmcHeaderSize + max_payload); // 送信中に確保しない
+            }
+        }
+
+        size_t maxFrameSize() const { return kRmcHeaderSize + mMaxPayload; }
+
+        // DATAフレームをoutに書き(maxFrameSize()以上), 再送リングにも残す. 返り値はフレーム長(0: 長すぎる).
+        size_t data(const uint8_t *payload, size_t length, uint8_t *out)
+        {
+            if (length > mMaxPayload)
+            {
+                return 0;
+            }
+            RmcHeader header;
+            header.mType = kRmcData;
+            header.mSession = mSession;
+            header.mSequence = mNext;
+            WriteRmcHeader(out, header);
+            std::memcpy(out + kRmcHeaderSize, payload, length);
+
+            Slot &slot = mHistory[mNext & mMask];
+            std::memcpy(slot.mFrame.data(), out, kRmcHeaderSize + length);
+            slot.mLength = kRmcHeaderSize + length;
+            slot.mSequence = mNext;
+            slot.mValid = true;
+            slot.mLastRepairMs = 0;
+            ++mNext;
+            ++mStats.mSent;
+            return slot.mLength;
+        }
+
+        // 最後に送った番号を知らせる (まだ1つも送っていなければ番号は next - 1 = 0xFFFFFFFF)
+        size_t heartbeat(uint8_t *out) const
+        {
+            RmcHeader header;
+            header.mType = kRmcHeartbeat;
+            header.mSession = mSession;
+            header.mSequence = mNext - 1;
+            WriteRmcHeader(out, header);
+            return kRmcHeaderSize;
+        }
+
+        // NAKの各番号について再送フレームをon_repair(const uint8_t *frame, size_t length)へ渡す (合計max_nak_span個まで)
+        template <typename OnRepair>
+        void onNak(BytesView frame, uint64_t now_ms, OnRepair &&on_repair)
+        {
+            RmcHeader header;
+            if (!ReadRmcHeader(frame, &header) || header.mType != kRmcNak || header.mSession != mSession)
+            {
+                return;
+            }
+            ++mStats.mNaks;
+            size_t budget = mMaxNakSpan;
+            for (size_t r = 0; r < header.mCount && kRmcHeaderSize + (r + 1) * 8 <= frame.size(); ++r)
+            {
+                uint32_t first = frame.u32(kRmcHeaderSize + r * 8);
+                uint32_t count = frame.u32(kRmcHeaderSize + r * 8 + 4);
+                count = (uint32_t)std::min<size_t>(count, mHistory.size());
+                if (count > budget)
+                {
+                    mStats.mClipped += count - budget;
+                    count = (uint32_t)budget;
+                }
+                budget -= count;
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    uint32_t sequence = first + i;
+                    if (!RmcSeqLess(sequence, mNext))
+                    {
+                        break; // まだ送っていない番号
+                    }
+                    Slot &slot = mHistory[sequence & mMask];
+                    if (!slot.mValid || slot.mSequence != sequence)
+                    {
+                        ++mStats.mUnrecoverable;
+                        continue;
+                    }
+                    if (slot.mLastRepairMs != 0 && now_ms - slot.mLastRepairMs < mRepairHoldoffMs)
+                    {
+                        ++mStats.mSuppressed; // 直前に再送済み (他の受信者のNAK)
+                        continue;
+                    }
+                    slot.mLastRepairMs = now_ms ? now_ms : 1;
+                    slot.mFrame[4] = kRmcRepair;
+                    on_repair(slot.mFrame.data(), slot.mLength);
+                    ++mStats.mRepairs;
+                }
+            }
+        }
+
+        uint32_t session() const { return mSession; }
+        uint32_t nextSequence() const { return mNext; }
+        const RmcSenderStats &stats() const { return mStats; }
+
+    private:
+        struct Slot
+        {
+            uint32_t mSequence = 0;
+            bool mValid = false;
+            uint64_t mLastRepairMs = 0;
+            size_t mLength = 0;
+            std::vector<uint8_t> mFrame;
+        };
+
+        const uint32_t mSession;
+        const size_t mMaxPayload;
+        const uint64_t mRepairHoldoffMs;
+        const size_t mMaxNakSpan;
+        size_t mMask = 0;
+        std::vector<Slot> mHistory;
+        uint32_t mNext = 0;
+        RmcSenderStats mStats;
+    };
+
+    /////////////////////////////////////////////////////////////
+    // 受信者
+    /////////////////////////////////////////////////////////////
+    struct RmcReceiverOptions
+    {
+        uint32_t mBackoffMaxMs = 10;  // 欠番に気付いてから最初のNAKまでの最大待ち (ランダム)
+        uint32_t mRetryMs = 40;       // NAKの再送間隔
+        uint32_t mMaxRetries = 5;     // これを超えたら欠落として先へ進む
+        size_t mMaxBuffered = 8192;   // 順番待ちで溜めるフレーム数の上限
+    };
+
+    struct RmcReceiverStats
+    {
+        uint64_t mReceived = 0;       // 受け取ったDATA/REPAIR (重複を除く)
+        uint64_t mDelivered = 0;      // 番号順に渡した数
+        uint64_t mDuplicates = 0;     // 受信済みの番号 (他の受信者向けの再送など)
+        uint64_t mMissing = 0;        // 欠番として検出した数
+        uint64_t mNaksSent = 0;       // NAKフレーム数
+        uint64_t mRecovered = 0;      // 再送で埋まった欠番
+        uint64_t mLost = 0;           // 諦めた欠番
+        uint64_t mRecoveryMsTotal = 0; // 欠番検出から埋まるまでの合計 [ms]
+        uint64_t mSessions = 0;       // 送信者の(再)起動を見た回数
+    };
+
+    class RmcReceiver
+    {
+    public:
+        explicit RmcReceiver(const RmcReceiverOptions &options = RmcReceiverOptions(), uint32_t seed = 1)
+            : mOptions(options), mRandom(seed ? seed : 1) {}
+
+        /**
+         * @brief 受信したフレームを処理する. 番号順に揃ったデータはon_deliver(uint32_t sequence, BytesView payload)へ.
+         * @return RMCのフレームならtrue
+         */
+        template <typename OnDeliver>
+        bool onPacket(BytesView frame, uint64_t now_ms, OnDeliver &&on_deliver)
+        {
+            RmcHeader header;
+            if (!ReadRmcHeader(frame, &header))
+            {
+                return false;
+            }
+            if (header.mType == kRmcHeartbeat)
+            {
+                if (!mStarted || header.mSession != mSession)
+                {
+                    restart(header.mSession, header.mSequence + 1); // 途中参加: 次の番号から
+                    return true;
+                }
+                if (!RmcSeqLess(header.mSequence, mExpected))
+                {
+                    markMissing(header.mSequence, now_ms, on_deliver); // 末尾の欠落
+                }
+                return true;
+            }
+            if (header.mType != kRmcData && header.mType != kRmcRepair)
+            {
+                return true;
+            }
+
+            uint32_t sequence = header.mSequence;
+            if (!mStarted || header.mSession != mSession)
+            {
+                restart(header.mSession, sequence);
+            }
+            if (RmcSeqLess(sequence, mExpected) || mBuffered.count(sequence) != 0)
+            {
+                ++mStats.mDuplicates;
+                return true;
+            }
+            ++mStats.mReceived;
+
+            auto missing = mMissing.find(sequence);
+            if (missing != mMissing.end())
+            {
+                ++mStats.mRecovered;
+                mStats.mRecoveryMsTotal += now_ms - missing->second.mDetectedMs;
+                mMissing.erase(missing);
+            }
+
+            markMissing(sequence - 1, now_ms, on_deliver); // 間に抜けがあれば欠番
+            if (RmcSeqLess(mHighest, sequence))
+            {
+                mHighest = sequence;
+            }
+
+            BytesView payload = frame.sub(kRmcHeaderSize);
+            if (sequence == mExpected)
+            {
+                on_deliver(sequence, payload);
+                ++mStats.mDelivered;
+                ++mExpected;
+                drain(on_deliver);
+                return true;
+            }
+
+            // 先の番号: 順番待ち
+            Buffered &buffered = mBuffered[sequence];
+            buffered.mLost = false;
+            buffered.mData.assign(payload.data(), payload.data() + payload.size());
+            if (mBuffered.size() > mOptions.mMaxBuffered)
+            {
+                giveUpOldest(on_deliver); // 溜めすぎ: 一番古い欠番を諦める
+            }
+            return true;
+        }
+
+        /**
+         * @brief 期限の来た欠番のNAKをon_nak(const uint8_t *frame, size_t length)で送らせる.
+         * 諦めた欠番の先に揃ったデータがあればon_deliverへ渡す.
+         */
+        template <typename OnNak, typename OnDeliver>
+        void poll(uint64_t now_ms, OnNak &&on_nak, OnDeliver &&on_deliver)
+        {
+            uint8_t frame[kRmcHeaderSize + kRmcMaxNakRanges * 8];
+            size_t nranges = 0;
+            uint32_t range_first = 0, range_count = 0;
+            bool gave_up = false;
+
+            auto flush_range = [&]() {
+                if (range_count == 0)
+                {
+                    return;
+                }
+                StoreBe32(frame + kRmcHeaderSize + nranges * 8, range_first);
+                StoreBe32(frame + kRmcHeaderSize + nranges * 8 + 4, range_count);
+                range_count = 0;
+                if (++nranges == kRmcMaxNakRanges)
+                {
+                    sendNak(frame, nranges, on_nak);
+                    nranges = 0;
+                }
+            };
+
+            for (auto it = mMissing.begin(); it != mMissing.end();)
+            {
+                Missing &missing = it->second;
+                if (missing.mNextNakMs > now_ms)
+                {
+                    ++it;
+                    continue;
+                }
+                if (missing.mRetries >= mOptions.mMaxRetries)
+                {
+                    ++mStats.mLost;
+                    mBuffered[it->first].mLost = true; // 順番が来たら飛ばす
+                    it = mMissing.erase(it);
+                    gave_up = true;
+                    continue;
+                }
+                ++missing.mRetries;
+                missing.mNextNakMs = now_ms + mOptions.mRetryMs;
+                if (range_count != 0 && it->first == range_first + range_count)
+                {
+                    ++range_count; // 連続した番号は1つの範囲に
+                }
+                else
+                {
+                    flush_range();
+                    range_first = it->first;
+                    range_count = 1;
+                }
+                ++it;
+            }
+            flush_range();
+            if (nranges != 0)
+            {
+                sendNak(frame, nranges, on_nak);
+            }
+            if (gave_up)
+            {
+                drain(on_deliver);
+            }
+        }
+
+        bool started() const { return mStarted; }
+        uint32_t session() const { return mSession; }
+        uint32_t expected() const { return mExpected; }
+        size_t pending() const { return mMissing.size(); }
+        const RmcReceiverStats &stats() const { return mStats; }
+
+    private:
+        struct Missing
+        {
+            uint64_t mDetectedMs;
+            uint64_t mNextNakMs;
+            uint32_t mRetries;
+        };
+
+        struct Buffered
+        {
+            bool mLost = false; // 諦めた欠番の目印
+            std::vector<uint8_t> mData;
+        };
+
+        void restart(uint32_t session, uint32_t expected)
+        {
+            mStarted = true;
+            mSession = session;
+            mExpected = expected;
+            mHighest = expected - 1;
+            mMissing.clear();
+            mBuffered.clear();
+            ++mStats.mSessions;
+        }
+
+        uint32_t nextRandom()
+        {
+            mRandom ^= mRandom << 13; // xorshift32
+            mRandom ^= mRandom >> 17;
+            mRandom ^= mRandom << 5;
+            return mRandom;
+        }
+
+        // まだ見ていない番号(mHighest+1 .. last)を欠番にする
+        template <typename OnDeliver>
+        void markMissing(uint32_t last, uint64_t now_ms, OnDeliver &&on_deliver)
+        {
+            if (!RmcSeqLess(mHighest, last))
+            {
+                return;
+            }
+            uint32_t first = mHighest + 1;
+            uint32_t count = last - first + 1;
+            if (count > mOptions.mMaxBuffered)
+            {
+                // 大きすぎる欠落は手前を諦める. 番号毎には記録せず数だけ足してmExpectedを進める
+                uint32_t keep_from = last - (uint32_t)mOptions.mMaxBuffered + 1;
+                mStats.mLost += keep_from - first;
+                skipTo(keep_from, on_deliver);
+                first = keep_from;
+            }
+            for (uint32_t s = first; s != last + 1; ++s)
+            {
+                uint32_t backoff = mOptions.mBackoffMaxMs ? nextRandom() % (mOptions.mBackoffMaxMs + 1) : 0;
+                mMissing.emplace(s, Missing{now_ms, now_ms + backoff, 0});
+                ++mStats.mMissing;
+            }
+            mHighest = last;
+        }
+
+        // keep_fromより前を片付ける: 残っている欠番は諦め, 溜めたデータは番号順に渡す
+        template <typename OnDeliver>
+        void skipTo(uint32_t keep_from, OnDeliver &&on_deliver)
+        {
+            while (!mMissing.empty() && RmcSeqLess(mMissing.begin()->first, keep_from))
+            {
+                ++mStats.mLost;
+                mMissing.erase(mMissing.begin());
+            }
+            while (!mBuffered.empty() && RmcSeqLess(mBuffered.begin()->first, keep_from))
+            {
+                auto it = mBuffered.begin();
+                if (!it->second.mLost)
+                {
+                    on_deliver(it->first, BytesView(it->second.mData.data(), it->second.mData.size()));
+                    ++mStats.mDelivered;
+                }
+                mBuffered.erase(it);
+            }
+            if (RmcSeqLess(mExpected, keep_from))
+            {
+                mExpected = keep_from;
+            }
+        }
+
+        template <typename OnDeliver>
+        void drain(OnDeliver &&on_deliver)
+        {
+            while (true)
+            {
+                auto it = mBuffered.find(mExpected);
+                if (it == mBuffered.end() || mMissing.count(mExpected) != 0)
+                {
+                    return;
+                }
+                if (!it->second.mLost)
+                {
+                    on_deliver(mExpected, BytesView(it->second.mData.data(), it->second.mData.size()));
+                    ++mStats.mDelivered;
+                }
+                mBuffered.erase(it);
+                ++mExpected;
+            }
+        }
+
+        template <typename OnDeliver>
+        void giveUpOldest(OnDeliver &&on_deliver)
+        {
+            if (mMissing.empty())
+            {
+                return;
+            }
+            auto oldest = mMissing.begin();
+            ++mStats.mLost;
+            mBuffered[oldest->first].mLost = true;
+            mMissing.erase(oldest);
+            drain(on_deliver);
+        }
+
+        template <typename OnNak>
+        void sendNak(uint8_t *frame, size_t nranges, OnNak &&on_nak)
+        {
+            RmcHeader header;
+            header.mType = kRmcNak;
+            header.mCount = (uint16_t)nranges;
+            header.mSession = mSession;
+            header.mSequence = mExpected;
+            WriteRmcHeader(frame, header);
+            on_nak(frame, kRmcHeaderSize + nranges * 8);
+            ++mStats.mNaksSent;
+        }
+
+        const RmcReceiverOptions mOptions;
+        uint32_t mRandom;
+        bool mStarted = false;
+        uint32_t mSession = 0;
+        uint32_t mExpected = 0; // 次に渡す番号
+        uint32_t mHighest = 0;  // ここまでの番号は渡した/溜めた/欠番のどれか
+        std::map<uint32_t, Missing, RmcSeqCompare> mMissing;
+        std::map<uint32_t, Buffered, RmcSeqCompare> mBuffered;
+        RmcReceiverStats mStats;
+    };
+} // namespace net
+} // namespace is
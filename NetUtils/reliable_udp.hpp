@@ -0,0 +1,1397 @@
+/**
+ * @file reliable_udp.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief UDPの上に載せる順序保証・再送付きのストリーム (SACK, RTT推定, 再送タイマ, 差し替え可能な輻輳制御)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * 長距離で損失のある回線の一括転送では, カーネルのTCPでは再送やペーシングの方針を変えられない.
+ * ここではTCPと同じ考え方(累積ACK + SACK, RFC 6298のRTO, 損失回復)をユーザ空間で持ち,
+ * 輻輳制御をcongestion_control.hppのNewReno/BBR風から選べるようにする.
+ *
+ * + 番号はセグメント単位(バイト単位ではない). 再送しても番号は変わらない.
+ * + 受信側は2セグメント毎か遅延ACKタイマ(既定2ms)でACKし, 順序が乱れたら即座にSACK付きでACKする.
+ *   データフレームにも累積ACKを載せる(SACKは載せない).
+ * + 送信側はSACKより上にdup_thresh個以上届いたセグメントを損失とみなして再送する(RFC 6675).
+ *   損失を見つけたら1往復に1回だけ輻輳制御へ知らせる(回復期間). 再送の損失はRTOで拾う.
+ * + RTTは送信時刻のエコー(tsval/tsecr)で測るので, 再送したセグメントのACKでも測れる.
+ * + 配送レートはdraft-cheng-iccrg-delivery-rate-estimationの方法で標本を取り, 輻輳制御へ渡す.
+ * + RTOと遅延ACKはtimer_wheel.hppのホイールに載せる. 取り消しは世代番号で(遅延削除).
+ * + 受信ウィンドウ(セグメント数)でフロー制御し, 閉じたままならRTOで1セグメントだけ送って確かめる.
+ *
+ * フレーム (32バイトのヘッダ + ペイロード, ネットワークバイトオーダ)
+ *   0: magic "RUD1"
+ *   4: type (SYN, SYNACK, DATA, ACK, FIN, RST)  5: reserved  6: count (ACKのSACKブロック数)
+ *   8: connection (クライアントが選ぶ乱数)
+ *  12: sequence (DATA/FIN: セグメント番号)
+ *  16: ack (次に欲しい番号)  20: window (ackから先に受け取れるセグメント数)
+ *  24: tsval (送信時刻 us の下位32bit)  28: tsecr (最後に受け取ったデータのtsval)
+ *  ACKのペイロードは{start(32bit), end(32bit, 含まない)}の並び.
+ *
+ * `RudpConnection`はソケットを持たない(フレームの組み立てと状態だけ).
+ * `RudpSocket`はUDPソケット1つに接続1つを載せ, TCPの例と同じ connect/accept/read/write/close を提供する.
+ * `ImpairedLink`は送信時に損失と遅延を与える(tc netemが使えない環境でのベンチ用).
+ * スレッドセーフではない.
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <NetUtils/congestion_control.hpp>
+#include <NetUtils/packet_view.hpp>
+#include <NetUtils/pacing.hpp> // MonotonicNs, TokenBucket
+#include <NetUtils/timer_wheel.hpp>
+
+namespace is
+{
+namespace net
+{
+    constexpr uint32_t kRudpMagic = 0x52554431; // "RUD1"
+    constexpr size_t kRudpHeaderSize = 32;
+    constexpr size_t kRudpMaxSackBlocks = 16;
+
+    enum RudpType : uint8_t
+    {
+        kRudpSyn = 1,
+        kRudpSynAck = 2,
+        kRudpData = 3,
+        kRudpAck = 4,
+        kRudpFin = 5,
+        kRudpReset = 6,
+    };
+
+    struct RudpHeader
+    {
+        uint8_t mType = 0;
+        uint16_t mCount = 0;
+        uint32_t mConnection = 0;
+        uint32_t mSequence = 0;
+        uint32_t mAck = 0;
+        uint32_t mWindow = 0;
+        uint32_t mTsVal = 0;
+        uint32_t mTsEcr = 0;
+    };
+
+    inline void WriteRudpHeader(uint8_t *out, const RudpHeader &header)
+    {
+        StoreBe32(out, kRudpMagic);
+        out[4] = header.mType;
+        out[5] = 0;
+        StoreBe16(out + 6, header.mCount);
+        StoreBe32(out + 8, header.mConnection);
+        StoreBe32(out + 12, header.mSequence);
+        StoreBe32(out + 16, header.mAck);
+        StoreBe32(out + 20, header.mWindow);
+        StoreBe32(out + 24, header.mTsVal);
+        StoreBe32(out + 28, header.mTsEcr);
+    }
+
+    inline bool ReadRudpHeader(BytesView frame, RudpHeader *header)
+    {
+        if (frame.size() < kRudpHeaderSize || frame.u32(0) != kRudpMagic)
+        {
+            return false;
+        }
+        header->mType = frame.u8(4);
+        header->mCount = frame.u16(6);
+        header->mConnection = frame.u32(8);
+        header->mSequence = frame.u32(12);
+        header->mAck = frame.u32(16);
+        header->mWindow = frame.u32(20);
+        header->mTsVal = frame.u32(24);
+        header->mTsEcr = frame.u32(28);
+        return true;
+    }
+
+    // 周回する32bit番号の比較 (RFC 1982)
+    inline bool RudpSeqLess(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+    struct RudpSeqCompare
+    {
+        bool operator()(uint32_t a, uint32_t b) const { return RudpSeqLess(a, b); }
+    };
+
+    enum RudpState : uint8_t
+    {
+        kRudpClosed,
+        kRudpListen,
+        kRudpSynSent,
+        kRudpSynReceived,
+        kRudpEstablished,
+        kRudpAborted, // 再送を諦めた / RSTを受けた
+    };
+
+    inline const char *RudpStateName(RudpState state)
+    {
+        switch (state)
+        {
+        case kRudpClosed:
+            return "CLOSED";
+        case kRudpListen:
+            return "LISTEN";
+        case kRudpSynSent:
+            return "SYN_SENT";
+        case kRudpSynReceived:
+            return "SYN_RECEIVED";
+        case kRudpEstablished:
+            return "ESTABLISHED";
+        case kRudpAborted:
+            return "ABORTED";
+        }
+        return "?";
+    }
+
+    struct RudpOptions
+    {
+        size_t mMaxPayload = 1400 - kRudpHeaderSize; // セグメントのペイロード
+        size_t mSendSegments = 4096;   // 送信バッファ (未ACK + 未送信)
+        size_t mRecvSegments = 4096;   // 受信バッファ (順番待ち + 未読)
+        uint64_t mInitialRtoMs = 1000; // 最初のRTTを測るまで (RFC 6298)
+        uint64_t mMinRtoMs = 200;      // Linux TCPと同じ
+        uint64_t mMaxRtoMs = 60000;
+        uint32_t mMaxRetransmits = 10; // 連続したRTOの回数. 超えたら諦める.
+        uint64_t mDelayedAckMs = 2;
+        uint32_t mDupThresh = 3;
+    };
+
+    struct RudpStats
+    {
+        uint64_t mFramesSent = 0;       // DATA/FIN (再送を含む)
+        uint64_t mRetransmits = 0;
+        uint64_t mTimeouts = 0;         // RTO
+        uint64_t mCongestionEvents = 0; // 損失回復に入った回数
+        uint64_t mAcksSent = 0;         // ACKフレーム
+        uint64_t mFramesReceived = 0;
+        uint64_t mDuplicates = 0;       // 受信済みのセグメント
+        uint64_t mBytesReceived = 0;    // アプリへ渡したバイト数
+    };
+
+    class RudpConnection
+    {
+    public:
+        RudpConnection(const RudpOptions &options, std::unique_ptr<CongestionControl> congestion)
+            : mOptions(options)
+            , mCongestion(std::move(congestion))
+            , mRtoNs(options.mInitialRtoMs * 1000000)
+        {
+            size_t slots = 1;
+            while (slots < options.mSendSegments)
+            {
+                slots <<= 1;
+            }
+            mMask = slots - 1;
+            mSegments.resize(slots);
+            for (Segment &segment : mSegments)
+            {
+                segment.mFrame.resize(kRudpHeaderSize + options.mMaxPayload); // 送信中に確保しない
+            }
+            mAckFrame.resize(kRudpHeaderSize + kRudpMaxSackBlocks * 8);
+        }
+
+        // クライアント: SYNを送る
+        void connect(uint32_t connection, uint64_t now_ns)
+        {
+            reset(now_ns);
+            mConnection = connection;
+            mState = kRudpSynSent;
+            mSendSyn = true;
+        }
+
+        // サーバ: 最初のSYNを待つ (SYNの接続番号を採用する)
+        void listen(uint64_t now_ns)
+        {
+            reset(now_ns);
+            mState = kRudpListen;
+        }
+
+        /**
+         * @brief 受信したフレームを処理する
+         * @return この接続のフレームならtrue
+         */
+        bool onFrame(BytesView frame, uint64_t now_ns)
+        {
+            RudpHeader header;
+            if (!ReadRudpHeader(frame, &header))
+            {
+                return false;
+            }
+            if (mState == kRudpListen)
+            {
+                if (header.mType != kRudpSyn)
+                {
+                    return false;
+                }
+                mConnection = header.mConnection;
+                mState = kRudpSynReceived;
+            }
+            else if (header.mConnection != mConnection || mState == kRudpClosed || mState == kRudpAborted)
+            {
+                return false;
+            }
+            ++mStats.mFramesReceived;
+
+            switch (header.mType)
+            {
+            case kRudpSyn:
+                if (mState == kRudpSynReceived)
+                {
+                    mTsRecent = header.mTsVal;
+                    mPeerWindowEnd = header.mAck + header.mWindow;
+                    mSendSynAck = true; // 初回, またはSYNACKが失われた
+                }
+                break;
+            case kRudpSynAck:
+                if (mState == kRudpSynSent)
+                {
+                    mState = kRudpEstablished;
+                    mPeerWindowEnd = header.mAck + header.mWindow;
+                    sampleRtt(header, now_ns);
+                    disarmRto();
+                    mBackoff = 0;
+                    mConsecutiveTimeouts = 0;
+                }
+                mTsRecent = header.mTsVal;
+                mAckNow = true; // 重複したSYNACKにも返す (相手がSYN_RECEIVEDから進めるように)
+                break;
+            case kRudpData:
+            case kRudpFin:
+                established();
+                if (mState == kRudpEstablished)
+                {
+                    mTsRecent = header.mTsVal;
+                    onAck(header, BytesView(), false, now_ns);
+                    receive(header, frame.sub(kRudpHeaderSize), now_ns);
+                }
+                break;
+            case kRudpAck:
+                established();
+                if (mState == kRudpEstablished)
+                {
+                    onAck(header, frame.sub(kRudpHeaderSize), true, now_ns);
+                }
+                break;
+            case kRudpReset:
+                mState = kRudpAborted;
+                break;
+            default:
+                break;
+            }
+            return true;
+        }
+
+        /**
+         * @brief 今送るべきフレームをemit(const uint8_t *frame, size_t length)へ渡す (タイマもここで進める)
+         * @return 渡したフレーム数
+         */
+        template <typename Emit>
+        size_t poll(uint64_t now_ns, Emit &&emit)
+        {
+            if (mState == kRudpClosed || mState == kRudpListen || mState == kRudpAborted)
+            {
+                return 0;
+            }
+            mTimers.advance(ToTick(now_ns), [&](RudpTimer &timer) { onTimer(timer, now_ns); });
+            if (mState == kRudpAborted)
+            {
+                return 0;
+            }
+
+            size_t frames = 0;
+            if (mSendSyn || mSendSynAck)
+            {
+                RudpHeader header = makeHeader(mSendSyn ? kRudpSyn : kRudpSynAck, 0, now_ns);
+                WriteRudpHeader(mAckFrame.data(), header);
+                emit(mAckFrame.data(), kRudpHeaderSize);
+                mSendSyn = false;
+                mSendSynAck = false;
+                armRto(now_ns); // 応答が無ければ送り直す
+                ++frames;
+            }
+            if (mState == kRudpEstablished)
+            {
+                frames += sendSegments(now_ns, emit);
+                if (mAckNow)
+                {
+                    sendAck(now_ns, emit);
+                    ++frames;
+                }
+            }
+            return frames;
+        }
+
+        // 次にpoll()すべき時刻 (UINT64_MAX: 受信待ちだけ)
+        uint64_t nextTimeoutNs(uint64_t now_ns) const
+        {
+            if (mSendSyn || mSendSynAck || mAckNow)
+            {
+                return now_ns;
+            }
+            uint64_t next = UINT64_MAX;
+            for (uint64_t deadline : {mRtoDeadlineNs, mAckDeadlineNs, mPacingReleaseNs})
+            {
+                if (deadline != 0)
+                {
+                    next = std::min(next, deadline);
+                }
+            }
+            return next;
+        }
+
+        // 送信バッファへ積む. 返り値は積めたバイト数 (満杯なら0).
+        size_t write(const void *data, size_t length)
+        {
+            if ((mState != kRudpSynSent && mState != kRudpSynReceived && mState != kRudpEstablished) || mFinQueued)
+            {
+                return 0;
+            }
+            const uint8_t *bytes = (const uint8_t *)data;
+            size_t done = 0;
+            while (done < length)
+            {
+                // 未送信の末尾セグメントに空きがあれば詰める (小さなwriteをまとめる)
+                if (mSndEnd != mSndNxt)
+                {
+                    Segment &tail = segment(mSndEnd - 1);
+                    if (tail.mType == kRudpData && tail.mLength < mOptions.mMaxPayload)
+                    {
+                        size_t chunk = std::min(length - done, mOptions.mMaxPayload - tail.mLength);
+                        std::memcpy(tail.mFrame.data() + kRudpHeaderSize + tail.mLength, bytes + done, chunk);
+                        tail.mLength += chunk;
+                        done += chunk;
+                        continue;
+                    }
+                }
+                if (sendBufferFull())
+                {
+                    break;
+                }
+                newSegment(kRudpData);
+            }
+            return done;
+        }
+
+        // 受信済みのバイト列を読む
+        size_t read(void *out, size_t length)
+        {
+            size_t n = std::min(length, readable());
+            std::memcpy(out, mReadBuffer.data() + mReadOffset, n);
+            mReadOffset += n;
+            if (mReadOffset == mReadBuffer.size())
+            {
+                mReadBuffer.clear();
+                mReadOffset = 0;
+            }
+            else if (mReadOffset > (1u << 16) && mReadOffset * 2 > mReadBuffer.size())
+            {
+                mReadBuffer.erase(mReadBuffer.begin(), mReadBuffer.begin() + (ptrdiff_t)mReadOffset);
+                mReadOffset = 0;
+            }
+            // ほぼ閉じていたウィンドウが開いたら知らせる
+            if (n != 0 && mLastWindow < mOptions.mRecvSegments / 4 && receiveWindow() >= mOptions.mRecvSegments / 2)
+            {
+                mAckNow = true;
+            }
+            return n;
+        }
+
+        // 送信の終わり(FIN)を積む. 送信バッファが満杯ならfalse.
+        bool shutdown()
+        {
+            if (mFinQueued)
+            {
+                return true;
+            }
+            if (sendBufferFull())
+            {
+                return false;
+            }
+            newSegment(kRudpFin);
+            mFinQueued = true;
+            return true;
+        }
+
+        // ICMP port unreachable (ECONNREFUSED) を受けた. 相手のFINを受け取り済みなら, 相手は読み終えて
+        // ソケットを閉じた(TIME_WAITを持たない)ので, こちらのFINへのACKはもう来ない.
+        void onPeerUnreachable()
+        {
+            if (mPeerFin && mFinQueued)
+            {
+                mFinAcked = true;
+                disarmRto();
+            }
+        }
+
+        RudpState state() const { return mState; }
+        bool isEstablished() const { return mState == kRudpEstablished; }
+        bool aborted() const { return mState == kRudpAborted; }
+        uint32_t connection() const { return mConnection; }
+        size_t readable() const { return mReadBuffer.size() - mReadOffset; }
+        size_t unacked() const { return (size_t)(mSndEnd - mSndUna); } // 未ACK + 未送信のセグメント
+        bool peerFinished() const { return mPeerFin && readable() == 0; }
+        bool finished() const { return mFinAcked && mPeerFin; }
+        uint64_t srttNs() const { return mSrttNs; }
+        uint64_t minRttNs() const { return mMinRttNs; }
+        uint64_t rtoNs() const { return currentRto(); }
+        uint64_t inflight() const { return mInflight; }
+        uint64_t delivered() const { return mDelivered; }
+        const CongestionControl &congestion() const { return *mCongestion; }
+        const RudpStats &stats() const { return mStats; }
+
+    private:
+        enum TimerKind : uint8_t
+        {
+            kTimerRto,
+            kTimerDelayedAck,
+        };
+
+        struct RudpTimer
+        {
+            TimerKind mKind;
+            uint32_t mGeneration;
+        };
+
+        struct Segment
+        {
+            std::vector<uint8_t> mFrame; // ヘッダ + ペイロード (ヘッダは送る度に書く)
+            size_t mLength = 0;          // ペイロード
+            uint8_t mType = kRudpData;
+            bool mInFlight = false;
+            bool mSacked = false;
+            bool mLost = false;
+            uint32_t mTransmissions = 0;
+            // 配送レートの標本用 (送信時の接続の状態)
+            uint64_t mSentNs = 0;
+            uint64_t mDeliveredAtSend = 0;
+            uint64_t mDeliveredNsAtSend = 0;
+            uint64_t mFirstSentNsAtSend = 0;
+            bool mAppLimitedAtSend = false;
+        };
+
+        struct RateSample
+        {
+            bool mValid = false;
+            uint64_t mPriorDelivered = 0;
+            uint64_t mPriorNs = 0;
+            uint64_t mSendElapsedNs = 0;
+            bool mAppLimited = false;
+        };
+
+        struct Pending
+        {
+            uint8_t mType;
+            std::vector<uint8_t> mData;
+        };
+
+        // タイマホイールのtickはミリ秒 (切り上げ)
+        static uint64_t ToTick(uint64_t ns) { return ns / 1000000; }
+        static uint64_t ToTickCeil(uint64_t ns) { return (ns + 999999) / 1000000; }
+
+        void reset(uint64_t now_ns)
+        {
+            mTimers = TimerWheel<RudpTimer>(512, ToTick(now_ns));
+            mSndUna = mSndNxt = mSndEnd = 0;
+            mRcvNxt = 0;
+            mSackHigh = mLossScan = 0;
+        }
+
+        Segment &segment(uint32_t sequence) { return mSegments[sequence & mMask]; }
+
+        bool sendBufferFull() const { return (size_t)(mSndEnd - mSndUna) >= mSegments.size(); }
+
+        void newSegment(uint8_t type)
+        {
+            Segment &seg = segment(mSndEnd++);
+            seg.mLength = 0;
+            seg.mType = type;
+            seg.mInFlight = false;
+            seg.mSacked = false;
+            seg.mLost = false;
+            seg.mTransmissions = 0;
+        }
+
+        void established()
+        {
+            if (mState == kRudpSynReceived)
+            {
+                mState = kRudpEstablished; // SYNACKへの応答が届いた
+                disarmRto();
+                mBackoff = 0;
+            }
+        }
+
+        uint32_t receiveWindow() const
+        {
+            size_t used = mOutOfOrder.size() + (readable() + mOptions.mMaxPayload - 1) / mOptions.mMaxPayload;
+            return used >= mOptions.mRecvSegments ? 0 : (uint32_t)(mOptions.mRecvSegments - used);
+        }
+
+        RudpHeader makeHeader(uint8_t type, uint32_t sequence, uint64_t now_ns)
+        {
+            RudpHeader header;
+            header.mType = type;
+            header.mConnection = mConnection;
+            header.mSequence = sequence;
+            header.mAck = mRcvNxt;
+            header.mWindow = receiveWindow();
+            header.mTsVal = (uint32_t)(now_ns / 1000);
+            header.mTsEcr = mTsRecent;
+            mLastWindow = header.mWindow;
+            return header;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // タイマ
+        /////////////////////////////////////////////////////////////
+        uint64_t currentRto() const
+        {
+            uint64_t rto = mRtoNs;
+            for (uint32_t i = 0; i < mBackoff && rto < mOptions.mMaxRtoMs * 1000000; ++i)
+            {
+                rto *= 2;
+            }
+            return std::min(rto, mOptions.mMaxRtoMs * 1000000);
+        }
+
+        void armRto(uint64_t now_ns)
+        {
+            uint64_t tick = ToTickCeil(now_ns + currentRto());
+            mRtoDeadlineNs = tick * 1000000;
+            mTimers.schedule(tick, RudpTimer{kTimerRto, ++mRtoGeneration});
+        }
+
+        void disarmRto()
+        {
+            ++mRtoGeneration; // ホイールに残った分は失効時に無視される
+            mRtoDeadlineNs = 0;
+        }
+
+        void armDelayedAck(uint64_t now_ns)
+        {
+            if (mAckDeadlineNs != 0)
+            {
+                return;
+            }
+            uint64_t tick = ToTickCeil(now_ns + mOptions.mDelayedAckMs * 1000000);
+            mAckDeadlineNs = tick * 1000000;
+            mTimers.schedule(tick, RudpTimer{kTimerDelayedAck, ++mAckGeneration});
+        }
+
+        void onTimer(const RudpTimer &timer, uint64_t now_ns)
+        {
+            if (timer.mKind == kTimerDelayedAck)
+            {
+                if (timer.mGeneration == mAckGeneration && mAckDeadlineNs != 0)
+                {
+                    mAckDeadlineNs = 0;
+                    mAckNow = true;
+                }
+                return;
+            }
+            if (timer.mGeneration != mRtoGeneration || mRtoDeadlineNs == 0)
+            {
+                return;
+            }
+            mRtoDeadlineNs = 0;
+
+            if (++mConsecutiveTimeouts > mOptions.mMaxRetransmits)
+            {
+                mState = kRudpAborted;
+                return;
+            }
+            ++mBackoff;
+            if (mState == kRudpSynSent)
+            {
+                mSendSyn = true;
+                return;
+            }
+            if (mState == kRudpSynReceived)
+            {
+                mSendSynAck = true;
+                return;
+            }
+            if (mSndUna == mSndNxt)
+            {
+                mForceProbe = mSndNxt != mSndEnd; // ウィンドウが閉じたまま: 1セグメント送って確かめる
+                mConsecutiveTimeouts = 0;
+                return;
+            }
+
+            // 飛行中のものを全て損失とみなし, cwndを絞ってsnd_unaから送り直す
+            ++mStats.mTimeouts;
+            for (uint32_t sequence = mSndUna; sequence != mSndNxt; ++sequence)
+            {
+                Segment &seg = segment(sequence);
+                if (!seg.mSacked && seg.mInFlight)
+                {
+                    markLost(seg, sequence);
+                }
+            }
+            mCongestion->onRetransmissionTimeout();
+            mInRecovery = true;
+            mRecoveryEnd = mSndNxt;
+            mLossScan = mSndNxt;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // 送信
+        /////////////////////////////////////////////////////////////
+        template <typename Emit>
+        size_t sendSegments(uint64_t now_ns, Emit &&emit)
+        {
+            size_t frames = 0;
+            mPacingReleaseNs = 0;
+            while (true)
+            {
+                // 損失とみなしたものが先 (その間にACK/SACKされたものは飛ばす)
+                while (!mRetransmitQueue.empty())
+                {
+                    uint32_t sequence = mRetransmitQueue.front();
+                    Segment &seg = segment(sequence);
+                    if (!RudpSeqLess(sequence, mSndUna) && RudpSeqLess(sequence, mSndNxt) && seg.mLost && !seg.mSacked)
+                    {
+                        break;
+                    }
+                    mRetransmitQueue.pop_front();
+                }
+
+                bool retransmission = !mRetransmitQueue.empty();
+                uint32_t sequence = retransmission ? mRetransmitQueue.front() : mSndNxt;
+                if (!retransmission)
+                {
+                    if (mSndNxt == mSndEnd)
+                    {
+                        // 送るものが無い: この間の配送レートはアプリ律速
+                        if (mInflight < mCongestion->cwnd())
+                        {
+                            mAppLimitedUntil = std::max<uint64_t>(mDelivered + mInflight, 1);
+                        }
+                        break;
+                    }
+                    if (!mForceProbe && !RudpSeqLess(mSndNxt, mPeerWindowEnd))
+                    {
+                        if (mRtoDeadlineNs == 0)
+                        {
+                            armRto(now_ns); // ゼロウィンドウの確認
+                        }
+                        break;
+                    }
+                }
+
+                Segment &seg = segment(sequence);
+                if (mInflight != 0 && mInflight + seg.mLength > mCongestion->cwnd())
+                {
+                    break;
+                }
+                uint64_t rate = mCongestion->pacingRate();
+                if (rate != 0)
+                {
+                    // 1msぶん(最低2セグメント)のバーストまで許す
+                    mPacer.configure(rate, std::max<uint64_t>(2 * (kRudpHeaderSize + mOptions.mMaxPayload), rate / 1000));
+                    uint64_t release = mPacer.earliest(kRudpHeaderSize + seg.mLength, now_ns);
+                    if (release > now_ns)
+                    {
+                        mPacingReleaseNs = release;
+                        break;
+                    }
+                    mPacer.consume(kRudpHeaderSize + seg.mLength, now_ns);
+                }
+
+                if (retransmission)
+                {
+                    mRetransmitQueue.pop_front();
+                }
+                else
+                {
+                    ++mSndNxt;
+                }
+                mForceProbe = false;
+                transmit(seg, sequence, now_ns, emit);
+                ++frames;
+            }
+            return frames;
+        }
+
+        template <typename Emit>
+        void transmit(Segment &seg, uint32_t sequence, uint64_t now_ns, Emit &&emit)
+        {
+            if (mInflight == 0)
+            {
+                mFirstSentNs = now_ns;
+                mDeliveredNs = now_ns;
+            }
+            seg.mSentNs = now_ns;
+            seg.mDeliveredAtSend = mDelivered;
+            seg.mDeliveredNsAtSend = mDeliveredNs;
+            seg.mFirstSentNsAtSend = mFirstSentNs;
+            seg.mAppLimitedAtSend = mAppLimitedUntil != 0;
+            seg.mInFlight = true;
+            seg.mLost = false;
+            if (seg.mTransmissions++ != 0)
+            {
+                ++mStats.mRetransmits;
+            }
+            mInflight += seg.mLength;
+
+            WriteRudpHeader(seg.mFrame.data(), makeHeader(seg.mType, sequence, now_ns));
+            emit(seg.mFrame.data(), kRudpHeaderSize + seg.mLength);
+            ++mStats.mFramesSent;
+
+            if (mOutOfOrder.empty())
+            {
+                clearAckPending(); // 累積ACKを載せた
+            }
+            if (mRtoDeadlineNs == 0)
+            {
+                armRto(now_ns);
+            }
+        }
+
+        template <typename Emit>
+        void sendAck(uint64_t now_ns, Emit &&emit)
+        {
+            // 順番待ちの連続した範囲をSACKブロックにする (低い方から)
+            uint8_t *out = mAckFrame.data();
+            uint16_t blocks = 0;
+            auto it = mOutOfOrder.begin();
+            while (it != mOutOfOrder.end() && blocks < kRudpMaxSackBlocks)
+            {
+                uint32_t start = it->first;
+                uint32_t end = start + 1;
+                for (++it; it != mOutOfOrder.end() && it->first == end; ++it)
+                {
+                    ++end;
+                }
+                StoreBe32(out + kRudpHeaderSize + blocks * 8, start);
+                StoreBe32(out + kRudpHeaderSize + blocks * 8 + 4, end);
+                ++blocks;
+            }
+            RudpHeader header = makeHeader(kRudpAck, mSndNxt, now_ns);
+            header.mCount = blocks;
+            WriteRudpHeader(out, header);
+            emit(out, kRudpHeaderSize + (size_t)blocks * 8);
+            ++mStats.mAcksSent;
+            clearAckPending();
+        }
+
+        void clearAckPending()
+        {
+            mAckNow = false;
+            mAckPendingSegments = 0;
+            if (mAckDeadlineNs != 0)
+            {
+                ++mAckGeneration;
+                mAckDeadlineNs = 0;
+            }
+        }
+
+        /////////////////////////////////////////////////////////////
+        // ACKの処理
+        /////////////////////////////////////////////////////////////
+        void onAck(const RudpHeader &header, BytesView sack, bool with_sack, uint64_t now_ns)
+        {
+            if (RudpSeqLess(mSndNxt, header.mAck))
+            {
+                return; // 送っていない番号へのACK
+            }
+            if (!RudpSeqLess(header.mAck, mSndUna))
+            {
+                mPeerWindowEnd = header.mAck + header.mWindow; // 古い(順序の入れ替わった)ACKでは更新しない
+            }
+
+            uint64_t inflight_before = mInflight;
+            uint64_t newly = 0;
+            RateSample sample;
+            bool advanced = false;
+            while (RudpSeqLess(mSndUna, header.mAck))
+            {
+                Segment &seg = segment(mSndUna);
+                if (!seg.mSacked)
+                {
+                    newly += deliver(seg, now_ns, &sample);
+                }
+                if (seg.mType == kRudpFin)
+                {
+                    mFinAcked = true;
+                }
+                ++mSndUna;
+                advanced = true;
+            }
+            if (RudpSeqLess(mSackHigh, mSndUna))
+            {
+                mSackHigh = mSndUna;
+            }
+
+            for (size_t b = 0; with_sack && b < header.mCount && (b + 1) * 8 <= sack.size(); ++b)
+            {
+                uint32_t start = sack.u32(b * 8);
+                uint32_t end = sack.u32(b * 8 + 4);
+                if (RudpSeqLess(start, mSndUna))
+                {
+                    start = mSndUna;
+                }
+                if (RudpSeqLess(mSndNxt, end))
+                {
+                    end = mSndNxt;
+                }
+                if (!RudpSeqLess(start, end))
+                {
+                    continue; // 丸めると空 (送っていない範囲や確認済みの範囲). mSackHighを動かさない
+                }
+                for (uint32_t sequence = start; RudpSeqLess(sequence, end); ++sequence)
+                {
+                    Segment &seg = segment(sequence);
+                    if (!seg.mSacked)
+                    {
+                        seg.mSacked = true;
+                        newly += deliver(seg, now_ns, &sample);
+                    }
+                }
+                if (RudpSeqLess(mSackHigh, end))
+                {
+                    mSackHigh = end;
+                }
+            }
+
+            if (advanced)
+            {
+                mConsecutiveTimeouts = 0;
+                mBackoff = 0;
+                if (mSndUna == mSndNxt)
+                {
+                    disarmRto();
+                }
+                else
+                {
+                    armRto(now_ns); // 進んだ分だけ先へ
+                }
+            }
+            if (!sample.mValid)
+            {
+                return; // 新しく届いたものは無い
+            }
+
+            CongestionAck ack;
+            ack.mNowNs = now_ns;
+            ack.mAckedBytes = newly;
+            ack.mRttNs = with_sack ? sampleRtt(header, now_ns) : 0;
+
+            detectLosses(now_ns, inflight_before);
+            if (mInRecovery && !RudpSeqLess(mSndUna, mRecoveryEnd))
+            {
+                mInRecovery = false;
+            }
+            if (mAppLimitedUntil != 0 && mDelivered > mAppLimitedUntil)
+            {
+                mAppLimitedUntil = 0;
+            }
+
+            // 配送レート = 区間に届いた量 / 送信側と受信側の区間の長い方 (最小RTTより短い区間は捨てる)
+            uint64_t interval = std::max(sample.mSendElapsedNs, mDeliveredNs - sample.mPriorNs);
+            if (interval != 0 && interval >= mMinRttNs)
+            {
+                ack.mDeliveryRate = (uint64_t)((double)(mDelivered - sample.mPriorDelivered) * 1e9 / (double)interval);
+            }
+            ack.mAppLimited = sample.mAppLimited;
+            ack.mDelivered = mDelivered;
+            ack.mPriorDelivered = sample.mPriorDelivered;
+            ack.mInflightBytes = mInflight;
+            mCongestion->onAck(ack);
+        }
+
+        // 届いたセグメントを飛行中から外し, 配送レートの標本を更新する
+        uint64_t deliver(Segment &seg, uint64_t now_ns, RateSample *sample)
+        {
+            if (seg.mInFlight)
+            {
+                mInflight -= seg.mLength;
+                seg.mInFlight = false;
+            }
+            seg.mLost = false;
+            mDelivered += seg.mLength;
+            mDeliveredNs = now_ns;
+            // 最も新しく送られたパケットで標本を取る
+            if (!sample->mValid || seg.mDeliveredAtSend >= sample->mPriorDelivered)
+            {
+                sample->mValid = true;
+                sample->mPriorDelivered = seg.mDeliveredAtSend;
+                sample->mPriorNs = seg.mDeliveredNsAtSend;
+                sample->mSendElapsedNs = seg.mSentNs - seg.mFirstSentNsAtSend;
+                sample->mAppLimited = seg.mAppLimitedAtSend;
+                mFirstSentNs = seg.mSentNs;
+            }
+            return seg.mLength;
+        }
+
+        // SACKされた最大の番号よりdup_thresh個以上下の未着は損失 (RFC 6675)
+        void detectLosses(uint64_t now_ns, uint64_t inflight_before)
+        {
+            if (RudpSeqLess(mLossScan, mSndUna))
+            {
+                mLossScan = mSndUna;
+            }
+            bool lost = false;
+            while (RudpSeqLess(mLossScan, mSackHigh) && mSackHigh - mLossScan > mOptions.mDupThresh)
+            {
+                Segment &seg = segment(mLossScan);
+                if (!seg.mSacked && seg.mInFlight)
+                {
+                    markLost(seg, mLossScan);
+                    lost = true;
+                }
+                ++mLossScan;
+            }
+            if (lost && !mInRecovery)
+            {
+                mInRecovery = true;
+                mRecoveryEnd = mSndNxt;
+                ++mStats.mCongestionEvents;
+                mCongestion->onCongestionEvent(now_ns, inflight_before);
+            }
+        }
+
+        void markLost(Segment &seg, uint32_t sequence)
+        {
+            mInflight -= seg.mLength;
+            seg.mInFlight = false;
+            seg.mLost = true;
+            mRetransmitQueue.push_back(sequence);
+        }
+
+        // RFC 6298
+        uint64_t sampleRtt(const RudpHeader &header, uint64_t now_ns)
+        {
+            if (header.mTsEcr == 0)
+            {
+                return 0;
+            }
+            uint32_t elapsed_us = (uint32_t)(now_ns / 1000) - header.mTsEcr;
+            if (elapsed_us > 60000000u)
+            {
+                return 0; // 古すぎる/不正なエコー
+            }
+            uint64_t rtt = std::max<uint64_t>(elapsed_us, 1) * 1000;
+            if (mSrttNs == 0)
+            {
+                mSrttNs = rtt;
+                mRttVarNs = rtt / 2;
+            }
+            else
+            {
+                uint64_t diff = mSrttNs > rtt ? mSrttNs - rtt : rtt - mSrttNs;
+                mRttVarNs = (mRttVarNs * 3 + diff) / 4;
+                mSrttNs = (mSrttNs * 7 + rtt) / 8;
+            }
+            mMinRttNs = mMinRttNs ? std::min(mMinRttNs, rtt) : rtt;
+            uint64_t rto = mSrttNs + std::max<uint64_t>(4 * mRttVarNs, 1000000);
+            mRtoNs = std::min(std::max(rto, mOptions.mMinRtoMs * 1000000), mOptions.mMaxRtoMs * 1000000);
+            return rtt;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // 受信
+        /////////////////////////////////////////////////////////////
+        void receive(const RudpHeader &header, BytesView payload, uint64_t now_ns)
+        {
+            uint32_t sequence = header.mSequence;
+            if (RudpSeqLess(sequence, mRcvNxt))
+            {
+                ++mStats.mDuplicates; // ACKが失われた. 現状を知らせる.
+                mAckNow = true;
+                return;
+            }
+            if (sequence - mRcvNxt >= mOptions.mRecvSegments)
+            {
+                mAckNow = true; // ウィンドウの外
+                return;
+            }
+            if (sequence != mRcvNxt)
+            {
+                auto inserted = mOutOfOrder.emplace(sequence, Pending{header.mType, {}});
+                if (inserted.second)
+                {
+                    inserted.first->second.mData.assign(payload.data(), payload.data() + payload.size());
+                }
+                else
+                {
+                    ++mStats.mDuplicates;
+                }
+                mAckNow = true; // 穴がある: すぐSACKする
+                return;
+            }
+
+            bool had_gap = !mOutOfOrder.empty();
+            accept(header.mType, payload);
+            for (auto it = mOutOfOrder.begin(); it != mOutOfOrder.end() && it->first == mRcvNxt; it = mOutOfOrder.erase(it))
+            {
+                accept(it->second.mType, BytesView(it->second.mData.data(), it->second.mData.size()));
+            }
+            if (had_gap || mPeerFin)
+            {
+                mAckNow = true;
+            }
+            else if (++mAckPendingSegments >= 2)
+            {
+                mAckNow = true;
+            }
+            else
+            {
+                armDelayedAck(now_ns);
+            }
+        }
+
+        void accept(uint8_t type, BytesView payload)
+        {
+            ++mRcvNxt;
+            if (type == kRudpFin)
+            {
+                mPeerFin = true;
+                return;
+            }
+            mReadBuffer.insert(mReadBuffer.end(), payload.data(), payload.data() + payload.size());
+            mStats.mBytesReceived += payload.size();
+        }
+
+        const RudpOptions mOptions;
+        std::unique_ptr<CongestionControl> mCongestion;
+        RudpState mState = kRudpClosed;
+        uint32_t mConnection = 0;
+        TimerWheel<RudpTimer> mTimers;
+        TokenBucket mPacer;
+        RudpStats mStats;
+
+        // 送信: [snd_una, snd_nxt) 送信済み未ACK, [snd_nxt, snd_end) 未送信
+        size_t mMask = 0;
+        std::vector<Segment> mSegments;
+        uint32_t mSndUna = 0;
+        uint32_t mSndNxt = 0;
+        uint32_t mSndEnd = 0;
+        uint32_t mPeerWindowEnd = 0;
+        uint32_t mSackHigh = 0;  // SACKされた範囲の最大の終わり
+        uint32_t mLossScan = 0;  // 損失判定を済ませた位置
+        uint32_t mRecoveryEnd = 0;
+        bool mInRecovery = false;
+        bool mForceProbe = false;
+        bool mFinQueued = false;
+        bool mFinAcked = false;
+        bool mSendSyn = false;
+        bool mSendSynAck = false;
+        std::deque<uint32_t> mRetransmitQueue;
+        uint64_t mInflight = 0;
+        uint64_t mPacingReleaseNs = 0;
+
+        // 配送レート
+        uint64_t mDelivered = 0;
+        uint64_t mDeliveredNs = 0;
+        uint64_t mFirstSentNs = 0;
+        uint64_t mAppLimitedUntil = 0;
+
+        // RTT/RTO
+        uint64_t mSrttNs = 0;
+        uint64_t mRttVarNs = 0;
+        uint64_t mMinRttNs = 0;
+        uint64_t mRtoNs;
+        uint32_t mBackoff = 0;
+        uint32_t mConsecutiveTimeouts = 0;
+        uint32_t mRtoGeneration = 0;
+        uint64_t mRtoDeadlineNs = 0;
+
+        // 受信
+        uint32_t mRcvNxt = 0;
+        uint32_t mTsRecent = 0;
+        std::map<uint32_t, Pending, RudpSeqCompare> mOutOfOrder;
+        std::vector<uint8_t> mReadBuffer;
+        size_t mReadOffset = 0;
+        bool mPeerFin = false;
+        bool mAckNow = false;
+        uint32_t mAckPendingSegments = 0;
+        uint32_t mAckGeneration = 0;
+        uint64_t mAckDeadlineNs = 0;
+        uint32_t mLastWindow = 0;
+        std::vector<uint8_t> mAckFrame;
+    };
+
+    /////////////////////////////////////////////////////////////
+    // 損失と遅延の注入
+    /////////////////////////////////////////////////////////////
+    class ImpairedLink
+    {
+    public:
+        // loss: 0.0-1.0, delay_ns: 片道の遅延
+        void configure(double loss, uint64_t delay_ns, uint64_t seed = 0x9E3779B97F4A7C15ull)
+        {
+            mLoss = loss;
+            mDelayNs = delay_ns;
+            mRandom = seed ? seed : 1;
+        }
+
+        uint64_t dropped() const { return mDropped; }
+
+        // send(const uint8_t *data, size_t length) で実際に送る
+        template <typename Send>
+        void submit(const uint8_t *data, size_t length, uint64_t now_ns, Send &&send)
+        {
+            if (mLoss > 0.0 && uniform() < mLoss)
+            {
+                ++mDropped;
+                return;
+            }
+            if (mDelayNs == 0)
+            {
+                send(data, length);
+                return;
+            }
+            mQueue.push_back(Delayed{now_ns + mDelayNs, std::vector<uint8_t>(data, data + length)});
+        }
+
+        template <typename Send>
+        void release(uint64_t now_ns, Send &&send)
+        {
+            while (!mQueue.empty() && mQueue.front().mDueNs <= now_ns)
+            {
+                send(mQueue.front().mData.data(), mQueue.front().mData.size());
+                mQueue.pop_front();
+            }
+        }
+
+        uint64_t nextDueNs() const { return mQueue.empty() ? UINT64_MAX : mQueue.front().mDueNs; }
+
+    private:
+        struct Delayed
+        {
+            uint64_t mDueNs;
+            std::vector<uint8_t> mData;
+        };
+
+        double uniform()
+        {
+            mRandom ^= mRandom << 13; // xorshift64
+            mRandom ^= mRandom >> 7;
+            mRandom ^= mRandom << 17;
+            return (double)(mRandom >> 11) / (double)(1ull << 53);
+        }
+
+        double mLoss = 0.0;
+        uint64_t mDelayNs = 0;
+        uint64_t mRandom = 1;
+        uint64_t mDropped = 0;
+        std::deque<Delayed> mQueue;
+    };
+
+    /////////////////////////////////////////////////////////////
+    // ブロッキングAPI (UDPソケット1つに接続1つ)
+    /////////////////////////////////////////////////////////////
+    class RudpSocket
+    {
+    public:
+        // sockはUDPソケット (閉じるのは呼び出し側)
+        RudpSocket(int sock, const RudpOptions &options, std::unique_ptr<CongestionControl> congestion)
+            : mSock(sock)
+            , mConnection(options, std::move(congestion))
+            , mBuffer(kRudpHeaderSize + options.mMaxPayload + kRudpMaxSackBlocks * 8)
+        {
+            int size = 4 << 20; // 1往復分のバーストを受け切る (上限はnet.core.rmem_max)
+            setsockopt(mSock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+            setsockopt(mSock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        }
+
+        RudpConnection &connection() { return mConnection; }
+        ImpairedLink &link() { return mLink; }
+
+        // 成功 0, 失敗 -1 (errno)
+        int connect(const struct sockaddr *server, socklen_t length, int timeout_ms = 5000)
+        {
+            if (::connect(mSock, server, length) != 0)
+            {
+                return -1;
+            }
+            uint64_t now = MonotonicNs();
+            uint32_t connection = (uint32_t)(now ^ (now >> 32) ^ ((uint64_t)getpid() << 16));
+            mConnection.connect(connection ? connection : 1, now);
+            uint64_t deadline = now + (uint64_t)timeout_ms * 1000000;
+            while (!mConnection.isEstablished() && !mConnection.aborted() && MonotonicNs() < deadline)
+            {
+                pump(deadline);
+            }
+            return established();
+        }
+
+        // 最初のSYNの送信元とつなぐ (ソケットはその相手にconnectされる)
+        int accept(struct sockaddr *client, socklen_t *length, int timeout_ms = -1)
+        {
+            uint64_t now = MonotonicNs();
+            uint64_t deadline = timeout_ms < 0 ? UINT64_MAX : now + (uint64_t)timeout_ms * 1000000;
+            mConnection.listen(now);
+            while (mConnection.state() == kRudpListen)
+            {
+                struct pollfd pfd = {mSock, POLLIN, 0};
+                now = MonotonicNs();
+                if (now >= deadline)
+                {
+                    errno = ETIMEDOUT;
+                    return -1;
+                }
+                if (::poll(&pfd, 1, timeout_ms < 0 ? 1000 : (int)std::min<uint64_t>((deadline - now) / 1000000 + 1, 1000)) <= 0)
+                {
+                    continue;
+                }
+                socklen_t from_length = *length;
+                ssize_t n = ::recvfrom(mSock, mBuffer.data(), mBuffer.size(), MSG_DONTWAIT, client, &from_length);
+                if (n > 0 && mConnection.onFrame(BytesView(mBuffer.data(), (size_t)n), MonotonicNs()))
+                {
+                    *length = from_length;
+                    if (::connect(mSock, client, from_length) != 0)
+                    {
+                        return -1;
+                    }
+                }
+            }
+            while (!mConnection.isEstablished() && !mConnection.aborted() && MonotonicNs() < deadline)
+            {
+                pump(deadline);
+            }
+            return established();
+        }
+
+        // 全て送信バッファへ積むまで待つ
+        ssize_t write(const void *data, size_t length)
+        {
+            const uint8_t *bytes = (const uint8_t *)data;
+            size_t done = 0;
+            while (done < length)
+            {
+                if (mConnection.aborted())
+                {
+                    errno = ECONNRESET;
+                    return -1;
+                }
+                done += mConnection.write(bytes + done, length - done);
+                pump(done < length ? UINT64_MAX : 0);
+            }
+            return (ssize_t)done;
+        }
+
+        // 1バイト以上読めるまで待つ. 相手が閉じたら0.
+        ssize_t read(void *out, size_t length)
+        {
+            while (mConnection.readable() == 0)
+            {
+                if (mConnection.peerFinished())
+                {
+                    return 0;
+                }
+                if (mConnection.aborted())
+                {
+                    errno = ECONNRESET;
+                    return -1;
+                }
+                pump(UINT64_MAX);
+            }
+            size_t n = mConnection.read(out, length);
+            flush(MonotonicNs()); // ウィンドウの更新
+            return (ssize_t)n;
+        }
+
+        // FINを送り, 相手のFINとFINへのACKを待つ
+        int close(int timeout_ms = 5000)
+        {
+            uint64_t deadline = MonotonicNs() + (uint64_t)timeout_ms * 1000000;
+            while (!mConnection.shutdown() && !mConnection.aborted() && MonotonicNs() < deadline)
+            {
+                pump(deadline);
+            }
+            while (!mConnection.finished() && !mConnection.aborted() && MonotonicNs() < deadline)
+            {
+                pump(deadline);
+            }
+            // 遅延を注入していれば, 最後のACKがまだキューにある
+            while (mLink.nextDueNs() != UINT64_MAX && MonotonicNs() < deadline)
+            {
+                pump(deadline);
+            }
+            if (!mConnection.finished())
+            {
+                errno = mConnection.aborted() ? ECONNRESET : ETIMEDOUT;
+                return -1;
+            }
+            return 0;
+        }
+
+    private:
+        int established()
+        {
+            if (mConnection.isEstablished())
+            {
+                return 0;
+            }
+            errno = mConnection.aborted() ? ECONNREFUSED : ETIMEDOUT;
+            return -1;
+        }
+
+        void flush(uint64_t now_ns)
+        {
+            auto send = [this](const uint8_t *data, size_t length) {
+                ::send(mSock, data, length, 0); // 失敗(ENOBUFS, ICMPエラー)は損失として扱う
+            };
+            mConnection.poll(now_ns, [&](const uint8_t *data, size_t length) { mLink.submit(data, length, now_ns, send); });
+            mLink.release(now_ns, send);
+        }
+
+        // 送って, 次のタイマ(最長deadline_ns, 1秒)まで受信を待ち, 届いた分を処理して送る
+        void pump(uint64_t deadline_ns)
+        {
+            uint64_t now = MonotonicNs();
+            flush(now);
+            uint64_t wake = std::min({mConnection.nextTimeoutNs(now), mLink.nextDueNs(), deadline_ns, now + (uint64_t)1000000000});
+            struct pollfd pfd = {mSock, POLLIN, 0};
+#if defined(__linux__)
+            uint64_t wait = wake > now ? wake - now : 0;
+            struct timespec ts;
+            ts.tv_sec = (time_t)(wait / 1000000000ull);
+            ts.tv_nsec = (long)(wait % 1000000000ull);
+            int ready = ::ppoll(&pfd, 1, &ts, nullptr);
+#else
+            int ready = ::poll(&pfd, 1, wake > now ? (int)((wake - now + 999999) / 1000000) : 0);
+#endif
+            if (ready > 0)
+            {
+                for (int i = 0; i < 256; ++i) // 送信側を止めすぎない
+                {
+                    ssize_t n = ::recv(mSock, mBuffer.data(), mBuffer.size(), MSG_DONTWAIT);
+                    if (n < 0)
+                    {
+                        if (errno == ECONNREFUSED)
+                        {
+                            mConnection.onPeerUnreachable(); // 相手がまだ/もういない
+                        }
+                        break;
+                    }
+                    mConnection.onFrame(BytesView(mBuffer.data(), (size_t)n), MonotonicNs());
+                }
+            }
+            flush(MonotonicNs());
+        }
+
+        int mSock;
+        RudpConnection mConnection;
+        ImpairedLink mLink;
+        std::vector<uint8_t> mBuffer;
+    };
+} // namespace net
+} // namespace is
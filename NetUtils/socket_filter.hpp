@@ -0,0 +1,311 @@
+/**
+ * @file socket_filter.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief classic BPFのプログラムを組み立ててソケットへ付ける (Linux)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * + `SO_ATTACH_FILTER`: ソケット毎の受信フィルタ. 戻り値0なら捨て, それ以外ならその長さまで受け取る.
+ *   ユーザー空間へのコピーとwakeupが起きる前にカーネル内で捨てられる.
+ * + `SO_ATTACH_REUSEPORT_CBPF`: 同じポートにbindしたSO_REUSEPORTソケット群のどれに配るかを決める.
+ *   プログラムの戻り値(Aレジスタ)がグループ内のソケットの番号(bindした順). 範囲外ならカーネルのハッシュに戻る.
+ *
+ * パケットの先頭(オフセット0)はソケットの種類と用途で変わる.
+ * + UDPソケットのSO_ATTACH_FILTER: UDPヘッダ (ペイロードは8バイト目から)
+ * + UDPソケットのSO_ATTACH_REUSEPORT_CBPF: UDPペイロード (ヘッダは取り除かれている)
+ * IPヘッダはどちらも`SKF_NET_OFF`からの負のオフセットで読む.
+ * IPv4のRAWソケットではオフセット0がIPヘッダ, IPv6のRAWソケットでは上位(ICMPv6)ヘッダになる.
+ */
+#pragma once
+
+#if defined(__linux__)
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h> // inet_pton
+#include <linux/filter.h> // sock_filter, sock_fprog, BPF_*, SKF_*
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+namespace is
+{
+namespace net
+{
+    /////////////////////////////////////////////////////////////
+    // classic BPFの命令列
+    /////////////////////////////////////////////////////////////
+    class BpfProgram
+    {
+    public:
+        BpfProgram &stmt(uint16_t code, uint32_t k)
+        {
+            mCode.push_back(BPF_STMT(code, k));
+            return *this;
+        }
+
+        // 条件分岐. jt/jfは次の命令からの相対位置.
+        BpfProgram &jump(uint16_t code, uint32_t k, uint8_t jt, uint8_t jf)
+        {
+            mCode.push_back(BPF_JUMP(code, k, jt, jf));
+            return *this;
+        }
+
+        size_t size() const { return mCode.size(); }
+        bool empty() const { return mCode.empty(); }
+        const std::vector<struct sock_filter> &code() const { return mCode; }
+
+        // setsockoptに渡す形 (このオブジェクトより長く使わないこと)
+        struct sock_fprog fprog() const
+        {
+            struct sock_fprog program;
+            program.len = (unsigned short)mCode.size();
+            program.filter = const_cast<struct sock_filter *>(mCode.data());
+            return program;
+        }
+
+    private:
+        std::vector<struct sock_filter> mCode;
+    };
+
+    constexpr uint32_t kBpfAccept = 0xFFFFFFFF; // パケット全体を受け取る
+    constexpr uint32_t kBpfReject = 0;
+
+    // 全ての条件を満たしたときだけ受け取る.
+    // 各プログラムの受理(0以外のret #k)を次のプログラムの先頭へのジャンプに置き換えて連結する.
+    inline BpfProgram BpfAllOf(const std::vector<BpfProgram> &programs)
+    {
+        BpfProgram joined;
+        for (size_t p = 0; p < programs.size(); ++p)
+        {
+            const std::vector<struct sock_filter> &code = programs[p].code();
+            for (size_t i = 0; i < code.size(); ++i)
+            {
+                bool accept = code[i].code == (BPF_RET | BPF_K) && code[i].k != kBpfReject;
+                if (accept && p + 1 < programs.size())
+                {
+                    joined.stmt(BPF_JMP | BPF_JA, (uint32_t)(code.size() - i - 1)); // 次のプログラムへ
+                }
+                else
+                {
+                    joined.jump(code[i].code, code[i].k, code[i].jt, code[i].jf);
+                }
+            }
+        }
+        return joined;
+    }
+
+    /////////////////////////////////////////////////////////////
+    // 受信フィルタ (SO_ATTACH_FILTER)
+    /////////////////////////////////////////////////////////////
+
+    // 自分宛のEcho Reply(ICMP ID一致)だけを通す. IPv4 RAWソケット用(オフセット0がIPヘッダ).
+    inline BpfProgram IcmpEchoReplyIdFilter(uint16_t id)
+    {
+        BpfProgram program;
+        program.stmt(BPF_LDX | BPF_B | BPF_MSH, 0)                 // X = IPヘッダ長
+            .stmt(BPF_LD | BPF_B | BPF_IND, 0)                     // ICMP type
+            .jump(BPF_JMP | BPF_JEQ | BPF_K, 0 /* ICMP_ECHOREPLY */, 0, 3)
+            .stmt(BPF_LD | BPF_H | BPF_IND, 4)                     // ICMP id
+            .jump(BPF_JMP | BPF_JEQ | BPF_K, id, 0, 1)
+            .stmt(BPF_RET | BPF_K, kBpfAccept)
+            .stmt(BPF_RET | BPF_K, kBpfReject);
+        return program;
+    }
+
+    // ICMPv6版. IPv6 RAWソケット用(オフセット0がICMPv6ヘッダ).
+    inline BpfProgram Icmp6EchoReplyIdFilter(uint16_t id)
+    {
+        BpfProgram program;
+        program.stmt(BPF_LD | BPF_B | BPF_ABS, 0)                  // ICMPv6 type
+            .jump(BPF_JMP | BPF_JEQ | BPF_K, 129 /* ICMP6_ECHO_REPLY */, 0, 3)
+            .stmt(BPF_LD | BPF_H | BPF_ABS, 4)                     // ICMPv6 id
+            .jump(BPF_JMP | BPF_JEQ | BPF_K, id, 0, 1)
+            .stmt(BPF_RET | BPF_K, kBpfAccept)
+            .stmt(BPF_RET | BPF_K, kBpfReject);
+        return program;
+    }
+
+    // UDPペイロードのoffsetバイト目からの32bit(ネットワークバイトオーダ)がmagicと一致するものだけを通す.
+    // 短すぎるパケットは範囲外の読み込みになり捨てられる.
+    inline BpfProgram UdpPayloadMagicFilter(uint32_t magic, uint32_t offset = 0)
+    {
+        BpfProgram program;
+        program.stmt(BPF_LD | BPF_W | BPF_ABS, 8 /* UDPヘッダ */ + offset)
+            .jump(BPF_JMP | BPF_JEQ | BPF_K, magic, 0, 1)
+            .stmt(BPF_RET | BPF_K, kBpfAccept)
+            .stmt(BPF_RET | BPF_K, kBpfReject);
+        return program;
+    }
+
+    // 送信元IPアドレスがprefix/prefix_lengthに含まれるものだけを通す.
+    // IPヘッダをSKF_NET_OFFから読むので, UDP/RAWどちらのソケットにも付けられる.
+    inline BpfProgram SourcePrefixFilter(const struct sockaddr *prefix, int prefix_length)
+    {
+        uint8_t address[16] = {};
+        size_t address_length = 4;
+        uint32_t source_offset = 12; // IPv4ヘッダ内の送信元
+        if (prefix->sa_family == AF_INET6)
+        {
+            std::memcpy(address, &((const struct sockaddr_in6 *)prefix)->sin6_addr, 16);
+            address_length = 16;
+            source_offset = 8;
+        }
+        else
+        {
+            std::memcpy(address, &((const struct sockaddr_in *)prefix)->sin_addr, 4);
+        }
+
+        // 32bit単位でマスクして比較. 一致しなければ最後のret #0へ飛ぶ.
+        std::vector<std::pair<uint32_t, uint32_t>> words; // (mask, value)
+        for (size_t w = 0; w * 4 < address_length; ++w)
+        {
+            int bits = prefix_length - (int)(w * 32);
+            if (bits <= 0)
+            {
+                break;
+            }
+            uint32_t mask = bits >= 32 ? 0xFFFFFFFFu : ~(0xFFFFFFFFu >> bits);
+            uint32_t value = ((uint32_t)address[w * 4] << 24) | ((uint32_t)address[w * 4 + 1] << 16) |
+                             ((uint32_t)address[w * 4 + 2] << 8) | (uint32_t)address[w * 4 + 3];
+            words.emplace_back(mask, value & mask);
+        }
+
+        BpfProgram program;
+        if (prefix->sa_family == AF_INET6)
+        {
+            // IPv4パケットを弾く (v4-mappedで受けるソケット向け)
+            program.stmt(BPF_LD | BPF_B | BPF_ABS, (uint32_t)SKF_NET_OFF)
+                .stmt(BPF_ALU | BPF_RSH | BPF_K, 4)
+                .jump(BPF_JMP | BPF_JEQ | BPF_K, 6, 0, (uint8_t)(words.size() * 3 + 1));
+        }
+        for (size_t w = 0; w < words.size(); ++w)
+        {
+            uint8_t to_reject = (uint8_t)((words.size() - w - 1) * 3 + 1);
+            program.stmt(BPF_LD | BPF_W | BPF_ABS, (uint32_t)SKF_NET_OFF + source_offset + (uint32_t)(w * 4))
+                .stmt(BPF_ALU | BPF_AND | BPF_K, words[w].first)
+                .jump(BPF_JMP | BPF_JEQ | BPF_K, words[w].second, 0, to_reject);
+        }
+        program.stmt(BPF_RET | BPF_K, kBpfAccept)
+            .stmt(BPF_RET | BPF_K, kBpfReject);
+        return program;
+    }
+
+    // "10.0.0.0/8", "2001:db8::/32", "192.0.2.1" (長さ省略時はホスト)
+    inline bool ParsePrefix(const char *text, struct sockaddr_storage *prefix, int *prefix_length)
+    {
+        std::string address(text);
+        int length = -1;
+        size_t slash = address.find('/');
+        if (slash != std::string::npos)
+        {
+            length = std::atoi(address.c_str() + slash + 1);
+            address.resize(slash);
+        }
+        std::memset(prefix, 0, sizeof(*prefix));
+        struct sockaddr_in *v4 = (struct sockaddr_in *)prefix;
+        struct sockaddr_in6 *v6 = (struct sockaddr_in6 *)prefix;
+        if (inet_pton(AF_INET, address.c_str(), &v4->sin_addr) == 1)
+        {
+            v4->sin_family = AF_INET;
+            *prefix_length = length < 0 ? 32 : length;
+            return *prefix_length <= 32;
+        }
+        if (inet_pton(AF_INET6, address.c_str(), &v6->sin6_addr) == 1)
+        {
+            v6->sin6_family = AF_INET6;
+            *prefix_length = length < 0 ? 128 : length;
+            return *prefix_length <= 128;
+        }
+        return false;
+    }
+
+    inline int AttachSocketFilter(int sock, const BpfProgram &program)
+    {
+        struct sock_fprog fprog = program.fprog();
+        return setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog));
+    }
+
+    inline int DetachSocketFilter(int sock)
+    {
+        int dummy = 0;
+        return setsockopt(sock, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy));
+    }
+
+    /////////////////////////////////////////////////////////////
+    // SO_REUSEPORTの振り分け
+    /////////////////////////////////////////////////////////////
+
+    // 受信したCPUの番号 % nsockets
+    inline BpfProgram ReuseportCpuProgram(uint32_t nsockets)
+    {
+        BpfProgram program;
+        program.stmt(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU))
+            .stmt(BPF_ALU | BPF_MOD | BPF_K, nsockets)
+            .stmt(BPF_RET | BPF_A, 0);
+        return program;
+    }
+
+    // 送信元IPアドレスのハッシュ % nsockets. 同じ送信元は常に同じソケットへ.
+    inline BpfProgram ReuseportSourceHashProgram(int family, uint32_t nsockets)
+    {
+        BpfProgram program;
+        if (family == AF_INET6)
+        {
+            // 128bitの送信元(オフセット8)を32bitずつXOR
+            program.stmt(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_NET_OFF + 8))
+                .stmt(BPF_MISC | BPF_TAX, 0);
+            for (uint32_t offset = 12; offset <= 20; offset += 4)
+            {
+                program.stmt(BPF_LD | BPF_W | BPF_ABS, (uint32_t)SKF_NET_OFF + offset)
+                    .stmt(BPF_ALU | BPF_XOR | BPF_X, 0)
+                    .stmt(BPF_MISC | BPF_TAX, 0);
+            }
+            program.stmt(BPF_MISC | BPF_TXA, 0);
+        }
+        else
+        {
+            program.stmt(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_NET_OFF + 12)); // IPv4の送信元
+        }
+        // 上位ビットを下位へ畳み込んでから剰余 (サブネット内の連番アドレスも散らす)
+        program.stmt(BPF_MISC | BPF_TAX, 0)
+            .stmt(BPF_ALU | BPF_RSH | BPF_K, 16)
+            .stmt(BPF_ALU | BPF_XOR | BPF_X, 0)
+            .stmt(BPF_MISC | BPF_TAX, 0)
+            .stmt(BPF_ALU | BPF_RSH | BPF_K, 8)
+            .stmt(BPF_ALU | BPF_XOR | BPF_X, 0)
+            .stmt(BPF_ALU | BPF_MOD | BPF_K, nsockets)
+            .stmt(BPF_RET | BPF_A, 0);
+        return program;
+    }
+
+    // UDPペイロードのoffsetにある32bit値 % nsockets (接続IDなど, 送信元が変わっても同じソケットへ).
+    // ペイロードが短いと読み出しに失敗して0番へ.
+    inline BpfProgram ReuseportPayloadWordProgram(uint32_t offset, uint32_t nsockets)
+    {
+        BpfProgram program;
+        program.stmt(BPF_LD | BPF_W | BPF_ABS, offset)
+            .stmt(BPF_ALU | BPF_MOD | BPF_K, nsockets)
+            .stmt(BPF_RET | BPF_A, 0);
+        return program;
+    }
+
+    // グループ内のどれか1つ(bind済み)に付ければグループ全体に効く
+    inline int AttachReuseportProgram(int sock, const BpfProgram &program)
+    {
+        struct sock_fprog fprog = program.fprog();
+        return setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &fprog, sizeof(fprog));
+    }
+} // namespace net
+} // namespace is
+
+#endif // __linux__
@@ -0,0 +1,378 @@
+/**
+ * @file socket_stats.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief カーネル側のドロップとキューの計測 (SO_RXQ_OVFL, SO_MEMINFO, TCP_INFO) Linux専用
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * 受信バッファ溢れなどカーネルの中で捨てられたパケットは, ユーザ空間のカウンタには現れない.
+ * + SO_RXQ_OVFL: 受信したデータグラムの補助データに, そのソケットで捨てた数の累計(sk_drops)が付く.
+ * + SO_MEMINFO : 受信/送信バッファの使用量, 上限, バックログ, sk_drops をいつでも読める(受信が無くても).
+ * + TCP_INFO   : 接続のrtt, 輻輳ウィンドウ, 再送数, 未確認のセグメント数.
+ *               listenソケットではtcpi_unackedがacceptキューの長さ, tcpi_sackedがその上限.
+ *
+ * SocketStatsMonitorは見張るソケット毎にメトリクス(NetUtils/metrics.hpp, ラベルfd/proto/local)を登録し,
+ * sample()で間隔毎にSO_MEMINFOとTCP_INFOを読んでゲージとカウンタへ反映する. acceptした接続はラベルを付けず,
+ * rtt/cwndのヒストグラム, 再送数, 未確認セグメントの合計にまとめる(接続毎の系列を作らない).
+ * スレッドセーフではない. 受信ループ(スレッド)毎に1つ持つ.
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h> // TCP_INFO, struct tcp_info
+#include <linux/sock_diag.h> // SK_MEMINFO_*
+#include <errno.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <NetUtils/metrics.hpp>
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+#ifndef SO_MEMINFO
+#define SO_MEMINFO 55
+#endif
+
+namespace is
+{
+namespace net
+{
+    struct SocketMemInfo
+    {
+        uint32_t mRmemAlloc = 0;  // 受信バッファに溜まっているバイト数
+        uint32_t mRcvBuf = 0;     // 受信バッファの上限 (SO_RCVBUF)
+        uint32_t mWmemAlloc = 0;  // 送信中のバイト数
+        uint32_t mSndBuf = 0;     // 送信バッファの上限 (SO_SNDBUF)
+        uint32_t mWmemQueued = 0; // 送信キューのバイト数 (TCP)
+        uint32_t mBacklog = 0;    // ユーザがソケットを持っている間に溜まったバイト数
+        uint32_t mDrops = 0;      // sk_drops (SO_RXQ_OVFLと同じ累計)
+        bool mHasDrops = false;   // 古いカーネルはSK_MEMINFO_DROPSを返さない
+    };
+
+    inline int EnableRxqOverflow(int sock)
+    {
+        const int on = 1;
+        return setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+    }
+
+    // recvmsg/recvmmsgの補助データからSO_RXQ_OVFLの累計を取り出す. 無ければfalse.
+    inline bool ReadRxqOverflow(const struct msghdr &msg, uint32_t &drops)
+    {
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR((struct msghdr *)&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+            {
+                std::memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline int ReadSocketMemInfo(int sock, SocketMemInfo &info)
+    {
+        uint32_t values[SK_MEMINFO_VARS] = {};
+        socklen_t length = sizeof(values);
+        if (getsockopt(sock, SOL_SOCKET, SO_MEMINFO, values, &length) != 0)
+        {
+            return -1;
+        }
+        info.mRmemAlloc = values[SK_MEMINFO_RMEM_ALLOC];
+        info.mRcvBuf = values[SK_MEMINFO_RCVBUF];
+        info.mWmemAlloc = values[SK_MEMINFO_WMEM_ALLOC];
+        info.mSndBuf = values[SK_MEMINFO_SNDBUF];
+        info.mWmemQueued = values[SK_MEMINFO_WMEM_QUEUED];
+        info.mBacklog = values[SK_MEMINFO_BACKLOG];
+        info.mHasDrops = length >= (socklen_t)((SK_MEMINFO_DROPS + 1) * sizeof(uint32_t));
+        info.mDrops = info.mHasDrops ? values[SK_MEMINFO_DROPS] : 0;
+        return 0;
+    }
+
+    inline int ReadTcpInfo(int sock, struct tcp_info &info)
+    {
+        std::memset(&info, 0, sizeof(info));
+        socklen_t length = sizeof(info);
+        return getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &length);
+    }
+
+    // メトリクスのラベル: fd="5",proto="udp",local="0.0.0.0:54321"
+    inline std::string SocketLabels(int sock)
+    {
+        int type = 0;
+        socklen_t type_length = sizeof(type);
+        getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &type_length);
+
+        struct sockaddr_storage self;
+        socklen_t self_length = sizeof(self);
+        std::memset(&self, 0, sizeof(self));
+        char host[INET6_ADDRSTRLEN] = "?";
+        unsigned port = 0;
+        if (getsockname(sock, (struct sockaddr *)&self, &self_length) == 0)
+        {
+            if (self.ss_family == AF_INET6)
+            {
+                const struct sockaddr_in6 *v6 = (const struct sockaddr_in6 *)&self;
+                inet_ntop(AF_INET6, &v6->sin6_addr, host, sizeof(host));
+                port = ntohs(v6->sin6_port);
+            }
+            else if (self.ss_family == AF_INET)
+            {
+                const struct sockaddr_in *v4 = (const struct sockaddr_in *)&self;
+                inet_ntop(AF_INET, &v4->sin_addr, host, sizeof(host));
+                port = ntohs(v4->sin_port);
+            }
+        }
+        char labels[128];
+        std::snprintf(labels, sizeof(labels), self.ss_family == AF_INET6 ? "fd=\"%d\",proto=\"%s\",local=\"[%s]:%u\"" : "fd=\"%d\",proto=\"%s\",local=\"%s:%u\"",
+                      sock, type == SOCK_STREAM ? "tcp" : type == SOCK_DGRAM ? "udp" : "other", host, port);
+        return labels;
+    }
+
+    class SocketStatsMonitor
+    {
+    public:
+        explicit SocketStatsMonitor(uint64_t interval_ms = 1000)
+            : mIntervalMs(interval_ms),
+              mTcpRtt("ipnetweb_tcp_rtt_seconds", "Smoothed RTT of accepted TCP connections (TCP_INFO)"),
+              mTcpCwnd("ipnetweb_tcp_cwnd_segments", "Congestion window of accepted TCP connections (TCP_INFO)", std::string(), 1.0),
+              mTcpRetransmits("ipnetweb_tcp_retransmits_total", "Retransmitted segments of accepted TCP connections (TCP_INFO)"),
+              mTcpUnacked("ipnetweb_tcp_unacked_segments", "Unacknowledged segments over open accepted TCP connections (TCP_INFO)") {}
+
+        ~SocketStatsMonitor()
+        {
+            // ゲージへ足した分を戻す (終わったスレッドの値が残らないように)
+            for (auto &kv : mConnections)
+            {
+                mTcpUnacked.sub(kv.second.mUnacked);
+            }
+            for (auto &kv : mSockets)
+            {
+                clearGauges(kv.second);
+            }
+        }
+
+        SocketStatsMonitor(const SocketStatsMonitor &) = delete;
+        SocketStatsMonitor &operator=(const SocketStatsMonitor &) = delete;
+
+        // 待ち受け/受信ソケットを見張る (ソケット毎の系列を登録する. 起動時に呼ぶ)
+        void watch(int sock)
+        {
+            std::string labels = SocketLabels(sock);
+            int type = 0;
+            socklen_t type_length = sizeof(type);
+            getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &type_length);
+            int listening = 0;
+            socklen_t listening_length = sizeof(listening);
+            getsockopt(sock, SOL_SOCKET, SO_ACCEPTCONN, &listening, &listening_length);
+
+            Watched watched{
+                labels,
+                Counter("ipnetweb_socket_drops_total", "Packets dropped by the kernel on this socket (sk_drops)", labels),
+                Gauge("ipnetweb_socket_receive_queue_bytes", "Bytes waiting in the receive buffer (SO_MEMINFO)", labels),
+                Gauge("ipnetweb_socket_receive_buffer_bytes", "Receive buffer limit (SO_MEMINFO)", labels),
+                Gauge("ipnetweb_socket_send_queue_bytes", "Bytes queued for sending (SO_MEMINFO)", labels),
+                Gauge("ipnetweb_socket_backlog_bytes", "Bytes in the socket backlog (SO_MEMINFO)", labels),
+            };
+            if (listening != 0 && type == SOCK_STREAM)
+            {
+                watched.mAcceptQueue.reset(new AcceptQueue{
+                    Gauge("ipnetweb_accept_queue", "Connections waiting for accept (TCP_INFO on the listener)", labels),
+                    Gauge("ipnetweb_accept_queue_limit", "Accept queue limit (TCP_INFO on the listener)", labels),
+                });
+            }
+            mSockets.emplace(sock, std::move(watched));
+        }
+
+        // SO_RXQ_OVFLの累計 (受信の度. SO_MEMINFOを待たずに反映する)
+        void onRxqOverflow(int sock, uint32_t drops)
+        {
+            auto iter = mSockets.find(sock);
+            if (iter != mSockets.end())
+            {
+                updateDrops(iter->second, drops);
+            }
+        }
+
+        // 間隔が経っていれば全てを読む. 読んだらtrue.
+        bool sample(uint64_t now_ms)
+        {
+            if (mLastSampleMs != 0 && now_ms - mLastSampleMs < mIntervalMs)
+            {
+                return false;
+            }
+            mLastSampleMs = now_ms;
+            for (auto &kv : mSockets)
+            {
+                sampleSocket(kv.first, kv.second);
+            }
+            for (auto &kv : mConnections)
+            {
+                sampleConnection(kv.first, kv.second);
+            }
+            return true;
+        }
+
+        // acceptした接続
+        void watchConnection(int sock)
+        {
+            mConnections.emplace(sock, Connection());
+        }
+
+        // 閉じる前に最後の値を読んで外す
+        void closeConnection(int sock)
+        {
+            auto iter = mConnections.find(sock);
+            if (iter == mConnections.end())
+            {
+                return;
+            }
+            sampleConnection(sock, iter->second);
+            mTcpUnacked.sub(iter->second.mUnacked);
+            mConnections.erase(iter);
+        }
+
+        uint64_t drops(int sock) const
+        {
+            auto iter = mSockets.find(sock);
+            return iter != mSockets.end() ? iter->second.mDrops : 0;
+        }
+
+        // [Status] ソケット毎の最後の値
+        void print()
+        {
+            for (auto &kv : mSockets)
+            {
+                sampleSocket(kv.first, kv.second);
+                const Watched &watched = kv.second;
+                std::printf("[Status] socket %s: kernel drops %llu, receive queue %u/%u bytes, backlog %u bytes",
+                            watched.mLabels.c_str(), (unsigned long long)watched.mDrops,
+                            watched.mLast.mRmemAlloc, watched.mLast.mRcvBuf, watched.mLast.mBacklog);
+                if (watched.mAcceptQueue)
+                {
+                    std::printf(", accept queue %u/%u", watched.mAcceptQueue->mLast, watched.mAcceptQueue->mLastLimit);
+                }
+                std::printf("\n");
+            }
+        }
+
+    private:
+        // listenソケットだけ
+        struct AcceptQueue
+        {
+            Gauge mLength;
+            Gauge mLimit;
+            uint32_t mLast = 0;
+            uint32_t mLastLimit = 0;
+        };
+
+        struct Watched
+        {
+            std::string mLabels;
+            Counter mDropCounter;
+            Gauge mReceiveQueue;
+            Gauge mReceiveBuffer;
+            Gauge mSendQueue;
+            Gauge mBacklog;
+            uint64_t mDrops = 0;
+            SocketMemInfo mLast;
+            std::unique_ptr<AcceptQueue> mAcceptQueue;
+        };
+
+        struct Connection
+        {
+            uint32_t mRetransmits = 0;
+            int64_t mUnacked = 0;
+        };
+
+        void updateDrops(Watched &watched, uint64_t drops)
+        {
+            if (drops > watched.mDrops)
+            {
+                watched.mDropCounter.inc(drops - watched.mDrops);
+                NetMetrics::instance().mSocketDrops.inc(drops - watched.mDrops);
+                watched.mDrops = drops;
+            }
+        }
+
+        // ゲージは増減の合計なので, 前回の値との差を足す
+        static void setGauge(const Gauge &gauge, uint32_t &last, uint32_t value)
+        {
+            gauge.add((int64_t)value - (int64_t)last);
+            last = value;
+        }
+
+        void sampleSocket(int sock, Watched &watched)
+        {
+            SocketMemInfo info;
+            if (ReadSocketMemInfo(sock, info) == 0)
+            {
+                setGauge(watched.mReceiveQueue, watched.mLast.mRmemAlloc, info.mRmemAlloc);
+                setGauge(watched.mReceiveBuffer, watched.mLast.mRcvBuf, info.mRcvBuf);
+                setGauge(watched.mSendQueue, watched.mLast.mWmemQueued, info.mWmemQueued);
+                setGauge(watched.mBacklog, watched.mLast.mBacklog, info.mBacklog);
+                if (info.mHasDrops)
+                {
+                    updateDrops(watched, info.mDrops);
+                }
+            }
+            struct tcp_info tcp;
+            if (watched.mAcceptQueue && ReadTcpInfo(sock, tcp) == 0)
+            {
+                setGauge(watched.mAcceptQueue->mLength, watched.mAcceptQueue->mLast, tcp.tcpi_unacked);
+                setGauge(watched.mAcceptQueue->mLimit, watched.mAcceptQueue->mLastLimit, tcp.tcpi_sacked);
+            }
+        }
+
+        void sampleConnection(int sock, Connection &connection)
+        {
+            struct tcp_info tcp;
+            if (ReadTcpInfo(sock, tcp) != 0)
+            {
+                return;
+            }
+            mTcpRtt.record((uint64_t)tcp.tcpi_rtt * 1000); // us -> ns
+            mTcpCwnd.record(tcp.tcpi_snd_cwnd);
+            if (tcp.tcpi_total_retrans > connection.mRetransmits)
+            {
+                mTcpRetransmits.inc(tcp.tcpi_total_retrans - connection.mRetransmits);
+                connection.mRetransmits = tcp.tcpi_total_retrans;
+            }
+            mTcpUnacked.add((int64_t)tcp.tcpi_unacked - connection.mUnacked);
+            connection.mUnacked = tcp.tcpi_unacked;
+        }
+
+        void clearGauges(Watched &watched)
+        {
+            watched.mReceiveQueue.sub(watched.mLast.mRmemAlloc);
+            watched.mReceiveBuffer.sub(watched.mLast.mRcvBuf);
+            watched.mSendQueue.sub(watched.mLast.mWmemQueued);
+            watched.mBacklog.sub(watched.mLast.mBacklog);
+            if (watched.mAcceptQueue)
+            {
+                watched.mAcceptQueue->mLength.sub(watched.mAcceptQueue->mLast);
+                watched.mAcceptQueue->mLimit.sub(watched.mAcceptQueue->mLastLimit);
+            }
+        }
+
+        uint64_t mIntervalMs;
+        uint64_t mLastSampleMs = 0;
+        std::unordered_map<int, Watched> mSockets;
+        std::unordered_map<int, Connection> mConnections;
+        Histogram mTcpRtt;
+        Histogram mTcpCwnd;
+        Counter mTcpRetransmits;
+        Gauge mTcpUnacked;
+    };
+} // namespace net
+} // namespace is
@@ -0,0 +1,469 @@
+/**
+ * @file stun.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief STUNメッセージの組み立てと解析 (RFC 5389 / RFC 5780)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * STUNヘッダ(20byte)
+ * ```
+ *  0                   1                   2                   3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |0 0|     STUN Message Type     |         Message Length        |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |                         Magic Cookie                          |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |                     Transaction ID (96 bits)                  |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * ```
+ * 属性はTLV(Type 16bit, Length 16bit, Value)で, 4バイト境界にパディングされる.
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <cerrno>
+#include <cstdlib> // std::strtol
+#include <cstring>
+#include <string>
+#include <random>
+#include <algorithm> // std::count
+
+#include <NetUtils/packet_view.hpp>
+
+namespace is
+{
+namespace net
+{
+    constexpr uint32_t kStunMagicCookie = 0x2112A442;
+    constexpr size_t kStunHeaderSize = 20;
+    constexpr size_t kStunTransactionIdSize = 12;
+
+    // メッセージタイプ (Binding)
+    constexpr uint16_t kStunBindingRequest = 0x0001;
+    constexpr uint16_t kStunBindingIndication = 0x0011;
+    constexpr uint16_t kStunBindingSuccess = 0x0101;
+    constexpr uint16_t kStunBindingError = 0x0111;
+
+    // 属性
+    constexpr uint16_t kStunAttrMappedAddress = 0x0001;
+    constexpr uint16_t kStunAttrChangeRequest = 0x0003;  // RFC 5780
+    constexpr uint16_t kStunAttrErrorCode = 0x0009;
+    constexpr uint16_t kStunAttrXorMappedAddress = 0x0020;
+    constexpr uint16_t kStunAttrPadding = 0x0026;        // RFC 5780
+    constexpr uint16_t kStunAttrResponsePort = 0x0027;   // RFC 5780
+    constexpr uint16_t kStunAttrSoftware = 0x8022;
+    constexpr uint16_t kStunAttrResponseOrigin = 0x802B; // RFC 5780
+    constexpr uint16_t kStunAttrOtherAddress = 0x802C;   // RFC 5780
+    constexpr uint16_t kStunAttrResponseDestination = 0xC010; // 独自: 応答の宛先 (要求元と同じIPに限る)
+
+    // CHANGE-REQUESTのフラグ
+    constexpr uint32_t kStunChangeIp = 0x04;
+    constexpr uint32_t kStunChangePort = 0x02;
+
+    // トランザクションID
+    struct StunTransactionId
+    {
+        uint8_t mBytes[kStunTransactionIdSize];
+
+        bool operator==(const StunTransactionId &other) const
+        {
+            return std::memcmp(mBytes, other.mBytes, sizeof(mBytes)) == 0;
+        }
+        bool operator!=(const StunTransactionId &other) const { return !(*this == other); }
+
+        static StunTransactionId Random()
+        {
+            static thread_local std::mt19937_64 engine{std::random_device{}()};
+            StunTransactionId id;
+            for (size_t i = 0; i < sizeof(id.mBytes); ++i)
+            {
+                id.mBytes[i] = (uint8_t)(engine() & 0xFF);
+            }
+            return id;
+        }
+    };
+
+    /////////////////////////////////////////////////////////////
+    // エンドポイント(sockaddr)の補助
+    /////////////////////////////////////////////////////////////
+
+    // アドレスとポートが等しいか
+    inline bool SameEndpoint(const struct sockaddr *a, const struct sockaddr *b)
+    {
+        if (a->sa_family != b->sa_family)
+        {
+            return false;
+        }
+        if (a->sa_family == AF_INET6)
+        {
+            const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+            const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+            return a6->sin6_port == b6->sin6_port &&
+                   std::memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+        }
+        const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+        const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+        return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+    }
+
+    // アドレスのみ等しいか
+    inline bool SameAddress(const struct sockaddr *a, const struct sockaddr *b)
+    {
+        if (a->sa_family != b->sa_family)
+        {
+            return false;
+        }
+        if (a->sa_family == AF_INET6)
+        {
+            return std::memcmp(&((const struct sockaddr_in6 *)a)->sin6_addr,
+                               &((const struct sockaddr_in6 *)b)->sin6_addr, sizeof(struct in6_addr)) == 0;
+        }
+        return ((const struct sockaddr_in *)a)->sin_addr.s_addr == ((const struct sockaddr_in *)b)->sin_addr.s_addr;
+    }
+
+    inline uint16_t EndpointPort(const struct sockaddr *address)
+    {
+        if (address->sa_family == AF_INET6)
+        {
+            return ntohs(((const struct sockaddr_in6 *)address)->sin6_port);
+        }
+        return ntohs(((const struct sockaddr_in *)address)->sin_port);
+    }
+
+    inline void SetEndpointPort(struct sockaddr *address, uint16_t port)
+    {
+        if (address->sa_family == AF_INET6)
+        {
+            ((struct sockaddr_in6 *)address)->sin6_port = htons(port);
+        }
+        else
+        {
+            ((struct sockaddr_in *)address)->sin_port = htons(port);
+        }
+    }
+
+    inline socklen_t EndpointLength(const struct sockaddr *address)
+    {
+        return address->sa_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+    }
+
+    // "IP:port" ("[IPv6]:port")
+    inline std::string EndpointName(const struct sockaddr *address)
+    {
+        char name[INET6_ADDRSTRLEN];
+        if (address->sa_family == AF_INET6)
+        {
+            inet_ntop(AF_INET6, &((const struct sockaddr_in6 *)address)->sin6_addr, name, sizeof(name));
+            return "[" + std::string(name) + "]:" + std::to_string(EndpointPort(address));
+        }
+        if (address->sa_family == AF_INET)
+        {
+            inet_ntop(AF_INET, &((const struct sockaddr_in *)address)->sin_addr, name, sizeof(name));
+            return std::string(name) + ":" + std::to_string(EndpointPort(address));
+        }
+        return "(none)";
+    }
+
+    // ポート番号の文字列 (10進, 0〜65535) を解析. 数字以外が残る・範囲外ならfalse
+    inline bool ParsePort(const std::string &text, uint16_t *port)
+    {
+        if (text.empty() || text[0] < '0' || text[0] > '9')
+        {
+            return false;
+        }
+        char *end = nullptr;
+        errno = 0;
+        long value = std::strtol(text.c_str(), &end, 10);
+        if (errno != 0 || end == text.c_str() || *end != '\0' || value < 0 || value > 65535)
+        {
+            return false;
+        }
+        *port = (uint16_t)value;
+        return true;
+    }
+
+    // "IP:port"形式を解析 (IPv6は"[IPv6]:port")
+    inline bool ParseEndpoint(const std::string &text, uint16_t default_port, struct sockaddr_storage *out)
+    {
+        std::string host = text;
+        uint16_t port = default_port;
+        if (!text.empty() && text[0] == '[')
+        {
+            size_t close = text.find(']');
+            if (close == std::string::npos)
+            {
+                return false;
+            }
+            host = text.substr(1, close - 1);
+            if (close + 1 < text.size())
+            {
+                if (text[close + 1] != ':' || !ParsePort(text.substr(close + 2), &port))
+                {
+                    return false;
+                }
+            }
+        }
+        else if (std::count(text.begin(), text.end(), ':') == 1)
+        {
+            size_t colon = text.find(':');
+            host = text.substr(0, colon);
+            if (!ParsePort(text.substr(colon + 1), &port))
+            {
+                return false;
+            }
+        }
+
+        std::memset(out, 0, sizeof(*out));
+        struct sockaddr_in *sin = (struct sockaddr_in *)out;
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)out;
+        if (inet_pton(AF_INET, host.c_str(), &sin->sin_addr) == 1)
+        {
+            sin->sin_family = AF_INET;
+            sin->sin_port = htons(port);
+            return true;
+        }
+        if (inet_pton(AF_INET6, host.c_str(), &sin6->sin6_addr) == 1)
+        {
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_port = htons(port);
+            return true;
+        }
+        return false;
+    }
+
+    /////////////////////////////////////////////////////////////
+    // STUNメッセージの組み立て
+    /////////////////////////////////////////////////////////////
+    class StunMessageWriter
+    {
+    public:
+        StunMessageWriter(uint8_t *buf, size_t capacity, uint16_t type, const StunTransactionId &id)
+            : mBuf(buf), mCapacity(capacity), mSize(kStunHeaderSize), mOverflow(capacity < kStunHeaderSize)
+        {
+            if (mOverflow)
+            {
+                return;
+            }
+            StoreBe16(mBuf + 0, type);
+            StoreBe16(mBuf + 2, 0);
+            StoreBe32(mBuf + 4, kStunMagicCookie);
+            std::memcpy(mBuf + 8, id.mBytes, kStunTransactionIdSize);
+        }
+
+        // 属性(TLV)の追加. 4バイト境界にパディングする.
+        void addAttribute(uint16_t type, const void *value, uint16_t length)
+        {
+            size_t padded = (length + 3u) & ~3u;
+            if (mOverflow || mSize + 4 + padded > mCapacity)
+            {
+                mOverflow = true;
+                return;
+            }
+            StoreBe16(mBuf + mSize, type);
+            StoreBe16(mBuf + mSize + 2, length);
+            if (length > 0)
+            {
+                std::memcpy(mBuf + mSize + 4, value, length);
+            }
+            std::memset(mBuf + mSize + 4 + length, 0, padded - length);
+            mSize += 4 + padded;
+            StoreBe16(mBuf + 2, (uint16_t)(mSize - kStunHeaderSize));
+        }
+
+        void addUint32(uint16_t type, uint32_t value)
+        {
+            uint8_t data[4];
+            StoreBe32(data, value);
+            addAttribute(type, data, sizeof(data));
+        }
+
+        // (XOR-)MAPPED-ADDRESS形式のアドレス属性
+        void addAddress(uint16_t type, const struct sockaddr *address, bool xored)
+        {
+            uint8_t data[20];
+            uint16_t port = EndpointPort(address);
+            data[0] = 0;
+            if (address->sa_family == AF_INET6)
+            {
+                data[1] = 0x02;
+                std::memcpy(data + 4, &((const struct sockaddr_in6 *)address)->sin6_addr, 16);
+            }
+            else
+            {
+                data[1] = 0x01;
+                std::memcpy(data + 4, &((const struct sockaddr_in *)address)->sin_addr, 4);
+            }
+            size_t addr_len = data[1] == 0x02 ? 16 : 4;
+            if (xored)
+            {
+                // ポートはクッキーの上位16bit, アドレスはクッキー(+トランザクションID)とXOR
+                port ^= (uint16_t)(kStunMagicCookie >> 16);
+                for (size_t i = 0; i < addr_len; ++i)
+                {
+                    data[4 + i] ^= mBuf[4 + i]; // mBuf[4..19] = cookie + transaction id
+                }
+            }
+            StoreBe16(data + 2, port);
+            addAttribute(type, data, (uint16_t)(4 + addr_len));
+        }
+
+        bool ok() const { return !mOverflow; }
+        size_t size() const { return mSize; }
+
+    private:
+        uint8_t *mBuf;
+        size_t mCapacity;
+        size_t mSize;
+        bool mOverflow;
+    };
+
+    /////////////////////////////////////////////////////////////
+    // STUNメッセージの解析 (コピーしない)
+    /////////////////////////////////////////////////////////////
+    class StunMessageView : public BytesView
+    {
+    public:
+        using BytesView::BytesView;
+
+        uint16_t type() const { return u16(0); }
+        uint16_t length() const { return u16(2); }
+        uint32_t cookie() const { return u32(4); }
+
+        StunTransactionId transactionId() const
+        {
+            StunTransactionId id;
+            std::memset(id.mBytes, 0, sizeof(id.mBytes));
+            if (has(kStunHeaderSize))
+            {
+                std::memcpy(id.mBytes, mData + 8, kStunTransactionIdSize);
+            }
+            return id;
+        }
+
+        // 先頭2bitが0, マジッククッキー一致, 長さが4の倍数で受信長に収まる
+        bool valid() const
+        {
+            return has(kStunHeaderSize) && (u8(0) & 0xC0) == 0 && cookie() == kStunMagicCookie &&
+                   (length() & 3) == 0 && has(kStunHeaderSize + length());
+        }
+
+        // 属性の値 (見つからなければ空). 同じ種類が複数あればindex番目.
+        BytesView attribute(uint16_t type, size_t index = 0) const
+        {
+            if (!valid())
+            {
+                return BytesView();
+            }
+            size_t offset = kStunHeaderSize;
+            size_t end = kStunHeaderSize + length();
+            while (offset + 4 <= end)
+            {
+                uint16_t attr_type = u16(offset);
+                uint16_t attr_len = u16(offset + 2);
+                if (offset + 4 + attr_len > end)
+                {
+                    break;
+                }
+                if (attr_type == type && index-- == 0)
+                {
+                    return BytesView(mData + offset + 4, attr_len);
+                }
+                offset += 4 + ((attr_len + 3u) & ~3u);
+            }
+            return BytesView();
+        }
+
+        bool hasAttribute(uint16_t type) const { return attributeExists(type); }
+
+        uint32_t attributeUint32(uint16_t type, uint32_t default_value = 0) const
+        {
+            BytesView value = attribute(type);
+            return value.has(4) ? value.u32(0) : default_value;
+        }
+
+        // 文字列属性 (SOFTWAREなど)
+        std::string attributeString(uint16_t type) const
+        {
+            BytesView value = attribute(type);
+            return value.empty() ? std::string() : std::string((const char *)value.data(), value.size());
+        }
+
+        // (XOR-)MAPPED-ADDRESS形式のアドレス属性を取り出す
+        bool address(uint16_t type, struct sockaddr_storage *out, bool xored, size_t index = 0) const
+        {
+            BytesView value = attribute(type, index);
+            if (!value.has(8))
+            {
+                return false;
+            }
+            uint8_t family = value.u8(1);
+            uint16_t port = value.u16(2);
+            size_t addr_len = family == 0x02 ? 16 : 4;
+            if ((family != 0x01 && family != 0x02) || !value.has(4 + addr_len))
+            {
+                return false;
+            }
+
+            uint8_t addr[16];
+            std::memcpy(addr, value.data() + 4, addr_len);
+            if (xored)
+            {
+                port ^= (uint16_t)(kStunMagicCookie >> 16);
+                for (size_t i = 0; i < addr_len; ++i)
+                {
+                    addr[i] ^= mData[4 + i];
+                }
+            }
+
+            std::memset(out, 0, sizeof(*out));
+            if (family == 0x02)
+            {
+                struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)out;
+                sin6->sin6_family = AF_INET6;
+                sin6->sin6_port = htons(port);
+                std::memcpy(&sin6->sin6_addr, addr, 16);
+            }
+            else
+            {
+                struct sockaddr_in *sin = (struct sockaddr_in *)out;
+                sin->sin_family = AF_INET;
+                sin->sin_port = htons(port);
+                std::memcpy(&sin->sin_addr, addr, 4);
+            }
+            return true;
+        }
+
+        // XOR-MAPPED-ADDRESSを優先し, 無ければMAPPED-ADDRESS
+        bool mappedAddress(struct sockaddr_storage *out) const
+        {
+            return address(kStunAttrXorMappedAddress, out, true) ||
+                   address(kStunAttrMappedAddress, out, false);
+        }
+
+    private:
+        // 属性の存在確認 (長さ0の属性も含む)
+        bool attributeExists(uint16_t type) const
+        {
+            size_t offset = kStunHeaderSize;
+            size_t end = kStunHeaderSize + length();
+            while (valid() && offset + 4 <= end)
+            {
+                if (u16(offset) == type)
+                {
+                    return true;
+                }
+                offset += 4 + ((u16(offset + 2) + 3u) & ~3u);
+            }
+            return false;
+        }
+    };
+
+} // namespace net
+} // namespace is
@@ -0,0 +1,109 @@
+/**
+ * @file timer_wheel.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief ハッシュ化タイミングホイール (大量のタイムアウトをO(1)で登録・失効させる)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * 時刻は呼び出し側が決める整数tick(秒でもミリ秒でもよい)で扱う.
+ * + `schedule()`は期限tickの剰余のスロットに値を積むだけ.
+ * + `advance()`は前回から進んだスロットだけを走査し, 期限切れの値をコールバックに渡す.
+ *   ホイール1周より先の期限はスロットに残り, 次の周回で再判定される.
+ * + 取り消しは持たない. 値に世代番号などを持たせ, コールバック側で最新か確認する(遅延削除).
+ *
+ * スレッドセーフではない. 複数スレッドから使う場合はシャードごとに1つ持つこと.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace is
+{
+namespace net
+{
+    template <typename T>
+    class TimerWheel
+    {
+    public:
+        explicit TimerWheel(size_t slots = 512, uint64_t now_tick = 0)
+            : mSlots(slots ? slots : 1), mCurrent(now_tick), mSize(0) {}
+
+        uint64_t now() const { return mCurrent; }
+        size_t size() const { return mSize; }
+        bool empty() const { return mSize == 0; }
+
+        // 期限deadline_tickで登録 (過去の期限は次のadvance()で失効する)
+        void schedule(uint64_t deadline_tick, T value)
+        {
+            if (deadline_tick <= mCurrent)
+            {
+                deadline_tick = mCurrent + 1;
+            }
+            mSlots[deadline_tick % mSlots.size()].push_back(Entry{deadline_tick, std::move(value)});
+            ++mSize;
+        }
+
+        // now_tickまで進め, 期限切れの値ごとにon_expire(T&)を呼ぶ. 失効数を返す.
+        // on_expireの中からschedule()してよい(再登録).
+        template <typename Func>
+        size_t advance(uint64_t now_tick, Func &&on_expire)
+        {
+            if (now_tick <= mCurrent)
+            {
+                return 0;
+            }
+            // 1周以上進んだ場合も各スロットを1回ずつ見れば足りる
+            uint64_t steps = now_tick - mCurrent;
+            if (steps > mSlots.size())
+            {
+                steps = mSlots.size();
+            }
+
+            size_t expired = 0;
+            for (uint64_t i = 1; i <= steps; ++i)
+            {
+                std::vector<Entry> &slot = mSlots[(now_tick - steps + i) % mSlots.size()];
+                std::vector<Entry> due;
+                for (size_t k = 0; k < slot.size();)
+                {
+                    if (slot[k].deadline <= now_tick)
+                    {
+                        due.push_back(std::move(slot[k]));
+                        slot[k] = std::move(slot.back()); // 順序は保たない
+                        slot.pop_back();
+                    }
+                    else
+                    {
+                        ++k;
+                    }
+                }
+                mSize -= due.size();
+                mCurrent = now_tick - steps + i;
+                for (Entry &entry : due)
+                {
+                    on_expire(entry.value);
+                    ++expired;
+                }
+            }
+            mCurrent = now_tick;
+            return expired;
+        }
+
+    private:
+        struct Entry
+        {
+            uint64_t deadline;
+            T value;
+        };
+
+        std::vector<std::vector<Entry>> mSlots;
+        uint64_t mCurrent;
+        size_t mSize;
+    };
+} // namespace net
+} // namespace is
@@ -0,0 +1,205 @@
+/**
+ * @file timestamping.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief SO_TIMESTAMPINGで受信/送信時刻をカーネルとNICから受け取る (Linux)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * 1つのパケットに付く時刻は次の3つ. 差を取るとどこで時間が掛かっているかが分かる.
+ * + ハードウェア: NICがワイヤ上で送受信した時刻 (NICのPHCの時計. phc2sysで同期していればシステム時刻と比べられる)
+ * + ソフトウェア: カーネル(ドライバ/qdisc)が受け取った, または渡した時刻 (CLOCK_REALTIME)
+ * + アプリ     : recvmsg/sendmsgの前後でclock_gettime(CLOCK_REALTIME)した時刻
+ *
+ * 受信時刻はrecvmsgの補助データ(SCM_TIMESTAMPING)で届く.
+ * 送信時刻はソケットのエラーキュー(recvmsg + MSG_ERRQUEUE)に届き, pollではPOLLERRになる.
+ * SOF_TIMESTAMPING_OPT_IDで, 送信毎に0から振られる番号(ee_data)から送信したデータグラムを引ける.
+ *
+ * ハードウェア時刻にはインターフェース側の設定(SIOCSHWTSTAMP, CAP_NET_ADMIN)が必要.
+ * lo, vethや非対応のNICでは失敗するので, その場合はソフトウェア時刻だけで動く.
+ */
+#pragma once
+
+#if defined(__linux__)
+
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <net/if.h>             // ifreq
+#include <linux/errqueue.h>     // sock_extended_err, scm_timestamping, SCM_TSTAMP_*
+#include <linux/net_tstamp.h>   // SOF_TIMESTAMPING_*, hwtstamp_config
+#include <linux/sockios.h>      // SIOCSHWTSTAMP
+#include <errno.h>
+#include <time.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace is
+{
+namespace net
+{
+    // 受信: ソフトウェアとハードウェア(あれば)の両方
+    constexpr uint32_t kTimestampingRx = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_RX_HARDWARE |
+                                         SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+
+    // 送信: qdiscに入った時刻(SCHED), ドライバに渡した/ワイヤに出た時刻(SND). 番号付きでデータは返さない.
+    constexpr uint32_t kTimestampingTx = SOF_TIMESTAMPING_TX_SCHED | SOF_TIMESTAMPING_TX_SOFTWARE |
+                                         SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_SOFTWARE |
+                                         SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_OPT_ID |
+                                         SOF_TIMESTAMPING_OPT_TSONLY;
+
+    inline uint64_t TimespecToNs(const struct timespec &ts)
+    {
+        return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    }
+
+    // アプリ側の時刻 (ソフトウェア時刻と同じ時計)
+    inline uint64_t RealtimeNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return TimespecToNs(ts);
+    }
+
+    // a - b [ns]. どちらかが無い(0)ときは0
+    inline int64_t StageNs(uint64_t a, uint64_t b)
+    {
+        return (a == 0 || b == 0) ? 0 : (int64_t)(a - b);
+    }
+
+    struct PacketTimestamps
+    {
+        uint64_t mSoftwareNs = 0; // 0なら無し
+        uint64_t mHardwareNs = 0; // 0なら無し
+    };
+
+    struct TxTimestamp
+    {
+        uint32_t mId = 0;   // SOF_TIMESTAMPING_OPT_IDの番号 (このソケットで何番目の送信か)
+        uint32_t mType = 0; // SCM_TSTAMP_SCHED, SCM_TSTAMP_SND, SCM_TSTAMP_ACK
+        PacketTimestamps mStamp;
+    };
+
+    inline int EnableTimestamping(int sock, uint32_t flags)
+    {
+        return setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+    }
+
+    /**
+     * @brief インターフェースのハードウェア時刻を有効にする. ifnameの全受信パケットに時刻が付く.
+     * @return 成功: 0, 失敗: -1 (EOPNOTSUPP: 非対応のNIC, EPERM: CAP_NET_ADMIN無し)
+     */
+    inline int EnableHardwareTimestamping(int sock, const char *ifname, bool tx = true, bool rx = true)
+    {
+        struct hwtstamp_config config;
+        std::memset(&config, 0, sizeof(config));
+        config.tx_type = tx ? HWTSTAMP_TX_ON : HWTSTAMP_TX_OFF;
+        config.rx_filter = rx ? HWTSTAMP_FILTER_ALL : HWTSTAMP_FILTER_NONE;
+
+        struct ifreq request;
+        std::memset(&request, 0, sizeof(request));
+        std::strncpy(request.ifr_name, ifname, IFNAMSIZ - 1);
+        request.ifr_data = (char *)&config;
+        if (ioctl(sock, SIOCSHWTSTAMP, &request) != 0)
+        {
+            return -1;
+        }
+        // NICによっては全パケットではなくPTPだけなど, 要求より狭いフィルタに丸められる
+        if (rx && config.rx_filter == HWTSTAMP_FILTER_NONE)
+        {
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+        return 0;
+    }
+
+    // recvmsgの補助データからSCM_TIMESTAMPINGを取り出す. 無ければfalse.
+    inline bool ParseTimestamps(const struct msghdr *msg, PacketTimestamps *stamps)
+    {
+        bool found = false;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != nullptr;
+             cmsg = CMSG_NXTHDR((struct msghdr *)msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING)
+            {
+                struct scm_timestamping tss;
+                std::memcpy(&tss, CMSG_DATA(cmsg), sizeof(tss));
+                stamps->mSoftwareNs = TimespecToNs(tss.ts[0]); // ts[1]は廃止
+                stamps->mHardwareNs = TimespecToNs(tss.ts[2]);
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    /**
+     * @brief エラーキューから送信時刻を1つ読む (ブロックしない)
+     * @return 1: 読めた, 0: 無い, -1: エラー
+     */
+    inline int ReadTxTimestamp(int sock, TxTimestamp *out)
+    {
+        char control[512];
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        // OPT_TSONLYなのでデータ部は空
+
+        if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+
+        bool have_stamp = false;
+        bool have_error = false;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING)
+            {
+                struct scm_timestamping tss;
+                std::memcpy(&tss, CMSG_DATA(cmsg), sizeof(tss));
+                out->mStamp.mSoftwareNs = TimespecToNs(tss.ts[0]);
+                out->mStamp.mHardwareNs = TimespecToNs(tss.ts[2]);
+                have_stamp = true;
+            }
+            else if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                     (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+            {
+                struct sock_extended_err error;
+                std::memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+                if (error.ee_errno == ENOMSG && error.ee_origin == SO_EE_ORIGIN_TIMESTAMPING)
+                {
+                    out->mId = error.ee_data;
+                    out->mType = error.ee_info;
+                    have_error = true;
+                }
+            }
+        }
+        if (!have_stamp || !have_error)
+        {
+            errno = EPROTO; // ICMPエラーなど時刻以外がキューに入っていた
+            return -1;
+        }
+        return 1;
+    }
+
+    inline const char *TxTimestampTypeName(uint32_t type)
+    {
+        switch (type)
+        {
+        case SCM_TSTAMP_SCHED:
+            return "sched";
+        case SCM_TSTAMP_SND:
+            return "snd";
+        case SCM_TSTAMP_ACK:
+            return "ack";
+        default:
+            return "?";
+        }
+    }
+} // namespace net
+} // namespace is
+
+#endif // __linux__
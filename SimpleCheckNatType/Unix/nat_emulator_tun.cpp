@@ -0,0 +1,1032 @@
+/**
+ * @file nat_emulator_tun.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief TUNデバイス上で動くユーザ空間NAT (EIM/ADM/APDM マッピング + EIF/ADF/APDF フィルタリング)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * 実機のルータ無しでNAT判定(udp_ipv4_from_lan_a_to_wan_b)やホールパンチングを試すためのNAT.
+ * README表のマッピング/フィルタリングの振る舞いを選んで再現する.
+ *
+ * + LAN側から来たパケットをポリシールーティングでTUNに流し込み, 送信元を公開アドレスへ変換してTUNへ書き戻す.
+ * + 公開アドレス宛のパケットもTUNに流し込み, マッピングを逆引きして宛先を内部アドレスへ戻す.
+ * + TUNから読んだパケットは宛先が公開アドレス(プール)かどうかで向きを決めるので, TUNは1つで足りる.
+ *
+ * 性能面の作り
+ * + マッピング表は順引き(内部側キー -> 公開側)と逆引き(公開側 -> バインディング)の2つ.
+ *   どちらもキーのハッシュで256シャードに分け, シャード毎のロックで守る.
+ *   ロック順は常に 順引き -> 逆引き.
+ * + タイムアウトは逆引きシャード毎のタイミングホイール(1秒刻み)で管理する.
+ *   通信の度にタイマを付け直さず, 失効時に最終通信時刻を見て再登録する.
+ * + TUNは1回の起床でまとめて読み(最大64パケット), まとめて変換してから書き戻す.
+ *   `-q N`でIFF_MULTI_QUEUEのキューをN本開き, キュー毎にスレッドを立てる.
+ * + `-b N`はTUNを使わずにN個のマッピングを作って変換性能を測るベンチマーク(CI用, root不要).
+ *
+ * 対応: UDP, TCP(状態は追わない), ICMP Echo(識別子をポートとして扱う). IPv4のみ.
+ * 非対応: フラグメント, ICMPエラーに引用されたパケットの変換, ヘアピン.
+ *
+ * 構成例 (名前空間 lan / nat / wan, 公開プール 203.0.113.0/24)
+ * ```
+ * # nat
+ * nat_emulator_tun -d nat0 -p 203.0.113.1 -m apdm -f apdf &
+ * ip route add 203.0.113.0/24 dev nat0
+ * ip rule add iif veth-lan lookup 100
+ * ip route add default dev nat0 table 100
+ * sysctl -w net.ipv4.ip_forward=1 net.ipv4.conf.all.rp_filter=0 net.ipv4.conf.nat0.rp_filter=0
+ * # wan
+ * ip route add 203.0.113.0/24 via <natのWAN側アドレス>
+ * ```
+ *
+ * usage: nat_emulator_tun [-d dev] [-p public_ip[/len]] [-m eim|adm|apdm] [-f eif|adf|apdf]
+ *                         [-a seq|random|preserve] [-t udp_timeout_sec] [-q queues] [-b bench_mappings]
+ */
+#include <test_utils.hpp>
+
+// tun
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include <NetUtils/flat_hash_map.hpp>
+#include <NetUtils/packet_view.hpp>
+#include <NetUtils/timer_wheel.hpp>
+
+#define BUFSIZE 2048
+#define NAT_BATCH 64   // 1回の起床で読むパケット数
+#define NAT_SHARDS 256 // ハッシュ表のシャード数 (2の冪)
+
+using socket_t = int;
+using steady_clock = std::chrono::steady_clock;
+
+// マッピング/フィルタリングの依存先 (RFC 4787)
+enum class NatBehavior
+{
+    EndpointIndependent,     // EIM / EIF
+    AddressDependent,        // ADM / ADF
+    AddressAndPortDependent, // APDM / APDF
+};
+
+// 公開ポートの割り当て方
+enum class PortAllocation
+{
+    Sequential, // 公開IP毎に連番
+    Random,
+    Preserve, // 内部ポートをそのまま使い, 使用中なら連番
+};
+
+struct NatConfig
+{
+    NatBehavior mMapping = NatBehavior::EndpointIndependent;
+    NatBehavior mFiltering = NatBehavior::EndpointIndependent;
+    PortAllocation mAllocation = PortAllocation::Sequential;
+    std::vector<uint32_t> mPublicIps; // ホストバイトオーダ
+    uint32_t mPublicNet = 0;
+    uint32_t mPublicMask = 0xFFFFFFFF;
+    uint16_t mPortMin = 1024;
+    uint16_t mPortMax = 65535;
+    uint32_t mUdpTimeout = 120;  // RFC 4787 REQ-5 (2分以上)
+    uint32_t mTcpTimeout = 7440; // RFC 5382 REQ-5 (確立済み接続)
+    uint32_t mIcmpTimeout = 60;  // RFC 5508 REQ-1
+    size_t mMaxPermits = 64;     // ADF/APDF で1マッピングが覚える宛先の数
+
+    bool isPublic(uint32_t ip) const { return (ip & mPublicMask) == mPublicNet; }
+};
+
+/////////////////////////////////////////////////////////////
+// マッピング表
+/////////////////////////////////////////////////////////////
+
+static inline uint64_t Mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB3F99B5F1B4DULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// 順引きキー. マッピングの種類に応じて外部側のフィールドを0にする.
+struct FlowKey
+{
+    uint32_t mIntIp;
+    uint32_t mExtIp;
+    uint16_t mIntPort;
+    uint16_t mExtPort;
+    uint8_t mProtocol;
+
+    bool operator==(const FlowKey &other) const
+    {
+        return mIntIp == other.mIntIp && mExtIp == other.mExtIp && mIntPort == other.mIntPort &&
+               mExtPort == other.mExtPort && mProtocol == other.mProtocol;
+    }
+    uint64_t hash() const
+    {
+        return Mix64(((uint64_t)mIntIp << 32 | mExtIp) ^
+                     Mix64((uint64_t)mIntPort << 24 | (uint64_t)mExtPort << 8 | mProtocol));
+    }
+};
+
+// 逆引きキー (公開側)
+struct PublicKey
+{
+    uint32_t mIp;
+    uint16_t mPort;
+    uint8_t mProtocol;
+
+    bool operator==(const PublicKey &other) const
+    {
+        return mIp == other.mIp && mPort == other.mPort && mProtocol == other.mProtocol;
+    }
+    uint64_t hash() const
+    {
+        return Mix64((uint64_t)mIp << 24 | (uint64_t)mPort << 8 | mProtocol);
+    }
+};
+
+struct KeyHash
+{
+    template <typename Key>
+    size_t operator()(const Key &key) const { return (size_t)key.hash(); }
+};
+
+struct NatBinding
+{
+    FlowKey mFlow;    // 削除用の順引きキー
+    uint32_t mIntIp;  // 変換先の内部アドレス
+    uint16_t mIntPort;
+    uint32_t mLastSeen; // 最後に内部から送信した時刻[s]
+    uint32_t mTimeout;
+    std::vector<uint64_t> mPermits; // 受信を許す外部側 (ip << 16 | port). ADFはport=0.
+};
+
+struct alignas(64) FlowShard
+{
+    std::mutex mLock;
+    is::net::FlatHashMap<FlowKey, PublicKey, KeyHash> mMap;
+};
+
+struct alignas(64) PublicShard
+{
+    std::mutex mLock;
+    is::net::FlatHashMap<PublicKey, NatBinding, KeyHash> mMap;
+    is::net::TimerWheel<PublicKey> mWheel{512};
+};
+
+class NatTable
+{
+public:
+    explicit NatTable(const NatConfig &config)
+        : mConfig(config),
+          mFlows(new FlowShard[NAT_SHARDS]),
+          mPublics(new PublicShard[NAT_SHARDS]),
+          mNextPort(new std::atomic<uint32_t>[config.mPublicIps.size()])
+    {
+        for (size_t i = 0; i < config.mPublicIps.size(); ++i)
+        {
+            mNextPort[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    const NatConfig &config() const { return mConfig; }
+
+    void reserve(size_t mappings)
+    {
+        for (size_t i = 0; i < NAT_SHARDS; ++i)
+        {
+            mFlows[i].mMap.reserve(mappings / NAT_SHARDS + 1);
+            mPublics[i].mMap.reserve(mappings / NAT_SHARDS + 1);
+        }
+    }
+
+    // 内部 -> 外部. 公開側アドレスを返す. 割り当てできなければ偽.
+    bool outbound(uint8_t protocol, uint32_t src_ip, uint16_t src_port,
+                  uint32_t dst_ip, uint16_t dst_port, uint32_t now,
+                  PublicKey *out, bool *created)
+    {
+        FlowKey flow{src_ip, 0, src_port, 0, protocol};
+        if (mConfig.mMapping != NatBehavior::EndpointIndependent)
+        {
+            flow.mExtIp = dst_ip;
+        }
+        if (mConfig.mMapping == NatBehavior::AddressAndPortDependent)
+        {
+            flow.mExtPort = dst_port;
+        }
+        uint64_t permit = mConfig.mFiltering == NatBehavior::AddressAndPortDependent
+                              ? ((uint64_t)dst_ip << 16 | dst_port)
+                              : ((uint64_t)dst_ip << 16);
+
+        FlowShard &fshard = mFlows[Shard(flow.hash())];
+        std::lock_guard<std::mutex> flock(fshard.mLock);
+        PublicKey *found = fshard.mMap.find(flow);
+        if (found)
+        {
+            PublicShard &pshard = mPublics[Shard(found->hash())];
+            std::lock_guard<std::mutex> plock(pshard.mLock);
+            NatBinding *binding = pshard.mMap.find(*found);
+            if (binding)
+            {
+                binding->mLastSeen = now; // REQ-6: 内部からの送信で延長
+                addPermit(*binding, permit);
+                *out = *found;
+                *created = false;
+                return true;
+            }
+            fshard.mMap.erase(flow); // 逆引きが無い(起こらないはず)なら作り直す
+        }
+
+        /* 新規割り当て */
+        if (!allocate(flow, permit, now, out))
+        {
+            return false;
+        }
+        fshard.mMap.emplace(flow, *out);
+        *created = true;
+        return true;
+    }
+
+    // 外部 -> 内部. フィルタを通れば内部アドレスを返す.
+    // 戻り値: 0 変換, 1 マッピング無し, 2 フィルタで破棄
+    int inbound(uint8_t protocol, uint32_t dst_ip, uint16_t dst_port,
+                uint32_t src_ip, uint16_t src_port,
+                uint32_t *int_ip, uint16_t *int_port)
+    {
+        PublicKey key{dst_ip, dst_port, protocol};
+        PublicShard &pshard = mPublics[Shard(key.hash())];
+        std::lock_guard<std::mutex> plock(pshard.mLock);
+        const NatBinding *binding = pshard.mMap.find(key);
+        if (!binding)
+        {
+            return 1;
+        }
+        if (mConfig.mFiltering != NatBehavior::EndpointIndependent)
+        {
+            uint64_t permit = mConfig.mFiltering == NatBehavior::AddressAndPortDependent
+                                  ? ((uint64_t)src_ip << 16 | src_port)
+                                  : ((uint64_t)src_ip << 16);
+            const std::vector<uint64_t> &permits = binding->mPermits;
+            if (std::find(permits.begin(), permits.end(), permit) == permits.end())
+            {
+                return 2;
+            }
+        }
+        *int_ip = binding->mIntIp;
+        *int_port = binding->mIntPort;
+        return 0;
+    }
+
+    // シャード first, first + step, ... のタイマを進め, 期限切れのマッピングを消す. 削除数を返す.
+    size_t expire(size_t first, size_t step, uint32_t now)
+    {
+        size_t removed = 0;
+        std::vector<std::pair<PublicKey, FlowKey>> candidates;
+        for (size_t s = first; s < NAT_SHARDS; s += step)
+        {
+            PublicShard &pshard = mPublics[s];
+            candidates.clear();
+            {
+                std::lock_guard<std::mutex> plock(pshard.mLock);
+                pshard.mWheel.advance(now, [&](PublicKey &key) {
+                    const NatBinding *binding = pshard.mMap.find(key);
+                    if (!binding)
+                    {
+                        return;
+                    }
+                    uint64_t deadline = (uint64_t)binding->mLastSeen + binding->mTimeout;
+                    if (deadline > now)
+                    {
+                        pshard.mWheel.schedule(deadline, key); // 通信があったので再登録
+                        return;
+                    }
+                    candidates.emplace_back(key, binding->mFlow);
+                });
+            }
+
+            // ロック順(順引き -> 逆引き)を守るため取り直して確認する
+            for (const auto &candidate : candidates)
+            {
+                FlowShard &fshard = mFlows[Shard(candidate.second.hash())];
+                std::lock_guard<std::mutex> flock(fshard.mLock);
+                std::lock_guard<std::mutex> plock(pshard.mLock);
+                const NatBinding *binding = pshard.mMap.find(candidate.first);
+                if (!binding)
+                {
+                    continue;
+                }
+                uint64_t deadline = (uint64_t)binding->mLastSeen + binding->mTimeout;
+                if (deadline > now)
+                {
+                    pshard.mWheel.schedule(deadline, candidate.first);
+                    continue;
+                }
+                fshard.mMap.erase(candidate.second);
+                pshard.mMap.erase(candidate.first);
+                ++removed;
+            }
+        }
+        return removed;
+    }
+
+    size_t size() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < NAT_SHARDS; ++i)
+        {
+            std::lock_guard<std::mutex> plock(mPublics[i].mLock);
+            total += mPublics[i].mMap.size();
+        }
+        return total;
+    }
+
+private:
+    static size_t Shard(uint64_t hash) { return (size_t)(hash >> 56) & (NAT_SHARDS - 1); }
+
+    void addPermit(NatBinding &binding, uint64_t permit)
+    {
+        if (mConfig.mFiltering == NatBehavior::EndpointIndependent)
+        {
+            return;
+        }
+        if (std::find(binding.mPermits.begin(), binding.mPermits.end(), permit) != binding.mPermits.end())
+        {
+            return;
+        }
+        if (binding.mPermits.size() >= mConfig.mMaxPermits)
+        {
+            binding.mPermits.erase(binding.mPermits.begin()); // 古いものから忘れる
+        }
+        binding.mPermits.push_back(permit);
+    }
+
+    // 順引きシャードのロックを持った状態で呼ぶ
+    bool allocate(const FlowKey &flow, uint64_t permit, uint32_t now, PublicKey *out)
+    {
+        // 同じ内部アドレスは常に同じ公開IPへ (RFC 4787 REQ-2 paired)
+        size_t ip_index = (size_t)(Mix64(flow.mIntIp) % mConfig.mPublicIps.size());
+        uint32_t public_ip = mConfig.mPublicIps[ip_index];
+        uint32_t range = (uint32_t)mConfig.mPortMax - mConfig.mPortMin + 1;
+        uint32_t timeout = flow.mProtocol == IPPROTO_TCP    ? mConfig.mTcpTimeout
+                           : flow.mProtocol == IPPROTO_ICMP ? mConfig.mIcmpTimeout
+                                                            : mConfig.mUdpTimeout;
+
+        auto try_claim = [&](uint16_t port) -> bool {
+            PublicKey key{public_ip, port, flow.mProtocol};
+            PublicShard &pshard = mPublics[Shard(key.hash())];
+            std::lock_guard<std::mutex> plock(pshard.mLock);
+            auto inserted = pshard.mMap.emplace(key, NatBinding{flow, flow.mIntIp, flow.mIntPort, now, timeout, {}});
+            if (!inserted.second)
+            {
+                return false; // 使用中
+            }
+            addPermit(*inserted.first, permit);
+            pshard.mWheel.schedule((uint64_t)now + timeout, key);
+            *out = key;
+            return true;
+        };
+
+        if (mConfig.mAllocation == PortAllocation::Preserve &&
+            flow.mIntPort >= mConfig.mPortMin && flow.mIntPort <= mConfig.mPortMax &&
+            try_claim(flow.mIntPort))
+        {
+            return true;
+        }
+        if (mConfig.mAllocation == PortAllocation::Random)
+        {
+            thread_local std::mt19937 engine{std::random_device{}()};
+            for (int i = 0; i < 32; ++i)
+            {
+                if (try_claim((uint16_t)(mConfig.mPortMin + engine() % range)))
+                {
+                    return true;
+                }
+            }
+            // 埋まってきたら連番で探す
+        }
+        for (uint32_t i = 0; i < range; ++i)
+        {
+            uint32_t next = mNextPort[ip_index].fetch_add(1, std::memory_order_relaxed);
+            if (try_claim((uint16_t)(mConfig.mPortMin + next % range)))
+            {
+                return true;
+            }
+        }
+        return false; // 公開IPのポートが枯渇
+    }
+
+    NatConfig mConfig;
+    std::unique_ptr<FlowShard[]> mFlows;
+    std::unique_ptr<PublicShard[]> mPublics;
+    std::unique_ptr<std::atomic<uint32_t>[]> mNextPort;
+};
+
+/////////////////////////////////////////////////////////////
+// パケット変換
+/////////////////////////////////////////////////////////////
+
+struct alignas(64) NatStats
+{
+    std::atomic<uint64_t> mReceived{0};
+    std::atomic<uint64_t> mOutbound{0};
+    std::atomic<uint64_t> mInbound{0};
+    std::atomic<uint64_t> mCreated{0};
+    std::atomic<uint64_t> mExpired{0};
+    std::atomic<uint64_t> mNoMapping{0};
+    std::atomic<uint64_t> mFiltered{0};
+    std::atomic<uint64_t> mUnsupported{0};
+    std::atomic<uint64_t> mExhausted{0};
+};
+
+static inline void Count(std::atomic<uint64_t> &counter, uint64_t n = 1)
+{
+    counter.fetch_add(n, std::memory_order_relaxed); // 担当スレッドしか書かない
+}
+
+// L4のポート(ICMPは識別子)とチェックサムの位置
+struct L4Layout
+{
+    size_t mSrcPort;
+    size_t mDstPort;
+    size_t mChecksum;
+    bool mPseudoHeader;
+};
+
+/* パケットをその場で書き換える. 転送するなら真 */
+static bool TranslatePacket(NatTable &table, uint8_t *pkt, size_t nbytes, uint32_t now, NatStats &stats)
+{
+    is::net::Ipv4View ip(pkt, nbytes);
+    if (!ip.valid() || (ip.flags() & 0x1) || ip.fragmentOffset() != 0)
+    {
+        Count(stats.mUnsupported); // IPv6, フラグメント
+        return false;
+    }
+    size_t hl = ip.headerLength();
+    is::net::BytesView l4 = ip.boundedPayload();
+    uint8_t protocol = ip.protocol();
+    uint32_t src_ip = is::net::LoadBe32(ip.src());
+    uint32_t dst_ip = is::net::LoadBe32(ip.dst());
+    bool inbound = table.config().isPublic(dst_ip);
+
+    L4Layout layout;
+    if (protocol == IPPROTO_UDP && l4.has(8))
+    {
+        layout = {0, 2, 6, true};
+    }
+    else if (protocol == IPPROTO_TCP && l4.has(20))
+    {
+        layout = {0, 2, 16, true};
+    }
+    else if (protocol == IPPROTO_ICMP && l4.has(8) &&
+             l4.u8(0) == (inbound ? 0 /* Echo Reply */ : 8 /* Echo Request */))
+    {
+        layout = {4, 4, 2, false}; // 識別子を送信元/宛先ポートとみなす
+    }
+    else
+    {
+        Count(stats.mUnsupported);
+        return false;
+    }
+
+    uint8_t *l4p = pkt + hl;
+    uint16_t src_port = is::net::LoadBe16(l4p + layout.mSrcPort);
+    uint16_t dst_port = layout.mPseudoHeader ? is::net::LoadBe16(l4p + layout.mDstPort) : 0;
+    uint16_t l4_checksum = is::net::LoadBe16(l4p + layout.mChecksum);
+    bool udp_no_checksum = protocol == IPPROTO_UDP && l4_checksum == 0;
+
+    // 書き換える位置(アドレス/ポート)と新旧の値
+    size_t address_offset;
+    size_t port_offset;
+    uint32_t old_ip, new_ip;
+    uint16_t old_port, new_port;
+    if (!inbound)
+    {
+        if (table.config().isPublic(src_ip))
+        {
+            Count(stats.mUnsupported); // 公開アドレスを騙る内部パケット
+            return false;
+        }
+        PublicKey mapped;
+        bool created = false;
+        if (!table.outbound(protocol, src_ip, src_port, dst_ip, dst_port, now, &mapped, &created))
+        {
+            Count(stats.mExhausted);
+            return false;
+        }
+        if (created)
+        {
+            Count(stats.mCreated);
+        }
+        address_offset = 12;
+        port_offset = layout.mSrcPort;
+        old_ip = src_ip;
+        new_ip = mapped.mIp;
+        old_port = src_port;
+        new_port = mapped.mPort;
+        Count(stats.mOutbound);
+    }
+    else
+    {
+        uint16_t public_port = layout.mPseudoHeader ? dst_port : src_port;
+        uint32_t int_ip = 0;
+        uint16_t int_port = 0;
+        int verdict = table.inbound(protocol, dst_ip, public_port,
+                                    src_ip, layout.mPseudoHeader ? src_port : 0, &int_ip, &int_port);
+        if (verdict != 0)
+        {
+            Count(verdict == 1 ? stats.mNoMapping : stats.mFiltered);
+            return false;
+        }
+        address_offset = 16;
+        port_offset = layout.mDstPort;
+        old_ip = dst_ip;
+        new_ip = int_ip;
+        old_port = public_port;
+        new_port = int_port;
+        Count(stats.mInbound);
+    }
+
+    /* 書き換えとチェックサムの差分更新 (RFC 1624) */
+    is::net::StoreBe32(pkt + address_offset, new_ip);
+    is::net::StoreBe16(pkt + 10, is::net::ChecksumAdjust32(ip.checksum(), old_ip, new_ip));
+    is::net::StoreBe16(l4p + port_offset, new_port);
+    if (!udp_no_checksum)
+    {
+        uint16_t checksum = l4_checksum;
+        if (layout.mPseudoHeader)
+        {
+            checksum = is::net::ChecksumAdjust32(checksum, old_ip, new_ip);
+        }
+        checksum = is::net::ChecksumAdjust16(checksum, old_port, new_port);
+        if (protocol == IPPROTO_UDP && checksum == 0)
+        {
+            checksum = 0xFFFF; // UDPの0は「チェックサム無し」なので
+        }
+        is::net::StoreBe16(l4p + layout.mChecksum, checksum);
+    }
+    return true;
+}
+
+static uint32_t NowSeconds()
+{
+    static const steady_clock::time_point start = steady_clock::now();
+    return (uint32_t)std::chrono::duration_cast<std::chrono::seconds>(steady_clock::now() - start).count() + 1;
+}
+
+/////////////////////////////////////////////////////////////
+// TUN
+/////////////////////////////////////////////////////////////
+
+static std::atomic<bool> g_running{true};
+
+static void OnSignal(int)
+{
+    g_running.store(false);
+}
+
+static socket_t OpenTun(const char *name, bool multi_queue)
+{
+    socket_t fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+    if (fd < 0)
+    {
+        std::printf("[Error] open /dev/net/tun: %s\n", strerror(errno));
+        return -1;
+    }
+    struct ifreq ifr;
+    std::memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = (short)(IFF_TUN | IFF_NO_PI | (multi_queue ? IFF_MULTI_QUEUE : 0));
+    std::strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(fd, TUNSETIFF, &ifr) < 0)
+    {
+        std::printf("[Error] TUNSETIFF %s: %s\n", name, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int LinkUp(const char *name)
+{
+    socket_t sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+        return -1;
+    }
+    struct ifreq ifr;
+    std::memset(&ifr, 0, sizeof(ifr));
+    std::strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    int ret = ioctl(sock, SIOCGIFFLAGS, &ifr);
+    if (ret == 0)
+    {
+        ifr.ifr_flags = (short)(ifr.ifr_flags | IFF_UP | IFF_RUNNING);
+        ret = ioctl(sock, SIOCSIFFLAGS, &ifr);
+    }
+    if (ret < 0)
+    {
+        std::printf("[Error] %s up: %s\n", name, strerror(errno));
+    }
+    close(sock);
+    return ret;
+}
+
+/* 1キュー分の転送ループ */
+static void ForwardLoop(NatTable &table, socket_t fd, size_t index, size_t workers, NatStats &stats)
+{
+    std::vector<uint8_t> buffers(NAT_BATCH * BUFSIZE);
+    size_t lengths[NAT_BATCH];
+    uint32_t last_expire = NowSeconds();
+
+    struct pollfd target;
+    target.fd = fd;
+    target.events = POLLIN;
+
+    while (g_running.load(std::memory_order_relaxed))
+    {
+        target.revents = 0;
+        int nready = poll(&target, 1, 100);
+        if (nready < 0 && errno != EINTR)
+        {
+            std::printf("[Error] poll: %s\n", strerror(errno));
+            break;
+        }
+
+        /* 1.まとめて読む */
+        size_t count = 0;
+        while (nready > 0 && count < NAT_BATCH)
+        {
+            ssize_t n = read(fd, &buffers[count * BUFSIZE], BUFSIZE);
+            if (n <= 0)
+            {
+                break; // EAGAIN: キューが空
+            }
+            lengths[count++] = (size_t)n;
+        }
+        Count(stats.mReceived, count);
+
+        /* 2.まとめて変換して書き戻す */
+        uint32_t now = NowSeconds();
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint8_t *pkt = &buffers[i * BUFSIZE];
+            if (TranslatePacket(table, pkt, lengths[i], now, stats))
+            {
+                if (write(fd, pkt, lengths[i]) < 0 && errno != EAGAIN)
+                {
+                    std::printf("[Error] write: %s\n", strerror(errno));
+                }
+            }
+        }
+
+        /* 3.タイムアウト (担当シャードのみ) */
+        if (now != last_expire)
+        {
+            last_expire = now;
+            Count(stats.mExpired, table.expire(index, workers, now));
+        }
+    }
+}
+
+static void PrintStats(const NatTable &table, const std::vector<std::unique_ptr<NatStats>> &stats)
+{
+    uint64_t sums[9] = {0};
+    for (const auto &s : stats)
+    {
+        sums[0] += s->mReceived.load(std::memory_order_relaxed);
+        sums[1] += s->mOutbound.load(std::memory_order_relaxed);
+        sums[2] += s->mInbound.load(std::memory_order_relaxed);
+        sums[3] += s->mCreated.load(std::memory_order_relaxed);
+        sums[4] += s->mExpired.load(std::memory_order_relaxed);
+        sums[5] += s->mNoMapping.load(std::memory_order_relaxed);
+        sums[6] += s->mFiltered.load(std::memory_order_relaxed);
+        sums[7] += s->mUnsupported.load(std::memory_order_relaxed);
+        sums[8] += s->mExhausted.load(std::memory_order_relaxed);
+    }
+    std::printf("mappings %zu | rx %llu out %llu in %llu | created %llu expired %llu | "
+                "drop: no-mapping %llu filtered %llu unsupported %llu exhausted %llu\n",
+                table.size(),
+                (unsigned long long)sums[0], (unsigned long long)sums[1], (unsigned long long)sums[2],
+                (unsigned long long)sums[3], (unsigned long long)sums[4], (unsigned long long)sums[5],
+                (unsigned long long)sums[6], (unsigned long long)sums[7], (unsigned long long)sums[8]);
+}
+
+/////////////////////////////////////////////////////////////
+// ベンチマーク (TUN無し)
+/////////////////////////////////////////////////////////////
+
+// 内部ホストi/64 のポート 20000 + i%64 から 198.51.100.1:3478 へのUDP
+static size_t BuildBenchPacket(uint8_t *pkt, uint32_t src_ip, uint16_t src_port, uint32_t dst_ip, uint16_t dst_port)
+{
+    const size_t payload = 32;
+    const size_t total = 20 + 8 + payload;
+    std::memset(pkt, 0, total);
+    pkt[0] = 0x45;
+    is::net::StoreBe16(pkt + 2, (uint16_t)total);
+    pkt[8] = 64;
+    pkt[9] = IPPROTO_UDP;
+    is::net::StoreBe32(pkt + 12, src_ip);
+    is::net::StoreBe32(pkt + 16, dst_ip);
+    is::net::StoreBe16(pkt + 10, is::net::InternetChecksum(pkt, 20));
+    uint8_t *udp = pkt + 20;
+    is::net::StoreBe16(udp, src_port);
+    is::net::StoreBe16(udp + 2, dst_port);
+    is::net::StoreBe16(udp + 4, (uint16_t)(8 + payload));
+    uint32_t sum = is::net::PseudoHeaderSum4(pkt + 12, pkt + 16, IPPROTO_UDP, 8 + payload);
+    uint16_t checksum = is::net::InternetChecksum(udp, 8 + payload, sum);
+    is::net::StoreBe16(udp + 6, checksum ? checksum : 0xFFFF);
+    return total;
+}
+
+static int RunBenchmark(const NatConfig &config, size_t mappings, size_t workers)
+{
+    const uint32_t internal_base = 0x0A000001; // 10.0.0.1
+    const uint32_t server_ip = 0xC6336401;     // 198.51.100.1
+    NatTable table(config);
+    table.reserve(mappings);
+    std::vector<std::unique_ptr<NatStats>> stats;
+    for (size_t w = 0; w < workers; ++w)
+    {
+        stats.emplace_back(new NatStats);
+    }
+
+    auto run = [&](const char *label, auto &&body) {
+        steady_clock::time_point start = steady_clock::now();
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w < workers; ++w)
+        {
+            threads.emplace_back(body, w);
+        }
+        for (auto &t : threads)
+        {
+            t.join();
+        }
+        double sec = std::chrono::duration<double>(steady_clock::now() - start).count();
+        std::printf("%-28s %10zu pkts %8.3f s %8.2f Mpps\n", label, mappings, sec, (double)mappings / sec / 1e6);
+    };
+
+    /* 1.マッピングの作成 */
+    std::vector<PublicKey> publics(mappings, PublicKey{0, 0, 0});
+    run("create (outbound, new)", [&](size_t w) {
+        uint8_t pkt[BUFSIZE];
+        for (size_t i = w; i < mappings; i += workers)
+        {
+            size_t n = BuildBenchPacket(pkt, internal_base + (uint32_t)(i / 64), (uint16_t)(20000 + i % 64), server_ip, 3478);
+            if (TranslatePacket(table, pkt, n, 1, *stats[w]))
+            {
+                publics[i] = PublicKey{is::net::LoadBe32(pkt + 12), is::net::LoadBe16(pkt + 20), IPPROTO_UDP};
+            }
+        }
+    });
+
+    /* 2.既存マッピングの変換 (送信, 順不同) */
+    run("translate (outbound, hit)", [&](size_t w) {
+        uint8_t pkt[BUFSIZE];
+        std::mt19937_64 engine(w + 1);
+        for (size_t k = w; k < mappings; k += workers)
+        {
+            size_t i = (size_t)(engine() % mappings);
+            size_t n = BuildBenchPacket(pkt, internal_base + (uint32_t)(i / 64), (uint16_t)(20000 + i % 64), server_ip, 3478);
+            TranslatePacket(table, pkt, n, 2, *stats[w]);
+        }
+    });
+
+    /* 3.応答の逆変換 */
+    run("translate (inbound, hit)", [&](size_t w) {
+        uint8_t pkt[BUFSIZE];
+        for (size_t i = w; i < mappings; i += workers)
+        {
+            if (publics[i].mIp == 0)
+            {
+                continue;
+            }
+            size_t n = BuildBenchPacket(pkt, server_ip, 3478, publics[i].mIp, publics[i].mPort);
+            TranslatePacket(table, pkt, n, 2, *stats[w]);
+        }
+    });
+
+    /* 4.タイムアウトで全削除 */
+    steady_clock::time_point start = steady_clock::now();
+    size_t removed = table.expire(0, 1, config.mUdpTimeout + 3);
+    double sec = std::chrono::duration<double>(steady_clock::now() - start).count();
+    std::printf("%-28s %10zu maps %8.3f s\n", "expire (timer wheel)", removed, sec);
+
+    PrintStats(table, stats);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////
+
+static bool ParseBehavior(const char *text, const char *suffix, NatBehavior *out)
+{
+    std::string name(text);
+    if (name == std::string("ei") + suffix)
+    {
+        *out = NatBehavior::EndpointIndependent;
+    }
+    else if (name == std::string("ad") + suffix)
+    {
+        *out = NatBehavior::AddressDependent;
+    }
+    else if (name == std::string("apd") + suffix)
+    {
+        *out = NatBehavior::AddressAndPortDependent;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// a.b.c.d[/len] -> 公開プール (/31以上はネットワーク・ブロードキャストも使う)
+static bool ParsePublicPool(const char *text, NatConfig &config)
+{
+    std::string spec(text);
+    int prefix = 32;
+    size_t slash = spec.find('/');
+    if (slash != std::string::npos)
+    {
+        prefix = std::atoi(spec.c_str() + slash + 1);
+        spec.resize(slash);
+    }
+    struct in_addr address;
+    if (prefix < 8 || prefix > 32 || inet_pton(AF_INET, spec.c_str(), &address) != 1)
+    {
+        return false;
+    }
+    config.mPublicMask = prefix == 32 ? 0xFFFFFFFF : ~(0xFFFFFFFFu >> prefix);
+    config.mPublicNet = ntohl(address.s_addr) & config.mPublicMask;
+    config.mPublicIps.clear();
+    if (prefix >= 31)
+    {
+        for (uint32_t i = 0; i <= ~config.mPublicMask; ++i)
+        {
+            config.mPublicIps.push_back(config.mPublicNet + i);
+        }
+    }
+    else
+    {
+        for (uint32_t i = 1; i < ~config.mPublicMask; ++i)
+        {
+            config.mPublicIps.push_back(config.mPublicNet + i);
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        NatConfig config;
+        std::string device = "nat0";
+        std::string pool = "203.0.113.1";
+        size_t queues = 1;
+        size_t bench = 0;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg(argv[i]);
+            bool has_value = i + 1 < argc;
+            bool ok = has_value;
+            if (arg == "-d" && has_value)
+            {
+                device = argv[++i];
+            }
+            else if (arg == "-p" && has_value)
+            {
+                pool = argv[++i];
+            }
+            else if (arg == "-m" && has_value)
+            {
+                ok = ParseBehavior(argv[++i], "m", &config.mMapping);
+            }
+            else if (arg == "-f" && has_value)
+            {
+                ok = ParseBehavior(argv[++i], "f", &config.mFiltering);
+            }
+            else if (arg == "-a" && has_value)
+            {
+                std::string alloc(argv[++i]);
+                config.mAllocation = alloc == "random"     ? PortAllocation::Random
+                                     : alloc == "preserve" ? PortAllocation::Preserve
+                                                           : PortAllocation::Sequential;
+                ok = alloc == "seq" || alloc == "random" || alloc == "preserve";
+            }
+            else if (arg == "-t" && has_value)
+            {
+                config.mUdpTimeout = (uint32_t)std::max(1, std::atoi(argv[++i]));
+            }
+            else if (arg == "-q" && has_value)
+            {
+                queues = (size_t)std::max(1, std::atoi(argv[++i]));
+            }
+            else if (arg == "-b" && has_value)
+            {
+                bench = (size_t)std::max(1, std::atoi(argv[++i]));
+            }
+            else
+            {
+                ok = false;
+            }
+            if (!ok)
+            {
+                std::printf("usage: %s [-d dev] [-p public_ip[/len]] [-m eim|adm|apdm] [-f eif|adf|apdf]\n"
+                            "       [-a seq|random|preserve] [-t udp_timeout_sec] [-q queues] [-b bench_mappings]\n",
+                            argv[0]);
+                return 1;
+            }
+        }
+
+        /* 1.公開アドレスプール */
+        if (bench > 0 && pool == "203.0.113.1")
+        {
+            pool = "203.0.113.0/24"; // 1IPあたり約64kポートなので, 数百万マッピングには複数IPが要る
+        }
+        if (!ParsePublicPool(pool.c_str(), config))
+        {
+            std::printf("[Error] invalid public pool: %s\n", pool.c_str());
+            throw std::runtime_error("Public Pool");
+        }
+        const char *names[] = {"EI", "AD", "APD"};
+        std::printf("[Done] Step1. NAT %sM / %sF, pool %s (%zu IPs)\n",
+                    names[(int)config.mMapping], names[(int)config.mFiltering], pool.c_str(), config.mPublicIps.size());
+
+        if (bench > 0)
+        {
+            return RunBenchmark(config, bench, queues);
+        }
+
+        /* 2.TUNの作成 (キュー毎にfd) */
+        std::vector<socket_t> fds;
+        for (size_t q = 0; q < queues; ++q)
+        {
+            socket_t fd = OpenTun(device.c_str(), queues > 1);
+            if (fd < 0)
+            {
+                throw std::runtime_error("TUN");
+            }
+            fds.push_back(fd);
+        }
+        if (LinkUp(device.c_str()) < 0)
+        {
+            throw std::runtime_error("Link Up");
+        }
+        std::printf("[Done] Step2. open %s (%zu queues)\n", device.c_str(), queues);
+
+        /* 3.転送 */
+        signal(SIGINT, OnSignal);
+        signal(SIGTERM, OnSignal);
+        NatTable table(config);
+        std::vector<std::unique_ptr<NatStats>> stats;
+        std::vector<std::thread> workers;
+        for (size_t q = 0; q < queues; ++q)
+        {
+            stats.emplace_back(new NatStats);
+        }
+        for (size_t q = 0; q < queues; ++q)
+        {
+            workers.emplace_back(ForwardLoop, std::ref(table), fds[q], q, queues, std::ref(*stats[q]));
+        }
+
+        int tick = 0;
+        while (g_running.load())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (++tick % 50 == 0)
+            {
+                PrintStats(table, stats);
+            }
+        }
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+        PrintStats(table, stats);
+
+        // クローズ
+        for (socket_t fd : fds)
+        {
+            close(fd);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    return 0;
+}
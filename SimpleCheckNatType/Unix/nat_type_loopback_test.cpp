@@ -0,0 +1,253 @@
+/**
+ * @file nat_type_loopback_test.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief STUNサーバ(udp_ipv4_checker_in_wan_b)とNAT判定(udp_ipv4_from_lan_a_to_wan_b)をループバックで動かす試験 (Linux)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: nat_type_loopback_test <udp_ipv4_checker_in_wan_b> <udp_ipv4_from_lan_a_to_wan_b>
+ *
+ * + サーバを127.0.0.1と127.0.0.2(Linuxのloは127.0.0.0/8を全て受ける)の空きポートで起動する
+ * + CHANGE-REQUEST, OTHER-ADDRESS, RESPONSE-ORIGINが正しいかをBindingで直接確かめる
+ * + NATが無いので判定は「No NAT」と「EIF」になり, 1秒以内に終わる
+ * + 不正なポート(範囲外, 数字以外, P1 == P2)ではサーバが1で終わる
+ * NATを挟んだ判定はnat_type_netns_test(nat_emulator_tunとネットワーク名前空間, root)で確かめる.
+ */
+#include <test_utils.hpp>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <NetUtils/stun.hpp>
+
+#include <UdpSenderReciever/Unix/test_check.hpp>
+
+namespace
+{
+    // 127.0.0.1の空いているUDPポート
+    uint16_t FreePort()
+    {
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in self;
+        std::memset(&self, 0, sizeof(self));
+        self.sin_family = AF_INET;
+        self.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(self);
+        if (sock < 0 || bind(sock, (struct sockaddr *)&self, length) != 0 ||
+            getsockname(sock, (struct sockaddr *)&self, &length) != 0)
+        {
+            throw std::runtime_error("bind");
+        }
+        close(sock);
+        return ntohs(self.sin_port);
+    }
+
+    struct Binding
+    {
+        bool mAnswered = false;
+        struct sockaddr_storage mFrom;
+        struct sockaddr_storage mMapped;
+        struct sockaddr_storage mOther;
+        struct sockaddr_storage mOrigin;
+    };
+
+    // serverへBinding Requestを送り, 応答を待つ (100msおきに再送, timeout_msまで)
+    Binding Bind(const std::string &server, uint32_t change, int timeout_ms)
+    {
+        Binding result;
+        struct sockaddr_storage to;
+        if (!is::net::ParseEndpoint(server, 3478, &to))
+        {
+            throw std::runtime_error("ParseEndpoint");
+        }
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+        uint8_t request_buf[256];
+        uint8_t response_buf[2048];
+        is::net::StunTransactionId id = is::net::StunTransactionId::Random();
+        is::net::StunMessageWriter request(request_buf, sizeof(request_buf), is::net::kStunBindingRequest, id);
+        if (change != 0)
+        {
+            request.addUint32(is::net::kStunAttrChangeRequest, change);
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (!result.mAnswered && std::chrono::steady_clock::now() < deadline)
+        {
+            sendto(sock, request_buf, request.size(), 0, (struct sockaddr *)&to, is::net::EndpointLength((struct sockaddr *)&to));
+            struct pollfd target = {sock, POLLIN, 0};
+            if (poll(&target, 1, 100) <= 0)
+            {
+                continue;
+            }
+            socklen_t from_length = sizeof(result.mFrom);
+            ssize_t n = recvfrom(sock, response_buf, sizeof(response_buf), 0, (struct sockaddr *)&result.mFrom, &from_length);
+            is::net::StunMessageView response(response_buf, n > 0 ? (size_t)n : 0);
+            if (response.valid() && response.type() == is::net::kStunBindingSuccess && response.transactionId() == id &&
+                response.mappedAddress(&result.mMapped) &&
+                response.address(is::net::kStunAttrOtherAddress, &result.mOther, false) &&
+                response.address(is::net::kStunAttrResponseOrigin, &result.mOrigin, false))
+            {
+                result.mAnswered = true;
+            }
+        }
+        close(sock);
+        return result;
+    }
+
+    std::string Name(const struct sockaddr_storage &address)
+    {
+        return is::net::EndpointName((const struct sockaddr *)&address);
+    }
+
+    // 標準出力を捨ててプログラムを起動する
+    pid_t Spawn(const std::vector<std::string> &args)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            freopen("/dev/null", "w", stdout);
+            std::vector<char *> argv;
+            for (const std::string &arg : args)
+            {
+                argv.push_back(const_cast<char *>(arg.c_str()));
+            }
+            argv.push_back(nullptr);
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+        return pid;
+    }
+
+    // 終了コード (2秒で終わらなければ-1)
+    int ExitCode(pid_t pid)
+    {
+        for (int i = 0; i < 200; ++i)
+        {
+            int status = 0;
+            if (waitpid(pid, &status, WNOHANG) == pid)
+            {
+                return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        return -1;
+    }
+
+    std::string Run(const std::string &command)
+    {
+        std::string output;
+        FILE *pipe = popen(command.c_str(), "r");
+        if (pipe == nullptr)
+        {
+            throw std::runtime_error("popen");
+        }
+        char line[512];
+        while (std::fgets(line, sizeof(line), pipe) != nullptr)
+        {
+            output += line;
+        }
+        pclose(pipe);
+        return output;
+    }
+
+    void TestServer(const std::string &p1, const std::string &p2)
+    {
+        std::string primary = "127.0.0.1:" + p1;
+        Binding plain = Bind(primary, 0, 2000); // サーバの起動待ちを兼ねる
+        TEST_CHECK(plain.mAnswered);
+        TEST_CHECK(Name(plain.mFrom) == primary);
+        TEST_CHECK(Name(plain.mOrigin) == primary);
+        TEST_CHECK(Name(plain.mOther) == "127.0.0.2:" + p2);
+        TEST_CHECK(is::net::EndpointPort((struct sockaddr *)&plain.mMapped) != 0);
+
+        Binding both = Bind(primary, is::net::kStunChangeIp | is::net::kStunChangePort, 1000);
+        TEST_CHECK(both.mAnswered);
+        TEST_CHECK(Name(both.mFrom) == "127.0.0.2:" + p2);
+        TEST_CHECK(Name(both.mOrigin) == "127.0.0.2:" + p2);
+
+        Binding port_only = Bind(primary, is::net::kStunChangePort, 1000);
+        TEST_CHECK(port_only.mAnswered);
+        TEST_CHECK(Name(port_only.mFrom) == "127.0.0.1:" + p2);
+
+        Binding alternate = Bind("127.0.0.2:" + p1, 0, 1000);
+        TEST_CHECK(alternate.mAnswered);
+        TEST_CHECK(Name(alternate.mOther) == "127.0.0.1:" + p2);
+    }
+
+    void TestClassification(const std::string &client, const std::string &p1)
+    {
+        std::string output = Run(client + " 127.0.0.1:" + p1 + " 2>&1");
+        bool no_nat = output.find("[Result] mapping        : No NAT (open)") != std::string::npos;
+        bool eif = output.find("[Result] filtering      : Endpoint Independent Filtering (EIF)") != std::string::npos;
+        TEST_CHECK(no_nat);
+        TEST_CHECK(eif);
+        size_t at = output.find("[Status] elapsed ");
+        double elapsed_ms = at == std::string::npos ? 1e9 : std::atof(output.c_str() + at + 17);
+        TEST_CHECK(elapsed_ms < 1000.0);
+        if (!no_nat || !eif)
+        {
+            std::printf("%s", output.c_str());
+        }
+    }
+
+    void TestBadPorts(const std::string &server)
+    {
+        TEST_CHECK_EQ(ExitCode(Spawn({server, "127.0.0.1", "127.0.0.2", "70000"})), 1);
+        TEST_CHECK_EQ(ExitCode(Spawn({server, "127.0.0.1", "127.0.0.2", "3478x"})), 1);
+        TEST_CHECK_EQ(ExitCode(Spawn({server, "127.0.0.1", "127.0.0.2", "-1"})), 1);
+        TEST_CHECK_EQ(ExitCode(Spawn({server, "127.0.0.1", "127.0.0.2", "40000", "40000"})), 1);
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    pid_t server_pid = -1;
+    try
+    {
+        if (argc < 3)
+        {
+            std::printf("usage: %s <udp_ipv4_checker_in_wan_b> <udp_ipv4_from_lan_a_to_wan_b>\n", argv[0]);
+            return 1;
+        }
+        std::string server = argv[1];
+        std::string client = argv[2];
+
+        /* 1.サーバの起動 */
+        std::string p1 = std::to_string(FreePort());
+        std::string p2 = std::to_string(FreePort());
+        server_pid = Spawn({server, "127.0.0.1", "127.0.0.2", p1, p2});
+        std::printf("[Done] Step1. start STUN server on 127.0.0.1/127.0.0.2 : %s/%s\n", p1.c_str(), p2.c_str());
+
+        TestServer(p1, p2);
+        std::printf("[Done] Step2. binding responses and CHANGE-REQUEST\n");
+        TestClassification(client, p1);
+        std::printf("[Done] Step3. classification without NAT\n");
+        TestBadPorts(server);
+        std::printf("[Done] Step4. invalid ports are rejected\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        ++TestFailures();
+    }
+    if (server_pid > 0)
+    {
+        kill(server_pid, SIGTERM);
+        waitpid(server_pid, nullptr, 0);
+    }
+    std::printf("[Result] %d failures\n", TestFailures());
+    return TestFailures() == 0 ? 0 : 1;
+}
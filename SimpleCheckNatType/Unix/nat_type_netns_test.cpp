@@ -0,0 +1,249 @@
+/**
+ * @file nat_type_netns_test.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief ネットワーク名前空間 lan / nat / wan の間にnat_emulator_tunを挟み, NAT判定の結果を確かめる (Linux, root)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: nat_type_netns_test <nat_emulator_tun> <udp_ipv4_checker_in_wan_b> <udp_ipv4_from_lan_a_to_wan_b>
+ *
+ * 構成 (名前空間の名前はプロセスID付きで毎回作って消す)
+ * ```
+ * [lan] 10.77.0.2 -- 10.77.0.1 [nat: nat0 = 203.0.113.1] 192.0.2.1 -- 192.0.2.2, 192.0.2.3 [wan: STUNサーバ]
+ * ```
+ * NATのマッピング/フィルタリングを eim/eif, adm/adf, apdm/apdf に切り替え, 判定が一致して1秒以内に終わるか.
+ * rootでない, または名前空間やTUNが使えなければ77を返す(ctestではスキップ).
+ */
+#include <test_utils.hpp>
+
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <UdpSenderReciever/Unix/test_check.hpp>
+
+namespace
+{
+    constexpr int kSkip = 77;
+
+    int Sh(const std::string &command)
+    {
+        int status = std::system((command + " >/dev/null 2>&1").c_str());
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+
+    std::string Capture(const std::string &command)
+    {
+        std::string output;
+        FILE *pipe = popen((command + " 2>&1").c_str(), "r");
+        if (pipe == nullptr)
+        {
+            throw std::runtime_error("popen");
+        }
+        char line[512];
+        while (std::fgets(line, sizeof(line), pipe) != nullptr)
+        {
+            output += line;
+        }
+        pclose(pipe);
+        return output;
+    }
+
+    // 名前空間の中でプログラムを起動する (ip netns execはexecするのでpidはプログラムのもの)
+    pid_t SpawnIn(const std::string &ns, const std::vector<std::string> &args)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            freopen("/dev/null", "w", stdout);
+            freopen("/dev/null", "w", stderr);
+            std::vector<std::string> all = {"ip", "netns", "exec", ns};
+            all.insert(all.end(), args.begin(), args.end());
+            std::vector<char *> argv;
+            for (const std::string &arg : all)
+            {
+                argv.push_back(const_cast<char *>(arg.c_str()));
+            }
+            argv.push_back(nullptr);
+            execvp("ip", argv.data());
+            _exit(127);
+        }
+        return pid;
+    }
+
+    void Stop(pid_t pid)
+    {
+        if (pid > 0)
+        {
+            kill(pid, SIGTERM);
+            waitpid(pid, nullptr, 0);
+        }
+    }
+
+    // lan / nat / wan の3つの名前空間
+    class Topology
+    {
+    public:
+        Topology()
+        {
+            std::string s = "t" + std::to_string(getpid() % 100000);
+            mLan = s + "l";
+            mNat = s + "n";
+            mWan = s + "w";
+            mLanLink = s + "a";
+            mNatLan = s + "b";
+            mNatWan = s + "c";
+            mWanLink = s + "d";
+        }
+        ~Topology() { destroy(); }
+
+        bool create()
+        {
+            for (const std::string *ns : {&mLan, &mNat, &mWan})
+            {
+                if (Sh("ip netns add " + *ns) != 0)
+                {
+                    return false;
+                }
+                mCreated.push_back(*ns);
+                Sh("ip -n " + *ns + " link set lo up");
+            }
+            const char *nat_sysctl = " sysctl -qw net.ipv4.ip_forward=1 net.ipv4.conf.all.rp_filter=0 net.ipv4.conf.default.rp_filter=0";
+            std::vector<std::string> commands = {
+                "ip link add " + mLanLink + " netns " + mLan + " type veth peer name " + mNatLan + " netns " + mNat,
+                "ip link add " + mNatWan + " netns " + mNat + " type veth peer name " + mWanLink + " netns " + mWan,
+                "ip -n " + mLan + " addr add 10.77.0.2/24 dev " + mLanLink,
+                "ip -n " + mLan + " link set " + mLanLink + " up",
+                "ip -n " + mLan + " route add default via 10.77.0.1",
+                "ip -n " + mNat + " addr add 10.77.0.1/24 dev " + mNatLan,
+                "ip -n " + mNat + " link set " + mNatLan + " up",
+                "ip -n " + mNat + " addr add 192.0.2.1/24 dev " + mNatWan,
+                "ip -n " + mNat + " link set " + mNatWan + " up",
+                "ip -n " + mWan + " addr add 192.0.2.2/24 dev " + mWanLink,
+                "ip -n " + mWan + " addr add 192.0.2.3/24 dev " + mWanLink,
+                "ip -n " + mWan + " link set " + mWanLink + " up",
+                "ip -n " + mWan + " route add 203.0.113.0/24 via 192.0.2.1",
+                "ip netns exec " + mNat + nat_sysctl,
+                // LAN側から来たパケットはTUNへ (公開プール宛ても)
+                "ip -n " + mNat + " rule add iif " + mNatLan + " lookup 100",
+            };
+            for (const std::string &command : commands)
+            {
+                if (Sh(command) != 0)
+                {
+                    std::printf("[Error] %s\n", command.c_str());
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // TUN(nat0)ができてから経路を張る. nat0が消えると経路も消えるのでNATを起動する度に呼ぶ
+        bool routeThroughTun()
+        {
+            for (int i = 0; i < 200 && Sh("ip -n " + mNat + " link show nat0") != 0; ++i)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            return Sh("ip netns exec " + mNat + " sysctl -qw net.ipv4.conf.nat0.rp_filter=0") == 0 &&
+                   Sh("ip -n " + mNat + " route add 203.0.113.0/24 dev nat0") == 0 &&
+                   Sh("ip -n " + mNat + " route add default dev nat0 table 100") == 0;
+        }
+
+        void destroy()
+        {
+            for (const std::string &ns : mCreated)
+            {
+                Sh("ip netns del " + ns);
+            }
+            mCreated.clear();
+        }
+
+        std::string mLan, mNat, mWan;
+
+    private:
+        std::string mLanLink, mNatLan, mNatWan, mWanLink;
+        std::vector<std::string> mCreated;
+    };
+
+    void TestBehavior(Topology &topology, const std::string &emulator, const std::string &client,
+                      const char *mapping, const char *filtering, const char *expected_mapping, const char *expected_filtering)
+    {
+        pid_t nat = SpawnIn(topology.mNat, {emulator, "-d", "nat0", "-p", "203.0.113.1", "-m", mapping, "-f", filtering});
+        TEST_CHECK(topology.routeThroughTun());
+        std::string output = Capture("ip netns exec " + topology.mLan + " " + client + " 192.0.2.2:3478");
+        Stop(nat);
+
+        bool mapping_ok = output.find(std::string("[Result] mapping        : ") + expected_mapping) != std::string::npos;
+        bool filtering_ok = output.find(std::string("[Result] filtering      : ") + expected_filtering) != std::string::npos;
+        bool translated = output.find("[Result] mapped address : 203.0.113.1:") != std::string::npos;
+        TEST_CHECK(mapping_ok);
+        TEST_CHECK(filtering_ok);
+        TEST_CHECK(translated);
+        size_t at = output.find("[Status] elapsed ");
+        double elapsed_ms = at == std::string::npos ? 1e9 : std::atof(output.c_str() + at + 17);
+        TEST_CHECK(elapsed_ms < 1000.0);
+        if (!mapping_ok || !filtering_ok || !translated)
+        {
+            std::printf("%s", output.c_str());
+        }
+        std::printf("  %s/%s -> %s / %s (%.1f ms)\n", mapping, filtering, expected_mapping, expected_filtering, elapsed_ms);
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        std::printf("usage: %s <nat_emulator_tun> <udp_ipv4_checker_in_wan_b> <udp_ipv4_from_lan_a_to_wan_b>\n", argv[0]);
+        return 1;
+    }
+    if (geteuid() != 0 || access("/dev/net/tun", R_OK | W_OK) != 0 || Sh("ip -V") != 0)
+    {
+        std::printf("[Skip] needs root, /dev/net/tun and iproute2\n");
+        return kSkip;
+    }
+
+    pid_t server = -1;
+    try
+    {
+        Topology topology;
+        if (!topology.create())
+        {
+            std::printf("[Skip] cannot create network namespaces\n");
+            return kSkip;
+        }
+        std::printf("[Done] Step1. create namespaces %s / %s / %s\n",
+                    topology.mLan.c_str(), topology.mNat.c_str(), topology.mWan.c_str());
+
+        server = SpawnIn(topology.mWan, {argv[2], "192.0.2.2", "192.0.2.3", "3478", "3479"});
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        std::printf("[Done] Step2. start STUN server in %s\n", topology.mWan.c_str());
+
+        TestBehavior(topology, argv[1], argv[3], "eim", "eif",
+                     "Endpoint Independent Mapping (EIM, type A)", "Endpoint Independent Filtering (EIF)");
+        TestBehavior(topology, argv[1], argv[3], "adm", "adf",
+                     "Address Dependent Mapping (ADM, type B)", "Address Dependent Filtering (ADF)");
+        TestBehavior(topology, argv[1], argv[3], "apdm", "apdf",
+                     "Address and Port Dependent Mapping (APDM, type C)", "Address and Port Dependent Filtering (APDF)");
+        TestBehavior(topology, argv[1], argv[3], "eim", "apdf",
+                     "Endpoint Independent Mapping (EIM, type A)", "Address and Port Dependent Filtering (APDF)");
+        std::printf("[Done] Step3. classify emulated NATs\n");
+        Stop(server);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        Stop(server);
+        ++TestFailures();
+    }
+    std::printf("[Result] %d failures\n", TestFailures());
+    return TestFailures() == 0 ? 0 : 1;
+}
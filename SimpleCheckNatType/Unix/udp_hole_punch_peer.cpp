@@ -0,0 +1,143 @@
+/**
+ * @file udp_hole_punch_peer.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief ランデブー(WAN B)経由でホールパンチングし, 相手ピアと直接メッセージを交換する
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * LAN A とWAN C(または別のNAT配下)で互いのIDを指定して同時に起動する.
+ * ```
+ * (LAN A) udp_hole_punch_peer <B> alice bob
+ * (WAN C) udp_hole_punch_peer <B> bob alice
+ * ```
+ * 開通後は1秒毎にメッセージを送り, 無通信が続いたらNATのマッピング寿命
+ * (`-l`, udp_nat_lifetime_proberなどで測った値)に合わせた間隔でキープアライブを送る.
+ *
+ * usage: udp_hole_punch_peer <rendezvous[:port]> <self_id> <peer_id> [-l lifetime_sec] [-p local_port] [-n count]
+ */
+#include <test_utils.hpp>
+
+// udp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <chrono>
+
+#include <NetUtils/hole_punch.hpp>
+
+#define BUFSIZE 2048
+
+using steady_clock = std::chrono::steady_clock;
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        if (argc < 4)
+        {
+            std::printf("usage: %s <rendezvous[:port]> <self_id> <peer_id> [-l lifetime_sec] [-p local_port] [-n count]\n", argv[0]);
+            return 1;
+        }
+        is::net::HolePunchOptions options;
+        int count = 5;
+        for (int i = 4; i + 1 < argc; i += 2)
+        {
+            std::string opt(argv[i]);
+            if (opt == "-l")
+            {
+                options.mBindingLifetimeSec = std::max(1, std::atoi(argv[i + 1]));
+            }
+            else if (opt == "-p")
+            {
+                if (!is::net::ParsePort(argv[i + 1], &options.mLocalPort))
+                {
+                    std::printf("[Error] invalid port: %s\n", argv[i + 1]);
+                    return 1;
+                }
+            }
+            else if (opt == "-n")
+            {
+                count = std::atoi(argv[i + 1]);
+            }
+        }
+
+        /* 1.ホールパンチング */
+        steady_clock::time_point start = steady_clock::now();
+        is::net::HolePunchResult punch;
+        int ret = is::net::HolePunchConnect(argv[1], argv[2], argv[3], options, &punch);
+        if (ret != 0)
+        {
+            std::printf("[Error] hole punching failed: %d\n", ret);
+            throw std::runtime_error("HolePunchConnect");
+        }
+        double elapsed_ms = std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+        std::printf("[Done] Step1. connected %s -> %s (mapped %s, rtt %.2f ms, %.1f ms, keepalive %d s)\n",
+                    argv[2], is::net::EndpointName((const struct sockaddr *)&punch.mPeer).c_str(),
+                    is::net::EndpointName((const struct sockaddr *)&punch.mMapped).c_str(),
+                    punch.mRttMs, elapsed_ms, punch.mKeepaliveSec);
+
+        /* 2.メッセージ交換 */
+        uint8_t buf[BUFSIZE];
+        steady_clock::time_point next_send = steady_clock::now();
+        steady_clock::time_point last_send = next_send;
+        int sent = 0;
+        int received = 0;
+        while (sent < count || steady_clock::now() < last_send + std::chrono::seconds(1))
+        {
+            steady_clock::time_point now = steady_clock::now();
+            if (sent < count && now >= next_send)
+            {
+                std::string message = "HELLO " + std::to_string(sent) + " from " + argv[2];
+                if (send(punch.mSocket, message.data(), message.size(), 0) < 0)
+                {
+                    std::printf("[Error] send: %s\n", strerror(errno));
+                }
+                ++sent;
+                last_send = now;
+                next_send = now + std::chrono::seconds(1);
+            }
+            else if (sent >= count && now >= last_send + std::chrono::seconds(punch.mKeepaliveSec))
+            {
+                is::net::SendKeepalive(punch.mSocket); // 無通信時のみ
+                last_send = now;
+            }
+
+            struct pollfd target;
+            target.fd = punch.mSocket;
+            target.events = POLLIN;
+            target.revents = 0;
+            if (poll(&target, 1, 100) <= 0)
+            {
+                continue;
+            }
+            ssize_t n = recv(punch.mSocket, buf, sizeof(buf) - 1, 0);
+            if (n < 0)
+            {
+                std::printf("[Error] recv: %s\n", strerror(errno)); // ICMP Port Unreachableなど
+                continue;
+            }
+            if (is::net::IsHolePunchControl(buf, (size_t)n))
+            {
+                continue; // 相手の再送Checkやキープアライブ
+            }
+            buf[n] = '\0';
+            ++received;
+            std::printf("Recv: %s\n", (const char *)buf);
+        }
+        std::printf("[Done] Step2. sent %d, received %d\n", sent, received);
+
+        // クローズ
+        close(punch.mSocket);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    return 0;
+}
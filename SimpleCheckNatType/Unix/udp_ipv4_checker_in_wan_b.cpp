@@ -1,10 +1,230 @@
 /**
  * @file udp_ipv4_checker_in_wan_b.cpp
  * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
- * @brief 
+ * @brief WAN B側のNAT判定用STUNサーバ (RFC 5389 Binding / RFC 5780 CHANGE-REQUEST)
  * @version 0.1
  * @date 2023-05-19
- * 
+ *
  * @copyright Copyright (c) 2023
- * 
- */
\ No newline at end of file
+ *
+ * 2つのIPアドレス(A1, A2)と2つのポート(P1, P2)の組み合わせ4つでUDPソケットを待ち受ける.
+ * ```
+ *          P1          P2
+ * A1  [A1:P1](主)  [A1:P2]
+ * A2  [A2:P1]      [A2:P2](OTHER-ADDRESS)
+ * ```
+ * Binding Requestを受けたら, CHANGE-REQUESTで指定されたIP/ポートのソケットから
+ * XOR-MAPPED-ADDRESS(クライアントのNAT変換後アドレス)を返す.
+ * 独自属性RESPONSE-DESTINATIONがあれば, 同じNATの別マッピングへ応答を送る(udp_nat_lifetime_prober用).
+ *
+ * usage: udp_ipv4_checker_in_wan_b <A1> <A2> [P1=3478] [P2=3479]
+ */
+#include <test_utils.hpp>
+
+// udp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h> // getaddrinfo, getnameinfo
+#include <netinet/in.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <NetUtils/stun.hpp>
+
+#if defined(__linux__)
+
+#elif defined(__MACH__)
+
+#else
+// Windows
+#endif
+
+#define BUFSIZE 2048
+
+using socket_t = int;
+
+// [IP][Port]のソケットと待受アドレス
+socket_t stun_sockets[2][2];
+struct sockaddr_storage stun_addresses[2][2];
+uint8_t buf[BUFSIZE];
+uint8_t sbuf[BUFSIZE];
+
+/* Binding Requestへの応答 */
+static void HandleRequest(int ip_index, int port_index, const uint8_t *data, int nbytes,
+                          const struct sockaddr_storage &client)
+{
+    is::net::StunMessageView request(data, (size_t)nbytes);
+    if (!request.valid() || request.type() != is::net::kStunBindingRequest)
+    {
+        return; // STUN以外, またはBinding Request以外は捨てる
+    }
+
+    // CHANGE-REQUEST: 応答に使うソケットを切り替える
+    uint32_t change = request.attributeUint32(is::net::kStunAttrChangeRequest, 0);
+    int reply_ip = (change & is::net::kStunChangeIp) ? 1 - ip_index : ip_index;
+    int reply_port = (change & is::net::kStunChangePort) ? 1 - port_index : port_index;
+
+    // RESPONSE-PORT: 応答の宛先ポートを変える (フィルタリングの追加試験用)
+    struct sockaddr_storage reply_to = client;
+    if (request.hasAttribute(is::net::kStunAttrResponsePort))
+    {
+        uint16_t port = (uint16_t)(request.attributeUint32(is::net::kStunAttrResponsePort) >> 16);
+        is::net::SetEndpointPort((struct sockaddr *)&reply_to, port);
+    }
+
+    // RESPONSE-DESTINATION: 別のマッピング宛てに応答する (マッピング寿命の測定用).
+    // 反射攻撃に使われないよう, 要求元と同じIP(同じNATの公開アドレス)だけを受け付ける.
+    struct sockaddr_storage destination;
+    if (request.address(is::net::kStunAttrResponseDestination, &destination, true) &&
+        is::net::SameAddress((const struct sockaddr *)&destination, (const struct sockaddr *)&client))
+    {
+        reply_to = destination;
+    }
+
+    is::net::StunMessageWriter response(sbuf, sizeof(sbuf), is::net::kStunBindingSuccess, request.transactionId());
+    response.addAddress(is::net::kStunAttrXorMappedAddress, (const struct sockaddr *)&client, true);
+    response.addAddress(is::net::kStunAttrMappedAddress, (const struct sockaddr *)&client, false);
+    response.addAddress(is::net::kStunAttrResponseOrigin, (const struct sockaddr *)&stun_addresses[reply_ip][reply_port], false);
+    response.addAddress(is::net::kStunAttrOtherAddress, (const struct sockaddr *)&stun_addresses[1 - ip_index][1 - port_index], false);
+    const char software[] = "IPNetWeb checker";
+    response.addAttribute(is::net::kStunAttrSoftware, software, sizeof(software) - 1);
+
+    ssize_t n = sendto(stun_sockets[reply_ip][reply_port],
+                   sbuf,
+                   response.size(),
+                   0,
+                   (const struct sockaddr *)&reply_to,
+                   is::net::EndpointLength((const struct sockaddr *)&reply_to));
+    if (n < 0)
+    {
+        std::printf("[Error] sendto %s: %s\n",
+                    is::net::EndpointName((const struct sockaddr *)&reply_to).c_str(), strerror(errno));
+        return;
+    }
+
+    std::printf("Binding from %s -> reply via %s%s%s\n",
+                is::net::EndpointName((const struct sockaddr *)&client).c_str(),
+                is::net::EndpointName((const struct sockaddr *)&stun_addresses[reply_ip][reply_port]).c_str(),
+                (change & is::net::kStunChangeIp) ? " [change ip]" : "",
+                (change & is::net::kStunChangePort) ? " [change port]" : "");
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        if (argc < 3)
+        {
+            std::printf("usage: %s <primary_ip> <alternate_ip> [primary_port] [alternate_port]\n", argv[0]);
+            return 1;
+        }
+        uint16_t ports[2] = {3478, 3479};
+        for (int i = 0; i < 2 && 3 + i < argc; ++i)
+        {
+            if (!is::net::ParsePort(argv[3 + i], &ports[i]) || ports[i] == 0)
+            {
+                std::printf("[Error] invalid port: %s\n", argv[3 + i]);
+                return 1;
+            }
+        }
+        if (ports[0] == ports[1])
+        {
+            std::printf("[Error] primary and alternate ports must differ: %u\n", ports[0]);
+            return 1;
+        }
+
+        /* 1.待受アドレスの確定 */
+        for (int ip = 0; ip < 2; ++ip)
+        {
+            for (int port = 0; port < 2; ++port)
+            {
+                if (!is::net::ParseEndpoint(argv[1 + ip], ports[port], &stun_addresses[ip][port]))
+                {
+                    std::printf("[Error] not an IP address: %s\n", argv[1 + ip]);
+                    throw std::runtime_error("Resolve IP Address");
+                }
+            }
+        }
+        std::printf("[Done] Step1. configure addresses\n");
+
+        /* 2.ソケットの作成とbind */
+        for (int ip = 0; ip < 2; ++ip)
+        {
+            for (int port = 0; port < 2; ++port)
+            {
+                struct sockaddr *address = (struct sockaddr *)&stun_addresses[ip][port];
+                if ((stun_sockets[ip][port] = socket(address->sa_family, SOCK_DGRAM, 0)) < 0)
+                {
+                    std::printf("[Error] %s\n", strerror(errno));
+                    throw std::runtime_error("socket");
+                }
+                if (bind(stun_sockets[ip][port], address, is::net::EndpointLength(address)) != 0)
+                {
+                    std::printf("[Error] %s: %s\n", is::net::EndpointName(address).c_str(), strerror(errno));
+                    throw std::runtime_error("bind");
+                }
+                std::printf("Listen %s\n", is::net::EndpointName(address).c_str());
+            }
+        }
+        std::printf("[Done] Step2. bind sockets\n");
+
+        /* 3.I/Oの多重化 */
+        struct pollfd targets[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            targets[i].fd = stun_sockets[i / 2][i % 2];
+            targets[i].events = POLLIN | POLLERR;
+            targets[i].revents = 0;
+        }
+
+        while (true)
+        {
+            int nready = poll(targets, 4, -1);
+            if (nready == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                std::printf("[Error] poll: %s\n", strerror(errno));
+                break;
+            }
+
+            for (int i = 0; i < 4; ++i)
+            {
+                if (!(targets[i].revents & POLLIN))
+                {
+                    continue;
+                }
+
+                /* 4.クライアントからの受信 */
+                struct sockaddr_storage client;
+                socklen_t client_length = sizeof(client);
+                ssize_t n = recvfrom(targets[i].fd, buf, sizeof(buf), 0,
+                                 (struct sockaddr *)&client, &client_length);
+                if (n < 0)
+                {
+                    std::printf("[Error] recvfrom: %s\n", strerror(errno));
+                    continue;
+                }
+
+                /* 5.応答 */
+                HandleRequest(i / 2, i % 2, buf, (int)n, client);
+            }
+        }
+
+        // クローズ
+        for (int i = 0; i < 4; ++i)
+        {
+            close(stun_sockets[i / 2][i % 2]);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -1,12 +1,26 @@
 /**
  * @file udp_ipv4_from_lan_a_to_wan_b.cpp
  * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
- * @brief 
+ * @brief LAN A側からWAN BのSTUNサーバに問い合わせてNATの振る舞いを判定する (RFC 5780)
  * @version 0.1
  * @date 2023-05-19
- * 
+ *
  * @copyright Copyright (c) 2023
- * 
+ *
+ * マッピング判定 (ソケットS1)
+ * + Test I   : A1:P1 へBinding -> X1 (OTHER-ADDRESSからA2:P2を知る)
+ * + Test II  : A2:P1 へBinding -> X2. X1 == X2 なら EIM
+ * + Test III : A2:P2 へBinding -> X3. X2 == X3 なら ADM, 異なれば APDM
+ *
+ * フィルタリング判定 (別ソケットS2. マッピング判定で開いた穴の影響を受けない)
+ * + Test I   : A1:P1 へBinding
+ * + Test II  : CHANGE-REQUEST(IP+Port) 応答が届けば EIF
+ * + Test III : CHANGE-REQUEST(Port)    応答が届けば ADF, 届かなければ APDF
+ *
+ * S1とS2の試験は並行に進め, 各リクエストはRTO(初期100ms, 倍々)で再送する.
+ * 届かない応答を待つ時間はTest Iの実測RTTから決めるので, 全体で1秒以内に終わる.
+ *
+ * usage: udp_ipv4_from_lan_a_to_wan_b <A1[:P1]> [-l listen_sec]
  */
 #include <test_utils.hpp>
 
@@ -18,5 +32,457 @@
 #include <netinet/in.h>
 #include <errno.h>
 #include <poll.h>
+#include <unistd.h>
+#include <chrono>
+#include <algorithm>
 
+#include <NetUtils/stun.hpp>
 
+#define BUFSIZE 2048
+
+using socket_t = int;
+using steady_clock = std::chrono::steady_clock;
+
+// 1つのBindingトランザクション
+struct StunProbe
+{
+    const char *mName;
+    socket_t mSocket = -1;
+    struct sockaddr_storage mDestination;
+    uint32_t mChangeRequest = 0;
+    is::net::StunTransactionId mId;
+    bool mStarted = false;
+    bool mAnswered = false;
+    int mSendCount = 0;
+    std::chrono::milliseconds mRto{100};
+    steady_clock::time_point mFirstSend;
+    steady_clock::time_point mNextSend;
+    double mRttMs = -1.0;
+    struct sockaddr_storage mMapped;         // XOR-MAPPED-ADDRESS
+    struct sockaddr_storage mOtherAddress;   // OTHER-ADDRESS
+    struct sockaddr_storage mResponseOrigin; // 応答の送信元
+    bool mHasOtherAddress = false;
+};
+
+enum class MappingType
+{
+    Unknown,
+    NoNat,
+    EndpointIndependent,
+    AddressDependent,
+    AddressAndPortDependent,
+};
+
+enum class FilteringType
+{
+    Unknown,
+    EndpointIndependent,
+    AddressDependent,
+    AddressAndPortDependent,
+};
+
+uint8_t buf[BUFSIZE];
+uint8_t sbuf[BUFSIZE];
+
+/* Binding Requestの送信 (初回/再送) */
+static void SendProbe(StunProbe &probe, steady_clock::time_point now)
+{
+    is::net::StunMessageWriter request(sbuf, sizeof(sbuf), is::net::kStunBindingRequest, probe.mId);
+    if (probe.mChangeRequest != 0)
+    {
+        request.addUint32(is::net::kStunAttrChangeRequest, probe.mChangeRequest);
+    }
+
+    ssize_t n = sendto(probe.mSocket, sbuf, request.size(), 0,
+                   (const struct sockaddr *)&probe.mDestination,
+                   is::net::EndpointLength((const struct sockaddr *)&probe.mDestination));
+    if (n < 0)
+    {
+        std::printf("[Error] sendto %s: %s\n", probe.mName, strerror(errno));
+    }
+
+    if (!probe.mStarted)
+    {
+        probe.mStarted = true;
+        probe.mFirstSend = now;
+    }
+    else
+    {
+        probe.mRto *= 2; // RFC 5389 7.2.1 再送ごとにRTOを倍にする
+    }
+    probe.mSendCount++;
+    probe.mNextSend = now + probe.mRto;
+}
+
+static void StartProbe(StunProbe &probe, const char *name, socket_t sock,
+                       const struct sockaddr_storage &destination, uint32_t change_request,
+                       steady_clock::time_point now)
+{
+    probe.mName = name;
+    probe.mSocket = sock;
+    probe.mDestination = destination;
+    probe.mChangeRequest = change_request;
+    probe.mId = is::net::StunTransactionId::Random();
+    SendProbe(probe, now);
+}
+
+/* 応答をトランザクションに対応付ける */
+static void HandleResponse(std::vector<StunProbe *> &probes, socket_t sock,
+                           const uint8_t *data, int nbytes,
+                           const struct sockaddr_storage &from, steady_clock::time_point now)
+{
+    is::net::StunMessageView response(data, (size_t)nbytes);
+    if (!response.valid() || response.type() != is::net::kStunBindingSuccess)
+    {
+        return;
+    }
+
+    for (StunProbe *probe : probes)
+    {
+        if (!probe->mStarted || probe->mAnswered || probe->mSocket != sock ||
+            probe->mId != response.transactionId())
+        {
+            continue;
+        }
+        if (!response.mappedAddress(&probe->mMapped))
+        {
+            return;
+        }
+        probe->mAnswered = true;
+        probe->mRttMs = std::chrono::duration<double, std::milli>(now - probe->mFirstSend).count();
+        probe->mResponseOrigin = from;
+        probe->mHasOtherAddress = response.address(is::net::kStunAttrOtherAddress, &probe->mOtherAddress, false);
+        return;
+    }
+}
+
+static socket_t OpenSocket(int family)
+{
+    socket_t sock = socket(family, SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+        std::printf("[Error] %s\n", strerror(errno));
+        throw std::runtime_error("socket");
+    }
+
+    struct sockaddr_storage self;
+    std::memset(&self, 0, sizeof(self));
+    self.ss_family = (sa_family_t)family; // ANY, ポートはカーネルに任せる
+    if (bind(sock, (struct sockaddr *)&self, is::net::EndpointLength((struct sockaddr *)&self)) != 0)
+    {
+        std::printf("[Error] %s\n", strerror(errno));
+        throw std::runtime_error("bind");
+    }
+    return sock;
+}
+
+/* ローカル側のエンドポイント (NATが無ければマッピングと一致する) */
+static struct sockaddr_storage LocalEndpoint(socket_t sock, const struct sockaddr_storage &server)
+{
+    struct sockaddr_storage local;
+    socklen_t length = sizeof(local);
+    getsockname(sock, (struct sockaddr *)&local, &length);
+    uint16_t port = is::net::EndpointPort((struct sockaddr *)&local);
+
+    // 経路上の送信元アドレスはconnectしたUDPソケットで調べる(パケットは出ない)
+    socket_t probe = socket(server.ss_family, SOCK_DGRAM, 0);
+    if (probe >= 0)
+    {
+        if (connect(probe, (const struct sockaddr *)&server, is::net::EndpointLength((const struct sockaddr *)&server)) == 0)
+        {
+            length = sizeof(local);
+            getsockname(probe, (struct sockaddr *)&local, &length);
+        }
+        close(probe);
+    }
+    is::net::SetEndpointPort((struct sockaddr *)&local, port);
+    return local;
+}
+
+static const char *MappingName(MappingType type)
+{
+    switch (type)
+    {
+    case MappingType::NoNat:
+        return "No NAT (open)";
+    case MappingType::EndpointIndependent:
+        return "Endpoint Independent Mapping (EIM, type A)";
+    case MappingType::AddressDependent:
+        return "Address Dependent Mapping (ADM, type B)";
+    case MappingType::AddressAndPortDependent:
+        return "Address and Port Dependent Mapping (APDM, type C)";
+    default:
+        return "Unknown";
+    }
+}
+
+static const char *FilteringName(FilteringType type)
+{
+    switch (type)
+    {
+    case FilteringType::EndpointIndependent:
+        return "Endpoint Independent Filtering (EIF)";
+    case FilteringType::AddressDependent:
+        return "Address Dependent Filtering (ADF)";
+    case FilteringType::AddressAndPortDependent:
+        return "Address and Port Dependent Filtering (APDF)";
+    default:
+        return "Unknown";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    socket_t mapping_socket = -1;
+    socket_t filtering_socket = -1;
+
+    try
+    {
+        if (argc < 2)
+        {
+            std::printf("usage: %s <server_ip[:port]> [-l listen_sec]\n", argv[0]);
+            return 1;
+        }
+        int listen_sec = 0;
+        for (int i = 2; i + 1 < argc; ++i)
+        {
+            if (std::string(argv[i]) == "-l")
+            {
+                listen_sec = std::atoi(argv[++i]);
+            }
+        }
+
+        /* 1.サーバ(A1:P1)の確定 */
+        struct sockaddr_storage server;
+        if (!is::net::ParseEndpoint(argv[1], 3478, &server))
+        {
+            std::printf("[Error] not an IP address: %s\n", argv[1]);
+            throw std::runtime_error("Resolve IP Address");
+        }
+        std::printf("[Done] Step1. configure server: %s\n", is::net::EndpointName((struct sockaddr *)&server).c_str());
+
+        /* 2.ソケットの作成 */
+        mapping_socket = OpenSocket(server.ss_family);
+        filtering_socket = OpenSocket(server.ss_family);
+        struct sockaddr_storage local = LocalEndpoint(mapping_socket, server);
+        std::printf("[Done] Step2. create sockets; local %s\n", is::net::EndpointName((struct sockaddr *)&local).c_str());
+
+        /* 3.マッピング試験とフィルタリング試験を並行して開始 */
+        StunProbe mapping1, mapping2, mapping3;
+        StunProbe filtering1, filtering2, filtering3;
+        std::vector<StunProbe *> probes = {&mapping1, &mapping2, &mapping3, &filtering1, &filtering2, &filtering3};
+
+        auto start = steady_clock::now();
+        auto deadline = start + std::chrono::milliseconds(900); // 全体の上限
+        steady_clock::time_point filtering_deadline = deadline;  // 届かない応答の待ち時間
+        bool filtering_deadline_fixed = false;
+
+        StartProbe(mapping1, "mapping I", mapping_socket, server, 0, start);
+        StartProbe(filtering1, "filtering I", filtering_socket, server, 0, start);
+        StartProbe(filtering2, "filtering II", filtering_socket, server,
+                   is::net::kStunChangeIp | is::net::kStunChangePort, start);
+        StartProbe(filtering3, "filtering III", filtering_socket, server, is::net::kStunChangePort, start);
+
+        struct pollfd targets[2];
+        targets[0].fd = mapping_socket;
+        targets[1].fd = filtering_socket;
+
+        while (true)
+        {
+            auto now = steady_clock::now();
+
+            // Test Iの応答でOTHER-ADDRESSが分かったらTest II/IIIを同時に開始
+            if (mapping1.mAnswered && !mapping2.mStarted && mapping1.mHasOtherAddress)
+            {
+                struct sockaddr_storage alternate_p1 = mapping1.mOtherAddress; // A2:P1
+                is::net::SetEndpointPort((struct sockaddr *)&alternate_p1,
+                                         is::net::EndpointPort((struct sockaddr *)&server));
+                StartProbe(mapping2, "mapping II", mapping_socket, alternate_p1, 0, now);
+                StartProbe(mapping3, "mapping III", mapping_socket, mapping1.mOtherAddress, 0, now);
+            }
+
+            // フィルタリングの判定待ち時間: Test Iの実測RTTの4倍(最低150ms)
+            if (filtering1.mAnswered && !filtering_deadline_fixed)
+            {
+                auto grace = std::chrono::milliseconds(std::max(150, (int)(filtering1.mRttMs * 4)));
+                filtering_deadline = std::min(deadline, now + grace);
+                filtering_deadline_fixed = true;
+            }
+
+            bool mapping_done = mapping1.mAnswered ? (!mapping1.mHasOtherAddress ||
+                                                      (mapping2.mAnswered && mapping3.mAnswered))
+                                                   : false;
+            // EIFなら即確定. それ以外は待ち時間が過ぎるまでII/IIIの応答を待つ.
+            bool filtering_done = filtering1.mAnswered &&
+                                  (filtering2.mAnswered || now >= filtering_deadline);
+            if ((mapping_done && filtering_done) || now >= deadline)
+            {
+                break;
+            }
+
+            // 次の再送時刻まで待つ
+            auto wake = deadline;
+            for (StunProbe *probe : probes)
+            {
+                if (probe->mStarted && !probe->mAnswered)
+                {
+                    if (probe->mNextSend <= now)
+                    {
+                        SendProbe(*probe, now);
+                    }
+                    wake = std::min(wake, probe->mNextSend);
+                }
+            }
+            if (filtering1.mAnswered)
+            {
+                wake = std::min(wake, filtering_deadline);
+            }
+            int wait_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count();
+
+            targets[0].events = targets[1].events = POLLIN | POLLERR;
+            targets[0].revents = targets[1].revents = 0;
+            int nready = poll(targets, 2, std::max(1, wait_ms));
+            if (nready == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                std::printf("[Error] poll: %s\n", strerror(errno));
+                break;
+            }
+
+            for (int i = 0; i < 2; ++i)
+            {
+                if (!(targets[i].revents & POLLIN))
+                {
+                    continue;
+                }
+                struct sockaddr_storage from;
+                socklen_t fromlen = sizeof(from);
+                ssize_t n = recvfrom(targets[i].fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromlen);
+                if (n > 0)
+                {
+                    HandleResponse(probes, targets[i].fd, buf, (int)n, from, steady_clock::now());
+                }
+            }
+        }
+        double elapsed_ms = std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+        std::printf("[Done] Step3. run tests\n");
+
+        /* 4.判定 */
+        for (StunProbe *probe : probes)
+        {
+            if (!probe->mStarted)
+            {
+                continue;
+            }
+            if (probe->mAnswered)
+            {
+                std::printf("  %-14s -> %s mapped %s from %s (%d sent, %.2f ms)\n",
+                            probe->mName,
+                            is::net::EndpointName((struct sockaddr *)&probe->mDestination).c_str(),
+                            is::net::EndpointName((struct sockaddr *)&probe->mMapped).c_str(),
+                            is::net::EndpointName((struct sockaddr *)&probe->mResponseOrigin).c_str(),
+                            probe->mSendCount,
+                            probe->mRttMs);
+            }
+            else
+            {
+                std::printf("  %-14s -> %s no response (%d sent)\n",
+                            probe->mName,
+                            is::net::EndpointName((struct sockaddr *)&probe->mDestination).c_str(),
+                            probe->mSendCount);
+            }
+        }
+
+        if (!mapping1.mAnswered)
+        {
+            std::printf("[Result] UDP blocked (no response from %s)\n",
+                        is::net::EndpointName((struct sockaddr *)&server).c_str());
+            throw std::runtime_error("no response");
+        }
+
+        MappingType mapping = MappingType::Unknown;
+        if (is::net::SameEndpoint((struct sockaddr *)&mapping1.mMapped, (struct sockaddr *)&local))
+        {
+            mapping = MappingType::NoNat;
+        }
+        else if (mapping2.mAnswered &&
+                 is::net::SameEndpoint((struct sockaddr *)&mapping1.mMapped, (struct sockaddr *)&mapping2.mMapped))
+        {
+            mapping = MappingType::EndpointIndependent;
+        }
+        else if (mapping2.mAnswered && mapping3.mAnswered)
+        {
+            mapping = is::net::SameEndpoint((struct sockaddr *)&mapping2.mMapped, (struct sockaddr *)&mapping3.mMapped)
+                          ? MappingType::AddressDependent
+                          : MappingType::AddressAndPortDependent;
+        }
+
+        FilteringType filtering = FilteringType::Unknown;
+        if (filtering1.mAnswered)
+        {
+            if (filtering2.mAnswered)
+            {
+                filtering = FilteringType::EndpointIndependent;
+            }
+            else if (filtering3.mAnswered)
+            {
+                filtering = FilteringType::AddressDependent;
+            }
+            else
+            {
+                filtering = FilteringType::AddressAndPortDependent;
+            }
+        }
+
+        std::printf("[Result] mapped address : %s\n", is::net::EndpointName((struct sockaddr *)&mapping1.mMapped).c_str());
+        std::printf("[Result] mapping        : %s\n", MappingName(mapping));
+        std::printf("[Result] filtering      : %s\n", FilteringName(filtering));
+        std::printf("[Status] elapsed %.1f ms\n", elapsed_ms);
+
+        /* 5.WAN Cからの直接送信を待つ (udp_ipv4_from_wan_c_to_lan_a) */
+        if (listen_sec > 0)
+        {
+            std::printf("[Status] waiting %d sec for packets to %s ...\n", listen_sec,
+                        is::net::EndpointName((struct sockaddr *)&mapping1.mMapped).c_str());
+            auto listen_deadline = steady_clock::now() + std::chrono::seconds(listen_sec);
+            while (steady_clock::now() < listen_deadline)
+            {
+                targets[0].events = POLLIN | POLLERR;
+                int wait_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                                  listen_deadline - steady_clock::now()).count();
+                if (poll(targets, 1, std::max(1, wait_ms)) <= 0)
+                {
+                    continue;
+                }
+                struct sockaddr_storage from;
+                socklen_t fromlen = sizeof(from);
+                std::memset(buf, 0, sizeof(buf));
+                ssize_t n = recvfrom(mapping_socket, buf, sizeof(buf) - 1, 0, (struct sockaddr *)&from, &fromlen);
+                if (n > 0)
+                {
+                    std::printf("UDP packet from : %s, %s\n",
+                                is::net::EndpointName((struct sockaddr *)&from).c_str(), (char *)buf);
+                }
+            }
+        }
+
+        close(mapping_socket);
+        close(filtering_socket);
+    }
+    catch (const std::exception &e)
+    {
+        if (mapping_socket >= 0)
+        {
+            close(mapping_socket);
+        }
+        if (filtering_socket >= 0)
+        {
+            close(filtering_socket);
+        }
+        std::cerr << e.what() << '\n';
+    }
+    return 0;
+}
@@ -1,10 +1,97 @@
 /**
  * @file udp_ipv4_from_wan_c_to_lan_a.cpp
  * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
- * @brief 
+ * @brief WAN C(第三者ホスト)からLAN AのNAT変換後アドレスに直接UDPを送る
  * @version 0.1
  * @date 2023-05-19
- * 
+ *
  * @copyright Copyright (c) 2023
- * 
- */
\ No newline at end of file
+ *
+ * LAN A側で`udp_ipv4_from_lan_a_to_wan_b <A1> -l <sec>`を実行し, 表示された
+ * mapped addressを宛先に指定する. LAN Aに届けばNATは第三者からの受信を通す(EIF).
+ *
+ * usage: udp_ipv4_from_wan_c_to_lan_a <mapped_ip:port> [count=3]
+ */
+#include <test_utils.hpp>
+
+// udp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h> // inet_pton, inet_ntop
+#include <netdb.h>
+#include <unistd.h>
+
+#include <NetUtils/stun.hpp>
+
+#if defined(__linux__)
+
+#elif defined(__MACH__)
+
+#else
+// Windows
+#endif
+
+#define BUFSIZE 1500
+
+struct sockaddr_storage reciever_info; // LAN AのNAT変換後アドレス
+int socket_to_reciever;                // 受信側に送信するソケット
+char buf[BUFSIZE];
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        if (argc < 2)
+        {
+            std::printf("usage: %s <mapped_ip:port> [count]\n", argv[0]);
+            return 1;
+        }
+        int count = (argc > 2) ? std::atoi(argv[2]) : 3;
+
+        /* 1.宛先(reciever)の確定 */
+        if (!is::net::ParseEndpoint(argv[1], 0, &reciever_info) ||
+            is::net::EndpointPort((struct sockaddr *)&reciever_info) == 0)
+        {
+            std::printf("[Error] not an IP:port: %s\n", argv[1]);
+            throw std::runtime_error("Resolve IP Address");
+        }
+        std::printf("[Done] Step1. configure destination (reciever): %s\n",
+                    is::net::EndpointName((struct sockaddr *)&reciever_info).c_str());
+
+        /* 2.ソケットの作成 */
+        if ((socket_to_reciever = socket(reciever_info.ss_family, SOCK_DGRAM, 0)) < 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("socket");
+        }
+        std::printf("[Done] Step2. create socket\n");
+
+        /* 3.受信側に送信 */
+        for (int i = 0; i < count; ++i)
+        {
+            std::snprintf(buf, sizeof(buf), "HELLO from WAN C (%d)", i + 1);
+            ssize_t n = sendto(socket_to_reciever,
+                           buf,
+                           std::strlen(buf) + 1,
+                           0,
+                           (struct sockaddr *)&reciever_info,
+                           is::net::EndpointLength((struct sockaddr *)&reciever_info));
+            if (n < 1)
+            {
+                std::printf("[Error] %s\n", strerror(errno));
+                throw std::runtime_error("sendto");
+            }
+            usleep(100 * 1000); // 100[ms]
+        }
+        std::printf("[Done] Step3. send %d packets\n", count);
+
+        /* 4.ソケットを閉じる */
+        close(socket_to_reciever);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    return 0;
+}
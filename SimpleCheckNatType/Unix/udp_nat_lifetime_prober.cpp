@@ -0,0 +1,537 @@
+/**
+ * @file udp_nat_lifetime_prober.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief LAN A側からNATのUDPマッピング寿命とポート割り当て方を測る (相手はWAN Bのudp_ipv4_checker_in_wan_b)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * ポート割り当て (バースト)
+ * + N個のソケットから同時にBindingを送り, 送信順に並べた公開側ポートの差分を見る.
+ * + 内部ポートと一致 -> preserve, 差分が一定 -> sequential(+d), それ以外 -> random.
+ *
+ * マッピング寿命 (アイドル時間を指数的に変えて並列に測る)
+ * + アイドル時間 1, 2, 4, ... 秒毎に別々のソケットでBindingしてマッピングXを作る.
+ * + 各ソケットは以後何も送らない. アイドル時間が過ぎたら, 別の「トリガ」ソケットから
+ *   RESPONSE-DESTINATION=X を付けて同じサーバアドレスへ送り, サーバにX宛てで応答させる.
+ *   元のソケットに届けばマッピングは生きている. トリガの通信は元のマッピングを延長しない.
+ * + 生存/失効の境目[lo, hi]を, 間を等分したアイドル時間でもう一度測って絞り込む.
+ *
+ * 結果は1行のプロファイルとして出力する. キープアライブ間隔はloから決める(hole_punch.hpp).
+ * ```
+ * [Profile] lifetime=56.9..64.0s keepalive=27s alloc=sequential(+1) preserve=0/16 ip=single
+ * ```
+ *
+ * usage: udp_nat_lifetime_prober <A1[:P1]> [-m max_idle_sec=256] [-s sockets_per_idle=2] [-b burst=16] [-r refine_steps=8]
+ */
+#include <test_utils.hpp>
+
+// udp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <chrono>
+#include <algorithm>
+#include <map>
+
+#include <NetUtils/hole_punch.hpp> // KeepaliveInterval
+#include <NetUtils/stun.hpp>
+
+#define BUFSIZE 2048
+#define TRIGGER_COUNT 3       // トリガの送信回数 (損失対策)
+#define TRIGGER_INTERVAL_MS 100
+
+using socket_t = int;
+using steady_clock = std::chrono::steady_clock;
+using milliseconds = std::chrono::milliseconds;
+
+// 1つのマッピングを作って観察するソケット
+struct BindingProbe
+{
+    socket_t mSocket = -1;
+    uint16_t mLocalPort = 0;
+    is::net::StunTransactionId mId;
+    struct sockaddr_storage mMapped;
+    bool mBound = false;
+    steady_clock::time_point mBoundAt;
+    int mIdleMs = 0;
+    is::net::StunTransactionId mTriggerId;
+    int mTriggers = 0;
+    steady_clock::time_point mNextTrigger;
+    bool mAlive = false;
+    bool mDone = false;
+};
+
+double min_rtt_ms = -1.0;
+int rejected_triggers = 0; // サーバがRESPONSE-DESTINATIONを受け付けずトリガへ返した数
+uint8_t buf[BUFSIZE];
+uint8_t sbuf[BUFSIZE];
+
+static socket_t OpenSocket(int family, uint16_t *local_port)
+{
+    socket_t sock = socket(family, SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+        std::printf("[Error] socket: %s\n", strerror(errno));
+        throw std::runtime_error("socket");
+    }
+    struct sockaddr_storage local;
+    std::memset(&local, 0, sizeof(local));
+    local.ss_family = (sa_family_t)family;
+    socklen_t length = sizeof(local);
+    if (bind(sock, (struct sockaddr *)&local, is::net::EndpointLength((struct sockaddr *)&local)) != 0 ||
+        getsockname(sock, (struct sockaddr *)&local, &length) != 0)
+    {
+        std::printf("[Error] bind: %s\n", strerror(errno));
+        throw std::runtime_error("bind");
+    }
+    *local_port = is::net::EndpointPort((struct sockaddr *)&local);
+    return sock;
+}
+
+static void SendBinding(socket_t sock, const struct sockaddr_storage &server, const is::net::StunTransactionId &id,
+                        const struct sockaddr_storage *destination)
+{
+    is::net::StunMessageWriter request(sbuf, sizeof(sbuf), is::net::kStunBindingRequest, id);
+    if (destination)
+    {
+        request.addAddress(is::net::kStunAttrResponseDestination, (const struct sockaddr *)destination, true);
+    }
+    sendto(sock, sbuf, request.size(), 0,
+           (const struct sockaddr *)&server, is::net::EndpointLength((const struct sockaddr *)&server));
+}
+
+// Binding Successを1つ読む
+static bool RecvBinding(socket_t sock, is::net::StunTransactionId *id, struct sockaddr_storage *mapped)
+{
+    ssize_t n = recv(sock, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n <= 0)
+    {
+        return false;
+    }
+    is::net::StunMessageView response(buf, (size_t)n);
+    if (!response.valid() || response.type() != is::net::kStunBindingSuccess)
+    {
+        return false;
+    }
+    *id = response.transactionId();
+    return response.mappedAddress(mapped);
+}
+
+/* 全ソケットからBindingを送り, マッピングを得る (RTO 100ms 倍々, 全体timeout_ms) */
+static size_t BindAll(std::vector<BindingProbe> &probes, const struct sockaddr_storage &server, int timeout_ms)
+{
+    steady_clock::time_point start = steady_clock::now();
+    steady_clock::time_point deadline = start + milliseconds(timeout_ms);
+    std::vector<steady_clock::time_point> sent_at(probes.size());
+    std::vector<struct pollfd> targets(probes.size());
+    for (size_t i = 0; i < probes.size(); ++i)
+    {
+        probes[i].mId = is::net::StunTransactionId::Random();
+        SendBinding(probes[i].mSocket, server, probes[i].mId, nullptr); // バースト
+        sent_at[i] = steady_clock::now();
+        targets[i].fd = probes[i].mSocket;
+        targets[i].events = POLLIN;
+    }
+
+    size_t bound = 0;
+    int rto_ms = 100;
+    steady_clock::time_point next_resend = start + milliseconds(rto_ms);
+    while (bound < probes.size() && steady_clock::now() < deadline)
+    {
+        if (steady_clock::now() >= next_resend)
+        {
+            for (size_t i = 0; i < probes.size(); ++i)
+            {
+                if (!probes[i].mBound)
+                {
+                    SendBinding(probes[i].mSocket, server, probes[i].mId, nullptr);
+                    sent_at[i] = steady_clock::now();
+                }
+            }
+            rto_ms *= 2;
+            next_resend = steady_clock::now() + milliseconds(rto_ms);
+        }
+
+        for (auto &target : targets)
+        {
+            target.revents = 0;
+        }
+        if (poll(targets.data(), (nfds_t)targets.size(), 10) <= 0)
+        {
+            continue;
+        }
+        for (size_t i = 0; i < probes.size(); ++i)
+        {
+            is::net::StunTransactionId id;
+            struct sockaddr_storage mapped;
+            while ((targets[i].revents & POLLIN) && RecvBinding(probes[i].mSocket, &id, &mapped))
+            {
+                if (probes[i].mBound || id != probes[i].mId)
+                {
+                    continue;
+                }
+                probes[i].mBound = true;
+                probes[i].mBoundAt = steady_clock::now();
+                probes[i].mMapped = mapped;
+                double rtt = std::chrono::duration<double, std::milli>(probes[i].mBoundAt - sent_at[i]).count();
+                min_rtt_ms = min_rtt_ms < 0 ? rtt : std::min(min_rtt_ms, rtt);
+                ++bound;
+            }
+        }
+    }
+    return bound;
+}
+
+static void CloseAll(std::vector<BindingProbe> &probes)
+{
+    for (BindingProbe &probe : probes)
+    {
+        close(probe.mSocket);
+    }
+    probes.clear();
+}
+
+/////////////////////////////////////////////////////////////
+// ポート割り当て
+/////////////////////////////////////////////////////////////
+
+static std::string MeasureAllocation(const struct sockaddr_storage &server, int burst,
+                                     int *preserved, std::string *ip_pool)
+{
+    std::vector<BindingProbe> probes((size_t)burst);
+    for (BindingProbe &probe : probes)
+    {
+        probe.mSocket = OpenSocket(server.ss_family, &probe.mLocalPort);
+    }
+    BindAll(probes, server, 2000);
+
+    // 送信順の公開側ポート
+    std::vector<int> ports;
+    std::vector<std::string> ips;
+    *preserved = 0;
+    for (const BindingProbe &probe : probes)
+    {
+        if (!probe.mBound)
+        {
+            continue;
+        }
+        uint16_t port = is::net::EndpointPort((const struct sockaddr *)&probe.mMapped);
+        ports.push_back(port);
+        std::string name = is::net::EndpointName((const struct sockaddr *)&probe.mMapped);
+        ips.push_back(name.substr(0, name.rfind(':')));
+        if (port == probe.mLocalPort)
+        {
+            ++*preserved;
+        }
+        std::printf("  local %5u -> %s\n", probe.mLocalPort, name.c_str());
+    }
+    CloseAll(probes);
+
+    std::sort(ips.begin(), ips.end());
+    size_t unique_ips = (size_t)(std::unique(ips.begin(), ips.end()) - ips.begin());
+    *ip_pool = unique_ips <= 1 ? "single" : "pooled(" + std::to_string(unique_ips) + ")";
+
+    if (ports.size() < 2)
+    {
+        return "unknown";
+    }
+    if (*preserved * 5 >= (int)ports.size() * 4)
+    {
+        return "preserve";
+    }
+
+    // 差分の最頻値が7割以上を占めれば連番
+    std::map<int, int> deltas;
+    for (size_t i = 1; i < ports.size(); ++i)
+    {
+        int delta = (ports[i] - ports[i - 1] + 65536) % 65536;
+        if (delta > 32768)
+        {
+            delta -= 65536;
+        }
+        ++deltas[delta];
+    }
+    auto mode = std::max_element(deltas.begin(), deltas.end(),
+                                 [](const std::pair<const int, int> &a, const std::pair<const int, int> &b) {
+                                     return a.second < b.second;
+                                 });
+    if (mode->second * 10 >= (int)(ports.size() - 1) * 7 && std::abs(mode->first) <= 16 && mode->first != 0)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), "sequential(%+d)", mode->first);
+        return text;
+    }
+    return "random";
+}
+
+/////////////////////////////////////////////////////////////
+// マッピング寿命
+/////////////////////////////////////////////////////////////
+
+/* アイドル時間毎にsockets本ずつ並列に測る. 戻り値: アイドル時間[ms] -> (生存数, 試行数) */
+static std::map<int, std::pair<int, int>> MeasureLifetime(const struct sockaddr_storage &server,
+                                                          socket_t trigger,
+                                                          const std::vector<int> &idles_ms,
+                                                          int sockets)
+{
+    std::vector<BindingProbe> probes;
+    for (int idle : idles_ms)
+    {
+        for (int s = 0; s < sockets; ++s)
+        {
+            BindingProbe probe;
+            probe.mSocket = OpenSocket(server.ss_family, &probe.mLocalPort);
+            probe.mIdleMs = idle;
+            probes.push_back(probe);
+        }
+    }
+    BindAll(probes, server, 2000);
+    for (BindingProbe &probe : probes)
+    {
+        probe.mDone = !probe.mBound; // マッピングが作れなかったものは数えない
+        probe.mNextTrigger = probe.mBoundAt + milliseconds(probe.mIdleMs);
+    }
+
+    // 届かない応答を待つ時間: トリガの最終送信からRTTの4倍 (最低300ms)
+    int verdict_ms = std::max(300, (int)(min_rtt_ms * 4));
+    std::vector<struct pollfd> targets(probes.size() + 1);
+    for (size_t i = 0; i < probes.size(); ++i)
+    {
+        targets[i].fd = probes[i].mSocket;
+        targets[i].events = POLLIN;
+    }
+    targets.back().fd = trigger;
+    targets.back().events = POLLIN;
+
+    std::map<int, std::pair<int, int>> results;
+    size_t remaining = (size_t)std::count_if(probes.begin(), probes.end(), [](const BindingProbe &p) { return !p.mDone; });
+    while (remaining > 0)
+    {
+        steady_clock::time_point now = steady_clock::now();
+        steady_clock::time_point wake = now + milliseconds(1000);
+        for (BindingProbe &probe : probes)
+        {
+            if (probe.mDone)
+            {
+                continue;
+            }
+            if (now >= probe.mNextTrigger)
+            {
+                if (probe.mTriggers < TRIGGER_COUNT)
+                {
+                    // 別ソケットから, 応答をこのマッピング宛てにするよう頼む
+                    if (probe.mTriggers == 0)
+                    {
+                        probe.mTriggerId = is::net::StunTransactionId::Random();
+                    }
+                    SendBinding(trigger, server, probe.mTriggerId, &probe.mMapped);
+                    ++probe.mTriggers;
+                    probe.mNextTrigger = now + milliseconds(probe.mTriggers < TRIGGER_COUNT ? TRIGGER_INTERVAL_MS : verdict_ms);
+                }
+                else
+                {
+                    probe.mDone = true; // 失効
+                    --remaining;
+                    auto &result = results[probe.mIdleMs];
+                    ++result.second;
+                    continue;
+                }
+            }
+            wake = std::min(wake, probe.mNextTrigger);
+        }
+
+        for (auto &target : targets)
+        {
+            target.revents = 0;
+        }
+        int wait_ms = (int)std::chrono::duration_cast<milliseconds>(wake - now).count();
+        if (poll(targets.data(), (nfds_t)targets.size(), std::max(0, wait_ms) + 1) <= 0)
+        {
+            continue;
+        }
+        is::net::StunTransactionId id;
+        struct sockaddr_storage mapped;
+        while ((targets.back().revents & POLLIN) && RecvBinding(trigger, &id, &mapped))
+        {
+            ++rejected_triggers; // 公開IPがマッピング毎に違う(pairedでない)とサーバは宛先を拒否する
+        }
+        for (size_t i = 0; i < probes.size(); ++i)
+        {
+            BindingProbe &probe = probes[i];
+            while ((targets[i].revents & POLLIN) && RecvBinding(probe.mSocket, &id, &mapped))
+            {
+                if (probe.mDone || probe.mTriggers == 0 || id != probe.mTriggerId)
+                {
+                    continue;
+                }
+                probe.mAlive = true;
+                probe.mDone = true;
+                --remaining;
+                auto &result = results[probe.mIdleMs];
+                ++result.first;
+                ++result.second;
+            }
+        }
+    }
+    CloseAll(probes);
+    return results;
+}
+
+// [lo, hi]: 全て生存した最大のアイドル時間と, 初めて失効が出たアイドル時間 (hi < 0 は失効無し)
+static void LifetimeBounds(const std::map<int, std::pair<int, int>> &results, int *lo_ms, int *hi_ms)
+{
+    *hi_ms = -1;
+    for (const auto &result : results)
+    {
+        if (result.second.first < result.second.second)
+        {
+            *hi_ms = result.first;
+            break;
+        }
+    }
+    for (const auto &result : results)
+    {
+        if ((*hi_ms < 0 || result.first < *hi_ms) && result.second.second > 0 &&
+            result.second.first == result.second.second)
+        {
+            *lo_ms = std::max(*lo_ms, result.first);
+        }
+    }
+}
+
+static void PrintResults(const std::map<int, std::pair<int, int>> &results)
+{
+    for (const auto &result : results)
+    {
+        std::printf("  idle %7.1f s : alive %d/%d\n",
+                    result.first / 1000.0, result.second.first, result.second.second);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        if (argc < 2)
+        {
+            std::printf("usage: %s <A1[:P1]> [-m max_idle_sec] [-s sockets_per_idle] [-b burst] [-r refine_steps]\n", argv[0]);
+            return 1;
+        }
+        int max_idle_sec = 256;
+        int sockets = 2;
+        int burst = 16;
+        int refine_steps = 8;
+        for (int i = 2; i + 1 < argc; i += 2)
+        {
+            std::string opt(argv[i]);
+            int value = std::max(1, std::atoi(argv[i + 1]));
+            if (opt == "-m")
+            {
+                max_idle_sec = value;
+            }
+            else if (opt == "-s")
+            {
+                sockets = value;
+            }
+            else if (opt == "-b")
+            {
+                burst = std::max(2, value);
+            }
+            else if (opt == "-r")
+            {
+                refine_steps = value;
+            }
+        }
+
+        /* 1.サーバアドレス */
+        struct sockaddr_storage server;
+        if (!is::net::ParseEndpoint(argv[1], 3478, &server))
+        {
+            std::printf("[Error] not an IP address: %s\n", argv[1]);
+            throw std::runtime_error("Resolve IP Address");
+        }
+        std::printf("[Done] Step1. server %s\n", is::net::EndpointName((const struct sockaddr *)&server).c_str());
+
+        /* 2.ポート割り当て (バースト) */
+        int preserved = 0;
+        std::string ip_pool;
+        std::string allocation = MeasureAllocation(server, burst, &preserved, &ip_pool);
+        if (min_rtt_ms < 0)
+        {
+            std::printf("[Error] no response from %s\n", argv[1]);
+            throw std::runtime_error("No Response");
+        }
+        std::printf("[Done] Step2. allocation %s (preserved %d/%d, rtt %.2f ms)\n",
+                    allocation.c_str(), preserved, burst, min_rtt_ms);
+
+        /* 3.マッピング寿命 (指数間隔) */
+        BindingProbe trigger;
+        trigger.mSocket = OpenSocket(server.ss_family, &trigger.mLocalPort);
+        std::vector<int> idles_ms;
+        for (int idle = 1; idle <= max_idle_sec; idle *= 2)
+        {
+            idles_ms.push_back(idle * 1000);
+        }
+        std::printf("Probing %zu idle intervals x %d sockets (up to %d s)...\n", idles_ms.size(), sockets, max_idle_sec);
+        std::map<int, std::pair<int, int>> results = MeasureLifetime(server, trigger.mSocket, idles_ms, sockets);
+        PrintResults(results);
+        int lo_ms = 0;
+        int hi_ms = -1;
+        LifetimeBounds(results, &lo_ms, &hi_ms);
+        std::printf("[Done] Step3. coarse lifetime %d..%d ms\n", lo_ms, hi_ms);
+
+        /* 4.境目の絞り込み (等間隔) */
+        if (hi_ms > 0 && hi_ms - lo_ms > 1000 && refine_steps > 0)
+        {
+            std::vector<int> refine_ms;
+            for (int i = 1; i <= refine_steps; ++i)
+            {
+                int idle = lo_ms + (hi_ms - lo_ms) * i / (refine_steps + 1);
+                if (refine_ms.empty() || idle > refine_ms.back())
+                {
+                    refine_ms.push_back(idle);
+                }
+            }
+            std::map<int, std::pair<int, int>> refined = MeasureLifetime(server, trigger.mSocket, refine_ms, sockets);
+            PrintResults(refined);
+            for (const auto &result : refined)
+            {
+                results[result.first] = result.second;
+            }
+            lo_ms = 0;
+            LifetimeBounds(results, &lo_ms, &hi_ms);
+            std::printf("[Done] Step4. refined lifetime %d..%d ms\n", lo_ms, hi_ms);
+        }
+        close(trigger.mSocket);
+        if (rejected_triggers > 0)
+        {
+            std::printf("[Warning] %d triggers were answered to the trigger socket; lifetime is not reliable\n",
+                        rejected_triggers);
+        }
+
+        /* 5.プロファイル */
+        char lifetime[64];
+        if (hi_ms < 0)
+        {
+            std::snprintf(lifetime, sizeof(lifetime), ">=%.1fs", lo_ms / 1000.0);
+        }
+        else
+        {
+            std::snprintf(lifetime, sizeof(lifetime), "%.1f..%.1fs", lo_ms / 1000.0, hi_ms / 1000.0);
+        }
+        int keepalive = lo_ms >= 1000 ? is::net::KeepaliveInterval(lo_ms / 1000, min_rtt_ms) : 1;
+        std::printf("[Profile] lifetime=%s keepalive=%ds alloc=%s preserve=%d/%d ip=%s\n",
+                    lifetime, keepalive, allocation.c_str(), preserved, burst, ip_pool.c_str());
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    return 0;
+}
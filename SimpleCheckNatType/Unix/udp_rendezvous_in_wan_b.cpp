@@ -0,0 +1,283 @@
+/**
+ * @file udp_rendezvous_in_wan_b.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief WAN B側のホールパンチング用ランデブーサーバ (NetUtils/hole_punch.hpp のRegisterを仲介)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * + Register(A->B)を受けたら, Aの公開側アドレス(送信元)と申告されたhost候補を記録して応答する.
+ * + Bも既にRegister(B->A)していれば, 応答にBの候補を載せ, BにはPeerIndicationでAの候補を送る.
+ *   両者がほぼ同時に候補を受け取るので, 同時に打ち始められる.
+ * + Binding RequestにはXOR-MAPPED-ADDRESSを返す(普通のSTUNサーバとしても使える).
+ *
+ * 状態は登録ID毎の1エントリだけで, 1メッセージの処理はO(1).
+ * 登録は30秒更新が無ければタイミングホイールで消すので, 数千の同時セッションを1スレッドで捌ける.
+ *
+ * usage: udp_rendezvous_in_wan_b [bind_ip=0.0.0.0] [port=3480]
+ */
+#include <test_utils.hpp>
+
+// udp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <chrono>
+#include <unordered_map>
+
+#include <NetUtils/hole_punch.hpp>
+#include <NetUtils/timer_wheel.hpp>
+
+#define BUFSIZE 2048
+#define REGISTRATION_TIMEOUT_SEC 30
+
+using socket_t = int;
+using steady_clock = std::chrono::steady_clock;
+
+struct Registration
+{
+    struct sockaddr_storage mReflexive; // ランデブーから見た送信元 (公開側)
+    std::vector<struct sockaddr_storage> mHosts; // 申告されたhost候補
+    std::string mTarget;
+    uint32_t mLifetime = 0;
+    uint32_t mLastSeen = 0;
+    bool mNotified = false; // 相手へPeerIndicationを送った
+};
+
+socket_t rendezvous_socket;
+std::unordered_map<std::string, Registration> registrations;
+is::net::TimerWheel<std::string> registration_timers(64);
+uint8_t buf[BUFSIZE];
+uint8_t sbuf[BUFSIZE];
+
+struct Counters
+{
+    uint64_t mRegisters = 0;
+    uint64_t mPairs = 0;
+    uint64_t mBindings = 0;
+    uint64_t mExpired = 0;
+} counters;
+
+static uint32_t NowSeconds()
+{
+    static const steady_clock::time_point start = steady_clock::now();
+    return (uint32_t)std::chrono::duration_cast<std::chrono::seconds>(steady_clock::now() - start).count() + 1;
+}
+
+static void SendTo(const is::net::StunMessageWriter &message, const struct sockaddr_storage &to)
+{
+    if (sendto(rendezvous_socket, sbuf, message.size(), 0,
+               (const struct sockaddr *)&to, is::net::EndpointLength((const struct sockaddr *)&to)) < 0)
+    {
+        std::printf("[Error] sendto %s: %s\n", is::net::EndpointName((const struct sockaddr *)&to).c_str(), strerror(errno));
+    }
+}
+
+// idの候補(公開側 -> host)と寿命を載せる
+static void AddPeerInfo(is::net::StunMessageWriter &message, const std::string &id, const Registration &peer)
+{
+    message.addAttribute(is::net::kPunchAttrPeerId, id.data(), (uint16_t)id.size());
+    message.addAddress(is::net::kPunchAttrCandidate, (const struct sockaddr *)&peer.mReflexive, true);
+    for (const struct sockaddr_storage &host : peer.mHosts)
+    {
+        message.addAddress(is::net::kPunchAttrCandidate, (const struct sockaddr *)&host, true);
+    }
+    message.addUint32(is::net::kPunchAttrLifetime, peer.mLifetime);
+}
+
+static void HandleRegister(const is::net::StunMessageView &request, const struct sockaddr_storage &from)
+{
+    std::string id = request.attributeString(is::net::kPunchAttrPeerId);
+    std::string target = request.attributeString(is::net::kPunchAttrTargetId);
+    if (id.empty() || id.size() > is::net::kPunchMaxIdLength || target.size() > is::net::kPunchMaxIdLength)
+    {
+        return;
+    }
+    ++counters.mRegisters;
+
+    /* 1.登録の更新 */
+    uint32_t now = NowSeconds();
+    auto inserted = registrations.emplace(id, Registration());
+    Registration &self = inserted.first->second;
+    if (inserted.second)
+    {
+        registration_timers.schedule(now + REGISTRATION_TIMEOUT_SEC, id);
+    }
+    if (!inserted.second && (self.mTarget != target || !is::net::SameEndpoint((const struct sockaddr *)&self.mReflexive,
+                                                                               (const struct sockaddr *)&from)))
+    {
+        self.mNotified = false; // 相手か公開側アドレスが変わったので知らせ直す
+    }
+    self.mReflexive = from;
+    self.mTarget = target;
+    self.mLifetime = request.attributeUint32(is::net::kPunchAttrLifetime, 0);
+    self.mLastSeen = now;
+    self.mHosts.clear();
+    struct sockaddr_storage host;
+    for (size_t i = 0; self.mHosts.size() < is::net::kPunchMaxCandidates - 1 &&
+                       request.address(is::net::kPunchAttrCandidate, &host, true, i);
+         ++i)
+    {
+        if (host.ss_family == from.ss_family)
+        {
+            self.mHosts.push_back(host);
+        }
+    }
+
+    /* 2.応答 (相手も自分を待っていれば相手の候補を載せる) */
+    auto peer = registrations.find(target);
+    bool paired = peer != registrations.end() && peer->second.mTarget == id &&
+                  peer->second.mReflexive.ss_family == from.ss_family;
+    is::net::StunMessageWriter response(sbuf, sizeof(sbuf), is::net::kPunchRegisterSuccess, request.transactionId());
+    response.addAddress(is::net::kStunAttrXorMappedAddress, (const struct sockaddr *)&from, true);
+    if (paired)
+    {
+        AddPeerInfo(response, target, peer->second);
+    }
+    SendTo(response, from);
+
+    /* 3.待っている相手へ自分の候補を押し出す */
+    if (paired && !self.mNotified)
+    {
+        is::net::StunMessageWriter indication(sbuf, sizeof(sbuf), is::net::kPunchPeerIndication,
+                                              is::net::StunTransactionId::Random());
+        AddPeerInfo(indication, id, self);
+        SendTo(indication, peer->second.mReflexive);
+        self.mNotified = true;
+        ++counters.mPairs;
+        std::printf("Pair %s(%s) <-> %s(%s)\n",
+                    id.c_str(), is::net::EndpointName((const struct sockaddr *)&from).c_str(),
+                    target.c_str(), is::net::EndpointName((const struct sockaddr *)&peer->second.mReflexive).c_str());
+    }
+}
+
+static void HandleBinding(const is::net::StunMessageView &request, const struct sockaddr_storage &from)
+{
+    ++counters.mBindings;
+    is::net::StunMessageWriter response(sbuf, sizeof(sbuf), is::net::kStunBindingSuccess, request.transactionId());
+    response.addAddress(is::net::kStunAttrXorMappedAddress, (const struct sockaddr *)&from, true);
+    SendTo(response, from);
+}
+
+static void ExpireRegistrations()
+{
+    uint32_t now = NowSeconds();
+    registration_timers.advance(now, [&](std::string &id) {
+        auto found = registrations.find(id);
+        if (found == registrations.end())
+        {
+            return;
+        }
+        uint32_t deadline = found->second.mLastSeen + REGISTRATION_TIMEOUT_SEC;
+        if (deadline > now)
+        {
+            registration_timers.schedule(deadline, id); // 更新されていた
+            return;
+        }
+        registrations.erase(found);
+        ++counters.mExpired;
+    });
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        /* 1.待受アドレス */
+        const char *bind_ip = argc > 1 ? argv[1] : "0.0.0.0";
+        uint16_t port = is::net::kPunchDefaultPort;
+        if (argc > 2 && (!is::net::ParsePort(argv[2], &port) || port == 0))
+        {
+            std::printf("[Error] invalid port: %s\n", argv[2]);
+            std::printf("usage: %s [bind_ip] [port]\n", argv[0]);
+            return 1;
+        }
+        struct sockaddr_storage address;
+        if (!is::net::ParseEndpoint(bind_ip, port, &address))
+        {
+            std::printf("usage: %s [bind_ip] [port]\n", argv[0]);
+            throw std::runtime_error("Resolve IP Address");
+        }
+        std::printf("[Done] Step1. configure address\n");
+
+        /* 2.ソケットの作成とbind */
+        if ((rendezvous_socket = socket(address.ss_family, SOCK_DGRAM, 0)) < 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("socket");
+        }
+        int rcvbuf = 4 * 1024 * 1024; // 登録が集中しても取りこぼさないように
+        setsockopt(rendezvous_socket, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        if (bind(rendezvous_socket, (struct sockaddr *)&address, is::net::EndpointLength((struct sockaddr *)&address)) != 0)
+        {
+            std::printf("[Error] bind: %s\n", strerror(errno));
+            throw std::runtime_error("bind");
+        }
+        std::printf("[Done] Step2. listen %s\n", is::net::EndpointName((struct sockaddr *)&address).c_str());
+
+        /* 3.受信ループ */
+        struct pollfd target;
+        target.fd = rendezvous_socket;
+        target.events = POLLIN;
+        uint32_t last_report = NowSeconds();
+        while (true)
+        {
+            target.revents = 0;
+            int nready = poll(&target, 1, 1000);
+            if (nready < 0 && errno != EINTR)
+            {
+                std::printf("[Error] poll: %s\n", strerror(errno));
+                break;
+            }
+
+            // 溜まっている分をまとめて処理する
+            while (nready > 0)
+            {
+                struct sockaddr_storage from;
+                socklen_t from_length = sizeof(from);
+                ssize_t n = recvfrom(rendezvous_socket, buf, sizeof(buf), MSG_DONTWAIT,
+                                     (struct sockaddr *)&from, &from_length);
+                if (n < 0)
+                {
+                    break;
+                }
+                is::net::StunMessageView request(buf, (size_t)n);
+                if (!request.valid())
+                {
+                    continue;
+                }
+                if (request.type() == is::net::kPunchRegisterRequest)
+                {
+                    HandleRegister(request, from);
+                }
+                else if (request.type() == is::net::kStunBindingRequest)
+                {
+                    HandleBinding(request, from);
+                }
+            }
+
+            ExpireRegistrations();
+            if (NowSeconds() - last_report >= 10)
+            {
+                last_report = NowSeconds();
+                std::printf("[Status] registrations %zu | register %llu pairs %llu binding %llu expired %llu\n",
+                            registrations.size(),
+                            (unsigned long long)counters.mRegisters, (unsigned long long)counters.mPairs,
+                            (unsigned long long)counters.mBindings, (unsigned long long)counters.mExpired);
+            }
+        }
+
+        // クローズ
+        close(rendezvous_socket);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,892 @@
+/**
+ * @file parallel_traceroute.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 全TTLのプローブを一斉に送信する並列traceroute (ICMP/UDP/TCP-SYN, IPv4/IPv6)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * 逐次型のtracerouteは1ホップずつ応答を待つため, 1経路に数十秒かかる.
+ * ここでは全宛先x全TTLのプローブを先に送り切り, 返ってきたICMPエラー
+ * (Time Exceeded / Destination Unreachable)に引用された元パケットのヘッダから
+ * 宛先とTTLを逆引きする. プローブのTTLは以下に埋め込む.
+ *
+ * | プローブ | 送信ソケット | TTLの埋め込み先 |
+ * | :-- | :-- | :-- |
+ * | ICMP | RAW(IPPROTO_ICMP/ICMPV6) | Echo Requestのシーケンス番号 |
+ * | UDP | SOCK_DGRAM | 宛先ポート番号 (33434 + 送信回 x 最大TTL + TTL - 1) |
+ * | TCP | RAW(IPPROTO_TCP) | SYNのシーケンス番号 |
+ *
+ * 再送したプローブには送信回(round)も埋め込み, 応答はその回の送信時刻と突き合わせる
+ * (最初のプローブへの遅れた応答を再送の時刻で測ると, RTTが小さく出てしまう).
+ */
+#include <test_utils.hpp>
+
+// traceroute
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/ip_icmp.h> // ICMP_ECHO, ICMP_TIME_EXCEEDED, ...
+#include <netinet/icmp6.h>   // icmp6_filter
+#include <sys/socket.h>
+#include <unistd.h>
+#include <poll.h>
+#include <chrono>
+#include <algorithm>
+
+#include <NetUtils/packet_view.hpp>
+
+#if defined(__linux__)
+
+#elif defined(__MACH__)
+
+#else
+// Windows
+#endif
+
+#define BUFSIZE 1500
+#define ECHO_HDR_SIZE 8
+#define TRACE_BASE_PORT 33434 // UDPプローブの基準ポート(従来のtracerouteと同じ)
+
+using socket_t = int;
+using steady_clock = std::chrono::steady_clock;
+
+// プローブの種類
+enum class ProbeType
+{
+    ICMP,
+    UDP,
+    TCP,
+};
+
+// 1つのプローブ(宛先 x TTL)
+struct Probe
+{
+    std::vector<steady_clock::time_point> mSendTimes; // index: 送信回
+    struct sockaddr_storage mResponder; // 応答したルータ(または宛先)
+    double mRttMs = -1.0;               // 未応答: -1
+    bool mReached = false;              // 宛先から応答した
+};
+
+// 1つの宛先
+struct TraceTarget
+{
+    std::string mName;
+    struct sockaddr_storage mAddress;
+    socklen_t mAddressLength;
+    struct sockaddr_storage mSource; // TCPのチェックサム計算用の送信元アドレス
+    unsigned short mSourcePort;      // TCPプローブの送信元ポート
+    int mReachedTtl = -1;            // 宛先に届いた最小TTL
+    std::vector<Probe> mProbes;      // index: TTL - 1
+};
+
+// トレース全体の状態
+struct TraceContext
+{
+    ProbeType mType = ProbeType::UDP;
+    int mMaxTtl = 30;
+    unsigned short mTcpPort = 80;
+    unsigned short mIdent = 0;
+    socket_t mIcmpSocket4 = -1; // ICMPエラーの受信(+ICMPプローブの送信)
+    socket_t mIcmpSocket6 = -1;
+    socket_t mUdpSocket4 = -1;  // UDPプローブの送信
+    socket_t mUdpSocket6 = -1;
+    socket_t mTcpSocket4 = -1;  // SYNの送信とSYN-ACK/RSTの受信
+    socket_t mTcpSocket6 = -1;
+    unsigned short mUdpSourcePort4 = 0;
+    unsigned short mUdpSourcePort6 = 0;
+    std::vector<TraceTarget> mTargets;
+    std::map<std::string, int> mTargetIndex; // バイナリアドレス -> mTargetsの添字
+};
+
+// アドレスのバイナリ表現(マップのキー)
+static std::string AddressKey(const struct sockaddr *address)
+{
+    if (address->sa_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)address;
+        return std::string((const char *)&sin6->sin6_addr, sizeof(sin6->sin6_addr));
+    }
+    const struct sockaddr_in *sin = (const struct sockaddr_in *)address;
+    return std::string((const char *)&sin->sin_addr, sizeof(sin->sin_addr));
+}
+
+static std::string AddressName(const struct sockaddr *address)
+{
+    char name[INET6_ADDRSTRLEN];
+    if (address->sa_family == AF_INET6)
+    {
+        inet_ntop(AF_INET6, &((const struct sockaddr_in6 *)address)->sin6_addr, name, sizeof(name));
+    }
+    else
+    {
+        inet_ntop(AF_INET, &((const struct sockaddr_in *)address)->sin_addr, name, sizeof(name));
+    }
+    return std::string(name);
+}
+
+/* 宛先の登録 */
+static int AddTarget(TraceContext &ctx, const char *name)
+{
+    struct addrinfo hints, *response;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = PF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    int error = getaddrinfo(name, NULL, &hints, &response);
+    if (error != 0)
+    {
+        std::printf("[Error] %s : %s\n", name, gai_strerror(error));
+        return -100;
+    }
+
+    TraceTarget target;
+    target.mName = name;
+    std::memset(&target.mAddress, 0, sizeof(target.mAddress));
+    std::memcpy(&target.mAddress, response->ai_addr, response->ai_addrlen);
+    target.mAddressLength = response->ai_addrlen;
+    freeaddrinfo(response);
+
+    std::string key = AddressKey((struct sockaddr *)&target.mAddress);
+    if (ctx.mTargetIndex.find(key) != ctx.mTargetIndex.end())
+    {
+        return 0; // 同じアドレスは1回だけトレースする
+    }
+
+    // 送信元アドレスの確定 (UDPソケットをconnectするだけでパケットは出ない)
+    socket_t sock = socket(target.mAddress.ss_family, SOCK_DGRAM, 0);
+    if (sock < 0 ||
+        connect(sock, (struct sockaddr *)&target.mAddress, target.mAddressLength) != 0)
+    {
+        std::printf("[Error] %s : %s\n", name, strerror(errno));
+        if (sock >= 0)
+        {
+            close(sock);
+        }
+        return -110;
+    }
+    socklen_t source_length = sizeof(target.mSource);
+    getsockname(sock, (struct sockaddr *)&target.mSource, &source_length);
+    close(sock);
+
+    target.mSourcePort = (unsigned short)(32768 + (ctx.mIdent + ctx.mTargets.size()) % 28000);
+    target.mProbes.resize(ctx.mMaxTtl);
+    ctx.mTargetIndex[key] = (int)ctx.mTargets.size();
+    ctx.mTargets.push_back(target);
+    return 0;
+}
+
+/* ソケットの作成 */
+static int OpenSockets(TraceContext &ctx)
+{
+    bool use_ipv4 = false, use_ipv6 = false;
+    for (const auto &target : ctx.mTargets)
+    {
+        use_ipv4 |= (target.mAddress.ss_family == AF_INET);
+        use_ipv6 |= (target.mAddress.ss_family == AF_INET6);
+    }
+
+    // ICMPエラーはどのプローブ種別でもRAWソケットで受ける
+    if (use_ipv4 && (ctx.mIcmpSocket4 = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP)) < 0)
+    {
+        std::printf("[Error] socket ICMP: %s\n", strerror(errno));
+        return -300;
+    }
+    if (use_ipv6)
+    {
+        if ((ctx.mIcmpSocket6 = socket(AF_INET6, SOCK_RAW, IPPROTO_ICMPV6)) < 0)
+        {
+            std::printf("[Error] socket ICMPv6: %s\n", strerror(errno));
+            return -300;
+        }
+
+        // tracerouteに関係するICMPv6以外はカーネルで落とす
+        struct icmp6_filter filter;
+        ICMP6_FILTER_SETBLOCKALL(&filter);
+        ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &filter);
+        ICMP6_FILTER_SETPASS(ICMP6_TIME_EXCEEDED, &filter);
+        ICMP6_FILTER_SETPASS(ICMP6_DST_UNREACH, &filter);
+        if (setsockopt(ctx.mIcmpSocket6, IPPROTO_ICMPV6, ICMP6_FILTER, &filter, sizeof(filter)) != 0)
+        {
+            std::printf("[Error] setsockopt ICMP6_FILTER: %s\n", strerror(errno));
+            return -310;
+        }
+    }
+
+    if (ctx.mType == ProbeType::UDP)
+    {
+        // 送信元ポートは宛先ごとに変えず, 宛先ポートにTTLを埋め込む
+        if (use_ipv4)
+        {
+            struct sockaddr_in self;
+            socklen_t length = sizeof(self);
+            if ((ctx.mUdpSocket4 = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+            {
+                std::printf("[Error] socket UDP: %s\n", strerror(errno));
+                return -320;
+            }
+            std::memset(&self, 0, sizeof(self));
+            self.sin_family = AF_INET;
+            bind(ctx.mUdpSocket4, (struct sockaddr *)&self, sizeof(self));
+            getsockname(ctx.mUdpSocket4, (struct sockaddr *)&self, &length);
+            ctx.mUdpSourcePort4 = ntohs(self.sin_port);
+        }
+        if (use_ipv6)
+        {
+            struct sockaddr_in6 self;
+            socklen_t length = sizeof(self);
+            if ((ctx.mUdpSocket6 = socket(AF_INET6, SOCK_DGRAM, 0)) < 0)
+            {
+                std::printf("[Error] socket UDPv6: %s\n", strerror(errno));
+                return -320;
+            }
+            std::memset(&self, 0, sizeof(self));
+            self.sin6_family = AF_INET6;
+            self.sin6_addr = in6addr_any;
+            bind(ctx.mUdpSocket6, (struct sockaddr *)&self, sizeof(self));
+            getsockname(ctx.mUdpSocket6, (struct sockaddr *)&self, &length);
+            ctx.mUdpSourcePort6 = ntohs(self.sin6_port);
+        }
+    }
+
+    if (ctx.mType == ProbeType::TCP)
+    {
+        // SYNはRAWソケットで組み立てる. 応答(SYN-ACK/RST)も同じソケットに届く.
+        if (use_ipv4 && (ctx.mTcpSocket4 = socket(AF_INET, SOCK_RAW, IPPROTO_TCP)) < 0)
+        {
+            std::printf("[Error] socket TCP: %s\n", strerror(errno));
+            return -330;
+        }
+        if (use_ipv6)
+        {
+            if ((ctx.mTcpSocket6 = socket(AF_INET6, SOCK_RAW, IPPROTO_TCP)) < 0)
+            {
+                std::printf("[Error] socket TCPv6: %s\n", strerror(errno));
+                return -330;
+            }
+            // IPv6はチェックサムの計算をカーネルに任せる (TCPヘッダ先頭から16バイト目)
+            int offset = 16;
+            if (setsockopt(ctx.mTcpSocket6, IPPROTO_IPV6, IPV6_CHECKSUM, &offset, sizeof(offset)) != 0)
+            {
+                std::printf("[Error] setsockopt IPV6_CHECKSUM: %s\n", strerror(errno));
+                return -340;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void CloseSockets(TraceContext &ctx)
+{
+    for (socket_t sock : {ctx.mIcmpSocket4, ctx.mIcmpSocket6,
+                          ctx.mUdpSocket4, ctx.mUdpSocket6,
+                          ctx.mTcpSocket4, ctx.mTcpSocket6})
+    {
+        if (sock >= 0)
+        {
+            close(sock);
+        }
+    }
+}
+
+/* TTL(Hop Limit)を設定 */
+static int SetTtl(socket_t sock, int family, int ttl)
+{
+    if (family == AF_INET6)
+    {
+        return setsockopt(sock, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &ttl, sizeof(ttl));
+    }
+    return setsockopt(sock, IPPROTO_IP, IP_TTL, &ttl, sizeof(ttl));
+}
+
+/* TCP SYNの作成 */
+static int BuildTcpSyn(const TraceContext &ctx, const TraceTarget &target, int ttl, int attempt, uint8_t *sbuff)
+{
+    constexpr int tcp_len = is::net::TcpView::kMinHeaderSize;
+    std::memset(sbuff, 0, tcp_len);
+    is::net::StoreBe16(sbuff + 0, target.mSourcePort);
+    is::net::StoreBe16(sbuff + 2, ctx.mTcpPort);
+    is::net::StoreBe32(sbuff + 4, ((uint32_t)ctx.mIdent << 16) | ((uint32_t)attempt << 8) | (uint32_t)ttl); // 送信回とTTLを埋め込む
+    sbuff[12] = (tcp_len / 4) << 4; // データオフセット
+    sbuff[13] = is::net::TcpView::kSyn;
+    is::net::StoreBe16(sbuff + 14, 1024); // ウィンドウ
+
+    if (target.mAddress.ss_family == AF_INET)
+    {
+        // 擬似ヘッダ(送信元, 宛先, プロトコル, TCP長)を含めたチェックサム
+        const struct sockaddr_in *src = (const struct sockaddr_in *)&target.mSource;
+        const struct sockaddr_in *dst = (const struct sockaddr_in *)&target.mAddress;
+        uint32_t sum = is::net::PseudoHeaderSum4((const uint8_t *)&src->sin_addr,
+                                                 (const uint8_t *)&dst->sin_addr,
+                                                 IPPROTO_TCP, tcp_len);
+        is::net::StoreBe16(sbuff + 16, is::net::InternetChecksum(sbuff, tcp_len, sum));
+    }
+    return tcp_len;
+}
+
+/* プローブの送信 (attempt: 送信回) */
+static int SendProbe(TraceContext &ctx, int target_index, int ttl, int attempt)
+{
+    TraceTarget &target = ctx.mTargets[target_index];
+    int family = target.mAddress.ss_family;
+    uint8_t sbuff[BUFSIZE];
+    struct sockaddr_storage dest;
+    socket_t sock = -1;
+    int len = 0;
+
+    std::memset(sbuff, 0, sizeof(sbuff));
+    std::memcpy(&dest, &target.mAddress, sizeof(dest));
+
+    switch (ctx.mType)
+    {
+    case ProbeType::ICMP:
+    {
+        // seq = (送信回 x 宛先数 + 宛先の添字) x 最大TTL + (TTL - 1)
+        unsigned short seq = (unsigned short)((attempt * (int)ctx.mTargets.size() + target_index) * ctx.mMaxTtl + ttl - 1);
+        len = ECHO_HDR_SIZE + 32;
+        if (family == AF_INET6)
+        {
+            is::net::WriteIcmpEchoHeader(sbuff, ICMP6_ECHO_REQUEST, ctx.mIdent, seq); // チェックサムはカーネルが計算
+            sock = ctx.mIcmpSocket6;
+        }
+        else
+        {
+            is::net::WriteIcmpEchoHeader(sbuff, ICMP_ECHO, ctx.mIdent, seq);
+            is::net::StoreBe16(sbuff + 2, is::net::InternetChecksum(sbuff, len));
+            sock = ctx.mIcmpSocket4;
+        }
+        break;
+    }
+    case ProbeType::UDP:
+    {
+        unsigned short port = (unsigned short)(TRACE_BASE_PORT + attempt * ctx.mMaxTtl + ttl - 1);
+        len = 32;
+        if (family == AF_INET6)
+        {
+            ((struct sockaddr_in6 *)&dest)->sin6_port = htons(port);
+            sock = ctx.mUdpSocket6;
+        }
+        else
+        {
+            ((struct sockaddr_in *)&dest)->sin_port = htons(port);
+            sock = ctx.mUdpSocket4;
+        }
+        break;
+    }
+    case ProbeType::TCP:
+    {
+        len = BuildTcpSyn(ctx, target, ttl, attempt, sbuff);
+        // RAWソケットのsin_port/sin6_portはプロトコル番号として解釈されるので0にする
+        if (family == AF_INET6)
+        {
+            ((struct sockaddr_in6 *)&dest)->sin6_port = 0;
+            sock = ctx.mTcpSocket6;
+        }
+        else
+        {
+            ((struct sockaddr_in *)&dest)->sin_port = 0;
+            sock = ctx.mTcpSocket4;
+        }
+        break;
+    }
+    }
+
+    if (SetTtl(sock, family, ttl) != 0)
+    {
+        std::printf("[Error] setsockopt TTL: %s\n", strerror(errno));
+        return -1000;
+    }
+
+    std::vector<steady_clock::time_point> &send_times = target.mProbes[ttl - 1].mSendTimes;
+    if ((int)send_times.size() <= attempt)
+    {
+        send_times.resize((size_t)attempt + 1);
+    }
+    send_times[(size_t)attempt] = steady_clock::now();
+    ssize_t n = sendto(sock, sbuff, (size_t)len, 0, (struct sockaddr *)&dest, target.mAddressLength);
+    if (n != len)
+    {
+        std::printf("[Error] sendto %s ttl=%d: %s\n", target.mName.c_str(), ttl, strerror(errno));
+        return -1000;
+    }
+    return 0;
+}
+
+/* 応答をプローブに対応付けて記録 */
+static void RecordReply(TraceContext &ctx,
+                        const std::string &target_key,
+                        int ttl,
+                        int attempt,
+                        const struct sockaddr *responder,
+                        socklen_t responder_length,
+                        bool reached,
+                        steady_clock::time_point recvtime)
+{
+    auto iter = ctx.mTargetIndex.find(target_key);
+    if (iter == ctx.mTargetIndex.end() || ttl < 1 || ttl > ctx.mMaxTtl)
+    {
+        return; // 他プロセスのパケット
+    }
+
+    TraceTarget &target = ctx.mTargets[iter->second];
+    Probe &probe = target.mProbes[ttl - 1];
+    if (probe.mRttMs >= 0.0)
+    {
+        return; // 再送プローブへの重複応答
+    }
+    if (attempt < 0 || attempt >= (int)probe.mSendTimes.size())
+    {
+        return; // 送っていない回
+    }
+
+    // 応答が返ってきた回の送信時刻で測る
+    probe.mRttMs = std::chrono::duration<double, std::milli>(recvtime - probe.mSendTimes[(size_t)attempt]).count();
+    std::memset(&probe.mResponder, 0, sizeof(probe.mResponder));
+    std::memcpy(&probe.mResponder, responder, responder_length);
+    probe.mReached = reached;
+    if (reached && (target.mReachedTtl < 0 || ttl < target.mReachedTtl))
+    {
+        target.mReachedTtl = ttl;
+    }
+}
+
+/* 引用された元パケット(L4ヘッダ先頭8バイト)からTTLと送信回を取り出す */
+static int QuotedTtl(const TraceContext &ctx, int protocol, is::net::BytesView l4, int family, int &attempt)
+{
+    if (!l4.has(8))
+    {
+        return -1;
+    }
+
+    switch (protocol)
+    {
+    case IPPROTO_ICMP:
+    case IPPROTO_ICMPV6:
+    {
+        is::net::IcmpView icp(l4); // id/seqの位置はICMPv6も同じ
+        if (ctx.mType != ProbeType::ICMP || icp.id() != ctx.mIdent)
+        {
+            return -1;
+        }
+        attempt = icp.seq() / (ctx.mMaxTtl * (int)ctx.mTargets.size());
+        return icp.seq() % ctx.mMaxTtl + 1;
+    }
+    case IPPROTO_UDP:
+    {
+        is::net::UdpView udp(l4);
+        unsigned short sport = family == AF_INET6 ? ctx.mUdpSourcePort6 : ctx.mUdpSourcePort4;
+        if (ctx.mType != ProbeType::UDP || udp.srcPort() != sport)
+        {
+            return -1;
+        }
+        int offset = udp.dstPort() - TRACE_BASE_PORT;
+        if (offset < 0)
+        {
+            return -1;
+        }
+        attempt = offset / ctx.mMaxTtl;
+        return offset % ctx.mMaxTtl + 1;
+    }
+    case IPPROTO_TCP:
+    {
+        is::net::TcpView tcp(l4); // 先頭8バイト(ポート, シーケンス番号)のみ
+        if (ctx.mType != ProbeType::TCP || (tcp.seq() >> 16) != ctx.mIdent)
+        {
+            return -1;
+        }
+        attempt = (int)((tcp.seq() >> 8) & 0xFF);
+        return (int)(tcp.seq() & 0xFF);
+    }
+    default:
+        return -1;
+    }
+}
+
+/* ICMPv4の受信処理 */
+static void HandleIcmp4(TraceContext &ctx, const uint8_t *rbuff, int nbytes,
+                        const struct sockaddr_in *from, steady_clock::time_point recvtime)
+{
+    is::net::Ipv4View iph(rbuff, (size_t)nbytes);
+    is::net::IcmpView icp(iph.payload());
+    if (!icp.valid())
+    {
+        return;
+    }
+
+    if (icp.type() == ICMP_ECHOREPLY)
+    {
+        int attempt = -1;
+        int ttl = QuotedTtl(ctx, IPPROTO_ICMP, icp, AF_INET, attempt);
+        RecordReply(ctx, AddressKey((const struct sockaddr *)from), ttl, attempt,
+                    (const struct sockaddr *)from, sizeof(*from), true, recvtime);
+        return;
+    }
+
+    if (icp.type() != ICMP_TIME_EXCEEDED && icp.type() != ICMP_DEST_UNREACH)
+    {
+        return;
+    }
+
+    // ICMPエラー: ICMPヘッダ(8) + 元のIPヘッダ + 元のL4ヘッダ先頭8バイト
+    is::net::Ipv4View inner(icp.payload());
+    if (!inner.valid())
+    {
+        return;
+    }
+
+    struct sockaddr_in original;
+    std::memset(&original, 0, sizeof(original));
+    original.sin_family = AF_INET;
+    std::memcpy(&original.sin_addr, inner.dst(), 4);
+
+    int attempt = -1;
+    int ttl = QuotedTtl(ctx, inner.protocol(), inner.payload(), AF_INET, attempt);
+    // 宛先自身からの到達不能(UDPのポート到達不能など)は到達とみなす
+    std::string original_key = AddressKey((const struct sockaddr *)&original);
+    bool reached = (icp.type() == ICMP_DEST_UNREACH) &&
+                   (original_key == AddressKey((const struct sockaddr *)from));
+    RecordReply(ctx, original_key, ttl, attempt,
+                (const struct sockaddr *)from, sizeof(*from), reached, recvtime);
+}
+
+/* ICMPv6の受信処理 (RAWソケットはIPv6ヘッダを含まない) */
+static void HandleIcmp6(TraceContext &ctx, const uint8_t *rbuff, int nbytes,
+                        const struct sockaddr_in6 *from, steady_clock::time_point recvtime)
+{
+    is::net::IcmpView icp6(rbuff, (size_t)nbytes);
+    if (!icp6.valid())
+    {
+        return;
+    }
+
+    if (icp6.type() == ICMP6_ECHO_REPLY)
+    {
+        int attempt = -1;
+        int ttl = QuotedTtl(ctx, IPPROTO_ICMPV6, icp6, AF_INET6, attempt);
+        RecordReply(ctx, AddressKey((const struct sockaddr *)from), ttl, attempt,
+                    (const struct sockaddr *)from, sizeof(*from), true, recvtime);
+        return;
+    }
+
+    is::net::Ipv6View inner(icp6.payload());
+    if (!inner.valid())
+    {
+        return;
+    }
+
+    struct sockaddr_in6 original;
+    std::memset(&original, 0, sizeof(original));
+    original.sin6_family = AF_INET6;
+    std::memcpy(&original.sin6_addr, inner.dst(), 16);
+
+    int attempt = -1;
+    int ttl = QuotedTtl(ctx, inner.nextHeader(), inner.payload(), AF_INET6, attempt);
+    std::string original_key = AddressKey((const struct sockaddr *)&original);
+    bool reached = (icp6.type() == ICMP6_DST_UNREACH) &&
+                   (original_key == AddressKey((const struct sockaddr *)from));
+    RecordReply(ctx, original_key, ttl, attempt,
+                (const struct sockaddr *)from, sizeof(*from), reached, recvtime);
+}
+
+/* TCP(SYN-ACK/RST)の受信処理 */
+static void HandleTcp(TraceContext &ctx, const uint8_t *rbuff, int nbytes,
+                      const struct sockaddr *from, socklen_t fromlen, steady_clock::time_point recvtime)
+{
+    is::net::TcpView tcp;
+    if (from->sa_family == AF_INET)
+    {
+        tcp = is::net::TcpView(is::net::Ipv4View(rbuff, (size_t)nbytes).payload()); // IPv4のRAWソケットはIPヘッダを含む
+    }
+    else
+    {
+        tcp = is::net::TcpView(rbuff, (size_t)nbytes);
+    }
+    if (!tcp.valid())
+    {
+        return;
+    }
+    if (!(tcp.rst() || (tcp.syn() && tcp.isAck())) || tcp.srcPort() != ctx.mTcpPort)
+    {
+        return;
+    }
+
+    // SYNに対する応答のACK番号は seq + 1
+    uint32_t seq = tcp.ack() - 1;
+    if ((seq >> 16) != ctx.mIdent)
+    {
+        return;
+    }
+    RecordReply(ctx, AddressKey(from), (int)(seq & 0xFF), (int)((seq >> 8) & 0xFF), from, fromlen, true, recvtime);
+}
+
+/* 全プローブの応答待ち */
+static void CollectReplies(TraceContext &ctx, int wait_ms)
+{
+    std::vector<struct pollfd> targets;
+    for (socket_t sock : {ctx.mIcmpSocket4, ctx.mIcmpSocket6, ctx.mTcpSocket4, ctx.mTcpSocket6})
+    {
+        if (sock >= 0)
+        {
+            struct pollfd target;
+            target.fd = sock;
+            target.events = POLLIN | POLLERR;
+            target.revents = 0;
+            targets.push_back(target);
+        }
+    }
+
+    uint8_t rbuff[BUFSIZE];
+    auto deadline = steady_clock::now() + std::chrono::milliseconds(wait_ms);
+    while (true)
+    {
+        // 全宛先の全ホップ(到達TTLまで)が揃ったら打ち切り
+        bool done = true;
+        for (const auto &target : ctx.mTargets)
+        {
+            int last = target.mReachedTtl > 0 ? target.mReachedTtl : ctx.mMaxTtl;
+            for (int i = 0; i < last && done; ++i)
+            {
+                done = target.mProbes[i].mRttMs >= 0.0;
+            }
+        }
+        if (done)
+        {
+            break;
+        }
+
+        int remain_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                            deadline - steady_clock::now()).count();
+        if (remain_ms <= 0)
+        {
+            break;
+        }
+
+        int nready = poll(targets.data(), targets.size(), remain_ms);
+        if (nready == 0)
+        {
+            break; // タイムアウト
+        }
+        if (nready == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::printf("[Error] poll: %s\n", strerror(errno));
+            break;
+        }
+
+        for (auto &target : targets)
+        {
+            if (!(target.revents & POLLIN))
+            {
+                continue;
+            }
+
+            // 溜まっている分をまとめて読む
+            while (true)
+            {
+                struct sockaddr_storage from;
+                socklen_t fromlen = sizeof(from);
+                ssize_t received = recvfrom(target.fd, rbuff, sizeof(rbuff), MSG_DONTWAIT,
+                                            (struct sockaddr *)&from, &fromlen);
+                int nbytes = (int)received; // <= BUFSIZE
+                if (received < 0)
+                {
+                    break;
+                }
+                auto recvtime = steady_clock::now();
+
+                if (target.fd == ctx.mIcmpSocket4)
+                {
+                    HandleIcmp4(ctx, rbuff, nbytes, (struct sockaddr_in *)&from, recvtime);
+                }
+                else if (target.fd == ctx.mIcmpSocket6)
+                {
+                    HandleIcmp6(ctx, rbuff, nbytes, (struct sockaddr_in6 *)&from, recvtime);
+                }
+                else
+                {
+                    HandleTcp(ctx, rbuff, nbytes, (struct sockaddr *)&from, fromlen, recvtime);
+                }
+            }
+        }
+    }
+}
+
+/* 結果の表示 */
+static void PrintTrace(const TraceContext &ctx)
+{
+    static const char *type_names[] = {"icmp", "udp", "tcp"};
+    for (const auto &target : ctx.mTargets)
+    {
+        std::printf("traceroute to %s (%s), %d hops max, %s probes\n",
+                    target.mName.c_str(),
+                    AddressName((const struct sockaddr *)&target.mAddress).c_str(),
+                    ctx.mMaxTtl,
+                    type_names[(int)ctx.mType]);
+
+        int last = target.mReachedTtl > 0 ? target.mReachedTtl : ctx.mMaxTtl;
+        for (int ttl = 1; ttl <= last; ++ttl)
+        {
+            const Probe &probe = target.mProbes[ttl - 1];
+            if (probe.mRttMs < 0.0)
+            {
+                std::printf("%2d  *\n", ttl);
+                continue;
+            }
+            std::printf("%2d  %s  %.3f ms%s\n",
+                        ttl,
+                        AddressName((const struct sockaddr *)&probe.mResponder).c_str(),
+                        probe.mRttMs,
+                        probe.mReached ? "  [reached]" : "");
+        }
+    }
+}
+
+/* traceroute (全宛先 x 全TTLを並列に送信) */
+int TracerouteCheck(const std::vector<std::string> &names,
+                    ProbeType type,
+                    int max_ttl,
+                    int wait_ms,
+                    int rounds)
+{
+    TraceContext ctx;
+    ctx.mType = type;
+    ctx.mMaxTtl = max_ttl;
+    ctx.mIdent = (unsigned short)getpid();
+
+    for (const auto &name : names)
+    {
+        AddTarget(ctx, name.c_str());
+    }
+    if (ctx.mTargets.empty())
+    {
+        return -100;
+    }
+    if (type == ProbeType::ICMP && ctx.mTargets.size() * max_ttl * rounds > 0xFFFF)
+    {
+        std::printf("[Error] too many targets for ICMP probes (seq is 16 bit)\n");
+        return -200;
+    }
+    if (type == ProbeType::UDP && TRACE_BASE_PORT + max_ttl * rounds > 0xFFFF)
+    {
+        std::printf("[Error] too many rounds for UDP probes (port is 16 bit)\n");
+        return -200;
+    }
+    if (type == ProbeType::TCP && (max_ttl > 0xFF || rounds > 0xFF))
+    {
+        std::printf("[Error] max ttl and rounds must be <= 255 for TCP probes\n");
+        return -200;
+    }
+
+    int ret = OpenSockets(ctx);
+    if (ret != 0)
+    {
+        CloseSockets(ctx);
+        return ret;
+    }
+
+    auto start = steady_clock::now();
+    for (int round = 0; round < rounds; ++round)
+    {
+        // 未応答のプローブだけを送る (2回目以降はICMPレート制限で落ちた分の再送)
+        for (int ttl = 1; ttl <= max_ttl; ++ttl)
+        {
+            for (int i = 0; i < (int)ctx.mTargets.size(); ++i)
+            {
+                const TraceTarget &target = ctx.mTargets[i];
+                if (target.mReachedTtl > 0 && ttl > target.mReachedTtl)
+                {
+                    continue;
+                }
+                if (target.mProbes[ttl - 1].mRttMs >= 0.0)
+                {
+                    continue;
+                }
+                SendProbe(ctx, i, ttl, round);
+            }
+        }
+
+        CollectReplies(ctx, wait_ms);
+    }
+    double elapsed_ms = std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+
+    PrintTrace(ctx);
+    std::printf("[Status] %zu targets traced in %.1f ms\n", ctx.mTargets.size(), elapsed_ms);
+
+    CloseSockets(ctx);
+
+    int reached = 0;
+    for (const auto &target : ctx.mTargets)
+    {
+        reached += (target.mReachedTtl > 0);
+    }
+    return reached;
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        ProbeType type = ProbeType::UDP;
+        int max_ttl = 30;
+        int wait_ms = 1000;
+        int rounds = 2;
+        std::vector<std::string> names;
+
+        // usage: parallel_traceroute [-I|-U|-T] [-m max_ttl] [-w wait_ms] host ...
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "-I")
+            {
+                type = ProbeType::ICMP;
+            }
+            else if (arg == "-U")
+            {
+                type = ProbeType::UDP;
+            }
+            else if (arg == "-T")
+            {
+                type = ProbeType::TCP;
+            }
+            else if (arg == "-m" && i + 1 < argc)
+            {
+                max_ttl = std::max(1, std::min(255, std::atoi(argv[++i])));
+            }
+            else if (arg == "-w" && i + 1 < argc)
+            {
+                wait_ms = std::max(1, std::atoi(argv[++i]));
+            }
+            else
+            {
+                names.push_back(arg);
+            }
+        }
+        if (names.empty())
+        {
+            names.push_back("127.0.0.1");
+        }
+
+        std::cout << "root uid : 0. Given is uid: " << getuid() << std::endl;
+
+        int ret = TracerouteCheck(names, type, max_ttl, wait_ms, rounds);
+        if (ret < 0)
+        {
+            std::printf("[Error]: %d\n", ret);
+        }
+        else
+        {
+            std::printf("[Success]: %d/%zu reached\n", ret, names.size());
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+
+    return 0;
+}
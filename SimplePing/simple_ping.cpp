@@ -8,6 +8,10 @@
  * @copyright Copyright (c) 2023
  *
  */
+#if defined(__MACH__)
+#define __APPLE_USE_RFC_3542 // IPV6_RECVHOPLIMIT
+#endif
+
 #include <test_utils.hpp>
 
 // ping
@@ -19,46 +23,54 @@
 #include <time.h>
 #include <unistd.h>
 #include <poll.h>
+#include <netinet/icmp6.h> // icmp6_hdr, icmp6_filter
+#include <thread>
+#include <algorithm> // std::min
+
+#include <NetUtils/packet_view.hpp>
+#if defined(__linux__)
+#include <NetUtils/socket_filter.hpp>
+#include <NetUtils/timestamping.hpp>
+#endif
 
 #define BUFSIZE 1500
 #define ECHO_HDR_SIZE 8
 
-/* チェックサム作成 */
-static int CalcChecksum(u_short *ptr, int nbytes)
+#if defined(__linux__)
+/* 送信時刻(SND)をエラーキューから読む. 1つずつ送るので, 今回の送信より前の時刻は前回分として捨てる. */
+static void ReadPingTxTimestamps(int soc, const struct timeval *sendtime, is::net::PacketTimestamps *tx)
 {
-    long sum;
-    u_short oddbyte;
-    u_short answer;
-
-    /* 対象となるパケットに対して,
-    16ビット毎の1の補数和をとり,
-    更にそれの1の補数をとる*/
-
-    // パケット(先頭ptr, 長さnbytes)のメモリを16bit毎に和を取る.
-    sum = 0;
-    while (nbytes > 1)
+    uint64_t app_ns = (uint64_t)sendtime->tv_sec * 1000000000ull + (uint64_t)sendtime->tv_usec * 1000ull;
+    is::net::TxTimestamp stamp;
+    while (is::net::ReadTxTimestamp(soc, &stamp) > 0)
     {
-        sum += *ptr++; // 16bit
-        nbytes -= 2;   // 2byte = 16bit
+        if (stamp.mType != SCM_TSTAMP_SND || stamp.mStamp.mSoftwareNs < app_ns)
+        {
+            continue;
+        }
+        tx->mSoftwareNs = stamp.mStamp.mSoftwareNs ? stamp.mStamp.mSoftwareNs : tx->mSoftwareNs;
+        tx->mHardwareNs = stamp.mStamp.mHardwareNs ? stamp.mStamp.mHardwareNs : tx->mHardwareNs;
     }
-    // このタイミングで, nbytes == 0 or 1
+}
 
-    // nbytesは奇数バイト
-    if (nbytes == 1)
+/* RTTの内訳: アプリ -> カーネル送信 -> (ネットワーク) -> カーネル受信 -> アプリ */
+static void PrintPingStages(const struct timeval *sendtime,
+                            const is::net::PacketTimestamps &tx,
+                            const is::net::PacketTimestamps &rx,
+                            uint64_t app_rx_ns)
+{
+    uint64_t app_tx_ns = (uint64_t)sendtime->tv_sec * 1000000000ull + (uint64_t)sendtime->tv_usec * 1000ull;
+    std::printf("    stages: app->kernel %.1f us, kernel tx->rx %.1f us, kernel->app %.1f us",
+                (double)is::net::StageNs(tx.mSoftwareNs, app_tx_ns) / 1000.0,
+                (double)is::net::StageNs(rx.mSoftwareNs, tx.mSoftwareNs) / 1000.0,
+                (double)is::net::StageNs(app_rx_ns, rx.mSoftwareNs) / 1000.0);
+    if (tx.mHardwareNs != 0 && rx.mHardwareNs != 0)
     {
-        oddbyte = 0;
-        *((u_char *)&oddbyte) = *(u_char *)ptr; // 先頭ポインタptrの先頭8bit
-        sum += oddbyte;
+        std::printf(", wire rtt %.1f us (PHC)", (double)is::net::StageNs(rx.mHardwareNs, tx.mHardwareNs) / 1000.0);
     }
-
-    // 1の補数を取る
-    sum = (sum >> 16) + (sum & 0xFFFF);
-    sum += (sum >> 16);
-
-    answer = ~sum;
-
-    return answer;
+    std::printf("\n");
 }
+#endif
 
 /* ping送信 */
 static int SendPing(int soc,
@@ -70,17 +82,9 @@ static int SendPing(int soc,
     struct hostent *host;
     struct sockaddr_in *sinp;
     struct sockaddr sa;
-
-#if defined(__linux__)
-    struct icmphdr *icp;
-#elif defined(__MACH__)
-    struct icmp *icp;
-#else
-    // Windows
-#endif
     unsigned char *ptr;
     int psize;
-    int n;
+    ssize_t n;
     char sbuff[BUFSIZE];
 
     sinp = (struct sockaddr_in *)&sa;
@@ -105,15 +109,12 @@ static int SendPing(int soc,
     gettimeofday(sendtime, NULL);
 
     /* 送信データ作成 */
+    // ワイヤ上のバイト列として書き込むので, OSごとのicmp構造体の違いは無い.
     std::memset(sbuff, 0, BUFSIZE);
-#if defined(__linux__)
-
-#elif defined(__MACH__)
-    icp = (struct icmp *)sbuff;
-    icp->icmp_type = ICMP_ECHO;
-    icp->icmp_code = 0;
-    icp->icmp_hun.ih_idseq.icd_id = htons((unsigned short)getpid()); // Intel リトルエンディアン形式 -> INet ビッグエンディアン形式
-    icp->icmp_hun.ih_idseq.icd_seq = htons(sqc); // シーケンス番号
+    is::net::WriteIcmpEchoHeader((uint8_t *)sbuff,
+                                 ICMP_ECHO,
+                                 (unsigned short)getpid(), // ID
+                                 sqc);                     // シーケンス番号
     ptr = (unsigned char *)&sbuff[ECHO_HDR_SIZE];
     psize = len - ECHO_HDR_SIZE; // 全体 : len, Echo Header : ECHO_HDR_SIZE
     for (; psize; psize--)       // 残りバイトにパディング
@@ -122,14 +123,11 @@ static int SendPing(int soc,
     }
     ptr = (unsigned char *)&sbuff[ECHO_HDR_SIZE]; // Echo Headerの末尾(残りバイトの先頭)
     std::memcpy(ptr, sendtime, sizeof(struct timeval));
-    icp->icmp_cksum = CalcChecksum((u_short *)icp, len);
-#else
-
-#endif
+    is::net::StoreBe16((uint8_t *)&sbuff[2], is::net::InternetChecksum((const uint8_t *)sbuff, len));
 
     /* 送信 */
     n = sendto(soc, sbuff, len, 0, &sa, sizeof(struct sockaddr));
-    std::printf("send %d bytes\n", n);
+    std::printf("send %zd bytes\n", n);
     if (n == len)
     {
         return 0;
@@ -151,16 +149,6 @@ static int CheckPacket(char *rbuff,
                        struct timeval *recvtime,
                        double *diff)
 {
-#if defined(__linux__)
-
-#elif defined(__MACH__)
-    struct ip *iph;
-    struct icmp *icp;
-
-#else
-    // Windows
-#endif
-
     unsigned char *ptr;
 
     /* RTTを計算(ms) */
@@ -168,53 +156,43 @@ static int CheckPacket(char *rbuff,
             (double)(recvtime->tv_usec - sendtime->tv_usec) / 1000000.0;
 
     /* 受信バッファにはIPヘッダも含まれている */
-#if defined(__linux__)
-
-#elif defined(__MACH__)
-    iph = (struct ip *)rbuff;
-    *ttl = iph->ip_ttl;
-#else
-    // Windows
-#endif
+    is::net::Ipv4View iph(rbuff, nbytes);
+    if (!iph.valid())
+    {
+        return -3000; // IPヘッダ エラー
+    }
+    int iphlen = (int)iph.headerLength(); // IPヘッダ長 [byte]
+    *ttl = iph.ttl();
 
     /* ICMPヘッダ */
-#if defined(__linux__)
-
-#elif defined(__MACH__)
-    icp = (struct icmp *)(rbuff + iph->ip_hl * 4);
-#else
-    // Windows
-#endif
+    is::net::IcmpView icp(iph.payload());
 
     /* 内容の確認 */
-#if defined(__linux__)
-
-#elif defined(__MACH__)
-    if (ntohs(icp->icmp_hun.ih_idseq.icd_id) != (unsigned short)getpid())
+    if (!icp.valid() || icp.id() != (unsigned short)getpid())
     {
-        std::printf("%s\n", strerror(errno));
         return 1; // プロセスID エラー
     }
-    if (nbytes < len + iph->ip_hl * 4)
+    if (nbytes < len + iphlen)
     {
         return -3000; // IPヘッダ エラー
     }
-    if (icp->icmp_type != ICMP_ECHOREPLY)
+    if (icp.type() != ICMP_ECHOREPLY)
     {
         return -3010; // ICMPタイプ エラー
     }
-    if (ntohs(icp->icmp_hun.ih_idseq.icd_seq) != sqc)
+    if (!icp.checksumValid())
+    {
+        return -3020; // チェックサム エラー
+    }
+    if (icp.seq() != sqc)
     {
         return -3030; // シーケンス番号 エラー
     }
-#else
-    // Windows
-#endif
 
-    ptr = (unsigned char *)(rbuff + iph->ip_hl * 4 + ECHO_HDR_SIZE); // ICMPデータの先頭ポインタ
-    std::memcpy(sendtime, ptr, sizeof(struct timeval));              // 送信時刻を取得
+    ptr = (unsigned char *)(rbuff + iphlen + ECHO_HDR_SIZE); // ICMPデータの先頭ポインタ
+    std::memcpy(sendtime, ptr, sizeof(struct timeval));      // 送信時刻を取得
     ptr += sizeof(struct timeval);
-    int rest_datasize = nbytes - iph->ip_hl * 4 - ECHO_HDR_SIZE - sizeof(struct timeval);
+    int rest_datasize = nbytes - iphlen - ECHO_HDR_SIZE - (int)sizeof(struct timeval);
     for (int i = rest_datasize; i > 0; i--)
     {
         // すべて0xA5の詰め物
@@ -226,7 +204,7 @@ static int CheckPacket(char *rbuff,
 
     std::printf(
         "%d bytes from %s : icmp_seq=%d ttl=%d time=%.2f ms\n",
-        nbytes - iph->ip_hl * 4,
+        nbytes - iphlen,
         inet_ntoa(from->sin_addr),
         sqc,
         *ttl,
@@ -241,12 +219,18 @@ static int RecvPing(int soc, int len, unsigned short sqc, timeval *sendtime, int
     double diff;
     int nready;
     int ret;
-    int nbytes;
+    ssize_t nbytes;
     int ttl;
     struct sockaddr_in from;
     socklen_t fromlen;
     struct timeval recvtime;
     char rbuff[BUFSIZE];
+    char cbuff[256]; // 補助データ(SCM_TIMESTAMPING)
+    struct iovec iov;
+    struct msghdr msg;
+#if defined(__linux__)
+    is::net::PacketTimestamps tx_stamps, rx_stamps;
+#endif
 
     std::memset(rbuff, 0, BUFSIZE);
 
@@ -283,16 +267,46 @@ static int RecvPing(int soc, int len, unsigned short sqc, timeval *sendtime, int
             }
         }
 
-        /* 受信 */
+#if defined(__linux__)
+        /* 送信時刻はエラーキューに届く(POLLERR) */
+        if (targets[0].revents & POLLERR)
+        {
+            ReadPingTxTimestamps(soc, sendtime, &tx_stamps);
+            if (!(targets[0].revents & POLLIN))
+            {
+                continue;
+            }
+        }
+#endif
+
+        /* 受信 (受信時刻は補助データで受け取る) */
         fromlen = sizeof(from);
-        nbytes = recvfrom(soc, rbuff, sizeof(rbuff), 0, (struct sockaddr *)&from, &fromlen);
+        iov.iov_base = rbuff;
+        iov.iov_len = sizeof(rbuff);
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &from;
+        msg.msg_namelen = fromlen;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cbuff;
+        msg.msg_controllen = sizeof(cbuff);
+        nbytes = recvmsg(soc, &msg, 0);
+        if (nbytes < 0)
+        {
+            std::printf("%s\n", strerror(errno));
+            return -2020;
+        }
 
         /* 受信時刻 */
         gettimeofday(&recvtime, NULL);
+#if defined(__linux__)
+        uint64_t app_rx_ns = is::net::RealtimeNs();
+        is::net::ParseTimestamps(&msg, &rx_stamps);
+#endif
 
         /* 受信パケットの確認 */
         ret = CheckPacket(rbuff,
-                          nbytes,
+                          (int)nbytes, // BUFSIZE以下
                           len,
                           &from,
                           sqc,
@@ -306,6 +320,10 @@ static int RecvPing(int soc, int len, unsigned short sqc, timeval *sendtime, int
         case /* constant-expression */ 0:
         {
             /* 自プロセスREPLYを正常に受信 */
+#if defined(__linux__)
+            ReadPingTxTimestamps(soc, sendtime, &tx_stamps); // 受信より後に届いた場合
+            PrintPingStages(sendtime, tx_stamps, rx_stamps, app_rx_ns);
+#endif
             return (int(diff * 1000.0));
         }
 
@@ -352,6 +370,20 @@ int PingCheck(char *name, int len, int times, int timeout_sec)
         return -300;
     }
 
+#if defined(__linux__)
+    /* カーネル内フィルタ: 他プロセス宛のEcho ReplyやICMPはコピーもwakeupもさせない */
+    if (is::net::AttachSocketFilter(soc, is::net::IcmpEchoReplyIdFilter((unsigned short)getpid())) != 0)
+    {
+        std::printf("[Error] setsockopt SO_ATTACH_FILTER: %s\n", strerror(errno)); // CheckPacketで弾くので続行
+    }
+
+    /* 送受信時刻 (RTTの内訳用). ハードウェア時刻はNIC側で有効なら付く. */
+    if (is::net::EnableTimestamping(soc, is::net::kTimestampingRx | is::net::kTimestampingTx) != 0)
+    {
+        std::printf("[Error] setsockopt SO_TIMESTAMPING: %s\n", strerror(errno));
+    }
+#endif
+
     for (int i = 0; i < times; ++i)
     {
         /* Echo Requestの送信 */
@@ -369,7 +401,7 @@ int PingCheck(char *name, int len, int times, int timeout_sec)
 
         /* スリープ */
 #if defined(__linux__)
-
+        sleep(1);
 #elif defined(__MACH__)
         sleep(1);
 #else
@@ -379,7 +411,7 @@ int PingCheck(char *name, int len, int times, int timeout_sec)
 
     /* ソケットを閉じる */
 #if defined(__linux__)
-
+    close(soc);
 #elif defined(__MACH__)
     close(soc);
 #else
@@ -396,11 +428,444 @@ int PingCheck(char *name, int len, int times, int timeout_sec)
     }
 }
 
+/* ICMPv6 ping送信 */
+static int SendPing6(int soc,
+                     const struct sockaddr_in6 *dest,
+                     int len,
+                     unsigned short sqc,
+                     struct timeval *sendtime)
+{
+    unsigned char *ptr;
+    int psize;
+    ssize_t n;
+    char sbuff[BUFSIZE];
+
+    /* 送信時間 */
+    gettimeofday(sendtime, NULL);
+
+    /* 送信データ作成 */
+    std::memset(sbuff, 0, BUFSIZE);
+    is::net::WriteIcmpEchoHeader((uint8_t *)sbuff,
+                                 ICMP6_ECHO_REQUEST,
+                                 (unsigned short)getpid(), // SOCK_DGRAMの場合はカーネルが書き換える
+                                 sqc);                     // シーケンス番号
+    ptr = (unsigned char *)&sbuff[ECHO_HDR_SIZE];
+    psize = len - ECHO_HDR_SIZE;
+    for (; psize; psize--)
+    {
+        *ptr++ = (unsigned char)0xA5; // 仮データ
+    }
+    ptr = (unsigned char *)&sbuff[ECHO_HDR_SIZE];
+    std::memcpy(ptr, sendtime, sizeof(struct timeval));
+    // ICMPv6のチェックサムは擬似ヘッダ(送信元/宛先IPv6アドレス)を含むため, カーネルに計算させる.
+
+    /* 送信 */
+    n = sendto(soc, sbuff, len, 0, (const struct sockaddr *)dest, sizeof(struct sockaddr_in6));
+    std::printf("send %zd bytes (ICMPv6)\n", n);
+    if (n == len)
+    {
+        return 0;
+    }
+    else
+    {
+        return -1000;
+    }
+}
+
+/* ICMPv6 受信パケットの確認 */
+static int CheckPacket6(char *rbuff,
+                        int nbytes,
+                        int len,
+                        struct sockaddr_in6 *from,
+                        unsigned short sqc,
+                        int hlim, /* hop limit */
+                        bool check_id,
+                        struct timeval *sendtime,
+                        struct timeval *recvtime,
+                        double *diff)
+{
+    unsigned char *ptr;
+    char from_name[INET6_ADDRSTRLEN];
+
+    /* RTTを計算(ms) */
+    *diff = (double)(recvtime->tv_sec - sendtime->tv_sec) +
+            (double)(recvtime->tv_usec - sendtime->tv_usec) / 1000000.0;
+
+    /* IPv6のRAWソケットは受信バッファにIPv6ヘッダを含まない */
+    is::net::IcmpView icp6(rbuff, nbytes);
+    if (!icp6.valid())
+    {
+        return -3000; // ICMPv6ヘッダ エラー
+    }
+
+    /* 内容の確認 */
+    if (icp6.type() != ICMP6_ECHO_REPLY)
+    {
+        return 1; // ICMP6_FILTERをすり抜けた他のICMPv6
+    }
+    if (check_id && icp6.id() != (unsigned short)getpid())
+    {
+        return 1; // プロセスID エラー
+    }
+    if (nbytes < len)
+    {
+        return -3000; // 長さ エラー
+    }
+    if (icp6.seq() != sqc)
+    {
+        return -3030; // シーケンス番号 エラー
+    }
+
+    ptr = (unsigned char *)(rbuff + ECHO_HDR_SIZE);     // ICMPv6データの先頭ポインタ
+    std::memcpy(sendtime, ptr, sizeof(struct timeval)); // 送信時刻を取得
+    ptr += sizeof(struct timeval);
+    int rest_datasize = nbytes - ECHO_HDR_SIZE - (int)sizeof(struct timeval);
+    for (int i = rest_datasize; i > 0; i--)
+    {
+        // すべて0xA5の詰め物
+        if (*ptr++ != 0xA5)
+        {
+            return -3040; // データ内容 エラー
+        }
+    }
+
+    inet_ntop(AF_INET6, &(from->sin6_addr), from_name, sizeof(from_name));
+    std::printf(
+        "%d bytes from %s : icmp_seq=%d hlim=%d time=%.2f ms\n",
+        nbytes,
+        from_name,
+        sqc,
+        hlim,
+        *diff * 1000.0);
+
+    return 0;
+}
+
+static int RecvPing6(int soc, int len, unsigned short sqc, bool check_id, timeval *sendtime, int timeout_sec)
+{
+    struct pollfd targets[1];
+    double diff;
+    int nready;
+    int ret;
+    ssize_t nbytes;
+    int hlim;
+    struct sockaddr_in6 from;
+    struct timeval recvtime;
+    char rbuff[BUFSIZE];
+    char cbuff[256]; // 補助データ(IPV6_HOPLIMIT, SCM_TIMESTAMPING)
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+#if defined(__linux__)
+    is::net::PacketTimestamps tx_stamps, rx_stamps;
+#endif
+
+    std::memset(rbuff, 0, BUFSIZE);
+
+    while (true)
+    {
+        // ポーリング設定
+        targets[0].fd = soc;
+        targets[0].events = POLLIN | POLLERR;
+        nready = poll(targets, 1, timeout_sec * 1000); // 監視チェック
+
+        // 結果
+        if (nready == 0)
+        {
+            // タイムアウト
+            return -2000;
+        }
+        if (nready == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue; // 再度受信バッファの確認
+            }
+            else
+            {
+                std::printf("%s\n", strerror(errno));
+                return -2010;
+            }
+        }
+
+#if defined(__linux__)
+        /* 送信時刻はエラーキューに届く(POLLERR) */
+        if (targets[0].revents & POLLERR)
+        {
+            ReadPingTxTimestamps(soc, sendtime, &tx_stamps);
+            if (!(targets[0].revents & POLLIN))
+            {
+                continue;
+            }
+        }
+#endif
+
+        /* 受信 (ホップリミットは補助データで受け取る) */
+        iov.iov_base = rbuff;
+        iov.iov_len = sizeof(rbuff);
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &from;
+        msg.msg_namelen = sizeof(from);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cbuff;
+        msg.msg_controllen = sizeof(cbuff);
+        nbytes = recvmsg(soc, &msg, 0);
+        if (nbytes < 0)
+        {
+            std::printf("%s\n", strerror(errno));
+            return -2020;
+        }
+
+        /* 受信時刻 */
+        gettimeofday(&recvtime, NULL);
+#if defined(__linux__)
+        uint64_t app_rx_ns = is::net::RealtimeNs();
+        is::net::ParseTimestamps(&msg, &rx_stamps);
+#endif
+
+        hlim = -1;
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_HOPLIMIT)
+            {
+                std::memcpy(&hlim, CMSG_DATA(cmsg), sizeof(int));
+            }
+        }
+
+        /* 受信パケットの確認 */
+        ret = CheckPacket6(rbuff,
+                           (int)nbytes, // BUFSIZE以下
+                           len,
+                           &from,
+                           sqc,
+                           hlim,
+                           check_id,
+                           sendtime,
+                           &recvtime,
+                           &diff);
+
+        switch (ret)
+        {
+        case 0:
+        {
+            /* 自プロセスREPLYを正常に受信 */
+#if defined(__linux__)
+            ReadPingTxTimestamps(soc, sendtime, &tx_stamps); // 受信より後に届いた場合
+            PrintPingStages(sendtime, tx_stamps, rx_stamps, app_rx_ns);
+#endif
+            return (int(diff * 1000.0));
+        }
+
+        case 1:
+        {
+            /* 他プロセスREPLYだった */
+            if (diff > timeout_sec)
+            {
+                // タイムアウト
+                return -2000;
+            }
+            break;
+        }
+
+        default:
+            /* 自プロセスREPLYだが内容が異常 */
+            ;
+        }
+    } // while
+}
+
+/* ICMPv6 ping送受信 (解決済みの宛先. リンクローカルのsin6_scope_idもそのまま使う) */
+int PingCheck6(const struct sockaddr_in6 &dest, int len, int times, int timeout_sec)
+{
+    int soc;
+    struct timeval sendtime;
+    int ret;
+    int total = 0, total_no = 0;
+    bool check_id = true;
+    constexpr int on = 1;
+
+    /* ソケット作成 */
+    // RAWソケットが作れない(非root)場合はICMPv6データグラムソケット(ping socket)を使う.
+    // データグラムソケットではカーネルがIDを割り当て, 自ソケット宛のEcho Replyのみを配送する.
+    if ((soc = socket(AF_INET6, SOCK_RAW, IPPROTO_ICMPV6)) < 0)
+    {
+        if ((errno != EPERM && errno != EACCES) ||
+            (soc = socket(AF_INET6, SOCK_DGRAM, IPPROTO_ICMPV6)) < 0)
+        {
+            std::printf("%s\n", strerror(errno));
+            return -300;
+        }
+        check_id = false;
+    }
+
+    /* カーネル内フィルタ: Echo Reply以外のICMPv6(近隣探索など)をユーザー空間に上げない */
+    if (check_id)
+    {
+        struct icmp6_filter filter;
+        ICMP6_FILTER_SETBLOCKALL(&filter);
+        ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &filter);
+        if (setsockopt(soc, IPPROTO_ICMPV6, ICMP6_FILTER, &filter, sizeof(filter)) != 0)
+        {
+            std::printf("[Error] setsockopt ICMP6_FILTER: %s\n", strerror(errno));
+            close(soc);
+            return -310;
+        }
+#if defined(__linux__)
+        // ICMP6_FILTERは種別までしか見ないので, IDもカーネル内で照合する
+        if (is::net::AttachSocketFilter(soc, is::net::Icmp6EchoReplyIdFilter((unsigned short)getpid())) != 0)
+        {
+            std::printf("[Error] setsockopt SO_ATTACH_FILTER: %s\n", strerror(errno));
+        }
+#endif
+    }
+
+    /* ホップリミットを補助データで受け取る */
+    if (setsockopt(soc, IPPROTO_IPV6, IPV6_RECVHOPLIMIT, &on, sizeof(on)) != 0)
+    {
+        std::printf("[Error] setsockopt IPV6_RECVHOPLIMIT: %s\n", strerror(errno));
+    }
+
+#if defined(__linux__)
+    /* 送受信時刻 (RTTの内訳用) */
+    if (is::net::EnableTimestamping(soc, is::net::kTimestampingRx | is::net::kTimestampingTx) != 0)
+    {
+        std::printf("[Error] setsockopt SO_TIMESTAMPING: %s\n", strerror(errno));
+    }
+#endif
+
+    for (int i = 0; i < times; ++i)
+    {
+        /* Echo Requestの送信 */
+        ret = SendPing6(soc, &dest, len, (unsigned short)(i + 1), &sendtime);
+        if (ret == 0)
+        {
+            /* Echo Replyを受信 */
+            ret = RecvPing6(soc, len, (unsigned short)(i + 1), check_id, &sendtime, timeout_sec);
+            if (ret >= 0)
+            {
+                total += ret;
+                total_no++;
+            }
+        }
+
+        /* スリープ */
+        sleep(1);
+    }
+
+    /* ソケットを閉じる */
+    close(soc);
+
+    if (total_no > 0)
+    {
+        return total / total_no;
+    }
+    else
+    {
+        return -1;
+    }
+}
+
+/* ICMPv6 ping送受信 (名前から) */
+int PingCheck6(const char *name, int len, int times, int timeout_sec)
+{
+    struct addrinfo hints, *response;
+    struct sockaddr_in6 dest;
+
+    /* 宛先の確定 */
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET6;
+    hints.ai_socktype = SOCK_RAW;
+    hints.ai_protocol = IPPROTO_ICMPV6;
+    int ret = getaddrinfo(name, NULL, &hints, &response);
+    if (ret != 0)
+    {
+        std::printf("No IPv6 Address : %s (%s)\n", name, gai_strerror(ret));
+        return -100;
+    }
+    std::memcpy(&dest, response->ai_addr, sizeof(dest));
+    freeaddrinfo(response);
+
+    return PingCheck6(dest, len, times, timeout_sec);
+}
+
+/* デュアルスタック ping送受信 (IPv4/IPv6を並行して計測) */
+int PingCheckDual(const char *name, int len, int times, int timeout_sec)
+{
+    struct addrinfo hints, *response_list, *response;
+    char addr_name_ipv4[INET_ADDRSTRLEN] = "";
+    char addr_name_ipv6[NI_MAXHOST] = ""; // fe80::1%eth0 のようにスコープ付き
+    struct sockaddr_in6 dest6;
+    int ret4 = -1, ret6 = -1;
+
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = PF_UNSPEC; // IPv4/IPv6両方
+    hints.ai_socktype = SOCK_RAW;
+    int error = getaddrinfo(name, NULL, &hints, &response_list);
+    if (error != 0)
+    {
+        std::printf("[Error] %s\n", gai_strerror(error));
+        return -100;
+    }
+    for (response = response_list; response != nullptr; response = response->ai_next)
+    {
+        if (response->ai_family == AF_INET && addr_name_ipv4[0] == '\0')
+        {
+            inet_ntop(AF_INET, &((struct sockaddr_in *)response->ai_addr)->sin_addr,
+                      addr_name_ipv4, sizeof(addr_name_ipv4));
+        }
+        if (response->ai_family == AF_INET6 && addr_name_ipv6[0] == '\0')
+        {
+            // 文字列に戻すとsin6_scope_idが落ちるので, アドレス構造体ごと渡す
+            std::memcpy(&dest6, response->ai_addr, sizeof(dest6));
+            if (getnameinfo(response->ai_addr, response->ai_addrlen, addr_name_ipv6, sizeof(addr_name_ipv6),
+                            nullptr, 0, NI_NUMERICHOST) != 0)
+            {
+                std::snprintf(addr_name_ipv6, sizeof(addr_name_ipv6), "?");
+            }
+        }
+    }
+    freeaddrinfo(response_list);
+
+    std::printf("[Status] %s -> IPv4: `%s`, IPv6: `%s`\n", name, addr_name_ipv4, addr_name_ipv6);
+
+    // 各ファミリのソケットは独立しているので, 別スレッドで同時に送受信する.
+    std::vector<std::thread> workers;
+    if (addr_name_ipv4[0] != '\0')
+    {
+        workers.emplace_back([&]() { ret4 = PingCheck(addr_name_ipv4, len, times, timeout_sec); });
+    }
+    if (addr_name_ipv6[0] != '\0')
+    {
+        workers.emplace_back([&]() { ret6 = PingCheck6(dest6, len, times, timeout_sec); });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    if (addr_name_ipv4[0] != '\0')
+    {
+        std::printf("[Status] IPv4 %s : %d\n", addr_name_ipv4, ret4);
+    }
+    if (addr_name_ipv6[0] != '\0')
+    {
+        std::printf("[Status] IPv6 %s : %d\n", addr_name_ipv6, ret6);
+    }
+
+    // どちらかのファミリで到達できれば成功(速い方のRTT)
+    if (ret4 >= 0 && ret6 >= 0)
+    {
+        return std::min(ret4, ret6);
+    }
+    return ret4 >= 0 ? ret4 : ret6;
+}
+
 int main(int argc, char **argv)
 {
     try
     {
-        char ip_address[] = "127.0.0.1";
+        const char *host_name = (argc > 1) ? argv[1] : "localhost"; // IPv4/IPv6どちらも可
 
         std::cout << "root uid : 0. Given is uid: " << getuid() << std::endl;
 
@@ -409,10 +874,10 @@ int main(int argc, char **argv)
          */
 
         /* ping送受信 */
-        int ret = PingCheck(ip_address,
-                            64, // 64バイトのICMPパケット
-                            5,  // 5回送受信を繰り返し
-                            1); // 待ち時間は1秒
+        int ret = PingCheckDual(host_name,
+                                64, // 64バイトのICMPパケット
+                                5,  // 5回送受信を繰り返し
+                                1); // 待ち時間は1秒
 
         if (ret < 0)
         {
@@ -7,6 +7,17 @@
  *
  * @copyright Copyright (c) 2023
  *
+ * usage: dual_tcp_server [-M metrics_port]
+ *
+ * acceptループの出力はNetUtils/async_log.hppに積むだけで, printfとfflushは書き出しスレッドが行う
+ * (pollのタイムアウト毎の表示はdebugレベル. -DIS_NET_LOG_LEVEL=1 で出る).
+ *
+ * `-M port` はNetUtils/metrics.hppの組み込みメトリクス(accept数, 接続数, バイト数, タイムアウト, errno毎のエラー,
+ * acceptから切断までの時間)を http://<host>:port/metrics にPrometheusのテキスト形式で出す.
+ *
+ * Linuxではlistenソケット毎に1秒毎にSO_MEMINFO(バッファ, sk_drops)とTCP_INFO(acceptキューの長さと上限)を読み,
+ * acceptした接続は閉じる前にTCP_INFO(rtt, cwnd, 再送数, 未確認セグメント)を読んでメトリクスへ出す
+ * (NetUtils/socket_stats.hpp).
  */
 #include <test_utils.hpp>
 
@@ -18,10 +29,13 @@
 #include <netinet/in.h>
 #include <errno.h>
 #include <poll.h>
+
+#include <NetUtils/async_log.hpp>
+#include <NetUtils/metrics.hpp>
 // #include <sys/epoll.h> // No MacOS  http://linuxjm.osdn.jp/html/LDP_man-pages/man7/epoll.7.html
 
 #if defined(__linux__)
-
+#include <NetUtils/socket_stats.hpp>
 #elif defined(__MACH__)
 
 #else
@@ -114,6 +128,27 @@ int main(int argc, char **argv)
 {
     try
     {
+        /* 0.オプション */
+        int metrics_port = 0;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::strcmp(argv[i], "-M") == 0)
+            {
+                metrics_port = std::atoi(argv[i + 1]);
+            }
+        }
+        is::net::NetMetrics &metrics = is::net::NetMetrics::instance();
+        is::net::MetricsHttpServer metrics_server;
+        if (metrics_port > 0)
+        {
+            if (metrics_server.start((unsigned short)metrics_port) != 0)
+            {
+                std::printf("[Error] metrics port %d: %s\n", metrics_port, strerror(errno));
+                throw std::runtime_error("MetricsHttpServer");
+            }
+            std::printf("[Status] metrics: http://0.0.0.0:%d/metrics\n", metrics_port);
+        }
+
         /* 1.名前解決(FQDN -> IP) */
         hints.ai_family = PF_UNSPEC;     // IPv4/IPv6両刀待ち
         hints.ai_flags = AI_PASSIVE;     // 自動設定; IPv4: IN_ADDR_ANY, IPv6: IN6_ADDR_ANY_INIT
@@ -204,6 +239,15 @@ int main(int argc, char **argv)
         }
         std::printf("[Done] Step4. listen sockets and accepting client ...\n");
 
+#if defined(__linux__)
+        // listenソケットのSO_MEMINFO/acceptキュー, 接続のTCP_INFO
+        is::net::SocketStatsMonitor socket_stats;
+        for (const auto &kv : map_tcp_sockets)
+        {
+            socket_stats.watch(kv.first);
+        }
+#endif
+
         /* 5.accept処理 (クライアントからの接続要求を受ける) */
         // I/Oの多重化 https://blog.shibayu36.org/entry/20120101/1325418188
         // poll http://linuxjm.osdn.jp/html/LDP_man-pages/man2/poll.2.html
@@ -234,19 +278,21 @@ int main(int argc, char **argv)
         {
             // タイムアウトまでBlocking [ms]
             nready = poll(targets.data(), num_targets, 300); // 300[ms] 
+#if defined(__linux__)
+            socket_stats.sample(is::net::MetricsClockNs() / 1000000);
+#endif
 
             if (nready == 0)
             {
                 // タイムアウト
+                metrics.mTimeouts.inc();
                 if (timeout_count < 20)
                 {
-                    std::printf("*");
-                    std::fflush(stdout); // https://daeudaeu.com/fflush/#fflush-3
+                    IS_LOG_DEBUG("poll timeout %d", timeout_count + 1);
                     timeout_count++;
                 }
                 else
                 {
-                    std::printf("\n");
                     timeout_count = 0;
                 }
                 
@@ -255,15 +301,16 @@ int main(int argc, char **argv)
 
             if (nready == -1)
             {
+                metrics.mPollErrors.inc(errno);
                 if (errno == EINTR)
                 {
                     // 要求されたイベントのどれかが起こる前にシグナルが発生した
-                    std::printf("[Error] EINTR -> continue: %s\n");
+                    IS_LOG_WARN("poll: EINTR -> continue");
                     continue;
                 }
                 else
                 {
-                    std::printf("[Error] poll: %s\n", strerror(errno));
+                    IS_LOG_ERROR("poll: %s", strerror(errno));
                     break; // whileを抜ける
                 }
             }
@@ -291,26 +338,41 @@ int main(int argc, char **argv)
             socket_to_client = accept(passive_socket, &client_info, &addlen);
             if (socket_to_client == -1)
             {
+                metrics.mAcceptErrors.inc(errno);
                 std::printf("[Error] %s\n", strerror(errno));
                 socket_address_error(passive_socket, address);
                 throw std::runtime_error("accept");
             }
-            std::printf("[Done] Step5. accept client; passive_socket %d -> socket_to_client %d\n", 
+            IS_LOG_INFO("[Done] Step5. accept client; passive_socket %d -> socket_to_client %d",
                         passive_socket, socket_to_client);
+            uint64_t accepted_ns = is::net::MetricsClockNs();
+            metrics.mAccepts.inc();
+            metrics.mConnections.add(1);
+#if defined(__linux__)
+            socket_stats.watchConnection(socket_to_client);
+#endif
 
             sleep(250); // 250[ms]
 
             /* 6.socket_to_clientと通信 */
             HostInfo client_host_info = get_host_info(&client_info);
-            std::printf("Connection from : client %s, port=%s\n", 
-                        client_host_info.mNumericHostName.c_str(), 
+            IS_LOG_INFO("Connection from : client %s, port=%s",
+                        client_host_info.mNumericHostName.c_str(),
                         client_host_info.mNumericServiceName.c_str());
 
             // クライアントから受信
             char buf[BUFSIZE];
             std::memset(buf, 0, sizeof(buf));
             int n = read(socket_to_client, buf, sizeof(buf));
-            std::printf("read n=%d, message : %s\n", n, buf);
+            if (n < 0)
+            {
+                metrics.mRecvErrors.inc(errno);
+            }
+            else
+            {
+                metrics.mBytesReceived.inc((uint64_t)n);
+            }
+            IS_LOG_INFO("read n=%d, message : %s", n, buf);
 
             // クライアントに送信
             std:memset(buf, 0, sizeof(buf));
@@ -318,11 +380,28 @@ int main(int argc, char **argv)
                           server_host_info.mNumericHostName.c_str(),
                           server_host_info.mNumericServiceName.c_str());
             n = write(socket_to_client, buf, strnlen(buf, sizeof(buf)));
+            if (n < 0)
+            {
+                metrics.mSendErrors.inc(errno);
+            }
+            else
+            {
+                metrics.mBytesSent.inc((uint64_t)n);
+            }
 
             // クローズ
+#if defined(__linux__)
+            socket_stats.closeConnection(socket_to_client); // rtt, cwnd, 再送数
+#endif
             close(socket_to_client);
+            metrics.mConnections.sub(1);
+            metrics.mHandling.record(is::net::MetricsClockNs() - accepted_ns);
         }
 
+#if defined(__linux__)
+        socket_stats.print();
+#endif
+
         // クローズ
         for (auto& kv : map_tcp_sockets)
         {
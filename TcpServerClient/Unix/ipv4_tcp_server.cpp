@@ -7,6 +7,9 @@
  * 
  * @copyright Copyright (c) 2023
  * 
+ * usage: ipv4_tcp_server [-b spin_us] [-c cpu|auto]
+ * -b (Linux) は低遅延モード: 接続後のソケットにSO_BUSY_POLLとTCP_NODELAYを付け, 読み出しは
+ * spin_usの間スピンしてからepollで眠る(NetUtils/busy_poll.hpp). -c でスレッドをそのCPU(autoは隔離コア)に固定する.
  */
 #include <test_utils.hpp>
 
@@ -16,9 +19,12 @@
 #include <netinet/in.h> // socket_in
 #include <arpa/inet.h>  // inet_pton, inet_ntop
 #include <netdb.h>
+#include <algorithm> // std::max
 
 #if defined(__linux__)
-
+#include <netinet/tcp.h> // TCP_NODELAY
+#include <memory>
+#include <NetUtils/busy_poll.hpp>
 #elif defined(__MACH__)
 
 #else
@@ -43,6 +49,20 @@ int main(int argc, char** argv)
 {
     try
     {
+        long spin_us = -1; // -1: ブロッキング受信
+        const char *cpu = nullptr;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::strcmp(argv[i], "-b") == 0)
+            {
+                spin_us = std::max(0L, std::atol(argv[i + 1]));
+            }
+            else if (std::strcmp(argv[i], "-c") == 0)
+            {
+                cpu = argv[i + 1];
+            }
+        }
+
         /* 1.ソケットの作成 */
         if ((passive_socket = socket(AF_INET, SOCK_STREAM, 0)) < 0)
         {
@@ -96,9 +116,42 @@ int main(int argc, char** argv)
         unsigned short port_of_client = ntohs(client_info.sin_port);
         std::printf("connection from : client %s, port=%u\n", client_address, port_of_client);
 
+#if defined(__linux__)
+        /* 6-1.低遅延モード (ビジーポーリング, CPU固定) */
+        std::unique_ptr<is::net::BusyPollReceiver> busy;
+        if (spin_us >= 0)
+        {
+            const int on = 1;
+            setsockopt(socket_to_client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            is::net::BusyPollOptions options;
+            options.mSpinNs = (uint64_t)spin_us * 1000;
+            if (is::net::EnableBusyPoll(socket_to_client, options) != 0)
+            {
+                std::printf("[Warning] SO_BUSY_POLL: %s (user-space spin only)\n", strerror(errno));
+            }
+            busy.reset(new is::net::BusyPollReceiver(socket_to_client, options));
+            std::printf("[Done] Step4-1. busy poll (spin %ld us)\n", spin_us);
+        }
+        if (cpu != nullptr)
+        {
+            int target = is::net::ParseCpu(cpu);
+            if (target < 0 || is::net::PinThreadToCpu(target) != 0)
+            {
+                std::printf("[Warning] pin to cpu %s: %s\n", cpu, target < 0 ? "no isolated cpu" : strerror(errno));
+            }
+        }
+#else
+        (void)spin_us;
+        (void)cpu;
+#endif
+
         /* 7.クライアントからのメッセージを受信 */
         std::memset(buf, 0, sizeof(buf));
+#if defined(__linux__)
+        int n = (int)(busy ? busy->recv(buf, sizeof(buf), 0, -1) : read(socket_to_client, buf, sizeof(buf)));
+#else
         int n = read(socket_to_client, buf, sizeof(buf));
+#endif
         std::printf("read n=%d, message : %s\n", n , buf);
 
         /* 8.サーバーからクライアントへ送信 */
@@ -0,0 +1,133 @@
+/**
+ * @file async_log_bench.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 受信ループでのprintfと非同期バイナリログ(NetUtils/async_log.hpp)の呼び出し側の時間を比べる
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: async_log_bench [-t threads=1] [-n records=200000] > /dev/null
+ *
+ * 各スレッドがパケット1個分のログ(整数, 文字列, 浮動小数点)をn回出し, 1回あたりの時間(p50/p99/p99.9/最大)を比べる.
+ * ログの行はstdoutへ, 結果はstderrへ出すので, stdoutは/dev/nullかファイルへ向ける.
+ * レベルで消える呼び出し(debug)と, 呼び出し箇所の上限(IS_LOG_RATE, 1000件/秒)を付けた呼び出しも測る.
+ * 非同期ログはリングが満杯だと捨てるので, 捨てた数も表示する(書き出しが追いつく量かどうかの目安).
+ */
+#include <test_utils.hpp>
+
+#include <algorithm> // std::sort
+#include <thread>
+#include <vector>
+
+#include <NetUtils/async_log.hpp>
+
+static uint64_t NowNs()
+{
+    return is::net::LogClockNs();
+}
+
+static void PrintLatency(const char *label, std::vector<uint64_t> &samples, uint64_t elapsed_ns, size_t records)
+{
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&](double p) { return samples[(size_t)(p * (double)(samples.size() - 1))]; };
+    std::fprintf(stderr, "[Result] %-16s per call ns: p50 %6llu, p99 %7llu, p99.9 %8llu, max %9llu; %.1f Mrecords/s\n",
+                 label,
+                 (unsigned long long)percentile(0.50),
+                 (unsigned long long)percentile(0.99),
+                 (unsigned long long)percentile(0.999),
+                 (unsigned long long)samples.back(),
+                 (double)records / ((double)elapsed_ns / 1e9) / 1e6);
+}
+
+template <typename Func>
+static void Run(const char *label, int threads, int records, Func &&log_one)
+{
+    std::vector<std::vector<uint64_t>> samples(threads);
+    std::vector<std::thread> workers;
+    uint64_t start = NowNs();
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]() {
+            samples[t].reserve((size_t)records);
+            for (int i = 0; i < records; ++i)
+            {
+                uint64_t begin = NowNs();
+                log_one(t, i);
+                samples[t].push_back(NowNs() - begin);
+            }
+        });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    uint64_t elapsed = NowNs() - start;
+
+    std::vector<uint64_t> all;
+    for (auto &s : samples)
+    {
+        all.insert(all.end(), s.begin(), s.end());
+    }
+    PrintLatency(label, all, elapsed, all.size());
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        int threads = 1;
+        int records = 200000;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::strcmp(argv[i], "-t") == 0)
+            {
+                threads = std::max(1, std::atoi(argv[i + 1]));
+            }
+            else if (std::strcmp(argv[i], "-n") == 0)
+            {
+                records = std::max(1, std::atoi(argv[i + 1]));
+            }
+        }
+        std::fprintf(stderr, "[Done] Step1. %d threads x %d records\n", threads, records);
+
+        /* 1.printf (書式化 + stdoutのロック + 溜まったらwrite) */
+        Run("printf", threads, records, [](int t, int i) {
+            std::printf("Connection from : sender %s, port=%d, thread %d seq %d rtt %.3f\n", "192.0.2.1", 54321, t, i, 1.25);
+        });
+        std::fflush(stdout);
+
+        /* 1-1.printf + fflush (端末への行バッファ, タイムアウト表示のfflushと同じ) */
+        Run("printf+fflush", threads, records, [](int t, int i) {
+            std::printf("Connection from : sender %s, port=%d, thread %d seq %d rtt %.3f\n", "192.0.2.1", 54321, t, i, 1.25);
+            std::fflush(stdout);
+        });
+
+        /* 2.非同期ログ (レコードをリングに積むだけ) */
+        uint64_t dropped_before = is::net::AsyncLogger::instance().dropped();
+        Run("async log", threads, records, [](int t, int i) {
+            IS_LOG_INFO("Connection from : sender %s, port=%d, thread %d seq %d rtt %.3f", "192.0.2.1", 54321, t, i, 1.25);
+        });
+        is::net::AsyncLogger::instance().flush();
+        std::fprintf(stderr, "[Stats] async log: dropped %llu (ring %zu records per thread)\n",
+                     (unsigned long long)(is::net::AsyncLogger::instance().dropped() - dropped_before),
+                     is::net::kLogRingRecords);
+
+        /* 3.レベルで消える呼び出し (debug < IS_NET_LOG_LEVEL) */
+        Run("filtered debug", threads, records, [](int t, int i) {
+            IS_LOG_DEBUG("poll timeout thread %d seq %d", t, i);
+        });
+
+        /* 4.件/秒の上限付き (上限を超えた分は数えるだけ) */
+        Run("rate limited", threads, records, [](int t, int i) {
+            IS_LOG_RATE(is::net::kLogInfo, 1000, "recvfrom: thread %d seq %d", t, i);
+        });
+        is::net::AsyncLogger::instance().flush();
+        std::fprintf(stderr, "[Done] Step2. finished\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    return 0;
+}
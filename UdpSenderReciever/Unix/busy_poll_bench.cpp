@@ -0,0 +1,364 @@
+/**
+ * @file busy_poll_bench.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief ピンポンの往復時間でブロッキング受信とビジーポーリング受信(NetUtils/busy_poll.hpp)を比べる
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: busy_poll_bench [-m server|client] [-P udp|tcp] [-a address=127.0.0.1] [-p port=54340]
+ *                        [-b on|off] [-s spin_us=50] [-y on|off|auto] [-c cpu|auto] [-n count=20000] [-l payload_bytes=64]
+ *
+ * 先にserver, 次にclientを起動する. clientは1個送って同じ大きさの返事を受け取るまでの時間をn回測り,
+ * p50/p90/p99/p99.9/最大を表示する(最初の1000回は捨てる). serverは受け取ったものをそのまま返す.
+ * -b on は両側の受信をSO_BUSY_POLL + スピン(-s) -> epollにし, -c で受信スレッドを固定する
+ * (-b onで-c無しなら隔離コア(isolcpus=)があればそこへ). 比べるときは両側を同じ-bで起動する.
+ * 送信側と受信側が別のコアに居ないとスピンは相手の時間を奪うだけになる. -y on はスピンの合間にsched_yieldする
+ * (autoはオンラインのCPUが1つのときだけ).
+ */
+#include <test_utils.hpp>
+
+// udp, tcp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h> // TCP_NODELAY
+#include <arpa/inet.h> // inet_pton, inet_ntop
+#include <netdb.h>
+
+#include <algorithm> // std::sort
+#include <memory>
+#include <vector>
+
+#include <NetUtils/busy_poll.hpp>
+
+#define WARMUP 1000
+
+struct BenchConfig
+{
+    bool mServer = true;
+    bool mTcp = false;
+    const char *mAddress = "127.0.0.1";
+    unsigned short mPort = 54340;
+    bool mBusy = false;
+    uint64_t mSpinUs = 50;
+    const char *mYield = "auto";
+    const char *mCpu = nullptr;
+    int mCount = 20000;
+    size_t mPayload = 64;
+};
+
+/* 受信: -b offはブロッキング, onはBusyPollReceiver */
+class Receiver
+{
+public:
+    Receiver(int sock, const BenchConfig &config) : mSocket(sock)
+    {
+        if (!config.mBusy)
+        {
+            return;
+        }
+        is::net::BusyPollOptions options;
+        options.mSpinNs = config.mSpinUs * 1000;
+        options.mYield = std::strcmp(config.mYield, "on") == 0 ||
+                         (std::strcmp(config.mYield, "auto") == 0 && sysconf(_SC_NPROCESSORS_ONLN) == 1);
+        if (is::net::EnableBusyPoll(sock, options) != 0)
+        {
+            std::printf("[Warning] SO_BUSY_POLL: %s (user-space spin only)\n", strerror(errno));
+        }
+        mBusy.reset(new is::net::BusyPollReceiver(sock, options));
+        std::printf("[Status] busy poll: spin %llu us%s\n", (unsigned long long)config.mSpinUs, options.mYield ? " (yield)" : "");
+    }
+
+    ssize_t recvfrom(void *buf, size_t length, struct sockaddr *from, socklen_t *from_length, int timeout_ms)
+    {
+        if (mBusy)
+        {
+            return mBusy->recvfrom(buf, length, 0, from, from_length, timeout_ms);
+        }
+        return ::recvfrom(mSocket, buf, length, 0, from, from_length);
+    }
+
+    // TCP: lengthバイト揃うまで読む. 0: 相手が閉じた
+    ssize_t readFull(char *buf, size_t length)
+    {
+        size_t done = 0;
+        while (done < length)
+        {
+            ssize_t n = recvfrom(buf + done, length - done, nullptr, nullptr, -1);
+            if (n <= 0)
+            {
+                return n;
+            }
+            done += (size_t)n;
+        }
+        return (ssize_t)done;
+    }
+
+    void printStats(const char *label) const
+    {
+        if (!mBusy)
+        {
+            return;
+        }
+        const is::net::BusyPollStats &stats = mBusy->stats();
+        std::printf("[Stats] %s: received %llu, spin hits %llu (%.1f%%), sleeps %llu, spin time %.1f ms\n",
+                    label,
+                    (unsigned long long)stats.mReceived,
+                    (unsigned long long)stats.mSpinHits,
+                    stats.mReceived ? 100.0 * (double)stats.mSpinHits / (double)stats.mReceived : 0.0,
+                    (unsigned long long)stats.mSleeps,
+                    (double)stats.mSpinNs / 1e6);
+    }
+
+private:
+    int mSocket;
+    std::unique_ptr<is::net::BusyPollReceiver> mBusy;
+};
+
+static void PinReceiveThread(const BenchConfig &config)
+{
+    const char *cpu_text = config.mCpu != nullptr ? config.mCpu : (config.mBusy ? "auto" : nullptr);
+    if (cpu_text == nullptr)
+    {
+        return;
+    }
+    int cpu = is::net::ParseCpu(cpu_text);
+    if (cpu < 0)
+    {
+        std::printf("[Status] no isolated cpu (isolcpus=); thread not pinned\n");
+        return;
+    }
+    if (is::net::PinThreadToCpu(cpu) != 0)
+    {
+        std::printf("[Warning] pin to cpu %d: %s\n", cpu, strerror(errno));
+        return;
+    }
+    std::printf("[Status] pinned to cpu %d\n", cpu);
+}
+
+static int RunServer(const BenchConfig &config)
+{
+    int sock = socket(AF_INET, config.mTcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+        std::printf("[Error] %s\n", strerror(errno));
+        throw std::runtime_error("socket");
+    }
+    const int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in self;
+    std::memset(&self, 0, sizeof(self));
+    self.sin_family = AF_INET;
+    self.sin_port = htons(config.mPort);
+    self.sin_addr.s_addr = INADDR_ANY;
+    if (bind(sock, (struct sockaddr *)&self, sizeof(self)) != 0)
+    {
+        std::printf("[Error] %s\n", strerror(errno));
+        throw std::runtime_error("bind");
+    }
+    std::printf("[Done] Step1. bind %s port=%u\n", config.mTcp ? "tcp" : "udp", config.mPort);
+
+    int peer = sock;
+    if (config.mTcp)
+    {
+        if (listen(sock, 1) != 0 || (peer = accept(sock, nullptr, nullptr)) < 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("accept");
+        }
+        setsockopt(peer, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    PinReceiveThread(config);
+    Receiver receiver(peer, config);
+    std::printf("[Done] Step2. echo (%s)\n", config.mBusy ? "busy poll" : "blocking");
+
+    std::vector<char> buf(65536);
+    uint64_t echoed = 0;
+    while (true)
+    {
+        ssize_t n;
+        if (config.mTcp)
+        {
+            n = receiver.readFull(buf.data(), config.mPayload);
+            if (n <= 0)
+            {
+                break; // クライアントが閉じた
+            }
+            if (send(peer, buf.data(), (size_t)n, 0) < 0)
+            {
+                break;
+            }
+        }
+        else
+        {
+            struct sockaddr_storage from;
+            socklen_t from_length = sizeof(from);
+            n = receiver.recvfrom(buf.data(), buf.size(), (struct sockaddr *)&from, &from_length, -1);
+            if (n < 0)
+            {
+                std::printf("[Error] recvfrom: %s\n", strerror(errno));
+                break;
+            }
+            if (n == 0)
+            {
+                break; // 空のデータグラムで終わり
+            }
+            sendto(peer, buf.data(), (size_t)n, 0, (struct sockaddr *)&from, from_length);
+        }
+        ++echoed;
+    }
+    std::printf("[Done] Step3. echoed %llu messages\n", (unsigned long long)echoed);
+    receiver.printStats("server");
+
+    if (peer != sock)
+    {
+        close(peer);
+    }
+    close(sock);
+    return 0;
+}
+
+static int RunClient(const BenchConfig &config)
+{
+    int sock = socket(AF_INET, config.mTcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+        std::printf("[Error] %s\n", strerror(errno));
+        throw std::runtime_error("socket");
+    }
+    struct sockaddr_in server;
+    std::memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(config.mPort);
+    if (inet_pton(AF_INET, config.mAddress, &server.sin_addr) != 1)
+    {
+        std::printf("[Error] not an IPv4 address: %s\n", config.mAddress);
+        throw std::runtime_error("IP Address");
+    }
+    // UDPもconnectして相手を固定する (他からのデータグラムを受けない)
+    if (connect(sock, (struct sockaddr *)&server, sizeof(server)) != 0)
+    {
+        std::printf("[Error] %s\n", strerror(errno));
+        throw std::runtime_error("connect");
+    }
+    if (config.mTcp)
+    {
+        const int on = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    std::printf("[Done] Step1. connect %s `%s`; port=%u\n", config.mTcp ? "tcp" : "udp", config.mAddress, config.mPort);
+    PinReceiveThread(config);
+    Receiver receiver(sock, config);
+
+    std::vector<char> ping(config.mPayload, 'p');
+    std::vector<char> pong(65536);
+    std::vector<uint64_t> samples;
+    samples.reserve((size_t)config.mCount);
+    int lost = 0;
+    for (int i = 0; i < config.mCount + WARMUP; ++i)
+    {
+        uint64_t start = is::net::MonotonicNs();
+        if (send(sock, ping.data(), ping.size(), 0) < 0)
+        {
+            std::printf("[Error] send: %s\n", strerror(errno));
+            break;
+        }
+        ssize_t n = config.mTcp ? receiver.readFull(pong.data(), ping.size())
+                                : receiver.recvfrom(pong.data(), pong.size(), nullptr, nullptr, 1000);
+        uint64_t elapsed = is::net::MonotonicNs() - start;
+        if (n <= 0)
+        {
+            if (config.mTcp)
+            {
+                std::printf("[Error] server closed\n");
+                break;
+            }
+            ++lost; // 1秒来なければ失ったとみなす (ブロッキングの-b offは待ち続ける)
+            continue;
+        }
+        if (i >= WARMUP)
+        {
+            samples.push_back(elapsed);
+        }
+    }
+    if (!config.mTcp)
+    {
+        send(sock, ping.data(), 0, 0); // 終わり
+    }
+    std::printf("[Done] Step2. ping-pong %zu samples (%s, %zu bytes)\n",
+                samples.size(), config.mBusy ? "busy poll" : "blocking", config.mPayload);
+
+    if (!samples.empty())
+    {
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [&](double p) { return (double)samples[(size_t)(p * (double)(samples.size() - 1))] / 1000.0; };
+        std::printf("[Result] %s %s rtt us: p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f%s\n",
+                    config.mTcp ? "tcp" : "udp",
+                    config.mBusy ? "busy" : "blocking",
+                    percentile(0.50), percentile(0.90), percentile(0.99), percentile(0.999),
+                    (double)samples.back() / 1000.0,
+                    lost ? " (some lost)" : "");
+    }
+    receiver.printStats("client");
+    close(sock);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        BenchConfig config;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::strcmp(argv[i], "-m") == 0)
+            {
+                config.mServer = std::strcmp(argv[i + 1], "client") != 0;
+            }
+            else if (std::strcmp(argv[i], "-P") == 0)
+            {
+                config.mTcp = std::strcmp(argv[i + 1], "tcp") == 0;
+            }
+            else if (std::strcmp(argv[i], "-a") == 0)
+            {
+                config.mAddress = argv[i + 1];
+            }
+            else if (std::strcmp(argv[i], "-p") == 0)
+            {
+                config.mPort = (unsigned short)std::atoi(argv[i + 1]);
+            }
+            else if (std::strcmp(argv[i], "-b") == 0)
+            {
+                config.mBusy = std::strcmp(argv[i + 1], "on") == 0;
+            }
+            else if (std::strcmp(argv[i], "-s") == 0)
+            {
+                config.mSpinUs = std::strtoull(argv[i + 1], nullptr, 10);
+            }
+            else if (std::strcmp(argv[i], "-y") == 0)
+            {
+                config.mYield = argv[i + 1];
+            }
+            else if (std::strcmp(argv[i], "-c") == 0)
+            {
+                config.mCpu = argv[i + 1];
+            }
+            else if (std::strcmp(argv[i], "-n") == 0)
+            {
+                config.mCount = std::max(1, std::atoi(argv[i + 1]));
+            }
+            else if (std::strcmp(argv[i], "-l") == 0)
+            {
+                config.mPayload = std::min<size_t>(std::max(1, std::atoi(argv[i + 1])), 65000);
+            }
+        }
+        return config.mServer ? RunServer(config) : RunClient(config);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    return 1;
+}
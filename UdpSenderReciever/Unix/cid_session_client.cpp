@@ -0,0 +1,214 @@
+/**
+ * @file cid_session_client.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 接続ID(NetUtils/connection_id.hpp)で識別されるUDPセッションのクライアント. 受信側は`dual_udp_reciever -m cid`.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: cid_session_client [-a address=127.0.0.1] [-n count=10] [-r rebind_every=0] [-i interval_ms=200]
+ * HELLOでIDを受け取り, DATAをinterval毎に送る.
+ * -r N でN個毎にソケットを作り直して送信元ポートを変える(NATの割り当てが変わったのを真似る).
+ * 新しいポートにはサーバからPATH_CHALLENGEが届くので応答し, セッションはそのまま続く.
+ * サーバがIDを忘れていたら(CLOSE)HELLOからやり直す.
+ */
+#include <test_utils.hpp>
+
+// udp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h> // inet_pton, inet_ntop
+#include <netdb.h>
+#include <poll.h>
+#include <chrono>
+
+#include <NetUtils/connection_id.hpp>
+
+#if defined(__linux__)
+
+#elif defined(__MACH__)
+
+#else
+// Windows
+#endif
+
+#define BUFSIZE 1500
+
+struct sockaddr_in reciever_info; // IPv4アドレス情報
+struct sockaddr *p_reciever; // インターフェース
+socklen_t socket_length;
+unsigned short port_of_reciever = 54321;
+
+int socket_to_reciever = -1; // 受信側に送るソケット (-rで作り直す)
+uint8_t frame[BUFSIZE];
+char buf[BUFSIZE];
+
+/* ソケットを作り, 割り当てられた送信元ポートを返す */
+unsigned short open_socket()
+{
+    if ((socket_to_reciever = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    {
+        std::printf("[Error] %s\n", strerror(errno));
+        throw std::runtime_error("socket");
+    }
+    // 送信元ポートを先に決める (connectしないので複数の返信元も受け取れる)
+    struct sockaddr_in self;
+    std::memset(&self, 0, sizeof(self));
+    self.sin_family = AF_INET;
+    socklen_t self_length = sizeof(self);
+    if (bind(socket_to_reciever, (struct sockaddr *)&self, self_length) != 0 ||
+        getsockname(socket_to_reciever, (struct sockaddr *)&self, &self_length) != 0)
+    {
+        std::printf("[Error] %s\n", strerror(errno));
+        throw std::runtime_error("bind");
+    }
+    return ntohs(self.sin_port);
+}
+
+/* timeout_msまでサーバからのフレームを処理する. (WELCOME, PATH_CHALLENGE, CLOSE) */
+void pump(is::net::CidClient &client, int timeout_ms)
+{
+    auto reply = [](const uint8_t *out, size_t length) {
+        sendto(socket_to_reciever, out, length, 0, p_reciever, socket_length);
+    };
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true)
+    {
+        int remain = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                         deadline - std::chrono::steady_clock::now())
+                         .count();
+        struct pollfd target;
+        target.fd = socket_to_reciever;
+        target.events = POLLIN;
+        if (remain <= 0 || poll(&target, 1, remain) <= 0)
+        {
+            return;
+        }
+        ssize_t n = recv(socket_to_reciever, frame, sizeof(frame), MSG_DONTWAIT);
+        if (n <= 0)
+        {
+            continue;
+        }
+        uint64_t answered = client.challengesAnswered();
+        bool was_connected = client.connected();
+        client.onFrame(is::net::BytesView(frame, (size_t)n), reply);
+        if (client.challengesAnswered() != answered)
+        {
+            std::printf("[Status] answered PATH_CHALLENGE\n");
+        }
+        if (was_connected && !client.connected())
+        {
+            std::printf("[Status] server closed the session\n");
+        }
+    }
+}
+
+/* HELLO -> WELCOME (500ms毎に5回まで) */
+void handshake(is::net::CidClient &client)
+{
+    for (int attempt = 0; attempt < 5 && !client.connected(); ++attempt)
+    {
+        size_t length = client.hello(frame);
+        if (sendto(socket_to_reciever, frame, length, 0, p_reciever, socket_length) < 0)
+        {
+            std::printf("[Error] sendto: %s\n", strerror(errno));
+        }
+        pump(client, 500);
+    }
+    if (!client.connected())
+    {
+        throw std::runtime_error("no WELCOME from reciever");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        const char *reciever_name = "127.0.0.1";
+        int count = 10;
+        int rebind_every = 0;
+        int interval_ms = 200;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::strcmp(argv[i], "-a") == 0)
+            {
+                reciever_name = argv[i + 1];
+            }
+            else if (std::strcmp(argv[i], "-n") == 0)
+            {
+                count = std::atoi(argv[i + 1]);
+            }
+            else if (std::strcmp(argv[i], "-r") == 0)
+            {
+                rebind_every = std::atoi(argv[i + 1]);
+            }
+            else if (std::strcmp(argv[i], "-i") == 0)
+            {
+                interval_ms = std::atoi(argv[i + 1]);
+            }
+        }
+
+        /* 1.ソケットの作成 */
+        unsigned short port_of_self = open_socket();
+        std::printf("[Done] Step1. create socket; port=%u\n", port_of_self);
+
+        /* 2.宛先の確定 */
+        std::memset(&reciever_info, 0, sizeof(reciever_info));
+        reciever_info.sin_family = AF_INET;
+        reciever_info.sin_port = htons(port_of_reciever);
+        socket_length = sizeof(reciever_info);
+        p_reciever = (struct sockaddr *)&reciever_info;
+        if (inet_pton(AF_INET, reciever_name, &(reciever_info.sin_addr)) != 1)
+        {
+            std::printf("[Error] not an IPv4 address: %s\n", reciever_name);
+            throw std::runtime_error("IP Address");
+        }
+        std::printf("[Done] Step2. configure destination (reciever): `%s`; port=%u\n", reciever_name, port_of_reciever);
+
+        /* 3.接続IDを受け取る */
+        is::net::CidClient client((uint64_t)std::chrono::steady_clock::now().time_since_epoch().count());
+        handshake(client);
+        std::printf("[Done] Step3. session %016llx\n", (unsigned long long)client.id());
+
+        /* 4.送信 (N個毎に送信元ポートを変える) */
+        int rebinds = 0;
+        for (int seq = 0; seq < count; ++seq)
+        {
+            if (rebind_every > 0 && seq > 0 && seq % rebind_every == 0)
+            {
+                close(socket_to_reciever);
+                port_of_self = open_socket();
+                ++rebinds;
+                std::printf("[Status] rebind: new source port=%u\n", port_of_self);
+            }
+            if (!client.connected())
+            {
+                handshake(client);
+                std::printf("[Status] new session %016llx\n", (unsigned long long)client.id());
+            }
+
+            int len = std::snprintf(buf, sizeof(buf), "HELLO CID seq=%d port=%u", seq, port_of_self);
+            size_t length = client.data(buf, (size_t)len, frame);
+            if (sendto(socket_to_reciever, frame, length, 0, p_reciever, socket_length) < 0)
+            {
+                std::printf("[Error] sendto: %s\n", strerror(errno));
+            }
+            pump(client, interval_ms);
+        }
+        std::printf("[Done] Step4. send %d datagrams (rebinds %d, challenges answered %llu)\n",
+                    count, rebinds, (unsigned long long)client.challengesAnswered());
+
+        /* 5.ソケットを閉じる */
+        close(socket_to_reciever);
+    }
+    catch (const std::exception &e)
+    {
+        close(socket_to_reciever);
+        std::cerr << e.what() << '\n';
+    }
+
+    return 0;
+}
@@ -0,0 +1,276 @@
+/**
+ * @file connection_id_test.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 接続IDのセッション表(NetUtils/connection_id.hpp)の単体テスト. ソケットは使わずフレームを直接渡す
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: connection_id_test
+ *
+ * + HELLO -> WELCOME -> DATA, 同じ乱数のHELLOには同じID
+ * + 送信元が変わったDATA -> PATH_CHALLENGE -> PATH_RESPONSEで返信先を切り替える
+ * + セッション数の上限 (DATAの来ていないものから追い出す / 全て確立済みなら断る)
+ * + 無通信の失効, 知らないIDへのCLOSE, 壊れたフレーム
+ */
+#include <test_utils.hpp>
+
+#include <arpa/inet.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <NetUtils/connection_id.hpp>
+
+#include "test_check.hpp"
+
+using is::net::BytesView;
+
+namespace
+{
+    struct Sent
+    {
+        std::vector<uint8_t> frame;
+        struct sockaddr_in to;
+    };
+
+    struct sockaddr_in Endpoint(const char *address, uint16_t port)
+    {
+        struct sockaddr_in sin;
+        std::memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons(port);
+        inet_pton(AF_INET, address, &sin.sin_addr);
+        return sin;
+    }
+
+    struct Server
+    {
+        is::net::CidSessionTable table;
+        std::vector<Sent> sent;
+        size_t dataCount = 0;
+
+        explicit Server(const is::net::CidSessionOptions &options = is::net::CidSessionOptions())
+            : table(options, 3, 0) {}
+
+        bool receive(const uint8_t *frame, size_t length, const struct sockaddr_in &from, uint64_t now_ms)
+        {
+            return table.onDatagram(
+                BytesView(frame, length), (const struct sockaddr *)&from, sizeof(from), now_ms,
+                [this](const uint8_t *out, size_t out_length, const struct sockaddr *to, socklen_t) {
+                    Sent s;
+                    s.frame.assign(out, out + out_length);
+                    std::memcpy(&s.to, to, sizeof(s.to));
+                    sent.push_back(s);
+                },
+                [this](const is::net::CidSession &, BytesView) { ++dataCount; });
+        }
+
+        void tick(uint64_t now_ms)
+        {
+            table.tick(now_ms, [this](const uint8_t *out, size_t out_length, const struct sockaddr *to, socklen_t) {
+                Sent s;
+                s.frame.assign(out, out + out_length);
+                std::memcpy(&s.to, to, sizeof(s.to));
+                sent.push_back(s);
+            });
+        }
+
+        uint8_t lastType() const
+        {
+            return sent.empty() ? 0 : sent.back().frame[4];
+        }
+    };
+
+    // HELLOを送ってWELCOMEをクライアントへ渡す
+    bool Connect(Server &server, is::net::CidClient &client, const struct sockaddr_in &from, uint64_t now_ms)
+    {
+        uint8_t frame[is::net::kCidHeaderSize];
+        size_t before = server.sent.size();
+        server.receive(frame, client.hello(frame), from, now_ms);
+        if (server.sent.size() == before)
+        {
+            return false;
+        }
+        const Sent &welcome = server.sent.back();
+        client.onFrame(BytesView(welcome.frame.data(), welcome.frame.size()), [](const uint8_t *, size_t) {});
+        return client.connected();
+    }
+
+    void SendData(Server &server, is::net::CidClient &client, const struct sockaddr_in &from, uint64_t now_ms)
+    {
+        uint8_t frame[is::net::kCidHeaderSize + 4];
+        server.receive(frame, client.data("ping", 4, frame), from, now_ms);
+    }
+
+    void TestHandshake()
+    {
+        Server server;
+        struct sockaddr_in a = Endpoint("192.0.2.1", 4000);
+        is::net::CidClient client(0xABCDEF);
+        TEST_CHECK(Connect(server, client, a, 0));
+        TEST_CHECK_EQ(server.table.size(), 1u);
+
+        // WELCOMEが失われたとして同じ乱数で再送: 同じID, セッションは増えない
+        is::net::CidClient retry(0xABCDEF);
+        TEST_CHECK(Connect(server, retry, a, 10));
+        TEST_CHECK_EQ(retry.id(), client.id());
+        TEST_CHECK_EQ(server.table.size(), 1u);
+        TEST_CHECK_EQ(server.table.stats().mHelloRepeats, 1u);
+        TEST_CHECK_EQ(server.table.stats().mCreated, 1u);
+
+        SendData(server, client, a, 20);
+        TEST_CHECK_EQ(server.dataCount, 1u);
+
+        // 別の乱数は別のセッション
+        is::net::CidClient other(0x123);
+        TEST_CHECK(Connect(server, other, a, 30));
+        TEST_CHECK(other.id() != client.id());
+        TEST_CHECK_EQ(server.table.size(), 2u);
+    }
+
+    void TestMigration()
+    {
+        Server server;
+        struct sockaddr_in a = Endpoint("192.0.2.1", 4000);
+        struct sockaddr_in b = Endpoint("192.0.2.1", 5000); // NATがポートを変えた
+        is::net::CidClient client(7);
+        TEST_CHECK(Connect(server, client, a, 0));
+        SendData(server, client, a, 1);
+        SendData(server, client, b, 2);
+        TEST_CHECK_EQ(server.dataCount, 2u); // 送信元が変わっても届く
+        TEST_CHECK_EQ(server.lastType(), is::net::kCidPathChallenge);
+        TEST_CHECK_EQ(ntohs(server.sent.back().to.sin_port), 5000);
+
+        // クライアントが応答する
+        std::vector<uint8_t> response;
+        const Sent &challenge = server.sent.back();
+        client.onFrame(BytesView(challenge.frame.data(), challenge.frame.size()), [&response](const uint8_t *frame, size_t length) {
+            response.assign(frame, frame + length);
+        });
+        TEST_CHECK(!response.empty());
+        server.receive(response.data(), response.size(), b, 3);
+        TEST_CHECK_EQ(server.table.stats().mMigrations, 1u);
+        const is::net::CidSession *session = server.table.find(client.id());
+        TEST_CHECK(session != nullptr && is::net::SameEndpoint((const struct sockaddr *)&session->mPeer, (const struct sockaddr *)&b));
+
+        // 違う値の応答では切り替えない
+        SendData(server, client, a, 4);
+        response[is::net::kCidHeaderSize] ^= 1;
+        server.receive(response.data(), response.size(), a, 5);
+        TEST_CHECK_EQ(server.table.stats().mMigrations, 1u);
+    }
+
+    void TestSessionLimit()
+    {
+        is::net::CidSessionOptions options;
+        options.mMaxSessions = 3;
+        Server server(options);
+        struct sockaddr_in a = Endpoint("198.51.100.1", 4000);
+
+        // 1つ確立 + 2つHELLOだけ
+        is::net::CidClient established(1);
+        TEST_CHECK(Connect(server, established, a, 0));
+        SendData(server, established, a, 1);
+        is::net::CidClient pending1(2), pending2(3);
+        TEST_CHECK(Connect(server, pending1, a, 2));
+        TEST_CHECK(Connect(server, pending2, a, 3));
+        TEST_CHECK_EQ(server.table.size(), 3u);
+
+        // 溢れる: 一番古いHELLOだけのセッション(pending1)を追い出す
+        is::net::CidClient flood(4);
+        TEST_CHECK(Connect(server, flood, a, 4));
+        TEST_CHECK_EQ(server.table.size(), 3u);
+        TEST_CHECK_EQ(server.table.stats().mEvicted, 1u);
+        TEST_CHECK(server.table.find(pending1.id()) == nullptr);
+        TEST_CHECK(server.table.find(established.id()) != nullptr);
+        TEST_CHECK(server.table.find(pending2.id()) != nullptr);
+
+        // 追い出されたものの乱数は新しいセッションとして扱う
+        is::net::CidClient pending1_retry(2);
+        TEST_CHECK(Connect(server, pending1_retry, a, 5));
+        TEST_CHECK_EQ(server.table.stats().mEvicted, 2u);
+
+        // 全て確立済みなら断る
+        SendData(server, flood, a, 6);
+        SendData(server, pending1_retry, a, 6);
+        is::net::CidClient refused(5);
+        TEST_CHECK(!Connect(server, refused, a, 7));
+        TEST_CHECK_EQ(server.table.stats().mRefused, 1u);
+        TEST_CHECK_EQ(server.table.size(), 3u);
+
+        // HELLOの連打でも表は上限を超えない
+        for (uint64_t nonce = 100; nonce < 1100; ++nonce)
+        {
+            is::net::CidClient client(nonce);
+            Connect(server, client, a, 8);
+        }
+        TEST_CHECK_EQ(server.table.size(), 3u);
+    }
+
+    void TestExpiry()
+    {
+        is::net::CidSessionOptions options;
+        options.mIdleTimeoutMs = 1000;
+        Server server(options);
+        struct sockaddr_in a = Endpoint("203.0.113.1", 4000);
+        is::net::CidClient client(9);
+        TEST_CHECK(Connect(server, client, a, 0));
+        server.tick(500);
+        TEST_CHECK_EQ(server.table.size(), 1u);
+        server.tick(1100);
+        TEST_CHECK_EQ(server.table.size(), 0u);
+        TEST_CHECK_EQ(server.table.stats().mExpired, 1u);
+
+        // 失効したIDのDATAにはCLOSE. クライアントはHELLOからやり直す (乱数は同じでも新しいセッション)
+        SendData(server, client, a, 1200);
+        TEST_CHECK_EQ(server.lastType(), is::net::kCidClose);
+        const Sent &close = server.sent.back();
+        client.onFrame(BytesView(close.frame.data(), close.frame.size()), [](const uint8_t *, size_t) {});
+        TEST_CHECK(!client.connected());
+        TEST_CHECK(Connect(server, client, a, 1300));
+        TEST_CHECK_EQ(server.table.stats().mCreated, 2u);
+    }
+
+    void TestMalformed()
+    {
+        Server server;
+        struct sockaddr_in a = Endpoint("192.0.2.9", 4000);
+        uint8_t frame[is::net::kCidHeaderSize] = {};
+        TEST_CHECK(!server.receive(frame, 8, a, 0));             // 短い
+        TEST_CHECK(!server.receive(frame, sizeof(frame), a, 0)); // magicが違う
+
+        // 値の無いPATH_RESPONSE / PATH_CHALLENGEは無視
+        is::net::CidHeader header;
+        header.mType = is::net::kCidPathChallenge;
+        header.mConnectionId = 1;
+        is::net::WriteCidHeader(frame, header);
+        TEST_CHECK(server.receive(frame, sizeof(frame), a, 0));
+        TEST_CHECK(server.sent.empty());
+    }
+} // namespace
+
+int main(int, char **)
+{
+    try
+    {
+        TestHandshake();
+        std::printf("[Done] Step1. handshake and repeated HELLO\n");
+        TestMigration();
+        std::printf("[Done] Step2. path validation\n");
+        TestSessionLimit();
+        std::printf("[Done] Step3. session limit\n");
+        TestExpiry();
+        std::printf("[Done] Step4. idle expiry\n");
+        TestMalformed();
+        std::printf("[Done] Step5. malformed frames\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::printf("[Result] %d failures\n", TestFailures());
+    return TestFailures() == 0 ? 0 : 1;
+}
@@ -7,6 +7,33 @@
  * 
  * @copyright Copyright (c) 2023
  * 
+ * usage: dual_udp_reciever [-t threads] [-s cpu|addr] [-m addr|cid] [-M metrics_port]
+ *
+ * 既定(-t無し)では受信ループはプールのバッファへ読んで記述子をSPSCリング(NetUtils/lockfree_ring.hpp)に積むだけで,
+ * 逆引きと表示は別スレッドで行う. 表示が詰まっても受信は止まらない.
+ *
+ * `-t N` (Linux) はIPv4/IPv6それぞれN個のSO_REUSEPORTソケットを同じポートにbindし,
+ * スレッドiがi番目のソケット対を読む. 振り分けはSO_ATTACH_REUSEPORT_CBPFで決める.
+ * + cpu : 受信したCPUの番号で振り分ける (キャッシュの局所性)
+ * + addr: 送信元IPのハッシュで振り分ける (送信元毎の状態をスレッド内に閉じ込められる. 既定)
+ * スレッド毎の受信数・バイト数・ドロップ数(SO_RXQ_OVFL)・送信元数を1秒毎に表示する.
+ *
+ * `-m cid` は相手を送信元アドレスではなく接続ID(NetUtils/connection_id.hpp)で識別する.
+ * HELLOにIDを払い出し, DATAはIDでセッション表を引く. 送信元が変わったらPATH_CHALLENGEで確かめてから返信先を移す
+ * (NATの割り当てが変わってもセッションは続く. クライアントはcid_session_client).
+ * `-t N`と併用すると, IDの下位32bitでスレッドを決めて払い出し, 同じ値で振り分ける(-sは無視).
+ * CIDの形式でないデータグラムは従来通り送信元アドレスで扱う.
+ *
+ * 受信ループと表示スレッドの出力はNetUtils/async_log.hppに積むだけで, printfとfflushは書き出しスレッドが行う
+ * (pollのタイムアウト毎の表示はdebugレベル. -DIS_NET_LOG_LEVEL=1 で出る).
+ *
+ * `-M port` はNetUtils/metrics.hppの組み込みメトリクス(受信数, バイト数, ドロップ, タイムアウト, errno毎のエラー,
+ * 受信から表示までの時間)を http://<host>:port/metrics にPrometheusのテキスト形式で出す.
+ * 数えるのは-M無しでも同じ(スレッド毎のセルへの書き込みだけ).
+ *
+ * Linuxでは各ソケットにSO_RXQ_OVFLを付け, カーネルが捨てた数(受信バッファ溢れ)をソケット毎に数える.
+ * 1秒毎にSO_MEMINFO(受信バッファの使用量, バックログ)も読み, 同じくメトリクスへ出す(NetUtils/socket_stats.hpp).
+ * 終了時にソケット毎の値を表示する.
  */
 #include <test_utils.hpp>
 
@@ -18,9 +45,20 @@
 #include <netinet/in.h>
 #include <errno.h>
 #include <poll.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
 
-#if defined(__linux__)
+#include <NetUtils/async_log.hpp>
+#include <NetUtils/connection_id.hpp>
+#include <NetUtils/lockfree_ring.hpp>
+#include <NetUtils/metrics.hpp>
+#include <NetUtils/packet_pool.hpp>
 
+#if defined(__linux__)
+#include <NetUtils/socket_filter.hpp>
+#include <NetUtils/socket_stats.hpp>
 #elif defined(__MACH__)
 
 #else
@@ -120,10 +158,507 @@ HostInfo get_host_info(struct sockaddr* address)
 }
 
 
+/////////////////////////////////////////////////////////////
+// 接続ID (-m cid)
+/////////////////////////////////////////////////////////////
+bool use_connection_id = false;
+
+uint64_t now_ms()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// 宛先と同じアドレスファミリのソケットから制御フレーム(WELCOME, PATH_CHALLENGEなど)を返す
+void send_cid_frame(const std::vector<socket_t> &sockets,
+                    const uint8_t *frame, size_t length,
+                    const struct sockaddr *to, socklen_t to_length)
+{
+    for (socket_t sock : sockets)
+    {
+        struct sockaddr_storage self;
+        socklen_t self_length = sizeof(self);
+        if (getsockname(sock, (struct sockaddr *)&self, &self_length) == 0 && self.ss_family == to->sa_family)
+        {
+            if (sendto(sock, frame, length, 0, to, to_length) < 0)
+            {
+                is::net::NetMetrics::instance().mSendErrors.inc(errno);
+                IS_LOG_RATE(is::net::kLogWarn, 10, "sendto: %s", strerror(errno));
+            }
+            else
+            {
+                is::net::NetMetrics::instance().mDatagramsSent.inc();
+                is::net::NetMetrics::instance().mBytesSent.inc(length);
+            }
+            return;
+        }
+    }
+}
+
+void print_session_stats(const is::net::CidSessionTable &sessions)
+{
+    const is::net::CidSessionStats &stats = sessions.stats();
+    std::printf("[Status] sessions %zu: created %llu, expired %llu, closed %llu, unknown %llu, "
+                "challenges %llu, migrations %llu, validation failures %llu, reordered %llu, "
+                "hello repeats %llu, evicted %llu, refused %llu\n",
+                sessions.size(),
+                (unsigned long long)stats.mCreated,
+                (unsigned long long)stats.mExpired,
+                (unsigned long long)stats.mClosed,
+                (unsigned long long)stats.mUnknown,
+                (unsigned long long)stats.mChallenges,
+                (unsigned long long)stats.mMigrations,
+                (unsigned long long)stats.mValidationFailures,
+                (unsigned long long)stats.mReordered,
+                (unsigned long long)stats.mHelloRepeats,
+                (unsigned long long)stats.mEvicted,
+                (unsigned long long)stats.mRefused);
+}
+
+
+/////////////////////////////////////////////////////////////
+// 受信ループ -> 表示スレッドの受け渡し
+/////////////////////////////////////////////////////////////
+#define DATAGRAM_SLOTS 1024 // 表示待ちにできるデータグラムの数
+
+// リングに流す記述子. ペイロードはプール(NetUtils/packet_pool.hpp)のスライスで, 表示後に破棄するとプールへ戻る.
+struct Datagram
+{
+    is::net::PacketSlice mPayload;
+    socket_t mSocket;
+    socklen_t mSenderLength;
+    struct sockaddr_storage mSender;
+    uint64_t mSession = 0;     // 接続ID (-m cid. 0: 送信元アドレスで識別)
+    uint32_t mMigrations = 0;  // セッションの経路の切り替え回数
+    size_t mOffset = 0;        // 表示するペイロードの位置 (CIDのヘッダを飛ばす)
+    uint64_t mReceivedNs = 0;  // 受信した時刻 (MetricsClockNs)
+};
+
+is::net::SpscRing<Datagram> received_ring(DATAGRAM_SLOTS); // 受信ループ -> 表示
+std::atomic<bool> receive_done{false};
+uint64_t queue_drops = 0;
+
+void print_datagram(const Datagram &datagram)
+{
+    struct sockaddr *address = (struct sockaddr *)&datagram.mSender;
+
+    // ホスト情報
+    HostInfo sender_host_info = get_host_info(address);
+
+    if (datagram.mSession != 0)
+    {
+        IS_LOG_INFO("Connection from : sender %s, port=%s, session %016llx (migrations %u)",
+                    sender_host_info.mNumericHostName.c_str(),
+                    sender_host_info.mNumericServiceName.c_str(),
+                    (unsigned long long)datagram.mSession,
+                    datagram.mMigrations);
+    }
+    else
+    {
+        IS_LOG_INFO("Connection from : sender %s, port=%s",
+                    sender_host_info.mNumericHostName.c_str(),
+                    sender_host_info.mNumericServiceName.c_str());
+    }
+
+    // ペイロード (ログにはkLogTextBytesまで)
+    std::string payload((const char *)datagram.mPayload.data() + datagram.mOffset,
+                        datagram.mPayload.size() - datagram.mOffset);
+    IS_LOG_INFO("%s", payload.c_str());
+
+    // 送信元ホスト情報を登録
+    if (address->sa_family == AF_INET6)
+    {
+        // IPv6
+        auto &map_ipv6_host = map_sender_hosts_ipv6[datagram.mSocket];
+
+        auto iter = map_ipv6_host.find(sender_host_info.mNumericHostName);
+        if (iter == map_ipv6_host.end())
+        {
+            map_ipv6_host[sender_host_info.mNumericHostName] = sender_host_info; // register
+        }
+    }
+    else
+    {
+        // IPv4
+        auto &map_ipv4_host = map_sender_hosts_ipv4[datagram.mSocket];
+
+        auto iter = map_ipv4_host.find(sender_host_info.mNumericHostName);
+        if (iter == map_ipv4_host.end())
+        {
+            map_ipv4_host[sender_host_info.mNumericHostName] = sender_host_info; // register
+        }
+    }
+}
+
+void print_worker()
+{
+    is::net::Backoff backoff;
+    Datagram datagram;
+    while (true)
+    {
+        if (!received_ring.tryPop(datagram))
+        {
+            if (receive_done.load(std::memory_order_acquire) && received_ring.sizeApprox() == 0)
+            {
+                break;
+            }
+            backoff.pause();
+            continue;
+        }
+        backoff.reset();
+
+        try
+        {
+            print_datagram(datagram);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << '\n';
+        }
+        is::net::NetMetrics::instance().mHandling.record(is::net::MetricsClockNs() - datagram.mReceivedNs);
+        datagram.mPayload.reset(); // プールへ返す
+    }
+}
+
+
+/////////////////////////////////////////////////////////////
+// SO_REUSEPORTによるマルチスレッド受信 (Linux)
+/////////////////////////////////////////////////////////////
+#if defined(__linux__)
+
+#define SHARD_BATCH 32 // recvmmsgでまとめて読む数
+
+// スレッド毎のカウンタ (書くのは担当スレッドだけ)
+struct alignas(64) ShardCounters
+{
+    std::atomic<uint64_t> mPackets{0};
+    std::atomic<uint64_t> mBytes{0};
+    std::atomic<uint64_t> mDrops{0}; // ソケットの受信キュー溢れ (SO_RXQ_OVFLの累計)
+    std::atomic<uint64_t> mFlows{0}; // 見た送信元の数 (-m cid: セッション数)
+    std::atomic<uint64_t> mMigrations{0}; // -m cid: 経路を切り替えたセッション
+};
+
+std::atomic<bool> shard_running{true};
+
+/* スレッドi: IPv4/IPv6のi番目のソケットを読む */
+void shard_loop(std::vector<socket_t> sockets, ShardCounters *counters, uint32_t shard, uint32_t num_shards)
+{
+    struct mmsghdr msgs[SHARD_BATCH];
+    struct iovec iovs[SHARD_BATCH];
+    struct sockaddr_storage senders[SHARD_BATCH];
+    std::vector<char> payloads(SHARD_BATCH * BUFSIZE);
+    char controls[SHARD_BATCH][CMSG_SPACE(sizeof(uint32_t))];
+
+    // 送信元毎の受信数. 振り分けで送信元が1スレッドに固定されるのでロック不要.
+    std::unordered_map<std::string, uint64_t> flows;
+    // -m cid: このスレッドに届くIDだけを払い出すセッション表 (振り分けと同じ値)
+    is::net::CidSessionOptions session_options;
+    session_options.mShard = shard;
+    session_options.mShards = num_shards;
+    is::net::CidSessionTable sessions(session_options, (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count() + shard, now_ms());
+    auto send_frame = [&sockets](const uint8_t *frame, size_t length, const struct sockaddr *to, socklen_t to_length) {
+        send_cid_frame(sockets, frame, length, to, to_length);
+    };
+    std::vector<uint64_t> drops(sockets.size(), 0);
+    is::net::NetMetrics &metrics = is::net::NetMetrics::instance();
+    is::net::SocketStatsMonitor socket_stats; // ソケット毎のsk_drops, SO_MEMINFO
+    for (socket_t sock : sockets)
+    {
+        socket_stats.watch(sock);
+    }
+
+    std::vector<struct pollfd> targets(sockets.size());
+    for (size_t i = 0; i < sockets.size(); ++i)
+    {
+        targets[i].fd = sockets[i];
+        targets[i].events = POLLIN;
+    }
+
+    while (shard_running.load(std::memory_order_relaxed))
+    {
+        for (auto &target : targets)
+        {
+            target.revents = 0;
+        }
+        int nready = poll(targets.data(), targets.size(), 100);
+        socket_stats.sample(now_ms());
+        if (use_connection_id)
+        {
+            sessions.tick(now_ms(), send_frame);
+            counters->mFlows.store(sessions.size(), std::memory_order_relaxed);
+        }
+        if (nready == 0)
+        {
+            metrics.mTimeouts.inc();
+            continue;
+        }
+        if (nready < 0)
+        {
+            metrics.mPollErrors.inc(errno);
+            continue;
+        }
+
+        for (size_t s = 0; s < sockets.size(); ++s)
+        {
+            if (!(targets[s].revents & POLLIN))
+            {
+                continue;
+            }
+            for (int i = 0; i < SHARD_BATCH; ++i)
+            {
+                iovs[i].iov_base = &payloads[i * BUFSIZE];
+                iovs[i].iov_len = BUFSIZE;
+                std::memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+                msgs[i].msg_hdr.msg_name = &senders[i];
+                msgs[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+                msgs[i].msg_hdr.msg_control = controls[i];
+                msgs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+            }
+            int n = recvmmsg(sockets[s], msgs, SHARD_BATCH, MSG_DONTWAIT, nullptr);
+            if (n <= 0)
+            {
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    metrics.mRecvErrors.inc(errno);
+                }
+                continue;
+            }
+
+            uint64_t bytes = 0;
+            for (int i = 0; i < n; ++i)
+            {
+                bytes += msgs[i].msg_len;
+                uint32_t dropped;
+                if (is::net::ReadRxqOverflow(msgs[i].msg_hdr, dropped))
+                {
+                    drops[s] = dropped;
+                    socket_stats.onRxqOverflow(sockets[s], dropped);
+                }
+                const struct sockaddr *sender = (const struct sockaddr *)&senders[i];
+                if (use_connection_id &&
+                    sessions.onDatagram(is::net::BytesView(iovs[i].iov_base, msgs[i].msg_len),
+                                        sender, msgs[i].msg_hdr.msg_namelen, now_ms(), send_frame,
+                                        [](const is::net::CidSession &, is::net::BytesView) {}))
+                {
+                    continue;
+                }
+                // 送信元IP(ポートを除く)をキーにする
+                std::string key = sender->sa_family == AF_INET6
+                                      ? std::string((const char *)&((const struct sockaddr_in6 *)sender)->sin6_addr, 16)
+                                      : std::string((const char *)&((const struct sockaddr_in *)sender)->sin_addr, 4);
+                ++flows[key];
+            }
+
+            uint64_t total_drops = 0;
+            for (uint64_t d : drops)
+            {
+                total_drops += d;
+            }
+            counters->mPackets.fetch_add((uint64_t)n, std::memory_order_relaxed);
+            counters->mBytes.fetch_add(bytes, std::memory_order_relaxed);
+            counters->mDrops.store(total_drops, std::memory_order_relaxed);
+            metrics.mDatagramsReceived.inc((uint64_t)n);
+            metrics.mBytesReceived.inc(bytes);
+            if (use_connection_id)
+            {
+                counters->mFlows.store(sessions.size(), std::memory_order_relaxed);
+                counters->mMigrations.store(sessions.stats().mMigrations, std::memory_order_relaxed);
+            }
+            else
+            {
+                counters->mFlows.store(flows.size(), std::memory_order_relaxed);
+            }
+        }
+    }
+    if (use_connection_id)
+    {
+        std::printf("thread %2u: ", shard);
+        print_session_stats(sessions);
+    }
+}
+
+int sharded_receiver(int num_threads, bool steer_by_cpu)
+{
+    /* 1.名前解決 */
+    struct addrinfo shard_hints;
+    std::memset(&shard_hints, 0, sizeof(shard_hints));
+    shard_hints.ai_family = PF_UNSPEC;
+    shard_hints.ai_flags = AI_PASSIVE;
+    shard_hints.ai_socktype = SOCK_DGRAM;
+    struct addrinfo *list = nullptr;
+    int error = getaddrinfo(NULL, port_of_self, &shard_hints, &list);
+    if (error != 0)
+    {
+        std::printf("[Error] %s\n", gai_strerror(error));
+        throw std::runtime_error("getaddrinfo");
+    }
+    std::printf("[Done] Step1. resolve FQDN.\n");
+
+    /* 2.アドレスファミリ毎にN個のソケットを同じポートへbindし, 振り分けプログラムを付ける */
+    std::vector<std::vector<socket_t>> thread_sockets(num_threads);
+    std::vector<socket_t> all_sockets;
+    const int on = 1;
+    for (struct addrinfo *ai = list; ai != nullptr; ai = ai->ai_next)
+    {
+        socket_t first = -1;
+        for (int t = 0; t < num_threads; ++t)
+        {
+            socket_t sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (sock < 0)
+            {
+                std::printf("[Error] %s\n", strerror(errno));
+                throw std::runtime_error("socket");
+            }
+            all_sockets.push_back(sock);
+            if (ai->ai_family == AF_INET6)
+            {
+                setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &only_ipv6_flag, sizeof(only_ipv6_flag));
+            }
+            if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0 ||
+                is::net::EnableRxqOverflow(sock) != 0)
+            {
+                std::printf("[Error] setsockopt: %s\n", strerror(errno));
+                throw std::runtime_error("setsockopt SO_REUSEPORT");
+            }
+            int rcvbuf = 4 * 1024 * 1024; // バースト時のドロップを減らす
+            setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+            if (bind(sock, ai->ai_addr, ai->ai_addrlen) != 0)
+            {
+                std::printf("[Error] %s\n", strerror(errno));
+                socket_address_error(sock, ai->ai_addr);
+                throw std::runtime_error("bind");
+            }
+            thread_sockets[t].push_back(sock); // bindした順 = グループ内の番号
+            if (first < 0)
+            {
+                first = sock;
+            }
+        }
+
+        is::net::BpfProgram program = use_connection_id
+                                          ? is::net::ReuseportPayloadWordProgram(is::net::kCidSteeringOffset, (uint32_t)num_threads)
+                                      : steer_by_cpu
+                                          ? is::net::ReuseportCpuProgram((uint32_t)num_threads)
+                                          : is::net::ReuseportSourceHashProgram(ai->ai_family, (uint32_t)num_threads);
+        if (is::net::AttachReuseportProgram(first, program) != 0)
+        {
+            std::printf("[Error] SO_ATTACH_REUSEPORT_CBPF: %s\n", strerror(errno));
+            throw std::runtime_error("setsockopt SO_ATTACH_REUSEPORT_CBPF");
+        }
+        std::printf("Make %d sockets, %s, steering by %s\n",
+                    num_threads, ai->ai_family == AF_INET6 ? "IPv6" : "IPv4",
+                    use_connection_id ? "connection id" : steer_by_cpu ? "cpu" : "source address");
+    }
+    freeaddrinfo(list);
+    std::printf("[Done] Step2. make reuseport sockets.\n");
+
+    /* 3.スレッド毎に受信 */
+    std::vector<ShardCounters> counters(num_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t)
+    {
+        threads.emplace_back(shard_loop, thread_sockets[t], &counters[t], (uint32_t)t, (uint32_t)num_threads);
+    }
+
+    // 1秒毎にカウンタを表示. 10秒間受信が無ければ終了.
+    std::vector<uint64_t> last_packets(num_threads, 0);
+    int idle_seconds = 0;
+    while (idle_seconds < 10)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t delta_total = 0;
+        for (int t = 0; t < num_threads; ++t)
+        {
+            uint64_t packets = counters[t].mPackets.load(std::memory_order_relaxed);
+            uint64_t delta = packets - last_packets[t];
+            last_packets[t] = packets;
+            delta_total += delta;
+            std::printf("thread %2d: %10llu pkts %8llu pps %10llu bytes %6llu drops %5llu %s",
+                        t,
+                        (unsigned long long)packets,
+                        (unsigned long long)delta,
+                        (unsigned long long)counters[t].mBytes.load(std::memory_order_relaxed),
+                        (unsigned long long)counters[t].mDrops.load(std::memory_order_relaxed),
+                        (unsigned long long)counters[t].mFlows.load(std::memory_order_relaxed),
+                        use_connection_id ? "sessions" : "senders\n");
+            if (use_connection_id)
+            {
+                std::printf(" %5llu migrations\n",
+                            (unsigned long long)counters[t].mMigrations.load(std::memory_order_relaxed));
+            }
+        }
+        std::printf("----------------------------------------------\n");
+        idle_seconds = delta_total == 0 ? idle_seconds + 1 : 0;
+    }
+
+    shard_running.store(false);
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    // クローズ
+    for (socket_t sock : all_sockets)
+    {
+        close(sock);
+    }
+    return 0;
+}
+#endif // __linux__
+
 int main(int argc, char** argv)
 {
     try
     {
+        /* 0.オプション */
+        int num_threads = 0;
+        bool steer_by_cpu = false;
+        int metrics_port = 0;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::strcmp(argv[i], "-t") == 0)
+            {
+                num_threads = std::atoi(argv[i + 1]);
+            }
+            else if (std::strcmp(argv[i], "-s") == 0)
+            {
+                steer_by_cpu = std::strcmp(argv[i + 1], "cpu") == 0;
+            }
+            else if (std::strcmp(argv[i], "-m") == 0)
+            {
+                use_connection_id = std::strcmp(argv[i + 1], "cid") == 0;
+            }
+            else if (std::strcmp(argv[i], "-M") == 0)
+            {
+                metrics_port = std::atoi(argv[i + 1]);
+            }
+        }
+
+        // メトリクスの公開 (受信より先に登録を済ませておく)
+        is::net::NetMetrics &metrics = is::net::NetMetrics::instance();
+        is::net::MetricsHttpServer metrics_server;
+        if (metrics_port > 0)
+        {
+            if (metrics_server.start((unsigned short)metrics_port) != 0)
+            {
+                std::printf("[Error] metrics port %d: %s\n", metrics_port, strerror(errno));
+                throw std::runtime_error("MetricsHttpServer");
+            }
+            std::printf("[Status] metrics: http://0.0.0.0:%d/metrics\n", metrics_port);
+        }
+        if (num_threads > 0)
+        {
+#if defined(__linux__)
+            return sharded_receiver(num_threads, steer_by_cpu);
+#else
+            std::printf("[Error] -t (SO_ATTACH_REUSEPORT_CBPF) is Linux only\n");
+            return 1;
+#endif
+        }
+
         /* 1.名前解決(FQDN -> IP) */
         hints.ai_family = PF_UNSPEC;     // IPv4/IPv6両刀待ち
         hints.ai_flags = AI_PASSIVE;     // 自動設定; IPv4: IN_ADDR_ANY, IPv6: IN6_ADDR_ANY_INIT
@@ -166,6 +701,14 @@ int main(int argc, char** argv)
                 }
             }
 
+#if defined(__linux__)
+            // カーネルが捨てた数を受信毎に受け取る
+            if (is::net::EnableRxqOverflow(sock) != 0)
+            {
+                std::printf("[Error] setsockopt SO_RXQ_OVFL: %s\n", strerror(errno));
+            }
+#endif
+
             struct sockaddr_storage ss;
             std::memcpy(&ss, response->ai_addr, sizeof(struct sockaddr_storage)); // copy binary address info
             map_udp_sockets[sock] = std::make_pair(ss, response->ai_addrlen);     // register
@@ -197,6 +740,15 @@ int main(int argc, char** argv)
         }
         std::printf("[Done] Step3. bind sockets\n");
 
+#if defined(__linux__)
+        // ソケット毎のsk_drops, SO_MEMINFO (受信ループだけが触る)
+        is::net::SocketStatsMonitor socket_stats;
+        for (const auto &kv : map_udp_sockets)
+        {
+            socket_stats.watch(kv.first);
+        }
+#endif
+
         /* 6.I/Oの多重化 */
         int num_targets = map_udp_sockets.size();
         std::vector<struct pollfd> targets;
@@ -216,6 +768,25 @@ int main(int argc, char** argv)
             targets[index].events = POLLIN | POLLERR; /* 読み出し可 | エラー */
             index++;
         }
+        // 受信バッファはヒュージページ上のプールから取る (受信毎のmemsetは不要)
+        is::net::PacketPool packet_pool(DATAGRAM_SLOTS, BUFSIZE);
+        is::net::PacketPool::LocalCache packet_cache(packet_pool);
+        std::printf("[Status] packet pool: %zu x %zu bytes%s\n", packet_pool.slotCount(), packet_pool.slotSize(),
+                    packet_pool.hugePages() ? " (hugetlb)" : "");
+        std::thread printer(print_worker);
+        is::net::PacketSlice held; // 受信に失敗して使わなかったバッファ
+
+        // -m cid: 接続IDのセッション表 (受信ループだけが触る)
+        is::net::CidSessionTable sessions(is::net::CidSessionOptions(),
+                                          (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count(), now_ms());
+        std::vector<socket_t> reply_sockets;
+        for (const auto &kv : map_udp_sockets)
+        {
+            reply_sockets.push_back(kv.first);
+        }
+        auto send_frame = [&reply_sockets](const uint8_t *frame, size_t length, const struct sockaddr *to, socklen_t to_length) {
+            send_cid_frame(reply_sockets, frame, length, to, to_length);
+        };
         int timeout_count = 0;
         const int timeout_ms = 500;
         const int shutdown_count = 20;
@@ -223,38 +794,29 @@ int main(int argc, char** argv)
         {
             // タイムアウトまでBlocking [ms]
             nready = poll(targets.data(), num_targets, timeout_ms);
+#if defined(__linux__)
+            socket_stats.sample(now_ms());
+#endif
+            if (use_connection_id)
+            {
+                sessions.tick(now_ms(), send_frame); // チャレンジの再送, 無通信セッションの失効
+            }
 
             if (nready == 0)
             {
                 // タイムアウト
+                metrics.mTimeouts.inc();
                 if (timeout_count < shutdown_count)
                 {
-                    std::printf("*%d", timeout_count + 1);
-
-                    int digit = 0; // 桁数
-                    int tmp_count = timeout_count + 1;
-                    while (tmp_count != 0)
-                    {
-                        tmp_count /= 10;
-                        digit++;
-                    }
-                    // カウント(tmp_count)の桁数分だけカーソルを戻す
-                    for (int i = 0; i < digit; ++i)
-                    {
-                        std::printf("\b"); // カーソルを左に一つ戻す
-                    }
-                    
-                    std::fflush(stdout); // https://daeudaeu.com/fflush/#fflush-3
+                    IS_LOG_DEBUG("poll timeout %d/%d", timeout_count + 1, shutdown_count);
                     timeout_count++;
                 }
                 else if (timeout_count == shutdown_count)
                 {
-                    std::printf("\n");
                     break; // whileループを抜ける
                 }
                 else
                 {
-                    std::printf("\n");
                     timeout_count = 0;
                 }
 
@@ -263,79 +825,130 @@ int main(int argc, char** argv)
 
             if (nready == -1)
             {
+                metrics.mPollErrors.inc(errno);
                 if (errno == EINTR)
                 {
                     // 要求されたイベントのどれかが起こる前にシグナルが発生した
-                    std::printf("[Error] EINTR -> continue: %s\n");
+                    IS_LOG_WARN("poll: EINTR -> continue");
                     continue;
                 }
                 else
                 {
-                    std::printf("[Error] poll: %s\n", strerror(errno));
+                    IS_LOG_ERROR("poll: %s", strerror(errno));
                     break; // whileを抜ける
                 }
             }
 
             // 受信チェック
+            timeout_count = 0;
             for (index = 0; index < num_targets; ++index)
             {
-                if (targets[index].revents & POLLIN)
+                if (!(targets[index].revents & POLLIN))
                 {
-                    break;
+                    continue;
                 }
-            }
-            // indexが処理すべきソケット
-            timeout_count = 0;
-
-            socket_t passive_socket = targets[index].fd;
-            struct sockaddr_storage ss = map_udp_sockets[passive_socket].first;
-            struct sockaddr *address = (struct sockaddr *)&ss;
-            socklen_t socket_length = map_udp_sockets[passive_socket].second; /* length of address (IPv4, IPv4 mapped IPv6, IPv6) */
-
-            /* 7.senderからの受信 */
-            std::memset(buf, 0, sizeof(buf));
-            int n = recvfrom(passive_socket,
-                             buf,
-                             sizeof(buf) - 1,
-                             0,
-                             address, // 複数の送信元ホストからの情報が流れ込む
-                             &socket_length);
-
-            // ホスト情報
-            HostInfo sender_host_info = get_host_info(address);
+                socket_t passive_socket = targets[index].fd;
 
-            std::printf("Connection from : sender %s, port=%s\n",
-                        sender_host_info.mNumericHostName.c_str(),
-                        sender_host_info.mNumericServiceName.c_str());
-
-            // 標準出力にそのまま出力
-            std::printf("%s\n", buf);
+                /* 7.senderからの受信 */
+                // 溜まっている分を読み切る. 空きスロットへ直接読み, 記述子だけを表示スレッドへ渡す
+                // (逆引きやprintfで受信を止めない).
+                while (true)
+                {
+                    Datagram datagram;
+                    datagram.mPayload = held ? std::move(held) : packet_cache.allocate();
+                    if (!datagram.mPayload)
+                    {
+                        // 表示が追いつかずバッファが尽きた. 読み捨てて数える.
+                        if (recv(passive_socket, buf, sizeof(buf), MSG_DONTWAIT) < 0)
+                        {
+                            break;
+                        }
+                        ++queue_drops;
+                        metrics.mQueueDrops.inc();
+                        continue;
+                    }
 
-            // 送信元ホスト情報を登録
-            if (address->sa_family == AF_INET6)
-            {
-                // IPv6
-                auto &map_ipv6_host = map_sender_hosts_ipv6[passive_socket];
+                    // 補助データでSO_RXQ_OVFLの累計も受け取る
+                    struct iovec iov;
+                    iov.iov_base = datagram.mPayload.data();
+                    iov.iov_len = datagram.mPayload.capacity();
+                    char control[CMSG_SPACE(sizeof(uint32_t))];
+                    struct msghdr msg;
+                    std::memset(&msg, 0, sizeof(msg));
+                    msg.msg_name = &datagram.mSender; // 複数の送信元ホストからの情報が流れ込む
+                    msg.msg_namelen = sizeof(datagram.mSender);
+                    msg.msg_iov = &iov;
+                    msg.msg_iovlen = 1;
+                    msg.msg_control = control;
+                    msg.msg_controllen = sizeof(control);
+                    datagram.mSocket = passive_socket;
+                    ssize_t n = recvmsg(passive_socket, &msg, MSG_DONTWAIT);
+                    datagram.mSenderLength = msg.msg_namelen;
+                    if (n < 0)
+                    {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK)
+                        {
+                            metrics.mRecvErrors.inc(errno);
+                            IS_LOG_RATE(is::net::kLogError, 10, "recvmsg: %s", strerror(errno));
+                        }
+                        held = std::move(datagram.mPayload); // 次の受信で使う
+                        break;
+                    }
+                    datagram.mPayload.resize((size_t)n);
+#if defined(__linux__)
+                    uint32_t dropped;
+                    if (is::net::ReadRxqOverflow(msg, dropped))
+                    {
+                        socket_stats.onRxqOverflow(passive_socket, dropped);
+                    }
+#endif
+                    datagram.mReceivedNs = is::net::MetricsClockNs();
+                    metrics.mDatagramsReceived.inc();
+                    metrics.mBytesReceived.inc((uint64_t)n);
 
-                auto iter = map_ipv6_host.find(sender_host_info.mNumericHostName);
-                if (iter == map_ipv6_host.end())
-                {
-                    map_ipv6_host[sender_host_info.mNumericHostName] = sender_host_info; // register
-                }
-            }
-            else
-            {
-                // IPv4
-                auto &map_ipv4_host = map_sender_hosts_ipv4[passive_socket];
+                    if (use_connection_id)
+                    {
+                        // IDでセッションを引く. 制御フレームはここで完結し, DATAだけを表示へ回す.
+                        bool deliver = false;
+                        bool is_cid = sessions.onDatagram(
+                            datagram.mPayload.view(), (const struct sockaddr *)&datagram.mSender, datagram.mSenderLength,
+                            now_ms(), send_frame,
+                            [&datagram, &deliver](const is::net::CidSession &session, is::net::BytesView) {
+                                datagram.mSession = session.mId;
+                                datagram.mMigrations = session.mMigrations;
+                                datagram.mOffset = is::net::kCidHeaderSize;
+                                deliver = true;
+                            });
+                        if (is_cid && !deliver)
+                        {
+                            held = std::move(datagram.mPayload);
+                            continue;
+                        }
+                    }
 
-                auto iter = map_ipv4_host.find(sender_host_info.mNumericHostName);
-                if (iter == map_ipv4_host.end())
-                {
-                    map_ipv4_host[sender_host_info.mNumericHostName] = sender_host_info; // register
+                    // バッファ数 <= リングの容量なので必ず入る
+                    received_ring.tryPush(std::move(datagram));
                 }
             }
         } // while
 
+        // 残りを表示し終えるまで待つ
+        held.reset();
+        receive_done.store(true, std::memory_order_release);
+        printer.join();
+        is::net::AsyncLogger::instance().flush(); // 以降のprintfと順序を揃える
+        if (queue_drops > 0)
+        {
+            std::printf("[Status] %llu datagrams dropped (no free buffer)\n", (unsigned long long)queue_drops);
+        }
+        if (use_connection_id)
+        {
+            print_session_stats(sessions);
+        }
+#if defined(__linux__)
+        socket_stats.print(); // カーネルが捨てた数など
+#endif
+
         // クローズ
         for (auto &kv : map_udp_sockets)
         {
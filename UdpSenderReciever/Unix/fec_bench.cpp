@@ -0,0 +1,222 @@
+/**
+ * @file fec_bench.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief NetUtils/fec.hpp の符号化/復号のスループットを測るベンチマーク
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * + GF(256)の dst ^= c * src を実装毎に (表引き / SSSE3 / AVX2. 使えないものは飛ばす)
+ * + (k, m) 毎に, 1ブロックの符号化と, m個のデータが欠けたブロックの復号をデータのMB/sで
+ * + FecEncoder -> 損失 -> FecDecoder を通して, 戻ったデータが元と一致するかを確かめる
+ *
+ * usage: fec_bench [-s shard_bytes=1400] [-t megabytes_per_case=256]
+ */
+#include <test_utils.hpp>
+
+#include <chrono>
+#include <random>
+
+#include <NetUtils/fec.hpp>
+
+using steady_clock = std::chrono::steady_clock;
+
+static double MegabytesPerSec(steady_clock::time_point start, double bytes)
+{
+    double sec = std::chrono::duration<double>(steady_clock::now() - start).count();
+    return bytes / sec / 1e6;
+}
+
+/* 1.GF(256)の積和 */
+static double BenchMulAdd(is::net::GfKernel kernel, size_t shard, size_t total)
+{
+    std::vector<uint8_t> src(shard), dst(shard, 0);
+    std::mt19937 random(1);
+    for (uint8_t &b : src)
+    {
+        b = (uint8_t)random();
+    }
+    size_t rounds = total / shard;
+    steady_clock::time_point start = steady_clock::now();
+    for (size_t i = 0; i < rounds; ++i)
+    {
+        is::net::GfMulAdd(dst.data(), src.data(), (uint8_t)(2 + i % 250), shard, kernel);
+    }
+    asm volatile("" ::"r"(dst.data()) : "memory");
+    return MegabytesPerSec(start, (double)rounds * (double)shard);
+}
+
+/* 2.ブロックの符号化/復号 */
+static void BenchCodec(int k, int m, size_t shard, size_t total)
+{
+    is::net::ReedSolomon codec(k, m);
+    std::vector<std::vector<uint8_t>> shards((size_t)(k + m), std::vector<uint8_t>(shard));
+    std::mt19937 random(2);
+    for (int j = 0; j < k; ++j)
+    {
+        for (uint8_t &b : shards[(size_t)j])
+        {
+            b = (uint8_t)random();
+        }
+    }
+    std::vector<const uint8_t *> data;
+    std::vector<uint8_t *> parity, all;
+    for (int s = 0; s < k + m; ++s)
+    {
+        (s < k ? data.push_back(shards[(size_t)s].data()) : parity.push_back(shards[(size_t)s].data()));
+        all.push_back(shards[(size_t)s].data());
+    }
+    size_t blocks = std::max<size_t>(1, total / (shard * (size_t)k));
+
+    steady_clock::time_point start = steady_clock::now();
+    for (size_t b = 0; b < blocks; ++b)
+    {
+        codec.encode(data.data(), parity.data(), shard);
+    }
+    double encode = MegabytesPerSec(start, (double)blocks * (double)k * (double)shard);
+
+    // 先頭m個のデータを落として戻す (最悪ケース: 全パリティを使う)
+    std::vector<std::vector<uint8_t>> original(shards.begin(), shards.begin() + m);
+    bool present[256];
+    for (int s = 0; s < k + m; ++s)
+    {
+        present[s] = s >= m;
+    }
+    bool ok = true;
+    start = steady_clock::now();
+    for (size_t b = 0; b < blocks; ++b)
+    {
+        ok &= codec.reconstruct(all.data(), present, shard);
+    }
+    double decode = MegabytesPerSec(start, (double)blocks * (double)k * (double)shard);
+    for (int j = 0; j < m; ++j)
+    {
+        ok &= shards[(size_t)j] == original[(size_t)j];
+    }
+
+    // 1個だけ落とす (m=1でなくてもXORで戻る)
+    std::fill(present, present + k + m, true);
+    present[k / 2] = false;
+    start = steady_clock::now();
+    for (size_t b = 0; b < blocks; ++b)
+    {
+        ok &= codec.reconstruct(all.data(), present, shard);
+    }
+    double decode_one = MegabytesPerSec(start, (double)blocks * (double)k * (double)shard);
+
+    std::printf("  k=%-3d m=%-2d overhead %5.1f%%  encode %8.1f MB/s  decode(%d lost) %8.1f MB/s  decode(1 lost) %8.1f MB/s  %s\n",
+                k, m, 100.0 * m / k, encode, m, decode, decode_one, ok ? "ok" : "MISMATCH");
+}
+
+/* 3.パケットの経路で損失を戻す */
+static void CheckPacketPath(int k, int m, double loss)
+{
+    is::net::FecEncoder encoder(k, m);
+    is::net::FecDecoder decoder;
+    std::mt19937 random(3);
+    std::bernoulli_distribution drop(loss);
+    std::vector<std::string> sent;
+    std::vector<bool> got;
+    uint64_t lost = 0, mismatch = 0;
+
+    auto on_datagram = [&](const uint8_t *data, size_t length, bool) {
+        std::string text((const char *)data, length);
+        size_t index = std::strtoull(text.c_str() + 4, nullptr, 10);
+        if (index >= sent.size() || sent[index] != text)
+        {
+            ++mismatch;
+            return;
+        }
+        got[index] = true;
+    };
+    auto on_packet = [&](const uint8_t *packet, size_t length) {
+        if (drop(random))
+        {
+            ++lost;
+            return;
+        }
+        decoder.onPacket(is::net::BytesView(packet, length), on_datagram);
+    };
+    for (int i = 0; i < 20000; ++i)
+    {
+        // 長さを変えて0埋めと長さの復元も確かめる
+        std::string text = "msg " + std::to_string(i) + std::string((size_t)(random() % 200), 'x');
+        sent.push_back(text);
+        got.push_back(false);
+        encoder.add((const uint8_t *)text.data(), text.size(), on_packet);
+        if (i % 997 == 0)
+        {
+            encoder.flush(on_packet); // 途中で閉じたブロック
+        }
+    }
+    encoder.flush(on_packet);
+
+    uint64_t missing = (uint64_t)std::count(got.begin(), got.end(), false);
+    const is::net::FecDecoderStats &stats = decoder.stats();
+    std::printf("  k=%-3d m=%-2d loss %4.1f%%: dropped %llu packets, recovered %llu, still missing %llu, mismatch %llu\n",
+                k, m, loss * 100.0, (unsigned long long)lost, (unsigned long long)stats.mRecovered,
+                (unsigned long long)missing, (unsigned long long)mismatch);
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        size_t shard = 1400;
+        size_t total = (size_t)256 << 20;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string opt(argv[i]);
+            if (opt == "-s")
+            {
+                shard = std::max<size_t>(16, std::strtoull(argv[i + 1], nullptr, 10));
+            }
+            else if (opt == "-t")
+            {
+                total = std::max<size_t>(1, std::strtoull(argv[i + 1], nullptr, 10)) << 20;
+            }
+        }
+
+        std::printf("[Done] Step1. GF(256) multiply-add, %zu byte shards (default kernel: %s)\n",
+                    shard, is::net::GfKernelName(is::net::GfActiveKernel()));
+        is::net::GfKernel kernels[] = {is::net::GfKernel::kTable, is::net::GfKernel::kSsse3, is::net::GfKernel::kAvx2};
+        for (is::net::GfKernel kernel : kernels)
+        {
+            if (kernel != is::net::GfKernel::kTable && (int)kernel > (int)is::net::GfBestKernel())
+            {
+                std::printf("  %-6s (not supported)\n", is::net::GfKernelName(kernel));
+                continue;
+            }
+            std::printf("  %-6s %8.1f MB/s\n", is::net::GfKernelName(kernel), BenchMulAdd(kernel, shard, total));
+        }
+
+        const int cases[][2] = {{4, 1}, {8, 1}, {8, 2}, {16, 2}, {16, 4}, {32, 4}, {64, 8}};
+        is::net::GfKernel best = is::net::GfActiveKernel();
+        is::net::GfKernel variants[] = {is::net::GfKernel::kTable, best};
+        for (is::net::GfKernel kernel : variants)
+        {
+            is::net::GfActiveKernel() = kernel;
+            std::printf("[Done] Step2. block encode/decode (%s)\n", is::net::GfKernelName(kernel));
+            for (const auto &c : cases)
+            {
+                BenchCodec(c[0], c[1], shard, total / 4);
+            }
+            if (best == is::net::GfKernel::kTable)
+            {
+                break;
+            }
+        }
+        is::net::GfActiveKernel() = best;
+
+        std::printf("[Done] Step3. packet path (FecEncoder -> loss -> FecDecoder)\n");
+        CheckPacketPath(8, 1, 0.02);
+        CheckPacketPath(8, 2, 0.05);
+        CheckPacketPath(16, 4, 0.10);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    return 0;
+}
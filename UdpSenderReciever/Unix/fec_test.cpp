@@ -0,0 +1,365 @@
+/**
+ * @file fec_test.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 前方誤り訂正(NetUtils/fec.hpp)の単体テスト
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: fec_test
+ *
+ * + GF(256): 逆元, SSSE3/AVX2の結果が表引きと一致するか (使えるCPUのみ)
+ * + Reed-Solomon: m個までの欠けの全ての組み合わせが戻る / m+1個は戻らない
+ * + FecEncoder -> 損失 -> FecDecoder: 長さの違うデータ, flushで閉じたブロック
+ * + 壊れたヘッダ (count = 0, count > k), 長さの食い違うパリティ, パリティより長いデータ
+ * + 送信者の再起動 (sessionが変わると同じブロック番号でも受け取る)
+ */
+#include <test_utils.hpp>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <NetUtils/fec.hpp>
+
+#include "test_check.hpp"
+
+using is::net::BytesView;
+
+namespace
+{
+    using Packet = std::vector<uint8_t>;
+
+    void TestGf256()
+    {
+        const is::net::Gf256 &gf = is::net::Gf256::instance();
+        for (int a = 1; a < 256; ++a)
+        {
+            TEST_CHECK_EQ(gf.mul((uint8_t)a, gf.inv((uint8_t)a)), 1);
+            TEST_CHECK_EQ(gf.mul((uint8_t)a, 1), a);
+            TEST_CHECK_EQ(gf.mul((uint8_t)a, 0), 0);
+        }
+        TEST_CHECK_EQ(gf.mul(0x80, 2), 0x1D); // x^8 = x^4+x^3+x^2+1
+
+        std::mt19937 random(1);
+        std::vector<is::net::GfKernel> kernels = {is::net::GfKernel::kTable};
+#if defined(IS_NET_GF_X86)
+        if (__builtin_cpu_supports("ssse3"))
+        {
+            kernels.push_back(is::net::GfKernel::kSsse3);
+        }
+        if (__builtin_cpu_supports("avx2"))
+        {
+            kernels.push_back(is::net::GfKernel::kAvx2);
+        }
+#endif
+        for (size_t n : {1u, 15u, 16u, 33u, 1000u})
+        {
+            std::vector<uint8_t> src(n), base(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                src[i] = (uint8_t)random();
+                base[i] = (uint8_t)random();
+            }
+            for (int c : {2, 0x53, 0xFF})
+            {
+                std::vector<uint8_t> expected = base;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    expected[i] ^= gf.mul((uint8_t)c, src[i]);
+                }
+                for (is::net::GfKernel kernel : kernels)
+                {
+                    std::vector<uint8_t> dst = base;
+                    is::net::GfMulAdd(dst.data(), src.data(), (uint8_t)c, n, kernel);
+                    TEST_CHECK(dst == expected);
+                }
+            }
+        }
+    }
+
+    void TestReedSolomon()
+    {
+        const int k = 6, m = 3;
+        const size_t len = 100;
+        is::net::ReedSolomon codec(k, m);
+        std::mt19937 random(2);
+        std::vector<std::vector<uint8_t>> original((size_t)(k + m), std::vector<uint8_t>(len));
+        for (int j = 0; j < k; ++j)
+        {
+            for (auto &b : original[(size_t)j])
+            {
+                b = (uint8_t)random();
+            }
+        }
+        const uint8_t *data[k];
+        uint8_t *parity[m];
+        for (int j = 0; j < k; ++j)
+        {
+            data[j] = original[(size_t)j].data();
+        }
+        for (int i = 0; i < m; ++i)
+        {
+            parity[i] = original[(size_t)(k + i)].data();
+        }
+        codec.encode(data, parity, len);
+
+        // 1つ目のパリティはデータのXOR
+        std::vector<uint8_t> xor_all(len, 0);
+        for (int j = 0; j < k; ++j)
+        {
+            is::net::GfXorRegion(xor_all.data(), data[j], len);
+        }
+        TEST_CHECK(xor_all == original[(size_t)k]);
+
+        // k+m個からの欠けの全ての組み合わせ
+        int recovered = 0, refused = 0;
+        for (uint32_t mask = 0; mask < (1u << (k + m)); ++mask)
+        {
+            int lost = __builtin_popcount(mask);
+            std::vector<std::vector<uint8_t>> shards = original;
+            uint8_t *pointers[k + m];
+            bool present[k + m];
+            for (int s = 0; s < k + m; ++s)
+            {
+                present[s] = (mask & (1u << s)) == 0;
+                if (!present[s])
+                {
+                    std::fill(shards[(size_t)s].begin(), shards[(size_t)s].end(), 0xEE);
+                }
+                pointers[s] = shards[(size_t)s].data();
+            }
+            bool ok = codec.reconstruct(pointers, present, len);
+            if (lost <= m)
+            {
+                TEST_CHECK(ok);
+                for (int j = 0; ok && j < k; ++j)
+                {
+                    TEST_CHECK(shards[(size_t)j] == original[(size_t)j]);
+                }
+                ++recovered;
+            }
+            else
+            {
+                // データの欠けがm個を超えたら戻らない (パリティの欠けだけなら戻すものが無い)
+                int data_lost = __builtin_popcount(mask & ((1u << k) - 1));
+                if (data_lost > 0 && k + m - lost < k)
+                {
+                    TEST_CHECK(!ok);
+                    ++refused;
+                }
+            }
+        }
+        TEST_CHECK(recovered > 0 && refused > 0);
+
+        bool threw = false;
+        try
+        {
+            is::net::ReedSolomon invalid(200, 57);
+        }
+        catch (const std::invalid_argument &)
+        {
+            threw = true;
+        }
+        TEST_CHECK(threw);
+    }
+
+    // encoderの出力を集める
+    std::vector<Packet> Encode(is::net::FecEncoder &encoder, const std::vector<std::string> &datagrams, bool flush)
+    {
+        std::vector<Packet> packets;
+        auto on_packet = [&packets](const uint8_t *packet, size_t length) { packets.emplace_back(packet, packet + length); };
+        for (const std::string &datagram : datagrams)
+        {
+            TEST_CHECK(encoder.add((const uint8_t *)datagram.data(), datagram.size(), on_packet));
+        }
+        if (flush)
+        {
+            encoder.flush(on_packet);
+        }
+        return packets;
+    }
+
+    struct Received
+    {
+        std::vector<std::string> datagrams;
+        int recovered = 0;
+    };
+
+    void Decode(is::net::FecDecoder &decoder, const Packet &packet, Received &received)
+    {
+        decoder.onPacket(BytesView(packet.data(), packet.size()), [&received](const uint8_t *data, size_t length, bool recovered) {
+            received.datagrams.emplace_back((const char *)data, length);
+            received.recovered += recovered ? 1 : 0;
+        });
+    }
+
+    void TestPacketPath()
+    {
+        const int k = 4, m = 2;
+        is::net::FecEncoder encoder(k, m, 256, 0x11);
+        is::net::FecDecoder decoder(8, 256);
+        std::vector<std::string> datagrams;
+        for (int i = 0; i < 10; ++i)
+        {
+            datagrams.push_back(std::string((size_t)(1 + i * 7), (char)('a' + i))); // 長さを変える
+        }
+        std::vector<Packet> packets = Encode(encoder, datagrams, true);
+        // 2ブロック(4+2)と, flushで閉じた2個の途中のブロック(2+2)
+        TEST_CHECK_EQ(packets.size(), (size_t)(6 + 6 + 4));
+
+        // 各ブロックのデータを2つずつ落とす
+        Received received;
+        for (size_t i = 0; i < packets.size(); ++i)
+        {
+            is::net::FecHeader header;
+            TEST_CHECK(is::net::ReadFecHeader(BytesView(packets[i].data(), packets[i].size()), &header));
+            if (header.mIndex < 2)
+            {
+                continue;
+            }
+            Decode(decoder, packets[i], received);
+        }
+        TEST_CHECK_EQ(received.recovered, 6);
+        TEST_CHECK_EQ(received.datagrams.size(), datagrams.size());
+        for (const std::string &datagram : datagrams)
+        {
+            TEST_CHECK(std::find(received.datagrams.begin(), received.datagrams.end(), datagram) != received.datagrams.end());
+        }
+        TEST_CHECK_EQ(decoder.stats().mUnrecoverable, 0u);
+
+        // 重複は渡さない
+        Decode(decoder, packets[2], received);
+        TEST_CHECK_EQ(received.datagrams.size(), datagrams.size());
+    }
+
+    // 先頭のブロック(データ1個 + パリティ1個)を組み立てる
+    std::vector<Packet> SmallBlock(uint32_t session)
+    {
+        is::net::FecEncoder encoder(2, 1, 64, session);
+        return Encode(encoder, {"hello"}, true);
+    }
+
+    void TestMalformedHeader()
+    {
+        std::vector<Packet> packets = SmallBlock(1);
+        TEST_CHECK_EQ(packets.size(), 2u);
+        Packet parity = packets[1];
+        is::net::FecHeader header;
+        TEST_CHECK(is::net::ReadFecHeader(BytesView(parity.data(), parity.size()), &header));
+        TEST_CHECK_EQ(header.mCount, 1);
+
+        Packet zero = parity;
+        zero[15] = 0; // count = 0
+        TEST_CHECK(!is::net::ReadFecHeader(BytesView(zero.data(), zero.size()), &header));
+        Packet over = parity;
+        over[15] = 3; // count > k
+        TEST_CHECK(!is::net::ReadFecHeader(BytesView(over.data(), over.size()), &header));
+        Packet index = parity;
+        index[12] = 3; // index >= k + m
+        TEST_CHECK(!is::net::ReadFecHeader(BytesView(index.data(), index.size()), &header));
+        TEST_CHECK(!is::net::ReadFecHeader(BytesView(parity.data(), is::net::kFecHeaderSize - 1), &header));
+
+        is::net::FecDecoder decoder(4, 64);
+        Received received;
+        TEST_CHECK(!decoder.onPacket(BytesView(zero.data(), zero.size()), [](const uint8_t *, size_t, bool) {}));
+        TEST_CHECK(!decoder.onPacket(BytesView(over.data(), over.size()), [](const uint8_t *, size_t, bool) {}));
+    }
+
+    void TestMismatchedParity()
+    {
+        // k=2, m=2: パリティを2つ送り, 2つ目の長さを変える
+        is::net::FecEncoder encoder(2, 2, 64, 1);
+        std::vector<Packet> packets = Encode(encoder, {"abc", "defgh"}, false);
+        TEST_CHECK_EQ(packets.size(), 4u);
+        is::net::FecDecoder decoder(4, 64);
+        Received received;
+        Decode(decoder, packets[2], received); // パリティ1 (シャード長が決まる)
+        Packet longer = packets[3];
+        longer.push_back(0);
+        Decode(decoder, longer, received); // 長さが違う: 捨てる
+        TEST_CHECK_EQ(decoder.stats().mMalformed, 1u);
+        TEST_CHECK_EQ(received.datagrams.size(), 0u); // 欠け2個, 使えるパリティは1個
+
+        Decode(decoder, packets[3], received); // 正しいパリティで2個とも戻る
+        TEST_CHECK_EQ(received.recovered, 2);
+        TEST_CHECK(received.datagrams.size() == 2 && (received.datagrams[0] == "abc" || received.datagrams[1] == "abc"));
+    }
+
+    void TestDataLongerThanParity()
+    {
+        // パリティは短いデータ(k=2のうち1個目のみ)から作られたのに, 長いデータが同じブロック番号で届く
+        std::vector<Packet> packets = SmallBlock(1);
+        is::net::FecEncoder other(2, 1, 64, 1);
+        std::vector<Packet> long_block = Encode(other, {"a much longer datagram", "x"}, false);
+
+        is::net::FecDecoder decoder(4, 64);
+        Received received;
+        Packet data1 = long_block[1]; // index 1, 長い方のブロックのデータ
+        Decode(decoder, data1, received);
+        Decode(decoder, packets[1], received); // count = 1のパリティ: index 1はcount以降
+        TEST_CHECK_EQ(received.recovered, 0);
+        TEST_CHECK_EQ(decoder.stats().mUnrecoverable, 1u);
+
+        // 長さだけが合わない場合 (count = k)
+        is::net::FecEncoder shorter(2, 1, 64, 2);
+        std::vector<Packet> short_block = Encode(shorter, {"ab", "cd"}, false);
+        is::net::FecEncoder longer(2, 1, 64, 2);
+        std::vector<Packet> longer_block = Encode(longer, {"ab", "this one is longer"}, false);
+        is::net::FecDecoder decoder2(4, 64);
+        Received received2;
+        Decode(decoder2, longer_block[1], received2); // 長いデータ
+        Decode(decoder2, short_block[2], received2);  // 短いデータのパリティ
+        TEST_CHECK_EQ(received2.recovered, 0);
+        TEST_CHECK_EQ(decoder2.stats().mUnrecoverable, 1u);
+    }
+
+    void TestSessionRestart()
+    {
+        is::net::FecDecoder decoder(4, 64);
+        Received received;
+        for (const Packet &packet : SmallBlock(1))
+        {
+            Decode(decoder, packet, received);
+        }
+        TEST_CHECK_EQ(received.datagrams.size(), 1u);
+
+        // 送信者の再起動: ブロック0, index 0を別のsessionで
+        is::net::FecEncoder restarted(2, 1, 64, 2);
+        std::vector<Packet> packets = Encode(restarted, {"again"}, false);
+        Decode(decoder, packets[0], received);
+        TEST_CHECK_EQ(received.datagrams.size(), 2u);
+        TEST_CHECK(received.datagrams.back() == "again");
+        TEST_CHECK_EQ(decoder.stats().mSessions, 2u);
+    }
+} // namespace
+
+int main(int, char **)
+{
+    try
+    {
+        TestGf256();
+        std::printf("[Done] Step1. GF(256) (kernel %s)\n", is::net::GfKernelName(is::net::GfBestKernel()));
+        TestReedSolomon();
+        std::printf("[Done] Step2. Reed-Solomon erasures\n");
+        TestPacketPath();
+        std::printf("[Done] Step3. packet path with loss\n");
+        TestMalformedHeader();
+        std::printf("[Done] Step4. malformed headers\n");
+        TestMismatchedParity();
+        std::printf("[Done] Step5. mismatched parity\n");
+        TestDataLongerThanParity();
+        std::printf("[Done] Step6. data longer than parity\n");
+        TestSessionRestart();
+        std::printf("[Done] Step7. sender restart\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::printf("[Result] %d failures\n", TestFailures());
+    return TestFailures() == 0 ? 0 : 1;
+}
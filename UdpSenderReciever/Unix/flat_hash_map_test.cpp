@@ -0,0 +1,168 @@
+/**
+ * @file flat_hash_map_test.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 線形探査のハッシュ表(NetUtils/flat_hash_map.hpp)の単体テスト
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: flat_hash_map_test
+ *
+ * + 挿入・重複・削除・再配置
+ * + 衝突ばかりのハッシュと表の末尾をまたぐ探査列での削除(backward shift)
+ * + 乱数で挿入と削除を繰り返し, std::unordered_mapと中身を比べる
+ */
+#include <test_utils.hpp>
+
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+
+#include <NetUtils/flat_hash_map.hpp>
+
+#include "test_check.hpp"
+
+namespace
+{
+    struct IdentityHash
+    {
+        size_t operator()(uint64_t key) const { return (size_t)key; }
+    };
+
+    // 全て同じ位置 (最悪の探査列)
+    struct ConstantHash
+    {
+        size_t operator()(uint64_t) const { return 13; }
+    };
+
+    template <typename Map>
+    bool SameContents(Map &map, const std::unordered_map<uint64_t, uint64_t> &reference)
+    {
+        if (map.size() != reference.size())
+        {
+            return false;
+        }
+        for (const auto &entry : reference)
+        {
+            uint64_t *value = map.find(entry.first);
+            if (value == nullptr || *value != entry.second)
+            {
+                return false;
+            }
+        }
+        size_t visited = 0;
+        map.forEach([&visited](const uint64_t &, uint64_t &) { ++visited; });
+        return visited == reference.size();
+    }
+
+    void TestBasic()
+    {
+        is::net::FlatHashMap<uint64_t, uint64_t, IdentityHash> map(4);
+        TEST_CHECK(map.empty());
+        TEST_CHECK_EQ(map.capacity(), 16u); // 最小
+        for (uint64_t k = 0; k < 100; ++k)
+        {
+            TEST_CHECK(map.emplace(k, k * 10).second);
+        }
+        TEST_CHECK_EQ(map.size(), 100u);
+        TEST_CHECK(map.capacity() * 7 >= map.size() * 10); // 負荷率70%以下
+        auto again = map.emplace(5, 999);
+        TEST_CHECK(!again.second);
+        TEST_CHECK_EQ(*again.first, 50u); // 既存はそのまま
+        TEST_CHECK(map.erase(5));
+        TEST_CHECK(!map.erase(5));
+        TEST_CHECK(map.find(5) == nullptr);
+        TEST_CHECK_EQ(map.size(), 99u);
+
+        is::net::FlatHashMap<uint64_t, uint64_t, IdentityHash> reserved;
+        reserved.reserve(1000);
+        size_t capacity = reserved.capacity();
+        for (uint64_t k = 0; k < 1000; ++k)
+        {
+            reserved.emplace(k, k);
+        }
+        TEST_CHECK_EQ(reserved.capacity(), capacity); // 再配置されない
+    }
+
+    void TestCollisions()
+    {
+        // 全て同じ位置から始まる探査列の途中を消しても残りが見つかる
+        is::net::FlatHashMap<uint64_t, uint64_t, ConstantHash> map(64);
+        std::unordered_map<uint64_t, uint64_t> reference;
+        for (uint64_t k = 1; k <= 30; ++k)
+        {
+            map.emplace(k, k);
+            reference.emplace(k, k);
+        }
+        for (uint64_t k = 1; k <= 30; k += 3)
+        {
+            TEST_CHECK(map.erase(k));
+            reference.erase(k);
+        }
+        TEST_CHECK(SameContents(map, reference));
+
+        // 表の末尾から先頭へ回り込む探査列 (容量16, 位置14と15から)
+        is::net::FlatHashMap<uint64_t, uint64_t, IdentityHash> wrap(16);
+        std::unordered_map<uint64_t, uint64_t> wrap_reference;
+        for (uint64_t k : {14u, 30u, 46u, 15u, 31u, 0u, 1u})
+        {
+            wrap.emplace(k, k + 1);
+            wrap_reference.emplace(k, k + 1);
+        }
+        for (uint64_t k : {14u, 15u, 30u})
+        {
+            TEST_CHECK(wrap.erase(k));
+            wrap_reference.erase(k);
+            TEST_CHECK(SameContents(wrap, wrap_reference));
+        }
+    }
+
+    void TestAgainstReference()
+    {
+        std::mt19937_64 random(11);
+        is::net::FlatHashMap<uint64_t, uint64_t, IdentityHash> map;
+        std::unordered_map<uint64_t, uint64_t> reference;
+        int mismatches = 0;
+        for (int i = 0; i < 200000; ++i)
+        {
+            uint64_t key = random() % 4096; // 小さい範囲で衝突と削除を多くする
+            if (random() % 3 == 0)
+            {
+                bool erased = map.erase(key);
+                mismatches += erased != (reference.erase(key) == 1) ? 1 : 0;
+            }
+            else
+            {
+                bool inserted = map.emplace(key, i).second;
+                mismatches += inserted != reference.emplace(key, i).second ? 1 : 0;
+            }
+            if (i % 10000 == 0 && !SameContents(map, reference))
+            {
+                ++mismatches;
+            }
+        }
+        TEST_CHECK_EQ(mismatches, 0);
+        TEST_CHECK(SameContents(map, reference));
+    }
+} // namespace
+
+int main(int, char **)
+{
+    try
+    {
+        TestBasic();
+        std::printf("[Done] Step1. insert, duplicate, erase, reserve\n");
+        TestCollisions();
+        std::printf("[Done] Step2. backward shift deletion\n");
+        TestAgainstReference();
+        std::printf("[Done] Step3. random operations against std::unordered_map\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::printf("[Result] %d failures\n", TestFailures());
+    return TestFailures() == 0 ? 0 : 1;
+}
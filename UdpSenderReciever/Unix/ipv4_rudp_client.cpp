@@ -0,0 +1,126 @@
+/**
+ * @file ipv4_rudp_client.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief UDPの上の信頼性のあるストリーム(reliable_udp.hpp)のクライアント. 手順はipv4_tcp_clientと同じ.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: ipv4_rudp_client [-a address=127.0.0.1] [-c newreno|bbr]
+ */
+#include <test_utils.hpp>
+
+// udp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h> // inet_pton, inet_ntop
+#include <netdb.h>
+
+#include <NetUtils/reliable_udp.hpp>
+
+#if defined(__linux__)
+
+#elif defined(__MACH__)
+
+#else
+// Windows
+#endif
+
+#define BUFSIZE 1500
+
+struct sockaddr_in server_info; // IPv4アドレス情報
+struct sockaddr *p_server; // インターフェース
+socklen_t socket_length;
+unsigned short port_of_server = 54321;
+
+int socket_to_server; // サーバに接続するソケット
+char buf[BUFSIZE];
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        const char *server_name = "127.0.0.1";
+        const char *congestion = "newreno";
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::strcmp(argv[i], "-a") == 0)
+            {
+                server_name = argv[i + 1];
+            }
+            else if (std::strcmp(argv[i], "-c") == 0)
+            {
+                congestion = argv[i + 1];
+            }
+        }
+        is::net::RudpOptions options;
+        std::unique_ptr<is::net::CongestionControl> control = is::net::MakeCongestionControl(congestion, options.mMaxPayload);
+        if (!control)
+        {
+            std::printf("[Error] unknown congestion control: %s\n", congestion);
+            throw std::runtime_error("congestion control");
+        }
+
+        /* 1.ソケットの作成 */
+        if ((socket_to_server = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("socket");
+        }
+        std::printf("[Done] Step1. create socket\n");
+
+        /* 2.接続先指定用構造体の準備 */
+        std::memset(&server_info, 0, sizeof(server_info));
+        server_info.sin_family = AF_INET;
+        server_info.sin_port = htons(port_of_server);
+        socket_length = sizeof(server_info);
+        p_server = (struct sockaddr *)&server_info;
+
+        /* 3.宛先(server)の確定 */
+        if (inet_pton(AF_INET, server_name, &(server_info.sin_addr)) != 1)
+        {
+            std::printf("[Error] not an IPv4 address: %s\n", server_name);
+            throw std::runtime_error("IP Address");
+        }
+        std::printf("[Done] Step2. configure destination (server): `%s`; port=%u\n", server_name, port_of_server);
+
+        /* 4.サーバーに接続 (SYN -> SYNACK -> ACK) */
+        is::net::RudpSocket stream(socket_to_server, options, std::move(control));
+        if (stream.connect(p_server, socket_length) != 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("connect");
+        }
+        std::printf("[Done] Step3. connect to server `%s`; port=%u (%s, connection 0x%08x)\n",
+                    server_name, port_of_server, congestion, stream.connection().connection());
+
+        /* 5.サーバーに送信 */
+        std::snprintf(buf, sizeof(buf), "message from IPv4 rudp client");
+        ssize_t n = stream.write(buf, strnlen(buf, sizeof(buf)));
+
+        /* 6.サーバーから受信 */
+        std::memset(buf, 0, sizeof(buf));
+        n = stream.read(buf, sizeof(buf) - 1);
+
+        std::printf("read n=%zd, %s\n", n, buf);
+
+        /* 7.接続を閉じる (FIN) */
+        if (stream.close() != 0)
+        {
+            std::printf("[Warning] close: %s\n", strerror(errno));
+        }
+        std::printf("[Done] Step4. close (srtt %.1f us, rto %.1f ms)\n",
+                    (double)stream.connection().srttNs() / 1000.0,
+                    (double)stream.connection().rtoNs() / 1e6);
+
+        /* 8.ソケットを閉じる */
+        close(socket_to_server);
+    }
+    catch (const std::exception &e)
+    {
+        close(socket_to_server);
+        std::cerr << e.what() << '\n';
+    }
+}
@@ -0,0 +1,133 @@
+/**
+ * @file ipv4_rudp_server.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief UDPの上の信頼性のあるストリーム(reliable_udp.hpp)のサーバ. 手順はipv4_tcp_serverと同じ.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: ipv4_rudp_server [-c newreno|bbr]
+ * UDPソケットにbindし, 最初のSYNの送信元を受け付ける(ソケットはそのクライアントにconnectされる).
+ */
+#include <test_utils.hpp>
+
+// udp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h> // inet_pton, inet_ntop
+#include <netdb.h>
+
+#include <NetUtils/reliable_udp.hpp>
+
+#if defined(__linux__)
+
+#elif defined(__MACH__)
+
+#else
+// Windows
+#endif
+
+#define BUFSIZE 1500
+
+struct sockaddr_in client_info;  // IPv4アドレス情報
+struct sockaddr *p_client;       // インターフェース
+socklen_t socket_length;
+unsigned short port_of_self = 54321;
+int ret;
+
+int passive_socket; // 受付用ソケット (受け付けた後はクライアントとの通信に使う)
+char buf[BUFSIZE];
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        const char *congestion = "newreno";
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::strcmp(argv[i], "-c") == 0)
+            {
+                congestion = argv[i + 1];
+            }
+        }
+        is::net::RudpOptions options;
+        std::unique_ptr<is::net::CongestionControl> control = is::net::MakeCongestionControl(congestion, options.mMaxPayload);
+        if (!control)
+        {
+            std::printf("[Error] unknown congestion control: %s\n", congestion);
+            throw std::runtime_error("congestion control");
+        }
+
+        /* 1.ソケットの作成 */
+        if ((passive_socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("socket");
+        }
+        std::printf("[Done] Step1. create socket\n");
+
+        /* 2.接続受付用構造体の準備 */
+        std::memset(&client_info, 0, sizeof(client_info));
+        client_info.sin_family = AF_INET;
+        client_info.sin_port = htons(port_of_self);
+        client_info.sin_addr.s_addr = INADDR_ANY; // 全てのINetインターフェースで受け付ける
+        socket_length = sizeof(client_info);
+        p_client = (struct sockaddr *)&client_info;
+
+        /* 3.待受を行うIPアドレスとポート番号を指定 */
+        if ((ret = bind(passive_socket, p_client, socket_length)) != 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("bind");
+        }
+        std::printf("[Done] Step2. bind socket\n");
+
+        /* 4.クライアントからの接続要求(SYN)を受ける */
+        is::net::RudpSocket stream(passive_socket, options, std::move(control));
+        std::printf("[Done] Step3. accepting client (%s) ...\n", congestion);
+        if (stream.accept(p_client, &socket_length) != 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("accept");
+        }
+        std::printf("[Done] Step4. accept client (connection 0x%08x)\n", stream.connection().connection());
+
+        /* 5.クライアントのIPv4アドレスを文字列に変換 */
+        char client_address[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &(client_info.sin_addr), client_address, sizeof(client_address));
+        unsigned short port_of_client = ntohs(client_info.sin_port);
+        std::printf("connection from : client %s, port=%u\n", client_address, port_of_client);
+
+        /* 6.クライアントからのメッセージを受信 */
+        std::memset(buf, 0, sizeof(buf));
+        ssize_t n = stream.read(buf, sizeof(buf) - 1);
+        std::printf("read n=%zd, message : %s\n", n, buf);
+
+        /* 7.サーバーからクライアントへ送信 */
+        std::snprintf(buf, sizeof(buf), "message from IPv4 rudp server");
+        n = stream.write(buf, strnlen(buf, sizeof(buf)));
+
+        /* 8.接続を閉じる (FIN) */
+        if (stream.close() != 0)
+        {
+            std::printf("[Warning] close: %s\n", strerror(errno));
+        }
+        const is::net::RudpStats &stats = stream.connection().stats();
+        std::printf("[Done] Step5. close (frames %llu, retransmits %llu, srtt %.1f us)\n",
+                    (unsigned long long)stats.mFramesSent,
+                    (unsigned long long)stats.mRetransmits,
+                    (double)stream.connection().srttNs() / 1000.0);
+
+        /* 9.ソケットを閉じる */
+        close(passive_socket);
+    }
+    catch (const std::exception &e)
+    {
+        close(passive_socket);
+        std::cerr << e.what() << '\n';
+    }
+
+    return 0;
+}
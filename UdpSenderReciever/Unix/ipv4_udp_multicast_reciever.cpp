@@ -6,6 +6,14 @@
  * @date 2023-05-24
  * 
  * @copyright Copyright (c) 2023
+ *
+ * usage: ipv4_udp_multicast_reciever [-s source_prefix] [-m magic] [-R ifname]
+ *
+ * (Linux) `-s`(例: 10.0.0.0/8)で送信元, `-m`(例: 0x49534E54)でペイロード先頭4バイトを
+ * SO_ATTACH_FILTERで照合し, 他の送信者のパケットはカーネル内で捨てる.
+ * (Linux) `-R`(例: eth0)でrecvfromの代わりにifnameのTPACKET_V3受信リング(NetUtils/packet_ring.hpp)から
+ * グループ宛てのデータグラムをコピーせずに読む(CAP_NET_RAWが必要). ソケットはJOINのためだけに使う.
+ * `-s`/`-m`のフィルタはソケットにしか効かない.
  * 
  */
 #include <test_utils.hpp>
@@ -18,7 +26,8 @@
 #include <netdb.h>
 
 #if defined(__linux__)
-
+#include <NetUtils/socket_filter.hpp>
+#include <NetUtils/packet_ring.hpp>
 #elif defined(__MACH__)
 
 #else
@@ -65,6 +74,43 @@ int main(int argc, char** argv)
         }
         std::printf("[Done] Step1. create socket\n");
 
+#if defined(__linux__)
+        /* (任意) 受信フィルタ. bind前に付けて, 最初のパケットから効かせる */
+        std::vector<is::net::BpfProgram> filters;
+        const char *ring_ifname = nullptr;
+        is::net::PacketRing ring;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::strcmp(argv[i], "-s") == 0)
+            {
+                struct sockaddr_storage prefix;
+                int prefix_length;
+                if (!is::net::ParsePrefix(argv[i + 1], &prefix, &prefix_length) || prefix.ss_family != AF_INET)
+                {
+                    throw std::runtime_error("invalid source prefix");
+                }
+                filters.push_back(is::net::SourcePrefixFilter((struct sockaddr *)&prefix, prefix_length));
+            }
+            else if (std::strcmp(argv[i], "-m") == 0)
+            {
+                filters.push_back(is::net::UdpPayloadMagicFilter((uint32_t)std::strtoul(argv[i + 1], nullptr, 0)));
+            }
+            else if (std::strcmp(argv[i], "-R") == 0)
+            {
+                ring_ifname = argv[i + 1];
+            }
+        }
+        if (!filters.empty())
+        {
+            if (is::net::AttachSocketFilter(passive_socket, is::net::BpfAllOf(filters)) != 0)
+            {
+                std::printf("[Error] setsockopt SO_ATTACH_FILTER: %s\n", strerror(errno));
+                throw std::runtime_error("setsockopt");
+            }
+            std::printf("[Done] Step1-1. attach socket filter\n");
+        }
+#endif
+
         /* 2.接続受付用構造体の準備 */
         std::memset(&sender_info, 0, sizeof(sender_info));
         sender_info.sin_family = AF_INET;
@@ -83,6 +129,19 @@ int main(int argc, char** argv)
         }
         std::printf("[Done] Step2. bind socket\n");
 
+#if defined(__linux__)
+        /* (任意) 受信リング. JOINの前に開いて, 最初のパケットから読む */
+        if (ring_ifname != nullptr)
+        {
+            if (ring.open(ring_ifname) != 0)
+            {
+                std::printf("[Error] open ring on %s: %s\n", ring_ifname, strerror(errno));
+                throw std::runtime_error("PacketRing::open");
+            }
+            std::printf("[Done] Step2-1. open TPACKET_V3 ring on %s\n", ring_ifname);
+        }
+#endif
+
         /* 5.マルチキャストグループ(239.192.100.100)に参加 */
         // struct sockaddr_storage multicast_reciever_info; // マルチキャスト受信用IPv4アドレス情報
         // std::memset(&multicast_reciever_info, 0, sizeof(multicast_reciever_info));
@@ -133,12 +192,45 @@ int main(int argc, char** argv)
         /* 6.受信 */
         std::memset(buf, 0, sizeof(buf));
         socket_length = sizeof(sender_info); // IPv4サイズ
-        int n = recvfrom(passive_socket,
-                         buf,
-                         sizeof(buf) - 1,
-                         0,
-                         p_sender, // 送信元情報が入る
-                         &socket_length);
+#if defined(__linux__)
+        if (ring.isOpen())
+        {
+            // グループ:ポート宛ての最初のデータグラムまでリングを読む
+            struct in_addr group;
+            inet_pton(AF_INET, multicast_addr_name_ipv4, &group);
+            bool received = false;
+            while (!received)
+            {
+                int polled = ring.poll(1000, [&](const is::net::PacketRingFrame &frame) {
+                    is::net::PacketRingUdp udp;
+                    if (received || !is::net::ParsePacketRingUdp(frame, &udp) || udp.mFamily != AF_INET ||
+                        udp.mDstPort != port_of_self || std::memcmp(udp.mDst, &group, 4) != 0)
+                    {
+                        return;
+                    }
+                    size_t length = std::min(udp.mPayload.size(), sizeof(buf) - 1);
+                    std::memcpy(buf, udp.mPayload.data(), length);
+                    std::memcpy(&sender_info.sin_addr, udp.mSrc, 4);
+                    sender_info.sin_port = htons(udp.mSrcPort);
+                    received = true;
+                });
+                if (polled < 0)
+                {
+                    std::printf("[Error] poll ring: %s\n", strerror(errno));
+                    throw std::runtime_error("PacketRing::poll");
+                }
+            }
+        }
+        else
+#endif
+        {
+            recvfrom(passive_socket,
+                     buf,
+                     sizeof(buf) - 1,
+                     0,
+                     p_sender, // 送信元情報が入る
+                     &socket_length);
+        }
 
         /* 送信元のIPアドレスとポート番号を表示 */
         inet_ntop(AF_INET,
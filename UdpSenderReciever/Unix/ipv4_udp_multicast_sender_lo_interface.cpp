@@ -7,6 +7,8 @@
  * 
  * @copyright Copyright (c) 2023
  * 
+ * usage: ipv4_udp_multicast_sender_lo_interface [-i interface_spec=127.0.0.1]
+ * 出力インターフェースは名前/番号/アドレス/`cap:`で指定できる (NetUtils/net_interface.hpp).
  */
 #include <test_utils.hpp>
 
@@ -17,6 +19,8 @@
 #include <arpa/inet.h> // inet_pton, inet_ntop
 #include <netdb.h>
 
+#include <NetUtils/net_interface.hpp>
+
 #if defined(__linux__)
 
 #elif defined(__MACH__)
@@ -58,6 +62,15 @@ int main(int argc, char** argv)
 {
     try
     {
+        std::string interface_spec = "127.0.0.1"; // lo
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::string(argv[i]) == "-i")
+            {
+                interface_spec = argv[i + 1];
+            }
+        }
+
         /* 1.ソケットの作成 */
         if ((socket_to_reciever = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
         {
@@ -84,9 +97,15 @@ int main(int argc, char** argv)
         std::printf("[Done] Step2. configure destination (reciever): `%s`; port=%u\n",
                     multicast_reciever_name_ipv4, port_of_reciever);
 
-        /* 4.マルチキャスト出力インターフェースとしてループバック(lo)を指定 */
+        /* 4.マルチキャスト出力インターフェースを指定 (既定はループバック(lo)) */
         // IPv4ではIPアドレスを用いてインターフェースを指定する.
-        inet_pton(AF_INET, "127.0.0.1", &specified_interface.sin_addr);
+        std::vector<is::net::NetInterface> selected = is::net::SelectInterfaces(is::net::EnumerateInterfaces(), {interface_spec});
+        if (selected.empty() || !selected.front().ipv4Address(&specified_interface.sin_addr))
+        {
+            throw std::runtime_error("no IPv4 interface: " + interface_spec);
+        }
+        std::printf("[Done] Step3. multicast interface `%s` (%s)\n",
+                    selected.front().mName.c_str(), inet_ntop(AF_INET, &specified_interface.sin_addr, addr_name_ipv4, sizeof(addr_name_ipv4)));
         if ((ret = setsockopt(socket_to_reciever, 
                               IPPROTO_IP, 
                               IP_MULTICAST_IF, 
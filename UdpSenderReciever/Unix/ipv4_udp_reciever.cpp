@@ -7,6 +7,13 @@
  * 
  * @copyright Copyright (c) 2023
  * 
+ * usage: ipv4_udp_reciever [-n count=1] [-i ifname] [-b spin_us] [-c cpu|auto]
+ * Linuxでは受信時刻(SO_TIMESTAMPING)をrecvmsgの補助データで受け取り, データグラム毎に
+ * (送信アプリ ->) ワイヤ -> カーネル -> アプリ の各段の時間を表示する.
+ * -i を付けるとそのインターフェースのハードウェア時刻を試す(CAP_NET_ADMIN). 無ければソフトウェア時刻のみ.
+ * 受信バッファはインターフェースのMTUから決め(ジャンボフレームでも切り詰めない), パスMTUのプローブには返事をする.
+ * -b (Linux) は低遅延モード: SO_BUSY_POLLを付け, recvmsgをspin_usの間スピンしてからepollで眠る
+ * (NetUtils/busy_poll.hpp). -c で受信スレッドをそのCPU(autoは隔離コア)に固定する.
  */
 #include <test_utils.hpp>
 
@@ -16,17 +23,21 @@
 #include <netinet/in.h>
 #include <arpa/inet.h> // inet_pton, inet_ntop
 #include <netdb.h>
+#include <algorithm> // std::max
+#include <vector>
 
-#if defined(__linux__)
+#include <NetUtils/path_mtu.hpp>
 
+#if defined(__linux__)
+#include <memory>
+#include <NetUtils/busy_poll.hpp>
+#include <NetUtils/timestamping.hpp>
 #elif defined(__MACH__)
 
 #else
 // Windows
 #endif
 
-#define BUFSIZE 2048
-
 struct sockaddr_in sender_info; // IPv4アドレス情報
 struct sockaddr* p_sender; // インターフェース
 socklen_t socket_length;
@@ -34,13 +45,63 @@ unsigned short port_of_self = 54321;
 int ret;
 
 int passive_socket; // 受信用ソケット
-char buf[BUFSIZE];
 char addr_name_ipv4[INET_ADDRSTRLEN];
 
+#if defined(__linux__)
+/* 受信時刻と送信側の時刻(ペイロードのt=)から各段の時間を表示 */
+static void ReportRxStages(const char *payload, const is::net::PacketTimestamps &stamps, uint64_t app_ns)
+{
+    unsigned long long sent_ns = 0;
+    const char *field = std::strstr(payload, " t=");
+    if (field != nullptr)
+    {
+        sent_ns = std::strtoull(field + 3, nullptr, 10);
+    }
+
+    std::printf("  rx:");
+    if (stamps.mHardwareNs != 0)
+    {
+        // NICの時計(PHC)とシステム時刻が同期している前提
+        std::printf(" wire->kernel %.1f us (PHC),", (double)is::net::StageNs(stamps.mSoftwareNs, stamps.mHardwareNs) / 1000.0);
+    }
+    std::printf(" kernel->app %.1f us", (double)is::net::StageNs(app_ns, stamps.mSoftwareNs) / 1000.0);
+    if (sent_ns != 0)
+    {
+        // 同じホストか, 時計を同期した送信側との差. ネットワークと両側のスタックを含む.
+        std::printf(", sender app->kernel %.1f us", (double)is::net::StageNs(stamps.mSoftwareNs, sent_ns) / 1000.0);
+    }
+    std::printf("%s\n", stamps.mSoftwareNs == 0 ? " (no timestamp)" : "");
+}
+#endif
+
 int main(int argc, char **argv)
 {
     try
     {
+        int count = 1;
+        const char *hw_ifname = nullptr;
+        long spin_us = -1; // -1: ブロッキング受信
+        const char *cpu = nullptr;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::strcmp(argv[i], "-n") == 0)
+            {
+                count = std::max(1, std::atoi(argv[i + 1]));
+            }
+            else if (std::strcmp(argv[i], "-i") == 0)
+            {
+                hw_ifname = argv[i + 1];
+            }
+            else if (std::strcmp(argv[i], "-b") == 0)
+            {
+                spin_us = std::max(0L, std::atol(argv[i + 1]));
+            }
+            else if (std::strcmp(argv[i], "-c") == 0)
+            {
+                cpu = argv[i + 1];
+            }
+        }
+
         /* 1.ソケットの作成 */
         if ((passive_socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0) 
         {
@@ -49,6 +110,45 @@ int main(int argc, char **argv)
         }
         std::printf("[Done] Step1. create socket\n");
 
+#if defined(__linux__)
+        /* 1-1.受信時刻 (既定はソフトウェア, 可能ならハードウェアも) */
+        if (hw_ifname != nullptr && is::net::EnableHardwareTimestamping(passive_socket, hw_ifname) != 0)
+        {
+            std::printf("[Warning] hardware timestamping on %s: %s (software only)\n", hw_ifname, strerror(errno));
+        }
+        if (is::net::EnableTimestamping(passive_socket, is::net::kTimestampingRx) != 0)
+        {
+            std::printf("[Warning] setsockopt SO_TIMESTAMPING: %s\n", strerror(errno));
+        }
+        std::printf("[Done] Step1-1. enable rx timestamping\n");
+
+        /* 1-2.低遅延モード (ビジーポーリング, CPU固定) */
+        std::unique_ptr<is::net::BusyPollReceiver> busy;
+        if (spin_us >= 0)
+        {
+            is::net::BusyPollOptions options;
+            options.mSpinNs = (uint64_t)spin_us * 1000;
+            if (is::net::EnableBusyPoll(passive_socket, options) != 0)
+            {
+                std::printf("[Warning] SO_BUSY_POLL: %s (user-space spin only)\n", strerror(errno));
+            }
+            busy.reset(new is::net::BusyPollReceiver(passive_socket, options));
+            std::printf("[Done] Step1-2. busy poll (spin %ld us)\n", spin_us);
+        }
+        if (cpu != nullptr)
+        {
+            int target = is::net::ParseCpu(cpu);
+            if (target < 0 || is::net::PinThreadToCpu(target) != 0)
+            {
+                std::printf("[Warning] pin to cpu %s: %s\n", cpu, target < 0 ? "no isolated cpu" : strerror(errno));
+            }
+        }
+#else
+        (void)hw_ifname;
+        (void)spin_us;
+        (void)cpu;
+#endif
+
         /* 2.接続受付用構造体の準備 */
         std::memset(&sender_info, 0, sizeof(sender_info));
         sender_info.sin_family = AF_INET;
@@ -65,26 +165,60 @@ int main(int argc, char **argv)
         }
         std::printf("[Done] Step2. bind socket\n");
 
-        /* 4.受信 */
-        std::memset(buf, 0, sizeof(buf));
-        socket_length = sizeof(sender_info); // IPv4サイズ
-        int n = recvfrom(passive_socket, 
-                         buf, 
-                         sizeof(buf) - 1, 
-                         0, 
-                         p_sender, // 送信元情報が入る
-                         &socket_length);
-
-        /* 送信元のIPアドレスとポート番号を表示 */
-        inet_ntop(AF_INET,
-                  &(sender_info.sin_addr),
-                  addr_name_ipv4,
-                  sizeof(addr_name_ipv4));
-        std::printf("UDP packet from : %s, port=%d\n", addr_name_ipv4, ntohs(sender_info.sin_port));
-
-        // 標準出力にそのまま出力
-        // write(fileno(stdout), buf, n);
-        std::printf("%s\n", buf);
+        /* 4.受信 (時刻は補助データで受け取る) */
+        std::vector<char> buf(is::net::MaxReceivePayload(AF_INET) + 1);
+        std::printf("[Done] Step3. receive buffer %zu bytes\n", buf.size() - 1);
+        for (int i = 0; i < count; ++i)
+        {
+            char control[256];
+            struct iovec iov;
+            struct msghdr msg;
+            iov.iov_base = buf.data();
+            iov.iov_len = buf.size() - 1;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_name = p_sender; // 送信元情報が入る
+            msg.msg_namelen = sizeof(sender_info); // IPv4サイズ
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+#if defined(__linux__)
+            int n = (int)(busy ? busy->recvmsg(&msg, 0, -1) : recvmsg(passive_socket, &msg, 0));
+#else
+            int n = recvmsg(passive_socket, &msg, 0);
+#endif
+            if (n < 0)
+            {
+                std::printf("[Error] %s\n", strerror(errno));
+                throw std::runtime_error("recvmsg");
+            }
+#if defined(__linux__)
+            uint64_t app_ns = is::net::RealtimeNs();
+#endif
+            if (is::net::AnswerPmtuProbe(passive_socket, is::net::BytesView((const uint8_t *)buf.data(), (size_t)n), p_sender, sizeof(sender_info)))
+            {
+                --i; // プローブは数えない
+                continue;
+            }
+            buf[(size_t)n] = '\0';
+
+            /* 送信元のIPアドレスとポート番号を表示 */
+            inet_ntop(AF_INET,
+                      &(sender_info.sin_addr),
+                      addr_name_ipv4,
+                      sizeof(addr_name_ipv4));
+            std::printf("UDP packet from : %s, port=%d\n", addr_name_ipv4, ntohs(sender_info.sin_port));
+
+            // 標準出力にそのまま出力
+            // write(fileno(stdout), buf, n);
+            std::printf("%s (%d bytes)\n", buf.data(), n);
+
+#if defined(__linux__)
+            is::net::PacketTimestamps stamps;
+            is::net::ParseTimestamps(&msg, &stamps);
+            ReportRxStages(buf.data(), stamps, app_ns);
+#endif
+        }
 
         /* 5. ソケットを閉じる */
         close(passive_socket);
@@ -7,6 +7,12 @@
  * 
  * @copyright Copyright (c) 2023
  * 
+ * usage: ipv4_udp_sender [-n count=1] [-i ifname] [-a address=127.0.0.1] [-s payload_bytes|max]
+ * Linuxでは送信時刻(SO_TIMESTAMPING)をエラーキューから読み, データグラム毎に
+ * アプリ -> qdisc -> ドライバ(-> ワイヤ) の各段の時間を表示する.
+ * -i を付けるとそのインターフェースのハードウェア時刻を試す(CAP_NET_ADMIN).
+ * ペイロードに送信時刻(t=)を入れるので, 受信側で片道の内訳も出せる.
+ * -s max でパスMTUを探し(NetUtils/path_mtu.hpp, 受信側が返事をする), 断片化しない最大の大きさで送る.
  */
 #include <test_utils.hpp>
 
@@ -16,29 +22,96 @@
 #include <netinet/in.h>
 #include <arpa/inet.h> // inet_pton, inet_ntop
 #include <netdb.h>
+#include <algorithm> // std::max
+#include <vector>
 
-#if defined(__linux__)
+#include <NetUtils/path_mtu.hpp>
 
+#if defined(__linux__)
+#include <poll.h>
+#include <NetUtils/timestamping.hpp>
 #elif defined(__MACH__)
 
 #else
 // Windows
 #endif
 
-#define BUFSIZE 1500
-
 struct sockaddr_in reciever_info; // IPv4アドレス情報
 struct sockaddr* p_reciever; // インターフェース
 socklen_t socket_length;
 unsigned short port_of_reciever = 54321;
 
 int socket_to_reciever; // 受信側に接続するソケット
-char buf[BUFSIZE];
+
+#if defined(__linux__)
+/* 送信時刻がsndまで揃うのを待って各段の時間を表示 */
+static void ReportTxStages(int sock, uint32_t id, uint64_t app_ns)
+{
+    is::net::TxTimestamp stamp;
+    uint64_t sched_ns = 0, snd_ns = 0, wire_ns = 0;
+    struct pollfd target;
+    target.fd = sock;
+    target.events = 0; // POLLERRは常に報告される
+    while (snd_ns == 0 && poll(&target, 1, 100) > 0)
+    {
+        while (is::net::ReadTxTimestamp(sock, &stamp) > 0)
+        {
+            if (stamp.mId != id)
+            {
+                continue; // 前の送信の遅れて届いた時刻
+            }
+            if (stamp.mType == SCM_TSTAMP_SCHED)
+            {
+                sched_ns = stamp.mStamp.mSoftwareNs;
+            }
+            else if (stamp.mType == SCM_TSTAMP_SND)
+            {
+                // ソフトウェアとハードウェアは別々の通知で届く
+                snd_ns = stamp.mStamp.mSoftwareNs ? stamp.mStamp.mSoftwareNs : snd_ns;
+                wire_ns = stamp.mStamp.mHardwareNs ? stamp.mStamp.mHardwareNs : wire_ns;
+            }
+        }
+    }
+    std::printf("  tx id=%u: app->qdisc %.1f us, qdisc->driver %.1f us",
+                id,
+                (double)is::net::StageNs(sched_ns, app_ns) / 1000.0,
+                (double)is::net::StageNs(snd_ns, sched_ns) / 1000.0);
+    if (wire_ns != 0)
+    {
+        std::printf(", driver->wire %.1f us (PHC)", (double)is::net::StageNs(wire_ns, snd_ns) / 1000.0);
+    }
+    std::printf("%s\n", snd_ns == 0 ? " (no snd timestamp)" : "");
+}
+#endif
 
 int main(int argc, char** argv)
 {
     try
     {
+        int count = 1;
+        const char *hw_ifname = nullptr;
+        const char *reciever_name = "127.0.0.1";
+        const char *payload_size = nullptr; // 既定はメッセージの長さだけ
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::strcmp(argv[i], "-n") == 0)
+            {
+                count = std::max(1, std::atoi(argv[i + 1]));
+            }
+            else if (std::strcmp(argv[i], "-i") == 0)
+            {
+                hw_ifname = argv[i + 1];
+            }
+            else if (std::strcmp(argv[i], "-a") == 0)
+            {
+                reciever_name = argv[i + 1];
+            }
+            else if (std::strcmp(argv[i], "-s") == 0)
+            {
+                payload_size = argv[i + 1];
+            }
+        }
+
         /* 1.ソケットの作成 */
         if ((socket_to_reciever = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
         {
@@ -47,6 +120,21 @@ int main(int argc, char** argv)
         }
         std::printf("[Done] Step1. create socket\n");
 
+#if defined(__linux__)
+        /* 1-1.送信時刻 (既定はソフトウェア, 可能ならハードウェアも) */
+        if (hw_ifname != nullptr && is::net::EnableHardwareTimestamping(socket_to_reciever, hw_ifname) != 0)
+        {
+            std::printf("[Warning] hardware timestamping on %s: %s (software only)\n", hw_ifname, strerror(errno));
+        }
+        if (is::net::EnableTimestamping(socket_to_reciever, is::net::kTimestampingTx) != 0)
+        {
+            std::printf("[Warning] setsockopt SO_TIMESTAMPING: %s\n", strerror(errno));
+        }
+        std::printf("[Done] Step1-1. enable tx timestamping\n");
+#else
+        (void)hw_ifname;
+#endif
+
         /* 2.接続先指定用構造体の準備 */
         reciever_info.sin_family = AF_INET;
         reciever_info.sin_port = htons(port_of_reciever);
@@ -54,7 +142,6 @@ int main(int argc, char** argv)
         p_reciever = (struct sockaddr *)&reciever_info;
 
         /* 3.宛先(reciever)の確定 */
-        char* reciever_name = "127.0.0.1";
         if (inet_pton(AF_INET, reciever_name, &(reciever_info.sin_addr)) == INADDR_NONE)
         {
             std::printf("[Error] %s\n", strerror(errno));
@@ -62,19 +149,56 @@ int main(int argc, char** argv)
         }
         std::printf("[Done] Step2. configure destination (reciever): `%s`; port=%u\n", reciever_name, port_of_reciever);
 
+        /* 3-1.データグラムの大きさ (maxならパスMTUを探す. 時刻の番号をずらさないよう別のソケットで) */
+        size_t fill = 0;
+        if (payload_size != nullptr && std::strcmp(payload_size, "max") == 0)
+        {
+            int probe_socket = socket(AF_INET, SOCK_DGRAM, 0);
+            is::net::EnableProbeMtuDiscovery(probe_socket, AF_INET);
+            is::net::EnableIcmpErrors(probe_socket, AF_INET);
+            is::net::PathMtuCache cache;
+            is::net::PlpmtudProber *prober = cache.entry(p_reciever, socket_length);
+            is::net::RunPlpmtud(probe_socket, p_reciever, socket_length, *prober, 10000, [](size_t ip_size, bool acked) {
+                std::printf("  probe %5zu bytes: %s\n", ip_size, acked ? "ack" : "lost");
+            });
+            close(probe_socket);
+            fill = cache.maxPayload(p_reciever);
+            std::printf("[Done] Step2-1. path MTU %zu (%s, %zu probes), max payload %zu\n",
+                        prober->plpmtu(), is::net::PlpmtudStateName(prober->state()), prober->probes(), fill);
+        }
+        else if (payload_size != nullptr)
+        {
+            fill = std::min<size_t>(std::strtoull(payload_size, nullptr, 10), is::net::MaxUdpPayload(AF_INET));
+        }
+        if (fill != 0)
+        {
+            is::net::EnableProbeMtuDiscovery(socket_to_reciever, AF_INET); // DF. 断片化させない
+        }
+        std::vector<char> msg(std::max<size_t>(fill, 64));
+
         /* 4.受信側に送信 */
-        char msg[] = "HELLO IPv4";
-        int n = sendto(socket_to_reciever,
-                       msg,
-                       sizeof(msg),
-                       0,
-                       p_reciever, // 受信側情報を受取る
-                       socket_length);
-
-        if (n < 1)
+        for (int seq = 0; seq < count; ++seq)
         {
-            std::printf("[Error] %s\n", strerror(errno));
-            throw std::runtime_error("sendto");
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            unsigned long long app_ns = (unsigned long long)now.tv_sec * 1000000000ull + (unsigned long long)now.tv_nsec;
+            size_t length = (size_t)std::snprintf(msg.data(), msg.size(), "HELLO IPv4 seq=%d t=%llu", seq, app_ns) + 1;
+            length = std::max(length, fill);
+            int n = sendto(socket_to_reciever,
+                           msg.data(),
+                           length,
+                           0,
+                           p_reciever, // 受信側情報を受取る
+                           socket_length);
+
+            if (n < 1)
+            {
+                std::printf("[Error] %s\n", strerror(errno));
+                throw std::runtime_error("sendto");
+            }
+#if defined(__linux__)
+            ReportTxStages(socket_to_reciever, (uint32_t)seq, app_ns); // OPT_IDは送信毎に0から
+#endif
         }
 
         /* 5.ソケットを閉じる */
@@ -7,6 +7,11 @@
  *
  * @copyright Copyright (c) 2023
  *
+ * usage: ipv6_udp_multicast_reciever [-s source_prefix] [-m magic]
+ *
+ * (Linux) `-s`(例: 2001:db8::/32)で送信元のIPv6アドレス, `-m`(例: 0x49534E54)でUDPペイロード先頭4バイトを
+ * SO_ATTACH_FILTERで照合し, 他の送信者のパケットはカーネル内で捨てる. `-s`にIPv4のプレフィックスは指定できない.
+ *
  */
 #include <test_utils.hpp>
 
@@ -19,7 +24,7 @@
 #include <net/if.h> // if_nametoindex
 
 #if defined(__linux__)
-
+#include <NetUtils/socket_filter.hpp>
 #elif defined(__MACH__)
 
 #else
@@ -66,6 +71,37 @@ int main(int argc, char** argv)
         }
         std::printf("[Done] Step1. create socket\n");
 
+#if defined(__linux__)
+        /* (任意) 受信フィルタ. bind前に付けて, 最初のパケットから効かせる */
+        std::vector<is::net::BpfProgram> filters;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::strcmp(argv[i], "-s") == 0)
+            {
+                struct sockaddr_storage prefix;
+                int prefix_length;
+                if (!is::net::ParsePrefix(argv[i + 1], &prefix, &prefix_length) || prefix.ss_family != AF_INET6)
+                {
+                    throw std::runtime_error("invalid source prefix");
+                }
+                filters.push_back(is::net::SourcePrefixFilter((struct sockaddr *)&prefix, prefix_length));
+            }
+            else if (std::strcmp(argv[i], "-m") == 0)
+            {
+                filters.push_back(is::net::UdpPayloadMagicFilter((uint32_t)std::strtoul(argv[i + 1], nullptr, 0)));
+            }
+        }
+        if (!filters.empty())
+        {
+            if (is::net::AttachSocketFilter(passive_socket, is::net::BpfAllOf(filters)) != 0)
+            {
+                std::printf("[Error] setsockopt SO_ATTACH_FILTER: %s\n", strerror(errno));
+                throw std::runtime_error("setsockopt");
+            }
+            std::printf("[Done] Step1-1. attach socket filter\n");
+        }
+#endif
+
         /* 2.接続受付用構造体の準備 */
         std::memset(&sender_info, 0, sizeof(sender_info));
         sender_info.sin6_family = AF_INET6;
@@ -7,6 +7,8 @@
  *
  * @copyright Copyright (c) 2023
  *
+ * usage: ipv6_udp_multicast_sender_eth0_interface [-i interface_spec=eth0 (macOS: en0)]
+ * 出力インターフェースは名前/番号/アドレス/`cap:`で指定できる (NetUtils/net_interface.hpp).
  */
 #include <test_utils.hpp>
 
@@ -18,6 +20,8 @@
 #include <netdb.h>
 #include <net/if.h> // if_nametoindex
 
+#include <NetUtils/net_interface.hpp>
+
 #if defined(__linux__)
 
 #elif defined(__MACH__)
@@ -59,6 +63,19 @@ int main(int argc, char** argv)
 {
     try
     {
+#if defined(__MACH__)
+        std::string interface_spec = "en0";
+#else
+        std::string interface_spec = "eth0";
+#endif
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::string(argv[i]) == "-i")
+            {
+                interface_spec = argv[i + 1];
+            }
+        }
+
         /* 1.ソケットの作成 */
         if ((socket_to_reciever = socket(AF_INET6, SOCK_DGRAM, 0)) < 0)
         {
@@ -85,9 +102,13 @@ int main(int argc, char** argv)
         std::printf("[Done] Step2. configure destination (reciever): `%s`; port=%u\n",
                     multicast_reciever_name_ipv6, port_of_reciever);
 
-        /* 4.マルチキャスト出力インターフェースとしてループバック(eth0)を指定 */
-        // IPv6ではif_nametoindex()関数を用いてインターフェースを指定する.
-        specified_interface_index = if_nametoindex/*mac*/("en0"); // /*linux*/("eth0");
+        /* 4.マルチキャスト出力インターフェースを指定 (既定はeth0) */
+        // IPv6ではインターフェース番号(if_nametoindex()など)でインターフェースを指定する.
+        if ((specified_interface_index = is::net::ResolveInterfaceIndex(interface_spec)) == 0)
+        {
+            throw std::runtime_error("unknown interface: " + interface_spec);
+        }
+        std::printf("[Done] Step3. multicast interface `%s` (#%u)\n", interface_spec.c_str(), specified_interface_index);
         if ((ret = setsockopt(socket_to_reciever,
                               IPPROTO_IPV6,
                               IPV6_MULTICAST_IF,
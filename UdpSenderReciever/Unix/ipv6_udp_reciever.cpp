@@ -7,6 +7,10 @@
  * 
  * @copyright Copyright (c) 2023
  * 
+ * usage: ipv6_udp_reciever [-b spin_us] [-c cpu|auto]
+ * 受信バッファはインターフェースのMTUから決め, パスMTUのプローブには返事をする(NetUtils/path_mtu.hpp).
+ * -b (Linux) は低遅延モード: SO_BUSY_POLLを付け, spin_usの間スピンしてからepollで眠る(NetUtils/busy_poll.hpp).
+ * -c で受信スレッドをそのCPU(autoは隔離コア)に固定する.
  */
 #include <test_utils.hpp>
 
@@ -16,17 +20,20 @@
 #include <netinet/in.h> // socket_in
 #include <arpa/inet.h>  // inet_pton
 #include <netdb.h>
+#include <algorithm> // std::max
+#include <vector>
 
-#if defined(__linux__)
+#include <NetUtils/path_mtu.hpp>
 
+#if defined(__linux__)
+#include <memory>
+#include <NetUtils/busy_poll.hpp>
 #elif defined(__MACH__)
 
 #else
 // Windows
 #endif
 
-#define BUFSIZE 2048
-
 struct sockaddr_in6 sender_info; // IPv6アドレス情報
 struct sockaddr* p_sender; // インターフェース
 socklen_t socket_length;
@@ -35,13 +42,26 @@ int ret;
 int only_ipv6_flag = 1;
 
 int passive_socket; // 受信ソケット
-char buf[BUFSIZE];
 char addr_name_ipv6[INET6_ADDRSTRLEN];
 
 int main(int argc, char** argv)
 {
     try
     {
+        long spin_us = -1; // -1: ブロッキング受信
+        const char *cpu = nullptr;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::strcmp(argv[i], "-b") == 0)
+            {
+                spin_us = std::max(0L, std::atol(argv[i + 1]));
+            }
+            else if (std::strcmp(argv[i], "-c") == 0)
+            {
+                cpu = argv[i + 1];
+            }
+        }
+
         /* 1.ソケットの作成 */
         if ((passive_socket = socket(AF_INET6, SOCK_DGRAM, 0)) < 0)
         {
@@ -60,6 +80,33 @@ int main(int argc, char** argv)
             throw std::runtime_error("setsockopt IPV6_V6ONLY");
         }
 
+#if defined(__linux__)
+        /* 1-1.低遅延モード (ビジーポーリング, CPU固定) */
+        std::unique_ptr<is::net::BusyPollReceiver> busy;
+        if (spin_us >= 0)
+        {
+            is::net::BusyPollOptions options;
+            options.mSpinNs = (uint64_t)spin_us * 1000;
+            if (is::net::EnableBusyPoll(passive_socket, options) != 0)
+            {
+                std::printf("[Warning] SO_BUSY_POLL: %s (user-space spin only)\n", strerror(errno));
+            }
+            busy.reset(new is::net::BusyPollReceiver(passive_socket, options));
+            std::printf("[Done] Step1-1. busy poll (spin %ld us)\n", spin_us);
+        }
+        if (cpu != nullptr)
+        {
+            int target = is::net::ParseCpu(cpu);
+            if (target < 0 || is::net::PinThreadToCpu(target) != 0)
+            {
+                std::printf("[Warning] pin to cpu %s: %s\n", cpu, target < 0 ? "no isolated cpu" : strerror(errno));
+            }
+        }
+#else
+        (void)spin_us;
+        (void)cpu;
+#endif
+
         /* 2.接続受付用構造体の準備 */
         std::memset(&sender_info, 0, sizeof(sender_info));
         sender_info.sin6_family = AF_INET6;
@@ -76,15 +123,32 @@ int main(int argc, char** argv)
         }
         std::printf("[Done] Step2. bind socket\n");
 
-        /* 4.受信 */
-        std::memset(buf, 0, sizeof(buf));
-        socket_length = sizeof(sender_info); // IPv6サイズ
-        int n = recvfrom(passive_socket,
-                         buf,
-                         sizeof(buf) - 1,
+        /* 4.受信 (パスMTUのプローブには返事をして, データが来るまで待つ) */
+        std::vector<char> buf(is::net::MaxReceivePayload(AF_INET6) + 1);
+        int n;
+        do
+        {
+            socket_length = sizeof(sender_info); // IPv6サイズ
+#if defined(__linux__)
+            if (busy)
+            {
+                n = (int)busy->recvfrom(buf.data(), buf.size() - 1, 0, p_sender, &socket_length, -1);
+            }
+            else
+#endif
+            n = recvfrom(passive_socket,
+                         buf.data(),
+                         buf.size() - 1,
                          0,
                          p_sender, // 送信元情報が入る
                          &socket_length);
+            if (n < 0)
+            {
+                std::printf("[Error] %s\n", strerror(errno));
+                throw std::runtime_error("recvfrom");
+            }
+        } while (is::net::AnswerPmtuProbe(passive_socket, is::net::BytesView((const uint8_t *)buf.data(), (size_t)n), p_sender, socket_length));
+        buf[(size_t)n] = '\0';
 
         /* 送信元のIPアドレスとポート番号を表示 */
         inet_ntop(AF_INET6,
@@ -94,7 +158,7 @@ int main(int argc, char** argv)
         std::printf("UDP packet from : %s, port=%d\n", addr_name_ipv6, ntohs(sender_info.sin6_port));
 
         // 標準出力にそのまま出力
-        std::printf("%s\n", buf);
+        std::printf("%s (%d bytes)\n", buf.data(), n);
 
         /* 5. ソケットを閉じる */
         close(passive_socket);
@@ -0,0 +1,355 @@
+/**
+ * @file lockfree_ring_bench.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief NetUtils/lockfree_ring.hpp のスループットと遅延を測るマイクロベンチマーク
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * 受信スレッド -> 処理スレッドの受け渡しを想定し, 16バイトの記述子を流す.
+ * + SPSC / MPMC / Disruptor / std::mutex+std::queue(比較用) のスループット
+ * + SPSCの往復(ping-pong)で測った片道遅延の分布
+ * 各ケースで受け取った記述子の合計を照合し, 取りこぼしや重複が無いことも確認する.
+ *
+ * usage: lockfree_ring_bench [-n messages=10000000] [-c capacity=1024]
+ */
+#include <test_utils.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+#include <NetUtils/lockfree_ring.hpp>
+
+using steady_clock = std::chrono::steady_clock;
+
+// 受信記述子 (バッファの番号と長さ, 受信時刻)
+struct Descriptor
+{
+    uint32_t mSlot;
+    uint32_t mLength;
+    uint64_t mTimestamp;
+};
+
+static double Seconds(steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(steady_clock::now() - start).count();
+}
+
+static void Report(const char *name, uint64_t messages, double seconds, bool ok)
+{
+    std::printf("%-28s %8.2f Mmsg/s  %7.1f ns/msg  %s\n",
+                name, (double)messages / seconds / 1e6, seconds * 1e9 / (double)messages, ok ? "ok" : "MISMATCH");
+}
+
+/* 1.SPSC */
+static void BenchSpsc(uint64_t n, size_t capacity)
+{
+    is::net::SpscRing<Descriptor> ring(capacity);
+    uint64_t sum = 0;
+    steady_clock::time_point start = steady_clock::now();
+    std::thread consumer([&]() {
+        Descriptor d;
+        is::net::Backoff backoff;
+        for (uint64_t i = 0; i < n;)
+        {
+            if (ring.tryPop(d))
+            {
+                sum += d.mSlot;
+                ++i;
+                backoff.reset();
+            }
+            else
+            {
+                backoff.pause();
+            }
+        }
+    });
+    is::net::Backoff backoff;
+    for (uint64_t i = 0; i < n;)
+    {
+        if (ring.tryPush(Descriptor{(uint32_t)i, 64, i}))
+        {
+            ++i;
+            backoff.reset();
+        }
+        else
+        {
+            backoff.pause();
+        }
+    }
+    consumer.join();
+    uint64_t expected = 0;
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        expected += (uint32_t)i;
+    }
+    Report("spsc 1p1c", n, Seconds(start), sum == expected);
+}
+
+/* 2.MPMC */
+static void BenchMpmc(uint64_t n, size_t capacity, int producers, int consumers)
+{
+    is::net::MpmcRing<Descriptor> ring(capacity);
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> received{0};
+    uint64_t per_producer = n / (uint64_t)producers;
+    uint64_t total = per_producer * (uint64_t)producers;
+
+    steady_clock::time_point start = steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < consumers; ++c)
+    {
+        threads.emplace_back([&]() {
+            Descriptor d;
+            uint64_t local = 0;
+            is::net::Backoff backoff;
+            while (received.load(std::memory_order_relaxed) < total)
+            {
+                if (ring.tryPop(d))
+                {
+                    local += d.mSlot;
+                    received.fetch_add(1, std::memory_order_relaxed);
+                    backoff.reset();
+                }
+                else
+                {
+                    backoff.pause();
+                }
+            }
+            sum.fetch_add(local);
+        });
+    }
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&, p]() {
+            is::net::Backoff backoff;
+            for (uint64_t i = 0; i < per_producer;)
+            {
+                if (ring.tryPush(Descriptor{(uint32_t)p + 1, 64, i}))
+                {
+                    ++i;
+                    backoff.reset();
+                }
+                else
+                {
+                    backoff.pause();
+                }
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    uint64_t expected = 0;
+    for (int p = 0; p < producers; ++p)
+    {
+        expected += (uint64_t)(p + 1) * per_producer;
+    }
+    char name[64];
+    std::snprintf(name, sizeof(name), "mpmc %dp%dc", producers, consumers);
+    Report(name, total, Seconds(start), sum.load() == expected);
+}
+
+/* 3.Disruptor: 統計(consumer 0) -> 表示(consumer 1) の2段. 両方が全記述子を読む. */
+static void BenchDisruptor(uint64_t n, size_t capacity)
+{
+    is::net::DisruptorRing<Descriptor> ring(capacity, 2);
+    ring.setUpstream(1, 0);
+    uint64_t sums[2] = {0, 0};
+
+    steady_clock::time_point start = steady_clock::now();
+    std::vector<std::thread> consumers;
+    for (size_t c = 0; c < 2; ++c)
+    {
+        consumers.emplace_back([&, c]() {
+            int64_t next = 0;
+            uint64_t local = 0;
+            is::net::Backoff backoff;
+            while ((uint64_t)next < n)
+            {
+                int64_t available = ring.available(c);
+                if (available < next)
+                {
+                    backoff.pause();
+                    continue;
+                }
+                for (; next <= available; ++next) // 溜まっている分をまとめて読む
+                {
+                    local += ring[next].mSlot;
+                }
+                ring.release(c, available);
+                backoff.reset();
+            }
+            sums[c] = local;
+        });
+    }
+    is::net::Backoff backoff;
+    for (uint64_t i = 0; i < n;)
+    {
+        int64_t sequence;
+        if (!ring.tryClaim(&sequence))
+        {
+            backoff.pause();
+            continue;
+        }
+        ring[sequence] = Descriptor{(uint32_t)i, 64, i};
+        ring.publish(sequence);
+        ++i;
+        backoff.reset();
+    }
+    for (auto &consumer : consumers)
+    {
+        consumer.join();
+    }
+    uint64_t expected = 0;
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        expected += (uint32_t)i;
+    }
+    Report("disruptor 1p2c (pipeline)", n, Seconds(start), sums[0] == expected && sums[1] == expected);
+}
+
+/* 4.比較: std::mutex + std::queue */
+static void BenchMutexQueue(uint64_t n, size_t capacity)
+{
+    std::mutex mutex;
+    std::queue<Descriptor> queue;
+    uint64_t sum = 0;
+    steady_clock::time_point start = steady_clock::now();
+    std::thread consumer([&]() {
+        is::net::Backoff backoff;
+        for (uint64_t i = 0; i < n;)
+        {
+            bool popped = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!queue.empty())
+                {
+                    sum += queue.front().mSlot;
+                    queue.pop();
+                    popped = true;
+                }
+            }
+            if (popped)
+            {
+                ++i;
+                backoff.reset();
+            }
+            else
+            {
+                backoff.pause();
+            }
+        }
+    });
+    is::net::Backoff backoff;
+    for (uint64_t i = 0; i < n;)
+    {
+        bool pushed = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queue.size() < capacity)
+            {
+                queue.push(Descriptor{(uint32_t)i, 64, i});
+                pushed = true;
+            }
+        }
+        if (pushed)
+        {
+            ++i;
+            backoff.reset();
+        }
+        else
+        {
+            backoff.pause();
+        }
+    }
+    consumer.join();
+    uint64_t expected = 0;
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        expected += (uint32_t)i;
+    }
+    Report("mutex+queue 1p1c", n, Seconds(start), sum == expected);
+}
+
+/* 5.SPSCの往復遅延. 片道 = 往復 / 2 */
+static void BenchSpscLatency(uint64_t rounds)
+{
+    is::net::SpscRing<Descriptor> ping(64);
+    is::net::SpscRing<Descriptor> pong(64);
+    std::thread echo([&]() {
+        Descriptor d;
+        for (uint64_t i = 0; i < rounds; ++i)
+        {
+            is::net::Backoff backoff;
+            while (!ping.tryPop(d))
+            {
+                backoff.pause();
+            }
+            pong.tryPush(d); // 往復で1つしか流れないので満杯にならない
+        }
+    });
+
+    std::vector<double> samples;
+    samples.reserve(rounds);
+    Descriptor d;
+    for (uint64_t i = 0; i < rounds; ++i)
+    {
+        steady_clock::time_point sent = steady_clock::now();
+        ping.tryPush(Descriptor{(uint32_t)i, 64, i});
+        is::net::Backoff backoff; // 1コアでも相手に譲れるようにスピンの後はyield
+        while (!pong.tryPop(d))
+        {
+            backoff.pause();
+        }
+        samples.push_back(std::chrono::duration<double, std::nano>(steady_clock::now() - sent).count() / 2.0);
+    }
+    echo.join();
+
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&](double p) { return samples[(size_t)(p * (double)(samples.size() - 1))]; };
+    std::printf("%-28s p50 %6.0f ns  p99 %6.0f ns  p99.9 %7.0f ns  max %8.0f ns\n",
+                "spsc one-way latency", percentile(0.50), percentile(0.99), percentile(0.999), samples.back());
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        uint64_t n = 10000000;
+        size_t capacity = 1024;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string opt(argv[i]);
+            if (opt == "-n")
+            {
+                n = std::strtoull(argv[i + 1], nullptr, 10);
+            }
+            else if (opt == "-c")
+            {
+                capacity = (size_t)std::strtoull(argv[i + 1], nullptr, 10);
+            }
+        }
+        std::printf("[Status] messages %llu, capacity %zu, hardware threads %u\n",
+                    (unsigned long long)n, capacity, std::thread::hardware_concurrency());
+
+        BenchSpsc(n, capacity);
+        BenchMpmc(n, capacity, 1, 1);
+        BenchMpmc(n, capacity, 2, 2);
+        BenchMpmc(n, capacity, 4, 4);
+        BenchDisruptor(n, capacity);
+        BenchMutexQueue(n, capacity);
+        BenchSpscLatency(std::min<uint64_t>(n, 100000));
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file metrics_test.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief スレッド毎のメトリクス(NetUtils/metrics.hpp)の単体テスト
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: metrics_test
+ *
+ * + 複数スレッドの更新と終わったスレッドの値がスクレイプで合計される
+ * + 登録が上限を超えても例外にならず(ワーカスレッドでも), 落とした数が公開される
+ */
+#include <test_utils.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <NetUtils/metrics.hpp>
+
+#include "test_check.hpp"
+
+namespace
+{
+    bool Contains(const std::string &text, const std::string &line)
+    {
+        return text.find(line) != std::string::npos;
+    }
+
+    void TestSum()
+    {
+        is::net::Counter counter("test_updates_total", "metrics_test counter", "kind=\"sum\"");
+        is::net::Gauge gauge("test_level", "metrics_test gauge");
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 4; ++t)
+        {
+            workers.emplace_back([&counter, &gauge]() {
+                for (int i = 0; i < 1000; ++i)
+                {
+                    counter.inc();
+                }
+                gauge.add(3);
+                gauge.sub(1);
+            });
+        }
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+        std::string text = is::net::MetricsRegistry::instance().scrape();
+        TEST_CHECK(Contains(text, "test_updates_total{kind=\"sum\"} 4000\n"));
+        TEST_CHECK(Contains(text, "test_level 8\n"));
+        TEST_CHECK(Contains(text, "ipnetweb_metrics_dropped_registrations_total 0\n"));
+    }
+
+    void TestRegistryFull()
+    {
+        // ErrnoCounterで表を使い切り, ワーカスレッドからさらに登録して更新する
+        std::vector<is::net::ErrnoCounter> errno_counters;
+        for (size_t i = 0; i < is::net::kMetricsMaxCells / is::net::kErrnoSlots + 1; ++i)
+        {
+            errno_counters.emplace_back("test_fill_total", "metrics_test filler", "n=\"" + std::to_string(i) + "\"");
+        }
+        bool threw = false;
+        std::thread worker([&threw]() {
+            try
+            {
+                for (int i = 0; i < 200; ++i) // 残りのセルより多い
+                {
+                    is::net::Counter extra("test_extra_total", "metrics_test overflow", "n=\"" + std::to_string(i) + "\"");
+                    extra.inc();
+                }
+                for (size_t i = 0; i < is::net::kMetricsMaxHistograms + 1; ++i)
+                {
+                    is::net::Histogram histogram("test_extra_seconds", "metrics_test overflow", "n=\"" + std::to_string(i) + "\"");
+                    histogram.record(1000);
+                }
+                is::net::ErrnoCounter more("test_extra_errors_total", "metrics_test overflow");
+                more.inc(ECONNREFUSED);
+            }
+            catch (...)
+            {
+                threw = true;
+            }
+        });
+        worker.join();
+        for (const auto &counter : errno_counters)
+        {
+            counter.inc(EAGAIN);
+        }
+        TEST_CHECK(!threw);
+
+        std::string text = is::net::MetricsRegistry::instance().scrape();
+        TEST_CHECK(Contains(text, "test_fill_total{n=\"0\",errno=\"EAGAIN\"} 1\n"));
+        TEST_CHECK(Contains(text, "test_extra_total{n=\"0\"} 1\n"));
+        TEST_CHECK(!Contains(text, "test_extra_total{n=\"199\"}"));
+        TEST_CHECK(!Contains(text, "test_extra_errors_total"));
+        TEST_CHECK(!Contains(text, "ipnetweb_metrics_dropped_registrations_total 0\n"));
+        TEST_CHECK(Contains(text, "test_updates_total{kind=\"sum\"} 4000\n")); // 捨て場への書き込みは他に混ざらない
+    }
+} // namespace
+
+int main(int, char **)
+{
+    try
+    {
+        TestSum();
+        std::printf("[Done] Step1. per-thread cells are summed at scrape\n");
+        TestRegistryFull();
+        std::printf("[Done] Step2. registrations beyond the limit are dropped, not thrown\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::printf("[Result] %d failures\n", TestFailures());
+    return TestFailures() == 0 ? 0 : 1;
+}
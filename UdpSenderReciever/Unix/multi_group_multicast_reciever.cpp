@@ -0,0 +1,216 @@
+/**
+ * @file multi_group_multicast_reciever.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 1つのソケット(ファミリ毎)で多数のマルチキャストグループに参加し, グループ毎のハンドラで受ける
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: multi_group_multicast_reciever [-g group[@source]]... [-r first_group+count]...
+ *                                      [-i ifname] [-p port=54321] [-d seconds=10]
+ *
+ * + `-g 239.192.100.100`, `-g ff0e::9999:9999`      : グループに参加 (ASM)
+ * + `-g 232.1.1.1@192.0.2.10`                        : 送信元を指定して参加 (SSM, MCAST_JOIN_SOURCE_GROUP)
+ * + `-r 239.192.0.1+300`                             : 連続した300グループ (アドレスの下位32bitを1ずつ増やす)
+ * 何も指定しなければ239.192.100.100に参加する.
+ *
+ * グループ毎に最初の1パケットを表示し, 1秒毎に合計/受信中のグループ数/wakeup数を表示する.
+ * 終了時にグループ毎の受信数を表示する.
+ *
+ * @note Linuxで20を超えるIPv4グループに参加するには`sysctl -w net.ipv4.igmp_max_memberships=1024`.
+ */
+#include <test_utils.hpp>
+
+// udp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h> // inet_pton, inet_ntop
+#include <netdb.h>
+#include <net/if.h> // if_nametoindex
+#include <signal.h>
+
+#include <algorithm> // std::min
+#include <chrono>
+
+#include <NetUtils/multicast_group.hpp>
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void OnSignal(int)
+{
+    stop_requested = 1;
+}
+
+static std::string AddressToString(const struct sockaddr_storage *address)
+{
+    char name[INET6_ADDRSTRLEN] = "";
+    if (address->ss_family == AF_INET)
+    {
+        inet_ntop(AF_INET, &((const struct sockaddr_in *)address)->sin_addr, name, sizeof(name));
+    }
+    else
+    {
+        inet_ntop(AF_INET6, &((const struct sockaddr_in6 *)address)->sin6_addr, name, sizeof(name));
+    }
+    return name;
+}
+
+/* "239.192.0.1+300" -> 239.192.0.1 ... 239.192.1.44 */
+static std::vector<std::string> ExpandGroupRange(const std::string &text)
+{
+    std::vector<std::string> groups;
+    size_t plus = text.find('+');
+    std::string first = text.substr(0, plus);
+    int count = (plus == std::string::npos) ? 1 : std::atoi(text.c_str() + plus + 1);
+
+    uint8_t address[16];
+    int af = (first.find(':') != std::string::npos) ? AF_INET6 : AF_INET;
+    if (inet_pton(af, first.c_str(), address) != 1)
+    {
+        throw std::runtime_error("invalid group: " + first);
+    }
+    size_t low = (af == AF_INET) ? 0 : 12; // 下位32bit
+    uint32_t base = is::net::LoadBe32(address + low);
+    for (int i = 0; i < count; ++i)
+    {
+        is::net::StoreBe32(address + low, base + (uint32_t)i);
+        char name[INET6_ADDRSTRLEN];
+        inet_ntop(af, address, name, sizeof(name));
+        groups.push_back(name);
+    }
+    return groups;
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        std::vector<std::pair<std::string, std::string>> subscriptions; // {group, source}
+        unsigned int ifindex = 0;
+        unsigned short port_of_self = 54321;
+        int duration_sec = 10;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string opt(argv[i]);
+            std::string value(argv[i + 1]);
+            if (opt == "-g")
+            {
+                size_t at = value.find('@');
+                subscriptions.emplace_back(value.substr(0, at), at == std::string::npos ? "" : value.substr(at + 1));
+            }
+            else if (opt == "-r")
+            {
+                for (const std::string &group : ExpandGroupRange(value))
+                {
+                    subscriptions.emplace_back(group, "");
+                }
+            }
+            else if (opt == "-i")
+            {
+                if ((ifindex = if_nametoindex(value.c_str())) == 0)
+                {
+                    throw std::runtime_error("unknown interface: " + value);
+                }
+            }
+            else if (opt == "-p")
+            {
+                port_of_self = (unsigned short)std::atoi(value.c_str());
+            }
+            else if (opt == "-d")
+            {
+                duration_sec = std::atoi(value.c_str());
+            }
+        }
+        if (subscriptions.empty())
+        {
+            subscriptions.emplace_back("239.192.100.100", "");
+        }
+
+        /* 1.グループに参加 (ファミリ毎に1ソケット) */
+        is::net::MulticastGroupReceiver receiver(port_of_self);
+        uint64_t total = 0;
+        int joined = 0;
+        for (const auto &subscription : subscriptions)
+        {
+            const char *source = subscription.second.empty() ? nullptr : subscription.second.c_str();
+            // グループ毎のハンドラ. ここでは最初の1パケットだけ表示する.
+            std::string group = subscription.first;
+            auto printed = std::make_shared<bool>(false);
+            int ret = receiver.join(group.c_str(), source, ifindex,
+                                    [&total, group, printed](const is::net::MulticastDatagram &datagram) {
+                                        ++total;
+                                        if (*printed)
+                                        {
+                                            return;
+                                        }
+                                        *printed = true;
+                                        std::printf("[%s] from %s, if=%u, %zu bytes: %.*s\n",
+                                                    group.c_str(),
+                                                    AddressToString(datagram.mSource).c_str(),
+                                                    datagram.mIfindex,
+                                                    datagram.mPayload.size(),
+                                                    (int)std::min<size_t>(datagram.mPayload.size(), 32),
+                                                    (const char *)datagram.mPayload.data());
+                                    });
+            if (ret != 0)
+            {
+                std::printf("[Error] join %s%s%s: %s\n",
+                            group.c_str(), source ? " source " : "", source ? source : "", strerror(errno));
+                if (errno == ENOBUFS)
+                {
+                    std::printf("        (net.ipv4.igmp_max_memberships / igmp_max_msf を大きくする)\n");
+                    break;
+                }
+                continue;
+            }
+            ++joined;
+        }
+        std::printf("[Done] Step1. joined %d / %zu groups on port %u\n", joined, subscriptions.size(), port_of_self);
+
+        /* 2.受信 (全グループを1つのpollで) */
+        signal(SIGINT, OnSignal);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point next_report = start + std::chrono::seconds(1);
+        while (!stop_requested)
+        {
+            if (receiver.poll(100) < 0)
+            {
+                std::printf("[Error] %s\n", strerror(errno));
+                break;
+            }
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (now >= next_report)
+            {
+                size_t active = 0;
+                receiver.forEachGroup([&](const is::net::MulticastGroupKey &, uint64_t packets) { active += packets > 0; });
+                std::printf("[Status] %llu datagrams, %zu/%zu groups active, %llu wakeups, %llu unmatched\n",
+                            (unsigned long long)total, active, receiver.groupCount(),
+                            (unsigned long long)receiver.wakeups(), (unsigned long long)receiver.unmatched());
+                next_report += std::chrono::seconds(1);
+            }
+            if (duration_sec > 0 && now - start >= std::chrono::seconds(duration_sec))
+            {
+                break;
+            }
+        }
+
+        /* 3.グループ毎の受信数 */
+        std::printf("[Done] Step2. per-group datagrams:\n");
+        receiver.forEachGroup([](const is::net::MulticastGroupKey &key, uint64_t packets) {
+            if (packets == 0)
+            {
+                return;
+            }
+            char name[INET6_ADDRSTRLEN];
+            inet_ntop(key.mFamily, key.mAddress, name, sizeof(name));
+            std::printf("  %-40s %llu\n", name, (unsigned long long)packets);
+        });
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    return 0;
+}
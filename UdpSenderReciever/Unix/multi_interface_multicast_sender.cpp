@@ -0,0 +1,343 @@
+/**
+ * @file multi_interface_multicast_sender.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 同じマルチキャストストリームを複数のインターフェースへ同時に流すSender (A/B冗長フィード)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * 出力インターフェースはNetUtils/net_interface.hppの指定で選ぶ (名前/番号/アドレス/`cap:`).
+ * + 1つのソケットで, インターフェース毎に作っておいたメッセージ(宛先 + IP_PKTINFO/IPV6_PKTINFOの出力番号)を
+ *   sendmmsgでまとめて送る. 中身(iovec)は全インターフェースで共有し, 1回書けばよい.
+ * + rtnetlinkでリンクのup/downとアドレスの増減を監視し, 変化したら選び直してメッセージを作り直す.
+ *   プロセスを止めずにNICの抜き差しやフェイルオーバーに追従する.
+ *
+ * usage: multi_interface_multicast_sender [-g group=239.192.100.100] [-p port=54321]
+ *                                         [-I interface_spec=cap:up,multicast]... [-n count=1000] [-r rate_per_sec=100]
+ *
+ * 例: `-I eth0 -I eth1` (A/B), `-I 'eth*'`, `-I 192.0.2.2`, `-I cap:up,multicast,!loopback`
+ */
+#include <test_utils.hpp>
+
+// udp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h> // inet_pton, inet_ntop
+#include <netdb.h>
+#include <net/if.h>
+#include <poll.h>
+
+#include <chrono>
+
+#include <NetUtils/net_interface.hpp>
+
+#define BUFSIZE 2048
+
+static uint64_t NowMs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// インターフェース1つ分の送信メッセージ
+struct FanoutTarget
+{
+    is::net::NetInterface mInterface;
+    alignas(struct cmsghdr) char mControl[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+    uint64_t mSent = 0;
+    uint64_t mErrors = 0;
+};
+
+class MulticastFanout
+{
+public:
+    MulticastFanout(int sock, const struct sockaddr_storage &group, socklen_t group_length)
+        : mSocket(sock), mGroup(group), mGroupLength(group_length)
+    {
+    }
+
+    // 選び直す. 送信できない(down, マルチキャスト不可, ファミリのアドレスが無い)ものは除く.
+    // Linuxのloには IFF_MULTICAST が付かないが, ループバックでのマルチキャストは通る.
+    void rebuild(const std::vector<std::string> &specs)
+    {
+        int family = mGroup.ss_family;
+        std::vector<FanoutTarget> targets;
+        for (const is::net::NetInterface &netif : is::net::SelectInterfaces(is::net::EnumerateInterfaces(), specs))
+        {
+            if (!netif.up() || !(netif.multicast() || netif.loopback()) || !netif.hasFamily(family))
+            {
+                continue;
+            }
+            targets.emplace_back();
+            targets.back().mInterface = netif;
+            for (const FanoutTarget &old : mTargets)
+            {
+                if (old.mInterface.mIndex == netif.mIndex)
+                {
+                    targets.back().mSent = old.mSent;
+                    targets.back().mErrors = old.mErrors;
+                }
+            }
+        }
+        mTargets.swap(targets);
+
+        // メッセージを作っておく (送るときは中身を書き換えるだけ)
+        mMessages.assign(mTargets.size(), {});
+        for (size_t i = 0; i < mTargets.size(); ++i)
+        {
+            FanoutTarget &target = mTargets[i];
+            std::memset(target.mControl, 0, sizeof(target.mControl));
+            struct msghdr &msg = mMessages[i].msg_hdr;
+            msg.msg_name = &mGroup;
+            msg.msg_namelen = mGroupLength;
+            msg.msg_iov = &mPayload;
+            msg.msg_iovlen = 1;
+            msg.msg_control = target.mControl;
+            struct cmsghdr *cmsg;
+            if (family == AF_INET)
+            {
+                msg.msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
+                cmsg = CMSG_FIRSTHDR(&msg);
+                cmsg->cmsg_level = IPPROTO_IP;
+                cmsg->cmsg_type = IP_PKTINFO;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
+                struct in_pktinfo info;
+                std::memset(&info, 0, sizeof(info));
+                info.ipi_ifindex = (int)target.mInterface.mIndex;
+                target.mInterface.ipv4Address(&info.ipi_spec_dst); // 送信元アドレスもそのインターフェースのものに
+                std::memcpy(CMSG_DATA(cmsg), &info, sizeof(info));
+            }
+            else
+            {
+                msg.msg_controllen = CMSG_SPACE(sizeof(struct in6_pktinfo));
+                cmsg = CMSG_FIRSTHDR(&msg);
+                cmsg->cmsg_level = IPPROTO_IPV6;
+                cmsg->cmsg_type = IPV6_PKTINFO;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
+                struct in6_pktinfo info;
+                std::memset(&info, 0, sizeof(info));
+                info.ipi6_ifindex = target.mInterface.mIndex;
+                std::memcpy(CMSG_DATA(cmsg), &info, sizeof(info));
+            }
+        }
+
+        std::printf("[Status] fan-out to %zu interface(s):", mTargets.size());
+        for (const FanoutTarget &target : mTargets)
+        {
+            std::printf(" %s(#%u)", target.mInterface.mName.c_str(), target.mInterface.mIndex);
+        }
+        std::printf("\n");
+    }
+
+    // 全インターフェースへ同じ中身を送る. 1つが失敗しても残りは送る.
+    void publish(const void *data, size_t length)
+    {
+        mPayload.iov_base = const_cast<void *>(data);
+        mPayload.iov_len = length;
+        size_t next = 0;
+        while (next < mMessages.size())
+        {
+            int sent = sendmmsg(mSocket, &mMessages[next], (unsigned int)(mMessages.size() - next), 0);
+            if (sent < 0)
+            {
+                // 先頭のメッセージが失敗した
+                if (++mTargets[next].mErrors == 1)
+                {
+                    std::printf("[Error] %s: %s\n", mTargets[next].mInterface.mName.c_str(), strerror(errno));
+                }
+                ++next;
+                continue;
+            }
+            for (int i = 0; i < sent; ++i)
+            {
+                ++mTargets[next + (size_t)i].mSent;
+            }
+            next += (size_t)sent;
+        }
+    }
+
+    size_t size() const { return mTargets.size(); }
+
+    void printStats() const
+    {
+        for (const FanoutTarget &target : mTargets)
+        {
+            std::printf("  %-12s sent %llu, errors %llu\n", target.mInterface.mName.c_str(),
+                        (unsigned long long)target.mSent, (unsigned long long)target.mErrors);
+        }
+    }
+
+private:
+    int mSocket;
+    struct sockaddr_storage mGroup;
+    socklen_t mGroupLength;
+    struct iovec mPayload = {};
+    std::vector<FanoutTarget> mTargets;
+    std::vector<struct mmsghdr> mMessages;
+};
+
+static void PrintInterfaces(const std::vector<is::net::NetInterface> &interfaces)
+{
+    for (const is::net::NetInterface &netif : interfaces)
+    {
+        std::printf("  #%-3u %-12s %s%s%s", netif.mIndex, netif.mName.c_str(), netif.up() ? "UP " : "DOWN ",
+                    netif.multicast() ? "MULTICAST " : "", netif.loopback() ? "LOOPBACK " : "");
+        for (const struct sockaddr_storage &address : netif.mAddresses)
+        {
+            std::printf(" %s", is::net::InterfaceAddressToString(address).c_str());
+        }
+        std::printf("\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        const char *group_name = "239.192.100.100";
+        unsigned short port_of_reciever = 54321;
+        std::vector<std::string> specs;
+        uint64_t count = 1000;
+        uint64_t rate = 100;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string opt(argv[i]);
+            if (opt == "-g")
+            {
+                group_name = argv[i + 1];
+            }
+            else if (opt == "-p")
+            {
+                port_of_reciever = (unsigned short)std::atoi(argv[i + 1]);
+            }
+            else if (opt == "-I")
+            {
+                specs.push_back(argv[i + 1]);
+            }
+            else if (opt == "-n")
+            {
+                count = std::strtoull(argv[i + 1], nullptr, 10);
+            }
+            else if (opt == "-r")
+            {
+                rate = std::max<uint64_t>(1, std::strtoull(argv[i + 1], nullptr, 10));
+            }
+        }
+        if (specs.empty())
+        {
+            specs.push_back("cap:up,multicast");
+        }
+
+        /* 1.インターフェースの一覧 */
+        std::printf("[Done] Step1. interfaces:\n");
+        PrintInterfaces(is::net::EnumerateInterfaces());
+
+        /* 2.宛先(マルチキャストグループ)とソケット */
+        struct sockaddr_storage group;
+        std::memset(&group, 0, sizeof(group));
+        socklen_t group_length;
+        int family = std::strchr(group_name, ':') ? AF_INET6 : AF_INET;
+        if (family == AF_INET)
+        {
+            struct sockaddr_in *group4 = (struct sockaddr_in *)&group;
+            group4->sin_family = AF_INET;
+            group4->sin_port = htons(port_of_reciever);
+            if (inet_pton(AF_INET, group_name, &group4->sin_addr) != 1)
+            {
+                throw std::runtime_error("Resolve IP Address");
+            }
+            group_length = sizeof(struct sockaddr_in);
+        }
+        else
+        {
+            struct sockaddr_in6 *group6 = (struct sockaddr_in6 *)&group;
+            group6->sin6_family = AF_INET6;
+            group6->sin6_port = htons(port_of_reciever);
+            if (inet_pton(AF_INET6, group_name, &group6->sin6_addr) != 1)
+            {
+                throw std::runtime_error("Resolve IP Address");
+            }
+            group_length = sizeof(struct sockaddr_in6);
+        }
+        int socket_to_reciever;
+        if ((socket_to_reciever = socket(family, SOCK_DGRAM, 0)) < 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("socket");
+        }
+        std::printf("[Done] Step2. destination `%s`; port=%u\n", group_name, port_of_reciever);
+
+        /* 3.出力インターフェースを選び, リンクの監視を始める */
+        MulticastFanout fanout(socket_to_reciever, group, group_length);
+        fanout.rebuild(specs);
+        is::net::InterfaceMonitor monitor;
+        std::printf("[Done] Step3. link monitor %s\n", monitor.fd() >= 0 ? "started" : "unavailable");
+
+        /* 4.送信 (一定レート). 合間にリンクの変化を待つ */
+        uint64_t start_ms = NowMs();
+        uint64_t sequence = 0;
+        uint64_t next_report_ms = start_ms + 1000;
+        char payload[BUFSIZE];
+        while (count == 0 || sequence < count)
+        {
+            uint64_t now_ms = NowMs();
+            uint64_t due = (now_ms - start_ms) * rate / 1000 + 1;
+            while (sequence < due && (count == 0 || sequence < count))
+            {
+                int length = std::snprintf(payload, sizeof(payload), "feed seq=%llu", (unsigned long long)sequence);
+                fanout.publish(payload, (size_t)length);
+                ++sequence;
+            }
+
+            struct pollfd target;
+            target.fd = monitor.fd();
+            target.events = POLLIN;
+            uint64_t next_due_ms = start_ms + sequence * 1000 / rate;
+            int timeout_ms = next_due_ms > now_ms ? (int)(next_due_ms - now_ms) : 0;
+            if (poll(&target, target.fd >= 0 ? 1 : 0, timeout_ms) > 0)
+            {
+                int events = monitor.process([](const is::net::InterfaceEvent &event) {
+                    switch (event.mKind)
+                    {
+                    case is::net::InterfaceEvent::kLinkChanged:
+                        std::printf("[Event] link #%u %s %s\n", event.mIndex, event.mName.c_str(),
+                                    (event.mFlags & IFF_UP) && (event.mFlags & IFF_RUNNING) ? "up" : "down");
+                        break;
+                    case is::net::InterfaceEvent::kLinkRemoved:
+                        std::printf("[Event] link #%u %s removed\n", event.mIndex, event.mName.c_str());
+                        break;
+                    case is::net::InterfaceEvent::kAddressAdded:
+                    case is::net::InterfaceEvent::kAddressRemoved:
+                        std::printf("[Event] address %s on #%u %s\n",
+                                    is::net::InterfaceAddressToString(event.mAddress).c_str(), event.mIndex,
+                                    event.mKind == is::net::InterfaceEvent::kAddressAdded ? "added" : "removed");
+                        break;
+                    }
+                });
+                if (events > 0)
+                {
+                    fanout.rebuild(specs);
+                }
+            }
+
+            if (now_ms >= next_report_ms)
+            {
+                std::printf("[Status] seq %llu\n", (unsigned long long)sequence);
+                fanout.printStats();
+                next_report_ms += 1000;
+            }
+        }
+        std::printf("[Done] Step4. published %llu datagrams\n", (unsigned long long)sequence);
+        fanout.printStats();
+
+        /* 5.ソケットを閉じる */
+        close(socket_to_reciever);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,340 @@
+/**
+ * @file paced_udp_sender.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 宛先毎/ソケット毎のトークンバケットで送信間隔を均すSender
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: paced_udp_sender [-d address:port=127.0.0.1:54321]... [-m mode=user] [-r mbps_per_destination=100]
+ *                         [-R mbps_per_socket=0] [-b burst_bytes=0] [-s payload_bytes=1200] [-n count_per_destination=10000]
+ *                         [-L txtime_lead_us=2000]
+ *
+ * mode (NetUtils/pacing.hpp)
+ * + none    : sendto()が返る速さで送る (今までのSender. 比較用)
+ * + user    : Pacerの予定時刻までWaitUntilNsで待ってから送る
+ * + txtime  : SO_TXTIMEで予定時刻を付け, lead分先まで渡しておく. fq qdiscが必要 (`tc qdisc replace dev eth0 root fq`)
+ * + maxrate : SO_MAX_PACING_RATEにソケットのレートを渡し, アプリは待たずに送る. fq qdiscが必要
+ *
+ * 宛先毎に目標と実際のレート, 目標の間隔の半分より詰まって出た数(バースト)を表示する.
+ * 実際の値は2つ: app = アプリが送った(txtimeでは予定した)時刻, wire = カーネルがドライバに渡した時刻
+ * (SO_TIMESTAMPINGのSND. qdiscでのペーシングはこちらにだけ表れる).
+ * バースト = 0 で1パケットずつ均等に. レートはIP/UDPヘッダを含めたバイト数で数える.
+ */
+#include <test_utils.hpp>
+
+// udp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h> // inet_pton, inet_ntop
+#include <netdb.h>
+
+#include <NetUtils/pacing.hpp>
+
+#define BUFSIZE 65536
+
+struct Destination
+{
+    std::string mName;
+    struct sockaddr_storage mAddress;
+    socklen_t mLength = 0;
+    uint64_t mSent = 0;
+    is::net::RateMeter mApp;
+    is::net::RateMeter mWire;
+
+    Destination(const std::string &name, uint64_t target) : mName(name), mApp(target), mWire(target) {}
+};
+
+/* "192.0.2.1:54321", "[fd00::1]:54321" */
+static bool ParseDestination(const std::string &text, struct sockaddr_storage *address, socklen_t *length)
+{
+    size_t colon = text.rfind(':');
+    if (colon == std::string::npos)
+    {
+        return false;
+    }
+    std::string host = text.substr(0, colon);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+    {
+        host = host.substr(1, host.size() - 2);
+    }
+    struct addrinfo hints, *result = nullptr;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+    if (getaddrinfo(host.c_str(), text.c_str() + colon + 1, &hints, &result) != 0)
+    {
+        return false;
+    }
+    std::memcpy(address, result->ai_addr, result->ai_addrlen);
+    *length = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+}
+
+static void PrintMeter(const char *label, const is::net::RateMeter &meter)
+{
+    if (meter.packets() == 0)
+    {
+        std::printf("    %-5s (no data)\n", label);
+        return;
+    }
+    std::printf("    %-5s %9.2f Mbit/s (%6.1f%% of target), bursty gaps %llu / %llu\n", label,
+                meter.achieved() * 8.0 / 1e6,
+                meter.target() ? 100.0 * meter.achieved() / (double)meter.target() : 0.0,
+                (unsigned long long)meter.bursty(), (unsigned long long)(meter.packets() - 1));
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        std::vector<std::string> names;
+        std::string mode = "user";
+        double mbps = 100.0;
+        double socket_mbps = 0.0;
+        uint64_t burst = 0;
+        size_t payload_size = 1200;
+        uint64_t count = 10000;
+        uint64_t lead_ns = 2000000;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string opt(argv[i]);
+            if (opt == "-d")
+            {
+                names.push_back(argv[i + 1]);
+            }
+            else if (opt == "-m")
+            {
+                mode = argv[i + 1];
+            }
+            else if (opt == "-r")
+            {
+                mbps = std::atof(argv[i + 1]);
+            }
+            else if (opt == "-R")
+            {
+                socket_mbps = std::atof(argv[i + 1]);
+            }
+            else if (opt == "-b")
+            {
+                burst = std::strtoull(argv[i + 1], nullptr, 10);
+            }
+            else if (opt == "-s")
+            {
+                payload_size = std::max<size_t>(16, std::min<size_t>(BUFSIZE - 64, std::strtoull(argv[i + 1], nullptr, 10)));
+            }
+            else if (opt == "-n")
+            {
+                count = std::strtoull(argv[i + 1], nullptr, 10);
+            }
+            else if (opt == "-L")
+            {
+                lead_ns = std::strtoull(argv[i + 1], nullptr, 10) * 1000;
+            }
+        }
+        if (names.empty())
+        {
+            names.push_back("127.0.0.1:54321");
+        }
+        if (mode != "none" && mode != "user" && mode != "txtime" && mode != "maxrate")
+        {
+            throw std::runtime_error("unknown mode: " + mode);
+        }
+        uint64_t rate = (uint64_t)(mbps * 1e6 / 8.0);
+        uint64_t socket_rate = (uint64_t)(socket_mbps * 1e6 / 8.0);
+
+        /* 1.宛先 */
+        std::vector<Destination> destinations;
+        for (const std::string &name : names)
+        {
+            destinations.emplace_back(name, rate);
+            if (!ParseDestination(name, &destinations.back().mAddress, &destinations.back().mLength))
+            {
+                throw std::runtime_error("invalid destination: " + name);
+            }
+        }
+        int family = destinations.front().mAddress.ss_family;
+        size_t wire_size = payload_size + (family == AF_INET ? 28 : 48); // IP + UDPヘッダ
+        std::printf("[Done] Step1. %zu destination(s), %zu byte datagrams, target %.1f Mbit/s each, mode %s\n",
+                    destinations.size(), payload_size, mbps, mode.c_str());
+
+        /* 2.ソケットとカーネル側のペーシング */
+        int socket_to_reciever;
+        if ((socket_to_reciever = socket(family, SOCK_DGRAM, 0)) < 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("socket");
+        }
+#if defined(__linux__)
+        uint32_t stamp_flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+                               SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+        if (is::net::EnableTimestamping(socket_to_reciever, stamp_flags) != 0)
+        {
+            std::printf("[Warn] SO_TIMESTAMPING: %s (no wire rate)\n", strerror(errno));
+        }
+#endif
+        if (mode == "txtime")
+        {
+#if defined(__linux__) && defined(SO_TXTIME)
+            if (is::net::EnableTxTime(socket_to_reciever, CLOCK_MONOTONIC) != 0)
+            {
+                std::printf("[Error] %s\n", strerror(errno));
+                throw std::runtime_error("setsockopt SO_TXTIME");
+            }
+#else
+            throw std::runtime_error("SO_TXTIME is not supported");
+#endif
+        }
+        else if (mode == "maxrate")
+        {
+#if defined(__linux__) && defined(SO_MAX_PACING_RATE)
+            uint64_t limit = socket_rate ? socket_rate : rate * destinations.size();
+            if (is::net::SetMaxPacingRate(socket_to_reciever, limit) != 0)
+            {
+                std::printf("[Error] %s\n", strerror(errno));
+                throw std::runtime_error("setsockopt SO_MAX_PACING_RATE");
+            }
+            for (Destination &destination : destinations)
+            {
+                destination.mApp = is::net::RateMeter(limit / destinations.size());
+                destination.mWire = is::net::RateMeter(limit / destinations.size());
+            }
+#else
+            throw std::runtime_error("SO_MAX_PACING_RATE is not supported");
+#endif
+        }
+        std::printf("[Done] Step2. create socket\n");
+
+        /* 3.送信 */
+        is::net::Pacer pacer(socket_rate, burst);
+        pacer.setDefaultDestinationRate(rate, burst);
+        std::vector<char> payload(payload_size, 'p');
+        std::vector<uint16_t> sent_to; // OPT_IDの番号 -> 宛先
+        uint64_t send_errors = 0;
+#if defined(__linux__) && defined(SO_TXTIME)
+        is::net::TxTimeErrors txtime_errors;
+#endif
+        auto drain = [&]() {
+#if defined(__linux__) && defined(SO_TXTIME)
+            is::net::DrainTxErrorQueue(socket_to_reciever, &txtime_errors, [&](const is::net::TxTimestamp &stamp) {
+                if (stamp.mType == SCM_TSTAMP_SND && stamp.mId < sent_to.size())
+                {
+                    destinations[sent_to[stamp.mId]].mWire.record(wire_size, stamp.mStamp.mSoftwareNs);
+                }
+            });
+#endif
+        };
+
+        uint64_t total = count * destinations.size();
+        uint64_t start_ns = is::net::MonotonicNs();
+        for (uint64_t n = 0; n < total; ++n)
+        {
+            // 次に送る宛先: 待たないモードは順番に, 待つモードは最も早く送れるもの
+            size_t index = n % destinations.size();
+            uint64_t now_ns = is::net::MonotonicNs();
+            uint64_t at = now_ns;
+            bool paced = mode == "user" || mode == "txtime";
+            if (paced)
+            {
+                uint64_t best = UINT64_MAX;
+                for (size_t i = 0; i < destinations.size(); ++i)
+                {
+                    if (destinations[i].mSent >= count)
+                    {
+                        continue;
+                    }
+                    uint64_t candidate = pacer.earliest((struct sockaddr *)&destinations[i].mAddress, wire_size, now_ns);
+                    if (candidate < best)
+                    {
+                        best = candidate;
+                        index = i;
+                    }
+                }
+                at = pacer.schedule((struct sockaddr *)&destinations[index].mAddress, wire_size, now_ns);
+            }
+            else
+            {
+                while (destinations[index].mSent >= count)
+                {
+                    index = (index + 1) % destinations.size();
+                }
+            }
+            Destination &destination = destinations[index];
+            std::snprintf(payload.data(), payload.size(), "seq=%llu", (unsigned long long)destination.mSent);
+
+            ssize_t ret;
+            if (mode == "txtime")
+            {
+#if defined(__linux__) && defined(SO_TXTIME)
+                is::net::WaitUntilNs(at > lead_ns ? at - lead_ns : 0); // lead分先までカーネルに渡す
+                ret = is::net::SendAtTxTime(socket_to_reciever, payload.data(), payload.size(),
+                                            (struct sockaddr *)&destination.mAddress, destination.mLength, at);
+#else
+                ret = -1;
+#endif
+            }
+            else
+            {
+                if (paced)
+                {
+                    is::net::WaitUntilNs(at);
+                }
+                ret = sendto(socket_to_reciever, payload.data(), payload.size(), 0,
+                             (struct sockaddr *)&destination.mAddress, destination.mLength);
+                at = is::net::MonotonicNs();
+            }
+            if (ret < 0)
+            {
+                if (send_errors++ == 0)
+                {
+                    std::printf("[Error] sendto %s: %s\n", destination.mName.c_str(), strerror(errno));
+                }
+                continue;
+            }
+            sent_to.push_back((uint16_t)index);
+            destination.mApp.record(wire_size, at);
+            ++destination.mSent;
+            if ((n & 63) == 0)
+            {
+                drain();
+            }
+        }
+        uint64_t elapsed_ns = is::net::MonotonicNs() - start_ns;
+
+        // 残りの送信時刻(txtimeでは先に渡した分が出るまで)を待つ
+        for (int i = 0; i < 20; ++i)
+        {
+            is::net::WaitUntilNs(is::net::MonotonicNs() + (mode == "txtime" ? lead_ns : 0) + 10000000);
+            drain();
+        }
+
+        /* 4.目標と実際のレート */
+        std::printf("[Done] Step3. sent %llu datagrams in %.3f s (%llu errors)\n",
+                    (unsigned long long)sent_to.size(), (double)elapsed_ns / 1e9, (unsigned long long)send_errors);
+        for (const Destination &destination : destinations)
+        {
+            std::printf("  %s: sent %llu, target %.2f Mbit/s\n", destination.mName.c_str(),
+                        (unsigned long long)destination.mSent, (double)destination.mApp.target() * 8.0 / 1e6);
+            PrintMeter("app", destination.mApp);
+            PrintMeter("wire", destination.mWire);
+        }
+#if defined(__linux__) && defined(SO_TXTIME)
+        if (mode == "txtime")
+        {
+            std::printf("  txtime: missed %llu, invalid %llu\n",
+                        (unsigned long long)txtime_errors.mMissed, (unsigned long long)txtime_errors.mInvalid);
+        }
+#endif
+
+        /* 5.ソケットを閉じる */
+        close(socket_to_reciever);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    return 0;
+}
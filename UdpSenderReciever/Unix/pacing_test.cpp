@@ -0,0 +1,183 @@
+/**
+ * @file pacing_test.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief ペーシング(NetUtils/pacing.hpp)のトークンバケット(GCRA)とPacerの単体テスト. 時刻は与えるだけで待たない
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: pacing_test
+ *
+ * + TokenBucket: バースト分はすぐ, その後はレート通り. 休んでもバーストより多くは溜まらない
+ * + バーストより大きいパケットは1個ずつ / レート0は無制限
+ * + Pacer: ソケット全体と宛先毎の両方の上限, 予定は単調増加
+ * + RateMeter: 平均レートと詰まった間隔の数
+ */
+#include <test_utils.hpp>
+
+#include <arpa/inet.h>
+
+#include <cstdint>
+
+#include <NetUtils/pacing.hpp>
+
+#include "test_check.hpp"
+
+namespace
+{
+    constexpr uint64_t kMs = 1000000;
+    constexpr uint64_t kStart = 1000 * kMs;
+
+    struct sockaddr_in Endpoint(const char *address, uint16_t port)
+    {
+        struct sockaddr_in sin;
+        std::memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons(port);
+        inet_pton(AF_INET, address, &sin.sin_addr);
+        return sin;
+    }
+
+    // 1000バイトずつcount個をできるだけ早く送ったときの各送信時刻
+    std::vector<uint64_t> SendBackToBack(is::net::TokenBucket &bucket, int count, uint64_t now_ns, uint64_t bytes = 1000)
+    {
+        std::vector<uint64_t> times;
+        for (int i = 0; i < count; ++i)
+        {
+            uint64_t at = bucket.earliest(bytes, now_ns);
+            bucket.consume(bytes, at);
+            times.push_back(at);
+        }
+        return times;
+    }
+
+    void TestTokenBucket()
+    {
+        // 1 MB/s (1000バイトで1ms), バースト10000バイト
+        is::net::TokenBucket bucket(1000000, 10000);
+        std::vector<uint64_t> times = SendBackToBack(bucket, 30, kStart);
+        for (int i = 0; i < 10; ++i)
+        {
+            TEST_CHECK_EQ(times[(size_t)i], kStart); // バースト分はすぐ
+        }
+        for (int i = 10; i < 30; ++i)
+        {
+            TEST_CHECK_EQ(times[(size_t)i], kStart + (uint64_t)(i - 9) * kMs); // その後は1msおき
+        }
+
+        // 1秒休んでも溜まるのはバースト分だけ
+        uint64_t later = times.back() + 1000 * kMs;
+        std::vector<uint64_t> again = SendBackToBack(bucket, 12, later);
+        TEST_CHECK_EQ(again[9], later);
+        TEST_CHECK_EQ(again[10], later + kMs);
+        TEST_CHECK_EQ(again[11], later + 2 * kMs);
+
+        // 長く送れば平均はレート通り
+        is::net::TokenBucket steady(1000000, 10000);
+        std::vector<uint64_t> many = SendBackToBack(steady, 1010, kStart);
+        TEST_CHECK_EQ(many.back() - kStart, 1000 * kMs);
+    }
+
+    void TestLargePacketAndUnlimited()
+    {
+        // バースト(500)より大きい1000バイトは1個ずつ, 1msおき
+        is::net::TokenBucket small_burst(1000000, 500);
+        std::vector<uint64_t> times = SendBackToBack(small_burst, 4, kStart);
+        TEST_CHECK_EQ(times[0], kStart);
+        TEST_CHECK_EQ(times[1], kStart + kMs);
+        TEST_CHECK_EQ(times[3], kStart + 3 * kMs);
+
+        is::net::TokenBucket unlimited;
+        std::vector<uint64_t> free_times = SendBackToBack(unlimited, 100, kStart);
+        TEST_CHECK_EQ(free_times.back(), kStart);
+
+        // 設定し直すと次から新しいレート
+        unlimited.configure(2000000, 0);
+        std::vector<uint64_t> limited = SendBackToBack(unlimited, 3, kStart);
+        TEST_CHECK_EQ(limited[2] - limited[1], kMs / 2);
+    }
+
+    void TestPacer()
+    {
+        // ソケット全体 2 MB/s, 宛先毎 1 MB/s (バーストは無し)
+        is::net::Pacer pacer(2000000, 0);
+        pacer.setDefaultDestinationRate(1000000, 0);
+        struct sockaddr_in a = Endpoint("192.0.2.1", 1000);
+        struct sockaddr_in b = Endpoint("192.0.2.2", 1000);
+
+        // 1つの宛先だけなら宛先のレート
+        uint64_t first = pacer.schedule((const struct sockaddr *)&a, 1000, kStart);
+        uint64_t second = pacer.schedule((const struct sockaddr *)&a, 1000, kStart);
+        TEST_CHECK_EQ(second - first, kMs);
+
+        // 2つの宛先へ交互に: 合計はソケットのレート, 宛先毎は1ms以上空く
+        is::net::Pacer shared(2000000, 0);
+        shared.setDefaultDestinationRate(1000000, 0);
+        uint64_t last = 0, last_a = 0, last_b = 0;
+        bool monotonic = true, per_destination = true;
+        for (int i = 0; i < 100; ++i)
+        {
+            const struct sockaddr *to = (i % 2 == 0) ? (const struct sockaddr *)&a : (const struct sockaddr *)&b;
+            uint64_t at = shared.schedule(to, 1000, kStart);
+            monotonic = monotonic && at >= last;
+            uint64_t &previous = (i % 2 == 0) ? last_a : last_b;
+            per_destination = per_destination && (previous == 0 || at - previous >= kMs);
+            previous = at;
+            last = at;
+        }
+        TEST_CHECK(monotonic);
+        TEST_CHECK(per_destination);
+        TEST_CHECK(last - kStart <= 50 * kMs); // 100個 x 1000バイト / 2 MB/s = 50ms
+        TEST_CHECK(last - kStart >= 49 * kMs);
+
+        // 個別に設定した宛先は既定より遅い
+        is::net::Pacer custom;
+        custom.setDestinationRate((const struct sockaddr *)&a, 100000, 0); // 100 KB/s
+        uint64_t c1 = custom.schedule((const struct sockaddr *)&a, 1000, kStart);
+        uint64_t c2 = custom.schedule((const struct sockaddr *)&a, 1000, kStart);
+        TEST_CHECK_EQ(c2 - c1, 10 * kMs);
+        TEST_CHECK_EQ(custom.schedule((const struct sockaddr *)&b, 1000, kStart), c2); // bは無制限 (順番は守る)
+    }
+
+    void TestRateMeter()
+    {
+        is::net::RateMeter meter(1000000);
+        for (int i = 0; i < 101; ++i)
+        {
+            meter.record(1000, kStart + (uint64_t)i * kMs);
+        }
+        TEST_CHECK_EQ(meter.bursty(), 0u);
+        TEST_CHECK(meter.achieved() > 999000.0 && meter.achieved() < 1001000.0);
+
+        // 10個が同じ時刻に出た
+        is::net::RateMeter bursty(1000000);
+        for (int i = 0; i < 10; ++i)
+        {
+            bursty.record(1000, kStart);
+        }
+        TEST_CHECK_EQ(bursty.bursty(), 9u);
+    }
+} // namespace
+
+int main(int, char **)
+{
+    try
+    {
+        TestTokenBucket();
+        std::printf("[Done] Step1. token bucket (GCRA)\n");
+        TestLargePacketAndUnlimited();
+        std::printf("[Done] Step2. packets larger than the burst, unlimited rate\n");
+        TestPacer();
+        std::printf("[Done] Step3. socket and per-destination pacer\n");
+        TestRateMeter();
+        std::printf("[Done] Step4. rate meter\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::printf("[Result] %d failures\n", TestFailures());
+    return TestFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,227 @@
+/**
+ * @file packet_pool_bench.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief NetUtils/packet_pool.hpp のパケット毎のコストを測るマイクロベンチマーク
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * 受信(カーネルからのコピー)をmemcpyで模擬し, 1パケットあたりの時間を比べる.
+ * + 固定バッファ + 毎回memset (今までの受信ループ) / プールのスライス
+ * + 多数のスロットをランダムに触る: 4KiBページ / ヒュージページ (TLBミスの差)
+ * + 1つの受信バッファを2つの消費者へ: スライスの共有(参照カウント) / 消費者毎のコピー
+ *
+ * ヒュージページを使うには予約が必要: `echo 128 > /proc/sys/vm/nr_hugepages`
+ *
+ * usage: packet_pool_bench [-n packets=5000000] [-l length=512] [-s slots=65536]
+ */
+#include <test_utils.hpp>
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include <NetUtils/packet_pool.hpp>
+
+#define BUFSIZE 2048
+
+using steady_clock = std::chrono::steady_clock;
+
+static double NsPerPacket(steady_clock::time_point start, uint64_t n)
+{
+    return std::chrono::duration<double, std::nano>(steady_clock::now() - start).count() / (double)n;
+}
+
+// 受信したパケットを軽く読む (最適化で消されないように合計を返す)
+static inline uint64_t Consume(const uint8_t *data, size_t length)
+{
+    return (uint64_t)data[0] + data[length / 2] + data[length - 1];
+}
+
+/* 1.固定バッファ + memset */
+static double BenchMemset(const std::vector<uint8_t> &packet, uint64_t n, uint64_t *checksum)
+{
+    static uint8_t buf[BUFSIZE];
+    uint64_t sum = 0;
+    steady_clock::time_point start = steady_clock::now();
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        std::memset(buf, 0, sizeof(buf));
+        std::memcpy(buf, packet.data(), packet.size());
+        asm volatile("" ::"r"(buf) : "memory"); // memsetを消させない
+        sum += Consume(buf, packet.size());
+    }
+    *checksum += sum;
+    return NsPerPacket(start, n);
+}
+
+/* 2.プールのスライス (LocalCache経由) */
+static double BenchPool(is::net::PacketPool &pool, const std::vector<uint8_t> &packet, uint64_t n, uint64_t *checksum)
+{
+    is::net::PacketPool::LocalCache cache(pool);
+    uint64_t sum = 0;
+    steady_clock::time_point start = steady_clock::now();
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        is::net::PacketSlice slice = cache.allocate();
+        std::memcpy(slice.data(), packet.data(), packet.size());
+        slice.resize(packet.size());
+        sum += Consume(slice.data(), slice.size());
+        cache.recycle(std::move(slice));
+    }
+    *checksum += sum;
+    return NsPerPacket(start, n);
+}
+
+/* 3.全スロットをランダムな順に触る (受信バッファが溜まっている状態) */
+static double BenchRandomSlots(is::net::PacketPool &pool, const std::vector<uint8_t> &packet, uint64_t n, uint64_t *checksum)
+{
+    std::vector<is::net::PacketSlice> slices;
+    slices.reserve(pool.slotCount());
+    for (size_t i = 0; i < pool.slotCount(); ++i)
+    {
+        slices.push_back(pool.allocate());
+    }
+    std::vector<uint32_t> order(slices.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = (uint32_t)i;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(1));
+
+    uint64_t sum = 0;
+    steady_clock::time_point start = steady_clock::now();
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        is::net::PacketSlice &slice = slices[order[i % order.size()]];
+        std::memcpy(slice.data(), packet.data(), 64); // ヘッダ分だけ書いて読む
+        sum += Consume(slice.data(), 64);
+    }
+    *checksum += sum;
+    return NsPerPacket(start, n);
+}
+
+/* 4.2つの消費者へ渡す: 共有 or コピー */
+static double BenchFanout(is::net::PacketPool &pool, const std::vector<uint8_t> &packet, uint64_t n, bool share,
+                          uint64_t *checksum)
+{
+    struct Item
+    {
+        is::net::PacketSlice mSlice;
+        std::vector<uint8_t> mCopy;
+    };
+    is::net::SpscRing<Item> rings[2] = {is::net::SpscRing<Item>(256), is::net::SpscRing<Item>(256)};
+    uint64_t sums[2] = {0, 0};
+
+    steady_clock::time_point start = steady_clock::now();
+    std::vector<std::thread> consumers;
+    for (int c = 0; c < 2; ++c)
+    {
+        consumers.emplace_back([&, c]() {
+            Item item;
+            is::net::Backoff backoff;
+            for (uint64_t i = 0; i < n;)
+            {
+                if (!rings[c].tryPop(item))
+                {
+                    backoff.pause();
+                    continue;
+                }
+                backoff.reset();
+                sums[c] += share ? Consume(item.mSlice.data(), item.mSlice.size())
+                                 : Consume(item.mCopy.data(), item.mCopy.size());
+                item.mSlice.reset();
+                ++i;
+            }
+        });
+    }
+
+    is::net::PacketPool::LocalCache cache(pool);
+    is::net::Backoff backoff;
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        is::net::PacketSlice slice;
+        while (!(slice = cache.allocate()))
+        {
+            backoff.pause(); // 消費者がまだ返していない
+        }
+        std::memcpy(slice.data(), packet.data(), packet.size());
+        slice.resize(packet.size());
+        for (int c = 0; c < 2; ++c)
+        {
+            Item item;
+            if (share)
+            {
+                item.mSlice = slice; // 参照カウント+1だけ
+            }
+            else
+            {
+                item.mCopy.assign(slice.data(), slice.data() + slice.size());
+            }
+            while (!rings[c].tryPush(std::move(item)))
+            {
+                backoff.pause();
+            }
+        }
+        backoff.reset();
+    }
+    for (auto &consumer : consumers)
+    {
+        consumer.join();
+    }
+    *checksum += sums[0] + sums[1];
+    return NsPerPacket(start, n);
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        uint64_t n = 5000000;
+        size_t length = 512;
+        size_t slots = 65536;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string opt(argv[i]);
+            if (opt == "-n")
+            {
+                n = std::strtoull(argv[i + 1], nullptr, 10);
+            }
+            else if (opt == "-l")
+            {
+                length = std::max<size_t>(64, std::min<size_t>(BUFSIZE, std::strtoull(argv[i + 1], nullptr, 10)));
+            }
+            else if (opt == "-s")
+            {
+                slots = std::max<size_t>(1024, std::strtoull(argv[i + 1], nullptr, 10));
+            }
+        }
+        std::vector<uint8_t> packet(length);
+        for (size_t i = 0; i < length; ++i)
+        {
+            packet[i] = (uint8_t)i;
+        }
+
+        /* 1.プールの確保 */
+        is::net::PacketPool huge_pool(slots, BUFSIZE, true);
+        is::net::PacketPool small_pool(slots, BUFSIZE, false);
+        std::printf("[Done] Step1. pools: %zu x %zu bytes, hugetlb=%s\n",
+                    slots, huge_pool.slotSize(), huge_pool.hugePages() ? "yes" : "no (THP madvise)");
+
+        /* 2.計測 */
+        uint64_t checksum = 0;
+        std::printf("%-36s %7.1f ns/pkt\n", "static buffer + memset + copy", BenchMemset(packet, n, &checksum));
+        std::printf("%-36s %7.1f ns/pkt\n", "pool slice + copy", BenchPool(huge_pool, packet, n, &checksum));
+        std::printf("%-36s %7.1f ns/pkt\n", "random slot touch, 4KiB pages", BenchRandomSlots(small_pool, packet, n, &checksum));
+        std::printf("%-36s %7.1f ns/pkt\n", "random slot touch, huge pages", BenchRandomSlots(huge_pool, packet, n, &checksum));
+        std::printf("%-36s %7.1f ns/pkt\n", "fan-out x2, copy per consumer", BenchFanout(huge_pool, packet, n / 4, false, &checksum));
+        std::printf("%-36s %7.1f ns/pkt\n", "fan-out x2, shared slice", BenchFanout(huge_pool, packet, n / 4, true, &checksum));
+        std::printf("[Done] Step2. checksum %llu\n", (unsigned long long)checksum);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,209 @@
+/**
+ * @file packet_ring_test.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief TPACKET_V3受信リング(NetUtils/packet_ring.hpp)のloでの単体テスト (Linux, CAP_NET_RAW)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: packet_ring_test
+ *
+ * + loに送ったUDPがリングから1回ずつ(送信側のコピーは除いて)読め, ParsePacketRingUdp()で中身が一致する
+ * + 2本のリングをPACKET_FANOUT_HASHに入れると, 合計は送った数で, 同じフローは片方にしか届かない
+ * + IPv6(::1)のUDP
+ * CAP_NET_RAWが無ければ77を返す(ctestではスキップ).
+ */
+#include <test_utils.hpp>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <map>
+#include <vector>
+
+#include <NetUtils/packet_ring.hpp>
+
+#include "test_check.hpp"
+
+namespace
+{
+    constexpr int kSkip = 77;
+
+    // 空いているポートにbindした受信ソケット (リングとは別にカーネルへ届け先を作る)
+    int BindUdp(int family, uint16_t *port)
+    {
+        int sock = socket(family, SOCK_DGRAM, 0);
+        struct sockaddr_storage self;
+        std::memset(&self, 0, sizeof(self));
+        socklen_t length;
+        if (family == AF_INET)
+        {
+            struct sockaddr_in *sin = (struct sockaddr_in *)&self;
+            sin->sin_family = AF_INET;
+            sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            length = sizeof(*sin);
+        }
+        else
+        {
+            struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&self;
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_addr = in6addr_loopback;
+            length = sizeof(*sin6);
+        }
+        if (sock < 0 || bind(sock, (struct sockaddr *)&self, length) != 0 ||
+            getsockname(sock, (struct sockaddr *)&self, &length) != 0)
+        {
+            throw std::runtime_error("bind");
+        }
+        *port = ntohs(family == AF_INET ? ((struct sockaddr_in *)&self)->sin_port : ((struct sockaddr_in6 *)&self)->sin6_port);
+        return sock;
+    }
+
+    void SendTo(int sender, int family, uint16_t port, const std::string &payload)
+    {
+        struct sockaddr_storage to;
+        std::memset(&to, 0, sizeof(to));
+        socklen_t length;
+        if (family == AF_INET)
+        {
+            struct sockaddr_in *sin = (struct sockaddr_in *)&to;
+            sin->sin_family = AF_INET;
+            sin->sin_port = htons(port);
+            sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            length = sizeof(*sin);
+        }
+        else
+        {
+            struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&to;
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_port = htons(port);
+            sin6->sin6_addr = in6addr_loopback;
+            length = sizeof(*sin6);
+        }
+        if (sendto(sender, payload.data(), payload.size(), 0, (struct sockaddr *)&to, length) != (ssize_t)payload.size())
+        {
+            throw std::runtime_error("sendto");
+        }
+    }
+
+    // portに届いたUDPのペイロードを, 送信元ポート毎に集める (wantに達するか2秒まで)
+    using Received = std::map<uint16_t, std::vector<std::string>>;
+    size_t Collect(std::vector<is::net::PacketRing *> rings, int family, uint16_t port, size_t want, std::vector<Received> *out)
+    {
+        out->assign(rings.size(), Received());
+        size_t total = 0;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (total < want && std::chrono::steady_clock::now() < deadline)
+        {
+            for (size_t r = 0; r < rings.size(); ++r)
+            {
+                rings[r]->poll(20, [&](const is::net::PacketRingFrame &frame) {
+                    is::net::PacketRingUdp udp;
+                    if (!is::net::ParsePacketRingUdp(frame, &udp) || udp.mFamily != family || udp.mDstPort != port)
+                    {
+                        return;
+                    }
+                    (*out)[r][udp.mSrcPort].emplace_back((const char *)udp.mPayload.data(), udp.mPayload.size());
+                    ++total;
+                });
+            }
+        }
+        return total;
+    }
+
+    void TestSingleRing(int family)
+    {
+        is::net::PacketRing ring;
+        TEST_CHECK_EQ(ring.open("lo"), 0);
+        uint16_t port;
+        int receiver = BindUdp(family, &port);
+        int sender = socket(family, SOCK_DGRAM, 0);
+        for (int i = 0; i < 50; ++i)
+        {
+            SendTo(sender, family, port, "datagram-" + std::to_string(i));
+        }
+        std::vector<Received> received;
+        size_t total = Collect({&ring}, family, port, 50, &received);
+        TEST_CHECK_EQ(total, 50u); // 送信側のコピー(PACKET_OUTGOING)は数えない
+        TEST_CHECK_EQ(received[0].size(), 1u);
+        const std::vector<std::string> &payloads = received[0].begin()->second;
+        bool in_order = payloads.size() == 50;
+        for (size_t i = 0; in_order && i < payloads.size(); ++i)
+        {
+            in_order = payloads[i] == "datagram-" + std::to_string(i);
+        }
+        TEST_CHECK(in_order);
+        close(sender);
+        close(receiver);
+    }
+
+    void TestFanout()
+    {
+        is::net::PacketRingOptions options;
+        options.mFanoutGroup = (int)(getpid() & 0xFFFF);
+        is::net::PacketRing first, second;
+        TEST_CHECK_EQ(first.open("lo", options), 0);
+        TEST_CHECK_EQ(second.open("lo", options), 0);
+
+        uint16_t port;
+        int receiver = BindUdp(AF_INET, &port);
+        std::vector<int> senders;
+        for (int s = 0; s < 16; ++s)
+        {
+            senders.push_back(socket(AF_INET, SOCK_DGRAM, 0));
+        }
+        for (int i = 0; i < 10; ++i)
+        {
+            for (int sender : senders)
+            {
+                SendTo(sender, AF_INET, port, "x");
+            }
+        }
+        std::vector<Received> received;
+        size_t total = Collect({&first, &second}, AF_INET, port, 160, &received);
+        TEST_CHECK_EQ(total, 160u);
+        size_t split_flows = 0;
+        for (const auto &flow : received[0])
+        {
+            split_flows += received[1].count(flow.first);
+        }
+        TEST_CHECK_EQ(split_flows, 0u);                               // 同じフローは同じリング
+        TEST_CHECK_EQ(received[0].size() + received[1].size(), 16u); // 全フローがどちらかに
+        for (int sender : senders)
+        {
+            close(sender);
+        }
+        close(receiver);
+    }
+} // namespace
+
+int main(int, char **)
+{
+    try
+    {
+        {
+            is::net::PacketRing probe;
+            if (probe.open("lo") != 0)
+            {
+                std::printf("[Skip] open ring on lo: %s\n", strerror(errno));
+                return (errno == EPERM || errno == EACCES) ? kSkip : 1;
+            }
+        }
+        TestSingleRing(AF_INET);
+        std::printf("[Done] Step1. IPv4 UDP on lo through one ring\n");
+        TestFanout();
+        std::printf("[Done] Step2. fanout over two rings keeps flows together\n");
+        TestSingleRing(AF_INET6);
+        std::printf("[Done] Step3. IPv6 UDP on lo through one ring\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::printf("[Result] %d failures\n", TestFailures());
+    return TestFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file packet_view_test.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief ヘッダのビュー(NetUtils/packet_view.hpp)の単体テスト
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: packet_view_test
+ *
+ * + IPv4: payload()はバッファの終わりまで, boundedPayload()はtotalLengthまで(詰め物を含めない)
+ * + macOSのRAWソケットのようにip_lenがホストバイトオーダ・ヘッダ長抜きでもvalid()とpayload()は変わらない
+ * + 途中で切れたパケット, IPv6のpayloadLength
+ */
+#include <test_utils.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include <NetUtils/packet_view.hpp>
+
+#include "test_check.hpp"
+
+namespace
+{
+    // 20バイトのIPv4ヘッダ + ICMPエコー8バイト + データ, 後ろにpadding個の0
+    std::vector<uint8_t> Ipv4Echo(size_t data_length, size_t padding)
+    {
+        std::vector<uint8_t> packet(20 + 8 + data_length + padding, 0);
+        size_t total = 20 + 8 + data_length;
+        packet[0] = 0x45;
+        packet[2] = (uint8_t)(total >> 8);
+        packet[3] = (uint8_t)total;
+        packet[8] = 64;
+        packet[9] = 1; // ICMP
+        packet[20] = 0; // echo reply
+        for (size_t i = 0; i < data_length; ++i)
+        {
+            packet[28 + i] = (uint8_t)(i + 1);
+        }
+        return packet;
+    }
+
+    void TestIpv4()
+    {
+        // Linux: ip_lenはワイヤ上のまま
+        std::vector<uint8_t> packet = Ipv4Echo(56, 0);
+        is::net::Ipv4View ip(packet.data(), packet.size());
+        TEST_CHECK(ip.valid());
+        TEST_CHECK_EQ(ip.totalLength(), 84u);
+        TEST_CHECK_EQ(ip.payload().size(), 64u);
+        TEST_CHECK_EQ(ip.boundedPayload().size(), 64u);
+
+        // イーサネットの詰め物: boundedPayload()だけが除く
+        std::vector<uint8_t> padded = Ipv4Echo(10, 8);
+        is::net::Ipv4View padded_ip(padded.data(), padded.size());
+        TEST_CHECK_EQ(padded_ip.payload().size(), 26u);
+        TEST_CHECK_EQ(padded_ip.boundedPayload().size(), 18u);
+
+        // macOS: ip_lenはホストバイトオーダ(リトルエンディアン)でヘッダ長抜き
+        std::vector<uint8_t> mac = Ipv4Echo(56, 0);
+        mac[2] = 64;
+        mac[3] = 0;
+        is::net::Ipv4View mac_ip(mac.data(), mac.size());
+        TEST_CHECK(mac_ip.valid());
+        TEST_CHECK_EQ(mac_ip.payload().size(), 64u);
+        TEST_CHECK_EQ(is::net::IcmpView(mac_ip.payload()).size(), 64u);
+        TEST_CHECK_EQ(mac_ip.boundedPayload().size(), 64u); // 16384として読むのでバッファの終わりまで
+
+        // ip_lenがヘッダ長より小さくても(バイトオーダによっては有り得る)valid()とpayload()は変わらない
+        mac[2] = 0;
+        mac[3] = 8;
+        TEST_CHECK(mac_ip.valid());
+        TEST_CHECK_EQ(mac_ip.payload().size(), 64u);
+        TEST_CHECK_EQ(mac_ip.boundedPayload().size(), 0u);
+
+        // 途中で切れている (ICMPエラーの引用): 有る所まで
+        std::vector<uint8_t> quoted = Ipv4Echo(56, 0);
+        is::net::Ipv4View quoted_ip(quoted.data(), 28);
+        TEST_CHECK_EQ(quoted_ip.boundedPayload().size(), 8u);
+        TEST_CHECK(!is::net::Ipv4View(quoted.data(), 19).valid());
+    }
+
+    void TestIpv6AndSub()
+    {
+        std::vector<uint8_t> packet(40 + 16 + 6, 0);
+        packet[0] = 0x60;
+        packet[5] = 16; // payloadLength
+        packet[6] = 17;
+        is::net::Ipv6View ip(packet.data(), packet.size());
+        TEST_CHECK(ip.valid());
+        TEST_CHECK_EQ(ip.payload().size(), 16u);
+        packet[5] = 0; // ジャンボグラム: 有る所まで
+        TEST_CHECK_EQ(ip.payload().size(), 22u);
+
+        is::net::BytesView bytes(packet.data(), 10);
+        TEST_CHECK_EQ(bytes.sub(4, 100).size(), 6u);
+        TEST_CHECK_EQ(bytes.sub(10, 1).size(), 0u);
+        TEST_CHECK(bytes.sub(11, 1).data() == nullptr);
+    }
+} // namespace
+
+int main(int, char **)
+{
+    try
+    {
+        TestIpv4();
+        std::printf("[Done] Step1. IPv4 payload and bounded payload\n");
+        TestIpv6AndSub();
+        std::printf("[Done] Step2. IPv6 payload and sub()\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::printf("[Result] %d failures\n", TestFailures());
+    return TestFailures() == 0 ? 0 : 1;
+}
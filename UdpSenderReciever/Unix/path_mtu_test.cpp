@@ -0,0 +1,145 @@
+/**
+ * @file path_mtu_test.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief DPLPMTUDの状態機械(NetUtils/path_mtu.hpp PlpmtudProber)の単体テスト
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: path_mtu_test
+ *
+ * プローブを送る代わりに, パスMTU以下ならACKを返し, 超えたら捨てる経路を真似る.
+ * + 経路のMTU(limit)が1500でパスも1500なら, 1500を確定しペイロードは1472 (IPv4) / 1452 (IPv6)
+ * + パスが経路のMTUより小さければ二分探索で分解能以内に収まり, パスを超えない
+ * + raise時間後の探し直しでも経路のMTUを超えるプローブを送らない
+ * + PTBで上限を知ればその大きさをまず試す. BASEも通らなければERROR
+ */
+#include <test_utils.hpp>
+
+#include <cstdint>
+
+#include <NetUtils/path_mtu.hpp>
+
+#include "test_check.hpp"
+
+namespace
+{
+    // パスMTUがpathの経路でdoneになるまで(またはmax_rounds回)プローブを回す. 送った最大の大きさを返す
+    size_t Run(is::net::PlpmtudProber &prober, size_t path, uint64_t *now_ms, int max_rounds = 200)
+    {
+        size_t largest = 0;
+        for (int round = 0; round < max_rounds; ++round)
+        {
+            size_t ip_size;
+            uint32_t token;
+            if (!prober.nextProbe(*now_ms, &ip_size, &token))
+            {
+                if (prober.done())
+                {
+                    break;
+                }
+                *now_ms += 100; // ACK待ち
+                continue;
+            }
+            largest = ip_size > largest ? ip_size : largest;
+            if (ip_size <= path)
+            {
+                uint8_t probe[65536];
+                is::net::BuildPmtuProbe(probe, AF_INET, token, ip_size);
+                probe[4] = is::net::kPmtuAck;
+                prober.onAck(is::net::BytesView(probe, is::net::kPmtuFrameSize), *now_ms);
+            }
+        }
+        return largest;
+    }
+
+    void TestExactRouteMtu()
+    {
+        uint64_t now = 0;
+        is::net::PlpmtudProber prober(AF_INET);
+        prober.limit(1500);
+        Run(prober, 1500, &now);
+        TEST_CHECK(prober.state() == is::net::PlpmtudState::kSearchComplete);
+        TEST_CHECK_EQ(prober.plpmtu(), 1500u);
+        TEST_CHECK_EQ(prober.maxPayload(), 1472u);
+        TEST_CHECK_EQ(prober.probes(), 2u); // BASEと1500の2つだけ
+
+        is::net::PlpmtudProber prober6(AF_INET6);
+        prober6.limit(1500);
+        Run(prober6, 1500, &now);
+        TEST_CHECK_EQ(prober6.plpmtu(), 1500u);
+        TEST_CHECK_EQ(prober6.maxPayload(), 1452u);
+    }
+
+    void TestNarrowerPath()
+    {
+        uint64_t now = 0;
+        is::net::PlpmtudOptions options;
+        is::net::PlpmtudProber prober(AF_INET, options);
+        prober.limit(1500);
+        size_t largest = Run(prober, 1400, &now);
+        TEST_CHECK(prober.state() == is::net::PlpmtudState::kSearchComplete);
+        TEST_CHECK(prober.plpmtu() <= 1400u);
+        TEST_CHECK(1400u - prober.plpmtu() < options.mResolution);
+        TEST_CHECK(largest <= 1500u);
+
+        // 経路のMTUを知らなければ上限(65535)から二分探索
+        is::net::PlpmtudProber unknown(AF_INET, options);
+        Run(unknown, 9000, &now, 1000);
+        TEST_CHECK(unknown.state() == is::net::PlpmtudState::kSearchComplete);
+        TEST_CHECK(unknown.plpmtu() <= 9000u && 9000u - unknown.plpmtu() < options.mResolution);
+    }
+
+    void TestRaiseKeepsLimit()
+    {
+        uint64_t now = 0;
+        is::net::PlpmtudOptions options;
+        options.mRaiseTimeoutMs = 1000;
+        is::net::PlpmtudProber prober(AF_INET, options);
+        prober.limit(1500);
+        Run(prober, 1500, &now);
+        TEST_CHECK_EQ(prober.plpmtu(), 1500u);
+
+        now += options.mRaiseTimeoutMs;
+        size_t before = prober.probes();
+        size_t largest = Run(prober, 9000, &now); // 経路の先が大きくなっても
+        TEST_CHECK(largest <= 1500u);
+        TEST_CHECK_EQ(prober.plpmtu(), 1500u);
+        TEST_CHECK_EQ(prober.probes() - before, 1u);
+    }
+
+    void TestPtb()
+    {
+        uint64_t now = 0;
+        is::net::PlpmtudProber prober(AF_INET);
+        prober.onPtb(1400, now); // 探索の前に届いたPTBは上限として使う
+        Run(prober, 1400, &now);
+        TEST_CHECK_EQ(prober.plpmtu(), 1400u);
+        TEST_CHECK_EQ(prober.probes(), 2u);
+
+        // 確定より小さいPTBはそこまで下げる
+        prober.onPtb(1280, now);
+        TEST_CHECK_EQ(prober.plpmtu(), 1280u);
+
+        // BASEも通らなければERROR (最小のMTU)
+        is::net::PlpmtudProber blackhole(AF_INET);
+        Run(blackhole, 1000, &now);
+        TEST_CHECK(blackhole.state() == is::net::PlpmtudState::kError);
+        TEST_CHECK_EQ(blackhole.plpmtu(), is::net::kMinPlpmtuIpv4);
+    }
+} // namespace
+
+int main(int, char **)
+{
+    TestExactRouteMtu();
+    std::printf("[Done] Step1. route MTU is probed first and confirmed exactly\n");
+    TestNarrowerPath();
+    std::printf("[Done] Step2. binary search below the route MTU\n");
+    TestRaiseKeepsLimit();
+    std::printf("[Done] Step3. raise re-search keeps the route MTU\n");
+    TestPtb();
+    std::printf("[Done] Step4. PTB hints and black hole\n");
+    std::printf("[Result] %d failures\n", TestFailures());
+    return TestFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+/**
+ * @file reliable_multicast_reciever.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief マルチキャストの欠番を検出し, 送信者へNAKを返して埋めるReciever
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * NetUtils/multicast_group.hppで複数グループを1つのソケットで受け, グループ毎にRmcReceiverを持つ.
+ * NAKは別のUDPソケットからデータの送信元(送信者のソケット)へユニキャストで返す.
+ * 1秒毎と終了時にグループ毎の損失/回復の統計を表示する.
+ * 送信者が`-f k,m`でFECを付けていれば(先頭が"FEC1"), FecDecoderでパリティから戻したDATAもRmcReceiverへ渡す.
+ *
+ * usage: reliable_multicast_reciever [-g group=239.192.100.100]... [-i ifname] [-p port=54321]
+ *                                    [-l loss_percent=0] [-d seconds=15]
+ *
+ * `-l`は受信したフレームをアプリ側で確率的に捨てる(回復の動作確認用).
+ */
+#include <test_utils.hpp>
+
+// udp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h> // inet_pton, inet_ntop
+#include <netdb.h>
+#include <net/if.h> // if_nametoindex
+#include <signal.h>
+
+#include <chrono>
+#include <random>
+
+#include <NetUtils/fec.hpp>
+#include <NetUtils/multicast_group.hpp>
+#include <NetUtils/reliable_multicast.hpp>
+#include <NetUtils/stun.hpp> // ParsePort
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void OnSignal(int)
+{
+    stop_requested = 1;
+}
+
+static uint64_t NowMs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// グループ毎の状態
+struct GroupState
+{
+    std::string mName;
+    is::net::RmcReceiver mReceiver;
+    is::net::FecDecoder mFec;
+    struct sockaddr_storage mSender; // NAKの宛先 (最後に受けたデータの送信元)
+    bool mHaveSender = false;
+    uint64_t mOutOfOrder = 0;        // 渡された番号が前より小さかった (発生しないはず)
+    uint32_t mLastDelivered = 0;
+    bool mDeliveredAny = false;
+
+    GroupState(const std::string &name, uint32_t seed) : mName(name), mReceiver(is::net::RmcReceiverOptions(), seed) {}
+
+    // 番号順に渡されたデータ. 諦めた欠番の後は番号が飛ぶ.
+    void deliver(uint32_t sequence)
+    {
+        if (mDeliveredAny && !is::net::RmcSeqLess(mLastDelivered, sequence))
+        {
+            ++mOutOfOrder;
+        }
+        mLastDelivered = sequence;
+        mDeliveredAny = true;
+    }
+};
+
+static void PrintStats(const GroupState &state)
+{
+    const is::net::RmcReceiverStats &stats = state.mReceiver.stats();
+    std::printf("  %-16s session 0x%08x: received %llu, delivered %llu, dup %llu, missing %llu, naks %llu, "
+                "recovered %llu, lost %llu, pending %zu, avg recovery %.1f ms%s\n",
+                state.mName.c_str(), state.mReceiver.session(),
+                (unsigned long long)stats.mReceived, (unsigned long long)stats.mDelivered,
+                (unsigned long long)stats.mDuplicates, (unsigned long long)stats.mMissing,
+                (unsigned long long)stats.mNaksSent, (unsigned long long)stats.mRecovered,
+                (unsigned long long)stats.mLost, state.mReceiver.pending(),
+                stats.mRecovered ? (double)stats.mRecoveryMsTotal / (double)stats.mRecovered : 0.0,
+                state.mOutOfOrder ? " OUT-OF-ORDER" : "");
+    const is::net::FecDecoderStats &fec = state.mFec.stats();
+    if (fec.mParity > 0)
+    {
+        std::printf("  %-16s fec: data %llu, parity %llu, recovered %llu, unrecoverable %llu, malformed %llu\n",
+                    "", (unsigned long long)fec.mData, (unsigned long long)fec.mParity,
+                    (unsigned long long)fec.mRecovered, (unsigned long long)fec.mUnrecoverable,
+                    (unsigned long long)fec.mMalformed);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        std::vector<std::string> group_names;
+        unsigned int ifindex = 0;
+        unsigned short port_of_self = 54321;
+        double loss = 0.0;
+        int duration_sec = 15;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string opt(argv[i]);
+            if (opt == "-g")
+            {
+                group_names.push_back(argv[i + 1]);
+            }
+            else if (opt == "-i")
+            {
+                if ((ifindex = if_nametoindex(argv[i + 1])) == 0)
+                {
+                    throw std::runtime_error(std::string("unknown interface: ") + argv[i + 1]);
+                }
+            }
+            else if (opt == "-p")
+            {
+                if (!is::net::ParsePort(argv[i + 1], &port_of_self) || port_of_self == 0)
+                {
+                    throw std::runtime_error(std::string("invalid port: ") + argv[i + 1]);
+                }
+            }
+            else if (opt == "-l")
+            {
+                loss = std::atof(argv[i + 1]) / 100.0;
+            }
+            else if (opt == "-d")
+            {
+                duration_sec = std::atoi(argv[i + 1]);
+            }
+        }
+        if (group_names.empty())
+        {
+            group_names.push_back("239.192.100.100");
+        }
+
+        /* 1.NAK送信用のソケット */
+        int nak_socket;
+        if ((nak_socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("socket");
+        }
+        std::printf("[Done] Step1. create nak socket\n");
+
+        /* 2.グループに参加し, グループ毎のハンドラでRmcReceiverへ渡す */
+        is::net::MulticastGroupReceiver receiver(port_of_self);
+        std::vector<std::unique_ptr<GroupState>> groups;
+        std::mt19937 random(std::random_device{}());
+        std::bernoulli_distribution drop(loss);
+        for (const std::string &name : group_names)
+        {
+            groups.emplace_back(new GroupState(name, (uint32_t)random()));
+            GroupState *state = groups.back().get();
+            int ret = receiver.join(name.c_str(), nullptr, ifindex, [&, state](const is::net::MulticastDatagram &datagram) {
+                if (loss > 0.0 && drop(random))
+                {
+                    return; // 損失の模擬
+                }
+                std::memcpy(&state->mSender, datagram.mSource, sizeof(state->mSender));
+                state->mHaveSender = true;
+                uint64_t now_ms = NowMs();
+                auto on_frame = [state, now_ms](is::net::BytesView frame) {
+                    state->mReceiver.onPacket(frame, now_ms, [state](uint32_t sequence, is::net::BytesView) {
+                        state->deliver(sequence);
+                    });
+                };
+                if (!state->mFec.onPacket(datagram.mPayload, [&](const uint8_t *data, size_t length, bool) {
+                        on_frame(is::net::BytesView(data, length));
+                    }))
+                {
+                    on_frame(datagram.mPayload);
+                }
+            });
+            if (ret != 0)
+            {
+                std::printf("[Error] join %s: %s\n", name.c_str(), strerror(errno));
+                throw std::runtime_error("join");
+            }
+        }
+        std::printf("[Done] Step2. joined %zu groups on port %u (loss %.1f%%)\n", groups.size(), port_of_self, loss * 100.0);
+
+        /* 3.受信. 合間に期限の来た欠番のNAKを送る */
+        signal(SIGINT, OnSignal);
+        uint64_t start_ms = NowMs();
+        uint64_t next_report_ms = start_ms + 1000;
+        while (!stop_requested)
+        {
+            if (receiver.poll(5) < 0)
+            {
+                std::printf("[Error] %s\n", strerror(errno));
+                break;
+            }
+            uint64_t now_ms = NowMs();
+            for (auto &group : groups)
+            {
+                GroupState *state = group.get();
+                if (!state->mHaveSender)
+                {
+                    continue;
+                }
+                state->mReceiver.poll(
+                    now_ms,
+                    [&](const uint8_t *nak, size_t length) {
+                        sendto(nak_socket, nak, length, 0, (struct sockaddr *)&state->mSender, sizeof(struct sockaddr_in));
+                    },
+                    [state](uint32_t sequence, is::net::BytesView) { state->deliver(sequence); });
+            }
+            if (now_ms >= next_report_ms)
+            {
+                std::printf("[Status] %llu ms\n", (unsigned long long)(now_ms - start_ms));
+                for (auto &group : groups)
+                {
+                    PrintStats(*group);
+                }
+                next_report_ms += 1000;
+            }
+            if (duration_sec > 0 && now_ms - start_ms >= (uint64_t)duration_sec * 1000)
+            {
+                break;
+            }
+        }
+
+        /* 4.グループ毎の統計 */
+        std::printf("[Done] Step3. per-group loss/recovery:\n");
+        for (auto &group : groups)
+        {
+            PrintStats(*group);
+        }
+        close(nak_socket);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,230 @@
+/**
+ * @file reliable_multicast_sender.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief マルチキャストで連番付きのデータを流し, 受信者からのNAKに再送で応えるSender
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * ipv4_udp_multicast_sender_lo_interface.cpp と同じく, IP_MULTICAST_IFで出力インターフェースを
+ * アドレスで指定して239.192.100.100へ送る. その上にNetUtils/reliable_multicast.hppのRmcSenderを載せる.
+ * + 同じソケットで受信者からのNAK(ユニキャスト)を受け, 再送はマルチキャストで流す.
+ * + データが途切れたら100ms毎にHEARTBEATを流す. 送り終えた後もlinger秒はNAKに応える.
+ * + `-f k,m`でDATAをNetUtils/fec.hppのFecEncoderに通し, k個毎にm個のパリティを足す.
+ *   パリティで埋まる損失はNAKの往復なしで戻る. HEARTBEATの前に途中のブロックを閉じる. 再送はFECに通さない.
+ *
+ * usage: reliable_multicast_sender [-g group=239.192.100.100] [-p port=54321] [-a interface_address=127.0.0.1]
+ *                                  [-n count=10000] [-r rate_per_sec=2000] [-h history=4096] [-w linger_sec=3]
+ *                                  [-f k,m]
+ */
+#include <test_utils.hpp>
+
+// udp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h> // inet_pton, inet_ntop
+#include <netdb.h>
+#include <poll.h>
+
+#include <chrono>
+#include <memory>
+#include <random>
+
+#include <NetUtils/fec.hpp>
+#include <NetUtils/reliable_multicast.hpp>
+#include <NetUtils/stun.hpp> // ParsePort
+
+#define BUFSIZE 2048
+
+static uint64_t NowMs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        const char *group_name = "239.192.100.100";
+        const char *interface_name = "127.0.0.1";
+        unsigned short port_of_reciever = 54321;
+        uint64_t count = 10000;
+        uint64_t rate = 2000;
+        size_t history = 4096;
+        int linger_sec = 3;
+        int fec_k = 0, fec_m = 0;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string opt(argv[i]);
+            if (opt == "-g")
+            {
+                group_name = argv[i + 1];
+            }
+            else if (opt == "-p")
+            {
+                if (!is::net::ParsePort(argv[i + 1], &port_of_reciever) || port_of_reciever == 0)
+                {
+                    throw std::runtime_error(std::string("invalid port: ") + argv[i + 1]);
+                }
+            }
+            else if (opt == "-a")
+            {
+                interface_name = argv[i + 1];
+            }
+            else if (opt == "-n")
+            {
+                count = std::strtoull(argv[i + 1], nullptr, 10);
+            }
+            else if (opt == "-r")
+            {
+                rate = std::max<uint64_t>(1, std::strtoull(argv[i + 1], nullptr, 10));
+            }
+            else if (opt == "-h")
+            {
+                history = (size_t)std::strtoull(argv[i + 1], nullptr, 10);
+            }
+            else if (opt == "-w")
+            {
+                linger_sec = std::atoi(argv[i + 1]);
+            }
+            else if (opt == "-f")
+            {
+                if (std::sscanf(argv[i + 1], "%d,%d", &fec_k, &fec_m) != 2)
+                {
+                    throw std::runtime_error("-f k,m");
+                }
+            }
+        }
+
+        /* 1.ソケットの作成 */
+        int socket_to_reciever;
+        if ((socket_to_reciever = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("socket");
+        }
+        std::printf("[Done] Step1. create socket\n");
+
+        /* 2.宛先(マルチキャストグループ)の確定 */
+        struct sockaddr_in reciever_info;
+        std::memset(&reciever_info, 0, sizeof(reciever_info));
+        reciever_info.sin_family = AF_INET;
+        reciever_info.sin_port = htons(port_of_reciever);
+        if (inet_pton(AF_INET, group_name, &reciever_info.sin_addr) != 1)
+        {
+            throw std::runtime_error("Resolve IP Address");
+        }
+        std::printf("[Done] Step2. configure destination (reciever): `%s`; port=%u\n", group_name, port_of_reciever);
+
+        /* 3.マルチキャスト出力インターフェースをアドレスで指定 */
+        struct in_addr specified_interface;
+        if (inet_pton(AF_INET, interface_name, &specified_interface) != 1 ||
+            setsockopt(socket_to_reciever, IPPROTO_IP, IP_MULTICAST_IF, &specified_interface, sizeof(specified_interface)) != 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("setsockopt IP_MULTICAST_IF");
+        }
+        std::printf("[Done] Step3. multicast interface `%s`\n", interface_name);
+
+        /* 4.送信 + NAKへの再送 */
+        is::net::RmcSender sender(std::random_device{}(), history);
+        std::printf("[Status] session 0x%08x, history %zu\n", sender.session(), history);
+        std::unique_ptr<is::net::FecEncoder> fec;
+        if (fec_k > 0)
+        {
+            fec.reset(new is::net::FecEncoder(fec_k, fec_m, sender.maxFrameSize(), sender.session()));
+            std::printf("[Status] fec k=%d m=%d (overhead %.1f%%)\n", fec_k, fec_m, 100.0 * fec_m / fec_k);
+        }
+        std::vector<uint8_t> frame(sender.maxFrameSize());
+        uint8_t nak[BUFSIZE];
+
+        auto send_frame = [&](const uint8_t *data, size_t length) {
+            if (sendto(socket_to_reciever, data, length, 0, (struct sockaddr *)&reciever_info, sizeof(reciever_info)) < 0)
+            {
+                std::printf("[Error] sendto: %s\n", strerror(errno));
+            }
+        };
+
+        uint64_t start_ms = NowMs();
+        uint64_t last_send_ms = start_ms;
+        uint64_t finished_ms = 0;
+        uint64_t next_report_ms = start_ms + 1000;
+        while (true)
+        {
+            uint64_t now_ms = NowMs();
+
+            // レート分だけ送る
+            uint64_t due = std::min<uint64_t>(count, (now_ms - start_ms) * rate / 1000 + 1);
+            while (sender.nextSequence() < due)
+            {
+                char payload[64];
+                int length = std::snprintf(payload, sizeof(payload), "update %u", sender.nextSequence());
+                size_t frame_length = sender.data((const uint8_t *)payload, (size_t)length, frame.data());
+                if (fec)
+                {
+                    fec->add(frame.data(), frame_length, send_frame);
+                }
+                else
+                {
+                    send_frame(frame.data(), frame_length);
+                }
+                last_send_ms = now_ms;
+            }
+            if (sender.nextSequence() >= count && finished_ms == 0)
+            {
+                finished_ms = now_ms;
+            }
+
+            // 途切れている間はHEARTBEATで最後の番号を知らせる
+            if (now_ms - last_send_ms >= 100)
+            {
+                if (fec)
+                {
+                    fec->flush(send_frame);
+                }
+                send_frame(frame.data(), sender.heartbeat(frame.data()));
+                last_send_ms = now_ms;
+            }
+
+            // NAKを待つ (次の送信まで)
+            struct pollfd target;
+            target.fd = socket_to_reciever;
+            target.events = POLLIN;
+            int timeout_ms = finished_ms ? 100 : (int)std::max<uint64_t>(1, 1000 / rate);
+            if (poll(&target, 1, timeout_ms) > 0)
+            {
+                ssize_t n;
+                while ((n = recv(socket_to_reciever, nak, sizeof(nak), MSG_DONTWAIT)) > 0)
+                {
+                    sender.onNak(is::net::BytesView(nak, (size_t)n), NowMs(), send_frame);
+                }
+            }
+
+            if (now_ms >= next_report_ms || (finished_ms && now_ms - finished_ms >= (uint64_t)linger_sec * 1000))
+            {
+                const is::net::RmcSenderStats &stats = sender.stats();
+                std::printf("[Status] sent %llu, naks %llu, repairs %llu, suppressed %llu, unrecoverable %llu, clipped %llu\n",
+                            (unsigned long long)stats.mSent, (unsigned long long)stats.mNaks,
+                            (unsigned long long)stats.mRepairs, (unsigned long long)stats.mSuppressed,
+                            (unsigned long long)stats.mUnrecoverable, (unsigned long long)stats.mClipped);
+                next_report_ms += 1000;
+                if (finished_ms && now_ms - finished_ms >= (uint64_t)linger_sec * 1000)
+                {
+                    break;
+                }
+            }
+        }
+
+        /* 5.ソケットを閉じる */
+        close(socket_to_reciever);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,316 @@
+/**
+ * @file reliable_multicast_test.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief NAK方式の再送(NetUtils/reliable_multicast.hpp)の単体テスト. ソケットは使わずフレームを直接渡す
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: reliable_multicast_test
+ *
+ * + 順番通りの受け渡しと重複
+ * + 欠番 -> NAK -> REPAIRで埋まる
+ * + max_retriesで諦めて先へ進む
+ * + 番号が大きく飛んだとき (手前は数だけ数えて諦め, 記録は窓の分だけ)
+ * + 壊れたフレーム, 送信者の再起動
+ * + 広い範囲を並べたNAK1つで再送できるのはmax_nak_span個まで
+ */
+#include <test_utils.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include <NetUtils/reliable_multicast.hpp>
+
+#include "test_check.hpp"
+
+using is::net::BytesView;
+
+namespace
+{
+    struct Link
+    {
+        is::net::RmcSender sender{0x1234, 64, 64};
+        is::net::RmcReceiver receiver;
+        std::vector<uint32_t> delivered;
+
+        explicit Link(const is::net::RmcReceiverOptions &options = is::net::RmcReceiverOptions())
+            : receiver(options, 7) {}
+
+        // 1フレーム送って (drop == falseなら) 受信者へ渡す
+        void send(uint8_t value, bool drop, uint64_t now_ms)
+        {
+            uint8_t frame[128];
+            size_t length = sender.data(&value, 1, frame);
+            if (!drop)
+            {
+                deliver(BytesView(frame, length), now_ms);
+            }
+        }
+
+        bool deliver(BytesView frame, uint64_t now_ms)
+        {
+            return receiver.onPacket(frame, now_ms, [this](uint32_t sequence, BytesView) {
+                delivered.push_back(sequence);
+            });
+        }
+
+        // 受信者のNAKを送信者へ, 送信者のREPAIRを受信者へ
+        void poll(uint64_t now_ms)
+        {
+            std::vector<std::vector<uint8_t>> naks;
+            receiver.poll(
+                now_ms,
+                [&naks](const uint8_t *frame, size_t length) { naks.emplace_back(frame, frame + length); },
+                [this](uint32_t sequence, BytesView) { delivered.push_back(sequence); });
+            for (auto &nak : naks)
+            {
+                std::vector<std::vector<uint8_t>> repairs;
+                sender.onNak(BytesView(nak.data(), nak.size()), now_ms, [&repairs](const uint8_t *frame, size_t length) {
+                    repairs.emplace_back(frame, frame + length);
+                });
+                for (auto &repair : repairs)
+                {
+                    deliver(BytesView(repair.data(), repair.size()), now_ms);
+                }
+            }
+        }
+
+        bool inOrder() const
+        {
+            for (size_t i = 1; i < delivered.size(); ++i)
+            {
+                if (!is::net::RmcSeqLess(delivered[i - 1], delivered[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    void TestInOrder()
+    {
+        Link link;
+        for (int i = 0; i < 10; ++i)
+        {
+            link.send((uint8_t)i, false, 0);
+        }
+        TEST_CHECK_EQ(link.delivered.size(), 10u);
+        TEST_CHECK(link.inOrder());
+        TEST_CHECK_EQ(link.receiver.expected(), 10u);
+        TEST_CHECK_EQ(link.receiver.pending(), 0u);
+
+        // 同じフレームをもう一度
+        uint8_t value = 0;
+        uint8_t frame[128];
+        is::net::RmcSender replay(0x1234, 64, 64);
+        size_t length = replay.data(&value, 1, frame);
+        TEST_CHECK(link.deliver(BytesView(frame, length), 0));
+        TEST_CHECK_EQ(link.receiver.stats().mDuplicates, 1u);
+        TEST_CHECK_EQ(link.delivered.size(), 10u);
+    }
+
+    void TestRepair()
+    {
+        Link link;
+        for (int i = 0; i < 10; ++i)
+        {
+            link.send((uint8_t)i, i == 3 || i == 5 || i == 6, 0);
+        }
+        TEST_CHECK_EQ(link.delivered.size(), 3u); // 0..2
+        TEST_CHECK_EQ(link.receiver.pending(), 3u);
+
+        link.poll(100); // backoff(<=10ms)を過ぎている
+        TEST_CHECK_EQ(link.receiver.stats().mNaksSent, 1u);
+        TEST_CHECK_EQ(link.sender.stats().mRepairs, 3u);
+        TEST_CHECK_EQ(link.delivered.size(), 10u);
+        TEST_CHECK(link.inOrder());
+        TEST_CHECK_EQ(link.receiver.stats().mRecovered, 3u);
+        TEST_CHECK_EQ(link.receiver.pending(), 0u);
+    }
+
+    void TestGiveUp()
+    {
+        is::net::RmcReceiverOptions options;
+        options.mMaxRetries = 2;
+        Link link(options);
+        for (int i = 0; i < 5; ++i)
+        {
+            link.send((uint8_t)i, i == 2, 0);
+        }
+        // NAKは出すが再送は届かない (送信者へ渡さない)
+        auto ignore_nak = [](const uint8_t *, size_t) {};
+        auto on_deliver = [&link](uint32_t sequence, BytesView) { link.delivered.push_back(sequence); };
+        for (uint64_t now = 100; now <= 1000; now += 100)
+        {
+            link.receiver.poll(now, ignore_nak, on_deliver);
+        }
+        TEST_CHECK_EQ(link.receiver.stats().mNaksSent, 2u);
+        TEST_CHECK_EQ(link.receiver.stats().mLost, 1u);
+        TEST_CHECK_EQ(link.delivered.size(), 4u); // 2を飛ばして3, 4
+        TEST_CHECK(link.inOrder());
+        TEST_CHECK_EQ(link.receiver.expected(), 5u);
+    }
+
+    void TestLargeGap()
+    {
+        is::net::RmcReceiverOptions options;
+        options.mMaxBuffered = 16;
+        Link link(options);
+        link.send(0, false, 0);
+        link.send(1, true, 0);   // 欠番 (窓の手前に残る)
+        link.send(2, false, 0);  // 順番待ち
+
+        // 送信者が大きく進んだように見せる: 番号2 + 10,000,000
+        const uint32_t far = 2 + 10000000u;
+        uint8_t frame[is::net::kRmcHeaderSize + 1] = {};
+        is::net::RmcHeader header;
+        header.mType = is::net::kRmcData;
+        header.mSession = link.sender.session();
+        header.mSequence = far;
+        is::net::WriteRmcHeader(frame, header);
+        TEST_CHECK(link.deliver(BytesView(frame, sizeof(frame)), 0));
+
+        // 窓(16)の手前は数だけ数えて諦める. 窓の中は欠番として記録する
+        const uint32_t keep_from = far - 1 - 16 + 1;
+        TEST_CHECK_EQ(link.receiver.pending(), 16u);
+        TEST_CHECK_EQ(link.receiver.expected(), keep_from);
+        TEST_CHECK_EQ(link.receiver.stats().mLost, (uint64_t)(keep_from - 3) + 1); // 3..keep_from-1 と 1
+        TEST_CHECK_EQ(link.delivered.size(), 2u); // 0と(1を諦めて)2
+        TEST_CHECK(link.inOrder());
+
+        // 窓の中は諦めればfarまで進む
+        auto ignore_nak = [](const uint8_t *, size_t) {};
+        auto on_deliver = [&link](uint32_t sequence, BytesView) { link.delivered.push_back(sequence); };
+        for (uint64_t now = 100; now <= 2000; now += 100)
+        {
+            link.receiver.poll(now, ignore_nak, on_deliver);
+        }
+        TEST_CHECK_EQ(link.receiver.expected(), far + 1);
+        TEST_CHECK_EQ(link.delivered.back(), far);
+        TEST_CHECK_EQ(link.receiver.pending(), 0u);
+    }
+
+    void TestHeartbeatTail()
+    {
+        Link link;
+        link.send(0, false, 0);
+        link.send(1, true, 0);
+        link.send(2, true, 0);
+        uint8_t frame[is::net::kRmcHeaderSize];
+        size_t length = link.sender.heartbeat(frame);
+        TEST_CHECK(link.deliver(BytesView(frame, length), 0));
+        TEST_CHECK_EQ(link.receiver.pending(), 2u); // 末尾の欠落に気付く
+        link.poll(100);
+        TEST_CHECK_EQ(link.delivered.size(), 3u);
+        TEST_CHECK(link.inOrder());
+    }
+
+    void TestMalformed()
+    {
+        Link link;
+        uint8_t frame[is::net::kRmcHeaderSize + 4] = {};
+        TEST_CHECK(!link.deliver(BytesView(frame, 4), 0));             // 短い
+        TEST_CHECK(!link.deliver(BytesView(frame, sizeof(frame)), 0)); // magicが違う
+        TEST_CHECK(!link.receiver.started());
+
+        // 範囲数が長さを超えるNAKは読める所まで
+        is::net::RmcHeader header;
+        header.mType = is::net::kRmcNak;
+        header.mCount = 1000;
+        header.mSession = link.sender.session();
+        is::net::WriteRmcHeader(frame, header);
+        int repairs = 0;
+        link.sender.onNak(BytesView(frame, sizeof(frame)), 0, [&repairs](const uint8_t *, size_t) { ++repairs; });
+        TEST_CHECK_EQ(repairs, 0);
+    }
+
+    void TestNakSpanLimit()
+    {
+        is::net::RmcSender sender(0x1234, 1024, 16, 20, 100);
+        uint8_t value = 0;
+        uint8_t data[64];
+        for (int i = 0; i < 1024; ++i)
+        {
+            sender.data(&value, 1, data);
+        }
+        // 偽のNAK: 1000個の範囲を64本 (再送リング全体を何度も)
+        uint8_t frame[is::net::kRmcHeaderSize + is::net::kRmcMaxNakRanges * 8];
+        is::net::RmcHeader header;
+        header.mType = is::net::kRmcNak;
+        header.mCount = (uint16_t)is::net::kRmcMaxNakRanges;
+        header.mSession = sender.session();
+        is::net::WriteRmcHeader(frame, header);
+        for (size_t r = 0; r < is::net::kRmcMaxNakRanges; ++r)
+        {
+            is::net::StoreBe32(frame + is::net::kRmcHeaderSize + r * 8, (uint32_t)(r * 16));
+            is::net::StoreBe32(frame + is::net::kRmcHeaderSize + r * 8 + 4, 1000);
+        }
+        int repairs = 0;
+        sender.onNak(BytesView(frame, sizeof(frame)), 1000, [&repairs](const uint8_t *, size_t) { ++repairs; });
+        TEST_CHECK_EQ(repairs, 100);
+        TEST_CHECK_EQ(sender.stats().mRepairs, 100u);
+        TEST_CHECK_EQ(sender.stats().mClipped, (uint64_t)(1000 - 100) + 63 * 1000);
+
+        // 上限内のNAKはそのまま (holdoff後の別の番号)
+        header.mCount = 1;
+        is::net::WriteRmcHeader(frame, header);
+        is::net::StoreBe32(frame + is::net::kRmcHeaderSize, 500);
+        is::net::StoreBe32(frame + is::net::kRmcHeaderSize + 4, 50);
+        repairs = 0;
+        sender.onNak(BytesView(frame, is::net::kRmcHeaderSize + 8), 1000, [&repairs](const uint8_t *, size_t) { ++repairs; });
+        TEST_CHECK_EQ(repairs, 50);
+        TEST_CHECK_EQ(sender.stats().mClipped, (uint64_t)(1000 - 100) + 63 * 1000);
+    }
+
+    void TestRestart()
+    {
+        Link link;
+        for (int i = 0; i < 5; ++i)
+        {
+            link.send((uint8_t)i, false, 0);
+        }
+        // 送信者の再起動: 別のsessionで0から
+        is::net::RmcSender restarted(0x5678, 64, 64);
+        uint8_t value = 0;
+        uint8_t frame[128];
+        size_t length = restarted.data(&value, 1, frame);
+        TEST_CHECK(link.deliver(BytesView(frame, length), 0));
+        TEST_CHECK_EQ(link.receiver.session(), 0x5678u);
+        TEST_CHECK_EQ(link.receiver.expected(), 1u);
+        TEST_CHECK_EQ(link.delivered.size(), 6u);
+        TEST_CHECK_EQ(link.receiver.stats().mSessions, 2u);
+    }
+} // namespace
+
+int main(int, char **)
+{
+    try
+    {
+        TestInOrder();
+        std::printf("[Done] Step1. in order\n");
+        TestRepair();
+        std::printf("[Done] Step2. NAK and repair\n");
+        TestGiveUp();
+        std::printf("[Done] Step3. give up after max retries\n");
+        TestLargeGap();
+        std::printf("[Done] Step4. large sequence gap\n");
+        TestHeartbeatTail();
+        std::printf("[Done] Step5. heartbeat tail loss\n");
+        TestMalformed();
+        std::printf("[Done] Step6. malformed frames\n");
+        TestRestart();
+        std::printf("[Done] Step7. sender restart\n");
+        TestNakSpanLimit();
+        std::printf("[Done] Step8. repairs per NAK are limited\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::printf("[Result] %d failures\n", TestFailures());
+    return TestFailures() == 0 ? 0 : 1;
+}
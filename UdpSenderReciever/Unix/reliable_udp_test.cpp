@@ -0,0 +1,268 @@
+/**
+ * @file reliable_udp_test.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 順序保証・再送付きのストリーム(NetUtils/reliable_udp.hpp)の単体テスト. ソケットは使わずフレームを直接渡す
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: reliable_udp_test
+ *
+ * + 損失の無い転送とFIN
+ * + 決まった間隔で落とす転送 (SACKによる再送で全て届く)
+ * + SACKの範囲: 送っていない番号の範囲はmSackHighを動かさない (偽の損失検出をしない)
+ * + 壊れたフレーム (短い, 別の接続, SACKブロック数がペイロードより多い)
+ */
+#include <test_utils.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include <NetUtils/reliable_udp.hpp>
+
+#include "test_check.hpp"
+
+using is::net::BytesView;
+
+namespace
+{
+    using Frame = std::vector<uint8_t>;
+    constexpr uint64_t kMs = 1000000;
+
+    std::unique_ptr<is::net::CongestionControl> Reno(const is::net::RudpOptions &options)
+    {
+        return std::unique_ptr<is::net::CongestionControl>(new is::net::NewReno(options.mMaxPayload));
+    }
+
+    // 2つの接続をメモリ上でつなぐ. dropがtrueを返したフレームは届かない.
+    struct Pair
+    {
+        is::net::RudpOptions options;
+        is::net::RudpConnection client;
+        is::net::RudpConnection server;
+        std::function<bool(const is::net::RudpHeader &)> drop;
+        uint64_t now = 1000 * kMs;
+        uint64_t dropped = 0;
+
+        Pair() : client(options, Reno(options)), server(options, Reno(options)) {}
+
+        void step()
+        {
+            std::vector<Frame> to_server, to_client;
+            client.poll(now, [&to_server](const uint8_t *frame, size_t length) { to_server.emplace_back(frame, frame + length); });
+            server.poll(now, [&to_client](const uint8_t *frame, size_t length) { to_client.emplace_back(frame, frame + length); });
+            for (Frame &frame : to_server)
+            {
+                is::net::RudpHeader header;
+                is::net::ReadRudpHeader(BytesView(frame.data(), frame.size()), &header);
+                if (drop && drop(header))
+                {
+                    ++dropped;
+                    continue;
+                }
+                server.onFrame(BytesView(frame.data(), frame.size()), now);
+            }
+            for (Frame &frame : to_client)
+            {
+                client.onFrame(BytesView(frame.data(), frame.size()), now);
+            }
+            now += kMs;
+        }
+
+        bool handshake()
+        {
+            server.listen(now);
+            client.connect(0xC0FFEE, now);
+            for (int i = 0; i < 10 && !(client.isEstablished() && server.isEstablished()); ++i)
+            {
+                step();
+            }
+            return client.isEstablished() && server.isEstablished();
+        }
+    };
+
+    std::vector<uint8_t> Pattern(size_t length)
+    {
+        std::vector<uint8_t> data(length);
+        for (size_t i = 0; i < length; ++i)
+        {
+            data[i] = (uint8_t)(i * 31 + (i >> 8));
+        }
+        return data;
+    }
+
+    // dataを送り切ってFINまで. 受け取ったバイト列を返す.
+    std::vector<uint8_t> Transfer(Pair &pair, const std::vector<uint8_t> &data, int max_steps)
+    {
+        std::vector<uint8_t> received;
+        size_t written = 0;
+        uint8_t buf[4096];
+        for (int i = 0; i < max_steps && !pair.server.peerFinished(); ++i)
+        {
+            if (written < data.size())
+            {
+                written += pair.client.write(data.data() + written, data.size() - written);
+                if (written == data.size())
+                {
+                    pair.client.shutdown();
+                }
+            }
+            pair.step();
+            size_t n;
+            while ((n = pair.server.read(buf, sizeof(buf))) > 0)
+            {
+                received.insert(received.end(), buf, buf + n);
+            }
+        }
+        return received;
+    }
+
+    void TestTransfer()
+    {
+        Pair pair;
+        TEST_CHECK(pair.handshake());
+        std::vector<uint8_t> data = Pattern(300000);
+        std::vector<uint8_t> received = Transfer(pair, data, 5000);
+        TEST_CHECK(received == data);
+        TEST_CHECK(pair.server.peerFinished());
+        TEST_CHECK_EQ(pair.client.stats().mRetransmits, 0u);
+    }
+
+    void TestTransferWithLoss()
+    {
+        Pair pair;
+        TEST_CHECK(pair.handshake());
+        uint64_t data_frames = 0;
+        pair.drop = [&data_frames](const is::net::RudpHeader &header) {
+            return header.mType == is::net::kRudpData && ++data_frames % 10 == 0; // 10個に1個
+        };
+        std::vector<uint8_t> data = Pattern(300000);
+        std::vector<uint8_t> received = Transfer(pair, data, 20000);
+        TEST_CHECK(received == data);
+        TEST_CHECK(pair.dropped > 0);
+        TEST_CHECK(pair.client.stats().mRetransmits >= pair.dropped);
+        TEST_CHECK(pair.client.stats().mCongestionEvents > 0);
+        TEST_CHECK(pair.client.srttNs() > 0);
+    }
+
+    // 受信側の代わりにACKを組み立てる
+    Frame MakeAck(uint32_t connection, uint32_t ack, const std::vector<std::pair<uint32_t, uint32_t>> &blocks, size_t count)
+    {
+        Frame frame(is::net::kRudpHeaderSize + blocks.size() * 8);
+        is::net::RudpHeader header;
+        header.mType = is::net::kRudpAck;
+        header.mCount = (uint16_t)count;
+        header.mConnection = connection;
+        header.mAck = ack;
+        header.mWindow = 4096;
+        header.mTsVal = 1;
+        is::net::WriteRudpHeader(frame.data(), header);
+        for (size_t b = 0; b < blocks.size(); ++b)
+        {
+            is::net::StoreBe32(frame.data() + is::net::kRudpHeaderSize + b * 8, blocks[b].first);
+            is::net::StoreBe32(frame.data() + is::net::kRudpHeaderSize + b * 8 + 4, blocks[b].second);
+        }
+        return frame;
+    }
+
+    // 10セグメントを送った(届いていない)状態の送信側
+    void SendTen(Pair &pair, std::vector<Frame> *sent)
+    {
+        std::vector<uint8_t> data = Pattern(pair.options.mMaxPayload * 10);
+        TEST_CHECK_EQ(pair.client.write(data.data(), data.size()), data.size());
+        pair.client.poll(pair.now, [sent](const uint8_t *frame, size_t length) { sent->emplace_back(frame, frame + length); });
+        TEST_CHECK_EQ(sent->size(), 10u); // 初期ウィンドウ10セグメント
+        TEST_CHECK_EQ(pair.client.inflight(), (uint64_t)data.size());
+    }
+
+    void TestSackScoreboard()
+    {
+        // 正しいSACK: 0が抜けて1, 5..8が届いた -> 8 - dup_thresh より下の未着(0, 2, 3, 4)が損失
+        {
+            Pair pair;
+            TEST_CHECK(pair.handshake());
+            std::vector<Frame> sent;
+            SendTen(pair, &sent);
+            Frame ack = MakeAck(pair.client.connection(), 0, {{1, 2}, {5, 9}}, 2);
+            TEST_CHECK(pair.client.onFrame(BytesView(ack.data(), ack.size()), pair.now));
+            TEST_CHECK_EQ(pair.client.stats().mCongestionEvents, 1u);
+            TEST_CHECK_EQ(pair.client.inflight(), (uint64_t)pair.options.mMaxPayload * 1); // 9だけ
+        }
+        // 送っていない範囲のSACK: 丸めると空になるので無視. 1だけ届いた扱いで損失は無い
+        {
+            Pair pair;
+            TEST_CHECK(pair.handshake());
+            std::vector<Frame> sent;
+            SendTen(pair, &sent);
+            Frame ack = MakeAck(pair.client.connection(), 0, {{1, 2}, {50, 60}}, 2);
+            TEST_CHECK(pair.client.onFrame(BytesView(ack.data(), ack.size()), pair.now));
+            TEST_CHECK_EQ(pair.client.stats().mCongestionEvents, 0u);
+            TEST_CHECK_EQ(pair.client.inflight(), (uint64_t)pair.options.mMaxPayload * 9);
+
+            // 続けて2が届いても (mSackHigh = 3) まだ損失ではない. 3も届けば0が損失
+            Frame next = MakeAck(pair.client.connection(), 0, {{1, 3}}, 1);
+            TEST_CHECK(pair.client.onFrame(BytesView(next.data(), next.size()), pair.now));
+            TEST_CHECK_EQ(pair.client.stats().mCongestionEvents, 0u);
+            Frame third = MakeAck(pair.client.connection(), 0, {{1, 4}}, 1);
+            TEST_CHECK(pair.client.onFrame(BytesView(third.data(), third.size()), pair.now));
+            TEST_CHECK_EQ(pair.client.stats().mCongestionEvents, 1u);
+            TEST_CHECK_EQ(pair.client.inflight(), (uint64_t)pair.options.mMaxPayload * 6); // 4..9
+        }
+        // 確認済み(ack未満)の範囲と逆向きの範囲も無視
+        {
+            Pair pair;
+            TEST_CHECK(pair.handshake());
+            std::vector<Frame> sent;
+            SendTen(pair, &sent);
+            Frame ack = MakeAck(pair.client.connection(), 3, {{0, 2}, {9, 5}}, 2);
+            TEST_CHECK(pair.client.onFrame(BytesView(ack.data(), ack.size()), pair.now));
+            TEST_CHECK_EQ(pair.client.stats().mCongestionEvents, 0u);
+            TEST_CHECK_EQ(pair.client.inflight(), (uint64_t)pair.options.mMaxPayload * 7);
+            TEST_CHECK_EQ(pair.client.unacked(), 7u);
+        }
+    }
+
+    void TestMalformed()
+    {
+        Pair pair;
+        TEST_CHECK(pair.handshake());
+        std::vector<Frame> sent;
+        SendTen(pair, &sent);
+
+        Frame ack = MakeAck(pair.client.connection(), 0, {{1, 2}}, 1);
+        TEST_CHECK(!pair.client.onFrame(BytesView(ack.data(), is::net::kRudpHeaderSize - 1), pair.now)); // 短い
+        Frame other = MakeAck(pair.client.connection() + 1, 0, {{1, 2}}, 1);
+        TEST_CHECK(!pair.client.onFrame(BytesView(other.data(), other.size()), pair.now)); // 別の接続
+
+        // ブロック数がペイロードより多い: 読める所まで
+        Frame liar = MakeAck(pair.client.connection(), 0, {{1, 2}}, 1000);
+        TEST_CHECK(pair.client.onFrame(BytesView(liar.data(), liar.size()), pair.now));
+        TEST_CHECK_EQ(pair.client.inflight(), (uint64_t)pair.options.mMaxPayload * 9);
+        TEST_CHECK(!pair.client.aborted());
+    }
+} // namespace
+
+int main(int, char **)
+{
+    try
+    {
+        TestTransfer();
+        std::printf("[Done] Step1. transfer without loss\n");
+        TestTransferWithLoss();
+        std::printf("[Done] Step2. transfer with 10%% loss\n");
+        TestSackScoreboard();
+        std::printf("[Done] Step3. SACK scoreboard\n");
+        TestMalformed();
+        std::printf("[Done] Step4. malformed frames\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::printf("[Result] %d failures\n", TestFailures());
+    return TestFailures() == 0 ? 0 : 1;
+}
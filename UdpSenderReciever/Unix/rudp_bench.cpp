@@ -0,0 +1,353 @@
+/**
+ * @file rudp_bench.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief 一括転送のスループットをreliable_udp.hpp(NewReno/BBR風)とカーネルのTCPで比べる
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: rudp_bench [-m server|client] [-P rudp|tcp] [-a address=127.0.0.1] [-p port=54330]
+ *                   [-c newreno|bbr] [-b megabytes=64] [-l loss_percent=0] [-d delay_ms=0] [-s datagram_bytes=1400]
+ *
+ * 先にserver, 次にclientを同じ-P/-l/-dで起動する. clientは-bぶん送ってFINし, 両側のFINが終わるまでの時間で測る.
+ * serverは受け取ったバイト列の順序と内容(オフセット % 251)を確かめる.
+ *
+ * 損失と遅延
+ * + rudp: -l/-dを両側の送信にImpairedLinkで与える (往復の遅延は2 x delay, 損失は両方向).
+ * + tcp : アプリからは与えられない. tc netem を使う
+ *   (`tc qdisc add dev lo root netem delay 10ms loss 1%`, 終わったら `tc qdisc del dev lo root`).
+ */
+#include <test_utils.hpp>
+
+// udp, tcp
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h> // TCP_INFO
+#include <arpa/inet.h> // inet_pton, inet_ntop
+#include <netdb.h>
+
+#include <vector>
+
+#include <NetUtils/reliable_udp.hpp>
+
+struct BenchConfig
+{
+    bool mServer = true;
+    bool mTcp = false;
+    const char *mAddress = "127.0.0.1";
+    unsigned short mPort = 54330;
+    const char *mCongestion = "newreno";
+    uint64_t mBytes = 64ull << 20;
+    double mLossPercent = 0.0;
+    uint64_t mDelayMs = 0;
+    size_t mDatagram = 1400;
+};
+
+/* 送る内容: オフセット % 251 (251は素数なので64KiBの区切りとずれる) */
+static void FillPattern(uint8_t *data, size_t length, uint64_t offset)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        data[i] = (uint8_t)((offset + i) % 251);
+    }
+}
+
+static uint64_t CountMismatches(const uint8_t *data, size_t length, uint64_t offset)
+{
+    uint64_t mismatches = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        mismatches += data[i] != (uint8_t)((offset + i) % 251);
+    }
+    return mismatches;
+}
+
+static void PrintThroughput(const char *label, uint64_t bytes, uint64_t elapsed_ns)
+{
+    double seconds = (double)elapsed_ns / 1e9;
+    std::printf("[Result] %s: %llu bytes in %.3f s = %.1f Mbit/s\n",
+                label, (unsigned long long)bytes, seconds, seconds > 0 ? (double)bytes * 8 / seconds / 1e6 : 0.0);
+}
+
+static void PrintRudpStats(is::net::RudpSocket &stream)
+{
+    const is::net::RudpConnection &connection = stream.connection();
+    const is::net::RudpStats &stats = connection.stats();
+    std::printf("[Stats] %s: frames %llu, retransmits %llu (%.2f%%), rto %llu, recoveries %llu, acks %llu, dup %llu, injected drops %llu\n",
+                connection.congestion().name(),
+                (unsigned long long)stats.mFramesSent,
+                (unsigned long long)stats.mRetransmits,
+                stats.mFramesSent ? 100.0 * (double)stats.mRetransmits / (double)stats.mFramesSent : 0.0,
+                (unsigned long long)stats.mTimeouts,
+                (unsigned long long)stats.mCongestionEvents,
+                (unsigned long long)stats.mAcksSent,
+                (unsigned long long)stats.mDuplicates,
+                (unsigned long long)stream.link().dropped());
+    std::printf("[Stats] srtt %.1f us, min rtt %.1f us, rto %.1f ms, cwnd %llu bytes, pacing %.1f Mbit/s\n",
+                (double)connection.srttNs() / 1000.0,
+                (double)connection.minRttNs() / 1000.0,
+                (double)connection.rtoNs() / 1e6,
+                (unsigned long long)connection.congestion().cwnd(),
+                (double)connection.congestion().pacingRate() * 8 / 1e6);
+}
+
+#if defined(__linux__)
+static void PrintTcpInfo(int sock)
+{
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+    if (getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &length) == 0)
+    {
+        std::printf("[Stats] tcp: retransmits %u, srtt %u us, cwnd %u segments, mss %u\n",
+                    info.tcpi_total_retrans, info.tcpi_rtt, info.tcpi_snd_cwnd, info.tcpi_snd_mss);
+    }
+}
+#endif
+
+static void RunRudp(const BenchConfig &config, struct sockaddr_in *address)
+{
+    is::net::RudpOptions options;
+    options.mMaxPayload = config.mDatagram - is::net::kRudpHeaderSize;
+    std::unique_ptr<is::net::CongestionControl> control = is::net::MakeCongestionControl(config.mCongestion, options.mMaxPayload);
+    if (!control)
+    {
+        std::printf("[Error] unknown congestion control: %s\n", config.mCongestion);
+        throw std::runtime_error("congestion control");
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+        std::printf("[Error] %s\n", strerror(errno));
+        throw std::runtime_error("socket");
+    }
+    is::net::RudpSocket stream(sock, options, std::move(control));
+    stream.link().configure(config.mLossPercent / 100.0, config.mDelayMs * 1000000, (uint64_t)getpid());
+    std::vector<uint8_t> buf(1 << 16);
+
+    if (config.mServer)
+    {
+        if (bind(sock, (struct sockaddr *)address, sizeof(*address)) != 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("bind");
+        }
+        std::printf("[Done] Step1. accepting rudp client on port %u ...\n", config.mPort);
+        struct sockaddr_in client;
+        socklen_t length = sizeof(client);
+        if (stream.accept((struct sockaddr *)&client, &length) != 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("accept");
+        }
+        std::printf("[Done] Step2. accept (connection 0x%08x)\n", stream.connection().connection());
+
+        uint64_t start = is::net::MonotonicNs();
+        uint64_t received = 0, mismatches = 0;
+        ssize_t n;
+        while ((n = stream.read(buf.data(), buf.size())) > 0)
+        {
+            mismatches += CountMismatches(buf.data(), (size_t)n, received);
+            received += (uint64_t)n;
+        }
+        uint64_t elapsed = is::net::MonotonicNs() - start;
+        stream.close();
+        std::printf("[Done] Step3. received until FIN (%s)\n", n < 0 ? strerror(errno) : "ok");
+        PrintThroughput("rudp receive", received, elapsed);
+        std::printf("[Result] mismatched bytes %llu\n", (unsigned long long)mismatches);
+        PrintRudpStats(stream);
+    }
+    else
+    {
+        if (stream.connect((struct sockaddr *)address, sizeof(*address)) != 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("connect");
+        }
+        std::printf("[Done] Step1. connect (%s, connection 0x%08x)\n", config.mCongestion, stream.connection().connection());
+
+        uint64_t start = is::net::MonotonicNs();
+        uint64_t sent = 0;
+        while (sent < config.mBytes)
+        {
+            size_t chunk = (size_t)std::min<uint64_t>(buf.size(), config.mBytes - sent);
+            FillPattern(buf.data(), chunk, sent);
+            if (stream.write(buf.data(), chunk) < 0)
+            {
+                std::printf("[Error] %s\n", strerror(errno));
+                throw std::runtime_error("write");
+            }
+            sent += chunk;
+        }
+        int closed = stream.close(60000);
+        uint64_t elapsed = is::net::MonotonicNs() - start;
+        std::printf("[Done] Step2. sent and closed (%s)\n", closed == 0 ? "ok" : strerror(errno));
+        PrintThroughput("rudp send", sent, elapsed);
+        PrintRudpStats(stream);
+    }
+    close(sock);
+}
+
+static void RunTcp(const BenchConfig &config, struct sockaddr_in *address)
+{
+    if (config.mLossPercent > 0.0 || config.mDelayMs != 0)
+    {
+        std::printf("[Info] tcp: -l/-d are ignored. use `tc qdisc add dev lo root netem delay <ms>ms loss <percent>%%`\n");
+    }
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        std::printf("[Error] %s\n", strerror(errno));
+        throw std::runtime_error("socket");
+    }
+    std::vector<uint8_t> buf(1 << 16);
+
+    if (config.mServer)
+    {
+        int on = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(sock, (struct sockaddr *)address, sizeof(*address)) != 0 || listen(sock, 1) != 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("bind/listen");
+        }
+        std::printf("[Done] Step1. accepting tcp client on port %u ...\n", config.mPort);
+        int client = accept(sock, nullptr, nullptr);
+        if (client < 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("accept");
+        }
+        std::printf("[Done] Step2. accept\n");
+
+        uint64_t start = is::net::MonotonicNs();
+        uint64_t received = 0, mismatches = 0;
+        ssize_t n;
+        while ((n = read(client, buf.data(), buf.size())) > 0)
+        {
+            mismatches += CountMismatches(buf.data(), (size_t)n, received);
+            received += (uint64_t)n;
+        }
+        uint64_t elapsed = is::net::MonotonicNs() - start;
+        close(client);
+        std::printf("[Done] Step3. received until FIN\n");
+        PrintThroughput("tcp receive", received, elapsed);
+        std::printf("[Result] mismatched bytes %llu\n", (unsigned long long)mismatches);
+    }
+    else
+    {
+        if (connect(sock, (struct sockaddr *)address, sizeof(*address)) != 0)
+        {
+            std::printf("[Error] %s\n", strerror(errno));
+            throw std::runtime_error("connect");
+        }
+        std::printf("[Done] Step1. connect\n");
+
+        uint64_t start = is::net::MonotonicNs();
+        uint64_t sent = 0;
+        while (sent < config.mBytes)
+        {
+            size_t chunk = (size_t)std::min<uint64_t>(buf.size(), config.mBytes - sent);
+            FillPattern(buf.data(), chunk, sent);
+            for (size_t done = 0; done < chunk;)
+            {
+                ssize_t n = write(sock, buf.data() + done, chunk - done);
+                if (n < 0)
+                {
+                    std::printf("[Error] %s\n", strerror(errno));
+                    throw std::runtime_error("write");
+                }
+                done += (size_t)n;
+            }
+            sent += chunk;
+        }
+        // 相手が全部読んで閉じるまでを測る (rudpのcloseと揃える)
+        shutdown(sock, SHUT_WR);
+        while (read(sock, buf.data(), buf.size()) > 0)
+        {
+        }
+        uint64_t elapsed = is::net::MonotonicNs() - start;
+        std::printf("[Done] Step2. sent and closed\n");
+        PrintThroughput("tcp send", sent, elapsed);
+#if defined(__linux__)
+        PrintTcpInfo(sock);
+#endif
+    }
+    close(sock);
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        BenchConfig config;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            if (std::strcmp(argv[i], "-m") == 0)
+            {
+                config.mServer = std::strcmp(argv[i + 1], "client") != 0;
+            }
+            else if (std::strcmp(argv[i], "-P") == 0)
+            {
+                config.mTcp = std::strcmp(argv[i + 1], "tcp") == 0;
+            }
+            else if (std::strcmp(argv[i], "-a") == 0)
+            {
+                config.mAddress = argv[i + 1];
+            }
+            else if (std::strcmp(argv[i], "-p") == 0)
+            {
+                config.mPort = (unsigned short)std::atoi(argv[i + 1]);
+            }
+            else if (std::strcmp(argv[i], "-c") == 0)
+            {
+                config.mCongestion = argv[i + 1];
+            }
+            else if (std::strcmp(argv[i], "-b") == 0)
+            {
+                config.mBytes = std::strtoull(argv[i + 1], nullptr, 10) << 20;
+            }
+            else if (std::strcmp(argv[i], "-l") == 0)
+            {
+                config.mLossPercent = std::atof(argv[i + 1]);
+            }
+            else if (std::strcmp(argv[i], "-d") == 0)
+            {
+                config.mDelayMs = std::strtoull(argv[i + 1], nullptr, 10);
+            }
+            else if (std::strcmp(argv[i], "-s") == 0)
+            {
+                config.mDatagram = std::max<size_t>(std::strtoul(argv[i + 1], nullptr, 10), is::net::kRudpHeaderSize + 1);
+            }
+        }
+
+        struct sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(config.mPort);
+        if (inet_pton(AF_INET, config.mAddress, &address.sin_addr) != 1)
+        {
+            std::printf("[Error] not an IPv4 address: %s\n", config.mAddress);
+            throw std::runtime_error("address");
+        }
+        std::printf("[Status] %s %s, %s:%u, loss %.2f%%, delay %llu ms\n",
+                    config.mTcp ? "tcp" : "rudp", config.mServer ? "server" : "client",
+                    config.mAddress, config.mPort, config.mLossPercent, (unsigned long long)config.mDelayMs);
+
+        if (config.mTcp)
+        {
+            RunTcp(config, &address);
+        }
+        else
+        {
+            RunRudp(config, &address);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,320 @@
+/**
+ * @file socket_filter_test.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief classic BPFの組み立て(NetUtils/socket_filter.hpp)の単体テスト. ループバックのUDPソケットに付けて確かめる (Linux)
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: socket_filter_test
+ *
+ * + 全ての組み立て関数のプログラムをカーネルが受け付けるか (検証器を通るか)
+ * + UdpPayloadMagicFilter / SourcePrefixFilter / BpfAllOf で捨てる・通すパケット
+ * + ReuseportPayloadWordProgram: ペイロードの値 % ソケット数 の順番のソケットに届く
+ * + ReuseportSourceHashProgram: 同じ送信元は同じソケットに届く
+ * + ParsePrefix
+ */
+#include <test_utils.hpp>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <NetUtils/packet_view.hpp> // StoreBe32
+#include <NetUtils/socket_filter.hpp>
+
+#include "test_check.hpp"
+
+namespace
+{
+    // ループバックにbindしたUDPソケット. portが0なら空いている番号.
+    int BoundSocket(int family, uint16_t port, bool reuseport, uint16_t *bound_port)
+    {
+        int sock = socket(family, SOCK_DGRAM, 0);
+        if (sock < 0)
+        {
+            return -1;
+        }
+        int on = 1;
+        if (reuseport)
+        {
+            setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        }
+        struct sockaddr_storage address;
+        std::memset(&address, 0, sizeof(address));
+        socklen_t length;
+        if (family == AF_INET6)
+        {
+            struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&address;
+            in6->sin6_family = AF_INET6;
+            in6->sin6_addr = in6addr_loopback;
+            in6->sin6_port = htons(port);
+            length = sizeof(*in6);
+        }
+        else
+        {
+            struct sockaddr_in *in = (struct sockaddr_in *)&address;
+            in->sin_family = AF_INET;
+            in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            in->sin_port = htons(port);
+            length = sizeof(*in);
+        }
+        if (bind(sock, (struct sockaddr *)&address, length) != 0)
+        {
+            close(sock);
+            return -1;
+        }
+        getsockname(sock, (struct sockaddr *)&address, &length);
+        *bound_port = ntohs(family == AF_INET6 ? ((struct sockaddr_in6 *)&address)->sin6_port
+                                               : ((struct sockaddr_in *)&address)->sin_port);
+        return sock;
+    }
+
+    void SendTo(int sender, int family, uint16_t port, const std::string &payload)
+    {
+        struct sockaddr_storage address;
+        std::memset(&address, 0, sizeof(address));
+        socklen_t length;
+        if (family == AF_INET6)
+        {
+            struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&address;
+            in6->sin6_family = AF_INET6;
+            in6->sin6_addr = in6addr_loopback;
+            in6->sin6_port = htons(port);
+            length = sizeof(*in6);
+        }
+        else
+        {
+            struct sockaddr_in *in = (struct sockaddr_in *)&address;
+            in->sin_family = AF_INET;
+            in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            in->sin_port = htons(port);
+            length = sizeof(*in);
+        }
+        sendto(sender, payload.data(), payload.size(), 0, (struct sockaddr *)&address, length);
+    }
+
+    // 少し待って届いているものを全て読む
+    std::vector<std::string> Drain(int sock, int timeout_ms = 50)
+    {
+        std::vector<std::string> received;
+        struct pollfd pfd = {sock, POLLIN, 0};
+        while (poll(&pfd, 1, timeout_ms) > 0)
+        {
+            char buf[2048];
+            ssize_t n = recv(sock, buf, sizeof(buf), 0);
+            if (n < 0)
+            {
+                break;
+            }
+            received.emplace_back(buf, (size_t)n);
+            timeout_ms = 10;
+        }
+        return received;
+    }
+
+    void TestVerifier()
+    {
+        uint16_t port = 0;
+        int sock = BoundSocket(AF_INET, 0, false, &port);
+        TEST_CHECK(sock >= 0);
+        struct sockaddr_storage prefix;
+        int prefix_length = 0;
+        TEST_CHECK(is::net::ParsePrefix("2001:db8::/33", &prefix, &prefix_length));
+        std::vector<is::net::BpfProgram> programs = {
+            is::net::IcmpEchoReplyIdFilter(0x1234),
+            is::net::Icmp6EchoReplyIdFilter(0x1234),
+            is::net::UdpPayloadMagicFilter(0x52554431, 4),
+            is::net::SourcePrefixFilter((const struct sockaddr *)&prefix, prefix_length),
+            is::net::ReuseportCpuProgram(4),
+            is::net::ReuseportSourceHashProgram(AF_INET, 4),
+            is::net::ReuseportSourceHashProgram(AF_INET6, 4),
+            is::net::ReuseportPayloadWordProgram(12, 4),
+        };
+        for (size_t i = 0; i < programs.size(); ++i)
+        {
+            int result = is::net::AttachSocketFilter(sock, programs[i]);
+            if (result != 0)
+            {
+                std::printf("[Error] program %zu: %s\n", i, strerror(errno));
+            }
+            TEST_CHECK_EQ(result, 0);
+        }
+        is::net::BpfProgram joined = is::net::BpfAllOf({programs[2], programs[3]});
+        TEST_CHECK_EQ(joined.size(), programs[2].size() + programs[3].size());
+        TEST_CHECK_EQ(is::net::AttachSocketFilter(sock, joined), 0);
+        TEST_CHECK_EQ(is::net::DetachSocketFilter(sock), 0);
+        close(sock);
+    }
+
+    void TestReceiveFilters()
+    {
+        uint16_t port = 0;
+        int receiver = BoundSocket(AF_INET, 0, false, &port);
+        int sender = socket(AF_INET, SOCK_DGRAM, 0);
+        TEST_CHECK(receiver >= 0 && sender >= 0);
+
+        // 先頭4バイトが"TEST"
+        TEST_CHECK_EQ(is::net::AttachSocketFilter(receiver, is::net::UdpPayloadMagicFilter(0x54455354)), 0);
+        SendTo(sender, AF_INET, port, "XXXXhello");
+        SendTo(sender, AF_INET, port, "TESThello");
+        SendTo(sender, AF_INET, port, "TE"); // 短い
+        std::vector<std::string> received = Drain(receiver);
+        TEST_CHECK(received.size() == 1 && received[0] == "TESThello");
+
+        // 送信元の範囲 (ループバックは127.0.0.0/8)
+        struct sockaddr_storage prefix;
+        int prefix_length = 0;
+        TEST_CHECK(is::net::ParsePrefix("10.0.0.0/8", &prefix, &prefix_length));
+        TEST_CHECK_EQ(is::net::AttachSocketFilter(receiver, is::net::SourcePrefixFilter((const struct sockaddr *)&prefix, prefix_length)), 0);
+        SendTo(sender, AF_INET, port, "TESTfrom-loopback");
+        TEST_CHECK(Drain(receiver).empty());
+        TEST_CHECK(is::net::ParsePrefix("127.0.0.0/8", &prefix, &prefix_length));
+        is::net::BpfProgram loopback = is::net::SourcePrefixFilter((const struct sockaddr *)&prefix, prefix_length);
+        TEST_CHECK_EQ(is::net::AttachSocketFilter(receiver, loopback), 0);
+        SendTo(sender, AF_INET, port, "TESTfrom-loopback");
+        TEST_CHECK_EQ(Drain(receiver).size(), 1u);
+
+        // 両方
+        TEST_CHECK_EQ(is::net::AttachSocketFilter(receiver, is::net::BpfAllOf({is::net::UdpPayloadMagicFilter(0x54455354), loopback})), 0);
+        SendTo(sender, AF_INET, port, "XXXXhello");
+        SendTo(sender, AF_INET, port, "TESThello");
+        received = Drain(receiver);
+        TEST_CHECK(received.size() == 1 && received[0] == "TESThello");
+        close(receiver);
+        close(sender);
+
+        // IPv6: ::1/128
+        int receiver6 = BoundSocket(AF_INET6, 0, false, &port);
+        int sender6 = socket(AF_INET6, SOCK_DGRAM, 0);
+        if (receiver6 >= 0 && sender6 >= 0)
+        {
+            TEST_CHECK(is::net::ParsePrefix("::1", &prefix, &prefix_length));
+            TEST_CHECK_EQ(prefix_length, 128);
+            TEST_CHECK_EQ(is::net::AttachSocketFilter(receiver6, is::net::SourcePrefixFilter((const struct sockaddr *)&prefix, prefix_length)), 0);
+            SendTo(sender6, AF_INET6, port, "v6");
+            TEST_CHECK_EQ(Drain(receiver6).size(), 1u);
+            TEST_CHECK(is::net::ParsePrefix("2001:db8::/32", &prefix, &prefix_length));
+            TEST_CHECK_EQ(is::net::AttachSocketFilter(receiver6, is::net::SourcePrefixFilter((const struct sockaddr *)&prefix, prefix_length)), 0);
+            SendTo(sender6, AF_INET6, port, "v6");
+            TEST_CHECK(Drain(receiver6).empty());
+        }
+        else
+        {
+            std::printf("[Status] IPv6 loopback is not available, skipped\n");
+        }
+        if (receiver6 >= 0)
+        {
+            close(receiver6);
+        }
+        if (sender6 >= 0)
+        {
+            close(sender6);
+        }
+    }
+
+    void TestReuseport()
+    {
+        const int nsockets = 3;
+        uint16_t port = 0;
+        int sockets[nsockets];
+        sockets[0] = BoundSocket(AF_INET, 0, true, &port);
+        for (int i = 1; i < nsockets; ++i)
+        {
+            uint16_t same = 0;
+            sockets[i] = BoundSocket(AF_INET, port, true, &same);
+        }
+        int sender = socket(AF_INET, SOCK_DGRAM, 0);
+        for (int i = 0; i < nsockets; ++i)
+        {
+            TEST_CHECK(sockets[i] >= 0);
+        }
+
+        // ペイロードの4バイト目からの32bit % 3 の番号のソケットへ
+        TEST_CHECK_EQ(is::net::AttachReuseportProgram(sockets[0], is::net::ReuseportPayloadWordProgram(4, nsockets)), 0);
+        for (uint32_t value = 0; value < 12; ++value)
+        {
+            uint8_t payload[8] = {'W', 'O', 'R', 'D'};
+            is::net::StoreBe32(payload + 4, value * 1000003u);
+            SendTo(sender, AF_INET, port, std::string((const char *)payload, sizeof(payload)));
+        }
+        int misrouted = 0, total = 0;
+        for (int i = 0; i < nsockets; ++i)
+        {
+            for (const std::string &datagram : Drain(sockets[i]))
+            {
+                uint32_t value = is::net::BytesView((const uint8_t *)datagram.data(), datagram.size()).u32(4);
+                misrouted += (int)(value % nsockets) != i ? 1 : 0;
+                ++total;
+            }
+        }
+        TEST_CHECK_EQ(total, 12);
+        TEST_CHECK_EQ(misrouted, 0);
+
+        // 同じ送信元は全て同じソケットへ
+        TEST_CHECK_EQ(is::net::AttachReuseportProgram(sockets[0], is::net::ReuseportSourceHashProgram(AF_INET, nsockets)), 0);
+        for (int i = 0; i < 10; ++i)
+        {
+            SendTo(sender, AF_INET, port, "same source " + std::to_string(i));
+        }
+        int busy = 0;
+        total = 0;
+        for (int i = 0; i < nsockets; ++i)
+        {
+            size_t n = Drain(sockets[i]).size();
+            busy += n != 0 ? 1 : 0;
+            total += (int)n;
+        }
+        TEST_CHECK_EQ(total, 10);
+        TEST_CHECK_EQ(busy, 1);
+
+        for (int i = 0; i < nsockets; ++i)
+        {
+            close(sockets[i]);
+        }
+        close(sender);
+    }
+
+    void TestParsePrefix()
+    {
+        struct sockaddr_storage prefix;
+        int length = 0;
+        TEST_CHECK(is::net::ParsePrefix("192.0.2.1", &prefix, &length));
+        TEST_CHECK_EQ(length, 32);
+        TEST_CHECK_EQ(prefix.ss_family, AF_INET);
+        TEST_CHECK(is::net::ParsePrefix("10.0.0.0/8", &prefix, &length));
+        TEST_CHECK_EQ(length, 8);
+        TEST_CHECK(!is::net::ParsePrefix("10.0.0.0/33", &prefix, &length));
+        TEST_CHECK(!is::net::ParsePrefix("2001:db8::/129", &prefix, &length));
+        TEST_CHECK(!is::net::ParsePrefix("not-an-address", &prefix, &length));
+    }
+} // namespace
+
+int main(int, char **)
+{
+    try
+    {
+        TestVerifier();
+        std::printf("[Done] Step1. kernel accepts every program\n");
+        TestReceiveFilters();
+        std::printf("[Done] Step2. receive filters\n");
+        TestReuseport();
+        std::printf("[Done] Step3. SO_REUSEPORT steering\n");
+        TestParsePrefix();
+        std::printf("[Done] Step4. ParsePrefix\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::printf("[Result] %d failures\n", TestFailures());
+    return TestFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file test_check.hpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief NetUtilsの単体テスト(*_test.cpp)で使う最小限のチェックマクロ
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * 失敗しても止めずに[Error]を表示して数え, mainはTestFailures()を返す(0以外ならctestが失敗にする).
+ */
+#pragma once
+
+#include <cstdio>
+
+inline int &TestFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define TEST_CHECK(cond)                                                            \
+    do                                                                              \
+    {                                                                               \
+        if (!(cond))                                                                \
+        {                                                                           \
+            std::printf("[Error] %s:%d: TEST_CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            ++TestFailures();                                                       \
+        }                                                                           \
+    } while (0)
+
+#define TEST_CHECK_EQ(a, b)                                                                 \
+    do                                                                                      \
+    {                                                                                       \
+        auto test_a_ = (a);                                                                 \
+        auto test_b_ = (b);                                                                 \
+        if (!(test_a_ == test_b_))                                                          \
+        {                                                                                   \
+            std::printf("[Error] %s:%d: TEST_CHECK_EQ(%s, %s): %lld != %lld\n", __FILE__, __LINE__, \
+                        #a, #b, (long long)test_a_, (long long)test_b_);                    \
+            ++TestFailures();                                                               \
+        }                                                                                   \
+    } while (0)
@@ -0,0 +1,152 @@
+/**
+ * @file timer_wheel_test.cpp
+ * @author Shinichi Inoue (inoue.shinichi.1800@gmail.com)
+ * @brief ハッシュ化タイミングホイール(NetUtils/timer_wheel.hpp)の単体テスト
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * usage: timer_wheel_test
+ *
+ * + 期限より前には失効せず, 期限を過ぎた最初のadvance()で失効する
+ * + 1周(スロット数)より先の期限, 過去の期限, 何周も飛ばしたadvance()
+ * + コールバックの中からの再登録
+ * + 乱数で登録と前進を繰り返し, 単純な参照実装と失効の集合を比べる
+ */
+#include <test_utils.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <NetUtils/timer_wheel.hpp>
+
+#include "test_check.hpp"
+
+namespace
+{
+    struct Timer
+    {
+        int mId;
+        uint64_t mDeadline;
+    };
+
+    void TestBasic()
+    {
+        is::net::TimerWheel<Timer> wheel(8, 100);
+        wheel.schedule(105, Timer{1, 105});
+        wheel.schedule(110, Timer{2, 110});
+        wheel.schedule(130, Timer{3, 130}); // 8スロットの数周先
+        wheel.schedule(50, Timer{4, 101});  // 過去: 次のtickで
+        TEST_CHECK_EQ(wheel.size(), 4u);
+
+        std::vector<int> expired;
+        auto collect = [&expired](Timer &timer) { expired.push_back(timer.mId); };
+        TEST_CHECK_EQ(wheel.advance(101, collect), 1u);
+        TEST_CHECK(expired == std::vector<int>({4}));
+        TEST_CHECK_EQ(wheel.advance(104, collect), 0u);
+        TEST_CHECK_EQ(wheel.advance(105, collect), 1u);
+        TEST_CHECK_EQ(wheel.advance(105, collect), 0u); // 進んでいない
+        TEST_CHECK_EQ(wheel.advance(129, collect), 1u); // 110
+        TEST_CHECK_EQ(wheel.size(), 1u);
+        TEST_CHECK_EQ(wheel.advance(130, collect), 1u);
+        TEST_CHECK(expired == std::vector<int>({4, 1, 2, 3}));
+        TEST_CHECK(wheel.empty());
+        TEST_CHECK_EQ(wheel.now(), 130u);
+    }
+
+    void TestLongJump()
+    {
+        is::net::TimerWheel<Timer> wheel(16, 0);
+        for (int i = 1; i <= 100; ++i)
+        {
+            wheel.schedule((uint64_t)i * 7, Timer{i, (uint64_t)i * 7});
+        }
+        // 何周も飛ばすと期限を過ぎたものだけが失効する
+        size_t expired = wheel.advance(350, [](Timer &) {});
+        TEST_CHECK_EQ(expired, 50u);
+        TEST_CHECK_EQ(wheel.size(), 50u);
+        bool early = false;
+        wheel.advance(100000, [&early](Timer &timer) { early = early || timer.mDeadline <= 350; });
+        TEST_CHECK(!early);
+        TEST_CHECK(wheel.empty());
+    }
+
+    void TestReschedule()
+    {
+        // 失効の度に10tick先へ積み直す (ホイールの中からschedule)
+        is::net::TimerWheel<Timer> wheel(4, 0);
+        wheel.schedule(10, Timer{1, 10});
+        int fired = 0;
+        for (uint64_t now = 1; now <= 100; ++now)
+        {
+            wheel.advance(now, [&](Timer &timer) {
+                TEST_CHECK_EQ(timer.mDeadline, now);
+                ++fired;
+                wheel.schedule(now + 10, Timer{timer.mId, now + 10});
+            });
+        }
+        TEST_CHECK_EQ(fired, 10);
+        TEST_CHECK_EQ(wheel.size(), 1u);
+    }
+
+    void TestAgainstReference()
+    {
+        std::mt19937_64 random(5);
+        is::net::TimerWheel<Timer> wheel(64, 0);
+        std::multimap<uint64_t, int> reference;
+        uint64_t now = 0;
+        int next_id = 0;
+        int mismatches = 0;
+        for (int round = 0; round < 2000; ++round)
+        {
+            int adds = (int)(random() % 5);
+            for (int a = 0; a < adds; ++a)
+            {
+                uint64_t deadline = now + 1 + random() % 300; // 数周先まで
+                wheel.schedule(deadline, Timer{next_id, deadline});
+                reference.emplace(deadline, next_id);
+                ++next_id;
+            }
+            now += 1 + random() % (round % 100 == 0 ? 500 : 20); // ときどき大きく飛ばす
+            std::vector<int> expired;
+            wheel.advance(now, [&expired](Timer &timer) { expired.push_back(timer.mId); });
+            std::vector<int> expected;
+            for (auto it = reference.begin(); it != reference.end() && it->first <= now;)
+            {
+                expected.push_back(it->second);
+                it = reference.erase(it);
+            }
+            std::sort(expired.begin(), expired.end());
+            std::sort(expected.begin(), expected.end());
+            mismatches += expired != expected ? 1 : 0;
+        }
+        TEST_CHECK_EQ(mismatches, 0);
+        TEST_CHECK_EQ(wheel.size(), reference.size());
+    }
+} // namespace
+
+int main(int, char **)
+{
+    try
+    {
+        TestBasic();
+        std::printf("[Done] Step1. expiry ticks\n");
+        TestLongJump();
+        std::printf("[Done] Step2. advancing over many rotations\n");
+        TestReschedule();
+        std::printf("[Done] Step3. rescheduling from the callback\n");
+        TestAgainstReference();
+        std::printf("[Done] Step4. random schedule/advance against a reference\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::printf("[Result] %d failures\n", TestFailures());
+    return TestFailures() == 0 ? 0 : 1;
+}